@@ -227,6 +227,7 @@ ASTNode *createArrayAccessNode(ASTNode *array, ASTNode *index){
 
     node->arrayAccess.array = array;
     node->arrayAccess.index = index;
+    node->arrayAccess.inBounds = false;
     return node;
 }
 
@@ -280,6 +281,7 @@ ASTNode *createFunctionNode(char *name, ASTNode *returnType, ASTNode **params, i
     }
     node->functionDef.bodyCount = bodyCount;
     node->functionDef.storageFlags = storageFlags;
+    node->functionDef.purity = PURITY_UNKNOWN;
     return node;
 }
 
@@ -306,6 +308,7 @@ ASTNode *createFunctionCallNode(ASTNode *function, ASTNode **args, int argsCount
         node->functionCall.args[i] = args[i];
     }
     node->functionCall.argsCount = argsCount;
+    node->functionCall.isTailCall = false;
     return node;
 }
 
@@ -338,6 +341,7 @@ ASTNode *createMallocExprNode(ASTNode *size){
     if(!node) return NULL;
 
     node->mallocExpr.size = size;
+    node->mallocExpr.placement = ALLOC_HEAP;
     return node;
 }
 
@@ -347,6 +351,7 @@ ASTNode *createCallocExprNode(ASTNode *num, ASTNode *size){
 
     node->callocExpr.num = num;
     node->callocExpr.size = size;
+    node->callocExpr.placement = ALLOC_HEAP;
     return node;
 }
 
@@ -364,6 +369,7 @@ ASTNode *createFreeExprNode(ASTNode *ptr){
     if(!node) return NULL;
 
     node->freeExpr.ptr = ptr;
+    node->freeExpr.elided = false;
     return node;
 }
 
@@ -585,6 +591,8 @@ ASTNode *createForStmtNode(ASTNode *initializer, ASTNode *condition, ASTNode *in
     }
 
     node->forStmt.bodyCount = bodyCount;
+    node->forStmt.tripCount = -1;
+    node->forStmt.parallel = false;
     return node;
 }
 
@@ -967,4 +975,436 @@ void freeAST(ASTNode *node){
             break;
     }
     free(node);
-}
\ No newline at end of file
+}
+
+#define VISIT(child) visit(&(child), ctx)
+#define VISIT_LIST(list, count) for(int i = 0; i < (count); i++) visit(&(list)[i], ctx)
+
+void forEachChild(ASTNode *node, void (*visit)(ASTNode **child, void *ctx), void *ctx){
+    if(!node) return;
+
+    switch(node->type){
+        case ASSIGNMENT_NODE:
+            VISIT(node->assignment.left);
+            VISIT(node->assignment.right);
+            break;
+        case DECLARATION_NODE:
+            VISIT(node->declaration.varType);
+            VISIT(node->declaration.initializer);
+            break;
+        case POINTER_NODE:
+            VISIT(node->pointer.ptr);
+            break;
+        case NULL_NODE:
+            VISIT(node->null.typeOf);
+            break;
+        case ARRAY_NODE:
+            VISIT(node->array.typeOfElement);
+            VISIT(node->array.size);
+            VISIT_LIST(node->array.elements, node->array.elementsCount);
+            break;
+        case STRUCT_NODE:
+            VISIT_LIST(node->structDef.fields, node->structDef.fieldsCount);
+            break;
+        case UNION_NODE:
+            VISIT_LIST(node->unionDef.fields, node->unionDef.fieldsCount);
+            break;
+        case TYPEDEF_NODE:
+            VISIT(node->typedefDef.original);
+            break;
+        case IMPL_NODE:
+            VISIT_LIST(node->implDef.methods, node->implDef.methodsCount);
+            break;
+        case ARRAY_ACCESS_NODE:
+            VISIT(node->arrayAccess.array);
+            VISIT(node->arrayAccess.index);
+            break;
+        case FIELD_ACCESS_NODE:
+            VISIT(node->fieldAccess.object);
+            break;
+        case FUNCTION_NODE:
+            VISIT(node->functionDef.returnType);
+            VISIT_LIST(node->functionDef.params, node->functionDef.paramCount);
+            VISIT_LIST(node->functionDef.body, node->functionDef.bodyCount);
+            break;
+        case RETURN_NODE:
+            VISIT(node->returnStmt.value);
+            break;
+        case FUNCTION_CALL_NODE:
+            VISIT(node->functionCall.function);
+            VISIT_LIST(node->functionCall.args, node->functionCall.argsCount);
+            break;
+        case MALLOC_NODE:
+            VISIT(node->mallocExpr.size);
+            break;
+        case CALLOC_NODE:
+            VISIT(node->callocExpr.num);
+            VISIT(node->callocExpr.size);
+            break;
+        case REALLOC_NODE:
+            VISIT(node->reallocExpr.ptr);
+            VISIT(node->reallocExpr.size);
+            break;
+        case FREE_NODE:
+            VISIT(node->freeExpr.ptr);
+            break;
+        case MEMCPY_NODE:
+            VISIT(node->memcpyExpr.dest);
+            VISIT(node->memcpyExpr.src);
+            VISIT(node->memcpyExpr.size);
+            break;
+        case MEMSET_NODE:
+            VISIT(node->memsetExpr.dest);
+            VISIT(node->memsetExpr.value);
+            VISIT(node->memsetExpr.size);
+            break;
+        case MEMMOVE_NODE:
+            VISIT(node->memmoveExpr.dest);
+            VISIT(node->memmoveExpr.src);
+            VISIT(node->memmoveExpr.size);
+            break;
+        case UNARY_OPERATION_NODE:
+            VISIT(node->unaryOp.expr);
+            break;
+        case BINARY_OPERATION_NODE:
+            VISIT(node->binaryOp.left);
+            VISIT(node->binaryOp.right);
+            break;
+        case TERNARY_OPERATION_NODE:
+            VISIT(node->ternaryOp.condition);
+            VISIT(node->ternaryOp.trueExpr);
+            VISIT(node->ternaryOp.falseExpr);
+            break;
+        case BLOCK_NODE:
+            VISIT_LIST(node->block.statements, node->block.stmtCount);
+            break;
+        case COMPOUND_EXPR_NODE:
+            VISIT_LIST(node->compoundExpr.statements, node->compoundExpr.stmtCount);
+            break;
+        case CAST_EXPR_NODE:
+            VISIT(node->castExpr.targetType);
+            VISIT(node->castExpr.value);
+            break;
+        case IF_NODE:
+            VISIT(node->ifStmt.condition);
+            VISIT(node->ifStmt.thenBranch);
+            VISIT(node->ifStmt.elseBranch);
+            break;
+        case SWITCH_NODE:
+            VISIT(node->switchStmt.expr);
+            VISIT_LIST(node->switchStmt.cases, node->switchStmt.caseCount);
+            break;
+        case CASE_NODE:
+            VISIT(node->caseStmt.value);
+            VISIT_LIST(node->caseStmt.body, node->caseStmt.bodyCount);
+            break;
+        case DEFAULT_NODE:
+            VISIT_LIST(node->defaultStmt.body, node->defaultStmt.bodyCount);
+            break;
+        case WHILE_NODE:
+            VISIT(node->whileStmt.condition);
+            VISIT_LIST(node->whileStmt.body, node->whileStmt.bodyCount);
+            break;
+        case DO_WHILE_NODE:
+            VISIT_LIST(node->doWhileStmt.body, node->doWhileStmt.bodyCount);
+            VISIT(node->doWhileStmt.condition);
+            break;
+        case FOR_NODE:
+            VISIT(node->forStmt.initializer);
+            VISIT(node->forStmt.condition);
+            VISIT(node->forStmt.increment);
+            VISIT_LIST(node->forStmt.body, node->forStmt.bodyCount);
+            break;
+        case TRY_NODE:
+            VISIT_LIST(node->tryStmt.tryBlock, node->tryStmt.tryBlockCount);
+            VISIT_LIST(node->tryStmt.catchBlock, node->tryStmt.catchCount);
+            break;
+        case CATCH_NODE:
+            VISIT(node->catchStmt.exceptionVar);
+            VISIT_LIST(node->catchStmt.body, node->catchStmt.bodyCount);
+            break;
+        case THROW_NODE:
+            VISIT(node->throwStmt.exceptionExpr);
+            break;
+        case TYPEOF_NODE:
+            VISIT(node->typeOfExpr.expr);
+            break;
+        case SIZEOF_NODE:
+            VISIT(node->sizeOfExpr.expr);
+            break;
+        case LAMBDA_NODE:
+            VISIT(node->lambda.returnType);
+            VISIT_LIST(node->lambda.params, node->lambda.paramCount);
+            VISIT_LIST(node->lambda.body, node->lambda.bodyCount);
+            break;
+        default:
+            break;
+    }
+}
+
+#undef VISIT
+#undef VISIT_LIST
+
+static void countChild(ASTNode **child, void *ctx){
+    *(int *)ctx += countASTNodes(*child);
+}
+
+int countASTNodes(ASTNode *node){
+    if(!node) return 0;
+
+    int count = 1;
+    forEachChild(node, countChild, &count);
+    return count;
+}
+
+static ASTNode **cloneList(ASTNode **list, int count){
+    ASTNode **copy = malloc((count > 0 ? count : 1) * sizeof(ASTNode *));
+    if(!copy) return NULL;
+
+    for(int i = 0; i < count; i++){
+        copy[i] = NULL;
+        if(list[i] && !(copy[i] = cloneAST(list[i]))){
+            for(int k = 0; k < i; k++){
+                freeAST(copy[k]);
+            }
+            free(copy);
+            return NULL;
+        }
+    }
+    return copy;
+}
+
+#define CLONE(field) if(node->field && !(copy->field = cloneAST(node->field))) goto fail
+#define CLONE_STRING(field) if(node->field && !(copy->field = strdup(node->field))) goto fail
+#define CLONE_LIST(list, count) \
+    if(!(copy->list = cloneList(node->list, node->count))) goto fail; \
+    copy->count = node->count
+
+// Deep copy; returns NULL when out of memory.
+ASTNode *cloneAST(ASTNode *node){
+    if(!node) return NULL;
+
+    ASTNode *copy = calloc(1, sizeof(ASTNode));
+    if(!copy) return NULL;
+    copy->type = node->type;
+
+    switch(node->type){
+        case IDENTIFIER_NODE:
+            CLONE_STRING(identifier.name);
+            break;
+        case LITERAL_NODE:
+            copy->literal = node->literal;
+            if(node->literal.type == TYPE_STRING){
+                copy->literal.value.stringVal = NULL;
+                CLONE_STRING(literal.value.stringVal);
+            }
+            break;
+        case ASSIGNMENT_NODE:
+            copy->assignment.op = node->assignment.op;
+            CLONE(assignment.left);
+            CLONE(assignment.right);
+            break;
+        case DECLARATION_NODE:
+            copy->declaration.storageFlags = node->declaration.storageFlags;
+            CLONE_STRING(declaration.varName);
+            CLONE(declaration.varType);
+            CLONE(declaration.initializer);
+            break;
+        case POINTER_NODE:
+            CLONE(pointer.ptr);
+            break;
+        case NULL_NODE:
+            CLONE(null.typeOf);
+            break;
+        case ARRAY_NODE:
+            CLONE(array.typeOfElement);
+            CLONE(array.size);
+            CLONE_LIST(array.elements, array.elementsCount);
+            break;
+        case STRUCT_NODE:
+            CLONE_STRING(structDef.name);
+            CLONE_LIST(structDef.fields, structDef.fieldsCount);
+            break;
+        case UNION_NODE:
+            CLONE_STRING(unionDef.name);
+            CLONE_LIST(unionDef.fields, unionDef.fieldsCount);
+            break;
+        case ENUM_NODE: {
+            int count = node->enumDef.valuesCount;
+            CLONE_STRING(enumDef.name);
+            copy->enumDef.values = calloc(count > 0 ? count : 1, sizeof(char *));
+            copy->enumDef.intValues = malloc((count > 0 ? count : 1) * sizeof(int));
+            if(!copy->enumDef.values || !copy->enumDef.intValues) goto fail;
+            copy->enumDef.valuesCount = count;
+            for(int i = 0; i < count; i++){
+                copy->enumDef.intValues[i] = node->enumDef.intValues[i];
+                CLONE_STRING(enumDef.values[i]);
+            }
+            break;
+        }
+        case TYPEDEF_NODE:
+            CLONE_STRING(typedefDef.alias);
+            CLONE(typedefDef.original);
+            break;
+        case IMPL_NODE:
+            CLONE_STRING(implDef.structName);
+            CLONE_LIST(implDef.methods, implDef.methodsCount);
+            break;
+        case ARRAY_ACCESS_NODE:
+            copy->arrayAccess.inBounds = node->arrayAccess.inBounds;
+            CLONE(arrayAccess.array);
+            CLONE(arrayAccess.index);
+            break;
+        case FIELD_ACCESS_NODE:
+            copy->fieldAccess.isPointerAccess = node->fieldAccess.isPointerAccess;
+            CLONE(fieldAccess.object);
+            CLONE_STRING(fieldAccess.fieldName);
+            break;
+        case FUNCTION_NODE:
+            copy->functionDef.storageFlags = node->functionDef.storageFlags;
+            copy->functionDef.purity = node->functionDef.purity;
+            CLONE_STRING(functionDef.name);
+            CLONE(functionDef.returnType);
+            CLONE_LIST(functionDef.params, functionDef.paramCount);
+            CLONE_LIST(functionDef.body, functionDef.bodyCount);
+            break;
+        case RETURN_NODE:
+            CLONE(returnStmt.value);
+            break;
+        case FUNCTION_CALL_NODE:
+            copy->functionCall.isTailCall = node->functionCall.isTailCall;
+            CLONE(functionCall.function);
+            CLONE_LIST(functionCall.args, functionCall.argsCount);
+            break;
+        case LABEL_NODE:
+            CLONE_STRING(labelStmt.labelName);
+            break;
+        case JUMP_NODE:
+            CLONE_STRING(jumpStmt.labelName);
+            break;
+        case MALLOC_NODE:
+            CLONE(mallocExpr.size);
+            copy->mallocExpr.placement = node->mallocExpr.placement;
+            break;
+        case CALLOC_NODE:
+            CLONE(callocExpr.num);
+            CLONE(callocExpr.size);
+            copy->callocExpr.placement = node->callocExpr.placement;
+            break;
+        case REALLOC_NODE:
+            CLONE(reallocExpr.ptr);
+            CLONE(reallocExpr.size);
+            break;
+        case FREE_NODE:
+            CLONE(freeExpr.ptr);
+            copy->freeExpr.elided = node->freeExpr.elided;
+            break;
+        case MEMCPY_NODE:
+            CLONE(memcpyExpr.dest);
+            CLONE(memcpyExpr.src);
+            CLONE(memcpyExpr.size);
+            break;
+        case MEMSET_NODE:
+            CLONE(memsetExpr.dest);
+            CLONE(memsetExpr.value);
+            CLONE(memsetExpr.size);
+            break;
+        case MEMMOVE_NODE:
+            CLONE(memmoveExpr.dest);
+            CLONE(memmoveExpr.src);
+            CLONE(memmoveExpr.size);
+            break;
+        case UNARY_OPERATION_NODE:
+            copy->unaryOp.op = node->unaryOp.op;
+            CLONE(unaryOp.expr);
+            break;
+        case BINARY_OPERATION_NODE:
+            copy->binaryOp.op = node->binaryOp.op;
+            CLONE(binaryOp.left);
+            CLONE(binaryOp.right);
+            break;
+        case TERNARY_OPERATION_NODE:
+            CLONE(ternaryOp.condition);
+            CLONE(ternaryOp.trueExpr);
+            CLONE(ternaryOp.falseExpr);
+            break;
+        case BLOCK_NODE:
+            CLONE_LIST(block.statements, block.stmtCount);
+            break;
+        case COMPOUND_EXPR_NODE:
+            CLONE_LIST(compoundExpr.statements, compoundExpr.stmtCount);
+            break;
+        case CAST_EXPR_NODE:
+            CLONE(castExpr.targetType);
+            CLONE(castExpr.value);
+            break;
+        case IF_NODE:
+            CLONE(ifStmt.condition);
+            CLONE(ifStmt.thenBranch);
+            CLONE(ifStmt.elseBranch);
+            break;
+        case SWITCH_NODE:
+            CLONE(switchStmt.expr);
+            CLONE_LIST(switchStmt.cases, switchStmt.caseCount);
+            break;
+        case CASE_NODE:
+            CLONE(caseStmt.value);
+            CLONE_LIST(caseStmt.body, caseStmt.bodyCount);
+            break;
+        case DEFAULT_NODE:
+            CLONE_LIST(defaultStmt.body, defaultStmt.bodyCount);
+            break;
+        case WHILE_NODE:
+            CLONE(whileStmt.condition);
+            CLONE_LIST(whileStmt.body, whileStmt.bodyCount);
+            break;
+        case DO_WHILE_NODE:
+            CLONE_LIST(doWhileStmt.body, doWhileStmt.bodyCount);
+            CLONE(doWhileStmt.condition);
+            break;
+        case FOR_NODE:
+            copy->forStmt.tripCount = node->forStmt.tripCount;
+            copy->forStmt.parallel = node->forStmt.parallel;
+            CLONE(forStmt.initializer);
+            CLONE(forStmt.condition);
+            CLONE(forStmt.increment);
+            CLONE_LIST(forStmt.body, forStmt.bodyCount);
+            break;
+        case TRY_NODE:
+            CLONE_LIST(tryStmt.tryBlock, tryStmt.tryBlockCount);
+            CLONE_LIST(tryStmt.catchBlock, tryStmt.catchCount);
+            break;
+        case CATCH_NODE:
+            CLONE(catchStmt.exceptionVar);
+            CLONE_LIST(catchStmt.body, catchStmt.bodyCount);
+            break;
+        case THROW_NODE:
+            CLONE(throwStmt.exceptionExpr);
+            break;
+        case TYPEOF_NODE:
+            CLONE(typeOfExpr.expr);
+            break;
+        case SIZEOF_NODE:
+            CLONE(sizeOfExpr.expr);
+            break;
+        case LAMBDA_NODE:
+            CLONE(lambda.returnType);
+            CLONE_LIST(lambda.params, lambda.paramCount);
+            CLONE_LIST(lambda.body, lambda.bodyCount);
+            break;
+        case INCLUDE_NODE:
+            CLONE_STRING(include.libName);
+            break;
+        default:
+            break;
+    }
+    return copy;
+
+fail:
+    freeAST(copy);
+    return NULL;
+}
+
+#undef CLONE
+#undef CLONE_STRING
+#undef CLONE_LIST
@@ -2,6 +2,7 @@
 #define AST_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef enum {
     TYPE_BYTE,
@@ -112,6 +113,19 @@ typedef enum {
     STORAGE_ATOMIC = 1 << 4
 } StorageFlags;
 
+typedef enum {
+    ALLOC_HEAP,
+    ALLOC_STACK,        // fixed size, released when the function returns
+    ALLOC_REGION        // released at the end of the enclosing loop iteration or call
+} AllocationKind;
+
+typedef enum {
+    PURITY_UNKNOWN,
+    PURITY_IMPURE,
+    PURITY_PURE,            // no side effects, the result depends only on the arguments
+    PURITY_MEMOIZABLE       // pure with primitive parameters and result
+} Purity;
+
 typedef enum {
     IDENTIFIER_NODE,
     LITERAL_NODE,
@@ -255,6 +269,7 @@ typedef struct ASTNode {
         struct {
             ASTNode *array;
             ASTNode *index;
+            bool inBounds;          // the index is proven within the array's length
         } arrayAccess;
 
         struct {
@@ -271,6 +286,7 @@ typedef struct ASTNode {
             ASTNode **body;
             int bodyCount;
             int storageFlags;
+            Purity purity;
         } functionDef;
 
         struct {
@@ -281,6 +297,7 @@ typedef struct ASTNode {
             ASTNode *function;
             ASTNode **args;
             int argsCount;
+            bool isTailCall;        // the caller's frame can be reused for the call
         } functionCall;
 
         struct {
@@ -293,11 +310,13 @@ typedef struct ASTNode {
 
         struct {
             ASTNode *size;
+            AllocationKind placement;
         } mallocExpr;
 
         struct {
             ASTNode *num;
             ASTNode *size;
+            AllocationKind placement;
         } callocExpr;
 
         struct {
@@ -307,6 +326,7 @@ typedef struct ASTNode {
 
         struct {
             ASTNode *ptr;
+            bool elided;        // frees a demoted allocation and does nothing
         } freeExpr;
 
         struct {
@@ -400,6 +420,8 @@ typedef struct ASTNode {
             ASTNode *increment;
             ASTNode **body;
             int bodyCount;
+            long long tripCount;        // iterations when run to completion, -1 if unknown
+            bool parallel;              // iterations are independent and may run on any thread
         } forStmt;
 
         struct {
@@ -493,5 +515,8 @@ ASTNode *createSizeOfExprNode(ASTNode *expr);
 ASTNode *createLambdaNode(ASTNode *returnType, ASTNode **params, int paramCount, ASTNode **body, int bodyCount);
 ASTNode *createImportNode(char *libName);
 void freeAST(ASTNode *node);
+void forEachChild(ASTNode *node, void (*visit)(ASTNode **child, void *ctx), void *ctx);
+int countASTNodes(ASTNode *node);
+ASTNode *cloneAST(ASTNode *node);
 
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
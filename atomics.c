@@ -0,0 +1,180 @@
+#include "atomics.h"
+#include "primitive.h"
+#include <stdatomic.h>
+
+// A slot is 64 bits whatever it holds, so it doubles as an atomic integer.
+_Static_assert(sizeof(VMValue) == sizeof(_Atomic int64_t), "VMValue and _Atomic int64_t differ in size");
+
+static _Atomic int64_t *atomicCell(VMValue *slot){
+    return (_Atomic int64_t *)&slot->i;
+}
+
+bool atomicKindOf(PrimitiveType type, AtomicKind *kind){
+    if(type == TYPE_FLOAT || type == TYPE_DOUBLE){
+        *kind = type == TYPE_FLOAT ? ATOMIC_F32 : ATOMIC_F64;
+        return true;
+    }
+    if(!isIntegerType(type)) return false;
+    bool isSigned = isSignedType(type);
+    switch(primitiveSize(type)){
+        case 1: *kind = isSigned ? ATOMIC_I8 : ATOMIC_U8; return true;
+        case 2: *kind = isSigned ? ATOMIC_I16 : ATOMIC_U16; return true;
+        case 4: *kind = isSigned ? ATOMIC_I32 : ATOMIC_U32; return true;
+        case 8: *kind = isSigned ? ATOMIC_I64 : ATOMIC_U64; return true;
+        default: return false;
+    }
+}
+
+static bool isFloatingKind(AtomicKind kind){
+    return kind == ATOMIC_F32 || kind == ATOMIC_F64;
+}
+
+static bool isSignedKind(AtomicKind kind){
+    return kind == ATOMIC_I8 || kind == ATOMIC_I16 || kind == ATOMIC_I32 || kind == ATOMIC_I64;
+}
+
+static int kindWidth(AtomicKind kind){
+    static const int widths[ATOMIC_KIND_COUNT] = {8, 8, 16, 16, 32, 32, 64, 64, 32, 64};
+    return widths[kind];
+}
+
+static bool isFetch(AtomicOp op){
+    return op == ATOMIC_FETCH_ADD || op == ATOMIC_FETCH_SUB;
+}
+
+bool validAtomicOperation(int operation){
+    if(operation < 0 || operation > UINT8_MAX) return false;
+    AtomicOp op = ATOMIC_OPERATION_OP(operation);
+    AtomicKind kind = ATOMIC_OPERATION_KIND(operation);
+    if(op >= ATOMIC_OP_COUNT || kind >= ATOMIC_KIND_COUNT) return false;
+    if(!isFloatingKind(kind)) return true;
+    return op == ATOMIC_ADD || op == ATOMIC_SUB || op == ATOMIC_MUL || op == ATOMIC_DIV || isFetch(op);
+}
+
+const char *atomicOpName(AtomicOp op){
+    static const char *const names[ATOMIC_OP_COUNT] = {
+        "add", "sub", "mul", "div", "mod", "and", "or", "xor", "shl", "shr", "fetch_add", "fetch_sub"
+    };
+    return op < ATOMIC_OP_COUNT ? names[op] : "?";
+}
+
+const char *atomicKindName(AtomicKind kind){
+    static const char *const names[ATOMIC_KIND_COUNT] = {"i8", "u8", "i16", "u16", "i32", "u32", "i64", "u64", "f32", "f64"};
+    return kind < ATOMIC_KIND_COUNT ? names[kind] : "?";
+}
+
+const char *atomicStatusMessage(AtomicStatus status){
+    switch(status){
+        case ATOMIC_DIVISION_BY_ZERO: return "division by zero";
+        case ATOMIC_INVALID_SHIFT: return "invalid shift count";
+        default: return "ok";
+    }
+}
+
+VMValue atomicLoad(VMValue *slot){
+    VMValue value;
+    value.i = atomic_load(atomicCell(slot));
+    return value;
+}
+
+void atomicStore(VMValue *slot, VMValue value){
+    atomic_store(atomicCell(slot), value.i);
+}
+
+// Brings a result computed in 64 bits back to how the kind is held, as the
+// WRAP instructions and FROUND do.
+static VMValue wrapKind(AtomicKind kind, VMValue value){
+    switch(kind){
+        case ATOMIC_I8: value.i = (int8_t)value.u; break;
+        case ATOMIC_U8: value.u = (uint8_t)value.u; break;
+        case ATOMIC_I16: value.i = (int16_t)value.u; break;
+        case ATOMIC_U16: value.u = (uint16_t)value.u; break;
+        case ATOMIC_I32: value.i = (int32_t)value.u; break;
+        case ATOMIC_U32: value.u = (uint32_t)value.u; break;
+        case ATOMIC_F32: value.f = (float)value.f; break;
+        default: break;
+    }
+    return value;
+}
+
+static AtomicStatus applyAtomic(AtomicOp op, AtomicKind kind, VMValue old, VMValue operand, VMValue *out){
+    VMValue value;
+    if(isFloatingKind(kind)){
+        switch(op){
+            case ATOMIC_ADD:
+            case ATOMIC_FETCH_ADD: value.f = old.f + operand.f; break;
+            case ATOMIC_SUB:
+            case ATOMIC_FETCH_SUB: value.f = old.f - operand.f; break;
+            case ATOMIC_MUL: value.f = old.f * operand.f; break;
+            default: value.f = old.f / operand.f; break;
+        }
+        *out = wrapKind(kind, value);
+        return ATOMIC_OK;
+    }
+
+    bool isSigned = isSignedKind(kind);
+    switch(op){
+        case ATOMIC_ADD:
+        case ATOMIC_FETCH_ADD: value.u = old.u + operand.u; break;
+        case ATOMIC_SUB:
+        case ATOMIC_FETCH_SUB: value.u = old.u - operand.u; break;
+        case ATOMIC_MUL: value.u = old.u * operand.u; break;
+        case ATOMIC_DIV:
+            if(operand.u == 0) return ATOMIC_DIVISION_BY_ZERO;
+            // MIN / -1 wraps to MIN as DIV_I does
+            if(isSigned) value.i = operand.i == -1 ? (int64_t)(0 - old.u) : old.i / operand.i;
+            else value.u = old.u / operand.u;
+            break;
+        case ATOMIC_MOD:
+            if(operand.u == 0) return ATOMIC_DIVISION_BY_ZERO;
+            if(isSigned) value.i = operand.i == -1 ? 0 : old.i % operand.i;
+            else value.u = old.u % operand.u;
+            break;
+        case ATOMIC_AND: value.u = old.u & operand.u; break;
+        case ATOMIC_OR: value.u = old.u | operand.u; break;
+        case ATOMIC_XOR: value.u = old.u ^ operand.u; break;
+        case ATOMIC_SHL:
+        case ATOMIC_SHR:
+            if(operand.i < 0 || operand.i >= kindWidth(kind)) return ATOMIC_INVALID_SHIFT;
+            if(op == ATOMIC_SHL) value.u = old.u << operand.i;
+            else if(isSigned) value.i = old.i >> operand.i;
+            else value.u = old.u >> operand.i;
+            break;
+        default:
+            value = old;
+            break;
+    }
+    *out = wrapKind(kind, value);
+    return ATOMIC_OK;
+}
+
+AtomicStatus atomicUpdate(VMValue *slot, uint8_t operation, VMValue operand, VMValue *result){
+    AtomicOp op = ATOMIC_OPERATION_OP(operation);
+    AtomicKind kind = ATOMIC_OPERATION_KIND(operation);
+    _Atomic int64_t *cell = atomicCell(slot);
+    bool wide = kind == ATOMIC_I64 || kind == ATOMIC_U64;
+    VMValue old, next;
+
+    // bitwise results stay sign or zero extended at any width, and 64-bit
+    // sums need no wrapping, so the hardware does those in one instruction
+    bool fetched = true;
+    if(op == ATOMIC_AND) old.i = atomic_fetch_and(cell, operand.i);
+    else if(op == ATOMIC_OR) old.i = atomic_fetch_or(cell, operand.i);
+    else if(op == ATOMIC_XOR) old.i = atomic_fetch_xor(cell, operand.i);
+    else if(wide && (op == ATOMIC_ADD || op == ATOMIC_FETCH_ADD)) old.i = atomic_fetch_add(cell, operand.i);
+    else if(wide && (op == ATOMIC_SUB || op == ATOMIC_FETCH_SUB)) old.i = atomic_fetch_sub(cell, operand.i);
+    else fetched = false;
+    if(fetched){
+        if(isFetch(op)) *result = old;
+        else applyAtomic(op, kind, old, operand, result);
+        return ATOMIC_OK;
+    }
+
+    old.i = atomic_load_explicit(cell, memory_order_relaxed);
+    do{
+        AtomicStatus status = applyAtomic(op, kind, old, operand, &next);
+        if(status != ATOMIC_OK) return status;
+    } while(!atomic_compare_exchange_weak(cell, &old.i, next.i));
+    *result = isFetch(op) ? old : next;
+    return ATOMIC_OK;
+}
@@ -0,0 +1,69 @@
+#ifndef ATOMICS_H
+#define ATOMICS_H
+
+#include "bytecode.h"
+#include <stdint.h>
+
+// Updates a compound assignment to an atomic global makes in one step; the
+// fetch forms give the value from before the update, for postfix steps.
+typedef enum {
+    ATOMIC_ADD,
+    ATOMIC_SUB,
+    ATOMIC_MUL,
+    ATOMIC_DIV,
+    ATOMIC_MOD,
+    ATOMIC_AND,
+    ATOMIC_OR,
+    ATOMIC_XOR,
+    ATOMIC_SHL,
+    ATOMIC_SHR,
+    ATOMIC_FETCH_ADD,
+    ATOMIC_FETCH_SUB,
+    ATOMIC_OP_COUNT
+} AtomicOp;
+
+// How a slot holds the variable, from its type.
+typedef enum {
+    ATOMIC_I8,
+    ATOMIC_U8,
+    ATOMIC_I16,
+    ATOMIC_U16,
+    ATOMIC_I32,
+    ATOMIC_U32,
+    ATOMIC_I64,
+    ATOMIC_U64,
+    ATOMIC_F32,
+    ATOMIC_F64,
+    ATOMIC_KIND_COUNT
+} AtomicKind;
+
+typedef enum {
+    ATOMIC_OK,
+    ATOMIC_DIVISION_BY_ZERO,
+    ATOMIC_INVALID_SHIFT
+} AtomicStatus;
+
+// The byte ATOMIC_UPDATE carries: the operation above the kind.
+#define ATOMIC_OPERATION(op, kind) ((uint8_t)((op) << 4 | (kind)))
+#define ATOMIC_OPERATION_OP(operation) ((AtomicOp)((operation) >> 4))
+#define ATOMIC_OPERATION_KIND(operation) ((AtomicKind)((operation) & 0xF))
+
+// False for bool, strings and long double, which are only loaded and stored.
+bool atomicKindOf(PrimitiveType type, AtomicKind *kind);
+bool validAtomicOperation(int operation);
+const char *atomicOpName(AtomicOp op);
+const char *atomicKindName(AtomicKind kind);
+// What the interpreters report for a failed update.
+const char *atomicStatusMessage(AtomicStatus status);
+
+VMValue atomicLoad(VMValue *slot);
+void atomicStore(VMValue *slot, VMValue value);
+
+// Applies the operation to slot and operand, which has the slot's type or,
+// for shifts, is the count. Bitwise operations and 64-bit sums and
+// differences are single fetch instructions; the rest retry a compare and
+// swap. result gets the new value, or the old one for the fetch forms. The
+// slot is left alone on errors.
+AtomicStatus atomicUpdate(VMValue *slot, uint8_t operation, VMValue operand, VMValue *result);
+
+#endif
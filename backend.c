@@ -0,0 +1,224 @@
+#include "backend.h"
+#include "bytecode.h"
+#include "closure.h"
+#include "jit.h"
+#include "regvm.h"
+#include "vm.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct Engine {
+    ExecutionBackend backend;
+    Evaluator *evaluator;
+    BytecodeModule *module;
+    const Snapshot *snapshot;   // lends the module when set
+    VM *vm;
+    RegisterModule *registers;
+    RegVM *regvm;
+    JitModule *jit;
+    ClosureProgram *closures;
+    ClosureRuntime *runtime;
+};
+
+static const char *backendNames[BACKEND_COUNT] = {"eval", "stack", "register", "closure", "jit", "tiered"};
+
+const char *backendName(ExecutionBackend backend){
+    return backend < BACKEND_COUNT ? backendNames[backend] : "unknown";
+}
+
+bool parseBackend(const char *name, ExecutionBackend *backend){
+    for(int i = 0; i < BACKEND_COUNT; i++){
+        if(strcmp(name, backendNames[i]) == 0){
+            *backend = (ExecutionBackend)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void freeEngine(Engine *engine){
+    if(!engine) return;
+    freeEvaluator(engine->evaluator);
+    freeRegVM(engine->regvm);
+    freeJit(engine->jit);
+    freeRegisterModule(engine->registers);
+    freeVM(engine->vm);
+    if(!engine->snapshot) freeBytecodeModule(engine->module);
+    freeClosureRuntime(engine->runtime);
+    freeClosureProgram(engine->closures);
+    free(engine);
+}
+
+static Engine *failEngine(Engine *engine, char *error, size_t errorSize, const char *message){
+    if(message && error && errorSize > 0) snprintf(error, errorSize, "%s", message);
+    freeEngine(engine);
+    return NULL;
+}
+
+Engine *createEngine(ASTNode *program, ExecutionBackend backend, FILE *out, char *error, size_t errorSize){
+    EngineOptions engineOptions = {.out = out};
+    return createEngineWithOptions(program, backend, &engineOptions, error, errorSize);
+}
+
+static VMOptions engineVMOptions(ExecutionBackend backend, const EngineOptions *engineOptions){
+    VMOptions options = backend == BACKEND_CLOSURES ? defaultClosureOptions() : defaultVMOptions();
+    if(engineOptions->out) options.out = engineOptions->out;
+    if(engineOptions->threads > 0) options.threads = engineOptions->threads;
+    return options;
+}
+
+static JitOptions engineJitOptions(const EngineOptions *engineOptions){
+    JitOptions options = defaultJitOptions();
+    if(engineOptions->perfMap) options.perfMap = true;
+    return options;
+}
+
+static TierOptions engineTierOptions(const EngineOptions *engineOptions){
+    TierOptions options = defaultTierOptions();
+    if(engineOptions->callThreshold > 0) options.callThreshold = engineOptions->callThreshold;
+    if(engineOptions->loopThreshold > 0) options.loopThreshold = engineOptions->loopThreshold;
+    options.log = engineOptions->tierLog;
+    return options;
+}
+
+// Starts the engine's backend on engine->module.
+static Engine *startBytecodeEngine(Engine *engine, const VMOptions *options, const EngineOptions *engineOptions, char *error, size_t errorSize){
+    JitOptions jitOptions = engineJitOptions(engineOptions);
+    TierOptions tierOptions = engineTierOptions(engineOptions);
+    ExecutionBackend backend = engine->backend;
+    if(backend == BACKEND_STACK_VM){
+        engine->vm = createVM(engine->module, options);
+        return engine->vm ? engine : failEngine(engine, error, errorSize, "out of memory");
+    }
+    engine->registers = compileRegisterModule(engine->module, error, errorSize);
+    if(!engine->registers) return failEngine(engine, error, errorSize, NULL);
+    if(backend == BACKEND_JIT) engine->jit = compileJit(engine->registers, &jitOptions, error, errorSize);
+    if(backend == BACKEND_TIERED) engine->jit = createJit(engine->registers, &jitOptions, error, errorSize);
+    if(backend != BACKEND_REGISTER_VM && !engine->jit) return failEngine(engine, error, errorSize, NULL);
+    engine->regvm = createRegVM(engine->registers, options);
+    if(!engine->regvm) return failEngine(engine, error, errorSize, "out of memory");
+    if(backend == BACKEND_JIT) attachRegVMJit(engine->regvm, engine->jit);
+    if(backend == BACKEND_TIERED && !enableRegVMTiering(engine->regvm, engine->jit, &tierOptions)) return failEngine(engine, error, errorSize, "out of memory");
+    return engine;
+}
+
+Engine *createEngineWithOptions(ASTNode *program, ExecutionBackend backend, const EngineOptions *engineOptions, char *error, size_t errorSize){
+    Engine *engine = calloc(1, sizeof(Engine));
+    if(!engine) return NULL;
+    engine->backend = backend;
+
+    VMOptions options = engineVMOptions(backend, engineOptions);
+    switch(backend){
+        case BACKEND_EVALUATOR: {
+            EvalOptions evalOptions = defaultEvalOptions();
+            if(engineOptions->out) evalOptions.out = engineOptions->out;
+            engine->evaluator = createEvaluator(program, &evalOptions);
+            if(!engine->evaluator) return failEngine(engine, error, errorSize, "out of memory");
+            return engine;
+        }
+        case BACKEND_STACK_VM:
+        case BACKEND_REGISTER_VM:
+        case BACKEND_JIT:
+        case BACKEND_TIERED:
+            engine->module = compileBytecode(program, error, errorSize);
+            if(!engine->module || !verifyBytecode(engine->module, error, errorSize)) return failEngine(engine, error, errorSize, NULL);
+            return startBytecodeEngine(engine, &options, engineOptions, error, errorSize);
+        case BACKEND_CLOSURES:
+            engine->closures = compileClosures(program, error, errorSize);
+            if(!engine->closures) return failEngine(engine, error, errorSize, NULL);
+            engine->runtime = createClosureRuntime(engine->closures, &options);
+            return engine->runtime ? engine : failEngine(engine, error, errorSize, "out of memory");
+        default:
+            return failEngine(engine, error, errorSize, "unknown backend");
+    }
+}
+
+Engine *createEngineFromSnapshot(const Snapshot *snapshot, ExecutionBackend backend, const EngineOptions *engineOptions, char *error, size_t errorSize){
+    if(backend == BACKEND_EVALUATOR || backend == BACKEND_CLOSURES || backend >= BACKEND_COUNT){
+        if(error && errorSize > 0) snprintf(error, errorSize, "the %s backend does not run snapshots", backendName(backend));
+        return NULL;
+    }
+    Engine *engine = calloc(1, sizeof(Engine));
+    if(!engine) return NULL;
+    engine->backend = backend;
+    engine->module = snapshot->module;
+    engine->snapshot = snapshot;
+
+    VMOptions options = engineVMOptions(backend, engineOptions);
+    if(!startBytecodeEngine(engine, &options, engineOptions, error, errorSize)) return NULL;
+    if(engine->vm) restoreVMGlobals(engine->vm, snapshot->globals);
+    else restoreRegVMGlobals(engine->regvm, snapshot->globals);
+    return engine;
+}
+
+bool runEngine(Engine *engine, Value *result){
+    switch(engine->backend){
+        case BACKEND_EVALUATOR: return runProgram(engine->evaluator, result);
+        case BACKEND_STACK_VM: return runVM(engine->vm, result);
+        case BACKEND_REGISTER_VM:
+        case BACKEND_JIT:
+        case BACKEND_TIERED: return runRegVM(engine->regvm, result);
+        default: return runClosures(engine->runtime, result);
+    }
+}
+
+bool callEngine(Engine *engine, const char *name, const Value *args, int argCount, Value *result){
+    switch(engine->backend){
+        case BACKEND_EVALUATOR: return callFunction(engine->evaluator, name, args, argCount, result);
+        case BACKEND_STACK_VM: return callVM(engine->vm, name, args, argCount, result);
+        case BACKEND_REGISTER_VM:
+        case BACKEND_JIT:
+        case BACKEND_TIERED: return callRegVM(engine->regvm, name, args, argCount, result);
+        default: return callClosures(engine->runtime, name, args, argCount, result);
+    }
+}
+
+const char *engineError(Engine *engine){
+    switch(engine->backend){
+        case BACKEND_EVALUATOR: return evalError(engine->evaluator);
+        case BACKEND_STACK_VM: return vmError(engine->vm);
+        case BACKEND_REGISTER_VM:
+        case BACKEND_JIT:
+        case BACKEND_TIERED: return regVMError(engine->regvm);
+        default: return closureError(engine->runtime);
+    }
+}
+
+bool snapshotEngine(Engine *engine, const char *path, char *error, size_t errorSize){
+    if(!engine->module){
+        if(error && errorSize > 0) snprintf(error, errorSize, "the %s backend does not write snapshots", backendName(engine->backend));
+        return false;
+    }
+    const VMValue *globals = engine->vm ? vmGlobals(engine->vm) : regVMGlobals(engine->regvm);
+    return writeSnapshot(engine->module, globals, path, error, errorSize);
+}
+
+// The program's own output goes to out ahead of the timings.
+void benchmarkBackends(ASTNode *program, const char *name, const Value *args, int argCount, int repeat, FILE *out){
+    for(int i = 0; i < BACKEND_COUNT; i++){
+        char error[256] = "";
+        Value result;
+        Engine *engine = createEngine(program, (ExecutionBackend)i, out, error, sizeof(error));
+        if(!engine){
+            fprintf(out, "%-10s not supported: %s\n", backendName(i), error);
+            continue;
+        }
+
+        bool ok = runEngine(engine, &result);
+        clock_t start = clock();
+        for(int k = 0; ok && k < repeat; k++){
+            ok = callEngine(engine, name, args, argCount, &result);
+        }
+        double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        if(!ok){
+            fprintf(out, "%-10s failed: %s\n", backendName(i), engineError(engine));
+        } else{
+            fprintf(out, "%-10s %10.3f ms  ", backendName(i), seconds * 1000.0 / (repeat > 0 ? repeat : 1));
+            printValue(&result, out);
+            fputc('\n', out);
+        }
+        freeEngine(engine);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include "ast.h"
+#include "eval.h"
+#include "snapshot.h"
+#include <stdio.h>
+
+typedef enum {
+    BACKEND_EVALUATOR,          // walks the AST, runs every program
+    BACKEND_STACK_VM,
+    BACKEND_REGISTER_VM,
+    BACKEND_CLOSURES,
+    BACKEND_JIT,                // the register VM running compiled functions as machine code
+    BACKEND_TIERED,             // the register VM compiling functions and loops once they are hot
+    BACKEND_COUNT
+} ExecutionBackend;
+
+typedef struct Engine Engine;
+
+typedef struct {
+    FILE *out;                  // the program's output, stdout when NULL
+    int threads;                // workers for parallel loops, 0 for one per core
+    bool perfMap;               // JIT symbols for perf, as with NEWLEAF_PERF_MAP
+    // the tiered backend; 0 for the default threshold
+    int callThreshold;          // calls before a function is compiled
+    int loopThreshold;          // iterations of one loop before its frame moves to machine code
+    FILE *tierLog;              // where tier-up events go, NULL for nowhere
+} EngineOptions;
+
+const char *backendName(ExecutionBackend backend);
+bool parseBackend(const char *name, ExecutionBackend *backend);
+
+// Prepares program for one backend; a program outside the backend's subset
+// fails here with the compiler's message. The program must outlive the engine.
+Engine *createEngine(ASTNode *program, ExecutionBackend backend, FILE *out, char *error, size_t errorSize);
+Engine *createEngineWithOptions(ASTNode *program, ExecutionBackend backend, const EngineOptions *engineOptions, char *error, size_t errorSize);
+// An engine on one of the bytecode backends whose globals start as the
+// snapshot saved them, so calls need no runEngine first. The snapshot must
+// outlive the engine.
+Engine *createEngineFromSnapshot(const Snapshot *snapshot, ExecutionBackend backend, const EngineOptions *engineOptions, char *error, size_t errorSize);
+void freeEngine(Engine *engine);
+
+bool runEngine(Engine *engine, Value *result);
+bool callEngine(Engine *engine, const char *name, const Value *args, int argCount, Value *result);
+const char *engineError(Engine *engine);
+// Saves the engine's program with the globals its last run left, for
+// createEngineFromSnapshot; bytecode backends only.
+bool snapshotEngine(Engine *engine, const char *path, char *error, size_t errorSize);
+
+// Runs program once on each backend that accepts it, then times repeat calls
+// of the named function and prints one line per backend.
+void benchmarkBackends(ASTNode *program, const char *name, const Value *args, int argCount, int repeat, FILE *out);
+
+#endif
@@ -0,0 +1,123 @@
+#include "atomics.h"
+#include "backend.h"
+#include "primitive.h"
+#include "builders.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+// Threads contending for one atomic variable: first the runtime's updates
+// called directly, then scripts whose parallel loops add to an atomic global.
+
+#define UPDATES 2000000
+#define ITERATIONS 4000000
+#define MAX_THREADS 8
+
+typedef struct {
+    VMValue *slot;
+    uint8_t operation;
+    VMValue operand;
+} Contender;
+
+static double now(void){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void *contend(void *arg){
+    Contender *c = arg;
+    VMValue result;
+    for(int i = 0; i < UPDATES; i++){
+        atomicUpdate(c->slot, c->operation, c->operand, &result);
+    }
+    return NULL;
+}
+
+static bool runtimeUpdates(const char *label, AtomicOp op, AtomicKind kind, VMValue operand){
+    printf("%-12s", label);
+    for(int threads = 1; threads <= MAX_THREADS; threads *= 2){
+        VMValue slot = {.i = 0};
+        if(kind == ATOMIC_F64) slot.f = 0;
+        Contender c = {&slot, ATOMIC_OPERATION(op, kind), operand};
+        pthread_t workers[MAX_THREADS];
+
+        double start = now();
+        for(int i = 0; i < threads; i++) pthread_create(&workers[i], NULL, contend, &c);
+        for(int i = 0; i < threads; i++) pthread_join(workers[i], NULL);
+        double seconds = now() - start;
+
+        // Sums must not lose updates however the threads interleave.
+        if(op == ATOMIC_ADD){
+            double expected = (double)threads * UPDATES * (kind == ATOMIC_F64 ? operand.f : (double)operand.i);
+            double actual = kind == ATOMIC_F64 ? slot.f : (double)slot.i;
+            if(actual != expected){
+                printf("\n%s with %d threads lost updates: %.0f of %.0f\n", label, threads, actual, expected);
+                return false;
+            }
+        }
+        printf(" %8.1f", threads * (double)UPDATES / seconds / 1e6);
+    }
+    printf("\n");
+    return true;
+}
+
+static ASTNode *buildProgram(void){
+    // count(n) adds 1 to total from every iteration of a parallel loop.
+    ASTNode *total = createDeclarationNode(name("longlong"), "total", literal(TYPE_LONG_LONG, 0), STORAGE_ATOMIC);
+    ASTNode *loop = forLoop(declare("int", "i", integer(0)), binary(name("i"), LESS_BINOP, name("n")), increment("i"),
+        block(1, update(name("total"), ADD_AND_ASSIGN, literal(TYPE_LONG_LONG, 1))));
+    loop->forStmt.parallel = true;
+    ASTNode *count = function("count", 1, "n", block(2, loop, returns(integer(0))));
+    ASTNode *result = createFunctionNode("result", name("longlong"), NULL, 0, (ASTNode *[]){returns(name("total"))}, 1, 0);
+    return block(3, total, count, result);
+}
+
+static bool scriptUpdates(ASTNode *program, ExecutionBackend backend){
+    printf("%-12s", backendName(backend));
+    for(int threads = 1; threads <= MAX_THREADS; threads *= 2){
+        EngineOptions options = {.threads = threads};
+        char error[256];
+        Engine *engine = createEngineWithOptions(program, backend, &options, error, sizeof(error));
+        if(!engine){
+            printf(" not supported: %s\n", error);
+            return true;
+        }
+        Value arg = makePrimitiveValue(TYPE_INT, primitiveFromLongLong(TYPE_INT, ITERATIONS));
+        Value result;
+        long long total = 0;
+
+        bool ok = runEngine(engine, &result);
+        double start = now();
+        ok = ok && callEngine(engine, "count", &arg, 1, &result);
+        double seconds = now() - start;
+        ok = ok && callEngine(engine, "result", NULL, 0, &result);
+        if(ok) primitiveToLongLong(result.type, result.as.primitive, &total);
+        if(!ok || total != ITERATIONS){
+            printf("\n%s with %d threads: %s, total %lld of %d\n", backendName(backend), threads, ok ? "lost updates" : engineError(engine), total, ITERATIONS);
+            freeEngine(engine);
+            return false;
+        }
+        printf(" %8.1f", ITERATIONS / seconds / 1e6);
+        freeEngine(engine);
+    }
+    printf("\n");
+    return true;
+}
+
+int main(void){
+    printf("million updates a second with 1, 2, 4 and 8 threads\n");
+    bool ok = runtimeUpdates("i64 add", ATOMIC_ADD, ATOMIC_I64, (VMValue){.i = 1})
+        && runtimeUpdates("i32 add", ATOMIC_ADD, ATOMIC_I32, (VMValue){.i = 1})
+        && runtimeUpdates("i64 or", ATOMIC_OR, ATOMIC_I64, (VMValue){.i = 1})
+        && runtimeUpdates("i64 mul", ATOMIC_MUL, ATOMIC_I64, (VMValue){.i = 1})
+        && runtimeUpdates("f64 add", ATOMIC_ADD, ATOMIC_F64, (VMValue){.f = 0.5});
+
+    printf("\nparallel loops adding to an atomic global\n");
+    ASTNode *program = buildProgram();
+    ok = ok && scriptUpdates(program, BACKEND_STACK_VM)
+        && scriptUpdates(program, BACKEND_REGISTER_VM)
+        && scriptUpdates(program, BACKEND_JIT);
+    freeAST(program);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,96 @@
+#include "context.h"
+#include "primitive.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Threads parsing and running scripts in their own contexts. Throughput
+// should grow with the thread count up to the number of cores.
+
+#define STATEMENTS 2000
+#define SCRIPTS 20
+#define MAX_THREADS 8
+
+typedef struct {
+    const char *source;
+    ExecutionBackend backend;
+    long long checksum;
+    bool failed;
+} Worker;
+
+static double now(void){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void *runScripts(void *arg){
+    Worker *w = arg;
+    w->checksum = 0;
+    for(int i = 0; i < SCRIPTS; i++){
+        ContextOptions options = defaultContextOptions();
+        options.backend = w->backend;
+        options.engine.threads = 1;
+        Context *context = createContext(&options);
+        Value result;
+        long long value = 0;
+        if(!runSource(context, w->source, &result)){
+            fprintf(stderr, "%s\n", contextError(context));
+            w->failed = true;
+            freeContext(context);
+            return NULL;
+        }
+        primitiveToLongLong(result.type, result.as.primitive, &value);
+        w->checksum += value;
+        freeContext(context);
+    }
+    return NULL;
+}
+
+// STATEMENTS lines of arithmetic, mostly parse and compile work.
+static char *buildSource(void){
+    size_t capacity = STATEMENTS * 64 + 64;
+    char *source = malloc(capacity);
+    if(!source) abort();
+    size_t length = snprintf(source, capacity, "{\n");
+    for(int i = 0; i < STATEMENTS; i++){
+        length += snprintf(source + length, capacity - length, "(%d + 2) * 3 - %d / 7 + (1 ? %d : 4);\n", i, i, i);
+    }
+    snprintf(source + length, capacity - length, "return 7; }\n");
+    return source;
+}
+
+int main(void){
+    const ExecutionBackend backends[] = {BACKEND_EVALUATOR, BACKEND_STACK_VM, BACKEND_REGISTER_VM};
+    char *source = buildSource();
+
+    printf("scripts a second with 1, 2, 4 and 8 threads\n");
+    for(size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++){
+        printf("%-10s", backendName(backends[b]));
+        for(int threads = 1; threads <= MAX_THREADS; threads *= 2){
+            pthread_t ids[MAX_THREADS];
+            Worker workers[MAX_THREADS];
+            double start = now();
+            for(int i = 0; i < threads; i++){
+                workers[i] = (Worker){source, backends[b], 0, false};
+                pthread_create(&ids[i], NULL, runScripts, &workers[i]);
+            }
+            for(int i = 0; i < threads; i++) pthread_join(ids[i], NULL);
+            double seconds = now() - start;
+
+            for(int i = 0; i < threads; i++){
+                if(workers[i].failed || workers[i].checksum != 7 * SCRIPTS){
+                    printf("\nthread %d returned %lld\n", i, workers[i].checksum);
+                    free(source);
+                    return 1;
+                }
+            }
+            printf(" %8.1f", threads * SCRIPTS / seconds);
+        }
+        printf("\n");
+    }
+
+    free(source);
+    return 0;
+}
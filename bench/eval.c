@@ -0,0 +1,77 @@
+#include "eval.h"
+#include "primitive.h"
+#include "builders.h"
+#include <stdio.h>
+#include <time.h>
+
+// Times the evaluator on scalar kernels: calls, int and double loops, and
+// array traffic. None of them should allocate per iteration.
+
+typedef struct {
+    const char *name;
+    long long arg;
+    int repeat;
+} Kernel;
+
+static ASTNode *buildProgram(void){
+    ASTNode *fib = function("fib", 1, "n", block(2,
+        ifElse(binary(name("n"), LESS_BINOP, integer(2)), returns(name("n")), NULL),
+        returns(binary(call("fib", 1, binary(name("n"), SUB_BINOP, integer(1))), ADD_BINOP,
+                       call("fib", 1, binary(name("n"), SUB_BINOP, integer(2)))))));
+    ASTNode *sumInt = function("sumInt", 1, "n", block(3,
+        declare("int", "s", integer(0)),
+        forLoop(declare("int", "i", integer(0)), binary(name("i"), LESS_BINOP, name("n")), increment("i"),
+            block(1, update(name("s"), ADD_AND_ASSIGN, binary(binary(name("i"), BIT_AND_BINOP, integer(7)), MUL_BINOP, integer(3))))),
+        returns(name("s"))));
+    ASTNode *sumDouble = function("sumDouble", 1, "n", block(4,
+        declare("double", "d", literal(TYPE_DOUBLE, 0)),
+        declare("double", "step", createLiteralNode(TYPE_DOUBLE, (PrimitiveValue){.doubleVal = 0.5})),
+        forLoop(declare("int", "i", integer(0)), binary(name("i"), LESS_BINOP, name("n")), increment("i"),
+            block(1, update(name("d"), ADD_AND_ASSIGN, binary(name("step"), MUL_BINOP, name("step"))))),
+        returns(createCastExprNode(name("int"), name("d")))));
+    ASTNode *arrays = function("arrays", 1, "n", block(5,
+        declareArray("int", 256, "a"),
+        declare("int", "s", integer(0)),
+        forLoop(declare("int", "i", integer(0)), binary(name("i"), LESS_BINOP, integer(256)), increment("i"),
+            block(1, assign(element(name("a"), name("i")), name("i")))),
+        forLoop(declare("int", "k", integer(0)), binary(name("k"), LESS_BINOP, name("n")), increment("k"),
+            block(1, update(name("s"), ADD_AND_ASSIGN, element(name("a"), binary(name("k"), BIT_AND_BINOP, integer(255)))))),
+        returns(name("s"))));
+    return block(4, fib, sumInt, sumDouble, arrays);
+}
+
+int main(void){
+    const Kernel kernels[] = {
+        {"fib", 24, 5},
+        {"sumInt", 1000000, 5},
+        {"sumDouble", 1000000, 5},
+        {"arrays", 1000000, 5}
+    };
+    ASTNode *program = buildProgram();
+    Evaluator *e = createEvaluator(program, NULL);
+
+    for(size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++){
+        Value arg = makePrimitiveValue(TYPE_INT, primitiveFromLongLong(TYPE_INT, kernels[i].arg));
+        Value result;
+        bool ok = true;
+        clock_t start = clock();
+        for(int k = 0; ok && k < kernels[i].repeat; k++){
+            ok = callFunction(e, kernels[i].name, &arg, 1, &result);
+        }
+        double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+        if(!ok){
+            printf("%-10s failed: %s\n", kernels[i].name, evalError(e));
+            return 1;
+        }
+        char label[64];
+        snprintf(label, sizeof(label), "%s(%lld)", kernels[i].name, kernels[i].arg);
+        printf("%-18s %10.3f ms  ", label, seconds * 1000.0 / kernels[i].repeat);
+        printValue(&result, stdout);
+        putchar('\n');
+    }
+    printEvalStats(e, stdout);
+
+    freeEvaluator(e);
+    freeAST(program);
+    return 0;
+}
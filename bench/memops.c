@@ -0,0 +1,79 @@
+#include "memops.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// The copy and fill kernels against libc from 1 B to 64 MB, in ns per
+// call: disjoint copies, overlapping moves and fills, each with the
+// general entry point and the kernel picked for the size.
+
+#define MAX_SIZE ((size_t)64 << 20)
+#define BYTES_PER_SIZE ((size_t)256 << 20)
+
+typedef void (*Move)(void *dest, const void *src, size_t size);
+typedef void (*Fill)(void *dest, int byte, size_t size);
+
+static double now(void){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void libcMove(void *dest, const void *src, size_t size){
+    memmove(dest, src, size);
+}
+
+static void libcFill(void *dest, int byte, size_t size){
+    memset(dest, byte, size);
+}
+
+// Offsets vary a little between calls so alignment is not always the same.
+static double timeMove(Move volatile move, unsigned char *dest, const unsigned char *src, size_t size, size_t iterations){
+    double start = now();
+    for(size_t i = 0; i < iterations; i++){
+        move(dest + (i & 7), src + (i & 3), size);
+    }
+    return (now() - start) / iterations * 1e9;
+}
+
+static double timeFill(Fill volatile fill, unsigned char *dest, size_t size, size_t iterations){
+    double start = now();
+    for(size_t i = 0; i < iterations; i++){
+        fill(dest + (i & 7), (int)i, size);
+    }
+    return (now() - start) / iterations * 1e9;
+}
+
+int main(void){
+    unsigned char *src = malloc(MAX_SIZE + 64);
+    unsigned char *dest = malloc(MAX_SIZE + 64);
+    if(!src || !dest) return 1;
+    memset(src, 1, MAX_SIZE + 64);
+    memset(dest, 2, MAX_SIZE + 64);
+
+    printf("%10s %10s %10s %10s | %10s %10s | %10s %10s %10s\n", "bytes",
+           "libc copy", "move", "kernel", "libc ovl", "move ovl", "libc fill", "fill", "kernel");
+    for(size_t size = 1; size <= MAX_SIZE; size *= 4){
+        size_t iterations = BYTES_PER_SIZE / (size < 64 ? 64 : size);
+        if(iterations < 4) iterations = 4;
+        double copy[3], overlap[2], fill[3];
+
+        copy[0] = timeMove(libcMove, dest, src, size, iterations);
+        copy[1] = timeMove(moveMemory, dest, src, size, iterations);
+        copy[2] = timeMove(moveKernelFor(size), dest, src, size, iterations);
+        // The destination starts a few bytes into its own source.
+        overlap[0] = timeMove(libcMove, dest + 16, dest, size, iterations);
+        overlap[1] = timeMove(moveMemory, dest + 16, dest, size, iterations);
+        fill[0] = timeFill(libcFill, dest, size, iterations);
+        fill[1] = timeFill(fillMemory, dest, size, iterations);
+        fill[2] = timeFill(fillKernelFor(size), dest, size, iterations);
+
+        printf("%10zu %10.1f %10.1f %10.1f | %10.1f %10.1f | %10.1f %10.1f %10.1f\n", size,
+               copy[0], copy[1], copy[2], overlap[0], overlap[1], fill[0], fill[1], fill[2]);
+    }
+
+    free(src);
+    free(dest);
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include "backend.h"
+#include "bytecode.h"
+#include "closure.h"
+#include "eval.h"
+#include "primitive.h"
+#include "tailcall.h"
+#include "vm.h"
+#include "builders.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Tail-recursive loops a million calls deep run on engines allowed only a
+// few frames, so they finish only if every tail call reuses its frame.
+
+#define DEPTH 1000000
+#define FRAMES 16
+
+static ASTNode *buildProgram(void){
+    // count(n, acc) counts n down to zero; isEven and isOdd call each other.
+    ASTNode *count = function("count", 2, "n", "acc", block(2,
+        ifElse(binary(name("n"), EQU_BINOP, integer(0)), returns(name("acc")), NULL),
+        returns(call("count", 2, binary(name("n"), SUB_BINOP, integer(1)), binary(name("acc"), ADD_BINOP, integer(1))))));
+    ASTNode *isEven = function("isEven", 1, "n", block(2,
+        ifElse(binary(name("n"), EQU_BINOP, integer(0)), returns(integer(1)), NULL),
+        returns(call("isOdd", 1, binary(name("n"), SUB_BINOP, integer(1))))));
+    ASTNode *isOdd = function("isOdd", 1, "n", block(2,
+        ifElse(binary(name("n"), EQU_BINOP, integer(0)), returns(integer(0)), NULL),
+        returns(call("isEven", 1, binary(name("n"), SUB_BINOP, integer(1))))));
+    ASTNode *program = block(3, count, isEven, isOdd);
+
+    TailCallStats stats;
+    eliminateTailCalls(program, &stats);
+    printf("tail calls marked %d, self calls rewritten %d\n", stats.tailCallsMarked, stats.selfCallsRewritten);
+    return program;
+}
+
+static void report(const char *engine, const char *name, bool ok, const Value *result, long long tailCalls, double seconds, const char *error){
+    long long value = 0;
+    if(!ok){
+        printf("%-10s %-7s failed: %s\n", engine, name, error);
+        exit(1);
+    }
+    primitiveToLongLong(result->type, result->as.primitive, &value);
+    printf("%-10s %-7s %lld with %d frames, %lld tail calls, %.1f ms\n", engine, name, value, FRAMES, tailCalls, seconds * 1000);
+}
+
+static double now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void){
+    ASTNode *program = buildProgram();
+    Value args[2] = {
+        makePrimitiveValue(TYPE_INT, primitiveFromLongLong(TYPE_INT, DEPTH)),
+        makePrimitiveValue(TYPE_INT, primitiveFromLongLong(TYPE_INT, 0))
+    };
+    const char *names[] = {"count", "isEven"};
+    const int argCounts[] = {2, 1};
+    char error[256];
+    Value result;
+
+    EvalOptions evalOptions = defaultEvalOptions();
+    evalOptions.maxCallDepth = FRAMES;
+    Evaluator *e = createEvaluator(program, &evalOptions);
+    for(int i = 0; i < 2; i++){
+        double start = now();
+        bool ok = callFunction(e, names[i], args, argCounts[i], &result);
+        report("evaluator", names[i], ok, &result, evalStats(e)->tailCalls, now() - start, evalError(e));
+    }
+    freeEvaluator(e);
+
+    BytecodeModule *module = compileBytecode(program, error, sizeof(error));
+    if(!module){
+        printf("bytecode: %s\n", error);
+        return 1;
+    }
+    VMOptions vmOptions = defaultVMOptions();
+    vmOptions.maxCallDepth = FRAMES;
+    VM *vm = createVM(module, &vmOptions);
+    for(int i = 0; i < 2; i++){
+        double start = now();
+        bool ok = callVM(vm, names[i], args, argCounts[i], &result);
+        report("stack vm", names[i], ok, &result, vmStats(vm)->tailCalls, now() - start, vmError(vm));
+    }
+    freeVM(vm);
+    freeBytecodeModule(module);
+
+    ClosureProgram *closures = compileClosures(program, error, sizeof(error));
+    if(!closures){
+        printf("closures: %s\n", error);
+        return 1;
+    }
+    VMOptions closureOptions = defaultClosureOptions();
+    closureOptions.maxCallDepth = FRAMES;
+    ClosureRuntime *rt = createClosureRuntime(closures, &closureOptions);
+    for(int i = 0; i < 2; i++){
+        double start = now();
+        bool ok = callClosures(rt, names[i], args, argCounts[i], &result);
+        report("closures", names[i], ok, &result, closureStats(rt)->tailCalls, now() - start, closureError(rt));
+    }
+    freeClosureRuntime(rt);
+    freeClosureProgram(closures);
+
+    printf("\ncount(%d, 0) on each backend:\n", DEPTH);
+    benchmarkBackends(program, "count", args, 2, 5, stdout);
+    printf("\nisEven(%d) on each backend:\n", DEPTH);
+    benchmarkBackends(program, "isEven", args, 1, 5, stdout);
+
+    freeAST(program);
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include "bytecode.h"
+#include "eval.h"
+#include "primitive.h"
+#include "regvm.h"
+#include "vm.h"
+#include "builders.h"
+#include <stdio.h>
+#include <time.h>
+
+// The fib, loop and array suite, run by the stack and register VMs and by
+// the evaluator walking the same tree. The register VM then runs the suite
+// again counting instruction pairs, the candidates for superinstructions.
+
+typedef struct {
+    const char *name;
+    long long arg;
+    int repeat;
+} Kernel;
+
+static ASTNode *buildProgram(void){
+    ASTNode *fib = function("fib", 1, "n", block(2,
+        ifElse(binary(name("n"), LESS_BINOP, integer(2)), returns(name("n")), NULL),
+        returns(binary(call("fib", 1, binary(name("n"), SUB_BINOP, integer(1))), ADD_BINOP,
+                       call("fib", 1, binary(name("n"), SUB_BINOP, integer(2)))))));
+    ASTNode *loop = function("loop", 1, "n", block(3,
+        declare("int", "s", integer(0)),
+        forLoop(declare("int", "i", integer(0)), binary(name("i"), LESS_BINOP, name("n")), increment("i"),
+            block(1, ifElse(binary(binary(name("i"), MOD_BINOP, integer(3)), EQU_BINOP, integer(0)),
+                update(name("s"), ADD_AND_ASSIGN, name("i")),
+                update(name("s"), SUB_AND_ASSIGN, integer(1))))),
+        returns(name("s"))));
+    ASTNode *array = function("array", 1, "n", block(5,
+        declareArray("int", 1024, "a"),
+        declare("int", "s", integer(0)),
+        forLoop(declare("int", "i", integer(0)), binary(name("i"), LESS_BINOP, integer(1024)), increment("i"),
+            block(1, assign(element(name("a"), name("i")), binary(name("i"), MUL_BINOP, integer(2))))),
+        forLoop(declare("int", "k", integer(0)), binary(name("k"), LESS_BINOP, name("n")), increment("k"),
+            block(1, update(name("s"), ADD_AND_ASSIGN, element(name("a"), binary(name("k"), BIT_AND_BINOP, integer(1023)))))),
+        returns(name("s"))));
+    return block(3, fib, loop, array);
+}
+
+static double perCall(clock_t start, int repeat){
+    return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC / repeat;
+}
+
+static bool sameResult(const char *kernel, const char *engine, const Value *expected, const Value *actual){
+    long long want = 0, got = 0;
+    primitiveToLongLong(expected->type, expected->as.primitive, &want);
+    primitiveToLongLong(actual->type, actual->as.primitive, &got);
+    if(want != got) printf("%s: the evaluator returned %lld, the %s %lld\n", kernel, want, engine, got);
+    return want == got;
+}
+
+int main(void){
+    const Kernel kernels[] = {
+        {"fib", 25, 3},
+        {"loop", 1000000, 3},
+        {"array", 1000000, 3}
+    };
+    char error[256];
+    ASTNode *program = buildProgram();
+    BytecodeModule *module = compileBytecode(program, error, sizeof(error));
+    if(!module){
+        printf("bytecode: %s\n", error);
+        return 1;
+    }
+    RegisterModule *registers = compileRegisterModule(module, error, sizeof(error));
+    if(!registers){
+        printf("registers: %s\n", error);
+        return 1;
+    }
+    Evaluator *e = createEvaluator(program, NULL);
+    VM *vm = createVM(module, NULL);
+    RegVM *regvm = createRegVM(registers, NULL);
+
+    printf("%-18s %12s %12s %12s %8s\n", "", "ast ms", "vm ms", "regvm ms", "speedup");
+    for(size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++){
+        const Kernel *kernel = &kernels[i];
+        Value arg = makePrimitiveValue(TYPE_INT, primitiveFromLongLong(TYPE_INT, kernel->arg));
+        Value evalResult, vmResult, regResult;
+        bool ok = true;
+
+        clock_t start = clock();
+        for(int k = 0; ok && k < kernel->repeat; k++){
+            ok = callFunction(e, kernel->name, &arg, 1, &evalResult);
+        }
+        double evalMs = perCall(start, kernel->repeat);
+        if(!ok){
+            printf("%s: %s\n", kernel->name, evalError(e));
+            return 1;
+        }
+
+        start = clock();
+        for(int k = 0; ok && k < kernel->repeat; k++){
+            ok = callVM(vm, kernel->name, &arg, 1, &vmResult);
+        }
+        double vmMs = perCall(start, kernel->repeat);
+        if(!ok){
+            printf("%s: %s\n", kernel->name, vmError(vm));
+            return 1;
+        }
+
+        start = clock();
+        for(int k = 0; ok && k < kernel->repeat; k++){
+            ok = callRegVM(regvm, kernel->name, &arg, 1, &regResult);
+        }
+        double regMs = perCall(start, kernel->repeat);
+        if(!ok){
+            printf("%s: %s\n", kernel->name, regVMError(regvm));
+            return 1;
+        }
+        if(!sameResult(kernel->name, "VM", &evalResult, &vmResult) || !sameResult(kernel->name, "register VM", &evalResult, &regResult)) return 1;
+
+        char label[64];
+        snprintf(label, sizeof(label), "%s(%lld)", kernel->name, kernel->arg);
+        printf("%-18s %12.3f %12.3f %12.3f %7.1fx\n", label, evalMs, vmMs, regMs, regMs > 0 ? evalMs / regMs : 0.0);
+    }
+
+    // profiling slows dispatch, so it gets a VM of its own
+    RegVM *profiled = createRegVM(registers, NULL);
+    enableRegVMProfile(profiled);
+    for(size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++){
+        Value arg = makePrimitiveValue(TYPE_INT, primitiveFromLongLong(TYPE_INT, kernels[i].arg));
+        Value result;
+        if(!callRegVM(profiled, kernels[i].name, &arg, 1, &result)){
+            printf("%s: %s\n", kernels[i].name, regVMError(profiled));
+            return 1;
+        }
+    }
+    printf("\nmost executed register instruction pairs:\n");
+    printRegVMProfile(profiled, 12, stdout);
+
+    freeRegVM(profiled);
+    freeRegVM(regvm);
+    freeRegisterModule(registers);
+    freeVM(vm);
+    freeEvaluator(e);
+    freeBytecodeModule(module);
+    freeAST(program);
+    return 0;
+}
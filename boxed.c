@@ -0,0 +1,169 @@
+#include "boxed.h"
+#include "primitive.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BOX_PREFIX 0xFFF8000000000000ULL
+#define BOX_TAG_SHIFT 48
+#define BOX_PAYLOAD 0x0000FFFFFFFFFFFFULL
+#define BOX_CANONICAL_NAN 0x7FF8000000000000ULL
+
+#define INLINE_TYPE_SHIFT 43
+#define INLINE_INT_BITS 43
+#define INLINE_INT_MASK ((1ULL << INLINE_INT_BITS) - 1)
+
+typedef enum {
+    TAG_INTEGER,
+    TAG_FLOAT,
+    TAG_STRING,
+    TAG_BOX
+} BoxTag;
+
+static bool isTagged(BoxedValue value){
+    return (value & BOX_PREFIX) == BOX_PREFIX;
+}
+
+static BoxTag tagOf(BoxedValue value){
+    return (BoxTag)((value >> BOX_TAG_SHIFT) & 7);
+}
+
+static BoxedValue tagged(BoxTag tag, uint64_t payload){
+    return BOX_PREFIX | ((uint64_t)tag << BOX_TAG_SHIFT) | (payload & BOX_PAYLOAD);
+}
+
+static const Box *boxOf(BoxedValue value){
+    return (const Box *)(uintptr_t)(value & BOX_PAYLOAD);
+}
+
+// Unused bytes of the union are zeroed so boxes compare and hash bytewise.
+static void fillBox(Box *box, PrimitiveType type, PrimitiveValue value){
+    memset(box, 0, sizeof(*box));
+    box->type = type;
+    if(type == TYPE_LONG_DOUBLE) box->value.longDoubleVal = value.longDoubleVal;
+    else memcpy(&box->value, &value, primitiveSize(type));
+}
+
+static BoxedValue outOfLine(PrimitiveType type, PrimitiveValue value, Box *box){
+    fillBox(box, type, value);
+    return tagged(TAG_BOX, (uint64_t)(uintptr_t)box);
+}
+
+static bool fitsPayload(const void *pointer){
+    return ((uint64_t)(uintptr_t)pointer & ~BOX_PAYLOAD) == 0;
+}
+
+// An integer goes inline when converting it to long long and back gives the
+// same bits and the long long fits in 43 bits.
+static bool inlineInteger(PrimitiveType type, PrimitiveValue value, BoxedValue *out){
+    long long n = convertPrimitive(type, value, TYPE_LONG_LONG).longLongVal;
+    long long limit = 1LL << (INLINE_INT_BITS - 1);
+    if(n < -limit || n >= limit) return false;
+    PrimitiveValue back = convertPrimitive(TYPE_LONG_LONG, (PrimitiveValue){.longLongVal = n}, type);
+    if(memcmp(&back, &value, primitiveSize(type)) != 0) return false;
+    *out = tagged(TAG_INTEGER, ((uint64_t)type << INLINE_TYPE_SHIFT) | ((uint64_t)n & INLINE_INT_MASK));
+    return true;
+}
+
+BoxedValue boxPrimitive(PrimitiveType type, PrimitiveValue value, Box *box){
+    BoxedValue out;
+    switch(type){
+        case TYPE_DOUBLE:
+            if(value.doubleVal != value.doubleVal) return BOX_CANONICAL_NAN;
+            memcpy(&out, &value.doubleVal, sizeof(out));
+            return out;
+        case TYPE_FLOAT: {
+            uint32_t bits;
+            memcpy(&bits, &value.floatVal, sizeof(bits));
+            return tagged(TAG_FLOAT, bits);
+        }
+        case TYPE_LONG_DOUBLE:
+            return outOfLine(type, value, box);
+        case TYPE_STRING:
+            if(!fitsPayload(value.stringVal)) return outOfLine(type, value, box);
+            return tagged(TAG_STRING, (uint64_t)(uintptr_t)value.stringVal);
+        default:
+            if(inlineInteger(type, value, &out)) return out;
+            return outOfLine(type, value, box);
+    }
+}
+
+PrimitiveType boxedType(BoxedValue value){
+    if(!isTagged(value)) return TYPE_DOUBLE;
+    switch(tagOf(value)){
+        case TAG_INTEGER: return (PrimitiveType)((value >> INLINE_TYPE_SHIFT) & 31);
+        case TAG_FLOAT: return TYPE_FLOAT;
+        case TAG_STRING: return TYPE_STRING;
+        default: return boxOf(value)->type;
+    }
+}
+
+PrimitiveValue unboxPrimitive(BoxedValue value){
+    PrimitiveValue out;
+    memset(&out, 0, sizeof(out));
+    if(!isTagged(value)){
+        memcpy(&out.doubleVal, &value, sizeof(value));
+        return out;
+    }
+    switch(tagOf(value)){
+        case TAG_INTEGER: {
+            // sign extend the 43-bit value
+            long long n = (long long)((value & INLINE_INT_MASK) << (64 - INLINE_INT_BITS)) >> (64 - INLINE_INT_BITS);
+            return convertPrimitive(TYPE_LONG_LONG, (PrimitiveValue){.longLongVal = n}, boxedType(value));
+        }
+        case TAG_FLOAT: {
+            uint32_t bits = (uint32_t)value;
+            memcpy(&out.floatVal, &bits, sizeof(bits));
+            return out;
+        }
+        case TAG_STRING:
+            out.stringVal = (char *)(uintptr_t)(value & BOX_PAYLOAD);
+            return out;
+        default:
+            return boxOf(value)->value;
+    }
+}
+
+bool isBoxedOutOfLine(BoxedValue value){
+    return isTagged(value) && tagOf(value) == TAG_BOX;
+}
+
+bool copyBoxed(BoxedValue value, BoxedValue *out){
+    if(!isBoxedOutOfLine(value)){
+        *out = value;
+        return true;
+    }
+    Box *box = malloc(sizeof(Box));
+    if(!box || !fitsPayload(box)){
+        free(box);
+        return false;
+    }
+    memcpy(box, boxOf(value), sizeof(Box));
+    *out = tagged(TAG_BOX, (uint64_t)(uintptr_t)box);
+    return true;
+}
+
+void freeBoxed(BoxedValue value){
+    if(isBoxedOutOfLine(value)) free((void *)boxOf(value));
+}
+
+bool boxedEquals(BoxedValue a, BoxedValue b){
+    if(a == b) return true;
+    if(!isBoxedOutOfLine(a) || !isBoxedOutOfLine(b)) return false;
+    return memcmp(boxOf(a), boxOf(b), sizeof(Box)) == 0;
+}
+
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size){
+    const unsigned char *bytes = data;
+    for(size_t i = 0; i < size; i++){
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Out-of-line values hash by content so equal boxes at different addresses
+// land together.
+uint64_t hashBoxed(uint64_t hash, BoxedValue value){
+    if(isBoxedOutOfLine(value)) return hashBytes(hash, boxOf(value), sizeof(Box));
+    return hashBytes(hash, &value, sizeof(value));
+}
@@ -0,0 +1,37 @@
+#ifndef BOXED_H
+#define BOXED_H
+
+#include "ast.h"
+
+// A primitive packed into 8 bytes. A double is stored as itself, with every
+// NaN folded into one; anything else sits in the payload of a negative quiet
+// NaN under a 3-bit tag:
+//   integers  the type and a 43-bit two's complement value
+//   float     the type and the float's bits
+//   string    a 48-bit pointer
+//   box       a pointer to a Box holding what does not fit, such as a long
+//             double or a 64-bit integer past 43 bits
+// Only memo cache entries use it; the engines keep their own value types.
+typedef uint64_t BoxedValue;
+
+typedef struct {
+    PrimitiveType type;
+    PrimitiveValue value;
+} Box;
+
+// box is only used when the value does not fit inline and must outlive the
+// result; copyBoxed moves it to the heap.
+BoxedValue boxPrimitive(PrimitiveType type, PrimitiveValue value, Box *box);
+PrimitiveType boxedType(BoxedValue value);
+PrimitiveValue unboxPrimitive(BoxedValue value);
+
+bool isBoxedOutOfLine(BoxedValue value);
+bool copyBoxed(BoxedValue value, BoxedValue *out);
+void freeBoxed(BoxedValue value);
+
+// Equal values have equal bits unless both are out of line; 0.0 and -0.0
+// stay apart.
+bool boxedEquals(BoxedValue a, BoxedValue b);
+uint64_t hashBoxed(uint64_t hash, BoxedValue value);
+
+#endif
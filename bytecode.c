@@ -0,0 +1,2385 @@
+#include "bytecode.h"
+#include "atomics.h"
+#include "primitive.h"
+#include "utils.h"
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_ARRAY_DIMENSIONS 8
+#define MAX_ARRAY_LENGTH (1 << 20)
+
+typedef struct {
+    const char *name;
+    OperandFormat operands;
+    int pops;
+    int pushes;
+} OpcodeInfo;
+
+#define BYTECODE_OP_INFO(name, operands, pops, pushes) {#name, operands, pops, pushes},
+static const OpcodeInfo opcodeInfo[OP_COUNT] = {
+    BYTECODE_OPS(BYTECODE_OP_INFO)
+};
+#undef BYTECODE_OP_INFO
+
+const char *opcodeName(Opcode op){
+    return op < OP_COUNT ? opcodeInfo[op].name : "?";
+}
+
+OperandFormat opcodeOperands(Opcode op){
+    return opcodeInfo[op].operands;
+}
+
+static uint16_t readU16(const uint8_t *p){
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t readU32(const uint8_t *p){
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+int instructionLength(const uint8_t *code, int offset){
+    switch(opcodeInfo[code[offset]].operands){
+        case OPERANDS_NONE: return 1;
+        case OPERANDS_U8: return 2;
+        case OPERANDS_U16: return 3;
+        case OPERANDS_U16_U16:
+        case OPERANDS_U32:
+        case OPERANDS_JUMP: return 5;
+        case OPERANDS_PRINT: return 2 + code[offset + 1];
+    }
+    return 1;
+}
+
+VMValue primitiveToVMValue(PrimitiveType type, PrimitiveValue value){
+    VMValue v;
+    v.i = 0;
+    switch(type){
+        case TYPE_BOOL: v.i = value.boolVal; break;
+        case TYPE_BYTE:
+        case TYPE_UNSIGNED_CHAR: v.u = value.uCharVal; break;
+        case TYPE_SIGNED_CHAR: v.i = value.signedCharVal; break;
+        case TYPE_CHAR: v.i = value.charVal; break;
+        case TYPE_SHORT: v.i = value.shortVal; break;
+        case TYPE_USHORT: v.u = value.uShortVal; break;
+        case TYPE_INT: v.i = value.intVal; break;
+        case TYPE_UINT: v.u = value.uIntVal; break;
+        case TYPE_LONG: v.i = value.longVal; break;
+        case TYPE_ULONG: v.u = value.uLongVal; break;
+        case TYPE_LONG_LONG: v.i = value.longLongVal; break;
+        case TYPE_ULONG_LONG: v.u = value.uLongLongVal; break;
+        case TYPE_ARCH: v.i = value.archVal; break;
+        case TYPE_UNSIGNED_ARCH: v.u = value.uArchVal; break;
+        case TYPE_FLOAT: v.f = value.floatVal; break;
+        case TYPE_DOUBLE: v.f = value.doubleVal; break;
+        case TYPE_LONG_DOUBLE: v.f = (double)value.longDoubleVal; break;
+        case TYPE_STRING: v.s = value.stringVal; break;
+    }
+    return v;
+}
+
+PrimitiveValue vmValueToPrimitive(PrimitiveType type, VMValue v){
+    PrimitiveValue value;
+    memset(&value, 0, sizeof(value));
+    switch(type){
+        case TYPE_BOOL: value.boolVal = v.i != 0; break;
+        case TYPE_BYTE:
+        case TYPE_UNSIGNED_CHAR: value.uCharVal = (unsigned char)v.u; break;
+        case TYPE_SIGNED_CHAR: value.signedCharVal = (signed char)v.i; break;
+        case TYPE_CHAR: value.charVal = (char)v.i; break;
+        case TYPE_SHORT: value.shortVal = (short)v.i; break;
+        case TYPE_USHORT: value.uShortVal = (unsigned short)v.u; break;
+        case TYPE_INT: value.intVal = (int)v.i; break;
+        case TYPE_UINT: value.uIntVal = (unsigned int)v.u; break;
+        case TYPE_LONG: value.longVal = (long)v.i; break;
+        case TYPE_ULONG: value.uLongVal = (unsigned long)v.u; break;
+        case TYPE_LONG_LONG: value.longLongVal = v.i; break;
+        case TYPE_ULONG_LONG: value.uLongLongVal = v.u; break;
+        case TYPE_ARCH: value.archVal = (intptr_t)v.i; break;
+        case TYPE_UNSIGNED_ARCH: value.uArchVal = (uintptr_t)v.u; break;
+        case TYPE_FLOAT: value.floatVal = (float)v.f; break;
+        case TYPE_DOUBLE: value.doubleVal = v.f; break;
+        case TYPE_LONG_DOUBLE: value.longDoubleVal = v.f; break;
+        case TYPE_STRING: value.stringVal = (char *)v.s; break;
+    }
+    return value;
+}
+
+int findBytecodeFunction(const BytecodeModule *module, const char *name){
+    for(int i = 1; i < module->functionCount; i++){
+        if(strcmp(module->functions[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+const BytecodeHandler *findBytecodeHandler(const BytecodeFunction *fn, int offset, PrimitiveType type){
+    for(int i = 0; i < fn->handlerCount; i++){
+        const BytecodeHandler *h = &fn->handlers[i];
+        if(offset >= h->start && offset < h->end && (h->type < 0 || h->type == (int)type)) return h;
+    }
+    return NULL;
+}
+
+static bool fail(char *error, size_t errorSize, const char *format, ...){
+    if(error && errorSize > 0){
+        va_list args;
+        va_start(args, format);
+        vsnprintf(error, errorSize, format, args);
+        va_end(args);
+    }
+    return false;
+}
+
+static BytecodeModule *newModule(void){
+    BytecodeModule *module = calloc(1, sizeof(BytecodeModule));
+    if(module) module->mainFunction = -1;
+    return module;
+}
+
+// NULL when out of memory.
+static BytecodeFunction *addFunction(BytecodeModule *module, const char *name){
+    char *copy = strdup(name);
+    if(!copy || !GROW(module->functions, module->functionCount, module->functionCapacity)){
+        free(copy);
+        return NULL;
+    }
+    BytecodeFunction *fn = &module->functions[module->functionCount++];
+    memset(fn, 0, sizeof(*fn));
+    fn->name = copy;
+    fn->returnType = TYPE_INT;
+    fn->returnsVoid = true;
+    return fn;
+}
+
+void freeBytecodeModule(BytecodeModule *module){
+    if(!module) return;
+    for(int i = 0; i < module->functionCount; i++){
+        free(module->functions[i].name);
+        free(module->functions[i].paramTypes);
+        free(module->functions[i].code);
+        free(module->functions[i].handlers);
+    }
+    for(int i = 0; i < module->constantCount; i++){
+        if(module->constants[i].type == TYPE_STRING) free((char *)module->constants[i].value.s);
+    }
+    for(int i = 0; i < module->globalCount; i++){
+        free(module->globals[i].name);
+    }
+    free(module->functions);
+    free(module->constants);
+    free(module->globals);
+    free(module);
+}
+
+// Compiler
+
+typedef enum {
+    SYMBOL_VARIABLE,
+    SYMBOL_CONSTANT             // enum value, slot is its constant
+} SymbolKind;
+
+typedef struct {
+    const char *name;
+    SymbolKind kind;
+    PrimitiveType type;
+    bool global;
+    bool typed;                 // an untyped variable keeps the type of its initializer
+    bool atomic;                // a global whose every access is one atomic instruction
+    int slot;
+    int dims[MAX_ARRAY_DIMENSIONS];
+    int dimCount;               // 0 for a scalar
+    int length;
+} Symbol;
+
+typedef struct {
+    int *sites;
+    int count;
+    int capacity;
+    int depth;                  // stack depth expected at the target
+} PatchList;
+
+// A label and its gotos have to be in the same compound expression, 0 for
+// none, so the stack holds the same operands at each; uses.depth is that
+// depth, set by whichever of them comes first.
+typedef struct {
+    const char *name;
+    int target;                 // -1 until the label is reached
+    int compound;
+    bool placed;                // compound and uses.depth are set
+    PatchList uses;
+} Label;
+
+typedef struct {
+    BytecodeFunction *fn;
+    int nextSlot;
+    int depth;
+    int lastOp;                 // offset of the last instruction emitted
+    int lastTarget;             // last offset a jump lands on
+    bool topLevel;
+    bool returnTyped;           // the top level's return type is set by its first return
+    int tryDepth;               // try blocks open around the code being compiled
+    int sharedSlots;            // in a parallel loop body, the slots every chunk gets a copy of
+    int compound;               // innermost compound expression being compiled, numbered from 1
+    int compoundCount;
+    PatchList *breaks;
+    int breakCount;
+    int breakCapacity;
+    PatchList *continues;
+    int continueCount;
+    int continueCapacity;
+    Label *labels;
+    int labelCount;
+    int labelCapacity;
+} FunctionState;
+
+typedef struct {
+    BytecodeModule *module;
+    FunctionState fs;
+    Symbol *symbols;
+    int symbolCount;
+    int symbolCapacity;
+    int parallelCount;
+    char *error;
+    size_t errorSize;
+    jmp_buf *outOfMemory;       // where compileBytecode resumes when an allocation fails
+} Compiler;
+
+static bool compileError(Compiler *c, const char *format, ...){
+    if(c->error && c->errorSize > 0){
+        va_list args;
+        va_start(args, format);
+        vsnprintf(c->error, c->errorSize, format, args);
+        va_end(args);
+    }
+    return false;
+}
+
+static _Noreturn void outOfMemory(Compiler *c){
+    longjmp(*c->outOfMemory, 1);
+}
+
+static void adjustDepth(Compiler *c, int delta){
+    c->fs.depth += delta;
+    if(c->fs.depth > c->fs.fn->maxStack) c->fs.fn->maxStack = c->fs.depth;
+}
+
+static void emitByte(Compiler *c, uint8_t byte){
+    BytecodeFunction *fn = c->fs.fn;
+    if(!GROW(fn->code, fn->codeSize, fn->codeCapacity)) outOfMemory(c);
+    fn->code[fn->codeSize++] = byte;
+}
+
+static void emitU16(Compiler *c, uint16_t value){
+    emitByte(c, value & 0xFF);
+    emitByte(c, value >> 8);
+}
+
+static void emitU32(Compiler *c, uint32_t value){
+    for(int i = 0; i < 4; i++){
+        emitByte(c, (value >> (8 * i)) & 0xFF);
+    }
+}
+
+static void writeU32At(Compiler *c, int offset, uint32_t value){
+    for(int i = 0; i < 4; i++){
+        c->fs.fn->code[offset + i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+// Stack effects that depend on the operands are adjusted by the caller.
+static void emitOp(Compiler *c, Opcode op){
+    c->fs.lastOp = c->fs.fn->codeSize;
+    emitByte(c, op);
+    if(opcodeInfo[op].pops > 0) adjustDepth(c, -opcodeInfo[op].pops);
+    if(opcodeInfo[op].pushes > 0) adjustDepth(c, opcodeInfo[op].pushes);
+}
+
+static bool emitOpU16(Compiler *c, Opcode op, int operand){
+    if(operand < 0 || operand > UINT16_MAX) return compileError(c, "too many slots, constants or functions for the bytecode");
+    emitOp(c, op);
+    emitU16(c, (uint16_t)operand);
+    return true;
+}
+
+static void emitOpU8(Compiler *c, Opcode op, int operand){
+    emitOp(c, op);
+    emitByte(c, (uint8_t)operand);
+}
+
+// Statement context drops a value just stored by turning the store into its
+// popping form, unless something jumps to the point between the two.
+static void emitPop(Compiler *c){
+    BytecodeFunction *fn = c->fs.fn;
+    if(c->fs.lastOp >= 0 && c->fs.lastTarget != fn->codeSize){
+        uint8_t *last = &fn->code[c->fs.lastOp];
+        Opcode popping = OP_COUNT;
+        switch(*last){
+            case OP_STORE: popping = OP_STORE_POP; break;
+            case OP_STORE_GLOBAL: popping = OP_STORE_GLOBAL_POP; break;
+            case OP_STORE_INDEXED: popping = OP_STORE_INDEXED_POP; break;
+            case OP_STORE_GLOBAL_INDEXED: popping = OP_STORE_GLOBAL_INDEXED_POP; break;
+            default: break;
+        }
+        if(popping != OP_COUNT){
+            *last = popping;
+            adjustDepth(c, -1);
+            return;
+        }
+    }
+    emitOp(c, OP_POP);
+}
+
+static int markTarget(Compiler *c){
+    c->fs.lastTarget = c->fs.fn->codeSize;
+    return c->fs.fn->codeSize;
+}
+
+static int emitJump(Compiler *c, Opcode op){
+    emitOp(c, op);
+    int site = c->fs.fn->codeSize;
+    emitU32(c, 0);
+    return site;
+}
+
+static void patchJumpTo(Compiler *c, int site, int target){
+    writeU32At(c, site, (uint32_t)(int32_t)(target - (site + 4)));
+}
+
+static void patchJump(Compiler *c, int site){
+    patchJumpTo(c, site, markTarget(c));
+}
+
+static void emitJumpTo(Compiler *c, Opcode op, int target){
+    patchJumpTo(c, emitJump(c, op), target);
+}
+
+static void addPatch(Compiler *c, PatchList *list, int site){
+    if(!GROW(list->sites, list->count, list->capacity)) outOfMemory(c);
+    list->sites[list->count++] = site;
+}
+
+static void patchAll(Compiler *c, PatchList *list, int target){
+    for(int i = 0; i < list->count; i++){
+        patchJumpTo(c, list->sites[i], target);
+    }
+}
+
+static int addConstant(Compiler *c, PrimitiveType type, VMValue value){
+    BytecodeModule *module = c->module;
+    // the default return of a string function is the empty string
+    if(type == TYPE_STRING && !value.s) value.s = "";
+    for(int i = 0; i < module->constantCount; i++){
+        BytecodeConstant *k = &module->constants[i];
+        if(k->type != type) continue;
+        if(type == TYPE_STRING ? strcmp(k->value.s, value.s) == 0 : k->value.u == value.u) return i;
+    }
+    if(!GROW(module->constants, module->constantCount, module->constantCapacity)) outOfMemory(c);
+    BytecodeConstant *k = &module->constants[module->constantCount];
+    k->type = type;
+    k->value = value;
+    if(type == TYPE_STRING) k->value.s = strdup(value.s);
+    return module->constantCount++;
+}
+
+static bool emitConstant(Compiler *c, PrimitiveType type, VMValue value){
+    return emitOpU16(c, OP_CONST, addConstant(c, type, value));
+}
+
+static bool emitInteger(Compiler *c, PrimitiveType type, long long n){
+    return emitConstant(c, type, primitiveToVMValue(type, primitiveFromLongLong(type, n)));
+}
+
+static bool emitString(Compiler *c, const char *s){
+    VMValue v;
+    v.s = s;
+    return emitConstant(c, TYPE_STRING, v);
+}
+
+// Scopes
+
+static Symbol *defineSymbol(Compiler *c, const char *name, SymbolKind kind, PrimitiveType type){
+    if(!GROW(c->symbols, c->symbolCount, c->symbolCapacity)) outOfMemory(c);
+    Symbol *symbol = &c->symbols[c->symbolCount++];
+    memset(symbol, 0, sizeof(*symbol));
+    symbol->name = name;
+    symbol->kind = kind;
+    symbol->type = type;
+    symbol->typed = true;
+    symbol->length = 1;
+    return symbol;
+}
+
+static Symbol *lookupSymbol(Compiler *c, const char *name){
+    for(int i = c->symbolCount - 1; i >= 0; i--){
+        if(strcmp(c->symbols[i].name, name) == 0) return &c->symbols[i];
+    }
+    return NULL;
+}
+
+static bool allocateSlots(Compiler *c, Symbol *symbol, bool global){
+    symbol->global = global;
+    if(global){
+        symbol->slot = c->module->globalSlots;
+        c->module->globalSlots += symbol->length;
+        if(c->module->globalSlots > UINT16_MAX) return compileError(c, "too many global slots for the bytecode");
+
+        BytecodeModule *module = c->module;
+        if(!GROW(module->globals, module->globalCount, module->globalCapacity)) outOfMemory(c);
+        BytecodeGlobal *g = &module->globals[module->globalCount++];
+        g->name = strdup(symbol->name);
+        if(!g->name) outOfMemory(c);
+        g->type = symbol->type;
+        g->slot = symbol->slot;
+        g->length = symbol->dimCount > 0 ? symbol->length : 0;
+        return true;
+    }
+    symbol->slot = c->fs.nextSlot;
+    c->fs.nextSlot += symbol->length;
+    if(c->fs.nextSlot > UINT16_MAX) return compileError(c, "too many local slots in %s", c->fs.fn->name);
+    if(c->fs.nextSlot > c->fs.fn->localCount) c->fs.fn->localCount = c->fs.nextSlot;
+    return true;
+}
+
+typedef struct {
+    int symbolCount;
+    int nextSlot;
+} Scope;
+
+static Scope enterScope(Compiler *c){
+    Scope scope = {c->symbolCount, c->fs.nextSlot};
+    return scope;
+}
+
+static void leaveScope(Compiler *c, Scope scope){
+    c->symbolCount = scope.symbolCount;
+    c->fs.nextSlot = scope.nextSlot;
+}
+
+// Types
+
+static bool isVoidType(ASTNode *node){
+    return node && (node->type == VOID_NODE || (node->type == IDENTIFIER_NODE && strcmp(node->identifier.name, "void") == 0));
+}
+
+static bool resolvePrimitive(Compiler *c, ASTNode *node, PrimitiveType *out){
+    if(!typeNodeToPrimitive(node, out)) return compileError(c, "only primitive types are compiled to bytecode");
+    if(*out == TYPE_LONG_DOUBLE) return compileError(c, "long double is not compiled to bytecode");
+    return true;
+}
+
+static bool isWide(PrimitiveType type){
+    return primitiveSize(type) == 8;
+}
+
+static bool isUnsignedInteger(PrimitiveType type){
+    return isIntegerType(type) && !isSignedType(type);
+}
+
+static Opcode wrapOp(PrimitiveType type){
+    if(!isIntegerType(type) || isWide(type)) return OP_COUNT;
+
+    bool isSigned = isSignedType(type);
+    switch(primitiveSize(type)){
+        case 1: return isSigned ? OP_WRAP_I8 : OP_WRAP_U8;
+        case 2: return isSigned ? OP_WRAP_I16 : OP_WRAP_U16;
+        default: return isSigned ? OP_WRAP_I32 : OP_WRAP_U32;
+    }
+}
+
+static void emitWrap(Compiler *c, PrimitiveType type){
+    Opcode op = wrapOp(type);
+    if(op != OP_COUNT) emitOp(c, op);
+}
+
+static bool emitConversion(Compiler *c, PrimitiveType from, PrimitiveType to){
+    if(from == to) return true;
+    if(from == TYPE_STRING || to == TYPE_STRING) return compileError(c, "cannot convert %s to %s", primitiveTypeName(from), primitiveTypeName(to));
+
+    if(to == TYPE_BOOL){
+        emitOp(c, isFloatingType(from) ? OP_TO_BOOL_F : OP_TO_BOOL);
+    } else if(isFloatingType(to)){
+        if(!isFloatingType(from)) emitOp(c, isUnsignedInteger(from) && isWide(from) ? OP_U2F : OP_I2F);
+        if(to == TYPE_FLOAT) emitOp(c, OP_FROUND);
+    } else if(isFloatingType(from)){
+        emitOpU8(c, OP_F2I, to);
+    } else if(from != TYPE_BOOL){
+        size_t fromSize = primitiveSize(from);
+        size_t toSize = primitiveSize(to);
+        bool fromSigned = isSignedType(from);
+        bool toSigned = isSignedType(to);
+        if(toSize < fromSize || (fromSigned && !toSigned) || (toSize == fromSize && fromSigned != toSigned)) emitWrap(c, to);
+    }
+    return true;
+}
+
+// Expressions
+
+static bool compileExpr(Compiler *c, ASTNode *node, bool *hasValue, PrimitiveType *type);
+static bool compileStatement(Compiler *c, ASTNode *node);
+static bool compileList(Compiler *c, ASTNode **items, int count);
+
+static bool compileValue(Compiler *c, ASTNode *node, PrimitiveType *type){
+    bool hasValue;
+    if(!compileExpr(c, node, &hasValue, type)) return false;
+    if(!hasValue) return compileError(c, "expression has no value");
+    return true;
+}
+
+static bool compileValueAs(Compiler *c, ASTNode *node, PrimitiveType type){
+    PrimitiveType actual;
+    return compileValue(c, node, &actual) && emitConversion(c, actual, type);
+}
+
+// Leaves 0 or 1 on the stack.
+static bool compileCondition(Compiler *c, ASTNode *node){
+    PrimitiveType type;
+    if(!compileValue(c, node, &type)) return false;
+    if(type == TYPE_STRING) return compileError(c, "a string is not a condition");
+    if(isFloatingType(type)) emitOp(c, OP_TO_BOOL_F);
+    return true;
+}
+
+static bool emitArithmetic(Compiler *c, BinaryOpType op, PrimitiveType type){
+    bool floating = isFloatingType(type);
+    bool isUnsigned = isUnsignedInteger(type);
+    bool int32 = isSignedType(type) && primitiveSize(type) == 4;
+    switch(op){
+        case ADD_BINOP:
+        case SUB_BINOP:
+        case MUL_BINOP: {
+            static const Opcode ops[3][3] = {
+                {OP_ADD_F, OP_ADD_I32, OP_ADD_I64},
+                {OP_SUB_F, OP_SUB_I32, OP_SUB_I64},
+                {OP_MUL_F, OP_MUL_I32, OP_MUL_I64}
+            };
+            int row = op == ADD_BINOP ? 0 : op == SUB_BINOP ? 1 : 2;
+            if(floating){
+                emitOp(c, ops[row][0]);
+                if(type == TYPE_FLOAT) emitOp(c, OP_FROUND);
+            } else if(int32){
+                emitOp(c, ops[row][1]);
+            } else{
+                emitOp(c, ops[row][2]);
+                emitWrap(c, type);
+            }
+            return true;
+        }
+        case DIV_BINOP:
+            if(floating){
+                emitOp(c, OP_DIV_F);
+                if(type == TYPE_FLOAT) emitOp(c, OP_FROUND);
+            } else if(isUnsigned){
+                emitOp(c, OP_DIV_U);
+            } else{
+                emitOp(c, OP_DIV_I);
+                emitWrap(c, type);
+            }
+            return true;
+        case MOD_BINOP: emitOp(c, isUnsigned ? OP_MOD_U : OP_MOD_I); return true;
+        case BIT_AND_BINOP: emitOp(c, OP_BIT_AND); return true;
+        case BIT_OR_BINOP: emitOp(c, OP_BIT_OR); return true;
+        case BIT_XOR_BINOP: emitOp(c, OP_BIT_XOR); return true;
+        case SHIFT_LEFT_BINOP:
+            emitOpU8(c, OP_SHL, (int)primitiveSize(type) * 8);
+            emitWrap(c, type);
+            return true;
+        case SHIFT_RIGHT_BINOP:
+            emitOpU8(c, isSignedType(type) ? OP_SHR_I : OP_SHR_U, (int)primitiveSize(type) * 8);
+            return true;
+        case EQU_BINOP: emitOp(c, floating ? OP_EQ_F : OP_EQ_I); return true;
+        case NOT_EQU_BINOP: emitOp(c, floating ? OP_NE_F : OP_NE_I); return true;
+        case LESS_BINOP: emitOp(c, floating ? OP_LT_F : isUnsigned ? OP_LT_U : OP_LT_I); return true;
+        case LESS_EQU_BINOP: emitOp(c, floating ? OP_LE_F : isUnsigned ? OP_LE_U : OP_LE_I); return true;
+        case GREATER_BINOP: emitOp(c, floating ? OP_GT_F : isUnsigned ? OP_GT_U : OP_GT_I); return true;
+        case GREATER_EQU_BINOP: emitOp(c, floating ? OP_GE_F : isUnsigned ? OP_GE_U : OP_GE_I); return true;
+        default:
+            return compileError(c, "operator not supported for %s", primitiveTypeName(type));
+    }
+}
+
+// Both operands are on the stack, the right one on top.
+static bool emitBinaryOperator(Compiler *c, BinaryOpType op, PrimitiveType leftType, PrimitiveType rightType, PrimitiveType *type){
+    if(leftType == TYPE_STRING || rightType == TYPE_STRING) return compileError(c, "string operators are not compiled to bytecode");
+
+    PrimitiveType operandType;
+    if(op == SHIFT_LEFT_BINOP || op == SHIFT_RIGHT_BINOP){
+        if(!isIntegerType(rightType)) return compileError(c, "operator not supported for %s", primitiveTypeName(leftType));
+        operandType = leftType;
+        if(!emitConversion(c, rightType, TYPE_LONG_LONG)) return false;
+    } else{
+        operandType = promotePrimitiveTypes(leftType, rightType);
+        if(leftType != operandType){
+            emitOp(c, OP_SWAP);
+            if(!emitConversion(c, leftType, operandType)) return false;
+            emitOp(c, OP_SWAP);
+        }
+        if(!emitConversion(c, rightType, operandType)) return false;
+    }
+    if(!primitiveBinaryHandlers[operandType][op]) return compileError(c, "operator not supported for %s", primitiveTypeName(operandType));
+
+    *type = isComparisonOp(op) ? TYPE_BOOL : operandType;
+    return emitArithmetic(c, op, operandType);
+}
+
+static bool compileLogical(Compiler *c, ASTNode *node){
+    if(!compileCondition(c, node->binaryOp.left)) return false;
+    emitOp(c, OP_TO_BOOL);
+    emitOp(c, OP_DUP);
+    int skip = emitJump(c, node->binaryOp.op == AND_BINOP ? OP_JUMP_IF_FALSE : OP_JUMP_IF_TRUE);
+    emitOp(c, OP_POP);
+    if(!compileCondition(c, node->binaryOp.right)) return false;
+    emitOp(c, OP_TO_BOOL);
+    patchJump(c, skip);
+    return true;
+}
+
+static bool compileBinary(Compiler *c, ASTNode *node, PrimitiveType *type){
+    BinaryOpType op = node->binaryOp.op;
+    if(op == AND_BINOP || op == OR_BINOP){
+        *type = TYPE_BOOL;
+        return compileLogical(c, node);
+    }
+    if(op == COMMA_BINOP){
+        bool hasValue;
+        PrimitiveType ignored;
+        if(!compileExpr(c, node->binaryOp.left, &hasValue, &ignored)) return false;
+        if(hasValue) emitPop(c);
+        return compileValue(c, node->binaryOp.right, type);
+    }
+
+    PrimitiveType leftType, rightType;
+    if(!compileValue(c, node->binaryOp.left, &leftType)) return false;
+    if(!compileValue(c, node->binaryOp.right, &rightType)) return false;
+    return emitBinaryOperator(c, op, leftType, rightType, type);
+}
+
+static bool compileTernary(Compiler *c, ASTNode *node, PrimitiveType *type){
+    PrimitiveType trueType, falseType;
+    if(!compileCondition(c, node->ternaryOp.condition)) return false;
+    int otherwise = emitJump(c, OP_JUMP_IF_FALSE);
+    int depth = c->fs.depth;
+
+    if(!compileValue(c, node->ternaryOp.trueExpr, &trueType)) return false;
+    int done = emitJump(c, OP_JUMP);
+    c->fs.depth = depth;
+    patchJump(c, otherwise);
+    if(!compileValue(c, node->ternaryOp.falseExpr, &falseType)) return false;
+
+    if((trueType == TYPE_STRING) != (falseType == TYPE_STRING)) return compileError(c, "branches of a conditional have different types");
+    *type = trueType == falseType ? trueType : promotePrimitiveTypes(trueType, falseType);
+    if(!emitConversion(c, falseType, *type)) return false;
+    if(trueType != *type){
+        // the true branch converts in a stub after the false one
+        int skip = emitJump(c, OP_JUMP);
+        c->fs.depth = depth + 1;
+        patchJump(c, done);
+        if(!emitConversion(c, trueType, *type)) return false;
+        done = skip;
+    }
+    patchJump(c, done);
+    return true;
+}
+
+// A place is a scalar variable, or an array element whose flat index is on the stack.
+typedef struct {
+    Symbol *symbol;
+    bool indexed;
+} Place;
+
+static bool compileIndex(Compiler *c, ASTNode *node, Symbol **out){
+    ASTNode *accesses[MAX_ARRAY_DIMENSIONS];
+    int count = 0;
+    ASTNode *base = node;
+    while(base->type == ARRAY_ACCESS_NODE){
+        if(count == MAX_ARRAY_DIMENSIONS) return compileError(c, "too many array dimensions");
+        accesses[count++] = base;
+        base = base->arrayAccess.array;
+    }
+    if(base->type != IDENTIFIER_NODE) return compileError(c, "only named arrays are compiled to bytecode");
+
+    Symbol *symbol = lookupSymbol(c, base->identifier.name);
+    if(!symbol || symbol->kind != SYMBOL_VARIABLE) return compileError(c, "unknown array '%s'", base->identifier.name);
+    if(symbol->dimCount != count) return compileError(c, "'%s' is indexed with %d subscripts but has %d dimensions", symbol->name, count, symbol->dimCount);
+
+    for(int k = 0; k < count; k++){
+        ASTNode *access = accesses[count - 1 - k];
+        PrimitiveType indexType;
+        if(k > 0){
+            if(!emitInteger(c, TYPE_LONG_LONG, symbol->dims[k])) return false;
+            emitOp(c, OP_MUL_I64);
+        }
+        if(!compileValue(c, access->arrayAccess.index, &indexType)) return false;
+        if(!isIntegerType(indexType) && indexType != TYPE_BOOL) return compileError(c, "array index is not an integer");
+        if(!emitConversion(c, indexType, TYPE_LONG_LONG)) return false;
+        if(!access->arrayAccess.inBounds){
+            emitOp(c, OP_CHECK_INDEX);
+            emitU32(c, (uint32_t)symbol->dims[k]);
+        }
+        if(k > 0) emitOp(c, OP_ADD_I64);
+    }
+    *out = symbol;
+    return true;
+}
+
+// A parallel loop body writes to a copy of the enclosing locals, which the
+// other chunks and the code after the loop would never see.
+static bool checkWritable(Compiler *c, const Symbol *symbol){
+    if(symbol->global || symbol->slot >= c->fs.sharedSlots) return true;
+    return compileError(c, "parallel for body assigns '%s', which belongs to the loop or the code around it", symbol->name);
+}
+
+static bool compilePlace(Compiler *c, ASTNode *node, Place *place){
+    place->indexed = false;
+    if(node->type == ARRAY_ACCESS_NODE){
+        place->indexed = true;
+        return compileIndex(c, node, &place->symbol) && checkWritable(c, place->symbol);
+    }
+    if(node->type != IDENTIFIER_NODE) return compileError(c, "only variables and array elements are assigned in bytecode");
+
+    Symbol *symbol = lookupSymbol(c, node->identifier.name);
+    if(!symbol) return compileError(c, "unknown variable '%s'", node->identifier.name);
+    if(symbol->kind != SYMBOL_VARIABLE) return compileError(c, "'%s' is not a variable", symbol->name);
+    if(symbol->dimCount > 0) return compileError(c, "array '%s' is assigned as a whole", symbol->name);
+    place->symbol = symbol;
+    return checkWritable(c, symbol);
+}
+
+static Opcode loadOp(const Symbol *symbol, bool indexed){
+    if(symbol->atomic) return indexed ? OP_ATOMIC_LOAD_INDEXED : OP_ATOMIC_LOAD;
+    if(symbol->global) return indexed ? OP_LOAD_GLOBAL_INDEXED : OP_LOAD_GLOBAL;
+    return indexed ? OP_LOAD_INDEXED : OP_LOAD;
+}
+
+static Opcode storeOp(const Symbol *symbol, bool indexed){
+    if(symbol->atomic) return indexed ? OP_ATOMIC_STORE_INDEXED : OP_ATOMIC_STORE;
+    if(symbol->global) return indexed ? OP_STORE_GLOBAL_INDEXED : OP_STORE_GLOBAL;
+    return indexed ? OP_STORE_INDEXED : OP_STORE;
+}
+
+// Keeps the index of an indexed place on the stack below the value.
+static bool emitLoadPlace(Compiler *c, const Place *place){
+    if(place->indexed) emitOp(c, OP_DUP);
+    return emitOpU16(c, loadOp(place->symbol, place->indexed), place->symbol->slot);
+}
+
+static bool emitStorePlace(Compiler *c, const Place *place){
+    return emitOpU16(c, storeOp(place->symbol, place->indexed), place->symbol->slot);
+}
+
+static bool checkStoredType(Compiler *c, const Place *place, PrimitiveType type){
+    if(!place->symbol->typed && type != place->symbol->type) return compileError(c, "untyped variable '%s' changes type", place->symbol->name);
+    return true;
+}
+
+static BinaryOpType assignmentOperator(AssignmentOpType op){
+    switch(op){
+        case ADD_AND_ASSIGN: return ADD_BINOP;
+        case SUB_AND_ASSIGN: return SUB_BINOP;
+        case MUL_AND_ASSIGN: return MUL_BINOP;
+        case DIV_AND_ASSIGN: return DIV_BINOP;
+        case MOD_AND_ASSIGN: return MOD_BINOP;
+        case AND_AND_ASSIGN: return BIT_AND_BINOP;
+        case OR_AND_ASSIGN: return BIT_OR_BINOP;
+        case XOR_AND_ASSIGN: return BIT_XOR_BINOP;
+        case SHIFT_LEFT_AND_ASSIGN: return SHIFT_LEFT_BINOP;
+        case SHIFT_RIGHT_AND_ASSIGN: return SHIFT_RIGHT_BINOP;
+        default: return COMMA_BINOP;
+    }
+}
+
+static AtomicOp atomicOperator(AssignmentOpType op){
+    switch(op){
+        case ADD_AND_ASSIGN: return ATOMIC_ADD;
+        case SUB_AND_ASSIGN: return ATOMIC_SUB;
+        case MUL_AND_ASSIGN: return ATOMIC_MUL;
+        case DIV_AND_ASSIGN: return ATOMIC_DIV;
+        case MOD_AND_ASSIGN: return ATOMIC_MOD;
+        case AND_AND_ASSIGN: return ATOMIC_AND;
+        case OR_AND_ASSIGN: return ATOMIC_OR;
+        case XOR_AND_ASSIGN: return ATOMIC_XOR;
+        case SHIFT_LEFT_AND_ASSIGN: return ATOMIC_SHL;
+        case SHIFT_RIGHT_AND_ASSIGN: return ATOMIC_SHR;
+        default: return ATOMIC_OP_COUNT;
+    }
+}
+
+static bool emitAtomicUpdate(Compiler *c, const Place *place, AtomicOp op, AtomicKind kind){
+    if(!emitOpU16(c, place->indexed ? OP_ATOMIC_UPDATE_INDEXED : OP_ATOMIC_UPDATE, place->symbol->slot)) return false;
+    emitU16(c, ATOMIC_OPERATION(op, kind));
+    return true;
+}
+
+// The update happens in the variable's type, so the operand is converted
+// to it first. Sums, products and bitwise results wrap the same whatever
+// integer width they are computed in; the other operators take no operand
+// the variable's type cannot hold.
+static bool compileAtomicAssignment(Compiler *c, const Place *place, AssignmentOpType assignOp, ASTNode *right, PrimitiveType *type){
+    PrimitiveType target = place->symbol->type;
+    BinaryOpType op = assignmentOperator(assignOp);
+    AtomicOp atomicOp = atomicOperator(assignOp);
+    AtomicKind kind;
+    PrimitiveType rightType;
+    if(!atomicKindOf(target, &kind) || !primitiveBinaryHandlers[target][op]) return compileError(c, "operator not supported for atomic %s", primitiveTypeName(target));
+    if(!compileValue(c, right, &rightType)) return false;
+
+    if(op == SHIFT_LEFT_BINOP || op == SHIFT_RIGHT_BINOP){
+        if(!isIntegerType(rightType)) return compileError(c, "operator not supported for %s", primitiveTypeName(target));
+        if(!emitConversion(c, rightType, TYPE_LONG_LONG)) return false;
+    } else{
+        bool wraps = op == ADD_BINOP || op == SUB_BINOP || op == MUL_BINOP || op == BIT_AND_BINOP || op == BIT_OR_BINOP || op == BIT_XOR_BINOP;
+        if(!(wraps && isIntegerType(target) && isIntegerType(rightType)) && promotePrimitiveTypes(target, rightType) != target){
+            return compileError(c, "atomic '%s' is updated with a %s operand", place->symbol->name, primitiveTypeName(rightType));
+        }
+        if(!emitConversion(c, rightType, target)) return false;
+    }
+    *type = target;
+    return emitAtomicUpdate(c, place, atomicOp, kind);
+}
+
+static bool compileAssignment(Compiler *c, ASTNode *node, PrimitiveType *type){
+    Place place;
+    PrimitiveType valueType;
+    if(!compilePlace(c, node->assignment.left, &place)) return false;
+    if(place.symbol->atomic && node->assignment.op != SIMPLE_ASSIGN) return compileAtomicAssignment(c, &place, node->assignment.op, node->assignment.right, type);
+
+    if(node->assignment.op == SIMPLE_ASSIGN){
+        if(!compileValue(c, node->assignment.right, &valueType)) return false;
+    } else{
+        PrimitiveType rightType;
+        if(!emitLoadPlace(c, &place)) return false;
+        if(!compileValue(c, node->assignment.right, &rightType)) return false;
+        if(!emitBinaryOperator(c, assignmentOperator(node->assignment.op), place.symbol->type, rightType, &valueType)) return false;
+    }
+    if(!checkStoredType(c, &place, valueType)) return false;
+    if(!emitConversion(c, valueType, place.symbol->type)) return false;
+    *type = place.symbol->type;
+    return emitStorePlace(c, &place);
+}
+
+static bool emitStep(Compiler *c, PrimitiveType type, bool increment){
+    BinaryOpType op = increment ? ADD_BINOP : SUB_BINOP;
+    if(!primitiveBinaryHandlers[type][op]) return compileError(c, "operator not supported for %s", primitiveTypeName(type));
+    if(!emitInteger(c, type, 1)) return false;
+    return emitArithmetic(c, op, type);
+}
+
+// A postfix step whose value is unused compiles as the prefix form.
+static bool compileIncrement(Compiler *c, ASTNode *node, bool valueUsed, PrimitiveType *type){
+    UnaryOpType op = node->unaryOp.op;
+    bool increment = op == PRE_INCREMENT_UNOP || op == POST_INCREMENT_UNOP;
+    bool postfix = valueUsed && (op == POST_INCREMENT_UNOP || op == POST_DECREMENT_UNOP);
+    Place place;
+    if(!compilePlace(c, node->unaryOp.expr, &place)) return false;
+    if(place.symbol->type == TYPE_STRING) return compileError(c, "operator not supported for string");
+    *type = place.symbol->type;
+    if(place.symbol->atomic){
+        AtomicKind kind;
+        if(!atomicKindOf(*type, &kind)) return compileError(c, "operator not supported for atomic %s", primitiveTypeName(*type));
+        if(!emitInteger(c, *type, 1)) return false;
+        AtomicOp step = postfix ? (increment ? ATOMIC_FETCH_ADD : ATOMIC_FETCH_SUB) : (increment ? ATOMIC_ADD : ATOMIC_SUB);
+        return emitAtomicUpdate(c, &place, step, kind);
+    }
+    if(!emitLoadPlace(c, &place)) return false;
+
+    if(!postfix){
+        if(!emitStep(c, *type, increment)) return false;
+        return emitStorePlace(c, &place);
+    }
+    if(!place.indexed){
+        emitOp(c, OP_DUP);
+        if(!emitStep(c, *type, increment)) return false;
+        if(!emitStorePlace(c, &place)) return false;
+        emitPop(c);
+        return true;
+    }
+
+    // the old value waits in a scratch slot while the index is consumed
+    int scratch = c->fs.nextSlot++;
+    if(c->fs.nextSlot > c->fs.fn->localCount) c->fs.fn->localCount = c->fs.nextSlot;
+    if(!emitOpU16(c, OP_STORE, scratch)) return false;
+    if(!emitStep(c, *type, increment)) return false;
+    if(!emitStorePlace(c, &place)) return false;
+    emitPop(c);
+    c->fs.nextSlot--;
+    return emitOpU16(c, OP_LOAD, scratch);
+}
+
+static bool compileSizeOf(Compiler *c, ASTNode *operand, PrimitiveType *type){
+    PrimitiveType primitive;
+    size_t size;
+    Symbol *symbol = operand->type == IDENTIFIER_NODE ? lookupSymbol(c, operand->identifier.name) : NULL;
+    *type = TYPE_UNSIGNED_ARCH;
+    if(operand->type == IDENTIFIER_NODE && !symbol && typeNodeToPrimitive(operand, &primitive)){
+        size = primitiveSize(primitive);
+    } else if(symbol && symbol->dimCount > 0){
+        size = (size_t)symbol->length * primitiveSize(symbol->type);
+    } else if(operand->type == LITERAL_NODE || operand->type == POINTER_NODE || operand->type == ARRAY_NODE || operand->type == STRUCT_NODE){
+        return compileError(c, "sizeof of this operand is not compiled to bytecode");
+    } else{
+        if(!compileValue(c, operand, &primitive)) return false;
+        emitPop(c);
+        size = primitiveSize(primitive);
+    }
+    return emitInteger(c, TYPE_UNSIGNED_ARCH, (long long)size);
+}
+
+static bool compileUnary(Compiler *c, ASTNode *node, bool valueUsed, PrimitiveType *type){
+    UnaryOpType op = node->unaryOp.op;
+    switch(op){
+        case PRE_INCREMENT_UNOP:
+        case POST_INCREMENT_UNOP:
+        case PRE_DECREMENT_UNOP:
+        case POST_DECREMENT_UNOP:
+            return compileIncrement(c, node, valueUsed, type);
+        case SIZE_OF_UNOP:
+            return compileSizeOf(c, node->unaryOp.expr, type);
+        case DEFERENCE_UNOP:
+        case ADDRESS_OF_UNOP:
+            return compileError(c, "pointers are not compiled to bytecode");
+        default:
+            break;
+    }
+
+    PrimitiveType operand;
+    if(!compileValue(c, node->unaryOp.expr, &operand)) return false;
+    if(operand == TYPE_STRING || !primitiveUnaryHandlers[operand][op]) return compileError(c, "operator not supported for %s", primitiveTypeName(operand));
+
+    *type = operand;
+    switch(op){
+        case NEGATIVE_UNOP:
+            if(isFloatingType(operand)){
+                emitOp(c, OP_NEG_F);
+            } else if(isSignedType(operand) && primitiveSize(operand) == 4){
+                emitOp(c, OP_NEG_I32);
+            } else{
+                emitOp(c, OP_NEG_I64);
+                emitWrap(c, operand);
+            }
+            return true;
+        case NOT_UNOP:
+            *type = TYPE_BOOL;
+            emitOp(c, isFloatingType(operand) ? OP_NOT_F : OP_NOT);
+            return true;
+        case BIT_NOT_UNOP:
+            emitOp(c, OP_BIT_NOT);
+            if(!isSignedType(operand)) emitWrap(c, operand);
+            return true;
+        default:
+            return true;
+    }
+}
+
+static bool compilePrint(Compiler *c, ASTNode *node){
+    int count = node->functionCall.argsCount;
+    PrimitiveType types[UINT8_MAX];
+    if(count > UINT8_MAX) return compileError(c, "too many arguments to print");
+
+    for(int i = 0; i < count; i++){
+        if(!compileValue(c, node->functionCall.args[i], &types[i])) return false;
+    }
+    emitOpU8(c, OP_PRINT, count);
+    for(int i = 0; i < count; i++){
+        emitByte(c, types[i]);
+    }
+    adjustDepth(c, -count);
+    return true;
+}
+
+static bool compileArguments(Compiler *c, ASTNode *node, const BytecodeFunction *callee){
+    if(node->functionCall.argsCount != callee->paramCount){
+        return compileError(c, "%s expects %d arguments, got %d", callee->name, callee->paramCount, node->functionCall.argsCount);
+    }
+    for(int i = 0; i < callee->paramCount; i++){
+        if(!compileValueAs(c, node->functionCall.args[i], callee->paramTypes[i])) return false;
+    }
+    return true;
+}
+
+static int calleeIndex(Compiler *c, ASTNode *node){
+    ASTNode *callee = node->functionCall.function;
+    if(callee->type != IDENTIFIER_NODE || lookupSymbol(c, callee->identifier.name)) return -1;
+    return findBytecodeFunction(c->module, callee->identifier.name);
+}
+
+static bool compileCall(Compiler *c, ASTNode *node, bool *hasValue, PrimitiveType *type){
+    ASTNode *callee = node->functionCall.function;
+    int index = calleeIndex(c, node);
+    if(index < 0){
+        if(callee->type == IDENTIFIER_NODE && !lookupSymbol(c, callee->identifier.name) && strcmp(callee->identifier.name, "print") == 0){
+            *hasValue = false;
+            return compilePrint(c, node);
+        }
+        return compileError(c, "only calls of top-level functions are compiled to bytecode");
+    }
+
+    if(!compileArguments(c, node, &c->module->functions[index])) return false;
+    if(!emitOpU16(c, OP_CALL, index)) return false;
+
+    const BytecodeFunction *fn = &c->module->functions[index];
+    adjustDepth(c, -fn->paramCount);
+    *hasValue = !fn->returnsVoid;
+    *type = fn->returnType;
+    if(*hasValue) adjustDepth(c, 1);
+    return true;
+}
+
+static bool compileCompound(Compiler *c, ASTNode *node, bool *hasValue, PrimitiveType *type){
+    Scope scope = enterScope(c);
+    int count = node->compoundExpr.stmtCount;
+    *hasValue = false;
+    int outer = c->fs.compound;
+    c->fs.compound = ++c->fs.compoundCount;
+    for(int i = 0; i < count; i++){
+        ASTNode *stmt = node->compoundExpr.statements[i];
+        bool ok = i == count - 1 && stmt->type != DECLARATION_NODE ? compileExpr(c, stmt, hasValue, type) : compileStatement(c, stmt);
+        if(!ok) return false;
+    }
+    c->fs.compound = outer;
+    leaveScope(c, scope);
+    return true;
+}
+
+static bool compileIdentifier(Compiler *c, ASTNode *node, PrimitiveType *type){
+    Symbol *symbol = lookupSymbol(c, node->identifier.name);
+    if(!symbol){
+        if(findBytecodeFunction(c->module, node->identifier.name) >= 0) return compileError(c, "function values are not compiled to bytecode");
+        return compileError(c, "unknown identifier '%s'", node->identifier.name);
+    }
+    *type = symbol->type;
+    if(symbol->kind == SYMBOL_CONSTANT) return emitOpU16(c, OP_CONST, symbol->slot);
+    if(symbol->dimCount > 0) return compileError(c, "array '%s' is used as a value", symbol->name);
+    return emitOpU16(c, loadOp(symbol, false), symbol->slot);
+}
+
+static bool compileExprInContext(Compiler *c, ASTNode *node, bool valueUsed, bool *hasValue, PrimitiveType *type){
+    *hasValue = true;
+    switch(node->type){
+        case LITERAL_NODE:
+            *type = node->literal.type;
+            if(*type == TYPE_LONG_DOUBLE) return compileError(c, "long double is not compiled to bytecode");
+            if(*type == TYPE_STRING) return emitString(c, node->literal.value.stringVal);
+            return emitConstant(c, *type, primitiveToVMValue(*type, node->literal.value));
+        case IDENTIFIER_NODE:
+            return compileIdentifier(c, node, type);
+        case ARRAY_ACCESS_NODE: {
+            Symbol *symbol;
+            if(!compileIndex(c, node, &symbol)) return false;
+            *type = symbol->type;
+            return emitOpU16(c, loadOp(symbol, true), symbol->slot);
+        }
+        case ASSIGNMENT_NODE:
+            return compileAssignment(c, node, type);
+        case UNARY_OPERATION_NODE:
+            return compileUnary(c, node, valueUsed, type);
+        case BINARY_OPERATION_NODE:
+            return compileBinary(c, node, type);
+        case TERNARY_OPERATION_NODE:
+            return compileTernary(c, node, type);
+        case CAST_EXPR_NODE: {
+            PrimitiveType from;
+            if(!resolvePrimitive(c, node->castExpr.targetType, type)) return false;
+            return compileValue(c, node->castExpr.value, &from) && emitConversion(c, from, *type);
+        }
+        case FUNCTION_CALL_NODE:
+            return compileCall(c, node, hasValue, type);
+        case COMPOUND_EXPR_NODE:
+            return compileCompound(c, node, hasValue, type);
+        case SIZEOF_NODE:
+            return compileSizeOf(c, node->sizeOfExpr.expr, type);
+        case TYPEOF_NODE: {
+            bool operandHasValue;
+            PrimitiveType operand;
+            if(!compileExpr(c, node->typeOfExpr.expr, &operandHasValue, &operand)) return false;
+            if(operandHasValue) emitPop(c);
+            *type = TYPE_STRING;
+            return emitString(c, operandHasValue ? primitiveTypeName(operand) : "any");
+        }
+        case NULL_NODE:
+        case MALLOC_NODE:
+        case CALLOC_NODE:
+        case REALLOC_NODE:
+        case FREE_NODE:
+        case MEMCPY_NODE:
+        case MEMSET_NODE:
+        case MEMMOVE_NODE:
+            return compileError(c, "pointers are not compiled to bytecode");
+        case FIELD_ACCESS_NODE:
+        case ARRAY_NODE:
+            return compileError(c, "aggregates are not compiled to bytecode");
+        case FUNCTION_NODE:
+        case LAMBDA_NODE:
+            return compileError(c, "nested functions are not compiled to bytecode");
+        default:
+            *hasValue = false;
+            return compileStatement(c, node);
+    }
+}
+
+static bool compileExpr(Compiler *c, ASTNode *node, bool *hasValue, PrimitiveType *type){
+    return compileExprInContext(c, node, true, hasValue, type);
+}
+
+static bool compileDiscarded(Compiler *c, ASTNode *node){
+    bool hasValue;
+    PrimitiveType type;
+    if(!compileExprInContext(c, node, false, &hasValue, &type)) return false;
+    if(hasValue) emitPop(c);
+    return true;
+}
+
+// Declarations
+
+static bool arrayShape(Compiler *c, ASTNode *varType, ASTNode *init, Symbol *symbol){
+    ASTNode *t = varType;
+    while(t->type == ARRAY_NODE){
+        if(symbol->dimCount == MAX_ARRAY_DIMENSIONS) return compileError(c, "too many array dimensions");
+
+        long long length;
+        ASTNode *size = t->array.size;
+        if(size && size->type == LITERAL_NODE && primitiveToLongLong(size->literal.type, size->literal.value, &length) && length > 0){
+            // sized by its literal
+        } else if(!size && symbol->dimCount == 0 && init && init->type == ARRAY_NODE && init->array.elementsCount > 0){
+            length = init->array.elementsCount;
+        } else{
+            return compileError(c, "only arrays of constant size are compiled to bytecode");
+        }
+        if(length > MAX_ARRAY_LENGTH / symbol->length) return compileError(c, "array '%s' is too large for the bytecode", symbol->name);
+        symbol->dims[symbol->dimCount++] = (int)length;
+        symbol->length *= (int)length;
+        t = t->array.typeOfElement;
+    }
+    return resolvePrimitive(c, t, &symbol->type);
+}
+
+static bool storeElements(Compiler *c, Symbol *symbol, ASTNode *list, int level, int offset){
+    int stride = 1;
+    for(int k = level + 1; k < symbol->dimCount; k++){
+        stride *= symbol->dims[k];
+    }
+    if(list->array.elementsCount > symbol->dims[level]) return compileError(c, "too many initializers for an array of %d elements", symbol->dims[level]);
+
+    for(int i = 0; i < list->array.elementsCount; i++){
+        ASTNode *element = list->array.elements[i];
+        int slot = offset + i * stride;
+        if(level + 1 < symbol->dimCount){
+            if(element->type != ARRAY_NODE) return compileError(c, "invalid array initializer");
+            if(!storeElements(c, symbol, element, level + 1, slot)) return false;
+            continue;
+        }
+        if(!compileValueAs(c, element, symbol->type)) return false;
+        if(!emitOpU16(c, symbol->global ? OP_STORE_GLOBAL_POP : OP_STORE_POP, symbol->slot + slot)) return false;
+    }
+    return true;
+}
+
+static bool compileDeclaration(Compiler *c, ASTNode *node, bool global){
+    ASTNode *varType = node->declaration.varType;
+    ASTNode *init = node->declaration.initializer;
+    if((node->declaration.storageFlags & STORAGE_STATIC) && !global) return compileError(c, "static locals are not compiled to bytecode");
+
+    Symbol shape;
+    memset(&shape, 0, sizeof(shape));
+    shape.name = node->declaration.varName;
+    shape.kind = SYMBOL_VARIABLE;
+    shape.typed = varType != NULL;
+    shape.length = 1;
+    // only globals are shared between threads; a local stays in its frame
+    shape.atomic = global && (node->declaration.storageFlags & STORAGE_ATOMIC);
+
+    if(varType && varType->type == ARRAY_NODE){
+        if(!arrayShape(c, varType, init, &shape)) return false;
+        if(init && init->type != ARRAY_NODE) return compileError(c, "invalid array initializer");
+    } else if(varType){
+        if(!resolvePrimitive(c, varType, &shape.type)) return false;
+    } else if(!init){
+        return compileError(c, "untyped variable '%s' has no initializer", shape.name);
+    }
+
+    // the initializer does not see the variable it initializes
+    if(shape.dimCount == 0 && init){
+        PrimitiveType initType;
+        if(!compileValue(c, init, &initType)) return false;
+        if(!varType) shape.type = initType;
+        if(!emitConversion(c, initType, shape.type)) return false;
+    }
+
+    Symbol *symbol = defineSymbol(c, shape.name, SYMBOL_VARIABLE, shape.type);
+    *symbol = shape;
+    if(!allocateSlots(c, symbol, global)) return false;
+
+    if(shape.dimCount == 0){
+        if(init) return emitOpU16(c, global ? OP_STORE_GLOBAL_POP : OP_STORE_POP, symbol->slot);
+        if(global) return true;
+    }
+    // locals are cleared on every entry, globals once when the program starts
+    if(!global){
+        if(!emitOpU16(c, OP_CLEAR, symbol->slot)) return false;
+        emitU16(c, (uint16_t)symbol->length);
+    }
+    return !init || storeElements(c, symbol, init, 0, 0);
+}
+
+static bool declareEnum(Compiler *c, ASTNode *node){
+    for(int i = 0; i < node->enumDef.valuesCount; i++){
+        int value = node->enumDef.intValues ? node->enumDef.intValues[i] : i;
+        VMValue v;
+        v.i = value;
+        Symbol *symbol = defineSymbol(c, node->enumDef.values[i], SYMBOL_CONSTANT, TYPE_INT);
+        symbol->slot = addConstant(c, TYPE_INT, v);
+    }
+    return true;
+}
+
+// Statements
+
+static PatchList *pushPatchList(Compiler *c, PatchList **lists, int *count, int *capacity, int depth){
+    if(!GROW(*lists, *count, *capacity)) outOfMemory(c);
+    PatchList *list = &(*lists)[(*count)++];
+    memset(list, 0, sizeof(*list));
+    list->depth = depth;
+    return list;
+}
+
+static void pushLoop(Compiler *c){
+    pushPatchList(c, &c->fs.breaks, &c->fs.breakCount, &c->fs.breakCapacity, c->fs.depth);
+    pushPatchList(c, &c->fs.continues, &c->fs.continueCount, &c->fs.continueCapacity, c->fs.depth);
+}
+
+static void popPatchList(Compiler *c, PatchList *lists, int *count, int target){
+    PatchList *list = &lists[--(*count)];
+    patchAll(c, list, target);
+    free(list->sites);
+}
+
+static bool emitBranch(Compiler *c, PatchList *lists, int count, const char *what){
+    if(count == 0) return compileError(c, "%s outside of a loop or switch", what);
+    PatchList *list = &lists[count - 1];
+    if(list->depth != c->fs.depth) return compileError(c, "%s out of an expression is not compiled to bytecode", what);
+    addPatch(c, list, emitJump(c, OP_JUMP));
+    return true;
+}
+
+static bool compileScoped(Compiler *c, ASTNode **body, int count){
+    Scope scope = enterScope(c);
+    if(!compileList(c, body, count)) return false;
+    leaveScope(c, scope);
+    return true;
+}
+
+static bool compileIf(Compiler *c, ASTNode *node){
+    if(!compileCondition(c, node->ifStmt.condition)) return false;
+    int otherwise = emitJump(c, OP_JUMP_IF_FALSE);
+    if(!compileScoped(c, &node->ifStmt.thenBranch, 1)) return false;
+    if(!node->ifStmt.elseBranch){
+        patchJump(c, otherwise);
+        return true;
+    }
+    int done = emitJump(c, OP_JUMP);
+    patchJump(c, otherwise);
+    if(!compileScoped(c, &node->ifStmt.elseBranch, 1)) return false;
+    patchJump(c, done);
+    return true;
+}
+
+// Loops test their condition at the bottom so an iteration takes one branch.
+static bool compileLoop(Compiler *c, ASTNode *condition, ASTNode *increment, ASTNode **body, int bodyCount, bool testFirst){
+    int test = testFirst && condition ? emitJump(c, OP_JUMP) : -1;
+    int top = markTarget(c);
+    pushLoop(c);
+    if(!compileScoped(c, body, bodyCount)) return false;
+
+    int next = markTarget(c);
+    popPatchList(c, c->fs.continues, &c->fs.continueCount, next);
+    if(increment && !compileDiscarded(c, increment)) return false;
+    if(test >= 0) patchJump(c, test);
+    if(condition){
+        if(!compileCondition(c, condition)) return false;
+        emitJumpTo(c, OP_JUMP_IF_TRUE, top);
+    } else{
+        emitJumpTo(c, OP_JUMP, top);
+    }
+    popPatchList(c, c->fs.breaks, &c->fs.breakCount, markTarget(c));
+    return true;
+}
+
+static bool compileParallelFor(Compiler *c, ASTNode *node);
+static void beginFunction(Compiler *c, BytecodeFunction *fn, bool topLevel);
+static bool endFunction(Compiler *c, bool ok);
+
+static bool compileFor(Compiler *c, ASTNode *node){
+    if(node->forStmt.parallel) return compileParallelFor(c, node);
+    Scope scope = enterScope(c);
+    if(node->forStmt.initializer && !compileStatement(c, node->forStmt.initializer)) return false;
+    if(!compileLoop(c, node->forStmt.condition, node->forStmt.increment, node->forStmt.body, node->forStmt.bodyCount, true)) return false;
+    leaveScope(c, scope);
+    return true;
+}
+
+static bool compileSwitch(Compiler *c, ASTNode *node){
+    PrimitiveType valueType;
+    Scope scope = enterScope(c);
+    int count = node->switchStmt.caseCount;
+    int *entries = calloc(count > 0 ? count : 1, sizeof(int));
+    if(!entries) outOfMemory(c);
+
+    bool ok = compileValue(c, node->switchStmt.expr, &valueType);
+    int scratch = c->fs.nextSlot++;
+    if(c->fs.nextSlot > c->fs.fn->localCount) c->fs.fn->localCount = c->fs.nextSlot;
+    ok = ok && emitOpU16(c, OP_STORE_POP, scratch);
+
+    // cases are tested in order, then the default, as the evaluator does
+    for(int i = 0; ok && i < count; i++){
+        ASTNode *caseNode = node->switchStmt.cases[i];
+        PrimitiveType caseType, ignored;
+        if(caseNode->type != CASE_NODE) continue;
+        ok = emitOpU16(c, OP_LOAD, scratch) && compileValue(c, caseNode->caseStmt.value, &caseType) && emitBinaryOperator(c, EQU_BINOP, valueType, caseType, &ignored);
+        if(ok) entries[i] = emitJump(c, OP_JUMP_IF_TRUE);
+    }
+    int fallback = -1;
+    for(int i = 0; ok && i < count; i++){
+        if(node->switchStmt.cases[i]->type == DEFAULT_NODE){
+            fallback = i;
+            entries[i] = emitJump(c, OP_JUMP);
+            break;
+        }
+    }
+    pushPatchList(c, &c->fs.breaks, &c->fs.breakCount, &c->fs.breakCapacity, c->fs.depth);
+    if(ok && fallback < 0) addPatch(c, &c->fs.breaks[c->fs.breakCount - 1], emitJump(c, OP_JUMP));
+
+    for(int i = 0; ok && i < count; i++){
+        ASTNode *caseNode = node->switchStmt.cases[i];
+        if(caseNode->type == CASE_NODE){
+            patchJump(c, entries[i]);
+            ok = compileList(c, caseNode->caseStmt.body, caseNode->caseStmt.bodyCount);
+        } else if(caseNode->type == DEFAULT_NODE){
+            patchJump(c, entries[i]);
+            ok = compileList(c, caseNode->defaultStmt.body, caseNode->defaultStmt.bodyCount);
+        }
+    }
+    free(entries);
+    popPatchList(c, c->fs.breaks, &c->fs.breakCount, markTarget(c));
+    leaveScope(c, scope);
+    return ok;
+}
+
+static Label *findLabel(Compiler *c, const char *name){
+    for(int i = 0; i < c->fs.labelCount; i++){
+        if(strcmp(c->fs.labels[i].name, name) == 0) return &c->fs.labels[i];
+    }
+    if(!GROW(c->fs.labels, c->fs.labelCount, c->fs.labelCapacity)) outOfMemory(c);
+    Label *label = &c->fs.labels[c->fs.labelCount++];
+    memset(label, 0, sizeof(*label));
+    label->name = name;
+    label->target = -1;
+    return label;
+}
+
+// Where the label or a goto to it is compiled has to match the others.
+static bool placeLabel(Compiler *c, Label *label){
+    if(!label->placed){
+        label->placed = true;
+        label->compound = c->fs.compound;
+        label->uses.depth = c->fs.depth;
+    }
+    if(label->compound != c->fs.compound || label->uses.depth != c->fs.depth) return compileError(c, "goto into or out of an expression is not compiled to bytecode");
+    return true;
+}
+
+static bool compileReturn(Compiler *c, ASTNode *node){
+    BytecodeFunction *fn = c->fs.fn;
+    ASTNode *value = node->returnStmt.value;
+    if(c->fs.sharedSlots > 0) return compileError(c, "return out of a parallel for");
+    if(!value){
+        if(!fn->returnsVoid && !c->fs.topLevel) return compileError(c, "%s returns without a value", fn->name);
+        emitOp(c, OP_RETURN_VOID);
+        return true;
+    }
+
+    // a tail call would leave the handlers of an enclosing try behind
+    int callee = value->type == FUNCTION_CALL_NODE && value->functionCall.isTailCall && !c->fs.topLevel && c->fs.tryDepth == 0 ? calleeIndex(c, value) : -1;
+    if(callee >= 0){
+        const BytecodeFunction *target = &c->module->functions[callee];
+        if(target->returnsVoid == fn->returnsVoid && (fn->returnsVoid || target->returnType == fn->returnType)){
+            if(!compileArguments(c, value, target)) return false;
+            if(!emitOpU16(c, OP_TAILCALL, callee)) return false;
+            adjustDepth(c, -target->paramCount);
+            return true;
+        }
+    }
+
+    if(fn->returnsVoid && !c->fs.topLevel){
+        bool hasValue;
+        PrimitiveType ignored;
+        if(!compileExpr(c, value, &hasValue, &ignored)) return false;
+        if(hasValue) return compileError(c, "void function %s returns a value", fn->name);
+        emitOp(c, OP_RETURN_VOID);
+        return true;
+    }
+
+    PrimitiveType type;
+    if(!compileValue(c, value, &type)) return false;
+    if(c->fs.topLevel && !c->fs.returnTyped){
+        fn->returnType = type;
+        c->fs.returnTyped = true;
+    }
+    if(!emitConversion(c, type, fn->returnType)) return false;
+    emitOp(c, OP_RETURN);
+    return true;
+}
+
+static bool compileCatch(Compiler *c, ASTNode *node, int start, int end){
+    ASTNode *var = node->catchStmt.exceptionVar;
+    PrimitiveType type = TYPE_INT;
+    if(var && (var->type != DECLARATION_NODE || !var->declaration.varType)) return compileError(c, "catch variables need a declared type in bytecode");
+    if(var && !resolvePrimitive(c, var->declaration.varType, &type)) return false;
+
+    BytecodeFunction *fn = c->fs.fn;
+    if(!GROW(fn->handlers, fn->handlerCount, fn->handlerCapacity)) outOfMemory(c);
+    fn->handlers[fn->handlerCount++] = (BytecodeHandler){start, end, markTarget(c), var ? (int)type : -1};
+    adjustDepth(c, 1);
+
+    Scope scope = enterScope(c);
+    if(var){
+        Symbol *symbol = defineSymbol(c, var->declaration.varName, SYMBOL_VARIABLE, type);
+        if(!allocateSlots(c, symbol, false) || !emitOpU16(c, OP_STORE_POP, symbol->slot)) return false;
+    } else{
+        emitPop(c);
+    }
+    if(!compileList(c, node->catchStmt.body, node->catchStmt.bodyCount)) return false;
+    leaveScope(c, scope);
+    return true;
+}
+
+// A try block emits no code of its own: its catches go into the function's
+// handler table, which only a throw ever reads.
+static bool compileTry(Compiler *c, ASTNode *node){
+    if(c->fs.depth != 0) return compileError(c, "try inside an expression is not compiled to bytecode");
+    int start = c->fs.fn->codeSize;
+    c->fs.tryDepth++;
+    bool ok = compileScoped(c, node->tryStmt.tryBlock, node->tryStmt.tryBlockCount);
+    c->fs.tryDepth--;
+    int end = c->fs.fn->codeSize;
+
+    PatchList done = {0};
+    if(ok) addPatch(c, &done, emitJump(c, OP_JUMP));
+    for(int i = 0; ok && i < node->tryStmt.catchCount; i++){
+        ASTNode *catchNode = node->tryStmt.catchBlock[i];
+        if(catchNode->type != CATCH_NODE) continue;
+        ok = compileCatch(c, catchNode, start, end);
+        if(ok) addPatch(c, &done, emitJump(c, OP_JUMP));
+    }
+    if(ok) patchAll(c, &done, markTarget(c));
+    free(done.sites);
+    return ok;
+}
+
+static bool compileThrow(Compiler *c, ASTNode *node){
+    PrimitiveType type;
+    if(!node->throwStmt.exceptionExpr) return compileError(c, "throw without a value");
+    if(!compileValue(c, node->throwStmt.exceptionExpr, &type)) return false;
+    emitOpU8(c, OP_THROW, type);
+    return true;
+}
+
+// The loop variable of a parallel for and its bounds, from
+// for(i = start; i < end; i++) or the <= and += 1 forms.
+typedef struct {
+    const char *name;
+    ASTNode *varType;
+    ASTNode *start;
+    ASTNode *end;
+    bool inclusive;
+} ParallelRange;
+
+static bool isNamed(ASTNode *node, const char *name){
+    return node && node->type == IDENTIFIER_NODE && strcmp(node->identifier.name, name) == 0;
+}
+
+static bool matchParallelRange(ASTNode *node, ParallelRange *range){
+    ASTNode *init = node->forStmt.initializer;
+    ASTNode *cond = node->forStmt.condition;
+    ASTNode *step = node->forStmt.increment;
+    if(!init || !cond || !step) return false;
+
+    // the loop declares its variable, so nothing sees it after the loop
+    if(init->type != DECLARATION_NODE || !init->declaration.varType || !init->declaration.initializer) return false;
+    range->name = init->declaration.varName;
+    range->varType = init->declaration.varType;
+    range->start = init->declaration.initializer;
+
+    if(cond->type != BINARY_OPERATION_NODE || !isNamed(cond->binaryOp.left, range->name)) return false;
+    if(cond->binaryOp.op != LESS_BINOP && cond->binaryOp.op != LESS_EQU_BINOP) return false;
+    range->end = cond->binaryOp.right;
+    range->inclusive = cond->binaryOp.op == LESS_EQU_BINOP;
+
+    if(step->type == UNARY_OPERATION_NODE){
+        return (step->unaryOp.op == PRE_INCREMENT_UNOP || step->unaryOp.op == POST_INCREMENT_UNOP) && isNamed(step->unaryOp.expr, range->name);
+    }
+    long long one;
+    return step->type == ASSIGNMENT_NODE && step->assignment.op == ADD_AND_ASSIGN && isNamed(step->assignment.left, range->name) &&
+           step->assignment.right->type == LITERAL_NODE && primitiveToLongLong(step->assignment.right->literal.type, step->assignment.right->literal.value, &one) && one == 1;
+}
+
+// The body becomes a function over one chunk [lo, hi). Its parameters
+// mirror the enclosing frame slot for slot, then come lo, which the loop
+// variable starts at, and hi, so symbols keep their slots inside it.
+static bool compileParallelBody(Compiler *c, ASTNode *node, const ParallelRange *range, PrimitiveType type){
+    FunctionState outer = c->fs;
+    Scope scope = enterScope(c);
+    int shared = outer.nextSlot;
+    char name[64];
+    snprintf(name, sizeof(name), "%s.parallel%d", outer.fn->name, c->parallelCount++);
+
+    BytecodeFunction *fn = addFunction(c->module, name);
+    if(!fn) outOfMemory(c);
+    fn->paramCount = shared + 2;
+    fn->paramTypes = malloc((size_t)fn->paramCount * sizeof(PrimitiveType));
+    if(!fn->paramTypes) outOfMemory(c);
+    for(int i = 0; i < shared; i++){
+        fn->paramTypes[i] = TYPE_LONG_LONG;
+    }
+    for(int i = 0; i < c->symbolCount; i++){
+        Symbol *s = &c->symbols[i];
+        if(s->kind != SYMBOL_VARIABLE || s->global || s->slot >= shared) continue;
+        for(int k = 0; k < s->length && s->slot + k < shared; k++){
+            fn->paramTypes[s->slot + k] = s->type;
+        }
+    }
+    fn->paramTypes[shared] = type;
+    fn->paramTypes[shared + 1] = TYPE_LONG_LONG;
+
+    beginFunction(c, fn, false);
+    c->fs.nextSlot = fn->localCount = fn->paramCount;
+    c->fs.sharedSlots = fn->paramCount;
+    Symbol *var = defineSymbol(c, range->name, SYMBOL_VARIABLE, type);
+    var->slot = shared;
+
+    int test = emitJump(c, OP_JUMP);
+    int top = markTarget(c);
+    pushLoop(c);
+    bool ok = compileScoped(c, node->forStmt.body, node->forStmt.bodyCount);
+    if(ok && c->fs.breaks[c->fs.breakCount - 1].count > 0) ok = compileError(c, "break out of a parallel for");
+    if(ok){
+        popPatchList(c, c->fs.continues, &c->fs.continueCount, markTarget(c));
+        ok = emitOpU16(c, OP_LOAD, shared) && emitStep(c, type, true) && emitOpU16(c, OP_STORE_POP, shared);
+    }
+    if(ok){
+        // bounds are sign or zero extended like every integer, so one 64-bit
+        // comparison serves all loop variable types
+        patchJump(c, test);
+        ok = emitOpU16(c, OP_LOAD, shared) && emitOpU16(c, OP_LOAD, shared + 1);
+        emitOp(c, OP_LT_I);
+        emitJumpTo(c, OP_JUMP_IF_TRUE, top);
+        popPatchList(c, c->fs.breaks, &c->fs.breakCount, markTarget(c));
+    }
+    ok = endFunction(c, ok);
+
+    leaveScope(c, scope);
+    c->fs = outer;
+    return ok;
+}
+
+// Iterations run in any order on any thread. The bounds are evaluated once
+// and the loop variable belongs to the loop, as in OpenMP; the body may
+// read the enclosing locals but only write its own locals and globals.
+static bool compileParallelFor(Compiler *c, ASTNode *node){
+    ParallelRange range;
+    if(!matchParallelRange(node, &range)) return compileError(c, "parallel for needs the form for(int i = start; i < end; i++)");
+
+    PrimitiveType type, startType, endType;
+    if(!resolvePrimitive(c, range.varType, &type)) return false;
+    if(!isIntegerType(type) || (isUnsignedInteger(type) && isWide(type))) return compileError(c, "parallel for needs a loop variable of a signed or narrower integer type");
+
+    if(!compileValue(c, range.start, &startType)) return false;
+    if(!emitConversion(c, startType, type) || !emitConversion(c, type, TYPE_LONG_LONG)) return false;
+    if(!compileValue(c, range.end, &endType)) return false;
+    if(!isIntegerType(endType) && endType != TYPE_BOOL) return compileError(c, "parallel for bound is not an integer");
+    if(!emitConversion(c, endType, TYPE_LONG_LONG)) return false;
+    if(range.inclusive && (!emitInteger(c, TYPE_LONG_LONG, 1) || !emitArithmetic(c, ADD_BINOP, TYPE_LONG_LONG))) return false;
+
+    int index = c->module->functionCount;
+    if(!compileParallelBody(c, node, &range, type)) return false;
+    return emitOpU16(c, OP_PARALLEL_FOR, index);
+}
+
+static bool compileStatement(Compiler *c, ASTNode *node){
+    if(!node) return true;
+
+    switch(node->type){
+        case DECLARATION_NODE:
+            return compileDeclaration(c, node, false);
+        case BLOCK_NODE:
+            return compileScoped(c, node->block.statements, node->block.stmtCount);
+        case IF_NODE:
+            return compileIf(c, node);
+        case WHILE_NODE:
+            return compileLoop(c, node->whileStmt.condition, NULL, node->whileStmt.body, node->whileStmt.bodyCount, true);
+        case DO_WHILE_NODE:
+            return compileLoop(c, node->doWhileStmt.condition, NULL, node->doWhileStmt.body, node->doWhileStmt.bodyCount, false);
+        case FOR_NODE:
+            return compileFor(c, node);
+        case SWITCH_NODE:
+            return compileSwitch(c, node);
+        case BREAK_NODE:
+            return emitBranch(c, c->fs.breaks, c->fs.breakCount, "break");
+        case CONTINUE_NODE:
+            return emitBranch(c, c->fs.continues, c->fs.continueCount, "continue");
+        case RETURN_NODE:
+            return compileReturn(c, node);
+        case LABEL_NODE: {
+            Label *label = findLabel(c, node->labelStmt.labelName);
+            if(label->target >= 0) return compileError(c, "label '%s' is defined twice", label->name);
+            if(!placeLabel(c, label)) return false;
+            label->target = markTarget(c);
+            return true;
+        }
+        case JUMP_NODE: {
+            Label *label = findLabel(c, node->jumpStmt.labelName);
+            if(!placeLabel(c, label)) return false;
+            addPatch(c, &label->uses, emitJump(c, OP_JUMP));
+            return true;
+        }
+        case ENUM_NODE:
+            return declareEnum(c, node);
+        case STRUCT_NODE:
+        case UNION_NODE:
+        case TYPEDEF_NODE:
+        case INCLUDE_NODE:
+            return true;
+        case TRY_NODE:
+            return compileTry(c, node);
+        case THROW_NODE:
+            return compileThrow(c, node);
+        case CATCH_NODE:
+            return compileError(c, "catch outside of a try");
+        case IMPL_NODE:
+            return compileError(c, "methods are not compiled to bytecode");
+        case CASE_NODE:
+        case DEFAULT_NODE:
+            return compileError(c, "case outside of a switch");
+        default:
+            return compileDiscarded(c, node);
+    }
+}
+
+static bool compileList(Compiler *c, ASTNode **items, int count){
+    for(int i = 0; i < count; i++){
+        if(!compileStatement(c, items[i])) return false;
+    }
+    return true;
+}
+
+// Functions
+
+static void beginFunction(Compiler *c, BytecodeFunction *fn, bool topLevel){
+    memset(&c->fs, 0, sizeof(c->fs));
+    c->fs.fn = fn;
+    c->fs.lastOp = -1;
+    c->fs.lastTarget = -1;
+    c->fs.topLevel = topLevel;
+}
+
+// ok is false when the body failed, whose error is kept.
+static bool endFunction(Compiler *c, bool ok){
+    BytecodeFunction *fn = c->fs.fn;
+    if(fn->returnsVoid || c->fs.topLevel){
+        emitOp(c, OP_RETURN_VOID);
+    } else{
+        // falling off the end of a typed function returns zero
+        ok = ok && emitInteger(c, fn->returnType, 0);
+        emitOp(c, OP_RETURN);
+    }
+
+    for(int i = 0; i < c->fs.labelCount; i++){
+        Label *label = &c->fs.labels[i];
+        if(ok && label->target < 0) ok = compileError(c, "label '%s' is not defined in %s", label->name, fn->name);
+        if(ok) patchAll(c, &label->uses, label->target);
+        free(label->uses.sites);
+    }
+    for(int i = 0; i < c->fs.breakCount; i++){
+        free(c->fs.breaks[i].sites);
+    }
+    for(int i = 0; i < c->fs.continueCount; i++){
+        free(c->fs.continues[i].sites);
+    }
+    free(c->fs.labels);
+    free(c->fs.breaks);
+    free(c->fs.continues);
+    return ok;
+}
+
+static bool declareFunction(Compiler *c, ASTNode *node){
+    const char *name = node->functionDef.name;
+    if(!name) return compileError(c, "anonymous functions are not compiled to bytecode");
+    if(findBytecodeFunction(c->module, name) >= 0) return compileError(c, "function %s is defined twice", name);
+
+    ASTNode *returnType = node->functionDef.returnType;
+    PrimitiveType type = TYPE_INT;
+    if(!returnType) return compileError(c, "%s has no declared return type", name);
+    if(!isVoidType(returnType) && !resolvePrimitive(c, returnType, &type)) return false;
+
+    BytecodeFunction *fn = addFunction(c->module, name);
+    if(!fn) outOfMemory(c);
+    fn->returnsVoid = isVoidType(returnType);
+    fn->returnType = type;
+    fn->paramCount = node->functionDef.paramCount;
+    fn->paramTypes = calloc(fn->paramCount > 0 ? fn->paramCount : 1, sizeof(PrimitiveType));
+    if(!fn->paramTypes) outOfMemory(c);
+
+    for(int i = 0; i < fn->paramCount; i++){
+        ASTNode *param = node->functionDef.params[i];
+        if(param->type != DECLARATION_NODE || !param->declaration.varType) return compileError(c, "parameters of %s need declared types", name);
+        if(param->declaration.varType->type == ARRAY_NODE) return compileError(c, "array parameters are not compiled to bytecode");
+        if(!resolvePrimitive(c, param->declaration.varType, &fn->paramTypes[i])) return false;
+    }
+    return true;
+}
+
+static bool compileFunction(Compiler *c, ASTNode *node){
+    int index = findBytecodeFunction(c->module, node->functionDef.name);
+    BytecodeFunction *fn = &c->module->functions[index];
+    FunctionState outer = c->fs;
+    Scope scope = enterScope(c);
+
+    beginFunction(c, fn, false);
+    for(int i = 0; i < fn->paramCount; i++){
+        ASTNode *param = node->functionDef.params[i];
+        Symbol *symbol = defineSymbol(c, param->declaration.varName, SYMBOL_VARIABLE, fn->paramTypes[i]);
+        allocateSlots(c, symbol, false);
+    }
+    bool ok = compileList(c, node->functionDef.body, node->functionDef.bodyCount);
+    ok = endFunction(c, ok);
+
+    leaveScope(c, scope);
+    c->fs = outer;
+    return ok;
+}
+
+static void countParallelLoops(ASTNode **node, void *ctx){
+    if(!*node) return;
+    if((*node)->type == FOR_NODE && (*node)->forStmt.parallel) (*(int *)ctx)++;
+    forEachChild(*node, countParallelLoops, ctx);
+}
+
+static bool isTopLevelCode(ASTNode *item){
+    switch(item->type){
+        case FUNCTION_NODE:
+        case DECLARATION_NODE:
+        case STRUCT_NODE:
+        case UNION_NODE:
+        case ENUM_NODE:
+        case TYPEDEF_NODE:
+        case IMPL_NODE:
+        case INCLUDE_NODE:
+            return false;
+        default:
+            return true;
+    }
+}
+
+static bool compileProgram(Compiler *c, ASTNode *program, bool *hasCode){
+    ASTNode **items = &program;
+    int count = program ? 1 : 0;
+    if(program && program->type == BLOCK_NODE){
+        items = program->block.statements;
+        count = program->block.stmtCount;
+    }
+
+    if(!addFunction(c->module, "__init")) outOfMemory(c);
+    bool ok = true;
+    for(int i = 0; ok && i < count; i++){
+        if(items[i] && items[i]->type == FUNCTION_NODE) ok = declareFunction(c, items[i]);
+    }
+
+    // parallel loop bodies are added in the middle of compiling the function
+    // around them, which must not move
+    int parallelLoops = 0;
+    countParallelLoops(&program, &parallelLoops);
+    if(c->module->functionCount + parallelLoops > c->module->functionCapacity){
+        int capacity = c->module->functionCount + parallelLoops;
+        BytecodeFunction *functions = realloc(c->module->functions, capacity * sizeof(BytecodeFunction));
+        if(!functions) outOfMemory(c);
+        c->module->functions = functions;
+        c->module->functionCapacity = capacity;
+    }
+
+    beginFunction(c, &c->module->functions[0], true);
+    for(int i = 0; ok && i < count; i++){
+        ASTNode *item = items[i];
+        if(!item) continue;
+
+        if(item->type == FUNCTION_NODE){
+            ok = compileFunction(c, item);
+        } else if(item->type == DECLARATION_NODE){
+            ok = compileDeclaration(c, item, true);
+        } else{
+            *hasCode = *hasCode || isTopLevelCode(item);
+            ok = compileStatement(c, item);
+        }
+    }
+    return endFunction(c, ok);
+}
+
+// An allocation failure anywhere in compileProgram ends up here, as an error.
+static bool compileGuarded(Compiler *c, ASTNode *program, bool *hasCode){
+    jmp_buf failed;
+    if(setjmp(failed)) return compileError(c, "out of memory compiling bytecode");
+    c->outOfMemory = &failed;
+    return compileProgram(c, program, hasCode);
+}
+
+BytecodeModule *compileBytecode(ASTNode *program, char *error, size_t errorSize){
+    Compiler c;
+    memset(&c, 0, sizeof(c));
+    c.module = newModule();
+    c.error = error;
+    c.errorSize = errorSize;
+
+    bool hasCode = false;
+    bool ok = c.module ? compileGuarded(&c, program, &hasCode) : compileError(&c, "out of memory compiling bytecode");
+    free(c.symbols);
+
+    if(!ok){
+        freeBytecodeModule(c.module);
+        return NULL;
+    }
+    if(!hasCode){
+        int entry = findBytecodeFunction(c.module, "main");
+        if(entry >= 0 && c.module->functions[entry].paramCount == 0) c.module->mainFunction = entry;
+    }
+    return c.module;
+}
+
+// Verifier
+
+static bool validType(int type){
+    return type >= 0 && type < PRIMITIVE_TYPE_COUNT && type != TYPE_LONG_DOUBLE;
+}
+
+static bool checkOperands(const BytecodeModule *module, const BytecodeFunction *fn, int offset, char *error, size_t errorSize){
+    const uint8_t *code = fn->code + offset;
+    Opcode op = code[0];
+    int a = 0, b = 0;
+    if(opcodeInfo[op].operands == OPERANDS_U16 || opcodeInfo[op].operands == OPERANDS_U16_U16) a = readU16(code + 1);
+    if(opcodeInfo[op].operands == OPERANDS_U16_U16) b = readU16(code + 3);
+
+    switch(op){
+        case OP_CONST:
+            if(a >= module->constantCount) return fail(error, errorSize, "%s@%d: constant %d out of range", fn->name, offset, a);
+            return true;
+        case OP_LOAD:
+        case OP_STORE:
+        case OP_STORE_POP:
+        case OP_LOAD_INDEXED:
+        case OP_STORE_INDEXED:
+        case OP_STORE_INDEXED_POP:
+        case OP_CLEAR:
+            if(a + (op == OP_CLEAR ? b : 1) > fn->localCount) return fail(error, errorSize, "%s@%d: local slot %d out of range", fn->name, offset, a);
+            return true;
+        case OP_ATOMIC_UPDATE:
+        case OP_ATOMIC_UPDATE_INDEXED:
+            if(!validAtomicOperation(b)) return fail(error, errorSize, "%s@%d: invalid atomic operation", fn->name, offset);
+            // fall through
+        case OP_LOAD_GLOBAL:
+        case OP_STORE_GLOBAL:
+        case OP_STORE_GLOBAL_POP:
+        case OP_LOAD_GLOBAL_INDEXED:
+        case OP_STORE_GLOBAL_INDEXED:
+        case OP_STORE_GLOBAL_INDEXED_POP:
+        case OP_ATOMIC_LOAD:
+        case OP_ATOMIC_STORE:
+        case OP_ATOMIC_LOAD_INDEXED:
+        case OP_ATOMIC_STORE_INDEXED:
+            if(a + 1 > module->globalSlots) return fail(error, errorSize, "%s@%d: global slot %d out of range", fn->name, offset, a);
+            return true;
+        case OP_PARALLEL_FOR:
+            if(a < 1 || a >= module->functionCount) return fail(error, errorSize, "%s@%d: function %d out of range", fn->name, offset, a);
+            if(!module->functions[a].returnsVoid || module->functions[a].paramCount < 2 || module->functions[a].paramCount - 2 > fn->localCount){
+                return fail(error, errorSize, "%s@%d: %s is not a parallel loop body for this frame", fn->name, offset, module->functions[a].name);
+            }
+            return true;
+        case OP_CALL:
+        case OP_TAILCALL:
+            if(a < 1 || a >= module->functionCount) return fail(error, errorSize, "%s@%d: function %d out of range", fn->name, offset, a);
+            if(op == OP_TAILCALL && (module->functions[a].returnsVoid != fn->returnsVoid || (!fn->returnsVoid && module->functions[a].returnType != fn->returnType))){
+                return fail(error, errorSize, "%s@%d: tail call to %s returns a different type", fn->name, offset, module->functions[a].name);
+            }
+            return true;
+        case OP_SHL:
+        case OP_SHR_I:
+        case OP_SHR_U:
+            if(code[1] == 0 || code[1] > 64) return fail(error, errorSize, "%s@%d: invalid shift width", fn->name, offset);
+            return true;
+        case OP_F2I:
+            if(!validType(code[1]) || isFloatingType(code[1]) || code[1] == TYPE_STRING) return fail(error, errorSize, "%s@%d: invalid conversion", fn->name, offset);
+            return true;
+        case OP_THROW:
+            if(!validType(code[1])) return fail(error, errorSize, "%s@%d: invalid exception type", fn->name, offset);
+            return true;
+        case OP_PRINT:
+            for(int i = 0; i < code[1]; i++){
+                if(!validType(code[2 + i])) return fail(error, errorSize, "%s@%d: invalid print type", fn->name, offset);
+            }
+            return true;
+        case OP_RETURN:
+            if(fn->returnsVoid && fn != &module->functions[0]) return fail(error, errorSize, "%s@%d: void function returns a value", fn->name, offset);
+            return true;
+        case OP_RETURN_VOID:
+            if(!fn->returnsVoid && fn != &module->functions[0]) return fail(error, errorSize, "%s@%d: missing return value", fn->name, offset);
+            return true;
+        default:
+            return true;
+    }
+}
+
+// Fills depths[offset] with the stack depth on entry to each instruction,
+// -1 for unreachable code and for offsets inside an instruction.
+static bool verifyFunction(const BytecodeModule *module, const BytecodeFunction *fn, int *depths, char *error, size_t errorSize){
+    if(fn->codeSize <= 0) return fail(error, errorSize, "%s has no code", fn->name);
+    if(fn->paramCount < 0 || fn->localCount < fn->paramCount || fn->maxStack < 0) return fail(error, errorSize, "%s has an invalid frame layout", fn->name);
+
+    bool *starts = calloc(fn->codeSize, sizeof(bool));
+    int *work = malloc(fn->codeSize * sizeof(int));
+    if(!starts || !work){
+        free(starts);
+        free(work);
+        return fail(error, errorSize, "out of memory verifying %s", fn->name);
+    }
+    for(int offset = 0; offset < fn->codeSize; offset++){
+        depths[offset] = -1;
+    }
+
+    bool ok = true;
+    for(int offset = 0; ok && offset < fn->codeSize; ){
+        if(fn->code[offset] >= OP_COUNT){
+            ok = fail(error, errorSize, "%s@%d: invalid opcode %d", fn->name, offset, fn->code[offset]);
+            break;
+        }
+        int length = opcodeInfo[fn->code[offset]].operands == OPERANDS_PRINT && offset + 1 >= fn->codeSize ? 2 : instructionLength(fn->code, offset);
+        if(offset + length > fn->codeSize){
+            ok = fail(error, errorSize, "%s@%d: truncated instruction", fn->name, offset);
+            break;
+        }
+        starts[offset] = true;
+        ok = checkOperands(module, fn, offset, error, errorSize);
+        offset += length;
+    }
+
+    // handlers are entered from the unwinder with the exception alone on the stack
+    int workCount = 0;
+    if(ok){
+        depths[0] = 0;
+        work[workCount++] = 0;
+    }
+    for(int i = 0; ok && i < fn->handlerCount; i++){
+        const BytecodeHandler *h = &fn->handlers[i];
+        bool boundary = h->start >= 0 && h->start <= h->end && h->end <= fn->codeSize && (h->start == fn->codeSize || starts[h->start]) && (h->end == fn->codeSize || starts[h->end]);
+        if(!boundary || h->target < 0 || h->target >= fn->codeSize || !starts[h->target]){
+            ok = fail(error, errorSize, "%s: handler %d is out of range", fn->name, i);
+        } else if(h->type != -1 && !validType(h->type)){
+            ok = fail(error, errorSize, "%s: handler %d catches an invalid type", fn->name, i);
+        } else if(fn->maxStack < 1){
+            ok = fail(error, errorSize, "%s: stack exceeds the declared %d values", fn->name, fn->maxStack);
+        } else if(depths[h->target] < 0){
+            depths[h->target] = 1;
+            work[workCount++] = h->target;
+        } else if(depths[h->target] != 1){
+            ok = fail(error, errorSize, "%s@%d: inconsistent stack depth", fn->name, h->target);
+        }
+    }
+
+    // every path reaches each instruction with the same stack depth
+    while(ok && workCount > 0){
+        int offset = work[--workCount];
+        const uint8_t *code = fn->code + offset;
+        Opcode op = code[0];
+        int depth = depths[offset];
+        int pops = opcodeInfo[op].pops;
+        int pushes = opcodeInfo[op].pushes;
+        if(op == OP_CALL || op == OP_TAILCALL){
+            const BytecodeFunction *callee = &module->functions[readU16(code + 1)];
+            pops = callee->paramCount;
+            pushes = op == OP_CALL && !callee->returnsVoid ? 1 : 0;
+        } else if(op == OP_PRINT){
+            pops = code[1];
+        }
+        if(depth < pops){
+            ok = fail(error, errorSize, "%s@%d: stack underflow", fn->name, offset);
+            break;
+        }
+        depth += pushes - pops;
+        if(depth > fn->maxStack){
+            ok = fail(error, errorSize, "%s@%d: stack exceeds the declared %d values", fn->name, offset, fn->maxStack);
+            break;
+        }
+
+        int next = offset + instructionLength(fn->code, offset);
+        int targets[2];
+        int targetCount = 0;
+        if(opcodeInfo[op].operands == OPERANDS_JUMP) targets[targetCount++] = next + (int32_t)readU32(code + 1);
+        if(op != OP_JUMP && op != OP_RETURN && op != OP_RETURN_VOID && op != OP_TAILCALL && op != OP_THROW) targets[targetCount++] = next;
+
+        for(int i = 0; ok && i < targetCount; i++){
+            int target = targets[i];
+            if(target < 0 || target >= fn->codeSize || !starts[target]){
+                ok = fail(error, errorSize, "%s@%d: %s", fn->name, offset, target == fn->codeSize ? "code falls off the end" : "invalid jump target");
+            } else if(depths[target] < 0){
+                depths[target] = depth;
+                work[workCount++] = target;
+            } else if(depths[target] != depth){
+                ok = fail(error, errorSize, "%s@%d: inconsistent stack depth", fn->name, target);
+            }
+        }
+    }
+
+    free(starts);
+    free(work);
+    return ok;
+}
+
+bool bytecodeStackDepths(const BytecodeModule *module, const BytecodeFunction *fn, int *depths, char *error, size_t errorSize){
+    return verifyFunction(module, fn, depths, error, errorSize);
+}
+
+// Indexed accesses the compiler proved in bounds carry no CHECK_INDEX, so
+// bytecode from an untrusted source is not made safe by verification alone.
+bool verifyBytecode(BytecodeModule *module, char *error, size_t errorSize){
+    if(module->functionCount < 1 || module->functions[0].paramCount != 0) return fail(error, errorSize, "missing top-level function");
+    if(module->mainFunction >= module->functionCount || module->mainFunction == 0 || (module->mainFunction > 0 && module->functions[module->mainFunction].paramCount != 0)){
+        return fail(error, errorSize, "invalid main function");
+    }
+    for(int i = 0; i < module->constantCount; i++){
+        if(!validType(module->constants[i].type)) return fail(error, errorSize, "constant %d has an invalid type", i);
+    }
+    for(int i = 0; i < module->functionCount; i++){
+        const BytecodeFunction *fn = &module->functions[i];
+        if((!fn->returnsVoid || i == 0) && !validType(fn->returnType)) return fail(error, errorSize, "%s has an invalid return type", fn->name);
+        for(int k = 0; k < fn->paramCount; k++){
+            if(!validType(fn->paramTypes[k])) return fail(error, errorSize, "%s has an invalid parameter type", fn->name);
+        }
+    }
+    for(int i = 0; i < module->functionCount; i++){
+        const BytecodeFunction *fn = &module->functions[i];
+        int *depths = malloc((fn->codeSize > 0 ? fn->codeSize : 1) * sizeof(int));
+        if(!depths) return fail(error, errorSize, "out of memory verifying %s", fn->name);
+        bool ok = verifyFunction(module, fn, depths, error, errorSize);
+        free(depths);
+        if(!ok) return false;
+    }
+    return true;
+}
+
+// Serialization
+
+static void writeBytes(FILE *out, const void *data, size_t size){
+    if(size > 0) fwrite(data, 1, size, out);
+}
+
+static void writeU8(FILE *out, uint8_t value){
+    fputc(value, out);
+}
+
+static void writeU32(FILE *out, uint32_t value){
+    uint8_t bytes[4];
+    for(int i = 0; i < 4; i++){
+        bytes[i] = (value >> (8 * i)) & 0xFF;
+    }
+    writeBytes(out, bytes, 4);
+}
+
+static void writeU64(FILE *out, uint64_t value){
+    writeU32(out, (uint32_t)value);
+    writeU32(out, (uint32_t)(value >> 32));
+}
+
+static void writeString(FILE *out, const char *s){
+    size_t length = strlen(s);
+    writeU32(out, (uint32_t)length);
+    writeBytes(out, s, length);
+}
+
+// All numbers are little-endian; a float constant is written as its double bits.
+bool writeBytecode(const BytecodeModule *module, FILE *out){
+    writeBytes(out, BYTECODE_MAGIC, 4);
+    writeU32(out, BYTECODE_VERSION);
+
+    writeU32(out, (uint32_t)module->constantCount);
+    for(int i = 0; i < module->constantCount; i++){
+        const BytecodeConstant *k = &module->constants[i];
+        writeU8(out, k->type);
+        if(k->type == TYPE_STRING) writeString(out, k->value.s);
+        else writeU64(out, k->value.u);
+    }
+
+    writeU32(out, (uint32_t)module->globalSlots);
+    writeU32(out, (uint32_t)module->globalCount);
+    for(int i = 0; i < module->globalCount; i++){
+        const BytecodeGlobal *g = &module->globals[i];
+        writeString(out, g->name);
+        writeU8(out, g->type);
+        writeU32(out, (uint32_t)g->slot);
+        writeU32(out, (uint32_t)g->length);
+    }
+
+    writeU32(out, (uint32_t)module->functionCount);
+    for(int i = 0; i < module->functionCount; i++){
+        const BytecodeFunction *fn = &module->functions[i];
+        writeString(out, fn->name);
+        writeU32(out, (uint32_t)fn->paramCount);
+        for(int k = 0; k < fn->paramCount; k++){
+            writeU8(out, fn->paramTypes[k]);
+        }
+        writeU8(out, fn->returnType);
+        writeU8(out, fn->returnsVoid);
+        writeU32(out, (uint32_t)fn->localCount);
+        writeU32(out, (uint32_t)fn->maxStack);
+        writeU32(out, (uint32_t)fn->codeSize);
+        writeBytes(out, fn->code, fn->codeSize);
+        writeU32(out, (uint32_t)fn->handlerCount);
+        for(int k = 0; k < fn->handlerCount; k++){
+            const BytecodeHandler *h = &fn->handlers[k];
+            writeU32(out, (uint32_t)h->start);
+            writeU32(out, (uint32_t)h->end);
+            writeU32(out, (uint32_t)h->target);
+            writeU32(out, (uint32_t)(int32_t)h->type);
+        }
+    }
+    writeU32(out, (uint32_t)(int32_t)module->mainFunction);
+    fflush(out);
+    return !ferror(out);
+}
+
+typedef struct {
+    FILE *in;
+    bool failed;
+    bool outOfMemory;           // failed because an allocation did
+} Reader;
+
+static void readBytes(Reader *r, void *data, size_t size){
+    if(r->failed || size == 0) return;
+    if(fread(data, 1, size, r->in) != size){
+        r->failed = true;
+        memset(data, 0, size);
+    }
+}
+
+static uint8_t readByte(Reader *r){
+    uint8_t value = 0;
+    readBytes(r, &value, 1);
+    return value;
+}
+
+static uint32_t readWord(Reader *r){
+    uint8_t bytes[4] = {0};
+    readBytes(r, bytes, 4);
+    return readU32(bytes);
+}
+
+static uint64_t readLong(Reader *r){
+    uint64_t low = readWord(r);
+    return low | (uint64_t)readWord(r) << 32;
+}
+
+// Counts are bounded so a damaged file cannot ask for huge allocations.
+static int readCount(Reader *r, uint32_t limit){
+    uint32_t count = readWord(r);
+    if(count > limit) r->failed = true;
+    return r->failed ? 0 : (int)count;
+}
+
+static char *readString(Reader *r){
+    int length = readCount(r, 1 << 24);
+    char *s = malloc((size_t)length + 1);
+    if(!s){
+        r->failed = r->outOfMemory = true;
+        return NULL;
+    }
+    readBytes(r, s, (size_t)length);
+    s[length] = '\0';
+    return s;
+}
+
+BytecodeModule *readBytecode(FILE *in, char *error, size_t errorSize){
+    Reader r = {in, false, false};
+    char magic[4];
+    readBytes(&r, magic, 4);
+    if(r.failed || memcmp(magic, BYTECODE_MAGIC, 4) != 0){
+        fail(error, errorSize, "not a bytecode file");
+        return NULL;
+    }
+    uint32_t version = readWord(&r);
+    if(version != BYTECODE_VERSION){
+        fail(error, errorSize, "unsupported bytecode version %u", version);
+        return NULL;
+    }
+
+    BytecodeModule *module = newModule();
+    if(!module){
+        fail(error, errorSize, "out of memory reading bytecode");
+        return NULL;
+    }
+    int constantCount = readCount(&r, UINT16_MAX + 1);
+    for(int i = 0; i < constantCount && !r.failed; i++){
+        if(!GROW(module->constants, module->constantCount, module->constantCapacity)){
+            r.failed = r.outOfMemory = true;
+            break;
+        }
+        BytecodeConstant *k = &module->constants[module->constantCount++];
+        k->type = readByte(&r);
+        if(k->type == TYPE_STRING) k->value.s = readString(&r);
+        else k->value.u = readLong(&r);
+    }
+
+    module->globalSlots = readCount(&r, UINT16_MAX);
+    int globalCount = readCount(&r, UINT16_MAX);
+    for(int i = 0; i < globalCount && !r.failed; i++){
+        if(!GROW(module->globals, module->globalCount, module->globalCapacity)){
+            r.failed = r.outOfMemory = true;
+            break;
+        }
+        BytecodeGlobal *g = &module->globals[module->globalCount++];
+        g->name = readString(&r);
+        g->type = readByte(&r);
+        g->slot = readCount(&r, UINT16_MAX);
+        g->length = readCount(&r, UINT16_MAX);
+    }
+
+    int functionCount = readCount(&r, UINT16_MAX + 1);
+    for(int i = 0; i < functionCount && !r.failed; i++){
+        char *name = readString(&r);
+        BytecodeFunction *fn = name ? addFunction(module, name) : NULL;
+        free(name);
+        if(!fn){
+            r.failed = r.outOfMemory = true;
+            break;
+        }
+        fn->paramCount = readCount(&r, UINT16_MAX);
+        fn->paramTypes = calloc(fn->paramCount > 0 ? fn->paramCount : 1, sizeof(PrimitiveType));
+        if(!fn->paramTypes){
+            r.failed = r.outOfMemory = true;
+            break;
+        }
+        for(int k = 0; k < fn->paramCount; k++){
+            fn->paramTypes[k] = readByte(&r);
+        }
+        fn->returnType = readByte(&r);
+        fn->returnsVoid = readByte(&r) != 0;
+        fn->localCount = readCount(&r, UINT16_MAX);
+        fn->maxStack = readCount(&r, 1 << 20);
+        fn->codeSize = readCount(&r, 1 << 28);
+        fn->codeCapacity = fn->codeSize;
+        fn->code = malloc(fn->codeSize > 0 ? fn->codeSize : 1);
+        if(!fn->code){
+            r.failed = r.outOfMemory = true;
+            break;
+        }
+        readBytes(&r, fn->code, fn->codeSize);
+        int handlerCount = readCount(&r, 1 << 20);
+        for(int k = 0; k < handlerCount && !r.failed; k++){
+            if(!GROW(fn->handlers, fn->handlerCount, fn->handlerCapacity)){
+                r.failed = r.outOfMemory = true;
+                break;
+            }
+            BytecodeHandler *h = &fn->handlers[fn->handlerCount++];
+            h->start = readCount(&r, 1 << 28);
+            h->end = readCount(&r, 1 << 28);
+            h->target = readCount(&r, 1 << 28);
+            h->type = (int32_t)readWord(&r);
+        }
+    }
+    module->mainFunction = (int32_t)readWord(&r);
+
+    if(r.failed){
+        fail(error, errorSize, r.outOfMemory ? "out of memory reading bytecode" : "truncated or damaged bytecode file");
+        freeBytecodeModule(module);
+        return NULL;
+    }
+    if(!verifyBytecode(module, error, errorSize)){
+        freeBytecodeModule(module);
+        return NULL;
+    }
+    return module;
+}
+
+// Disassembler
+
+static void dumpConstant(const BytecodeConstant *k, FILE *out){
+    if(k->type == TYPE_STRING) fprintf(out, "\"%s\"", k->value.s);
+    else if(isFloatingType(k->type)) fprintf(out, "%g", k->value.f);
+    else if(isUnsignedInteger(k->type)) fprintf(out, "%llu", (unsigned long long)k->value.u);
+    else fprintf(out, "%lld", (long long)k->value.i);
+    fprintf(out, " : %s", primitiveTypeName(k->type));
+}
+
+void dumpBytecodeFunction(const BytecodeModule *module, const BytecodeFunction *fn, FILE *out){
+    fprintf(out, "fun %s(", fn->name);
+    for(int i = 0; i < fn->paramCount; i++){
+        fprintf(out, "%s%s", i > 0 ? ", " : "", primitiveTypeName(fn->paramTypes[i]));
+    }
+    fprintf(out, ") -> %s    ; %d locals, %d stack\n", fn->returnsVoid ? "void" : primitiveTypeName(fn->returnType), fn->localCount, fn->maxStack);
+
+    for(int offset = 0; offset < fn->codeSize; offset += instructionLength(fn->code, offset)){
+        const uint8_t *code = fn->code + offset;
+        Opcode op = code[0];
+        fprintf(out, "%6d  %s", offset, opcodeName(op));
+        switch(opcodeInfo[op].operands){
+            case OPERANDS_NONE:
+                break;
+            case OPERANDS_U8:
+                fprintf(out, " %d", code[1]);
+                if(op == OP_F2I || op == OP_THROW) fprintf(out, "    ; %s", primitiveTypeName(code[1]));
+                break;
+            case OPERANDS_U16: {
+                int a = readU16(code + 1);
+                fprintf(out, " %d", a);
+                if(op == OP_CONST && a < module->constantCount){
+                    fprintf(out, "    ; ");
+                    dumpConstant(&module->constants[a], out);
+                } else if((op == OP_CALL || op == OP_TAILCALL || op == OP_PARALLEL_FOR) && a < module->functionCount){
+                    fprintf(out, "    ; %s", module->functions[a].name);
+                }
+                break;
+            }
+            case OPERANDS_U16_U16:
+                fprintf(out, " %d %d", readU16(code + 1), readU16(code + 3));
+                if(op == OP_ATOMIC_UPDATE || op == OP_ATOMIC_UPDATE_INDEXED){
+                    int operation = readU16(code + 3);
+                    fprintf(out, "    ; %s %s", atomicOpName(ATOMIC_OPERATION_OP(operation)), atomicKindName(ATOMIC_OPERATION_KIND(operation)));
+                }
+                break;
+            case OPERANDS_U32:
+                fprintf(out, " %u", readU32(code + 1));
+                break;
+            case OPERANDS_JUMP:
+                fprintf(out, " -> %d", offset + 5 + (int32_t)readU32(code + 1));
+                break;
+            case OPERANDS_PRINT:
+                fprintf(out, " %d", code[1]);
+                for(int i = 0; i < code[1]; i++){
+                    fprintf(out, " %s", primitiveTypeName(code[2 + i]));
+                }
+                break;
+        }
+        fprintf(out, "\n");
+    }
+    for(int i = 0; i < fn->handlerCount; i++){
+        const BytecodeHandler *h = &fn->handlers[i];
+        fprintf(out, "        catch %s [%d, %d) -> %d\n", h->type < 0 ? "any" : primitiveTypeName(h->type), h->start, h->end, h->target);
+    }
+}
+
+void dumpBytecodeModule(const BytecodeModule *module, FILE *out){
+    for(int i = 0; i < module->globalCount; i++){
+        const BytecodeGlobal *g = &module->globals[i];
+        fprintf(out, "global @%s : %s", g->name, primitiveTypeName(g->type));
+        if(g->length > 0) fprintf(out, "[%d]", g->length);
+        fprintf(out, "    ; slot %d\n", g->slot);
+    }
+    if(module->globalCount > 0) fprintf(out, "\n");
+
+    for(int i = 0; i < module->functionCount; i++){
+        if(i > 0) fprintf(out, "\n");
+        dumpBytecodeFunction(module, &module->functions[i], out);
+    }
+}
@@ -0,0 +1,215 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "ast.h"
+#include <stddef.h>
+#include <stdio.h>
+
+#define BYTECODE_MAGIC "NLBC"
+#define BYTECODE_VERSION 4
+
+typedef enum {
+    OPERANDS_NONE,
+    OPERANDS_U8,
+    OPERANDS_U16,
+    OPERANDS_U16_U16,
+    OPERANDS_U32,
+    OPERANDS_JUMP,          // i32 offset from the end of the instruction
+    OPERANDS_PRINT          // u8 count followed by one type byte per argument
+} OperandFormat;
+
+// name, operands, values popped, values pushed (-1 when it depends on the operands)
+#define BYTECODE_OPS(X) \
+    X(CONST, OPERANDS_U16, 0, 1) \
+    X(LOAD, OPERANDS_U16, 0, 1) \
+    X(STORE, OPERANDS_U16, 1, 1) \
+    X(STORE_POP, OPERANDS_U16, 1, 0) \
+    X(LOAD_GLOBAL, OPERANDS_U16, 0, 1) \
+    X(STORE_GLOBAL, OPERANDS_U16, 1, 1) \
+    X(STORE_GLOBAL_POP, OPERANDS_U16, 1, 0) \
+    X(LOAD_INDEXED, OPERANDS_U16, 1, 1) \
+    X(STORE_INDEXED, OPERANDS_U16, 2, 1) \
+    X(STORE_INDEXED_POP, OPERANDS_U16, 2, 0) \
+    X(LOAD_GLOBAL_INDEXED, OPERANDS_U16, 1, 1) \
+    X(STORE_GLOBAL_INDEXED, OPERANDS_U16, 2, 1) \
+    X(STORE_GLOBAL_INDEXED_POP, OPERANDS_U16, 2, 0) \
+    X(ATOMIC_LOAD, OPERANDS_U16, 0, 1) \
+    X(ATOMIC_STORE, OPERANDS_U16, 1, 1) \
+    X(ATOMIC_LOAD_INDEXED, OPERANDS_U16, 1, 1) \
+    X(ATOMIC_STORE_INDEXED, OPERANDS_U16, 2, 1) \
+    X(ATOMIC_UPDATE, OPERANDS_U16_U16, 1, 1) \
+    X(ATOMIC_UPDATE_INDEXED, OPERANDS_U16_U16, 2, 1) \
+    X(CHECK_INDEX, OPERANDS_U32, 1, 1) \
+    X(CLEAR, OPERANDS_U16_U16, 0, 0) \
+    X(POP, OPERANDS_NONE, 1, 0) \
+    X(DUP, OPERANDS_NONE, 1, 2) \
+    X(SWAP, OPERANDS_NONE, 2, 2) \
+    X(ADD_I32, OPERANDS_NONE, 2, 1) \
+    X(SUB_I32, OPERANDS_NONE, 2, 1) \
+    X(MUL_I32, OPERANDS_NONE, 2, 1) \
+    X(NEG_I32, OPERANDS_NONE, 1, 1) \
+    X(ADD_I64, OPERANDS_NONE, 2, 1) \
+    X(SUB_I64, OPERANDS_NONE, 2, 1) \
+    X(MUL_I64, OPERANDS_NONE, 2, 1) \
+    X(NEG_I64, OPERANDS_NONE, 1, 1) \
+    X(DIV_I, OPERANDS_NONE, 2, 1) \
+    X(MOD_I, OPERANDS_NONE, 2, 1) \
+    X(DIV_U, OPERANDS_NONE, 2, 1) \
+    X(MOD_U, OPERANDS_NONE, 2, 1) \
+    X(ADD_F, OPERANDS_NONE, 2, 1) \
+    X(SUB_F, OPERANDS_NONE, 2, 1) \
+    X(MUL_F, OPERANDS_NONE, 2, 1) \
+    X(DIV_F, OPERANDS_NONE, 2, 1) \
+    X(NEG_F, OPERANDS_NONE, 1, 1) \
+    X(BIT_AND, OPERANDS_NONE, 2, 1) \
+    X(BIT_OR, OPERANDS_NONE, 2, 1) \
+    X(BIT_XOR, OPERANDS_NONE, 2, 1) \
+    X(BIT_NOT, OPERANDS_NONE, 1, 1) \
+    X(SHL, OPERANDS_U8, 2, 1) \
+    X(SHR_I, OPERANDS_U8, 2, 1) \
+    X(SHR_U, OPERANDS_U8, 2, 1) \
+    X(NOT, OPERANDS_NONE, 1, 1) \
+    X(NOT_F, OPERANDS_NONE, 1, 1) \
+    X(EQ_I, OPERANDS_NONE, 2, 1) \
+    X(NE_I, OPERANDS_NONE, 2, 1) \
+    X(LT_I, OPERANDS_NONE, 2, 1) \
+    X(LE_I, OPERANDS_NONE, 2, 1) \
+    X(GT_I, OPERANDS_NONE, 2, 1) \
+    X(GE_I, OPERANDS_NONE, 2, 1) \
+    X(LT_U, OPERANDS_NONE, 2, 1) \
+    X(LE_U, OPERANDS_NONE, 2, 1) \
+    X(GT_U, OPERANDS_NONE, 2, 1) \
+    X(GE_U, OPERANDS_NONE, 2, 1) \
+    X(EQ_F, OPERANDS_NONE, 2, 1) \
+    X(NE_F, OPERANDS_NONE, 2, 1) \
+    X(LT_F, OPERANDS_NONE, 2, 1) \
+    X(LE_F, OPERANDS_NONE, 2, 1) \
+    X(GT_F, OPERANDS_NONE, 2, 1) \
+    X(GE_F, OPERANDS_NONE, 2, 1) \
+    X(WRAP_I8, OPERANDS_NONE, 1, 1) \
+    X(WRAP_U8, OPERANDS_NONE, 1, 1) \
+    X(WRAP_I16, OPERANDS_NONE, 1, 1) \
+    X(WRAP_U16, OPERANDS_NONE, 1, 1) \
+    X(WRAP_I32, OPERANDS_NONE, 1, 1) \
+    X(WRAP_U32, OPERANDS_NONE, 1, 1) \
+    X(TO_BOOL, OPERANDS_NONE, 1, 1) \
+    X(TO_BOOL_F, OPERANDS_NONE, 1, 1) \
+    X(I2F, OPERANDS_NONE, 1, 1) \
+    X(U2F, OPERANDS_NONE, 1, 1) \
+    X(F2I, OPERANDS_U8, 1, 1) \
+    X(FROUND, OPERANDS_NONE, 1, 1) \
+    X(JUMP, OPERANDS_JUMP, 0, 0) \
+    X(JUMP_IF_FALSE, OPERANDS_JUMP, 1, 0) \
+    X(JUMP_IF_TRUE, OPERANDS_JUMP, 1, 0) \
+    X(CALL, OPERANDS_U16, -1, -1) \
+    X(TAILCALL, OPERANDS_U16, -1, 0) \
+    X(RETURN, OPERANDS_NONE, 1, 0) \
+    X(RETURN_VOID, OPERANDS_NONE, 0, 0) \
+    X(THROW, OPERANDS_U8, 1, 0) \
+    X(PARALLEL_FOR, OPERANDS_U16, 2, 0) \
+    X(PRINT, OPERANDS_PRINT, -1, 0)
+
+#define BYTECODE_OP_ENUM(name, operands, pops, pushes) OP_##name,
+typedef enum {
+    BYTECODE_OPS(BYTECODE_OP_ENUM)
+    OP_COUNT
+} Opcode;
+#undef BYTECODE_OP_ENUM
+
+// Integers are kept sign or zero extended from the width of their type,
+// float and double are both held as double, strings only as constants.
+typedef union {
+    int64_t i;
+    uint64_t u;
+    double f;
+    const char *s;
+} VMValue;
+
+typedef struct {
+    PrimitiveType type;
+    VMValue value;
+} BytecodeConstant;
+
+typedef struct {
+    char *name;
+    PrimitiveType type;
+    int slot;
+    int length;             // elements of an array, 0 for a scalar
+} BytecodeGlobal;
+
+// A throw from an offset in [start, end) whose type matches lands on target
+// with only the exception on the stack. Handlers of a try block nested in
+// another come first, so the first match is the innermost.
+typedef struct {
+    int start;
+    int end;
+    int target;
+    int type;               // PrimitiveType caught, -1 for any
+} BytecodeHandler;
+
+typedef struct {
+    char *name;
+    int paramCount;
+    PrimitiveType *paramTypes;
+    PrimitiveType returnType;
+    bool returnsVoid;
+    int localCount;         // slots for parameters, then locals and arrays
+    int maxStack;
+    uint8_t *code;
+    int codeSize;
+    int codeCapacity;
+    BytecodeHandler *handlers;
+    int handlerCount;
+    int handlerCapacity;
+} BytecodeFunction;
+
+// The ATOMIC instructions access global slots of variables declared atomic.
+// ATOMIC_UPDATE pops an operand and pushes the result of the update its
+// second operand describes, an ATOMIC_OPERATION from atomics.h.
+
+// PARALLEL_FOR pops start and end and runs function over [start, end) in
+// chunks, each a call with the first paramCount - 2 locals of the running
+// frame followed by the chunk's bounds.
+
+// Function 0 runs the top-level code and initializes the globals.
+typedef struct {
+    BytecodeFunction *functions;
+    int functionCount;
+    int functionCapacity;
+    BytecodeConstant *constants;
+    int constantCount;
+    int constantCapacity;
+    BytecodeGlobal *globals;
+    int globalCount;
+    int globalCapacity;
+    int globalSlots;
+    int mainFunction;       // called after the top-level code, -1 if the program has its own
+} BytecodeModule;
+
+// Returns NULL with a message for programs outside the compiled subset
+// (pointers, aggregates, allocation, closures); those still run
+// on the tree-walking evaluator.
+BytecodeModule *compileBytecode(ASTNode *program, char *error, size_t errorSize);
+void freeBytecodeModule(BytecodeModule *module);
+
+VMValue primitiveToVMValue(PrimitiveType type, PrimitiveValue value);
+PrimitiveValue vmValueToPrimitive(PrimitiveType type, VMValue value);
+
+int findBytecodeFunction(const BytecodeModule *module, const char *name);
+// The handler for a throw of type from the instruction at offset, NULL if
+// the exception leaves the function.
+const BytecodeHandler *findBytecodeHandler(const BytecodeFunction *fn, int offset, PrimitiveType type);
+const char *opcodeName(Opcode op);
+OperandFormat opcodeOperands(Opcode op);
+int instructionLength(const uint8_t *code, int offset);
+
+bool verifyBytecode(BytecodeModule *module, char *error, size_t errorSize);
+// depths holds codeSize entries: the stack depth before each instruction, -1 elsewhere
+bool bytecodeStackDepths(const BytecodeModule *module, const BytecodeFunction *fn, int *depths, char *error, size_t errorSize);
+bool writeBytecode(const BytecodeModule *module, FILE *out);
+BytecodeModule *readBytecode(FILE *in, char *error, size_t errorSize);
+
+void dumpBytecodeFunction(const BytecodeModule *module, const BytecodeFunction *fn, FILE *out);
+void dumpBytecodeModule(const BytecodeModule *module, FILE *out);
+
+#endif
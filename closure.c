@@ -0,0 +1,2278 @@
+#include "closure.h"
+#include "primitive.h"
+#include "utils.h"
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_ARRAY_DIMENSIONS 8
+#define MAX_ARRAY_LENGTH (1 << 20)
+
+typedef enum {
+    FLOW_NORMAL,
+    FLOW_BREAK,
+    FLOW_CONTINUE,
+    FLOW_RETURN,
+    FLOW_JUMP,                  // frame->jumpLabel names the target
+    FLOW_TAILCALL,              // frame->tailCallee takes over the frame
+    FLOW_ERROR
+} Flow;
+
+typedef struct Closure Closure;
+typedef struct ClosureFunction ClosureFunction;
+typedef struct ClosureFrame ClosureFrame;
+
+typedef bool (*EvalFn)(const Closure *self, ClosureFrame *frame, VMValue *out);
+typedef Flow (*ExecFn)(const Closure *self, ClosureFrame *frame);
+
+// Expressions set eval and statements exec; which other fields a node uses
+// depends on that function.
+struct Closure {
+    EvalFn eval;
+    ExecFn exec;
+    Closure *a;
+    Closure *b;
+    Closure *c;
+    Closure **items;
+    int count;
+    int slot;
+    int other;                  // a second slot, a length, a width or a type
+    VMValue constant;
+    bool pure;                  // cannot fail or write, so constant operands fold
+    const ClosureFunction *callee;
+    const char *name;           // goto target
+    const char **labels;        // label defined by each item of a list, NULL when none are
+    int *entries;               // first item of each switch case
+    PrimitiveType *types;       // print arguments
+};
+
+struct ClosureFunction {
+    char *name;
+    int paramCount;
+    PrimitiveType *paramTypes;
+    PrimitiveType returnType;
+    bool returnsVoid;
+    int localCount;
+    Closure *body;
+};
+
+// Function 0 runs the top-level code and initializes the globals.
+struct ClosureProgram {
+    ClosureFunction *functions;
+    int functionCount;
+    int functionCapacity;
+    int globalSlots;
+    int mainFunction;           // called after the top-level code, -1 if the program has its own
+    Closure **nodes;            // every node, for freeing
+    int nodeCount;
+    int nodeCapacity;
+    char **strings;
+    int stringCount;
+    int stringCapacity;
+};
+
+struct ClosureRuntime {
+    const ClosureProgram *program;
+    VMOptions options;
+    VMValue *slots;
+    VMValue *slotsEnd;
+    VMValue *globals;
+    int depth;
+    VMStats stats;
+    char error[256];
+};
+
+struct ClosureFrame {
+    ClosureRuntime *rt;
+    const ClosureFunction *fn;
+    VMValue *slots;
+    VMValue *top;               // where a call made now places its arguments
+    VMValue result;
+    bool hasResult;
+    const char *jumpLabel;
+    const ClosureFunction *tailCallee;
+};
+
+#define EVAL(node, out) ((node)->eval((node), frame, (out)))
+#define EXEC(node) ((node)->exec((node), frame))
+
+static bool runtimeError(ClosureFrame *frame, const char *format, ...){
+    ClosureRuntime *rt = frame->rt;
+    va_list args;
+    va_start(args, format);
+    int length = snprintf(rt->error, sizeof(rt->error), "%s: ", frame->fn->name);
+    if(length < 0 || length >= (int)sizeof(rt->error)) length = 0;
+    vsnprintf(rt->error + length, sizeof(rt->error) - length, format, args);
+    va_end(args);
+    return false;
+}
+
+static Value toValue(PrimitiveType type, VMValue v){
+    return makePrimitiveValue(type, vmValueToPrimitive(type, v));
+}
+
+// Leaves
+
+static bool evalConstant(const Closure *self, ClosureFrame *frame, VMValue *out){
+    (void)frame;
+    *out = self->constant;
+    return true;
+}
+
+static bool evalLocal(const Closure *self, ClosureFrame *frame, VMValue *out){
+    *out = frame->slots[self->slot];
+    return true;
+}
+
+static bool evalGlobal(const Closure *self, ClosureFrame *frame, VMValue *out){
+    *out = frame->rt->globals[self->slot];
+    return true;
+}
+
+static bool evalIndexed(const Closure *self, ClosureFrame *frame, VMValue *out){
+    VMValue index;
+    if(!EVAL(self->a, &index)) return false;
+    *out = frame->slots[self->slot + index.i];
+    return true;
+}
+
+static bool evalIndexedByLocal(const Closure *self, ClosureFrame *frame, VMValue *out){
+    *out = frame->slots[self->slot + frame->slots[self->other].i];
+    return true;
+}
+
+static bool evalGlobalIndexed(const Closure *self, ClosureFrame *frame, VMValue *out){
+    VMValue index;
+    if(!EVAL(self->a, &index)) return false;
+    *out = frame->rt->globals[self->slot + index.i];
+    return true;
+}
+
+static bool evalCheckIndex(const Closure *self, ClosureFrame *frame, VMValue *out){
+    if(!EVAL(self->a, out)) return false;
+    if(out->u >= (uint64_t)self->other) return runtimeError(frame, "index %lld out of bounds for length %d", (long long)out->i, self->other);
+    return true;
+}
+
+// Stores
+
+static bool evalStoreLocal(const Closure *self, ClosureFrame *frame, VMValue *out){
+    if(!EVAL(self->a, out)) return false;
+    frame->slots[self->slot] = *out;
+    return true;
+}
+
+static bool evalStoreGlobal(const Closure *self, ClosureFrame *frame, VMValue *out){
+    if(!EVAL(self->a, out)) return false;
+    frame->rt->globals[self->slot] = *out;
+    return true;
+}
+
+static bool evalStoreIndexed(const Closure *self, ClosureFrame *frame, VMValue *out){
+    VMValue index;
+    if(!EVAL(self->a, &index) || !EVAL(self->b, out)) return false;
+    frame->slots[self->slot + index.i] = *out;
+    return true;
+}
+
+static bool evalStoreGlobalIndexed(const Closure *self, ClosureFrame *frame, VMValue *out){
+    VMValue index;
+    if(!EVAL(self->a, &index) || !EVAL(self->b, out)) return false;
+    frame->rt->globals[self->slot + index.i] = *out;
+    return true;
+}
+
+// A postfix step stores the new value and yields the old one.
+static bool evalSwapLocal(const Closure *self, ClosureFrame *frame, VMValue *out){
+    VMValue value;
+    *out = frame->slots[self->slot];
+    if(!EVAL(self->a, &value)) return false;
+    frame->slots[self->slot] = value;
+    return true;
+}
+
+static bool evalSwapGlobal(const Closure *self, ClosureFrame *frame, VMValue *out){
+    VMValue value;
+    *out = frame->rt->globals[self->slot];
+    if(!EVAL(self->a, &value)) return false;
+    frame->rt->globals[self->slot] = value;
+    return true;
+}
+
+// Compound assignment and steps of an element stage the element in the local
+// scratch slot `other`, which the value closure reads.
+#define DEFINE_UPDATE(name, storage, postfix) \
+    static bool name(const Closure *self, ClosureFrame *frame, VMValue *out){ \
+        VMValue index, value; \
+        if(!EVAL(self->a, &index)) return false; \
+        VMValue *element = &(storage)[self->slot + index.i]; \
+        frame->slots[self->other] = *element; \
+        if(!EVAL(self->b, &value)) return false; \
+        *out = (postfix) ? frame->slots[self->other] : value; \
+        *element = value; \
+        return true; \
+    }
+
+DEFINE_UPDATE(evalUpdateIndexed, frame->slots, false)
+DEFINE_UPDATE(evalUpdateGlobalIndexed, frame->rt->globals, false)
+DEFINE_UPDATE(evalPostUpdateIndexed, frame->slots, true)
+DEFINE_UPDATE(evalPostUpdateGlobalIndexed, frame->rt->globals, true)
+
+// Arithmetic
+
+// name, operand type and field, result field, result of a and b
+#define SIMPLE_BINARY_OPS(X) \
+    X(ADD_I32, int64_t, i, i, (int32_t)(uint32_t)((uint64_t)a + (uint64_t)b)) \
+    X(SUB_I32, int64_t, i, i, (int32_t)(uint32_t)((uint64_t)a - (uint64_t)b)) \
+    X(MUL_I32, int64_t, i, i, (int32_t)(uint32_t)((uint64_t)a * (uint64_t)b)) \
+    X(ADD_I64, uint64_t, u, u, a + b) \
+    X(SUB_I64, uint64_t, u, u, a - b) \
+    X(MUL_I64, uint64_t, u, u, a * b) \
+    X(ADD_F, double, f, f, a + b) \
+    X(SUB_F, double, f, f, a - b) \
+    X(MUL_F, double, f, f, a * b) \
+    X(BIT_AND, uint64_t, u, u, a & b) \
+    X(BIT_OR, uint64_t, u, u, a | b) \
+    X(BIT_XOR, uint64_t, u, u, a ^ b) \
+    X(EQ_I, int64_t, i, i, a == b) \
+    X(NE_I, int64_t, i, i, a != b) \
+    X(LT_I, int64_t, i, i, a < b) \
+    X(LE_I, int64_t, i, i, a <= b) \
+    X(GT_I, int64_t, i, i, a > b) \
+    X(GE_I, int64_t, i, i, a >= b) \
+    X(LT_U, uint64_t, u, i, a < b) \
+    X(LE_U, uint64_t, u, i, a <= b) \
+    X(GT_U, uint64_t, u, i, a > b) \
+    X(GE_U, uint64_t, u, i, a >= b) \
+    X(EQ_F, double, f, i, a == b) \
+    X(NE_F, double, f, i, a != b) \
+    X(LT_F, double, f, i, a < b) \
+    X(LE_F, double, f, i, a <= b) \
+    X(GT_F, double, f, i, a > b) \
+    X(GE_F, double, f, i, a >= b)
+
+// One function per operand shape: any two expressions (XX), an expression
+// and a constant (XK), a local and a constant (LK), two locals (LL).
+#define DEFINE_SIMPLE_BINARY(name, T, field, result, expr) \
+    static bool eval##name##XX(const Closure *self, ClosureFrame *frame, VMValue *out){ \
+        VMValue x, y; \
+        if(!EVAL(self->a, &x) || !EVAL(self->b, &y)) return false; \
+        T a = x.field, b = y.field; \
+        out->result = (expr); \
+        return true; \
+    } \
+    static bool eval##name##XK(const Closure *self, ClosureFrame *frame, VMValue *out){ \
+        VMValue x; \
+        if(!EVAL(self->a, &x)) return false; \
+        T a = x.field, b = self->constant.field; \
+        out->result = (expr); \
+        return true; \
+    } \
+    static bool eval##name##LK(const Closure *self, ClosureFrame *frame, VMValue *out){ \
+        T a = frame->slots[self->slot].field, b = self->constant.field; \
+        out->result = (expr); \
+        return true; \
+    } \
+    static bool eval##name##LL(const Closure *self, ClosureFrame *frame, VMValue *out){ \
+        T a = frame->slots[self->slot].field, b = frame->slots[self->other].field; \
+        out->result = (expr); \
+        return true; \
+    }
+
+SIMPLE_BINARY_OPS(DEFINE_SIMPLE_BINARY)
+
+// Division by zero and bad shift counts fail, so these only come as XX.
+#define DEFINE_CHECKED_BINARY(name, T, field, check, message, expr) \
+    static bool eval##name##XX(const Closure *self, ClosureFrame *frame, VMValue *out){ \
+        VMValue x, y; \
+        if(!EVAL(self->a, &x) || !EVAL(self->b, &y)) return false; \
+        T a = x.field, b = y.field; \
+        int width = self->other; \
+        (void)width; \
+        if(check) return runtimeError(frame, message); \
+        out->field = (expr); \
+        return true; \
+    }
+
+// MIN / -1 wraps to MIN as the evaluator's handlers do
+DEFINE_CHECKED_BINARY(DIV_I, int64_t, i, b == 0, "division by zero", b == -1 ? (int64_t)(0 - (uint64_t)a) : a / b)
+DEFINE_CHECKED_BINARY(MOD_I, int64_t, i, b == 0, "division by zero", b == -1 ? 0 : a % b)
+DEFINE_CHECKED_BINARY(DIV_U, uint64_t, u, b == 0, "division by zero", a / b)
+DEFINE_CHECKED_BINARY(MOD_U, uint64_t, u, b == 0, "division by zero", a % b)
+DEFINE_CHECKED_BINARY(DIV_F, double, f, b == 0.0, "division by zero", a / b)
+DEFINE_CHECKED_BINARY(SHL, uint64_t, u, (int64_t)b < 0 || (int64_t)b >= width, "invalid shift count", a << b)
+DEFINE_CHECKED_BINARY(SHR_I, int64_t, i, b < 0 || b >= width, "invalid shift count", a >> b)
+DEFINE_CHECKED_BINARY(SHR_U, uint64_t, u, (int64_t)b < 0 || (int64_t)b >= width, "invalid shift count", a >> b)
+
+typedef struct {
+    EvalFn xx;
+    EvalFn xk;
+    EvalFn lk;
+    EvalFn ll;
+} BinaryForms;
+
+#define SIMPLE_BINARY_FORMS(name, T, field, result, expr) [OP_##name] = {eval##name##XX, eval##name##XK, eval##name##LK, eval##name##LL},
+static const BinaryForms binaryForms[OP_COUNT] = {
+    SIMPLE_BINARY_OPS(SIMPLE_BINARY_FORMS)
+    [OP_DIV_I] = {evalDIV_IXX, NULL, NULL, NULL},
+    [OP_MOD_I] = {evalMOD_IXX, NULL, NULL, NULL},
+    [OP_DIV_U] = {evalDIV_UXX, NULL, NULL, NULL},
+    [OP_MOD_U] = {evalMOD_UXX, NULL, NULL, NULL},
+    [OP_DIV_F] = {evalDIV_FXX, NULL, NULL, NULL},
+    [OP_SHL] = {evalSHLXX, NULL, NULL, NULL},
+    [OP_SHR_I] = {evalSHR_IXX, NULL, NULL, NULL},
+    [OP_SHR_U] = {evalSHR_UXX, NULL, NULL, NULL}
+};
+
+#define UNARY_OPS(X) \
+    X(NEG_I32, r.i = (int32_t)(uint32_t)(0 - v.u)) \
+    X(NEG_I64, r.u = 0 - v.u) \
+    X(NEG_F, r.f = -v.f) \
+    X(BIT_NOT, r.u = ~v.u) \
+    X(NOT, r.i = v.i == 0) \
+    X(NOT_F, r.i = v.f == 0.0) \
+    X(WRAP_I8, r.i = (int8_t)v.u) \
+    X(WRAP_U8, r.u = (uint8_t)v.u) \
+    X(WRAP_I16, r.i = (int16_t)v.u) \
+    X(WRAP_U16, r.u = (uint16_t)v.u) \
+    X(WRAP_I32, r.i = (int32_t)v.u) \
+    X(WRAP_U32, r.u = (uint32_t)v.u) \
+    X(TO_BOOL, r.i = v.i != 0) \
+    X(TO_BOOL_F, r.i = v.f != 0.0) \
+    X(I2F, r.f = (double)v.i) \
+    X(U2F, r.f = (double)v.u) \
+    X(FROUND, r.f = (float)v.f)
+
+#define DEFINE_UNARY(name, expr) \
+    static bool eval##name(const Closure *self, ClosureFrame *frame, VMValue *out){ \
+        VMValue v, r; \
+        if(!EVAL(self->a, &v)) return false; \
+        expr; \
+        *out = r; \
+        return true; \
+    }
+
+UNARY_OPS(DEFINE_UNARY)
+
+static bool evalF2I(const Closure *self, ClosureFrame *frame, VMValue *out){
+    VMValue v;
+    if(!EVAL(self->a, &v)) return false;
+    PrimitiveValue value;
+    value.doubleVal = v.f;
+    *out = primitiveToVMValue(self->other, convertPrimitive(TYPE_DOUBLE, value, self->other));
+    return true;
+}
+
+#define UNARY_FORM(name, expr) [OP_##name] = eval##name,
+static const EvalFn unaryForms[OP_COUNT] = {
+    UNARY_OPS(UNARY_FORM)
+    [OP_F2I] = evalF2I
+};
+
+// Control within expressions
+
+static bool evalAnd(const Closure *self, ClosureFrame *frame, VMValue *out){
+    if(!EVAL(self->a, out)) return false;
+    if(out->i == 0) return true;
+    if(!EVAL(self->b, out)) return false;
+    out->i = out->i != 0;
+    return true;
+}
+
+static bool evalOr(const Closure *self, ClosureFrame *frame, VMValue *out){
+    if(!EVAL(self->a, out)) return false;
+    if(out->i != 0){
+        out->i = 1;
+        return true;
+    }
+    if(!EVAL(self->b, out)) return false;
+    out->i = out->i != 0;
+    return true;
+}
+
+static bool evalTernary(const Closure *self, ClosureFrame *frame, VMValue *out){
+    VMValue truth;
+    if(!EVAL(self->a, &truth)) return false;
+    return truth.i ? EVAL(self->b, out) : EVAL(self->c, out);
+}
+
+// Runs a for its effects, then yields b.
+static bool evalSequence(const Closure *self, ClosureFrame *frame, VMValue *out){
+    return EVAL(self->a, out) && EVAL(self->b, out);
+}
+
+// Breaks, continues and returns never leave an expression, and gotos only
+// move within their compound's items, so a statement used for a value only
+// ends normally or with an error.
+static bool evalStatement(const Closure *self, ClosureFrame *frame, VMValue *out){
+    out->u = 0;
+    return EXEC(self->a) == FLOW_NORMAL;
+}
+
+static Flow runList(const Closure *list, ClosureFrame *frame, int start);
+
+// Gotos in the compound were checked to target its own labels.
+static bool evalCompound(const Closure *self, ClosureFrame *frame, VMValue *out){
+    Flow flow = runList(self, frame, 0);
+    if(flow == FLOW_JUMP) return runtimeError(frame, "no label '%s' to jump to", frame->jumpLabel);
+    if(flow != FLOW_NORMAL) return false;
+    if(!self->a){
+        out->u = 0;
+        return true;
+    }
+    return EVAL(self->a, out);
+}
+
+// Calls
+
+static bool invoke(ClosureRuntime *rt, const ClosureFunction *caller, const ClosureFunction *fn, VMValue *slots, VMValue *out){
+    ClosureFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.rt = rt;
+    frame.fn = caller;
+    if(rt->depth == rt->options.maxCallDepth) return runtimeError(&frame, "maximum call depth of %d exceeded", rt->options.maxCallDepth);
+    if(slots + fn->localCount > rt->slotsEnd) return runtimeError(&frame, "stack overflow calling %s", fn->name);
+
+    rt->depth++;
+    rt->stats.calls++;
+    frame.slots = slots;
+    Flow flow;
+    for(;;){
+        frame.fn = fn;
+        frame.top = slots + fn->localCount;
+        memset(slots + fn->paramCount, 0, (size_t)(fn->localCount - fn->paramCount) * sizeof(VMValue));
+        flow = fn->body->exec(fn->body, &frame);
+        if(flow != FLOW_TAILCALL) break;
+
+        fn = frame.tailCallee;
+        rt->stats.calls++;
+        rt->stats.tailCalls++;
+    }
+    rt->depth--;
+
+    switch(flow){
+        case FLOW_ERROR:
+            return false;
+        case FLOW_JUMP:
+            return runtimeError(&frame, "no label '%s' to jump to", frame.jumpLabel);
+        case FLOW_RETURN:
+            if(frame.hasResult){
+                *out = frame.result;
+                return true;
+            }
+            // fall through
+        default:
+            // falling off the end of a typed function returns zero
+            out->u = 0;
+            return true;
+    }
+}
+
+// Arguments go straight into the callee's frame, above the caller's locals;
+// a call inside an argument starts its own frame above those evaluated so far.
+static bool evalCall(const Closure *self, ClosureFrame *frame, VMValue *out){
+    const ClosureFunction *callee = self->callee;
+    VMValue *base = frame->top;
+    if(base + callee->localCount > frame->rt->slotsEnd) return runtimeError(frame, "stack overflow calling %s", callee->name);
+
+    for(int i = 0; i < self->count; i++){
+        VMValue value;
+        frame->top = base + i;
+        if(!EVAL(self->items[i], &value)){
+            frame->top = base;
+            return false;
+        }
+        base[i] = value;
+    }
+    frame->top = base;
+    return invoke(frame->rt, frame->fn, callee, base, out);
+}
+
+static bool evalPrint(const Closure *self, ClosureFrame *frame, VMValue *out){
+    VMValue values[UINT8_MAX];
+    for(int i = 0; i < self->count; i++){
+        if(!EVAL(self->items[i], &values[i])) return false;
+    }
+    FILE *stream = frame->rt->options.out;
+    for(int i = 0; i < self->count; i++){
+        Value value = toValue(self->types[i], values[i]);
+        if(i > 0) fputc(' ', stream);
+        printValue(&value, stream);
+    }
+    fputc('\n', stream);
+    out->u = 0;
+    return true;
+}
+
+// Statements
+
+static Flow execNothing(const Closure *self, ClosureFrame *frame){
+    (void)self;
+    (void)frame;
+    return FLOW_NORMAL;
+}
+
+static Flow execExpr(const Closure *self, ClosureFrame *frame){
+    VMValue ignored;
+    return EVAL(self->a, &ignored) ? FLOW_NORMAL : FLOW_ERROR;
+}
+
+static Flow execStoreLocal(const Closure *self, ClosureFrame *frame){
+    return EVAL(self->a, &frame->slots[self->slot]) ? FLOW_NORMAL : FLOW_ERROR;
+}
+
+static Flow execStoreGlobal(const Closure *self, ClosureFrame *frame){
+    return EVAL(self->a, &frame->rt->globals[self->slot]) ? FLOW_NORMAL : FLOW_ERROR;
+}
+
+static Flow execClear(const Closure *self, ClosureFrame *frame){
+    memset(frame->slots + self->slot, 0, (size_t)self->other * sizeof(VMValue));
+    return FLOW_NORMAL;
+}
+
+static int findListLabel(const Closure *list, const char *name){
+    for(int i = 0; i < list->count; i++){
+        if(list->labels[i] && strcmp(list->labels[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+// A goto is resolved by the innermost enclosing list that defines its label,
+// as in the evaluator.
+static Flow runList(const Closure *list, ClosureFrame *frame, int start){
+    for(int i = start; i < list->count; i++){
+        Flow flow = EXEC(list->items[i]);
+        if(flow == FLOW_NORMAL) continue;
+        if(flow != FLOW_JUMP || !list->labels) return flow;
+
+        int target = findListLabel(list, frame->jumpLabel);
+        if(target < 0) return flow;
+        i = target;
+    }
+    return FLOW_NORMAL;
+}
+
+static Flow execList(const Closure *self, ClosureFrame *frame){
+    return runList(self, frame, 0);
+}
+
+static Flow execIf(const Closure *self, ClosureFrame *frame){
+    VMValue truth;
+    if(!EVAL(self->a, &truth)) return FLOW_ERROR;
+    if(truth.i) return EXEC(self->b);
+    return self->c ? EXEC(self->c) : FLOW_NORMAL;
+}
+
+// a is the condition, b the body, c the increment; other is set when the
+// condition is tested before the first iteration.
+static Flow execLoop(const Closure *self, ClosureFrame *frame){
+    VMValue truth;
+    for(;;){
+        if(self->other && self->a){
+            if(!EVAL(self->a, &truth)) return FLOW_ERROR;
+            if(!truth.i) break;
+        }
+        Flow flow = EXEC(self->b);
+        if(flow == FLOW_BREAK) break;
+        if(flow != FLOW_NORMAL && flow != FLOW_CONTINUE) return flow;
+        if(self->c && EXEC(self->c) != FLOW_NORMAL) return FLOW_ERROR;
+        if(!self->other && self->a){
+            if(!EVAL(self->a, &truth)) return FLOW_ERROR;
+            if(!truth.i) break;
+        }
+    }
+    return FLOW_NORMAL;
+}
+
+// a stores the value in a scratch slot, items test each case against it and
+// b holds the bodies of all cases, entered at entries[i]; other is the entry
+// of the default, -1 without one.
+static Flow execSwitch(const Closure *self, ClosureFrame *frame){
+    VMValue v;
+    if(!EVAL(self->a, &v)) return FLOW_ERROR;
+
+    int entry = self->other;
+    for(int i = 0; i < self->count; i++){
+        if(!self->items[i]) continue;
+        if(!EVAL(self->items[i], &v)) return FLOW_ERROR;
+        if(v.i){
+            entry = self->entries[i];
+            break;
+        }
+    }
+    if(entry < 0) return FLOW_NORMAL;
+    Flow flow = runList(self->b, frame, entry);
+    return flow == FLOW_BREAK ? FLOW_NORMAL : flow;
+}
+
+static Flow execBreak(const Closure *self, ClosureFrame *frame){
+    (void)self;
+    (void)frame;
+    return FLOW_BREAK;
+}
+
+static Flow execContinue(const Closure *self, ClosureFrame *frame){
+    (void)self;
+    (void)frame;
+    return FLOW_CONTINUE;
+}
+
+static Flow execJump(const Closure *self, ClosureFrame *frame){
+    frame->jumpLabel = self->name;
+    return FLOW_JUMP;
+}
+
+static Flow execReturn(const Closure *self, ClosureFrame *frame){
+    if(!EVAL(self->a, &frame->result)) return FLOW_ERROR;
+    frame->hasResult = true;
+    return FLOW_RETURN;
+}
+
+// a, when set, is a call without a value made before returning.
+static Flow execReturnVoid(const Closure *self, ClosureFrame *frame){
+    VMValue ignored;
+    if(self->a && !EVAL(self->a, &ignored)) return FLOW_ERROR;
+    frame->hasResult = false;
+    return FLOW_RETURN;
+}
+
+static Flow execTailCall(const Closure *self, ClosureFrame *frame){
+    const ClosureFunction *callee = self->callee;
+    VMValue *args = frame->top;
+    if(args + self->count > frame->rt->slotsEnd || frame->slots + callee->localCount > frame->rt->slotsEnd){
+        runtimeError(frame, "stack overflow calling %s", callee->name);
+        return FLOW_ERROR;
+    }
+    for(int i = 0; i < self->count; i++){
+        VMValue value;
+        frame->top = args + i;
+        if(!EVAL(self->items[i], &value)) return FLOW_ERROR;
+        args[i] = value;
+    }
+    memmove(frame->slots, args, (size_t)self->count * sizeof(VMValue));
+    frame->tailCallee = callee;
+    return FLOW_TAILCALL;
+}
+
+// Compiler
+
+typedef enum {
+    SYMBOL_VARIABLE,
+    SYMBOL_CONSTANT             // enum value
+} SymbolKind;
+
+typedef struct {
+    const char *name;
+    SymbolKind kind;
+    PrimitiveType type;
+    bool global;
+    bool typed;                 // an untyped variable keeps the type of its initializer
+    int slot;
+    VMValue value;              // of a constant
+    int dims[MAX_ARRAY_DIMENSIONS];
+    int dimCount;               // 0 for a scalar
+    int length;
+} Symbol;
+
+// Each break and continue target records how many compound expressions
+// enclose it, so a branch out of an expression is refused.
+typedef struct {
+    int *depths;
+    int count;
+    int capacity;
+} TargetStack;
+
+// A label or goto with the compound expression it is in, 0 when none; a
+// goto has to stay inside its compound, where evalCompound resolves it.
+typedef struct {
+    const char *name;
+    int compound;
+} LabelSite;
+
+typedef struct {
+    ClosureFunction *fn;
+    int nextSlot;
+    bool topLevel;
+    bool returnTyped;           // the top level's return type is set by its first return
+    int exprDepth;              // compound expressions being compiled
+    int compound;               // the innermost of them, numbered from 1
+    int compoundCount;
+    TargetStack breaks;
+    TargetStack continues;
+    LabelSite *labels;
+    int labelCount;
+    int labelCapacity;
+    LabelSite *jumps;
+    int jumpCount;
+    int jumpCapacity;
+} FunctionState;
+
+typedef struct {
+    ClosureProgram *program;
+    FunctionState fs;
+    Symbol *symbols;
+    int symbolCount;
+    int symbolCapacity;
+    char *error;
+    size_t errorSize;
+    jmp_buf *outOfMemory;       // where compileClosures resumes when an allocation fails
+} Compiler;
+
+static bool compileError(Compiler *c, const char *format, ...){
+    if(c->error && c->errorSize > 0){
+        va_list args;
+        va_start(args, format);
+        vsnprintf(c->error, c->errorSize, format, args);
+        va_end(args);
+    }
+    return false;
+}
+
+static _Noreturn void outOfMemory(Compiler *c){
+    longjmp(*c->outOfMemory, 1);
+}
+
+static Closure *newNode(Compiler *c){
+    ClosureProgram *program = c->program;
+    Closure *node = calloc(1, sizeof(Closure));
+    if(!node || !GROW(program->nodes, program->nodeCount, program->nodeCapacity)){
+        free(node);
+        outOfMemory(c);
+    }
+    program->nodes[program->nodeCount++] = node;
+    return node;
+}
+
+static Closure *expression(Compiler *c, EvalFn eval, Closure *a, Closure *b){
+    Closure *node = newNode(c);
+    node->eval = eval;
+    node->a = a;
+    node->b = b;
+    return node;
+}
+
+static Closure *statement(Compiler *c, ExecFn exec, Closure *a, Closure *b){
+    Closure *node = newNode(c);
+    node->exec = exec;
+    node->a = a;
+    node->b = b;
+    return node;
+}
+
+static Closure **newItems(Compiler *c, int count){
+    Closure **items = calloc(count > 0 ? count : 1, sizeof(Closure *));
+    if(!items) outOfMemory(c);
+    return items;
+}
+
+static Closure *constant(Compiler *c, VMValue value){
+    Closure *node = expression(c, evalConstant, NULL, NULL);
+    node->constant = value;
+    node->pure = true;
+    return node;
+}
+
+static Closure *integer(Compiler *c, PrimitiveType type, long long n){
+    return constant(c, primitiveToVMValue(type, primitiveFromLongLong(type, n)));
+}
+
+static Closure *string(Compiler *c, const char *s){
+    ClosureProgram *program = c->program;
+    char *copy = strdup(s ? s : "");
+    if(!copy || !GROW(program->strings, program->stringCount, program->stringCapacity)){
+        free(copy);
+        outOfMemory(c);
+    }
+    program->strings[program->stringCount++] = copy;
+
+    VMValue v;
+    v.s = copy;
+    return constant(c, v);
+}
+
+static Closure *local(Compiler *c, int slot){
+    Closure *node = expression(c, evalLocal, NULL, NULL);
+    node->slot = slot;
+    return node;
+}
+
+static bool isConstant(const Closure *node){
+    return node->eval == evalConstant;
+}
+
+static bool isLocal(const Closure *node){
+    return node->eval == evalLocal;
+}
+
+// A pure node over constants is run once here and becomes a constant.
+static Closure *fold(Closure *node){
+    if(!node->pure || (node->a && !isConstant(node->a)) || (node->b && !isConstant(node->b))) return node;
+
+    ClosureFrame scratch;
+    memset(&scratch, 0, sizeof(scratch));
+    VMValue value;
+    if(!node->eval(node, &scratch, &value)) return node;
+    node->eval = evalConstant;
+    node->constant = value;
+    node->a = node->b = NULL;
+    return node;
+}
+
+static Closure *unary(Compiler *c, Opcode op, Closure *operand, int aux){
+    Closure *node = expression(c, unaryForms[op], operand, NULL);
+    node->other = aux;
+    node->pure = true;
+    return fold(node);
+}
+
+// Picks the form of op matching the shape of its operands.
+static Closure *binary(Compiler *c, Opcode op, Closure *left, Closure *right, int aux){
+    const BinaryForms *forms = &binaryForms[op];
+    Closure *node = newNode(c);
+    if(forms->ll && isLocal(left) && isLocal(right)){
+        node->eval = forms->ll;
+        node->slot = left->slot;
+        node->other = right->slot;
+        return node;
+    }
+    if(forms->lk && isLocal(left) && isConstant(right)){
+        node->eval = forms->lk;
+        node->slot = left->slot;
+        node->constant = right->constant;
+        return node;
+    }
+    node->pure = forms->xk != NULL;
+    if(forms->xk && isConstant(right)){
+        node->eval = forms->xk;
+        node->a = left;
+        node->constant = right->constant;
+    } else{
+        node->eval = forms->xx;
+        node->a = left;
+        node->b = right;
+        node->other = aux;
+    }
+    return fold(node);
+}
+
+// Scopes
+
+static Symbol *defineSymbol(Compiler *c, const char *name, SymbolKind kind, PrimitiveType type){
+    if(!GROW(c->symbols, c->symbolCount, c->symbolCapacity)) outOfMemory(c);
+    Symbol *symbol = &c->symbols[c->symbolCount++];
+    memset(symbol, 0, sizeof(*symbol));
+    symbol->name = name;
+    symbol->kind = kind;
+    symbol->type = type;
+    symbol->typed = true;
+    symbol->length = 1;
+    return symbol;
+}
+
+static Symbol *lookupSymbol(Compiler *c, const char *name){
+    for(int i = c->symbolCount - 1; i >= 0; i--){
+        if(strcmp(c->symbols[i].name, name) == 0) return &c->symbols[i];
+    }
+    return NULL;
+}
+
+static void reserveSlots(Compiler *c, int count){
+    c->fs.nextSlot += count;
+    if(c->fs.nextSlot > c->fs.fn->localCount) c->fs.fn->localCount = c->fs.nextSlot;
+}
+
+static void allocateSlots(Compiler *c, Symbol *symbol, bool global){
+    symbol->global = global;
+    if(global){
+        symbol->slot = c->program->globalSlots;
+        c->program->globalSlots += symbol->length;
+        return;
+    }
+    symbol->slot = c->fs.nextSlot;
+    reserveSlots(c, symbol->length);
+}
+
+typedef struct {
+    int symbolCount;
+    int nextSlot;
+} Scope;
+
+static Scope enterScope(Compiler *c){
+    Scope scope = {c->symbolCount, c->fs.nextSlot};
+    return scope;
+}
+
+static void leaveScope(Compiler *c, Scope scope){
+    c->symbolCount = scope.symbolCount;
+    c->fs.nextSlot = scope.nextSlot;
+}
+
+static int findClosureFunction(const ClosureProgram *program, const char *name){
+    for(int i = 1; i < program->functionCount; i++){
+        if(strcmp(program->functions[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+// Types, converted exactly as the bytecode compiler does
+
+static bool isVoidType(ASTNode *node){
+    return node && (node->type == VOID_NODE || (node->type == IDENTIFIER_NODE && strcmp(node->identifier.name, "void") == 0));
+}
+
+static bool resolvePrimitive(Compiler *c, ASTNode *node, PrimitiveType *out){
+    if(!typeNodeToPrimitive(node, out)) return compileError(c, "only primitive types are compiled to closures");
+    if(*out == TYPE_LONG_DOUBLE) return compileError(c, "long double is not compiled to closures");
+    return true;
+}
+
+static bool isWide(PrimitiveType type){
+    return primitiveSize(type) == 8;
+}
+
+static bool isUnsignedInteger(PrimitiveType type){
+    return isIntegerType(type) && !isSignedType(type);
+}
+
+static Closure *wrap(Compiler *c, Closure *node, PrimitiveType type){
+    if(!isIntegerType(type) || isWide(type)) return node;
+
+    bool isSigned = isSignedType(type);
+    switch(primitiveSize(type)){
+        case 1: return unary(c, isSigned ? OP_WRAP_I8 : OP_WRAP_U8, node, 0);
+        case 2: return unary(c, isSigned ? OP_WRAP_I16 : OP_WRAP_U16, node, 0);
+        default: return unary(c, isSigned ? OP_WRAP_I32 : OP_WRAP_U32, node, 0);
+    }
+}
+
+static bool convert(Compiler *c, Closure **node, PrimitiveType from, PrimitiveType to){
+    if(from == to) return true;
+    if(from == TYPE_STRING || to == TYPE_STRING) return compileError(c, "cannot convert %s to %s", primitiveTypeName(from), primitiveTypeName(to));
+
+    if(to == TYPE_BOOL){
+        *node = unary(c, isFloatingType(from) ? OP_TO_BOOL_F : OP_TO_BOOL, *node, 0);
+    } else if(isFloatingType(to)){
+        if(!isFloatingType(from)) *node = unary(c, isUnsignedInteger(from) && isWide(from) ? OP_U2F : OP_I2F, *node, 0);
+        if(to == TYPE_FLOAT) *node = unary(c, OP_FROUND, *node, 0);
+    } else if(isFloatingType(from)){
+        *node = unary(c, OP_F2I, *node, to);
+    } else if(from != TYPE_BOOL){
+        size_t fromSize = primitiveSize(from);
+        size_t toSize = primitiveSize(to);
+        bool fromSigned = isSignedType(from);
+        bool toSigned = isSignedType(to);
+        if(toSize < fromSize || (fromSigned && !toSigned) || (toSize == fromSize && fromSigned != toSigned)) *node = wrap(c, *node, to);
+    }
+    return true;
+}
+
+// Expressions
+
+static bool compileExpr(Compiler *c, ASTNode *node, Closure **out, bool *hasValue, PrimitiveType *type);
+static bool compileStatement(Compiler *c, ASTNode *node, Closure **out);
+static bool compileList(Compiler *c, ASTNode **items, int count, Closure **out);
+static void markLabels(Compiler *c, Closure *list);
+
+static bool compileValue(Compiler *c, ASTNode *node, Closure **out, PrimitiveType *type){
+    bool hasValue;
+    if(!compileExpr(c, node, out, &hasValue, type)) return false;
+    if(!hasValue) return compileError(c, "expression has no value");
+    return true;
+}
+
+static bool compileValueAs(Compiler *c, ASTNode *node, Closure **out, PrimitiveType type){
+    PrimitiveType actual;
+    return compileValue(c, node, out, &actual) && convert(c, out, actual, type);
+}
+
+// Yields 0 or 1 for floats, zero or not for the rest.
+static bool compileCondition(Compiler *c, ASTNode *node, Closure **out){
+    PrimitiveType type;
+    if(!compileValue(c, node, out, &type)) return false;
+    if(type == TYPE_STRING) return compileError(c, "a string is not a condition");
+    if(isFloatingType(type)) *out = unary(c, OP_TO_BOOL_F, *out, 0);
+    return true;
+}
+
+static bool arithmetic(Compiler *c, BinaryOpType op, PrimitiveType type, Closure *left, Closure *right, Closure **out){
+    bool floating = isFloatingType(type);
+    bool isUnsigned = isUnsignedInteger(type);
+    bool int32 = isSignedType(type) && primitiveSize(type) == 4;
+    switch(op){
+        case ADD_BINOP:
+        case SUB_BINOP:
+        case MUL_BINOP: {
+            static const Opcode ops[3][3] = {
+                {OP_ADD_F, OP_ADD_I32, OP_ADD_I64},
+                {OP_SUB_F, OP_SUB_I32, OP_SUB_I64},
+                {OP_MUL_F, OP_MUL_I32, OP_MUL_I64}
+            };
+            int row = op == ADD_BINOP ? 0 : op == SUB_BINOP ? 1 : 2;
+            if(floating){
+                *out = binary(c, ops[row][0], left, right, 0);
+                if(type == TYPE_FLOAT) *out = unary(c, OP_FROUND, *out, 0);
+            } else if(int32){
+                *out = binary(c, ops[row][1], left, right, 0);
+            } else{
+                *out = wrap(c, binary(c, ops[row][2], left, right, 0), type);
+            }
+            return true;
+        }
+        case DIV_BINOP:
+            if(floating){
+                *out = binary(c, OP_DIV_F, left, right, 0);
+                if(type == TYPE_FLOAT) *out = unary(c, OP_FROUND, *out, 0);
+            } else if(isUnsigned){
+                *out = binary(c, OP_DIV_U, left, right, 0);
+            } else{
+                *out = wrap(c, binary(c, OP_DIV_I, left, right, 0), type);
+            }
+            return true;
+        case MOD_BINOP: *out = binary(c, isUnsigned ? OP_MOD_U : OP_MOD_I, left, right, 0); return true;
+        case BIT_AND_BINOP: *out = binary(c, OP_BIT_AND, left, right, 0); return true;
+        case BIT_OR_BINOP: *out = binary(c, OP_BIT_OR, left, right, 0); return true;
+        case BIT_XOR_BINOP: *out = binary(c, OP_BIT_XOR, left, right, 0); return true;
+        case SHIFT_LEFT_BINOP:
+            *out = wrap(c, binary(c, OP_SHL, left, right, (int)primitiveSize(type) * 8), type);
+            return true;
+        case SHIFT_RIGHT_BINOP:
+            *out = binary(c, isSignedType(type) ? OP_SHR_I : OP_SHR_U, left, right, (int)primitiveSize(type) * 8);
+            return true;
+        case EQU_BINOP: *out = binary(c, floating ? OP_EQ_F : OP_EQ_I, left, right, 0); return true;
+        case NOT_EQU_BINOP: *out = binary(c, floating ? OP_NE_F : OP_NE_I, left, right, 0); return true;
+        case LESS_BINOP: *out = binary(c, floating ? OP_LT_F : isUnsigned ? OP_LT_U : OP_LT_I, left, right, 0); return true;
+        case LESS_EQU_BINOP: *out = binary(c, floating ? OP_LE_F : isUnsigned ? OP_LE_U : OP_LE_I, left, right, 0); return true;
+        case GREATER_BINOP: *out = binary(c, floating ? OP_GT_F : isUnsigned ? OP_GT_U : OP_GT_I, left, right, 0); return true;
+        case GREATER_EQU_BINOP: *out = binary(c, floating ? OP_GE_F : isUnsigned ? OP_GE_U : OP_GE_I, left, right, 0); return true;
+        default:
+            return compileError(c, "operator not supported for %s", primitiveTypeName(type));
+    }
+}
+
+static bool binaryOperator(Compiler *c, BinaryOpType op, PrimitiveType leftType, PrimitiveType rightType, Closure *left, Closure *right, PrimitiveType *type, Closure **out){
+    if(leftType == TYPE_STRING || rightType == TYPE_STRING) return compileError(c, "string operators are not compiled to closures");
+
+    PrimitiveType operandType;
+    if(op == SHIFT_LEFT_BINOP || op == SHIFT_RIGHT_BINOP){
+        if(!isIntegerType(rightType)) return compileError(c, "operator not supported for %s", primitiveTypeName(leftType));
+        operandType = leftType;
+        if(!convert(c, &right, rightType, TYPE_LONG_LONG)) return false;
+    } else{
+        operandType = promotePrimitiveTypes(leftType, rightType);
+        if(!convert(c, &left, leftType, operandType)) return false;
+        if(!convert(c, &right, rightType, operandType)) return false;
+    }
+    if(!primitiveBinaryHandlers[operandType][op]) return compileError(c, "operator not supported for %s", primitiveTypeName(operandType));
+
+    *type = isComparisonOp(op) ? TYPE_BOOL : operandType;
+    return arithmetic(c, op, operandType, left, right, out);
+}
+
+static bool compileBinary(Compiler *c, ASTNode *node, Closure **out, PrimitiveType *type){
+    BinaryOpType op = node->binaryOp.op;
+    Closure *left, *right;
+    if(op == AND_BINOP || op == OR_BINOP){
+        *type = TYPE_BOOL;
+        if(!compileCondition(c, node->binaryOp.left, &left) || !compileCondition(c, node->binaryOp.right, &right)) return false;
+        *out = expression(c, op == AND_BINOP ? evalAnd : evalOr, left, right);
+        return true;
+    }
+    if(op == COMMA_BINOP){
+        bool hasValue;
+        PrimitiveType ignored;
+        if(!compileExpr(c, node->binaryOp.left, &left, &hasValue, &ignored)) return false;
+        if(!compileValue(c, node->binaryOp.right, &right, type)) return false;
+        *out = expression(c, evalSequence, left, right);
+        return true;
+    }
+
+    PrimitiveType leftType, rightType;
+    if(!compileValue(c, node->binaryOp.left, &left, &leftType)) return false;
+    if(!compileValue(c, node->binaryOp.right, &right, &rightType)) return false;
+    return binaryOperator(c, op, leftType, rightType, left, right, type, out);
+}
+
+static bool compileTernary(Compiler *c, ASTNode *node, Closure **out, PrimitiveType *type){
+    PrimitiveType trueType, falseType;
+    Closure *condition, *whenTrue, *whenFalse;
+    if(!compileCondition(c, node->ternaryOp.condition, &condition)) return false;
+    if(!compileValue(c, node->ternaryOp.trueExpr, &whenTrue, &trueType)) return false;
+    if(!compileValue(c, node->ternaryOp.falseExpr, &whenFalse, &falseType)) return false;
+
+    if((trueType == TYPE_STRING) != (falseType == TYPE_STRING)) return compileError(c, "branches of a conditional have different types");
+    *type = trueType == falseType ? trueType : promotePrimitiveTypes(trueType, falseType);
+    if(!convert(c, &whenTrue, trueType, *type) || !convert(c, &whenFalse, falseType, *type)) return false;
+
+    if(isConstant(condition)){
+        *out = condition->constant.i ? whenTrue : whenFalse;
+        return true;
+    }
+    *out = expression(c, evalTernary, condition, whenTrue);
+    (*out)->c = whenFalse;
+    return true;
+}
+
+// A place is a scalar variable, or an array element with its flat index.
+typedef struct {
+    Symbol *symbol;
+    Closure *index;             // NULL for a scalar
+} Place;
+
+static bool compileIndex(Compiler *c, ASTNode *node, Symbol **symbolOut, Closure **out){
+    ASTNode *accesses[MAX_ARRAY_DIMENSIONS];
+    int count = 0;
+    ASTNode *base = node;
+    while(base->type == ARRAY_ACCESS_NODE){
+        if(count == MAX_ARRAY_DIMENSIONS) return compileError(c, "too many array dimensions");
+        accesses[count++] = base;
+        base = base->arrayAccess.array;
+    }
+    if(base->type != IDENTIFIER_NODE) return compileError(c, "only named arrays are compiled to closures");
+
+    Symbol *symbol = lookupSymbol(c, base->identifier.name);
+    if(!symbol || symbol->kind != SYMBOL_VARIABLE) return compileError(c, "unknown array '%s'", base->identifier.name);
+    if(symbol->dimCount != count) return compileError(c, "'%s' is indexed with %d subscripts but has %d dimensions", symbol->name, count, symbol->dimCount);
+
+    Closure *flat = NULL;
+    for(int k = 0; k < count; k++){
+        ASTNode *access = accesses[count - 1 - k];
+        PrimitiveType indexType;
+        Closure *index;
+        if(!compileValue(c, access->arrayAccess.index, &index, &indexType)) return false;
+        if(!isIntegerType(indexType) && indexType != TYPE_BOOL) return compileError(c, "array index is not an integer");
+        if(!convert(c, &index, indexType, TYPE_LONG_LONG)) return false;
+        if(!access->arrayAccess.inBounds){
+            index = expression(c, evalCheckIndex, index, NULL);
+            index->other = symbol->dims[k];
+        }
+        flat = k == 0 ? index : binary(c, OP_ADD_I64, binary(c, OP_MUL_I64, flat, integer(c, TYPE_LONG_LONG, symbol->dims[k]), 0), index, 0);
+    }
+    *symbolOut = symbol;
+    *out = flat;
+    return true;
+}
+
+static Closure *loadElement(Compiler *c, Symbol *symbol, Closure *index){
+    Closure *node;
+    if(!symbol->global && isLocal(index)){
+        node = expression(c, evalIndexedByLocal, NULL, NULL);
+        node->other = index->slot;
+    } else{
+        node = expression(c, symbol->global ? evalGlobalIndexed : evalIndexed, index, NULL);
+    }
+    node->slot = symbol->slot;
+    return node;
+}
+
+static bool compilePlace(Compiler *c, ASTNode *node, Place *place){
+    place->index = NULL;
+    if(node->type == ARRAY_ACCESS_NODE) return compileIndex(c, node, &place->symbol, &place->index);
+    if(node->type != IDENTIFIER_NODE) return compileError(c, "only variables and array elements are assigned in closures");
+
+    Symbol *symbol = lookupSymbol(c, node->identifier.name);
+    if(!symbol) return compileError(c, "unknown variable '%s'", node->identifier.name);
+    if(symbol->kind != SYMBOL_VARIABLE) return compileError(c, "'%s' is not a variable", symbol->name);
+    if(symbol->dimCount > 0) return compileError(c, "array '%s' is assigned as a whole", symbol->name);
+    place->symbol = symbol;
+    return true;
+}
+
+static Closure *loadScalar(Compiler *c, const Symbol *symbol){
+    if(!symbol->global) return local(c, symbol->slot);
+    Closure *node = expression(c, evalGlobal, NULL, NULL);
+    node->slot = symbol->slot;
+    return node;
+}
+
+static Closure *storeScalar(Compiler *c, const Symbol *symbol, Closure *value){
+    Closure *node = expression(c, symbol->global ? evalStoreGlobal : evalStoreLocal, value, NULL);
+    node->slot = symbol->slot;
+    return node;
+}
+
+static Closure *storeElement(Compiler *c, const Symbol *symbol, Closure *index, Closure *value){
+    Closure *node = expression(c, symbol->global ? evalStoreGlobalIndexed : evalStoreIndexed, index, value);
+    node->slot = symbol->slot;
+    return node;
+}
+
+// The element of an indexed place is staged in a scratch slot while value is
+// computed from it; the caller releases the slot.
+static int stageElement(Compiler *c){
+    int scratch = c->fs.nextSlot;
+    reserveSlots(c, 1);
+    return scratch;
+}
+
+static Closure *updateElement(Compiler *c, const Place *place, int scratch, Closure *value, bool postfix){
+    EvalFn eval;
+    if(place->symbol->global) eval = postfix ? evalPostUpdateGlobalIndexed : evalUpdateGlobalIndexed;
+    else eval = postfix ? evalPostUpdateIndexed : evalUpdateIndexed;
+    Closure *node = expression(c, eval, place->index, value);
+    node->slot = place->symbol->slot;
+    node->other = scratch;
+    return node;
+}
+
+static bool checkStoredType(Compiler *c, const Place *place, PrimitiveType type){
+    if(!place->symbol->typed && type != place->symbol->type) return compileError(c, "untyped variable '%s' changes type", place->symbol->name);
+    return true;
+}
+
+static BinaryOpType assignmentOperator(AssignmentOpType op){
+    switch(op){
+        case ADD_AND_ASSIGN: return ADD_BINOP;
+        case SUB_AND_ASSIGN: return SUB_BINOP;
+        case MUL_AND_ASSIGN: return MUL_BINOP;
+        case DIV_AND_ASSIGN: return DIV_BINOP;
+        case MOD_AND_ASSIGN: return MOD_BINOP;
+        case AND_AND_ASSIGN: return BIT_AND_BINOP;
+        case OR_AND_ASSIGN: return BIT_OR_BINOP;
+        case XOR_AND_ASSIGN: return BIT_XOR_BINOP;
+        case SHIFT_LEFT_AND_ASSIGN: return SHIFT_LEFT_BINOP;
+        case SHIFT_RIGHT_AND_ASSIGN: return SHIFT_RIGHT_BINOP;
+        default: return COMMA_BINOP;
+    }
+}
+
+static bool compileAssignment(Compiler *c, ASTNode *node, Closure **out, PrimitiveType *type){
+    Place place;
+    PrimitiveType valueType;
+    Closure *value;
+    if(!compilePlace(c, node->assignment.left, &place)) return false;
+
+    int scratch = -1;
+    if(node->assignment.op == SIMPLE_ASSIGN){
+        if(!compileValue(c, node->assignment.right, &value, &valueType)) return false;
+    } else{
+        PrimitiveType rightType;
+        Closure *current, *right;
+        if(place.index){
+            scratch = stageElement(c);
+            current = local(c, scratch);
+        } else{
+            current = loadScalar(c, place.symbol);
+        }
+        if(!compileValue(c, node->assignment.right, &right, &rightType)) return false;
+        if(!binaryOperator(c, assignmentOperator(node->assignment.op), place.symbol->type, rightType, current, right, &valueType, &value)) return false;
+    }
+    if(!checkStoredType(c, &place, valueType)) return false;
+    if(!convert(c, &value, valueType, place.symbol->type)) return false;
+    *type = place.symbol->type;
+
+    if(scratch >= 0){
+        *out = updateElement(c, &place, scratch, value, false);
+        c->fs.nextSlot--;
+    } else{
+        *out = place.index ? storeElement(c, place.symbol, place.index, value) : storeScalar(c, place.symbol, value);
+    }
+    return true;
+}
+
+static bool step(Compiler *c, PrimitiveType type, bool increment, Closure *current, Closure **out){
+    BinaryOpType op = increment ? ADD_BINOP : SUB_BINOP;
+    if(!primitiveBinaryHandlers[type][op]) return compileError(c, "operator not supported for %s", primitiveTypeName(type));
+    return arithmetic(c, op, type, current, integer(c, type, 1), out);
+}
+
+// A postfix step whose value is unused compiles as the prefix form.
+static bool compileIncrement(Compiler *c, ASTNode *node, bool valueUsed, Closure **out, PrimitiveType *type){
+    UnaryOpType op = node->unaryOp.op;
+    bool increment = op == PRE_INCREMENT_UNOP || op == POST_INCREMENT_UNOP;
+    bool postfix = valueUsed && (op == POST_INCREMENT_UNOP || op == POST_DECREMENT_UNOP);
+    Place place;
+    Closure *value;
+    if(!compilePlace(c, node->unaryOp.expr, &place)) return false;
+    if(place.symbol->type == TYPE_STRING) return compileError(c, "operator not supported for string");
+    *type = place.symbol->type;
+
+    if(place.index){
+        int scratch = stageElement(c);
+        if(!step(c, *type, increment, local(c, scratch), &value)) return false;
+        *out = updateElement(c, &place, scratch, value, postfix);
+        c->fs.nextSlot--;
+        return true;
+    }
+    if(!step(c, *type, increment, loadScalar(c, place.symbol), &value)) return false;
+    if(!postfix){
+        *out = storeScalar(c, place.symbol, value);
+        return true;
+    }
+    *out = expression(c, place.symbol->global ? evalSwapGlobal : evalSwapLocal, value, NULL);
+    (*out)->slot = place.symbol->slot;
+    return true;
+}
+
+static bool compileSizeOf(Compiler *c, ASTNode *operand, Closure **out, PrimitiveType *type){
+    PrimitiveType primitive;
+    size_t size;
+    Closure *value = NULL;
+    Symbol *symbol = operand->type == IDENTIFIER_NODE ? lookupSymbol(c, operand->identifier.name) : NULL;
+    *type = TYPE_UNSIGNED_ARCH;
+    if(operand->type == IDENTIFIER_NODE && !symbol && typeNodeToPrimitive(operand, &primitive)){
+        size = primitiveSize(primitive);
+    } else if(symbol && symbol->dimCount > 0){
+        size = (size_t)symbol->length * primitiveSize(symbol->type);
+    } else if(operand->type == LITERAL_NODE || operand->type == POINTER_NODE || operand->type == ARRAY_NODE || operand->type == STRUCT_NODE){
+        return compileError(c, "sizeof of this operand is not compiled to closures");
+    } else{
+        if(!compileValue(c, operand, &value, &primitive)) return false;
+        size = primitiveSize(primitive);
+    }
+    *out = integer(c, TYPE_UNSIGNED_ARCH, (long long)size);
+    if(value && !value->pure) *out = expression(c, evalSequence, value, *out);
+    return true;
+}
+
+static bool compileUnary(Compiler *c, ASTNode *node, bool valueUsed, Closure **out, PrimitiveType *type){
+    UnaryOpType op = node->unaryOp.op;
+    switch(op){
+        case PRE_INCREMENT_UNOP:
+        case POST_INCREMENT_UNOP:
+        case PRE_DECREMENT_UNOP:
+        case POST_DECREMENT_UNOP:
+            return compileIncrement(c, node, valueUsed, out, type);
+        case SIZE_OF_UNOP:
+            return compileSizeOf(c, node->unaryOp.expr, out, type);
+        case DEFERENCE_UNOP:
+        case ADDRESS_OF_UNOP:
+            return compileError(c, "pointers are not compiled to closures");
+        default:
+            break;
+    }
+
+    PrimitiveType operand;
+    if(!compileValue(c, node->unaryOp.expr, out, &operand)) return false;
+    if(operand == TYPE_STRING || !primitiveUnaryHandlers[operand][op]) return compileError(c, "operator not supported for %s", primitiveTypeName(operand));
+
+    *type = operand;
+    switch(op){
+        case NEGATIVE_UNOP:
+            if(isFloatingType(operand)){
+                *out = unary(c, OP_NEG_F, *out, 0);
+            } else if(isSignedType(operand) && primitiveSize(operand) == 4){
+                *out = unary(c, OP_NEG_I32, *out, 0);
+            } else{
+                *out = wrap(c, unary(c, OP_NEG_I64, *out, 0), operand);
+            }
+            return true;
+        case NOT_UNOP:
+            *type = TYPE_BOOL;
+            *out = unary(c, isFloatingType(operand) ? OP_NOT_F : OP_NOT, *out, 0);
+            return true;
+        case BIT_NOT_UNOP:
+            *out = unary(c, OP_BIT_NOT, *out, 0);
+            if(!isSignedType(operand)) *out = wrap(c, *out, operand);
+            return true;
+        default:
+            return true;
+    }
+}
+
+static bool compilePrint(Compiler *c, ASTNode *node, Closure **out){
+    int count = node->functionCall.argsCount;
+    if(count > UINT8_MAX) return compileError(c, "too many arguments to print");
+
+    Closure *print = expression(c, evalPrint, NULL, NULL);
+    print->items = newItems(c, count);
+    print->types = calloc(count > 0 ? count : 1, sizeof(PrimitiveType));
+    if(!print->types) outOfMemory(c);
+    print->count = count;
+    for(int i = 0; i < count; i++){
+        if(!compileValue(c, node->functionCall.args[i], &print->items[i], &print->types[i])) return false;
+    }
+    *out = print;
+    return true;
+}
+
+static bool compileArguments(Compiler *c, ASTNode *node, const ClosureFunction *callee, Closure *call){
+    if(node->functionCall.argsCount != callee->paramCount){
+        return compileError(c, "%s expects %d arguments, got %d", callee->name, callee->paramCount, node->functionCall.argsCount);
+    }
+    call->callee = callee;
+    call->count = callee->paramCount;
+    call->items = newItems(c, callee->paramCount);
+    for(int i = 0; i < callee->paramCount; i++){
+        if(!compileValueAs(c, node->functionCall.args[i], &call->items[i], callee->paramTypes[i])) return false;
+    }
+    return true;
+}
+
+static int calleeIndex(Compiler *c, ASTNode *node){
+    ASTNode *callee = node->functionCall.function;
+    if(callee->type != IDENTIFIER_NODE || lookupSymbol(c, callee->identifier.name)) return -1;
+    return findClosureFunction(c->program, callee->identifier.name);
+}
+
+static bool compileCall(Compiler *c, ASTNode *node, Closure **out, bool *hasValue, PrimitiveType *type){
+    ASTNode *callee = node->functionCall.function;
+    int index = calleeIndex(c, node);
+    if(index < 0){
+        if(callee->type == IDENTIFIER_NODE && !lookupSymbol(c, callee->identifier.name) && strcmp(callee->identifier.name, "print") == 0){
+            *hasValue = false;
+            return compilePrint(c, node, out);
+        }
+        return compileError(c, "only calls of top-level functions are compiled to closures");
+    }
+
+    const ClosureFunction *fn = &c->program->functions[index];
+    *out = expression(c, evalCall, NULL, NULL);
+    if(!compileArguments(c, node, fn, *out)) return false;
+    *hasValue = !fn->returnsVoid;
+    *type = fn->returnType;
+    return true;
+}
+
+// Statements of the list run for their effects and the last item, when it
+// is an expression, gives the value.
+static bool compileCompound(Compiler *c, ASTNode *node, Closure **out, bool *hasValue, PrimitiveType *type){
+    Scope scope = enterScope(c);
+    int count = node->compoundExpr.stmtCount;
+    Closure *compound = expression(c, evalCompound, NULL, NULL);
+    compound->items = newItems(c, count);
+    *hasValue = false;
+    int outer = c->fs.compound;
+    c->fs.compound = ++c->fs.compoundCount;
+    c->fs.exprDepth++;
+    for(int i = 0; i < count; i++){
+        ASTNode *stmt = node->compoundExpr.statements[i];
+        Closure *item = NULL;
+        if(i == count - 1 && stmt->type != DECLARATION_NODE){
+            if(!compileExpr(c, stmt, &item, hasValue, type)) return false;
+            if(*hasValue){
+                compound->a = item;
+                break;
+            }
+            // A label or goto stays an item so runList can see it.
+            item = item->eval == evalStatement ? item->a : statement(c, execExpr, item, NULL);
+        } else if(!compileStatement(c, stmt, &item)){
+            return false;
+        }
+        if(item) compound->items[compound->count++] = item;
+    }
+    markLabels(c, compound);
+    c->fs.exprDepth--;
+    c->fs.compound = outer;
+    leaveScope(c, scope);
+    *out = compound;
+    return true;
+}
+
+static bool compileIdentifier(Compiler *c, ASTNode *node, Closure **out, PrimitiveType *type){
+    Symbol *symbol = lookupSymbol(c, node->identifier.name);
+    if(!symbol){
+        if(findClosureFunction(c->program, node->identifier.name) >= 0) return compileError(c, "function values are not compiled to closures");
+        return compileError(c, "unknown identifier '%s'", node->identifier.name);
+    }
+    *type = symbol->type;
+    if(symbol->kind == SYMBOL_CONSTANT){
+        *out = constant(c, symbol->value);
+        return true;
+    }
+    if(symbol->dimCount > 0) return compileError(c, "array '%s' is used as a value", symbol->name);
+    *out = loadScalar(c, symbol);
+    return true;
+}
+
+static bool compileExprInContext(Compiler *c, ASTNode *node, bool valueUsed, Closure **out, bool *hasValue, PrimitiveType *type){
+    *hasValue = true;
+    switch(node->type){
+        case LITERAL_NODE:
+            *type = node->literal.type;
+            if(*type == TYPE_LONG_DOUBLE) return compileError(c, "long double is not compiled to closures");
+            *out = *type == TYPE_STRING ? string(c, node->literal.value.stringVal) : constant(c, primitiveToVMValue(*type, node->literal.value));
+            return true;
+        case IDENTIFIER_NODE:
+            return compileIdentifier(c, node, out, type);
+        case ARRAY_ACCESS_NODE: {
+            Symbol *symbol;
+            Closure *index;
+            if(!compileIndex(c, node, &symbol, &index)) return false;
+            *type = symbol->type;
+            *out = loadElement(c, symbol, index);
+            return true;
+        }
+        case ASSIGNMENT_NODE:
+            return compileAssignment(c, node, out, type);
+        case UNARY_OPERATION_NODE:
+            return compileUnary(c, node, valueUsed, out, type);
+        case BINARY_OPERATION_NODE:
+            return compileBinary(c, node, out, type);
+        case TERNARY_OPERATION_NODE:
+            return compileTernary(c, node, out, type);
+        case CAST_EXPR_NODE: {
+            PrimitiveType from;
+            if(!resolvePrimitive(c, node->castExpr.targetType, type)) return false;
+            return compileValue(c, node->castExpr.value, out, &from) && convert(c, out, from, *type);
+        }
+        case FUNCTION_CALL_NODE:
+            return compileCall(c, node, out, hasValue, type);
+        case COMPOUND_EXPR_NODE:
+            return compileCompound(c, node, out, hasValue, type);
+        case SIZEOF_NODE:
+            return compileSizeOf(c, node->sizeOfExpr.expr, out, type);
+        case TYPEOF_NODE: {
+            bool operandHasValue;
+            PrimitiveType operand;
+            Closure *value;
+            if(!compileExpr(c, node->typeOfExpr.expr, &value, &operandHasValue, &operand)) return false;
+            *type = TYPE_STRING;
+            *out = string(c, operandHasValue ? primitiveTypeName(operand) : "any");
+            if(!value->pure) *out = expression(c, evalSequence, value, *out);
+            return true;
+        }
+        case NULL_NODE:
+        case MALLOC_NODE:
+        case CALLOC_NODE:
+        case REALLOC_NODE:
+        case FREE_NODE:
+        case MEMCPY_NODE:
+        case MEMSET_NODE:
+        case MEMMOVE_NODE:
+            return compileError(c, "pointers are not compiled to closures");
+        case FIELD_ACCESS_NODE:
+        case ARRAY_NODE:
+            return compileError(c, "aggregates are not compiled to closures");
+        case FUNCTION_NODE:
+        case LAMBDA_NODE:
+            return compileError(c, "nested functions are not compiled to closures");
+        default: {
+            Closure *stmt = NULL;
+            *hasValue = false;
+            if(!compileStatement(c, node, &stmt)) return false;
+            *out = stmt ? expression(c, evalStatement, stmt, NULL) : integer(c, TYPE_INT, 0);
+            return true;
+        }
+    }
+}
+
+static bool compileExpr(Compiler *c, ASTNode *node, Closure **out, bool *hasValue, PrimitiveType *type){
+    return compileExprInContext(c, node, true, out, hasValue, type);
+}
+
+// Expressions run as statements drop their value; a store then writes its
+// slot directly.
+static bool compileDiscarded(Compiler *c, ASTNode *node, Closure **out){
+    bool hasValue;
+    PrimitiveType type;
+    Closure *value;
+    if(!compileExprInContext(c, node, false, &value, &hasValue, &type)) return false;
+    if(value->eval == evalStoreLocal || value->eval == evalStoreGlobal){
+        *out = statement(c, value->eval == evalStoreLocal ? execStoreLocal : execStoreGlobal, value->a, NULL);
+        (*out)->slot = value->slot;
+    } else if(value->eval == evalStatement){
+        *out = value->a;
+    } else{
+        *out = value->pure ? NULL : statement(c, execExpr, value, NULL);
+    }
+    return true;
+}
+
+// Declarations
+
+static bool arrayShape(Compiler *c, ASTNode *varType, ASTNode *init, Symbol *symbol){
+    ASTNode *t = varType;
+    while(t->type == ARRAY_NODE){
+        if(symbol->dimCount == MAX_ARRAY_DIMENSIONS) return compileError(c, "too many array dimensions");
+
+        long long length;
+        ASTNode *size = t->array.size;
+        if(size && size->type == LITERAL_NODE && primitiveToLongLong(size->literal.type, size->literal.value, &length) && length > 0){
+            // sized by its literal
+        } else if(!size && symbol->dimCount == 0 && init && init->type == ARRAY_NODE && init->array.elementsCount > 0){
+            length = init->array.elementsCount;
+        } else{
+            return compileError(c, "only arrays of constant size are compiled to closures");
+        }
+        if(length > MAX_ARRAY_LENGTH / symbol->length) return compileError(c, "array '%s' is too large for closures", symbol->name);
+        symbol->dims[symbol->dimCount++] = (int)length;
+        symbol->length *= (int)length;
+        t = t->array.typeOfElement;
+    }
+    return resolvePrimitive(c, t, &symbol->type);
+}
+
+typedef struct {
+    Closure **items;
+    int count;
+    int capacity;
+} StatementList;
+
+static void appendStatement(Compiler *c, StatementList *list, Closure *item){
+    if(!item) return;
+    if(!GROW(list->items, list->count, list->capacity)) outOfMemory(c);
+    list->items[list->count++] = item;
+}
+
+static bool storeElements(Compiler *c, Symbol *symbol, ASTNode *list, int level, int offset, StatementList *out){
+    int stride = 1;
+    for(int k = level + 1; k < symbol->dimCount; k++){
+        stride *= symbol->dims[k];
+    }
+    if(list->array.elementsCount > symbol->dims[level]) return compileError(c, "too many initializers for an array of %d elements", symbol->dims[level]);
+
+    for(int i = 0; i < list->array.elementsCount; i++){
+        ASTNode *element = list->array.elements[i];
+        int slot = offset + i * stride;
+        Closure *value;
+        if(level + 1 < symbol->dimCount){
+            if(element->type != ARRAY_NODE) return compileError(c, "invalid array initializer");
+            if(!storeElements(c, symbol, element, level + 1, slot, out)) return false;
+            continue;
+        }
+        if(!compileValueAs(c, element, &value, symbol->type)) return false;
+        Closure *store = statement(c, symbol->global ? execStoreGlobal : execStoreLocal, value, NULL);
+        store->slot = symbol->slot + slot;
+        appendStatement(c, out, store);
+    }
+    return true;
+}
+
+static Closure *listOf(Compiler *c, StatementList *list){
+    Closure *node = statement(c, execList, NULL, NULL);
+    node->items = list->items ? list->items : newItems(c, 0);
+    node->count = list->count;
+    return node;
+}
+
+static bool compileDeclaration(Compiler *c, ASTNode *node, bool global, Closure **out){
+    ASTNode *varType = node->declaration.varType;
+    ASTNode *init = node->declaration.initializer;
+    *out = NULL;
+    if((node->declaration.storageFlags & STORAGE_STATIC) && !global) return compileError(c, "static locals are not compiled to closures");
+
+    Symbol shape;
+    memset(&shape, 0, sizeof(shape));
+    shape.name = node->declaration.varName;
+    shape.kind = SYMBOL_VARIABLE;
+    shape.typed = varType != NULL;
+    shape.length = 1;
+
+    if(varType && varType->type == ARRAY_NODE){
+        if(!arrayShape(c, varType, init, &shape)) return false;
+        if(init && init->type != ARRAY_NODE) return compileError(c, "invalid array initializer");
+    } else if(varType){
+        if(!resolvePrimitive(c, varType, &shape.type)) return false;
+    } else if(!init){
+        return compileError(c, "untyped variable '%s' has no initializer", shape.name);
+    }
+
+    // the initializer does not see the variable it initializes
+    Closure *value = NULL;
+    if(shape.dimCount == 0 && init){
+        PrimitiveType initType;
+        if(!compileValue(c, init, &value, &initType)) return false;
+        if(!varType) shape.type = initType;
+        if(!convert(c, &value, initType, shape.type)) return false;
+    }
+
+    Symbol *symbol = defineSymbol(c, shape.name, SYMBOL_VARIABLE, shape.type);
+    *symbol = shape;
+    allocateSlots(c, symbol, global);
+
+    if(shape.dimCount == 0 && (init || global)){
+        if(init){
+            *out = statement(c, global ? execStoreGlobal : execStoreLocal, value, NULL);
+            (*out)->slot = symbol->slot;
+        }
+        return true;
+    }
+
+    // locals are cleared on every entry, globals once when the program starts
+    StatementList list = {NULL, 0, 0};
+    if(!global){
+        Closure *clear = statement(c, execClear, NULL, NULL);
+        clear->slot = symbol->slot;
+        clear->other = symbol->length;
+        appendStatement(c, &list, clear);
+    }
+    bool ok = !init || storeElements(c, symbol, init, 0, 0, &list);
+    if(list.count == 1){
+        *out = list.items[0];
+        free(list.items);
+    } else if(list.count > 1){
+        *out = listOf(c, &list);
+    }
+    return ok;
+}
+
+static void declareEnum(Compiler *c, ASTNode *node){
+    for(int i = 0; i < node->enumDef.valuesCount; i++){
+        Symbol *symbol = defineSymbol(c, node->enumDef.values[i], SYMBOL_CONSTANT, TYPE_INT);
+        symbol->value.i = node->enumDef.intValues ? node->enumDef.intValues[i] : i;
+    }
+}
+
+// Statements
+
+// Records which items are labels so gotos can find them.
+static void markLabels(Compiler *c, Closure *list){
+    for(int i = 0; i < list->count; i++){
+        Closure *item = list->items[i];
+        if(item->exec != execNothing || !item->name) continue;
+        if(!list->labels){
+            list->labels = calloc(list->count, sizeof(const char *));
+            if(!list->labels) outOfMemory(c);
+        }
+        list->labels[i] = item->name;
+    }
+}
+
+static void pushTarget(Compiler *c, TargetStack *stack, int depth){
+    if(!GROW(stack->depths, stack->count, stack->capacity)) outOfMemory(c);
+    stack->depths[stack->count++] = depth;
+}
+
+static bool checkBranch(Compiler *c, const TargetStack *stack, const char *what){
+    if(stack->count == 0) return compileError(c, "%s outside of a loop or switch", what);
+    if(stack->depths[stack->count - 1] != c->fs.exprDepth) return compileError(c, "%s out of an expression is not compiled to closures", what);
+    return true;
+}
+
+static bool compileScoped(Compiler *c, ASTNode **body, int count, Closure **out){
+    Scope scope = enterScope(c);
+    if(!compileList(c, body, count, out)) return false;
+    leaveScope(c, scope);
+    return true;
+}
+
+static bool compileIf(Compiler *c, ASTNode *node, Closure **out){
+    Closure *condition, *then, *otherwise = NULL;
+    if(!compileCondition(c, node->ifStmt.condition, &condition)) return false;
+    if(!compileScoped(c, &node->ifStmt.thenBranch, 1, &then)) return false;
+    if(node->ifStmt.elseBranch && !compileScoped(c, &node->ifStmt.elseBranch, 1, &otherwise)) return false;
+
+    *out = statement(c, execIf, condition, then);
+    (*out)->c = otherwise;
+    return true;
+}
+
+static bool compileLoop(Compiler *c, ASTNode *condition, ASTNode *increment, ASTNode **body, int bodyCount, bool testFirst, Closure **out){
+    Closure *loop = statement(c, execLoop, NULL, NULL);
+    loop->other = testFirst;
+    pushTarget(c, &c->fs.breaks, c->fs.exprDepth);
+    pushTarget(c, &c->fs.continues, c->fs.exprDepth);
+    bool ok = compileScoped(c, body, bodyCount, &loop->b);
+    c->fs.breaks.count--;
+    c->fs.continues.count--;
+    if(!ok) return false;
+
+    if(increment && !compileDiscarded(c, increment, &loop->c)) return false;
+    if(condition && !compileCondition(c, condition, &loop->a)) return false;
+    *out = loop;
+    return true;
+}
+
+static bool compileFor(Compiler *c, ASTNode *node, Closure **out){
+    Scope scope = enterScope(c);
+    Closure *init = NULL, *loop;
+    if(node->forStmt.initializer && !compileStatement(c, node->forStmt.initializer, &init)) return false;
+    if(!compileLoop(c, node->forStmt.condition, node->forStmt.increment, node->forStmt.body, node->forStmt.bodyCount, true, &loop)) return false;
+    leaveScope(c, scope);
+
+    if(!init){
+        *out = loop;
+        return true;
+    }
+    *out = statement(c, execList, NULL, NULL);
+    (*out)->items = newItems(c, 2);
+    (*out)->items[0] = init;
+    (*out)->items[1] = loop;
+    (*out)->count = 2;
+    return true;
+}
+
+static bool compileSwitch(Compiler *c, ASTNode *node, Closure **out){
+    PrimitiveType valueType;
+    Closure *value;
+    Scope scope = enterScope(c);
+    int count = node->switchStmt.caseCount;
+    if(!compileValue(c, node->switchStmt.expr, &value, &valueType)) return false;
+
+    int scratch = c->fs.nextSlot;
+    reserveSlots(c, 1);
+    Closure *select = statement(c, execSwitch, expression(c, evalStoreLocal, value, NULL), NULL);
+    select->a->slot = scratch;
+    select->items = newItems(c, count);
+    select->entries = calloc(count > 0 ? count : 1, sizeof(int));
+    if(!select->entries) outOfMemory(c);
+    select->count = count;
+    select->other = -1;
+    *out = select;
+
+    // cases are tested in order, then the default, as the evaluator does
+    for(int i = 0; i < count; i++){
+        ASTNode *caseNode = node->switchStmt.cases[i];
+        PrimitiveType caseType, ignored;
+        Closure *caseValue;
+        if(caseNode->type != CASE_NODE) continue;
+        if(!compileValue(c, caseNode->caseStmt.value, &caseValue, &caseType)) return false;
+        if(!binaryOperator(c, EQU_BINOP, valueType, caseType, local(c, scratch), caseValue, &ignored, &select->items[i])) return false;
+    }
+
+    // the bodies form one list so control falls from a case into the next
+    pushTarget(c, &c->fs.breaks, c->fs.exprDepth);
+    StatementList bodies = {NULL, 0, 0};
+    bool ok = true;
+    for(int i = 0; ok && i < count; i++){
+        ASTNode *caseNode = node->switchStmt.cases[i];
+        Closure *body;
+        if(caseNode->type == CASE_NODE){
+            ok = compileList(c, caseNode->caseStmt.body, caseNode->caseStmt.bodyCount, &body);
+        } else if(caseNode->type == DEFAULT_NODE){
+            ok = compileList(c, caseNode->defaultStmt.body, caseNode->defaultStmt.bodyCount, &body);
+            if(select->other < 0) select->other = bodies.count;
+        } else{
+            continue;
+        }
+        select->entries[i] = bodies.count;
+        for(int k = 0; ok && k < body->count; k++){
+            appendStatement(c, &bodies, body->items[k]);
+        }
+    }
+    c->fs.breaks.count--;
+    select->b = listOf(c, &bodies);
+    markLabels(c, select->b);
+    leaveScope(c, scope);
+    return ok;
+}
+
+static bool compileReturn(Compiler *c, ASTNode *node, Closure **out){
+    ClosureFunction *fn = c->fs.fn;
+    ASTNode *value = node->returnStmt.value;
+    if(c->fs.exprDepth > 0) return compileError(c, "return out of an expression is not compiled to closures");
+    if(!value){
+        if(!fn->returnsVoid && !c->fs.topLevel) return compileError(c, "%s returns without a value", fn->name);
+        *out = statement(c, execReturnVoid, NULL, NULL);
+        return true;
+    }
+
+    int callee = value->type == FUNCTION_CALL_NODE && value->functionCall.isTailCall && !c->fs.topLevel ? calleeIndex(c, value) : -1;
+    if(callee >= 0){
+        const ClosureFunction *target = &c->program->functions[callee];
+        if(target->returnsVoid == fn->returnsVoid && (fn->returnsVoid || target->returnType == fn->returnType)){
+            *out = statement(c, execTailCall, NULL, NULL);
+            return compileArguments(c, value, target, *out);
+        }
+    }
+
+    Closure *result;
+    if(fn->returnsVoid && !c->fs.topLevel){
+        bool hasValue;
+        PrimitiveType ignored;
+        if(!compileExpr(c, value, &result, &hasValue, &ignored)) return false;
+        if(hasValue) return compileError(c, "void function %s returns a value", fn->name);
+        *out = statement(c, execReturnVoid, result, NULL);
+        return true;
+    }
+
+    PrimitiveType type;
+    if(!compileValue(c, value, &result, &type)) return false;
+    if(c->fs.topLevel && !c->fs.returnTyped){
+        fn->returnType = type;
+        c->fs.returnTyped = true;
+    }
+    if(!convert(c, &result, type, fn->returnType)) return false;
+    *out = statement(c, execReturn, result, NULL);
+    return true;
+}
+
+static const LabelSite *findLabelSite(const LabelSite *sites, int count, const char *name){
+    for(int i = 0; i < count; i++){
+        if(strcmp(sites[i].name, name) == 0) return &sites[i];
+    }
+    return NULL;
+}
+
+// Sets *out to NULL for statements that do nothing at run time.
+static bool compileStatement(Compiler *c, ASTNode *node, Closure **out){
+    *out = NULL;
+    if(!node) return true;
+
+    switch(node->type){
+        case DECLARATION_NODE:
+            return compileDeclaration(c, node, false, out);
+        case BLOCK_NODE:
+            return compileScoped(c, node->block.statements, node->block.stmtCount, out);
+        case IF_NODE:
+            return compileIf(c, node, out);
+        case WHILE_NODE:
+            return compileLoop(c, node->whileStmt.condition, NULL, node->whileStmt.body, node->whileStmt.bodyCount, true, out);
+        case DO_WHILE_NODE:
+            return compileLoop(c, node->doWhileStmt.condition, NULL, node->doWhileStmt.body, node->doWhileStmt.bodyCount, false, out);
+        case FOR_NODE:
+            return compileFor(c, node, out);
+        case SWITCH_NODE:
+            return compileSwitch(c, node, out);
+        case BREAK_NODE:
+            if(!checkBranch(c, &c->fs.breaks, "break")) return false;
+            *out = statement(c, execBreak, NULL, NULL);
+            return true;
+        case CONTINUE_NODE:
+            if(!checkBranch(c, &c->fs.continues, "continue")) return false;
+            *out = statement(c, execContinue, NULL, NULL);
+            return true;
+        case RETURN_NODE:
+            return compileReturn(c, node, out);
+        case LABEL_NODE: {
+            const char *name = node->labelStmt.labelName;
+            if(findLabelSite(c->fs.labels, c->fs.labelCount, name)) return compileError(c, "label '%s' is defined twice", name);
+            if(!GROW(c->fs.labels, c->fs.labelCount, c->fs.labelCapacity)) outOfMemory(c);
+            c->fs.labels[c->fs.labelCount++] = (LabelSite){name, c->fs.compound};
+            *out = statement(c, execNothing, NULL, NULL);
+            (*out)->name = name;
+            return true;
+        }
+        case JUMP_NODE:
+            if(!GROW(c->fs.jumps, c->fs.jumpCount, c->fs.jumpCapacity)) outOfMemory(c);
+            c->fs.jumps[c->fs.jumpCount++] = (LabelSite){node->jumpStmt.labelName, c->fs.compound};
+            *out = statement(c, execJump, NULL, NULL);
+            (*out)->name = node->jumpStmt.labelName;
+            return true;
+        case ENUM_NODE:
+            declareEnum(c, node);
+            return true;
+        case STRUCT_NODE:
+        case UNION_NODE:
+        case TYPEDEF_NODE:
+        case INCLUDE_NODE:
+            return true;
+        case TRY_NODE:
+        case THROW_NODE:
+        case CATCH_NODE:
+            return compileError(c, "exceptions are not compiled to closures");
+        case IMPL_NODE:
+            return compileError(c, "methods are not compiled to closures");
+        case CASE_NODE:
+        case DEFAULT_NODE:
+            return compileError(c, "case outside of a switch");
+        case COMPOUND_EXPR_NODE:
+            return compileScoped(c, node->compoundExpr.statements, node->compoundExpr.stmtCount, out);
+        default:
+            return compileDiscarded(c, node, out);
+    }
+}
+
+static bool compileList(Compiler *c, ASTNode **items, int count, Closure **out){
+    Closure *list = statement(c, execList, NULL, NULL);
+    list->items = newItems(c, count);
+    *out = list;
+    for(int i = 0; i < count; i++){
+        Closure *item;
+        if(!compileStatement(c, items[i], &item)) return false;
+        if(item) list->items[list->count++] = item;
+    }
+    markLabels(c, list);
+    return true;
+}
+
+// Functions
+
+static void beginFunction(Compiler *c, ClosureFunction *fn, bool topLevel){
+    memset(&c->fs, 0, sizeof(c->fs));
+    c->fs.fn = fn;
+    c->fs.topLevel = topLevel;
+}
+
+static bool endFunction(Compiler *c){
+    bool ok = true;
+    for(int i = 0; ok && i < c->fs.jumpCount; i++){
+        const LabelSite *jump = &c->fs.jumps[i];
+        const LabelSite *label = findLabelSite(c->fs.labels, c->fs.labelCount, jump->name);
+        if(!label) ok = compileError(c, "label '%s' is not defined in %s", jump->name, c->fs.fn->name);
+        else if(label->compound != jump->compound) ok = compileError(c, "goto into or out of an expression is not compiled to closures");
+    }
+    free(c->fs.labels);
+    free(c->fs.jumps);
+    free(c->fs.breaks.depths);
+    free(c->fs.continues.depths);
+    return ok;
+}
+
+static ClosureFunction *addFunction(Compiler *c, const char *name){
+    ClosureProgram *program = c->program;
+    if(!GROW(program->functions, program->functionCount, program->functionCapacity)) outOfMemory(c);
+    ClosureFunction *fn = &program->functions[program->functionCount++];
+    memset(fn, 0, sizeof(*fn));
+    fn->name = strdup(name);
+    if(!fn->name) outOfMemory(c);
+    fn->returnType = TYPE_INT;
+    fn->returnsVoid = true;
+    return fn;
+}
+
+static bool declareFunction(Compiler *c, ASTNode *node){
+    const char *name = node->functionDef.name;
+    if(!name) return compileError(c, "anonymous functions are not compiled to closures");
+    if(findClosureFunction(c->program, name) >= 0) return compileError(c, "function %s is defined twice", name);
+
+    ASTNode *returnType = node->functionDef.returnType;
+    PrimitiveType type = TYPE_INT;
+    if(!returnType) return compileError(c, "%s has no declared return type", name);
+    if(!isVoidType(returnType) && !resolvePrimitive(c, returnType, &type)) return false;
+
+    ClosureFunction *fn = addFunction(c, name);
+    fn->returnsVoid = isVoidType(returnType);
+    fn->returnType = type;
+    fn->paramCount = node->functionDef.paramCount;
+    fn->paramTypes = calloc(fn->paramCount > 0 ? fn->paramCount : 1, sizeof(PrimitiveType));
+    if(!fn->paramTypes) outOfMemory(c);
+
+    for(int i = 0; i < fn->paramCount; i++){
+        ASTNode *param = node->functionDef.params[i];
+        if(param->type != DECLARATION_NODE || !param->declaration.varType) return compileError(c, "parameters of %s need declared types", name);
+        if(param->declaration.varType->type == ARRAY_NODE) return compileError(c, "array parameters are not compiled to closures");
+        if(!resolvePrimitive(c, param->declaration.varType, &fn->paramTypes[i])) return false;
+    }
+    return true;
+}
+
+static bool compileFunction(Compiler *c, ASTNode *node){
+    ClosureFunction *fn = &c->program->functions[findClosureFunction(c->program, node->functionDef.name)];
+    FunctionState outer = c->fs;
+    Scope scope = enterScope(c);
+
+    beginFunction(c, fn, false);
+    for(int i = 0; i < fn->paramCount; i++){
+        ASTNode *param = node->functionDef.params[i];
+        Symbol *symbol = defineSymbol(c, param->declaration.varName, SYMBOL_VARIABLE, fn->paramTypes[i]);
+        allocateSlots(c, symbol, false);
+    }
+    bool ok = compileList(c, node->functionDef.body, node->functionDef.bodyCount, &fn->body);
+    ok = endFunction(c) && ok;
+
+    leaveScope(c, scope);
+    c->fs = outer;
+    return ok;
+}
+
+static bool isTopLevelCode(ASTNode *item){
+    switch(item->type){
+        case FUNCTION_NODE:
+        case DECLARATION_NODE:
+        case STRUCT_NODE:
+        case UNION_NODE:
+        case ENUM_NODE:
+        case TYPEDEF_NODE:
+        case IMPL_NODE:
+        case INCLUDE_NODE:
+            return false;
+        default:
+            return true;
+    }
+}
+
+void freeClosureProgram(ClosureProgram *program){
+    if(!program) return;
+    for(int i = 0; i < program->functionCount; i++){
+        free(program->functions[i].name);
+        free(program->functions[i].paramTypes);
+    }
+    for(int i = 0; i < program->nodeCount; i++){
+        Closure *node = program->nodes[i];
+        free(node->items);
+        free(node->labels);
+        free(node->entries);
+        free(node->types);
+        free(node);
+    }
+    for(int i = 0; i < program->stringCount; i++){
+        free(program->strings[i]);
+    }
+    free(program->functions);
+    free(program->nodes);
+    free(program->strings);
+    free(program);
+}
+
+static bool compileProgram(Compiler *c, ASTNode *program, bool *hasCode){
+    ASTNode **items = &program;
+    int count = program ? 1 : 0;
+    if(program && program->type == BLOCK_NODE){
+        items = program->block.statements;
+        count = program->block.stmtCount;
+    }
+
+    addFunction(c, "__init");
+    bool ok = true;
+    for(int i = 0; ok && i < count; i++){
+        if(items[i] && items[i]->type == FUNCTION_NODE) ok = declareFunction(c, items[i]);
+    }
+
+    // functions are all declared, so pointers into the table stay valid from here
+    ClosureFunction *top = &c->program->functions[0];
+    Closure *list = statement(c, execList, NULL, NULL);
+    list->items = newItems(c, count);
+    top->body = list;
+    beginFunction(c, top, true);
+    for(int i = 0; ok && i < count; i++){
+        ASTNode *item = items[i];
+        Closure *stmt = NULL;
+        if(!item) continue;
+
+        if(item->type == FUNCTION_NODE){
+            ok = compileFunction(c, item);
+        } else if(item->type == DECLARATION_NODE){
+            ok = compileDeclaration(c, item, true, &stmt);
+        } else{
+            *hasCode = *hasCode || isTopLevelCode(item);
+            ok = compileStatement(c, item, &stmt);
+        }
+        if(stmt) list->items[list->count++] = stmt;
+    }
+    markLabels(c, list);
+    return endFunction(c) && ok;
+}
+
+// An allocation failure anywhere in compileProgram ends up here, as an error.
+static bool compileGuarded(Compiler *c, ASTNode *program, bool *hasCode){
+    jmp_buf failed;
+    if(setjmp(failed)) return compileError(c, "out of memory compiling closures");
+    c->outOfMemory = &failed;
+    return compileProgram(c, program, hasCode);
+}
+
+ClosureProgram *compileClosures(ASTNode *program, char *error, size_t errorSize){
+    Compiler c;
+    memset(&c, 0, sizeof(c));
+    c.program = calloc(1, sizeof(ClosureProgram));
+    if(!c.program) return NULL;
+    c.program->mainFunction = -1;
+    c.error = error;
+    c.errorSize = errorSize;
+
+    bool hasCode = false;
+    bool ok = compileGuarded(&c, program, &hasCode);
+    free(c.symbols);
+
+    if(!ok){
+        freeClosureProgram(c.program);
+        return NULL;
+    }
+    if(!hasCode){
+        int entry = findClosureFunction(c.program, "main");
+        if(entry >= 0 && c.program->functions[entry].paramCount == 0) c.program->mainFunction = entry;
+    }
+    return c.program;
+}
+
+// Runtime
+
+VMOptions defaultClosureOptions(void){
+    VMOptions options = defaultVMOptions();
+    options.maxCallDepth = 2000;
+    return options;
+}
+
+ClosureRuntime *createClosureRuntime(const ClosureProgram *program, const VMOptions *options){
+    ClosureRuntime *rt = calloc(1, sizeof(ClosureRuntime));
+    if(!rt) return NULL;
+
+    rt->program = program;
+    rt->options = options ? *options : defaultClosureOptions();
+    if(!rt->options.out) rt->options.out = stdout;
+    int slots = rt->options.stackSlots > 0 ? rt->options.stackSlots : 1;
+    rt->slots = calloc(slots, sizeof(VMValue));
+    rt->slotsEnd = rt->slots + rt->options.stackSlots;
+    rt->globals = calloc(program->globalSlots > 0 ? program->globalSlots : 1, sizeof(VMValue));
+    if(!rt->slots || !rt->globals){
+        freeClosureRuntime(rt);
+        return NULL;
+    }
+    return rt;
+}
+
+void freeClosureRuntime(ClosureRuntime *rt){
+    if(!rt) return;
+    free(rt->slots);
+    free(rt->globals);
+    free(rt);
+}
+
+const char *closureError(ClosureRuntime *rt){
+    return rt->error[0] ? rt->error : NULL;
+}
+
+const VMStats *closureStats(ClosureRuntime *rt){
+    return &rt->stats;
+}
+
+static void resetRun(ClosureRuntime *rt){
+    rt->error[0] = '\0';
+    rt->depth = 0;
+    memset(&rt->stats, 0, sizeof(rt->stats));
+}
+
+// The top-level code returns a value only through an explicit return.
+static bool runTopLevel(ClosureRuntime *rt, Value *result){
+    const ClosureFunction *top = &rt->program->functions[0];
+    ClosureFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.rt = rt;
+    frame.fn = top;
+    frame.slots = rt->slots;
+    frame.top = rt->slots + top->localCount;
+    if(frame.top > rt->slotsEnd) return runtimeError(&frame, "stack overflow");
+
+    Flow flow = top->body->exec(top->body, &frame);
+    if(flow == FLOW_ERROR) return false;
+    if(flow == FLOW_JUMP) return runtimeError(&frame, "no label '%s' to jump to", frame.jumpLabel);
+    if(flow == FLOW_RETURN && frame.hasResult){
+        *result = toValue(top->returnType, frame.result);
+    } else{
+        result->kind = VALUE_VOID;
+    }
+    return true;
+}
+
+bool runClosures(ClosureRuntime *rt, Value *result){
+    const ClosureProgram *program = rt->program;
+    resetRun(rt);
+    memset(rt->globals, 0, (size_t)program->globalSlots * sizeof(VMValue));
+
+    Value value;
+    if(!runTopLevel(rt, &value)) return false;
+    if(value.kind == VALUE_VOID && program->mainFunction > 0){
+        const ClosureFunction *fn = &program->functions[program->mainFunction];
+        VMValue v;
+        if(!invoke(rt, &program->functions[0], fn, rt->slots, &v)) return false;
+        if(!fn->returnsVoid) value = toValue(fn->returnType, v);
+    }
+    if(result) *result = value;
+    return true;
+}
+
+// Globals keep the values left by the last runClosures.
+bool callClosures(ClosureRuntime *rt, const char *name, const Value *args, int argCount, Value *result){
+    const ClosureProgram *program = rt->program;
+    resetRun(rt);
+    int index = findClosureFunction(program, name);
+    if(index < 0){
+        snprintf(rt->error, sizeof(rt->error), "no function named '%s'", name);
+        return false;
+    }
+
+    const ClosureFunction *fn = &program->functions[index];
+    ClosureFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.rt = rt;
+    frame.fn = fn;
+    if(argCount != fn->paramCount) return runtimeError(&frame, "expects %d arguments, got %d", fn->paramCount, argCount);
+    if(argCount > rt->options.stackSlots) return runtimeError(&frame, "stack overflow");
+    for(int i = 0; i < argCount; i++){
+        PrimitiveType type = fn->paramTypes[i];
+        if(args[i].kind != VALUE_PRIMITIVE || (args[i].type == TYPE_STRING) != (type == TYPE_STRING)){
+            return runtimeError(&frame, "argument %d is not convertible to %s", i + 1, primitiveTypeName(type));
+        }
+        rt->slots[i] = primitiveToVMValue(type, convertPrimitive(args[i].type, args[i].as.primitive, type));
+    }
+
+    VMValue v;
+    if(!invoke(rt, fn, fn, rt->slots, &v)) return false;
+    if(result){
+        if(fn->returnsVoid) result->kind = VALUE_VOID;
+        else *result = toValue(fn->returnType, v);
+    }
+    return true;
+}
@@ -0,0 +1,31 @@
+#ifndef CLOSURE_H
+#define CLOSURE_H
+
+#include "ast.h"
+#include "eval.h"
+#include "vm.h"
+
+typedef struct ClosureProgram ClosureProgram;
+typedef struct ClosureRuntime ClosureRuntime;
+
+// Compiles the subset compileBytecode accepts into a tree of closures: a C
+// function per node, picked by node type, operand types and whether the
+// operands are locals or constants, with its operands bound in. Running a
+// program then never switches on node types again.
+ClosureProgram *compileClosures(ASTNode *program, char *error, size_t errorSize);
+void freeClosureProgram(ClosureProgram *program);
+
+// Calls recurse on the C stack, so the default call depth is the evaluator's.
+VMOptions defaultClosureOptions(void);
+
+// The program must outlive the runtime.
+ClosureRuntime *createClosureRuntime(const ClosureProgram *program, const VMOptions *options);
+void freeClosureRuntime(ClosureRuntime *rt);
+
+bool runClosures(ClosureRuntime *rt, Value *result);
+bool callClosures(ClosureRuntime *rt, const char *name, const Value *args, int argCount, Value *result);
+
+const char *closureError(ClosureRuntime *rt);
+const VMStats *closureStats(ClosureRuntime *rt);
+
+#endif
@@ -0,0 +1,230 @@
+#include "context.h"
+#include "parser.h"
+#include "utils.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_BLOCK_SIZE 65536
+
+// Strings live in blocks freed all at once with the context, so lexing a
+// token costs a table lookup and, for new text, a bump of the block.
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t size;
+    unsigned char data[];
+} ArenaBlock;
+
+typedef struct {
+    uint64_t hash;
+    size_t length;
+    char *text;                 // NULL for an empty entry
+} InternEntry;
+
+struct Context {
+    ContextOptions options;
+    ArenaBlock *blocks;         // the newest, which is being filled, first
+
+    InternEntry *strings;       // open addressing, capacity a power of two
+    int stringCount;
+    int stringCapacity;
+
+    ASTNode **programs;
+    int programCount;
+    int programCapacity;
+
+    Engine **engines;
+    int engineCount;
+    int engineCapacity;
+
+    bool outOfMemory;           // set by internString, reported by parseSource
+    char error[256];
+};
+
+ContextOptions defaultContextOptions(void){
+    ContextOptions options;
+    options.backend = BACKEND_EVALUATOR;
+    options.engine.out = NULL;
+    options.engine.threads = 0;
+    options.engine.perfMap = false;
+    options.engine.callThreshold = 0;
+    options.engine.loopThreshold = 0;
+    options.engine.tierLog = NULL;
+    return options;
+}
+
+Context *createContext(const ContextOptions *options){
+    Context *context = calloc(1, sizeof(Context));
+    if(!context) return NULL;
+    context->options = options ? *options : defaultContextOptions();
+    return context;
+}
+
+void freeContext(Context *context){
+    if(!context) return;
+    for(int i = 0; i < context->engineCount; i++){
+        freeEngine(context->engines[i]);
+    }
+    for(int i = 0; i < context->programCount; i++){
+        freeAST(context->programs[i]);
+    }
+    while(context->blocks){
+        ArenaBlock *next = context->blocks->next;
+        free(context->blocks);
+        context->blocks = next;
+    }
+    free(context->engines);
+    free(context->programs);
+    free(context->strings);
+    free(context);
+}
+
+static char *arenaAllocate(Context *context, size_t size){
+    ArenaBlock *block = context->blocks;
+    if(!block || block->used + size > block->size){
+        // text longer than a block gets one of its own
+        size_t blockSize = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = malloc(offsetof(ArenaBlock, data) + blockSize);
+        if(!block) return NULL;
+        block->next = context->blocks;
+        block->used = 0;
+        block->size = blockSize;
+        context->blocks = block;
+    }
+    char *start = (char *)block->data + block->used;
+    block->used += size;
+    return start;
+}
+
+static uint64_t hashText(const char *text, size_t length){
+    uint64_t hash = 1469598103934665603ULL;
+    for(size_t i = 0; i < length; i++){
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static bool rehashStrings(Context *context){
+    int capacity = context->stringCapacity ? context->stringCapacity * 2 : 256;
+    InternEntry *strings = calloc(capacity, sizeof(InternEntry));
+    if(!strings) return false;
+    for(int i = 0; i < context->stringCapacity; i++){
+        InternEntry *entry = &context->strings[i];
+        if(!entry->text) continue;
+        int slot = (int)(entry->hash & (uint64_t)(capacity - 1));
+        while(strings[slot].text) slot = (slot + 1) & (capacity - 1);
+        strings[slot] = *entry;
+    }
+    free(context->strings);
+    context->strings = strings;
+    context->stringCapacity = capacity;
+    return true;
+}
+
+char *internString(Context *context, const char *text, size_t length){
+    static char empty[1];
+    if((context->stringCount + 1) * 4 > context->stringCapacity * 3 && !rehashStrings(context)){
+        context->outOfMemory = true;
+        return empty;
+    }
+
+    uint64_t hash = hashText(text, length);
+    int mask = context->stringCapacity - 1;
+    int slot = (int)(hash & (uint64_t)mask);
+    while(context->strings[slot].text){
+        InternEntry *entry = &context->strings[slot];
+        if(entry->hash == hash && entry->length == length && memcmp(entry->text, text, length) == 0) return entry->text;
+        slot = (slot + 1) & mask;
+    }
+
+    char *copy = arenaAllocate(context, length + 1);
+    if(!copy){
+        context->outOfMemory = true;
+        return empty;
+    }
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    context->strings[slot] = (InternEntry){hash, length, copy};
+    context->stringCount++;
+    return copy;
+}
+
+ASTNode *parseSource(Context *context, const char *source){
+    Lexer lexer;
+    Parser parser;
+    initLexer(&lexer, context, source);
+    initParser(&parser, &lexer);
+
+    ASTNode **statements = NULL;
+    int count = 0;
+    int capacity = 0;
+    context->outOfMemory = false;
+    while(parser.current.type != TOKEN_EOF){
+        ASTNode *statement = parseStmt(&parser);
+        if(!statement){
+            // the parser stops at the token it could not take
+            snprintf(context->error, sizeof(context->error), "line %d, column %d: unexpected '%s'",
+                     parser.current.line, parser.current.column, parser.current.type == TOKEN_EOF ? "end of input" : parser.current.lexeme);
+            for(int i = 0; i < count; i++){
+                freeAST(statements[i]);
+            }
+            free(statements);
+            return NULL;
+        }
+        if(!GROW(statements, count, capacity)){
+            freeAST(statement);
+            context->outOfMemory = true;
+            break;
+        }
+        statements[count++] = statement;
+    }
+
+    ASTNode *program = context->outOfMemory ? NULL : createBlockNode(statements, count);
+    if(!program){
+        if(context->outOfMemory){
+            for(int i = 0; i < count; i++){
+                freeAST(statements[i]);
+            }
+        }
+        free(statements);
+        snprintf(context->error, sizeof(context->error), "out of memory");
+        return NULL;
+    }
+    free(statements);
+    if(!GROW(context->programs, context->programCount, context->programCapacity)){
+        freeAST(program);
+        snprintf(context->error, sizeof(context->error), "out of memory");
+        return NULL;
+    }
+    context->programs[context->programCount++] = program;
+    return program;
+}
+
+Engine *contextEngine(Context *context, ASTNode *program){
+    Engine *engine = createEngineWithOptions(program, context->options.backend, &context->options.engine, context->error, sizeof(context->error));
+    if(!engine) return NULL;
+    if(!GROW(context->engines, context->engineCount, context->engineCapacity)){
+        freeEngine(engine);
+        snprintf(context->error, sizeof(context->error), "out of memory");
+        return NULL;
+    }
+    context->engines[context->engineCount++] = engine;
+    return engine;
+}
+
+bool runSource(Context *context, const char *source, Value *result){
+    ASTNode *program = parseSource(context, source);
+    if(!program) return false;
+    Engine *engine = contextEngine(context, program);
+    if(!engine) return false;
+    if(runEngine(engine, result)) return true;
+    snprintf(context->error, sizeof(context->error), "%s", engineError(engine));
+    return false;
+}
+
+const char *contextError(Context *context){
+    return context->error;
+}
@@ -0,0 +1,36 @@
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include "backend.h"
+
+// Everything one script needs from source to result: the strings its tokens
+// point into, the programs parsed from it and the engines running them.
+// Contexts share nothing, so each thread can parse and run its own scripts
+// without locks; a single context is used by one thread at a time.
+typedef struct Context Context;
+
+typedef struct {
+    ExecutionBackend backend;
+    EngineOptions engine;       // threads counts each engine's parallel loop workers
+} ContextOptions;
+
+ContextOptions defaultContextOptions(void);
+Context *createContext(const ContextOptions *options);
+// Frees the context's engines, programs and strings together.
+void freeContext(Context *context);
+
+// The context's copy of length bytes of text, the same pointer for equal
+// text; shared, so it is never written or freed. Empty text when out of
+// memory, which parseSource then reports.
+char *internString(Context *context, const char *text, size_t length);
+
+// Parses source as a list of statements into a block the context owns; NULL
+// with the position in contextError when it does not parse.
+ASTNode *parseSource(Context *context, const char *source);
+// Engine for program on the context's backend, freed with the context.
+Engine *contextEngine(Context *context, ASTNode *program);
+// Parses and runs source on a fresh engine.
+bool runSource(Context *context, const char *source, Value *result);
+const char *contextError(Context *context);
+
+#endif
@@ -0,0 +1,1092 @@
+#include "cse.h"
+#include "primitive.h"
+#include "utils.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ADDRESS_KEY -1          // key kind for the address of an element or field
+
+typedef struct {
+    int kind;                   // node type, or ADDRESS_KEY
+    int op;
+    int operands[2];
+    const char *name;
+    long long version;          // variable version or memory epoch the value was read in
+    PrimitiveType literalType;
+    PrimitiveValue literal;
+} ValueKey;
+
+typedef struct {
+    ValueKey key;
+    uint64_t hash;
+    ASTNode **first;            // where the value is first computed, NULL for leaves
+    ASTNode ***list;            // statement list the temporary is declared in
+    int *listCount;
+    int listIndex;
+    int reuses;
+    bool isAddress;
+    bool available;
+    bool dead;                  // first computation lies inside a reused expression
+    bool typed;
+    PrimitiveType type;
+} ValueEntry;
+
+typedef struct {
+    int entry;
+    ASTNode **slot;
+} Reuse;
+
+typedef struct {
+    ASTNode ***list;
+    int *count;
+    int index;
+} ListContext;
+
+typedef struct {
+    char *name;
+    long long version;
+} NameVersion;
+
+typedef struct {
+    CSEStats *stats;
+    TypeScope scope;
+    int tempCount;
+
+    ValueEntry *entries;
+    int entryCount;
+    int entryCapacity;
+    int *buckets;
+    int bucketCount;
+
+    Reuse *reuses;
+    int reuseCount;
+    int reuseCapacity;
+
+    int *available;             // entries in the order they became available
+    int availableCount;
+    int availableCapacity;
+
+    ListContext *lists;
+    int listDepth;
+    int listCapacity;
+
+    NameSet locals;
+    NameSet aliased;            // address taken, or written by a nested function
+    NameVersion *versions;
+    int versionCount;
+    int versionCapacity;
+    long long nextVersion;
+    long long memoryEpoch;
+
+    bool failed;
+} CSEPass;
+
+typedef struct {
+    NameSet written;
+    bool writesMemory;
+} Effects;
+
+static bool grow(void **items, int *capacity, int count, size_t size){
+    if(count < *capacity) return true;
+
+    int newCapacity = *capacity ? *capacity * 2 : 16;
+    void *grown = realloc(*items, newCapacity * size);
+    if(!grown) return false;
+    *items = grown;
+    *capacity = newCapacity;
+    return true;
+}
+
+// Variables and memory
+
+static NameVersion *findVersion(CSEPass *p, const char *name){
+    for(int i = 0; i < p->versionCount; i++){
+        if(strcmp(p->versions[i].name, name) == 0) return &p->versions[i];
+    }
+    return NULL;
+}
+
+static long long versionOf(CSEPass *p, const char *name){
+    NameVersion *version = findVersion(p, name);
+    return version ? version->version : 0;
+}
+
+// Globals and aliased locals can change through any pointer or call.
+static bool isExposed(CSEPass *p, const char *name){
+    return !hasName(&p->locals, name) || hasName(&p->aliased, name);
+}
+
+static void killMemory(CSEPass *p){
+    p->memoryEpoch++;
+}
+
+static void killName(CSEPass *p, const char *name){
+    NameVersion *version = findVersion(p, name);
+    if(!version){
+        char *copy = strdup(name);
+        if(!copy || !grow((void **)&p->versions, &p->versionCapacity, p->versionCount, sizeof(NameVersion))){
+            free(copy);
+            p->failed = true;
+            return;
+        }
+        version = &p->versions[p->versionCount++];
+        version->name = copy;
+    }
+    version->version = ++p->nextVersion;
+    if(isExposed(p, name)) killMemory(p);
+}
+
+static void noteWrite(CSEPass *p, ASTNode *target){
+    while(target){
+        switch(target->type){
+            case IDENTIFIER_NODE:
+                killName(p, target->identifier.name);
+                return;
+            case FIELD_ACCESS_NODE:
+                // a field of a local aggregate changes the aggregate's value
+                if(!target->fieldAccess.isPointerAccess){
+                    target = target->fieldAccess.object;
+                    break;
+                }
+                killMemory(p);
+                return;
+            default:
+                killMemory(p);
+                return;
+        }
+    }
+}
+
+static void collectWrites(ASTNode **slot, void *ctx){
+    Effects *effects = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    ASTNode *target = NULL;
+    switch(node->type){
+        case ASSIGNMENT_NODE:
+            target = node->assignment.left;
+            break;
+        case UNARY_OPERATION_NODE:
+            if(node->unaryOp.op >= PRE_INCREMENT_UNOP && node->unaryOp.op <= POST_DECREMENT_UNOP) target = node->unaryOp.expr;
+            break;
+        case DECLARATION_NODE:
+            addName(&effects->written, node->declaration.varName);
+            break;
+        case FUNCTION_CALL_NODE:
+        case REALLOC_NODE:
+        case FREE_NODE:
+        case MEMCPY_NODE:
+        case MEMSET_NODE:
+        case MEMMOVE_NODE:
+            effects->writesMemory = true;
+            break;
+        default:
+            break;
+    }
+
+    while(target){
+        if(target->type == IDENTIFIER_NODE){
+            addName(&effects->written, target->identifier.name);
+            break;
+        } else if(target->type == FIELD_ACCESS_NODE && !target->fieldAccess.isPointerAccess){
+            target = target->fieldAccess.object;
+        } else{
+            effects->writesMemory = true;
+            break;
+        }
+    }
+    forEachChild(node, collectWrites, ctx);
+}
+
+// values from before a loop only survive into it if no iteration changes them
+static void killLoopEffects(CSEPass *p, ASTNode **slot){
+    Effects effects;
+    initNameSet(&effects.written);
+    effects.writesMemory = false;
+    forEachChild(*slot, collectWrites, &effects);
+
+    for(int i = 0; i < effects.written.count; i++){
+        killName(p, effects.written.names[i]);
+    }
+    if(effects.writesMemory) killMemory(p);
+    freeNameSet(&effects.written);
+}
+
+// Value table
+
+static uint64_t mix(uint64_t hash, uint64_t value){
+    hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+static uint64_t hashKey(const ValueKey *key){
+    uint64_t hash = mix(1469598103934665603ULL, (uint64_t)(key->kind + 2));
+    hash = mix(hash, (uint64_t)key->op);
+    hash = mix(hash, (uint64_t)key->operands[0]);
+    hash = mix(hash, (uint64_t)key->operands[1]);
+    hash = mix(hash, (uint64_t)key->version);
+    if(key->name){
+        for(const char *c = key->name; *c; c++){
+            hash = mix(hash, (unsigned char)*c);
+        }
+    }
+    if(key->kind == LITERAL_NODE){
+        hash = mix(hash, key->literalType);
+        if(key->literalType == TYPE_STRING){
+            for(const char *c = key->literal.stringVal; c && *c; c++){
+                hash = mix(hash, (unsigned char)*c);
+            }
+        } else{
+            const unsigned char *bytes = (const unsigned char *)&key->literal;
+            size_t size = key->literalType == TYPE_LONG_DOUBLE ? sizeof(double) : primitiveSize(key->literalType);
+            for(size_t i = 0; i < size; i++){
+                hash = mix(hash, bytes[i]);
+            }
+        }
+    }
+    return hash;
+}
+
+static bool sameLiteral(const ValueKey *a, const ValueKey *b){
+    if(a->literalType != b->literalType) return false;
+
+    switch(a->literalType){
+        case TYPE_STRING:
+            if(!a->literal.stringVal || !b->literal.stringVal) return a->literal.stringVal == b->literal.stringVal;
+            return strcmp(a->literal.stringVal, b->literal.stringVal) == 0;
+        case TYPE_LONG_DOUBLE:
+            return memcmp(&a->literal.longDoubleVal, &b->literal.longDoubleVal, sizeof(double)) == 0 && a->literal.longDoubleVal == b->literal.longDoubleVal;
+        default:
+            return memcmp(&a->literal, &b->literal, primitiveSize(a->literalType)) == 0;
+    }
+}
+
+static bool sameKey(const ValueKey *a, const ValueKey *b){
+    if(a->kind != b->kind || a->op != b->op || a->operands[0] != b->operands[0] || a->operands[1] != b->operands[1] || a->version != b->version) return false;
+    if((a->name == NULL) != (b->name == NULL) || (a->name && strcmp(a->name, b->name) != 0)) return false;
+    return a->kind != LITERAL_NODE || sameLiteral(a, b);
+}
+
+static ValueKey makeKey(int kind, int op, int left, int right){
+    ValueKey key;
+    memset(&key, 0, sizeof(key));
+    key.kind = kind;
+    key.op = op;
+    key.operands[0] = left;
+    key.operands[1] = right;
+    return key;
+}
+
+static bool rehash(CSEPass *p){
+    int bucketCount = p->bucketCount ? p->bucketCount * 2 : 64;
+    int *buckets = malloc(bucketCount * sizeof(int));
+    if(!buckets) return false;
+
+    for(int i = 0; i < bucketCount; i++){
+        buckets[i] = -1;
+    }
+    // later entries replace earlier ones with the same key
+    for(int i = 0; i < p->entryCount; i++){
+        uint64_t slot = p->entries[i].hash & (uint64_t)(bucketCount - 1);
+        while(buckets[slot] >= 0 && !sameKey(&p->entries[buckets[slot]].key, &p->entries[i].key)){
+            slot = (slot + 1) & (uint64_t)(bucketCount - 1);
+        }
+        buckets[slot] = i;
+    }
+    free(p->buckets);
+    p->buckets = buckets;
+    p->bucketCount = bucketCount;
+    return true;
+}
+
+static int *findBucket(CSEPass *p, const ValueKey *key, uint64_t hash){
+    uint64_t slot = hash & (uint64_t)(p->bucketCount - 1);
+    while(p->buckets[slot] >= 0 && !sameKey(&p->entries[p->buckets[slot]].key, key)){
+        slot = (slot + 1) & (uint64_t)(p->bucketCount - 1);
+    }
+    return &p->buckets[slot];
+}
+
+static int addEntry(CSEPass *p, const ValueKey *key, uint64_t hash, ASTNode **first){
+    if((p->entryCount + 1) * 2 > p->bucketCount && !rehash(p)) return -1;
+    if(!grow((void **)&p->entries, &p->entryCapacity, p->entryCount, sizeof(ValueEntry))) return -1;
+
+    ValueEntry *entry = &p->entries[p->entryCount];
+    memset(entry, 0, sizeof(*entry));
+    entry->key = *key;
+    entry->hash = hash;
+    entry->first = first;
+    *findBucket(p, key, hash) = p->entryCount;
+    return p->entryCount++;
+}
+
+// Leaves, and values not worth a temporary, are numbered by key alone.
+static int leafValue(CSEPass *p, const ValueKey *key){
+    uint64_t hash = hashKey(key);
+    if(p->bucketCount){
+        int index = *findBucket(p, key, hash);
+        if(index >= 0) return index;
+    }
+
+    int index = addEntry(p, key, hash, NULL);
+    if(index < 0) p->failed = true;
+    return index;
+}
+
+static void dropNested(CSEPass *p, int reuseMark, int entryMark){
+    for(int i = reuseMark; i < p->reuseCount; i++){
+        p->entries[p->reuses[i].entry].reuses--;
+    }
+    p->reuseCount = reuseMark;
+
+    for(int i = entryMark; i < p->entryCount; i++){
+        if(p->entries[i].first){
+            p->entries[i].dead = true;
+            p->entries[i].available = false;
+        }
+    }
+}
+
+// A computation at slot: reused if the same value is available, otherwise
+// recorded as the first computation of it.
+static int computedValue(CSEPass *p, ASTNode **slot, const ValueKey *key, bool isAddress, int reuseMark, int entryMark){
+    uint64_t hash = hashKey(key);
+    int index = p->bucketCount ? *findBucket(p, key, hash) : -1;
+
+    if(index >= 0 && p->entries[index].first && p->entries[index].available){
+        if(!grow((void **)&p->reuses, &p->reuseCapacity, p->reuseCount, sizeof(Reuse))){
+            p->failed = true;
+            return -1;
+        }
+        dropNested(p, reuseMark, entryMark);
+        p->reuses[p->reuseCount++] = (Reuse){ index, slot };
+        p->entries[index].reuses++;
+        return index;
+    }
+
+    if(!grow((void **)&p->available, &p->availableCapacity, p->availableCount, sizeof(int))){
+        p->failed = true;
+        return -1;
+    }
+    index = addEntry(p, key, hash, slot);
+    if(index < 0){
+        p->failed = true;
+        return -1;
+    }
+
+    ValueEntry *entry = &p->entries[index];
+    entry->isAddress = isAddress;
+    entry->available = true;
+    if(p->listDepth > 0){
+        ListContext *context = &p->lists[p->listDepth - 1];
+        entry->list = context->list;
+        entry->listCount = context->count;
+        entry->listIndex = context->index;
+    } else{
+        entry->dead = true;
+    }
+    if(!isAddress) entry->typed = inferExpressionType(*slot, &p->scope, &entry->type);
+    p->available[p->availableCount++] = index;
+    return index;
+}
+
+static int enterRegion(CSEPass *p){
+    return p->availableCount;
+}
+
+static void leaveRegion(CSEPass *p, int mark){
+    for(int i = mark; i < p->availableCount; i++){
+        p->entries[p->available[i]].available = false;
+    }
+    p->availableCount = mark;
+}
+
+// Expressions, visited in the order they are evaluated
+
+static int walkExpr(CSEPass *p, ASTNode **slot);
+static void walkStatement(CSEPass *p, ASTNode **slot);
+static void walkList(CSEPass *p, ASTNode ***list, int *count);
+
+typedef enum {
+    PLACE_VALUE,                // the element or field is read
+    PLACE_ADDRESS,              // only its address is used, by an enclosing access
+    PLACE_TARGET                // it is assigned
+} PlaceMode;
+
+static bool isAggregateAccess(ASTNode *node){
+    return node && (node->type == ARRAY_ACCESS_NODE || (node->type == FIELD_ACCESS_NODE && !node->fieldAccess.isPointerAccess));
+}
+
+// The base of an element or field access: an enclosing access only needs
+// its address, which is what gets reused for chains like a[i].x and a[i].y.
+static int walkBase(CSEPass *p, ASTNode **slot, bool *indexed);
+
+static int walkPlace(CSEPass *p, ASTNode **slot, PlaceMode mode, bool *indexed){
+    ASTNode *node = *slot;
+    int reuseMark = p->reuseCount, entryMark = p->entryCount;
+    bool baseIndexed = false;
+    ValueKey key;
+
+    if(node->type == ARRAY_ACCESS_NODE){
+        int base = walkBase(p, &node->arrayAccess.array, &baseIndexed);
+        int index = walkExpr(p, &node->arrayAccess.index);
+        if(base < 0 || index < 0 || mode == PLACE_TARGET) return -1;
+
+        *indexed = true;
+        key = makeKey(mode == PLACE_ADDRESS ? ADDRESS_KEY : ARRAY_ACCESS_NODE, ARRAY_ACCESS_NODE, base, index);
+        if(mode == PLACE_VALUE) key.version = p->memoryEpoch;
+        return computedValue(p, slot, &key, mode == PLACE_ADDRESS, reuseMark, entryMark);
+    }
+
+    int object;
+    bool fromMemory = node->fieldAccess.isPointerAccess;
+    if(node->fieldAccess.isPointerAccess){
+        object = walkExpr(p, &node->fieldAccess.object);
+    } else{
+        ASTNode *base = node->fieldAccess.object;
+        fromMemory = isAggregateAccess(base) || (base && base->type == UNARY_OPERATION_NODE && base->unaryOp.op == DEFERENCE_UNOP);
+        object = walkBase(p, &node->fieldAccess.object, &baseIndexed);
+    }
+    if(object < 0 || mode == PLACE_TARGET) return -1;
+
+    key = makeKey(mode == PLACE_ADDRESS ? ADDRESS_KEY : FIELD_ACCESS_NODE, FIELD_ACCESS_NODE + node->fieldAccess.isPointerAccess, object, 0);
+    key.name = node->fieldAccess.fieldName;
+    if(mode == PLACE_VALUE){
+        if(fromMemory) key.version = p->memoryEpoch;
+        return computedValue(p, slot, &key, false, reuseMark, entryMark);
+    }
+
+    // a field address is a constant offset; it is only worth keeping
+    // when an index computation went into it
+    *indexed = baseIndexed;
+    if(!baseIndexed) return leafValue(p, &key);
+    return computedValue(p, slot, &key, true, reuseMark, entryMark);
+}
+
+static int walkBase(CSEPass *p, ASTNode **slot, bool *indexed){
+    ASTNode *node = *slot;
+    *indexed = false;
+    if(isAggregateAccess(node)) return walkPlace(p, slot, PLACE_ADDRESS, indexed);
+
+    // (*p).x: the address is the pointer itself
+    if(node && node->type == UNARY_OPERATION_NODE && node->unaryOp.op == DEFERENCE_UNOP) return walkExpr(p, &node->unaryOp.expr);
+    return walkExpr(p, slot);
+}
+
+static void walkTarget(CSEPass *p, ASTNode **slot){
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    bool indexed;
+    switch(node->type){
+        case IDENTIFIER_NODE:
+            return;
+        case ARRAY_ACCESS_NODE:
+        case FIELD_ACCESS_NODE:
+            walkPlace(p, slot, PLACE_TARGET, &indexed);
+            return;
+        case UNARY_OPERATION_NODE:
+            if(node->unaryOp.op == DEFERENCE_UNOP){
+                walkExpr(p, &node->unaryOp.expr);
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+    walkExpr(p, slot);
+}
+
+static void walkChild(ASTNode **slot, void *ctx){
+    walkExpr(ctx, slot);
+}
+
+static int walkExpr(CSEPass *p, ASTNode **slot){
+    ASTNode *node = *slot;
+    if(!node) return -1;
+
+    int reuseMark = p->reuseCount, entryMark = p->entryCount;
+    ValueKey key;
+    bool indexed;
+
+    switch(node->type){
+        case LITERAL_NODE:
+            key = makeKey(LITERAL_NODE, 0, 0, 0);
+            key.literalType = node->literal.type;
+            key.literal = node->literal.value;
+            return leafValue(p, &key);
+        case NULL_NODE:
+            key = makeKey(NULL_NODE, 0, 0, 0);
+            return leafValue(p, &key);
+        case IDENTIFIER_NODE: {
+            const char *name = node->identifier.name;
+            key = makeKey(IDENTIFIER_NODE, 0, 0, 0);
+            key.name = name;
+            key.version = versionOf(p, name);
+            if(isExposed(p, name)) key.operands[0] = (int)(p->memoryEpoch & 0x7fffffff);
+            return leafValue(p, &key);
+        }
+        case UNARY_OPERATION_NODE:
+            switch(node->unaryOp.op){
+                case POSITIVE_UNOP:
+                case NEGATIVE_UNOP:
+                case NOT_UNOP:
+                case BIT_NOT_UNOP:
+                case DEFERENCE_UNOP: {
+                    int operand = walkExpr(p, &node->unaryOp.expr);
+                    if(operand < 0) return -1;
+                    key = makeKey(UNARY_OPERATION_NODE, node->unaryOp.op, operand, 0);
+                    if(node->unaryOp.op == DEFERENCE_UNOP) key.version = p->memoryEpoch;
+                    return computedValue(p, slot, &key, false, reuseMark, entryMark);
+                }
+                case PRE_INCREMENT_UNOP:
+                case POST_INCREMENT_UNOP:
+                case PRE_DECREMENT_UNOP:
+                case POST_DECREMENT_UNOP:
+                    walkTarget(p, &node->unaryOp.expr);
+                    noteWrite(p, node->unaryOp.expr);
+                    return -1;
+                case ADDRESS_OF_UNOP:
+                    walkTarget(p, &node->unaryOp.expr);
+                    return -1;
+                default:
+                    return -1;
+            }
+        case BINARY_OPERATION_NODE:
+            switch(node->binaryOp.op){
+                case AND_BINOP:
+                case OR_BINOP: {
+                    walkExpr(p, &node->binaryOp.left);
+                    int mark = enterRegion(p);
+                    walkExpr(p, &node->binaryOp.right);
+                    leaveRegion(p, mark);
+                    return -1;
+                }
+                case COMMA_BINOP:
+                    walkExpr(p, &node->binaryOp.left);
+                    walkExpr(p, &node->binaryOp.right);
+                    return -1;
+                default: {
+                    // a division that traps does so the first time already
+                    int left = walkExpr(p, &node->binaryOp.left);
+                    int right = walkExpr(p, &node->binaryOp.right);
+                    if(left < 0 || right < 0) return -1;
+                    key = makeKey(BINARY_OPERATION_NODE, node->binaryOp.op, left, right);
+                    return computedValue(p, slot, &key, false, reuseMark, entryMark);
+                }
+            }
+        case TERNARY_OPERATION_NODE: {
+            walkExpr(p, &node->ternaryOp.condition);
+            int mark = enterRegion(p);
+            walkExpr(p, &node->ternaryOp.trueExpr);
+            leaveRegion(p, mark);
+            walkExpr(p, &node->ternaryOp.falseExpr);
+            leaveRegion(p, mark);
+            return -1;
+        }
+        case CAST_EXPR_NODE: {
+            int value = walkExpr(p, &node->castExpr.value);
+            PrimitiveType type;
+            if(value < 0 || !typeNodeToPrimitive(node->castExpr.targetType, &type)) return -1;
+            key = makeKey(CAST_EXPR_NODE, type, value, 0);
+            return computedValue(p, slot, &key, false, reuseMark, entryMark);
+        }
+        case ARRAY_ACCESS_NODE:
+        case FIELD_ACCESS_NODE:
+            return walkPlace(p, slot, PLACE_VALUE, &indexed);
+        case ASSIGNMENT_NODE:
+            walkTarget(p, &node->assignment.left);
+            walkExpr(p, &node->assignment.right);
+            noteWrite(p, node->assignment.left);
+            return -1;
+        case FUNCTION_CALL_NODE:
+            forEachChild(node, walkChild, p);
+            killMemory(p);
+            return -1;
+        case REALLOC_NODE:
+        case FREE_NODE:
+        case MEMCPY_NODE:
+        case MEMSET_NODE:
+        case MEMMOVE_NODE:
+            forEachChild(node, walkChild, p);
+            killMemory(p);
+            return -1;
+        case COMPOUND_EXPR_NODE:
+            walkList(p, &node->compoundExpr.statements, &node->compoundExpr.stmtCount);
+            return -1;
+        case TYPEOF_NODE:
+            walkExpr(p, &node->typeOfExpr.expr);
+            return -1;
+        case ARRAY_NODE:
+            for(int i = 0; i < node->array.elementsCount; i++){
+                walkExpr(p, &node->array.elements[i]);
+            }
+            return -1;
+        case FUNCTION_NODE:
+        case LAMBDA_NODE:
+        case SIZEOF_NODE:
+            return -1;
+        default:
+            forEachChild(node, walkChild, p);
+            return -1;
+    }
+}
+
+// Statements
+
+static void clearAvailable(CSEPass *p){
+    for(int i = 0; i < p->availableCount; i++){
+        p->entries[p->available[i]].available = false;
+    }
+}
+
+static void walkBranch(CSEPass *p, ASTNode **slot){
+    int mark = enterRegion(p);
+    int scopeMark = enterTypeScope(&p->scope);
+    walkStatement(p, slot);
+    leaveTypeScope(&p->scope, scopeMark);
+    leaveRegion(p, mark);
+}
+
+static void walkStatement(CSEPass *p, ASTNode **slot){
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    switch(node->type){
+        case BLOCK_NODE:
+            walkList(p, &node->block.statements, &node->block.stmtCount);
+            break;
+        case IF_NODE:
+            walkExpr(p, &node->ifStmt.condition);
+            walkBranch(p, &node->ifStmt.thenBranch);
+            walkBranch(p, &node->ifStmt.elseBranch);
+            break;
+        case WHILE_NODE: {
+            killLoopEffects(p, slot);
+            int mark = enterRegion(p);
+            walkExpr(p, &node->whileStmt.condition);
+            walkList(p, &node->whileStmt.body, &node->whileStmt.bodyCount);
+            leaveRegion(p, mark);
+            break;
+        }
+        case DO_WHILE_NODE: {
+            killLoopEffects(p, slot);
+            int mark = enterRegion(p);
+            walkList(p, &node->doWhileStmt.body, &node->doWhileStmt.bodyCount);
+            walkExpr(p, &node->doWhileStmt.condition);
+            leaveRegion(p, mark);
+            break;
+        }
+        case FOR_NODE: {
+            int scopeMark = enterTypeScope(&p->scope);
+            walkStatement(p, &node->forStmt.initializer);
+            killLoopEffects(p, slot);
+            int mark = enterRegion(p);
+            walkExpr(p, &node->forStmt.condition);
+            walkList(p, &node->forStmt.body, &node->forStmt.bodyCount);
+            walkExpr(p, &node->forStmt.increment);
+            leaveRegion(p, mark);
+            leaveTypeScope(&p->scope, scopeMark);
+            break;
+        }
+        case SWITCH_NODE:
+            walkExpr(p, &node->switchStmt.expr);
+            for(int i = 0; i < node->switchStmt.caseCount; i++){
+                ASTNode *branch = node->switchStmt.cases[i];
+                if(!branch) continue;
+                if(branch->type == CASE_NODE) walkList(p, &branch->caseStmt.body, &branch->caseStmt.bodyCount);
+                else if(branch->type == DEFAULT_NODE) walkList(p, &branch->defaultStmt.body, &branch->defaultStmt.bodyCount);
+            }
+            break;
+        case TRY_NODE:
+            walkList(p, &node->tryStmt.tryBlock, &node->tryStmt.tryBlockCount);
+            for(int i = 0; i < node->tryStmt.catchCount; i++){
+                walkStatement(p, &node->tryStmt.catchBlock[i]);
+            }
+            break;
+        case CATCH_NODE: {
+            int scopeMark = enterTypeScope(&p->scope);
+            ASTNode *exception = node->catchStmt.exceptionVar;
+            if(exception && exception->type == DECLARATION_NODE){
+                killName(p, exception->declaration.varName);
+                declareSymbol(&p->scope, exception);
+            }
+            walkList(p, &node->catchStmt.body, &node->catchStmt.bodyCount);
+            leaveTypeScope(&p->scope, scopeMark);
+            break;
+        }
+        case DECLARATION_NODE:
+            walkExpr(p, &node->declaration.initializer);
+            killName(p, node->declaration.varName);
+            declareSymbol(&p->scope, node);
+            break;
+        case RETURN_NODE:
+            walkExpr(p, &node->returnStmt.value);
+            break;
+        case THROW_NODE:
+            walkExpr(p, &node->throwStmt.exceptionExpr);
+            break;
+        case LABEL_NODE:
+            // reachable from jumps that skipped everything computed so far
+            clearAvailable(p);
+            break;
+        case JUMP_NODE:
+        case BREAK_NODE:
+        case CONTINUE_NODE:
+        case FUNCTION_NODE:
+        case LAMBDA_NODE:
+        case STRUCT_NODE:
+        case UNION_NODE:
+        case ENUM_NODE:
+        case TYPEDEF_NODE:
+        case IMPL_NODE:
+        case INCLUDE_NODE:
+            break;
+        default:
+            walkExpr(p, slot);
+            break;
+    }
+}
+
+static void walkList(CSEPass *p, ASTNode ***list, int *count){
+    if(!grow((void **)&p->lists, &p->listCapacity, p->listDepth, sizeof(ListContext))){
+        p->failed = true;
+        return;
+    }
+    int depth = p->listDepth++;
+    p->lists[depth] = (ListContext){ list, count, 0 };
+
+    int mark = enterRegion(p);
+    int scopeMark = enterTypeScope(&p->scope);
+    for(int i = 0; i < *count; i++){
+        p->lists[depth].index = i;
+        walkStatement(p, &(*list)[i]);
+    }
+    leaveTypeScope(&p->scope, scopeMark);
+    leaveRegion(p, mark);
+    p->listDepth--;
+}
+
+// Rewriting
+
+typedef struct {
+    ASTNode ***list;
+    int *count;
+    int index;
+    int order;
+    ASTNode *declaration;
+} Insertion;
+
+static int compareInsertions(const void *a, const void *b){
+    const Insertion *x = a, *y = b;
+    if(x->list != y->list) return (uintptr_t)x->list < (uintptr_t)y->list ? -1 : 1;
+    if(x->index != y->index) return x->index - y->index;
+    return x->order - y->order;
+}
+
+static bool insertDeclarations(Insertion *insertions, int count){
+    qsort(insertions, count, sizeof(Insertion), compareInsertions);
+
+    for(int start = 0; start < count;){
+        int end = start;
+        while(end < count && insertions[end].list == insertions[start].list){
+            end++;
+        }
+
+        ASTNode ***list = insertions[start].list;
+        int *listCount = insertions[start].count;
+        int newCount = *listCount + (end - start);
+        ASTNode **merged = malloc(newCount * sizeof(ASTNode *));
+        if(!merged) return false;
+
+        int next = start, out = 0;
+        for(int i = 0; i <= *listCount; i++){
+            while(next < end && insertions[next].index == i){
+                merged[out++] = insertions[next++].declaration;
+            }
+            if(i < *listCount) merged[out++] = (*list)[i];
+        }
+        free(*list);
+        *list = merged;
+        *listCount = newCount;
+        start = end;
+    }
+    return true;
+}
+
+static ASTNode *wrapFirst(const char *name, ASTNode *value, bool isAddress){
+    ASTNode *target = createIdentifierNode(name);
+    if(!target) return NULL;
+
+    if(isAddress){
+        // *(t = &a[i])
+        ASTNode *address = createUnaryOpNode(value, ADDRESS_OF_UNOP);
+        ASTNode *assignment = address ? createAssignmentNode(target, address, SIMPLE_ASSIGN) : NULL;
+        ASTNode *deref = assignment ? createUnaryOpNode(assignment, DEFERENCE_UNOP) : NULL;
+        if(!deref){
+            if(assignment){
+                address->unaryOp.expr = NULL;
+                freeAST(assignment);
+            } else{
+                if(address) address->unaryOp.expr = NULL;
+                freeAST(address);
+                freeAST(target);
+            }
+        }
+        return deref;
+    }
+
+    ASTNode *assignment = createAssignmentNode(target, value, SIMPLE_ASSIGN);
+    if(!assignment) freeAST(target);
+    return assignment;
+}
+
+static ASTNode *reference(const char *name, bool isAddress){
+    ASTNode *identifier = createIdentifierNode(name);
+    if(!identifier || !isAddress) return identifier;
+
+    ASTNode *deref = createUnaryOpNode(identifier, DEFERENCE_UNOP);
+    if(!deref) freeAST(identifier);
+    return deref;
+}
+
+static void rewrite(CSEPass *p){
+    Insertion *insertions = NULL;
+    ASTNode **wrappers = NULL;
+    int *owners = NULL;
+    int count = 0, capacity = 0;
+    char (*names)[32] = NULL;
+
+    for(int i = 0; i < p->entryCount; i++){
+        ValueEntry *entry = &p->entries[i];
+        if(!entry->first || entry->dead || entry->reuses == 0) continue;
+
+        if(count == capacity){
+            int newCapacity = capacity ? capacity * 2 : 8;
+            Insertion *grownInsertions = realloc(insertions, newCapacity * sizeof(Insertion));
+            if(grownInsertions) insertions = grownInsertions;
+            ASTNode **grownWrappers = realloc(wrappers, newCapacity * sizeof(ASTNode *));
+            if(grownWrappers) wrappers = grownWrappers;
+            int *grownOwners = realloc(owners, newCapacity * sizeof(int));
+            if(grownOwners) owners = grownOwners;
+            char (*grownNames)[32] = realloc(names, newCapacity * sizeof(*names));
+            if(grownNames) names = grownNames;
+            if(!grownInsertions || !grownWrappers || !grownOwners || !grownNames) break;
+            capacity = newCapacity;
+        }
+
+        snprintf(names[count], sizeof(names[count]), "__cse%d", p->tempCount);
+        ASTNode *type = entry->typed ? createIdentifierNode(primitiveTypeName(entry->type)) : NULL;
+        ASTNode *declaration = !entry->typed || type ? createDeclarationNode(type, names[count], NULL, 0) : NULL;
+        ASTNode *wrapper = declaration ? wrapFirst(names[count], NULL, entry->isAddress) : NULL;
+        if(!wrapper){
+            if(declaration) freeAST(declaration);
+            else freeAST(type);
+            entry->reuses = 0;
+            continue;
+        }
+
+        p->tempCount++;
+        insertions[count] = (Insertion){ entry->list, entry->listCount, entry->listIndex, count, declaration };
+        wrappers[count] = wrapper;
+        owners[count] = i;
+        count++;
+    }
+
+    if(count > 0 && insertDeclarations(insertions, count)){
+        // insertion sorted by list; order still names the wrapper
+        for(int k = 0; k < count; k++){
+            int w = insertions[k].order;
+            ValueEntry *entry = &p->entries[owners[w]];
+            ASTNode *wrapper = wrappers[w];
+            ASTNode *value = *entry->first;
+            if(entry->isAddress) wrapper->unaryOp.expr->assignment.right->unaryOp.expr = value;
+            else wrapper->assignment.right = value;
+            *entry->first = wrapper;
+            p->stats->temporariesIntroduced++;
+
+            for(int r = 0; r < p->reuseCount; r++){
+                if(p->reuses[r].entry != owners[w]) continue;
+                ASTNode *replacement = reference(names[w], entry->isAddress);
+                if(!replacement) continue;
+                freeAST(*p->reuses[r].slot);
+                *p->reuses[r].slot = replacement;
+                p->stats->expressionsReused++;
+            }
+        }
+    } else{
+        for(int k = 0; k < count; k++){
+            freeAST(insertions[k].declaration);
+            freeAST(wrappers[k]);
+        }
+    }
+
+    free(insertions);
+    free(wrappers);
+    free(owners);
+    free(names);
+}
+
+// Functions
+
+typedef struct {
+    NameSet *locals;
+    NameSet *aliased;
+    int depth;                  // nesting below the function being optimized
+} NameScan;
+
+static void scanNames(ASTNode **slot, void *ctx){
+    NameScan *scan = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    switch(node->type){
+        case DECLARATION_NODE:
+            if(scan->depth == 0) addName(scan->locals, node->declaration.varName);
+            break;
+        case UNARY_OPERATION_NODE:
+            if(node->unaryOp.op == ADDRESS_OF_UNOP && node->unaryOp.expr && node->unaryOp.expr->type == IDENTIFIER_NODE) addName(scan->aliased, node->unaryOp.expr->identifier.name);
+            break;
+        case FUNCTION_NODE:
+        case LAMBDA_NODE: {
+            // whatever a nested function writes may change at any call
+            Effects effects;
+            initNameSet(&effects.written);
+            effects.writesMemory = false;
+            forEachChild(node, collectWrites, &effects);
+            for(int i = 0; i < effects.written.count; i++){
+                addName(scan->aliased, effects.written.names[i]);
+            }
+            freeNameSet(&effects.written);
+
+            scan->depth++;
+            forEachChild(node, scanNames, ctx);
+            scan->depth--;
+            return;
+        }
+        default:
+            break;
+    }
+    forEachChild(node, scanNames, ctx);
+}
+
+static void resetPass(CSEPass *p){
+    for(int i = 0; i < p->versionCount; i++){
+        free(p->versions[i].name);
+    }
+    free(p->entries);
+    free(p->buckets);
+    free(p->reuses);
+    free(p->available);
+    free(p->lists);
+    free(p->versions);
+    freeNameSet(&p->locals);
+    freeNameSet(&p->aliased);
+    initNameSet(&p->locals);
+    initNameSet(&p->aliased);
+
+    p->entries = NULL;
+    p->entryCount = p->entryCapacity = 0;
+    p->buckets = NULL;
+    p->bucketCount = 0;
+    p->reuses = NULL;
+    p->reuseCount = p->reuseCapacity = 0;
+    p->available = NULL;
+    p->availableCount = p->availableCapacity = 0;
+    p->lists = NULL;
+    p->listDepth = p->listCapacity = 0;
+    p->versions = NULL;
+    p->versionCount = p->versionCapacity = 0;
+    p->nextVersion = 0;
+    p->memoryEpoch = 0;
+    p->failed = false;
+}
+
+static void optimizeFunction(CSEPass *p, ASTNode *function){
+    ASTNode ***body;
+    int *bodyCount;
+    ASTNode **params;
+    int paramCount;
+    if(function->type == FUNCTION_NODE){
+        body = &function->functionDef.body;
+        bodyCount = &function->functionDef.bodyCount;
+        params = function->functionDef.params;
+        paramCount = function->functionDef.paramCount;
+    } else{
+        body = &function->lambda.body;
+        bodyCount = &function->lambda.bodyCount;
+        params = function->lambda.params;
+        paramCount = function->lambda.paramCount;
+    }
+
+    NameScan names = { &p->locals, &p->aliased, 0 };
+    for(int i = 0; i < paramCount; i++){
+        scanNames(&params[i], &names);
+    }
+    for(int i = 0; i < *bodyCount; i++){
+        scanNames(&(*body)[i], &names);
+    }
+
+    int scopeMark = enterTypeScope(&p->scope);
+    for(int i = 0; i < paramCount; i++){
+        declareSymbol(&p->scope, params[i]);
+    }
+    walkList(p, body, bodyCount);
+    leaveTypeScope(&p->scope, scopeMark);
+
+    if(!p->failed) rewrite(p);
+    resetPass(p);
+}
+
+static void visitSlot(ASTNode **slot, void *ctx){
+    CSEPass *p = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    switch(node->type){
+        case FUNCTION_NODE:
+        case LAMBDA_NODE: {
+            optimizeFunction(p, node);
+            int mark = enterTypeScope(&p->scope);
+            forEachChild(node, visitSlot, p);
+            leaveTypeScope(&p->scope, mark);
+            break;
+        }
+        case BLOCK_NODE:
+        case FOR_NODE:
+        case WHILE_NODE:
+        case DO_WHILE_NODE:
+        case CATCH_NODE: {
+            int mark = enterTypeScope(&p->scope);
+            forEachChild(node, visitSlot, p);
+            leaveTypeScope(&p->scope, mark);
+            break;
+        }
+        case DECLARATION_NODE:
+            forEachChild(node, visitSlot, p);
+            declareSymbol(&p->scope, node);
+            break;
+        default:
+            forEachChild(node, visitSlot, p);
+            break;
+    }
+}
+
+ASTNode *eliminateCommonSubexpressions(ASTNode *node, CSEStats *stats){
+    CSEPass p;
+    memset(&p, 0, sizeof(p));
+    p.stats = stats;
+    initTypeScope(&p.scope);
+    initNameSet(&p.locals);
+    initNameSet(&p.aliased);
+    *stats = (CSEStats){0};
+
+    visitSlot(&node, &p);
+
+    resetPass(&p);
+    freeTypeScope(&p.scope);
+    return node;
+}
@@ -0,0 +1,13 @@
+#ifndef CSE_H
+#define CSE_H
+
+#include "ast.h"
+
+typedef struct {
+    int temporariesIntroduced;
+    int expressionsReused;
+} CSEStats;
+
+ASTNode *eliminateCommonSubexpressions(ASTNode *node, CSEStats *stats);
+
+#endif
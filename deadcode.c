@@ -0,0 +1,378 @@
+#include "deadcode.h"
+#include "primitive.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    char **labels;
+    int labelCount;
+    int labelCapacity;
+    DeadCodeStats *stats;
+} Eliminator;
+
+static void eliminateSlot(ASTNode **slot, void *ctx);
+
+static void collectJumpTargets(ASTNode **slot, void *ctx){
+    Eliminator *elim = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    if(node->type == JUMP_NODE){
+        if(elim->labelCount == elim->labelCapacity){
+            int capacity = elim->labelCapacity ? elim->labelCapacity * 2 : 8;
+            char **labels = realloc(elim->labels, capacity * sizeof(char *));
+            if(!labels) return;
+            elim->labels = labels;
+            elim->labelCapacity = capacity;
+        }
+        char *name = strdup(node->jumpStmt.labelName);
+        if(!name) return;
+        elim->labels[elim->labelCount++] = name;
+    }
+    forEachChild(node, collectJumpTargets, ctx);
+}
+
+static bool isTargetLabel(Eliminator *elim, ASTNode *node){
+    if(!node || node->type != LABEL_NODE) return false;
+
+    for(int i = 0; i < elim->labelCount; i++){
+        if(strcmp(elim->labels[i], node->labelStmt.labelName) == 0) return true;
+    }
+    return false;
+}
+
+typedef struct {
+    Eliminator *elim;
+    bool found;
+} LabelSearch;
+
+static void searchTargetLabel(ASTNode **slot, void *ctx){
+    LabelSearch *search = ctx;
+    if(search->found || !*slot) return;
+
+    if(isTargetLabel(search->elim, *slot)){
+        search->found = true;
+        return;
+    }
+    forEachChild(*slot, searchTargetLabel, ctx);
+}
+
+// A subtree holding a jump target can be entered from outside, so it
+// stays even when its own entry is dead.
+static bool containsTargetLabel(Eliminator *elim, ASTNode *node){
+    LabelSearch search = { elim, false };
+    searchTargetLabel(&node, &search);
+    return search.found;
+}
+
+static bool isLiteralCondition(ASTNode *condition, bool *value){
+    if(!condition || condition->type != LITERAL_NODE || condition->literal.type == TYPE_STRING) return false;
+
+    *value = primitiveIsTruthy(condition->literal.type, condition->literal.value);
+    return true;
+}
+
+static bool isExpressionNode(ASTNode *node){
+    switch(node->type){
+        case IDENTIFIER_NODE:
+        case LITERAL_NODE:
+        case NULL_NODE:
+        case ARRAY_ACCESS_NODE:
+        case FIELD_ACCESS_NODE:
+        case UNARY_OPERATION_NODE:
+        case BINARY_OPERATION_NODE:
+        case TERNARY_OPERATION_NODE:
+        case CAST_EXPR_NODE:
+        case TYPEOF_NODE:
+        case SIZEOF_NODE:
+        case LAMBDA_NODE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool isEmptyBlock(ASTNode *node){
+    return node->type == BLOCK_NODE && node->block.stmtCount == 0;
+}
+
+typedef struct {
+    NodeType jump;              // BREAK_NODE or CONTINUE_NODE
+    bool found;
+} LoopJumpSearch;
+
+// Nested loops and functions have their own break and continue; a switch
+// only has its own break.
+static void searchLoopJump(ASTNode **slot, void *ctx){
+    LoopJumpSearch *search = ctx;
+    ASTNode *node = *slot;
+    if(!node || search->found) return;
+
+    if(node->type == search->jump){
+        search->found = true;
+        return;
+    }
+    switch(node->type){
+        case SWITCH_NODE:
+            if(search->jump == BREAK_NODE) return;
+            break;
+        case WHILE_NODE:
+        case DO_WHILE_NODE:
+        case FOR_NODE:
+        case FUNCTION_NODE:
+        case LAMBDA_NODE:
+            return;
+        default:
+            break;
+    }
+    forEachChild(node, searchLoopJump, ctx);
+}
+
+static bool hasLoopJump(ASTNode **body, int bodyCount, NodeType jump){
+    LoopJumpSearch search = {jump, false};
+    for(int i = 0; i < bodyCount && !search.found; i++){
+        searchLoopJump(&body[i], &search);
+    }
+    return search.found;
+}
+
+static bool alwaysExits(Eliminator *elim, ASTNode *node){
+    if(!node) return false;
+
+    bool value;
+    switch(node->type){
+        case RETURN_NODE:
+        case BREAK_NODE:
+        case CONTINUE_NODE:
+        case JUMP_NODE:
+        case THROW_NODE:
+            return true;
+        case BLOCK_NODE: {
+            bool exits = false;
+            for(int i = 0; i < node->block.stmtCount; i++){
+                ASTNode *stmt = node->block.statements[i];
+                if(isTargetLabel(elim, stmt)) exits = false;
+                else if(alwaysExits(elim, stmt)) exits = true;
+            }
+            return exits;
+        }
+        case IF_NODE:
+            return node->ifStmt.elseBranch && alwaysExits(elim, node->ifStmt.thenBranch) && alwaysExits(elim, node->ifStmt.elseBranch);
+        case WHILE_NODE:
+            return isLiteralCondition(node->whileStmt.condition, &value) && value && !hasLoopJump(node->whileStmt.body, node->whileStmt.bodyCount, BREAK_NODE);
+        case DO_WHILE_NODE:
+            return isLiteralCondition(node->doWhileStmt.condition, &value) && value && !hasLoopJump(node->doWhileStmt.body, node->doWhileStmt.bodyCount, BREAK_NODE);
+        case FOR_NODE:
+            if(node->forStmt.condition && !(isLiteralCondition(node->forStmt.condition, &value) && value)) return false;
+            return !hasLoopJump(node->forStmt.body, node->forStmt.bodyCount, BREAK_NODE);
+        default:
+            return false;
+    }
+}
+
+static ASTNode *createEmptyBlock(void){
+    return createBlockNode(NULL, 0);
+}
+
+static void discard(Eliminator *elim, ASTNode *node){
+    elim->stats->nodesEliminated += countASTNodes(node);
+    freeAST(node);
+}
+
+// Replaces *slot by keep (a detached child of it, or NULL for an empty block).
+static void replaceSlot(Eliminator *elim, ASTNode **slot, ASTNode *keep){
+    if(!keep){
+        keep = createEmptyBlock();
+        if(!keep) return;
+        elim->stats->nodesEliminated--;
+    }
+    discard(elim, *slot);
+    *slot = keep;
+}
+
+static void cleanStatementList(Eliminator *elim, ASTNode **list, int *count, bool keepLast){
+    int kept = 0;
+    bool reachable = true;
+
+    for(int i = 0; i < *count; i++){
+        ASTNode *stmt = list[i];
+        bool isLast = i == *count - 1;
+
+        if(!reachable){
+            if(isTargetLabel(elim, stmt) || containsTargetLabel(elim, stmt)){
+                reachable = true;
+            } else if(stmt->type != DECLARATION_NODE){
+                discard(elim, stmt);
+                elim->stats->unreachableRemoved++;
+                continue;
+            }
+        }
+
+        if(isEmptyBlock(stmt) && !(keepLast && isLast)){
+            discard(elim, stmt);
+            continue;
+        }
+        if(isExpressionNode(stmt) && isPureExpression(stmt) && !(keepLast && isLast)){
+            discard(elim, stmt);
+            elim->stats->expressionsDropped++;
+            continue;
+        }
+
+        list[kept++] = stmt;
+        if(reachable && alwaysExits(elim, stmt)) reachable = false;
+    }
+    *count = kept;
+}
+
+static void cleanStatementLists(Eliminator *elim, ASTNode *node){
+    switch(node->type){
+        case BLOCK_NODE:
+            cleanStatementList(elim, node->block.statements, &node->block.stmtCount, false);
+            break;
+        case COMPOUND_EXPR_NODE:
+            cleanStatementList(elim, node->compoundExpr.statements, &node->compoundExpr.stmtCount, true);
+            break;
+        case FUNCTION_NODE:
+            cleanStatementList(elim, node->functionDef.body, &node->functionDef.bodyCount, false);
+            break;
+        case LAMBDA_NODE:
+            cleanStatementList(elim, node->lambda.body, &node->lambda.bodyCount, false);
+            break;
+        case CASE_NODE:
+            cleanStatementList(elim, node->caseStmt.body, &node->caseStmt.bodyCount, false);
+            break;
+        case DEFAULT_NODE:
+            cleanStatementList(elim, node->defaultStmt.body, &node->defaultStmt.bodyCount, false);
+            break;
+        case WHILE_NODE:
+            cleanStatementList(elim, node->whileStmt.body, &node->whileStmt.bodyCount, false);
+            break;
+        case DO_WHILE_NODE:
+            cleanStatementList(elim, node->doWhileStmt.body, &node->doWhileStmt.bodyCount, false);
+            break;
+        case FOR_NODE:
+            cleanStatementList(elim, node->forStmt.body, &node->forStmt.bodyCount, false);
+            break;
+        case TRY_NODE:
+            cleanStatementList(elim, node->tryStmt.tryBlock, &node->tryStmt.tryBlockCount, false);
+            break;
+        case CATCH_NODE:
+            cleanStatementList(elim, node->catchStmt.body, &node->catchStmt.bodyCount, false);
+            break;
+        default:
+            break;
+    }
+}
+
+static void pruneIf(Eliminator *elim, ASTNode **slot){
+    ASTNode *node = *slot;
+    bool value;
+    if(!isLiteralCondition(node->ifStmt.condition, &value)) return;
+
+    ASTNode **taken = value ? &node->ifStmt.thenBranch : &node->ifStmt.elseBranch;
+    ASTNode *dropped = value ? node->ifStmt.elseBranch : node->ifStmt.thenBranch;
+    if(containsTargetLabel(elim, dropped)) return;
+
+    ASTNode *keep = *taken;
+    *taken = NULL;
+    replaceSlot(elim, slot, keep);
+    elim->stats->branchesPruned++;
+}
+
+static void pruneTernary(Eliminator *elim, ASTNode **slot){
+    ASTNode *node = *slot;
+    bool value;
+    if(!isLiteralCondition(node->ternaryOp.condition, &value)) return;
+
+    ASTNode **taken = value ? &node->ternaryOp.trueExpr : &node->ternaryOp.falseExpr;
+    ASTNode *keep = *taken;
+    *taken = NULL;
+    replaceSlot(elim, slot, keep);
+    elim->stats->branchesPruned++;
+}
+
+static void pruneLoop(Eliminator *elim, ASTNode **slot){
+    ASTNode *node = *slot;
+    bool value;
+
+    switch(node->type){
+        case WHILE_NODE:
+            if(!isLiteralCondition(node->whileStmt.condition, &value) || value) return;
+            if(containsTargetLabel(elim, node)) return;
+            replaceSlot(elim, slot, NULL);
+            break;
+        case FOR_NODE: {
+            if(!isLiteralCondition(node->forStmt.condition, &value) || value) return;
+            if(containsTargetLabel(elim, node)) return;
+
+            // the initializer still runs once, in a scope of its own
+            ASTNode *init = node->forStmt.initializer;
+            ASTNode *keep = NULL;
+            if(init && !(isExpressionNode(init) && isPureExpression(init))){
+                keep = createBlockNode(&init, 1);
+                if(!keep) return;
+                node->forStmt.initializer = NULL;
+                elim->stats->nodesEliminated--;
+            }
+            replaceSlot(elim, slot, keep);
+            break;
+        }
+        case DO_WHILE_NODE: {
+            if(!isLiteralCondition(node->doWhileStmt.condition, &value) || value) return;
+            if(hasLoopJump(node->doWhileStmt.body, node->doWhileStmt.bodyCount, BREAK_NODE)) return;
+            // continue would jump to the condition, which leaves the loop
+            if(hasLoopJump(node->doWhileStmt.body, node->doWhileStmt.bodyCount, CONTINUE_NODE)) return;
+
+            ASTNode *keep = createBlockNode(node->doWhileStmt.body, node->doWhileStmt.bodyCount);
+            if(!keep) return;
+            node->doWhileStmt.bodyCount = 0;
+            elim->stats->nodesEliminated--;
+            replaceSlot(elim, slot, keep);
+            break;
+        }
+        default:
+            return;
+    }
+    elim->stats->loopsRemoved++;
+}
+
+static void eliminateSlot(ASTNode **slot, void *ctx){
+    Eliminator *elim = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    forEachChild(node, eliminateSlot, elim);
+    cleanStatementLists(elim, node);
+
+    switch(node->type){
+        case IF_NODE:
+            pruneIf(elim, slot);
+            break;
+        case TERNARY_OPERATION_NODE:
+            pruneTernary(elim, slot);
+            break;
+        case WHILE_NODE:
+        case FOR_NODE:
+        case DO_WHILE_NODE:
+            pruneLoop(elim, slot);
+            break;
+        default:
+            break;
+    }
+}
+
+ASTNode *eliminateDeadCode(ASTNode *node, DeadCodeStats *stats){
+    Eliminator elim = {0};
+    elim.stats = stats;
+    *stats = (DeadCodeStats){0};
+
+    collectJumpTargets(&node, &elim);
+    eliminateSlot(&node, &elim);
+
+    for(int i = 0; i < elim.labelCount; i++){
+        free(elim.labels[i]);
+    }
+    free(elim.labels);
+    return node;
+}
@@ -0,0 +1,16 @@
+#ifndef DEADCODE_H
+#define DEADCODE_H
+
+#include "ast.h"
+
+typedef struct {
+    int nodesEliminated;
+    int branchesPruned;
+    int loopsRemoved;
+    int unreachableRemoved;
+    int expressionsDropped;
+} DeadCodeStats;
+
+ASTNode *eliminateDeadCode(ASTNode *node, DeadCodeStats *stats);
+
+#endif
@@ -0,0 +1,423 @@
+#include "escape.h"
+#include "primitive.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_STACK_ALLOCATION 4096
+
+typedef struct {
+    ASTNode *declaration;
+    ASTNode *allocation;
+    bool inLoop;
+} AllocationSite;
+
+typedef struct {
+    AllocationSite *sites;
+    int count;
+    int capacity;
+    int loopDepth;
+    bool hasLabels;
+    bool failed;
+} SiteScan;
+
+typedef struct {
+    const char *name;
+    int declarations;
+    bool mentioned;
+} NameScan;
+
+typedef struct {
+    const char *name;
+    bool escaped;
+} UseScan;
+
+typedef struct {
+    UseScan *scan;
+    ASTNode *parent;
+    ASTNode **skip;             // a condition already scanned as an address
+} ChildScan;
+
+const char *allocationKindName(AllocationKind kind){
+    switch(kind){
+        case ALLOC_HEAP: return "heap";
+        case ALLOC_STACK: return "stack";
+        case ALLOC_REGION: return "region";
+    }
+    return "?";
+}
+
+static ASTNode *stripCasts(ASTNode *node){
+    while(node && node->type == CAST_EXPR_NODE){
+        node = node->castExpr.value;
+    }
+    return node;
+}
+
+static bool isName(ASTNode *node, const char *name){
+    return node && node->type == IDENTIFIER_NODE && strcmp(node->identifier.name, name) == 0;
+}
+
+static bool isHeapAllocation(ASTNode *node){
+    if(!node) return false;
+    if(node->type == MALLOC_NODE) return node->mallocExpr.placement == ALLOC_HEAP;
+    if(node->type == CALLOC_NODE) return node->callocExpr.placement == ALLOC_HEAP;
+    return false;
+}
+
+static bool literalSize(ASTNode *node, long long *out){
+    return node && node->type == LITERAL_NODE && primitiveToLongLong(node->literal.type, node->literal.value, out) && *out >= 0;
+}
+
+static bool fitsOnStack(ASTNode *allocation){
+    long long size, count = 1;
+    if(allocation->type == MALLOC_NODE){
+        if(!literalSize(allocation->mallocExpr.size, &size)) return false;
+    } else{
+        if(!literalSize(allocation->callocExpr.num, &count) || !literalSize(allocation->callocExpr.size, &size)) return false;
+        if(count != 0 && size > MAX_STACK_ALLOCATION / count) return false;
+    }
+    return count * size <= MAX_STACK_ALLOCATION;
+}
+
+// Allocation sites: T *p = malloc(...) declared directly in the function
+static void scanStatements(ASTNode **list, int count, SiteScan *scan, int loopDepth);
+
+static void scanSites(ASTNode **slot, void *ctx){
+    SiteScan *scan = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    switch(node->type){
+        case FUNCTION_NODE:
+        case LAMBDA_NODE:
+            return;
+        case LABEL_NODE:
+        case JUMP_NODE:
+            scan->hasLabels = true;
+            return;
+        case FOR_NODE:
+            scanSites(&node->forStmt.initializer, scan);
+            scanStatements(node->forStmt.body, node->forStmt.bodyCount, scan, scan->loopDepth + 1);
+            return;
+        case WHILE_NODE:
+            scanStatements(node->whileStmt.body, node->whileStmt.bodyCount, scan, scan->loopDepth + 1);
+            return;
+        case DO_WHILE_NODE:
+            scanStatements(node->doWhileStmt.body, node->doWhileStmt.bodyCount, scan, scan->loopDepth + 1);
+            return;
+        case DECLARATION_NODE: {
+            ASTNode *allocation = stripCasts(node->declaration.initializer);
+            if(!(node->declaration.storageFlags & STORAGE_STATIC) && isHeapAllocation(allocation)){
+                if(scan->count == scan->capacity){
+                    int newCapacity = scan->capacity ? scan->capacity * 2 : 8;
+                    AllocationSite *grown = realloc(scan->sites, newCapacity * sizeof(AllocationSite));
+                    if(!grown){
+                        scan->failed = true;
+                        return;
+                    }
+                    scan->sites = grown;
+                    scan->capacity = newCapacity;
+                }
+                scan->sites[scan->count++] = (AllocationSite){ node, allocation, scan->loopDepth > 0 };
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    forEachChild(node, scanSites, scan);
+}
+
+static void scanStatements(ASTNode **list, int count, SiteScan *scan, int loopDepth){
+    int saved = scan->loopDepth;
+    scan->loopDepth = loopDepth;
+    for(int i = 0; i < count; i++){
+        scanSites(&list[i], scan);
+    }
+    scan->loopDepth = saved;
+}
+
+static void scanName(ASTNode **slot, void *ctx){
+    NameScan *scan = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    if(node->type == DECLARATION_NODE && strcmp(node->declaration.varName, scan->name) == 0) scan->declarations++;
+    if(isName(node, scan->name)) scan->mentioned = true;
+    forEachChild(node, scanName, scan);
+}
+
+// Escape check. A pointer that is only dereferenced, indexed, compared,
+// tested or handed to free/memcpy/memset/memmove cannot outlive the
+// variable holding it. Anything else (stores, calls, returns, captures,
+// reassignment) counts as an escape.
+static void scanUses(ASTNode **slot, void *ctx);
+
+static void scanAddress(ASTNode *node, UseScan *scan){
+    if(!node || isName(node, scan->name)) return;
+
+    switch(node->type){
+        case CAST_EXPR_NODE:
+            scanAddress(node->castExpr.value, scan);
+            return;
+        case BINARY_OPERATION_NODE:
+            if(node->binaryOp.op == ADD_BINOP || node->binaryOp.op == SUB_BINOP){
+                scanAddress(node->binaryOp.left, scan);
+                scanUses(&node->binaryOp.right, scan);
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+    scanUses(&node, scan);
+}
+
+static bool inList(ASTNode **slot, ASTNode **list, int count){
+    return list && slot >= list && slot < list + count;
+}
+
+// memcpy and friends return their destination, so they only keep the
+// pointer from escaping when the result is discarded
+static bool isStatementSlot(ASTNode *parent, ASTNode **slot){
+    if(!parent) return true;
+
+    switch(parent->type){
+        case BLOCK_NODE: return inList(slot, parent->block.statements, parent->block.stmtCount);
+        case COMPOUND_EXPR_NODE: return inList(slot, parent->compoundExpr.statements, parent->compoundExpr.stmtCount - 1);
+        case FUNCTION_NODE: return inList(slot, parent->functionDef.body, parent->functionDef.bodyCount);
+        case IF_NODE: return slot == &parent->ifStmt.thenBranch || slot == &parent->ifStmt.elseBranch;
+        case CASE_NODE: return inList(slot, parent->caseStmt.body, parent->caseStmt.bodyCount);
+        case DEFAULT_NODE: return inList(slot, parent->defaultStmt.body, parent->defaultStmt.bodyCount);
+        case WHILE_NODE: return inList(slot, parent->whileStmt.body, parent->whileStmt.bodyCount);
+        case DO_WHILE_NODE: return inList(slot, parent->doWhileStmt.body, parent->doWhileStmt.bodyCount);
+        case FOR_NODE: return slot == &parent->forStmt.increment || inList(slot, parent->forStmt.body, parent->forStmt.bodyCount);
+        case TRY_NODE: return inList(slot, parent->tryStmt.tryBlock, parent->tryStmt.tryBlockCount);
+        case CATCH_NODE: return inList(slot, parent->catchStmt.body, parent->catchStmt.bodyCount);
+        default: return false;
+    }
+}
+
+static void scanChild(ASTNode **slot, void *ctx){
+    ChildScan *child = ctx;
+    ASTNode *node = *slot;
+    if(!node || slot == child->skip) return;
+
+    if(isStatementSlot(child->parent, slot)){
+        switch(node->type){
+            case MEMCPY_NODE:
+                scanAddress(node->memcpyExpr.dest, child->scan);
+                scanAddress(node->memcpyExpr.src, child->scan);
+                scanUses(&node->memcpyExpr.size, child->scan);
+                return;
+            case MEMMOVE_NODE:
+                scanAddress(node->memmoveExpr.dest, child->scan);
+                scanAddress(node->memmoveExpr.src, child->scan);
+                scanUses(&node->memmoveExpr.size, child->scan);
+                return;
+            case MEMSET_NODE:
+                scanAddress(node->memsetExpr.dest, child->scan);
+                scanUses(&node->memsetExpr.value, child->scan);
+                scanUses(&node->memsetExpr.size, child->scan);
+                return;
+            default:
+                break;
+        }
+    }
+    scanUses(slot, child->scan);
+}
+
+static void scanUses(ASTNode **slot, void *ctx){
+    UseScan *scan = ctx;
+    ASTNode *node = *slot;
+    if(!node || scan->escaped) return;
+
+    ChildScan child = { scan, node, NULL };
+    switch(node->type){
+        case IDENTIFIER_NODE:
+            if(isName(node, scan->name)) scan->escaped = true;
+            return;
+        case FUNCTION_NODE:
+        case LAMBDA_NODE: {
+            // the name is unique in the function, so any mention is a capture
+            NameScan names = { scan->name, 0, false };
+            forEachChild(node, scanName, &names);
+            if(names.mentioned) scan->escaped = true;
+            return;
+        }
+        case UNARY_OPERATION_NODE:
+            if(node->unaryOp.op == DEFERENCE_UNOP || node->unaryOp.op == NOT_UNOP){
+                scanAddress(node->unaryOp.expr, scan);
+                return;
+            }
+            break;
+        case BINARY_OPERATION_NODE:
+            switch(node->binaryOp.op){
+                case EQU_BINOP:
+                case NOT_EQU_BINOP:
+                case AND_BINOP:
+                case OR_BINOP:
+                    scanAddress(node->binaryOp.left, scan);
+                    scanAddress(node->binaryOp.right, scan);
+                    return;
+                default:
+                    break;
+            }
+            break;
+        case ARRAY_ACCESS_NODE:
+            scanAddress(node->arrayAccess.array, scan);
+            scanUses(&node->arrayAccess.index, scan);
+            return;
+        case FIELD_ACCESS_NODE:
+            if(node->fieldAccess.isPointerAccess){
+                scanAddress(node->fieldAccess.object, scan);
+                return;
+            }
+            break;
+        case FREE_NODE:
+            scanAddress(node->freeExpr.ptr, scan);
+            return;
+        case MEMCPY_NODE:
+            scanUses(&node->memcpyExpr.dest, scan);
+            scanAddress(node->memcpyExpr.src, scan);
+            scanUses(&node->memcpyExpr.size, scan);
+            return;
+        case MEMMOVE_NODE:
+            scanUses(&node->memmoveExpr.dest, scan);
+            scanAddress(node->memmoveExpr.src, scan);
+            scanUses(&node->memmoveExpr.size, scan);
+            return;
+        case IF_NODE:
+            scanAddress(node->ifStmt.condition, scan);
+            child.skip = &node->ifStmt.condition;
+            break;
+        case WHILE_NODE:
+            scanAddress(node->whileStmt.condition, scan);
+            child.skip = &node->whileStmt.condition;
+            break;
+        case DO_WHILE_NODE:
+            scanAddress(node->doWhileStmt.condition, scan);
+            child.skip = &node->doWhileStmt.condition;
+            break;
+        case FOR_NODE:
+            scanAddress(node->forStmt.condition, scan);
+            child.skip = &node->forStmt.condition;
+            break;
+        case TERNARY_OPERATION_NODE:
+            scanAddress(node->ternaryOp.condition, scan);
+            scanUses(&node->ternaryOp.trueExpr, scan);
+            scanUses(&node->ternaryOp.falseExpr, scan);
+            return;
+        default:
+            break;
+    }
+
+    forEachChild(node, scanChild, &child);
+}
+
+typedef struct {
+    const char *name;
+    int elided;
+} FreeScan;
+
+static void elideFrees(ASTNode **slot, void *ctx){
+    FreeScan *scan = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    if(node->type == FREE_NODE && !node->freeExpr.elided && isName(stripCasts(node->freeExpr.ptr), scan->name)){
+        node->freeExpr.elided = true;
+        scan->elided++;
+    }
+    forEachChild(node, elideFrees, scan);
+}
+
+static void recordDemotion(EscapeReport *report, const char *function, const char *variable, AllocationKind placement){
+    if(report->demotionCount == report->demotionCapacity){
+        int newCapacity = report->demotionCapacity ? report->demotionCapacity * 2 : 8;
+        EscapeDemotion *grown = realloc(report->demotions, newCapacity * sizeof(EscapeDemotion));
+        if(!grown) return;
+        report->demotions = grown;
+        report->demotionCapacity = newCapacity;
+    }
+
+    EscapeDemotion *demotion = &report->demotions[report->demotionCount];
+    demotion->function = strdup(function);
+    demotion->variable = strdup(variable);
+    demotion->placement = placement;
+    if(!demotion->function || !demotion->variable){
+        free(demotion->function);
+        free(demotion->variable);
+        return;
+    }
+    report->demotionCount++;
+}
+
+static void analyzeFunction(ASTNode *function, EscapeReport *report){
+    SiteScan sites = {0};
+    scanStatements(function->functionDef.body, function->functionDef.bodyCount, &sites, 0);
+    report->allocationsSeen += sites.count;
+
+    // a jump back over the declaration would allocate again without
+    // the frame or region ever being released
+    if(!sites.hasLabels && !sites.failed){
+        for(int i = 0; i < sites.count; i++){
+            AllocationSite *site = &sites.sites[i];
+            const char *name = site->declaration->declaration.varName;
+
+            // with a single declaration every use refers to this allocation
+            NameScan names = { name, 0, false };
+            forEachChild(function, scanName, &names);
+            if(names.declarations != 1) continue;
+
+            UseScan uses = { name, false };
+            for(int k = 0; k < function->functionDef.bodyCount && !uses.escaped; k++){
+                ChildScan child = { &uses, function, NULL };
+                scanChild(&function->functionDef.body[k], &child);
+            }
+            if(uses.escaped) continue;
+
+            AllocationKind placement = !site->inLoop && fitsOnStack(site->allocation) ? ALLOC_STACK : ALLOC_REGION;
+            if(site->allocation->type == MALLOC_NODE) site->allocation->mallocExpr.placement = placement;
+            else site->allocation->callocExpr.placement = placement;
+
+            FreeScan frees = { name, 0 };
+            forEachChild(function, elideFrees, &frees);
+            report->freesElided += frees.elided;
+            recordDemotion(report, function->functionDef.name, name, placement);
+        }
+    }
+    free(sites.sites);
+}
+
+static void visitFunctions(ASTNode **slot, void *ctx){
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    if(node->type == FUNCTION_NODE) analyzeFunction(node, ctx);
+    forEachChild(node, visitFunctions, ctx);
+}
+
+ASTNode *analyzeEscapes(ASTNode *node, EscapeReport *report){
+    *report = (EscapeReport){0};
+    visitFunctions(&node, report);
+    return node;
+}
+
+void printEscapeReport(EscapeReport *report, FILE *out){
+    for(int i = 0; i < report->demotionCount; i++){
+        EscapeDemotion *demotion = &report->demotions[i];
+        fprintf(out, "%s: %s -> %s\n", demotion->function, demotion->variable, allocationKindName(demotion->placement));
+    }
+    fprintf(out, "%d of %d allocations demoted, %d frees elided\n", report->demotionCount, report->allocationsSeen, report->freesElided);
+}
+
+void freeEscapeReport(EscapeReport *report){
+    for(int i = 0; i < report->demotionCount; i++){
+        free(report->demotions[i].function);
+        free(report->demotions[i].variable);
+    }
+    free(report->demotions);
+    *report = (EscapeReport){0};
+}
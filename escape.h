@@ -0,0 +1,27 @@
+#ifndef ESCAPE_H
+#define ESCAPE_H
+
+#include "ast.h"
+#include <stdio.h>
+
+typedef struct {
+    char *function;
+    char *variable;
+    AllocationKind placement;
+} EscapeDemotion;
+
+typedef struct {
+    EscapeDemotion *demotions;
+    int demotionCount;
+    int demotionCapacity;
+    int allocationsSeen;
+    int freesElided;
+} EscapeReport;
+
+ASTNode *analyzeEscapes(ASTNode *node, EscapeReport *report);
+
+const char *allocationKindName(AllocationKind kind);
+void printEscapeReport(EscapeReport *report, FILE *out);
+void freeEscapeReport(EscapeReport *report);
+
+#endif
@@ -0,0 +1,2664 @@
+#include "eval.h"
+#include "heap.h"
+#include "memo.h"
+#include "memops.h"
+#include "primitive.h"
+#include "utils.h"
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MEMORY_ALIGN 16
+#define INLINE_CACHE_WAYS 4         // targets a site keeps before it goes megamorphic
+#define MEGAMORPHIC_ENTRIES 256
+
+typedef enum {
+    EXEC_NORMAL,
+    EXEC_BREAK,
+    EXEC_CONTINUE,
+    EXEC_RETURN,
+    EXEC_JUMP,
+    EXEC_THROW,
+    EXEC_TAILCALL,          // the frame is to be reused for a pending call
+    EXEC_ERROR
+} ExecStatus;
+
+typedef enum {
+    KIND_VOID,
+    KIND_PRIMITIVE,
+    KIND_POINTER,
+    KIND_ARRAY,
+    KIND_STRUCT,
+    KIND_UNION
+} TypeKind;
+
+typedef struct {
+    const char *name;
+    const EvalType *type;
+    size_t offset;
+} EvalField;
+
+struct EvalType {
+    TypeKind kind;
+    PrimitiveType primitive;
+    const EvalType *element;    // pointee or array element
+    long long length;           // array elements, -1 when only known at run time
+    ASTNode *lengthExpr;
+    size_t size;
+    size_t align;
+    const char *name;
+    EvalField *fields;
+    int fieldCount;
+    bool complete;
+    EvalType *pointerTo;        // pointer to this type, made on first use
+};
+
+typedef enum {
+    RESOLVED_UNKNOWN,
+    RESOLVED_LOCAL,         // slot of the frame depth static links up
+    RESOLVED_GLOBAL,
+    RESOLVED_FUNCTION,
+    RESOLVED_ENUM,
+    RESOLVED_BUILTIN,
+    RESOLVED_TYPE,          // a type node, or an operand of sizeof that names a type
+    RESOLVED_KERNEL         // a memcpy, memmove or memset whose size is the constant
+} ResolvedKind;
+
+typedef enum {
+    CACHE_EMPTY,
+    CACHE_MONOMORPHIC,
+    CACHE_POLYMORPHIC,
+    CACHE_MEGAMORPHIC
+} CacheState;
+
+// What a field access site has seen: the struct layouts with the field
+// each resolved to.
+typedef struct {
+    CacheState state;
+    int count;
+    const void *keys[INLINE_CACHE_WAYS];
+    const EvalField *fields[INLINE_CACHE_WAYS];
+} InlineCache;
+
+// Shared by the megamorphic field sites.
+typedef struct {
+    const ASTNode *site;
+    const EvalType *type;
+    const EvalField *field;
+} MegamorphicEntry;
+
+// What the evaluator knows about a node before running it, kept in a
+// table keyed by the node so the tree itself stays untouched.
+typedef struct {
+    const ASTNode *node;
+    ResolvedKind kind;
+    int index;
+    int depth;
+    int constant;
+    bool inMemory;              // the slot holds a pointer to the variable's storage
+    const EvalType *type;
+    EvalFunction *function;
+    InlineCache *cache;
+    MoveKernel move;
+    FillKernel fill;
+} Resolution;
+
+struct EvalFunction {
+    ASTNode *definition;
+    const char *name;
+    ASTNode **params;
+    int paramCount;
+    ASTNode **body;
+    int bodyCount;
+    const EvalType *returnType;
+    bool returnsVoid;
+    int slotCount;
+    int level;                  // nesting depth, the top level is 0
+    bool memoize;
+    MemoCache memo;
+};
+
+struct EvalFrame {
+    EvalFunction *function;
+    Value *slots;
+    EvalFrame *env;
+    unsigned long serial;
+    char *memoryMark;
+};
+
+typedef struct {
+    const char *name;
+    ASTNode *definition;
+    EvalType *type;
+} NamedType;
+
+typedef struct {
+    const char *name;
+    const EvalType *type;
+    bool isStatic;
+    bool initialized;
+} GlobalInfo;
+
+typedef enum {
+    BUILTIN_PRINT
+} Builtin;
+
+struct Evaluator {
+    ASTNode *program;
+    EvalOptions options;
+    EvalStats stats;
+    char error[256];
+    jmp_buf *outOfMemory;       // set by the entry point resolving or running
+
+    Resolution *resolutions;
+    int resolutionCapacity;
+    InlineCache **caches;
+    int cacheCount;
+    int cacheCapacity;
+    MegamorphicEntry megamorphic[MEGAMORPHIC_ENTRIES];
+
+    EvalType primitiveTypes[PRIMITIVE_TYPE_COUNT];
+    EvalType voidType;
+    EvalType **types;
+    int typeCount;
+    int typeCapacity;
+    NamedType *namedTypes;
+    int namedTypeCount;
+    int namedTypeCapacity;
+
+    EvalFunction **functions;
+    int functionCount;
+    int functionCapacity;
+    EvalFunction *top;
+
+    GlobalInfo *globalInfo;
+    int globalCount;
+    int globalCapacity;
+    Value *globals;
+    void **permanent;           // storage of globals and static locals
+    int permanentCount;
+    int permanentCapacity;
+
+    Value *stack;
+    int stackTop;
+    EvalFrame *frames;
+    int frameCount;
+    char *memory;
+    char *memoryTop;
+    char *memoryLimit;
+    EvalFrame *frame;
+    unsigned long nextSerial;
+    int pinned;                 // stack placed allocations, which outlive loop iterations
+    int tryDepth;               // try blocks open in the current frame
+
+    Value returnValue;
+    Value exception;
+    const char *jumpLabel;
+    EvalFunction *tailFunction;
+    EvalFrame *tailEnv;
+    int tailArgs;               // stack index of the pending call's arguments
+};
+
+static ExecStatus runtimeError(Evaluator *e, const char *format, ...){
+    va_list args;
+    va_start(args, format);
+    vsnprintf(e->error, sizeof(e->error), format, args);
+    va_end(args);
+    return EXEC_ERROR;
+}
+
+// Types, functions and caches are allocated deep inside resolution and
+// evaluation, so a failure jumps back to the entry point that reports it.
+static _Noreturn void outOfMemory(Evaluator *e){
+    longjmp(*e->outOfMemory, 1);
+}
+
+// Resolution table
+
+static uint64_t hashNode(const ASTNode *node){
+    return ((uint64_t)(uintptr_t)node >> 4) * 0x9e3779b97f4a7c15ULL;
+}
+
+static Resolution *findResolution(Evaluator *e, const ASTNode *node){
+    uint64_t mask = (uint64_t)e->resolutionCapacity - 1;
+    for(uint64_t i = hashNode(node) >> 20 & mask;; i = (i + 1) & mask){
+        Resolution *r = &e->resolutions[i];
+        if(r->node == node) return r;
+        if(!r->node) return NULL;
+    }
+}
+
+static Resolution *addResolution(Evaluator *e, const ASTNode *node){
+    uint64_t mask = (uint64_t)e->resolutionCapacity - 1;
+    for(uint64_t i = hashNode(node) >> 20 & mask;; i = (i + 1) & mask){
+        Resolution *r = &e->resolutions[i];
+        if(r->node == node) return r;
+        if(!r->node){
+            memset(r, 0, sizeof(*r));
+            r->node = node;
+            return r;
+        }
+    }
+}
+
+// Inline caches
+
+static InlineCache *newInlineCache(Evaluator *e){
+    InlineCache *cache = calloc(1, sizeof(InlineCache));
+    if(!cache || !GROW(e->caches, e->cacheCount, e->cacheCapacity)){
+        free(cache);
+        outOfMemory(e);
+    }
+    e->caches[e->cacheCount++] = cache;
+    return cache;
+}
+
+static int cacheLookup(const InlineCache *cache, const void *key){
+    for(int i = 0; i < cache->count; i++){
+        if(cache->keys[i] == key) return i;
+    }
+    return -1;
+}
+
+// A site that keeps seeing new targets stops collecting them.
+static void cacheInsert(InlineCache *cache, const void *key, const EvalField *field){
+    if(cache->count == INLINE_CACHE_WAYS){
+        cache->state = CACHE_MEGAMORPHIC;
+        return;
+    }
+    cache->keys[cache->count] = key;
+    cache->fields[cache->count] = field;
+    cache->count++;
+    cache->state = cache->count == 1 ? CACHE_MONOMORPHIC : CACHE_POLYMORPHIC;
+}
+
+static const EvalField *findField(const EvalType *type, const char *name){
+    for(int i = 0; i < type->fieldCount; i++){
+        if(strcmp(type->fields[i].name, name) == 0) return &type->fields[i];
+    }
+    return NULL;
+}
+
+// Offsets depend only on the layout, so a site looks a field up by name
+// once per struct type it meets.
+static const EvalField *cachedField(Evaluator *e, const ASTNode *node, const EvalType *type){
+    Resolution *site = findResolution(e, node);
+    InlineCache *cache = site ? site->cache : NULL;
+    if(!cache) return findField(type, node->fieldAccess.fieldName);
+    int way = cacheLookup(cache, type);
+    if(way >= 0){
+        e->stats.fieldCacheHits++;
+        return cache->fields[way];
+    }
+
+    MegamorphicEntry *entry = NULL;
+    if(cache->state == CACHE_MEGAMORPHIC){
+        entry = &e->megamorphic[(hashNode(node) ^ hashNode((const ASTNode *)type)) >> 20 & (MEGAMORPHIC_ENTRIES - 1)];
+        if(entry->site == node && entry->type == type){
+            e->stats.fieldCacheHits++;
+            return entry->field;
+        }
+    }
+    e->stats.fieldCacheMisses++;
+    const EvalField *field = findField(type, node->fieldAccess.fieldName);
+    if(!field) return NULL;
+    if(entry) *entry = (MegamorphicEntry){node, type, field};
+    else cacheInsert(cache, type, field);
+    return field;
+}
+
+// Types
+
+static EvalType *newType(Evaluator *e, TypeKind kind){
+    EvalType *type = calloc(1, sizeof(EvalType));
+    if(!type || !GROW(e->types, e->typeCount, e->typeCapacity)){
+        free(type);
+        outOfMemory(e);
+    }
+    type->kind = kind;
+    type->length = -1;
+    type->align = 1;
+    e->types[e->typeCount++] = type;
+    return type;
+}
+
+static const EvalType *pointerTo(Evaluator *e, const EvalType *pointee){
+    EvalType *target = (EvalType *)(pointee ? pointee : &e->voidType);
+    if(!target->pointerTo){
+        EvalType *type = newType(e, KIND_POINTER);
+        type->element = target;
+        type->size = type->align = sizeof(char *);
+        type->complete = true;
+        target->pointerTo = type;
+    }
+    return target->pointerTo;
+}
+
+static NamedType *findNamedType(Evaluator *e, const char *name){
+    for(int i = 0; i < e->namedTypeCount; i++){
+        if(strcmp(e->namedTypes[i].name, name) == 0) return &e->namedTypes[i];
+    }
+    return NULL;
+}
+
+static const EvalType *resolveType(Evaluator *e, ASTNode *node);
+
+static size_t alignUp(size_t n, size_t align){
+    return (n + align - 1) & ~(align - 1);
+}
+
+// Fields are laid out in order with C alignment; a union overlays them.
+static const EvalType *layoutAggregate(Evaluator *e, ASTNode *definition, NamedType *named){
+    Resolution *r = addResolution(e, definition);
+    if(r->type) return r->type;
+
+    bool isUnion = definition->type == UNION_NODE;
+    ASTNode **fields = isUnion ? definition->unionDef.fields : definition->structDef.fields;
+    int fieldCount = isUnion ? definition->unionDef.fieldsCount : definition->structDef.fieldsCount;
+
+    EvalType *type = newType(e, isUnion ? KIND_UNION : KIND_STRUCT);
+    type->name = isUnion ? definition->unionDef.name : definition->structDef.name;
+    r->kind = RESOLVED_TYPE;
+    r->type = type;
+    if(named) named->type = type;
+
+    type->fields = calloc(fieldCount > 0 ? fieldCount : 1, sizeof(EvalField));
+    if(!type->fields) outOfMemory(e);
+
+    size_t size = 0;
+    for(int i = 0; i < fieldCount; i++){
+        ASTNode *field = fields[i];
+        if(!field || field->type != DECLARATION_NODE) continue;
+
+        const EvalType *fieldType = resolveType(e, field->declaration.varType);
+        if(!fieldType || !fieldType->complete || fieldType->kind == KIND_VOID) return type;
+
+        EvalField *out = &type->fields[type->fieldCount++];
+        out->name = field->declaration.varName;
+        out->type = fieldType;
+        if(isUnion){
+            out->offset = 0;
+            if(fieldType->size > size) size = fieldType->size;
+        } else{
+            out->offset = alignUp(size, fieldType->align);
+            size = out->offset + fieldType->size;
+        }
+        if(fieldType->align > type->align) type->align = fieldType->align;
+    }
+    type->size = alignUp(size, type->align);
+    type->complete = true;
+    return type;
+}
+
+static const EvalType *namedType(Evaluator *e, const char *name){
+    NamedType *named = findNamedType(e, name);
+    if(!named) return NULL;
+    if(named->type) return named->type;
+
+    ASTNode *definition = named->definition;
+    switch(definition->type){
+        case STRUCT_NODE:
+        case UNION_NODE:
+            return layoutAggregate(e, definition, named);
+        case ENUM_NODE:
+            return &e->primitiveTypes[TYPE_INT];
+        case TYPEDEF_NODE:
+            // guards against a typedef naming itself
+            named->definition = NULL;
+            named->type = (EvalType *)resolveType(e, definition->typedefDef.original);
+            named->definition = definition;
+            return named->type;
+        default:
+            return NULL;
+    }
+}
+
+// NULL means untyped: the variable takes whatever value it is given.
+static const EvalType *resolveType(Evaluator *e, ASTNode *node){
+    if(!node) return NULL;
+
+    PrimitiveType primitive;
+    switch(node->type){
+        case IDENTIFIER_NODE:
+            if(typeNodeToPrimitive(node, &primitive)) return &e->primitiveTypes[primitive];
+            if(strcmp(node->identifier.name, "void") == 0) return &e->voidType;
+            return namedType(e, node->identifier.name);
+        case VOID_NODE:
+            return &e->voidType;
+        case POINTER_NODE: {
+            const EvalType *pointee = resolveType(e, node->pointer.ptr);
+            return pointerTo(e, pointee);
+        }
+        case ARRAY_NODE: {
+            const EvalType *element = resolveType(e, node->array.typeOfElement);
+            if(!element || !element->complete || element->kind == KIND_VOID) return NULL;
+
+            EvalType *type = newType(e, KIND_ARRAY);
+            type->element = element;
+            type->align = element->align;
+            type->complete = true;
+            long long length;
+            ASTNode *size = node->array.size;
+            if(size && size->type == LITERAL_NODE && primitiveToLongLong(size->literal.type, size->literal.value, &length) && length >= 0){
+                type->length = length;
+                type->size = (size_t)length * element->size;
+            } else{
+                type->lengthExpr = size;
+            }
+            return type;
+        }
+        case STRUCT_NODE:
+        case UNION_NODE: {
+            const char *name = node->type == STRUCT_NODE ? node->structDef.name : node->unionDef.name;
+            int fieldCount = node->type == STRUCT_NODE ? node->structDef.fieldsCount : node->unionDef.fieldsCount;
+            // a reference by name to a definition elsewhere
+            if(fieldCount == 0 && name) return namedType(e, name);
+            return layoutAggregate(e, node, NULL);
+        }
+        default:
+            return NULL;
+    }
+}
+
+static bool isAggregateType(const EvalType *type){
+    return type && (type->kind == KIND_STRUCT || type->kind == KIND_UNION);
+}
+
+// An untyped pointee is a cell holding a whole Value.
+static size_t elementSize(const EvalType *pointee){
+    if(!pointee) return sizeof(Value);
+    return pointee->kind != KIND_VOID && pointee->size > 0 ? pointee->size : 1;
+}
+
+static const char *typeName(const EvalType *type){
+    if(!type) return "any";
+    switch(type->kind){
+        case KIND_VOID: return "void";
+        case KIND_PRIMITIVE: return primitiveTypeName(type->primitive);
+        case KIND_POINTER: return "pointer";
+        case KIND_ARRAY: return "array";
+        case KIND_STRUCT: return type->name ? type->name : "struct";
+        case KIND_UNION: return type->name ? type->name : "union";
+    }
+    return "any";
+}
+
+// Name resolution, done once before running so that every variable
+// access at run time is a slot index and a count of static links.
+
+typedef struct {
+    const char *name;
+    ResolvedKind kind;
+    int index;
+    int level;
+    int constant;
+    bool inMemory;
+    const EvalType *type;
+    EvalFunction *function;
+} ScopeEntry;
+
+typedef struct {
+    Evaluator *e;
+    ScopeEntry *entries;
+    int count;
+    int capacity;
+    EvalFunction *function;
+    NameSet addressTaken;
+} Resolver;
+
+static void resolveNode(Resolver *r, ASTNode *node);
+
+static ScopeEntry *lookupEntry(Resolver *r, const char *name){
+    for(int i = r->count - 1; i >= 0; i--){
+        if(strcmp(r->entries[i].name, name) == 0) return &r->entries[i];
+    }
+    return NULL;
+}
+
+static ScopeEntry *pushEntry(Resolver *r, const char *name, ResolvedKind kind){
+    if(!GROW(r->entries, r->count, r->capacity)) outOfMemory(r->e);
+    ScopeEntry *entry = &r->entries[r->count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->name = name;
+    entry->kind = kind;
+    entry->level = r->function->level;
+    return entry;
+}
+
+static void recordEntry(Resolver *r, const ASTNode *node, const ScopeEntry *entry){
+    Resolution *res = addResolution(r->e, node);
+    res->kind = entry->kind;
+    res->index = entry->index;
+    res->depth = r->function->level - entry->level;
+    res->constant = entry->constant;
+    res->inMemory = entry->inMemory;
+    res->type = entry->type;
+    res->function = entry->function;
+}
+
+static void collectAddressTaken(ASTNode **child, void *ctx){
+    ASTNode *node = *child;
+    if(!node) return;
+
+    if(node->type == UNARY_OPERATION_NODE && node->unaryOp.op == ADDRESS_OF_UNOP){
+        ASTNode *root = node->unaryOp.expr;
+        while(root){
+            if(root->type == FIELD_ACCESS_NODE && !root->fieldAccess.isPointerAccess) root = root->fieldAccess.object;
+            else if(root->type == ARRAY_ACCESS_NODE) root = root->arrayAccess.array;
+            else break;
+        }
+        if(root && root->type == IDENTIFIER_NODE) addName(ctx, root->identifier.name);
+    }
+    forEachChild(node, collectAddressTaken, ctx);
+}
+
+static void registerNamedType(Evaluator *e, const char *name, ASTNode *definition){
+    if(!name || findNamedType(e, name)) return;
+    if(!GROW(e->namedTypes, e->namedTypeCount, e->namedTypeCapacity)) outOfMemory(e);
+    e->namedTypes[e->namedTypeCount++] = (NamedType){name, definition, NULL};
+}
+
+static void declareEnum(Resolver *r, ASTNode *node){
+    registerNamedType(r->e, node->enumDef.name, node);
+    for(int i = 0; i < node->enumDef.valuesCount; i++){
+        ScopeEntry *entry = pushEntry(r, node->enumDef.values[i], RESOLVED_ENUM);
+        entry->constant = node->enumDef.intValues[i];
+    }
+}
+
+static void declareType(Resolver *r, ASTNode *node){
+    switch(node->type){
+        case STRUCT_NODE:
+            if(node->structDef.fieldsCount > 0) registerNamedType(r->e, node->structDef.name, node);
+            break;
+        case UNION_NODE:
+            if(node->unionDef.fieldsCount > 0) registerNamedType(r->e, node->unionDef.name, node);
+            break;
+        case TYPEDEF_NODE:
+            registerNamedType(r->e, node->typedefDef.alias, node);
+            break;
+        case ENUM_NODE:
+            declareEnum(r, node);
+            break;
+        default:
+            break;
+    }
+}
+
+// Array sizes inside a type are expressions evaluated at run time.
+static void resolveTypeExpressions(Resolver *r, ASTNode *type){
+    while(type){
+        if(type->type == ARRAY_NODE){
+            if(type->array.size) resolveNode(r, type->array.size);
+            type = type->array.typeOfElement;
+        } else if(type->type == POINTER_NODE){
+            type = type->pointer.ptr;
+        } else{
+            break;
+        }
+    }
+}
+
+static const EvalType *decayedType(Evaluator *e, const EvalType *type){
+    if(type && type->kind == KIND_ARRAY) return pointerTo(e, type->element);
+    return type;
+}
+
+static EvalFunction *newFunction(Evaluator *e, ASTNode *definition){
+    EvalFunction *fn = calloc(1, sizeof(EvalFunction));
+    if(!fn) outOfMemory(e);
+    fn->definition = definition;
+    if(definition->type == FUNCTION_NODE){
+        fn->name = definition->functionDef.name;
+        fn->params = definition->functionDef.params;
+        fn->paramCount = definition->functionDef.paramCount;
+        fn->body = definition->functionDef.body;
+        fn->bodyCount = definition->functionDef.bodyCount;
+    } else{
+        fn->name = "lambda";
+        fn->params = definition->lambda.params;
+        fn->paramCount = definition->lambda.paramCount;
+        fn->body = definition->lambda.body;
+        fn->bodyCount = definition->lambda.bodyCount;
+    }
+    if(!GROW(e->functions, e->functionCount, e->functionCapacity)){
+        free(fn);
+        outOfMemory(e);
+    }
+    e->functions[e->functionCount++] = fn;
+
+    Resolution *res = addResolution(e, definition);
+    res->kind = RESOLVED_FUNCTION;
+    res->function = fn;
+    return fn;
+}
+
+static int declareGlobal(Evaluator *e, const char *name, const EvalType *type, bool isStatic){
+    if(!GROW(e->globalInfo, e->globalCount, e->globalCapacity)) outOfMemory(e);
+    e->globalInfo[e->globalCount] = (GlobalInfo){name, type, isStatic, false};
+    return e->globalCount++;
+}
+
+static ScopeEntry *declareVariable(Resolver *r, ASTNode *declaration, const char *name, const EvalType *type, bool isParam){
+    Evaluator *e = r->e;
+    bool isStatic = declaration && declaration->type == DECLARATION_NODE && (declaration->declaration.storageFlags & STORAGE_STATIC);
+
+    ScopeEntry *entry;
+    if(!isParam && (r->function->level == 0 || isStatic)){
+        entry = pushEntry(r, name, RESOLVED_GLOBAL);
+        entry->level = 0;
+        entry->index = declareGlobal(e, name, type, isStatic);
+    } else{
+        entry = pushEntry(r, name, RESOLVED_LOCAL);
+        entry->index = r->function->slotCount++;
+    }
+    entry->type = type;
+    entry->inMemory = (type && (type->kind == KIND_ARRAY || isAggregateType(type))) || hasName(&r->addressTaken, name);
+
+    Resolution *res = addResolution(e, declaration);
+    res->kind = entry->kind;
+    res->index = entry->index;
+    res->inMemory = entry->inMemory;
+    res->type = type;
+    return entry;
+}
+
+// Only functions of primitive arguments and result can share the cache key.
+static bool isMemoizable(Evaluator *e, EvalFunction *fn){
+    if(fn->definition->type != FUNCTION_NODE || fn->definition->functionDef.purity != PURITY_MEMOIZABLE) return false;
+    if(fn->level != 1 || fn->paramCount > MEMO_MAX_ARGS) return false;
+    if(!fn->returnType || fn->returnType->kind != KIND_PRIMITIVE || fn->returnType->primitive == TYPE_STRING) return false;
+
+    for(int i = 0; i < fn->paramCount; i++){
+        Resolution *res = findResolution(e, fn->params[i]);
+        if(!res || !res->type || res->type->kind != KIND_PRIMITIVE || res->type->primitive == TYPE_STRING) return false;
+    }
+    return true;
+}
+
+static void resolveFunction(Resolver *r, EvalFunction *fn){
+    Evaluator *e = r->e;
+    EvalFunction *outer = r->function;
+    NameSet outerTaken = r->addressTaken;
+    int mark = r->count;
+
+    fn->level = outer->level + 1;
+    r->function = fn;
+    initNameSet(&r->addressTaken);
+    for(int i = 0; i < fn->bodyCount; i++){
+        collectAddressTaken(&fn->body[i], &r->addressTaken);
+    }
+
+    ASTNode *returnType = fn->definition->type == FUNCTION_NODE ? fn->definition->functionDef.returnType : fn->definition->lambda.returnType;
+    fn->returnType = resolveType(e, returnType);
+    fn->returnsVoid = fn->returnType && fn->returnType->kind == KIND_VOID;
+
+    for(int i = 0; i < fn->paramCount; i++){
+        ASTNode *param = fn->params[i];
+        if(param->type == DECLARATION_NODE){
+            resolveTypeExpressions(r, param->declaration.varType);
+            const EvalType *type = decayedType(e, resolveType(e, param->declaration.varType));
+            declareVariable(r, param, param->declaration.varName, type, true);
+        } else if(param->type == IDENTIFIER_NODE){
+            declareVariable(r, param, param->identifier.name, NULL, true);
+        }
+    }
+    for(int i = 0; i < fn->bodyCount; i++){
+        resolveNode(r, fn->body[i]);
+    }
+    if(e->options.memoize && isMemoizable(e, fn)){
+        fn->memoize = initMemoCache(&fn->memo, fn->paramCount, e->options.memoCapacity);
+    }
+
+    freeNameSet(&r->addressTaken);
+    r->addressTaken = outerTaken;
+    r->function = outer;
+    r->count = mark;
+}
+
+static void resolveChild(ASTNode **child, void *ctx){
+    resolveNode(ctx, *child);
+}
+
+static void resolveList(Resolver *r, ASTNode **nodes, int count){
+    int mark = r->count;
+    for(int i = 0; i < count; i++){
+        resolveNode(r, nodes[i]);
+    }
+    r->count = mark;
+}
+
+static bool isTypeOperand(Resolver *r, ASTNode *node){
+    PrimitiveType primitive;
+    switch(node->type){
+        case IDENTIFIER_NODE:
+            if(typeNodeToPrimitive(node, &primitive) || strcmp(node->identifier.name, "void") == 0) return true;
+            return !lookupEntry(r, node->identifier.name) && findNamedType(r->e, node->identifier.name);
+        case POINTER_NODE:
+        case VOID_NODE:
+        case STRUCT_NODE:
+        case UNION_NODE:
+            return true;
+        case ARRAY_NODE:
+            return node->array.elementsCount == 0 && node->array.typeOfElement;
+        default:
+            return false;
+    }
+}
+
+static void resolveSizeOf(Resolver *r, ASTNode *node, ASTNode *operand){
+    if(!operand) return;
+    if(isTypeOperand(r, operand)){
+        resolveTypeExpressions(r, operand);
+        Resolution *res = addResolution(r->e, node);
+        res->kind = RESOLVED_TYPE;
+        res->type = resolveType(r->e, operand);
+        return;
+    }
+    resolveNode(r, operand);
+}
+
+// A size written as an integer or as sizeof a fixed-size type picks its
+// kernel here, once, instead of being evaluated on every call.
+static void resolveMemoryKernel(Evaluator *e, ASTNode *node){
+    ASTNode *size = node->type == MEMCPY_NODE ? node->memcpyExpr.size : node->type == MEMMOVE_NODE ? node->memmoveExpr.size : node->memsetExpr.size;
+    long long n = -1;
+    if(!size) return;
+    if(size->type == LITERAL_NODE){
+        if(!isIntegerType(size->literal.type) || !primitiveToLongLong(size->literal.type, size->literal.value, &n)) return;
+    } else if(size->type == SIZEOF_NODE || (size->type == UNARY_OPERATION_NODE && size->unaryOp.op == SIZE_OF_UNOP)){
+        Resolution *sized = findResolution(e, size);
+        if(!sized || sized->kind != RESOLVED_TYPE || !sized->type || !sized->type->complete) return;
+        if(sized->type->kind == KIND_ARRAY && sized->type->length < 0) return;
+        n = (long long)sized->type->size;
+    }
+    if(n < 0 || n > INT_MAX) return;
+
+    Resolution *res = addResolution(e, node);
+    res->kind = RESOLVED_KERNEL;
+    res->constant = (int)n;
+    if(node->type == MEMSET_NODE) res->fill = fillKernelFor((size_t)n);
+    else res->move = moveKernelFor((size_t)n);
+}
+
+static void resolveNode(Resolver *r, ASTNode *node){
+    if(!node) return;
+
+    Evaluator *e = r->e;
+    Resolution *res;
+    switch(node->type){
+        case IDENTIFIER_NODE: {
+            ScopeEntry *entry = lookupEntry(r, node->identifier.name);
+            if(entry){
+                recordEntry(r, node, entry);
+                return;
+            }
+            res = addResolution(e, node);
+            res->kind = strcmp(node->identifier.name, "print") == 0 ? RESOLVED_BUILTIN : RESOLVED_UNKNOWN;
+            res->constant = BUILTIN_PRINT;
+            return;
+        }
+        case DECLARATION_NODE:
+            resolveTypeExpressions(r, node->declaration.varType);
+            resolveNode(r, node->declaration.initializer);
+            res = findResolution(e, node);
+            if(res && res->kind == RESOLVED_GLOBAL) return;
+            declareVariable(r, node, node->declaration.varName, resolveType(e, node->declaration.varType), false);
+            return;
+        case FUNCTION_NODE: {
+            res = findResolution(e, node);
+            EvalFunction *fn = res ? res->function : NULL;
+            if(!fn){
+                fn = newFunction(e, node);
+                pushEntry(r, node->functionDef.name, RESOLVED_FUNCTION)->function = fn;
+            }
+            resolveFunction(r, fn);
+            return;
+        }
+        case LAMBDA_NODE:
+            resolveFunction(r, newFunction(e, node));
+            return;
+        case STRUCT_NODE:
+        case UNION_NODE:
+        case TYPEDEF_NODE:
+        case ENUM_NODE:
+            declareType(r, node);
+            return;
+        case IMPL_NODE:
+        case INCLUDE_NODE:
+            return;
+        case CAST_EXPR_NODE:
+            resolveTypeExpressions(r, node->castExpr.targetType);
+            res = addResolution(e, node);
+            res->kind = RESOLVED_TYPE;
+            res->type = resolveType(e, node->castExpr.targetType);
+            resolveNode(r, node->castExpr.value);
+            return;
+        case NULL_NODE:
+            res = addResolution(e, node);
+            res->kind = RESOLVED_TYPE;
+            res->type = resolveType(e, node->null.typeOf);
+            return;
+        case SIZEOF_NODE:
+            resolveSizeOf(r, node, node->sizeOfExpr.expr);
+            return;
+        case UNARY_OPERATION_NODE:
+            if(node->unaryOp.op == SIZE_OF_UNOP) resolveSizeOf(r, node, node->unaryOp.expr);
+            else resolveNode(r, node->unaryOp.expr);
+            return;
+        case ARRAY_NODE:
+            res = addResolution(e, node);
+            res->kind = RESOLVED_TYPE;
+            res->type = resolveType(e, node->array.typeOfElement);
+            resolveNode(r, node->array.size);
+            for(int i = 0; i < node->array.elementsCount; i++){
+                resolveNode(r, node->array.elements[i]);
+            }
+            return;
+        case BLOCK_NODE:
+            resolveList(r, node->block.statements, node->block.stmtCount);
+            return;
+        case COMPOUND_EXPR_NODE:
+            resolveList(r, node->compoundExpr.statements, node->compoundExpr.stmtCount);
+            return;
+        case FOR_NODE: {
+            int mark = r->count;
+            resolveNode(r, node->forStmt.initializer);
+            resolveNode(r, node->forStmt.condition);
+            resolveNode(r, node->forStmt.increment);
+            resolveList(r, node->forStmt.body, node->forStmt.bodyCount);
+            r->count = mark;
+            return;
+        }
+        case WHILE_NODE:
+            resolveNode(r, node->whileStmt.condition);
+            resolveList(r, node->whileStmt.body, node->whileStmt.bodyCount);
+            return;
+        case DO_WHILE_NODE:
+            resolveList(r, node->doWhileStmt.body, node->doWhileStmt.bodyCount);
+            resolveNode(r, node->doWhileStmt.condition);
+            return;
+        case CASE_NODE:
+            resolveNode(r, node->caseStmt.value);
+            resolveList(r, node->caseStmt.body, node->caseStmt.bodyCount);
+            return;
+        case DEFAULT_NODE:
+            resolveList(r, node->defaultStmt.body, node->defaultStmt.bodyCount);
+            return;
+        case TRY_NODE:
+            resolveList(r, node->tryStmt.tryBlock, node->tryStmt.tryBlockCount);
+            for(int i = 0; i < node->tryStmt.catchCount; i++){
+                resolveNode(r, node->tryStmt.catchBlock[i]);
+            }
+            return;
+        case FIELD_ACCESS_NODE:
+            resolveNode(r, node->fieldAccess.object);
+            addResolution(e, node)->cache = newInlineCache(e);
+            return;
+        case CATCH_NODE: {
+            int mark = r->count;
+            ASTNode *var = node->catchStmt.exceptionVar;
+            if(var && var->type == DECLARATION_NODE){
+                declareVariable(r, var, var->declaration.varName, resolveType(e, var->declaration.varType), false);
+            } else if(var && var->type == IDENTIFIER_NODE){
+                declareVariable(r, var, var->identifier.name, NULL, false);
+            }
+            resolveList(r, node->catchStmt.body, node->catchStmt.bodyCount);
+            r->count = mark;
+            return;
+        }
+        case MEMCPY_NODE:
+        case MEMMOVE_NODE:
+        case MEMSET_NODE:
+            forEachChild(node, resolveChild, r);
+            resolveMemoryKernel(e, node);
+            return;
+        default:
+            forEachChild(node, resolveChild, r);
+            return;
+    }
+}
+
+// Top-level functions, globals and types are visible before their
+// definition so that they can be used in any order.
+static void resolveProgram(Evaluator *e, ASTNode **items, int itemCount){
+    Resolver r = {0};
+    r.e = e;
+    r.function = e->top;
+    initNameSet(&r.addressTaken);
+    for(int i = 0; i < itemCount; i++){
+        collectAddressTaken(&items[i], &r.addressTaken);
+    }
+
+    for(int i = 0; i < itemCount; i++){
+        if(items[i]) declareType(&r, items[i]);
+    }
+    for(int i = 0; i < itemCount; i++){
+        ASTNode *item = items[i];
+        if(!item) continue;
+
+        if(item->type == FUNCTION_NODE){
+            pushEntry(&r, item->functionDef.name, RESOLVED_FUNCTION)->function = newFunction(e, item);
+        } else if(item->type == DECLARATION_NODE){
+            declareVariable(&r, item, item->declaration.varName, resolveType(e, item->declaration.varType), false);
+        }
+    }
+    for(int i = 0; i < itemCount; i++){
+        if(!items[i] || items[i]->type == ENUM_NODE) continue;
+        resolveNode(&r, items[i]);
+    }
+
+    freeNameSet(&r.addressTaken);
+    free(r.entries);
+}
+
+// Values and storage
+
+Value makePrimitiveValue(PrimitiveType type, PrimitiveValue value){
+    Value v;
+    memset(&v, 0, sizeof(v));
+    v.kind = VALUE_PRIMITIVE;
+    v.type = type;
+    v.as.primitive = value;
+    return v;
+}
+
+static Value voidValue(void){
+    Value v;
+    memset(&v, 0, sizeof(v));
+    v.kind = VALUE_VOID;
+    return v;
+}
+
+static Value makePointer(char *address, char *base, char *limit, const EvalType *pointee){
+    Value v;
+    v.kind = VALUE_POINTER;
+    v.type = TYPE_UNSIGNED_ARCH;
+    v.as.pointer.address = address;
+    v.as.pointer.base = base;
+    v.as.pointer.limit = limit;
+    v.as.pointer.pointee = pointee;
+    return v;
+}
+
+static Value makeAggregate(char *address, const EvalType *type){
+    Value v;
+    v.kind = VALUE_AGGREGATE;
+    v.type = TYPE_UNSIGNED_ARCH;
+    v.as.aggregate.address = address;
+    v.as.aggregate.type = type;
+    return v;
+}
+
+static Value makeFunction(EvalFunction *function, EvalFrame *env, unsigned long serial){
+    Value v;
+    v.kind = VALUE_FUNCTION;
+    v.type = TYPE_UNSIGNED_ARCH;
+    v.as.function.function = function;
+    v.as.function.env = env;
+    v.as.function.serial = serial;
+    return v;
+}
+
+// Zeroed storage on the evaluator's byte stack, released with the
+// enclosing loop iteration or call.
+static ExecStatus stackAllocate(Evaluator *e, size_t size, char **out){
+    size_t aligned = alignUp(size ? size : 1, MEMORY_ALIGN);
+    if(aligned > (size_t)(e->memoryLimit - e->memoryTop)) return runtimeError(e, "out of evaluator memory allocating %zu bytes", size);
+
+    *out = e->memoryTop;
+    memset(*out, 0, aligned);
+    e->memoryTop += aligned;
+    return EXEC_NORMAL;
+}
+
+static char *permanentAllocate(Evaluator *e, size_t size){
+    char *storage = calloc(1, size ? size : 1);
+    if(!storage || !GROW(e->permanent, e->permanentCount, e->permanentCapacity)){
+        free(storage);
+        return NULL;
+    }
+    e->permanent[e->permanentCount++] = storage;
+    return storage;
+}
+
+static bool inEvaluatorMemory(Evaluator *e, const char *address){
+    return address >= e->memory && address < e->memoryLimit;
+}
+
+// A variable, array element or field: either a slot holding a Value, or
+// typed bytes in memory together with the bounds of the object around it.
+typedef struct {
+    Value *slot;
+    const EvalType *type;
+    char *address;
+    char *base;
+    char *limit;
+} Place;
+
+static Value decayArray(const Place *place){
+    char *limit = place->type->length >= 0 ? place->address + place->type->size : place->limit;
+    return makePointer(place->address, place->address, limit, place->type->element);
+}
+
+static Value loadValue(const EvalType *type, char *address){
+    if(!type){
+        Value v;
+        memcpy(&v, address, sizeof(v));
+        return v;
+    }
+
+    PrimitiveValue primitive;
+    char *pointer;
+    switch(type->kind){
+        case KIND_PRIMITIVE:
+            memset(&primitive, 0, sizeof(primitive));
+            memcpy(&primitive, address, primitiveSize(type->primitive));
+            return makePrimitiveValue(type->primitive, primitive);
+        case KIND_POINTER:
+            memcpy(&pointer, address, sizeof(pointer));
+            return makePointer(pointer, NULL, NULL, type->element);
+        case KIND_STRUCT:
+        case KIND_UNION:
+            return makeAggregate(address, type);
+        default:
+            return voidValue();
+    }
+}
+
+static ExecStatus readPlace(Evaluator *e, const Place *place, Value *out){
+    if(place->slot){
+        *out = *place->slot;
+        return EXEC_NORMAL;
+    }
+    if(place->type && place->type->kind == KIND_ARRAY){
+        *out = decayArray(place);
+        return EXEC_NORMAL;
+    }
+    if(place->type && place->type->kind == KIND_VOID) return runtimeError(e, "dereferencing a void pointer");
+
+    *out = loadValue(place->type, place->address);
+    return EXEC_NORMAL;
+}
+
+static ExecStatus convertValue(Evaluator *e, Value value, const EvalType *type, Value *out){
+    if(!type){
+        *out = value;
+        return EXEC_NORMAL;
+    }
+
+    switch(type->kind){
+        case KIND_PRIMITIVE:
+            if(value.kind == VALUE_PRIMITIVE){
+                *out = value.type == type->primitive ? value : makePrimitiveValue(type->primitive, convertPrimitive(value.type, value.as.primitive, type->primitive));
+                return EXEC_NORMAL;
+            }
+            if(value.kind == VALUE_POINTER && isIntegerType(type->primitive)){
+                PrimitiveValue address = {0};
+                address.uArchVal = (uintptr_t)value.as.pointer.address;
+                *out = makePrimitiveValue(type->primitive, convertPrimitive(TYPE_UNSIGNED_ARCH, address, type->primitive));
+                return EXEC_NORMAL;
+            }
+            break;
+        case KIND_POINTER:
+            if(value.kind == VALUE_POINTER){
+                *out = value;
+                out->as.pointer.pointee = type->element;
+                return EXEC_NORMAL;
+            }
+            if(value.kind == VALUE_PRIMITIVE && isIntegerType(value.type)){
+                PrimitiveValue address = convertPrimitive(value.type, value.as.primitive, TYPE_UNSIGNED_ARCH);
+                *out = makePointer((char *)address.uArchVal, NULL, NULL, type->element);
+                return EXEC_NORMAL;
+            }
+            if(value.kind == VALUE_PRIMITIVE && value.type == TYPE_STRING){
+                char *string = value.as.primitive.stringVal;
+                *out = makePointer(string, string, string ? string + strlen(string) + 1 : NULL, type->element);
+                return EXEC_NORMAL;
+            }
+            break;
+        case KIND_STRUCT:
+        case KIND_UNION:
+            if(value.kind == VALUE_AGGREGATE && value.as.aggregate.type == type){
+                *out = value;
+                return EXEC_NORMAL;
+            }
+            break;
+        case KIND_VOID:
+            *out = voidValue();
+            return EXEC_NORMAL;
+        default:
+            break;
+    }
+    return runtimeError(e, "cannot convert a value to %s", typeName(type));
+}
+
+static ExecStatus writePlace(Evaluator *e, const Place *place, Value value, Value *stored){
+    Value converted;
+    ExecStatus status = convertValue(e, value, place->type, &converted);
+    if(status != EXEC_NORMAL) return status;
+
+    if(place->slot){
+        *place->slot = converted;
+    } else if(!place->type){
+        memcpy(place->address, &converted, sizeof(converted));
+    } else{
+        switch(place->type->kind){
+            case KIND_PRIMITIVE:
+                memcpy(place->address, &converted.as.primitive, primitiveSize(place->type->primitive));
+                break;
+            case KIND_POINTER:
+                memcpy(place->address, &converted.as.pointer.address, sizeof(char *));
+                break;
+            case KIND_STRUCT:
+            case KIND_UNION:
+                if(converted.as.aggregate.address != place->address) memmove(place->address, converted.as.aggregate.address, place->type->size);
+                converted.as.aggregate.address = place->address;
+                break;
+            default:
+                return runtimeError(e, "cannot assign to %s", typeName(place->type));
+        }
+    }
+    if(stored) *stored = converted;
+    return EXEC_NORMAL;
+}
+
+static Value zeroValue(const EvalType *type){
+    if(type && type->kind == KIND_PRIMITIVE) return makePrimitiveValue(type->primitive, (PrimitiveValue){0});
+    if(type && type->kind == KIND_POINTER) return makePointer(NULL, NULL, NULL, type->element);
+    return voidValue();
+}
+
+static bool valueIsTruthy(Evaluator *e, Value value, bool *out){
+    switch(value.kind){
+        case VALUE_PRIMITIVE:
+            *out = primitiveIsTruthy(value.type, value.as.primitive);
+            return true;
+        case VALUE_POINTER:
+            *out = value.as.pointer.address != NULL;
+            return true;
+        case VALUE_FUNCTION:
+        case VALUE_AGGREGATE:
+            *out = true;
+            return true;
+        default:
+            runtimeError(e, "void value used as a condition");
+            return false;
+    }
+}
+
+static bool valueToLongLong(Value value, long long *out){
+    return value.kind == VALUE_PRIMITIVE && isIntegerType(value.type) && primitiveToLongLong(value.type, value.as.primitive, out);
+}
+
+static EvalFrame *frameAtDepth(Evaluator *e, int depth){
+    EvalFrame *frame = e->frame;
+    while(depth-- > 0) frame = frame->env;
+    return frame;
+}
+
+// The frame a nested function or lambda refers to for outer variables.
+static EvalFrame *functionEnv(Evaluator *e, const EvalFunction *fn){
+    if(fn->level <= 1) return NULL;
+
+    EvalFrame *frame = e->frame;
+    while(frame && frame->function->level >= fn->level) frame = frame->env;
+    return frame;
+}
+
+// Expressions
+
+static ExecStatus evalExpr(Evaluator *e, ASTNode *node, Value *out);
+static ExecStatus execStmt(Evaluator *e, ASTNode *node);
+static ExecStatus execList(Evaluator *e, ASTNode **statements, int count);
+static int findLabel(ASTNode **statements, int count, const char *name);
+static ExecStatus evalCall(Evaluator *e, ASTNode *node, bool tail, Value *out);
+
+static ExecStatus variablePlace(Evaluator *e, ASTNode *node, const Resolution *r, Place *out){
+    Value *slot = r->kind == RESOLVED_GLOBAL ? &e->globals[r->index] : &frameAtDepth(e, r->depth)->slots[r->index];
+    memset(out, 0, sizeof(*out));
+    out->type = r->type;
+    if(!r->inMemory){
+        out->slot = slot;
+        return EXEC_NORMAL;
+    }
+    if(slot->kind != VALUE_POINTER || !slot->as.pointer.address) return runtimeError(e, "'%s' used before its declaration", node->identifier.name);
+
+    out->address = out->base = slot->as.pointer.address;
+    out->limit = slot->as.pointer.limit;
+    return EXEC_NORMAL;
+}
+
+static ExecStatus checkAccess(Evaluator *e, const Value *pointer, char *address, size_t size){
+    if(!address) return runtimeError(e, "null pointer dereference");
+    if(pointer->as.pointer.base && (address < pointer->as.pointer.base || address + size > pointer->as.pointer.limit)){
+        return runtimeError(e, "access at offset %td outside an object of %td bytes", address - pointer->as.pointer.base, pointer->as.pointer.limit - pointer->as.pointer.base);
+    }
+    return EXEC_NORMAL;
+}
+
+static ExecStatus pointerPlace(Evaluator *e, const Value *pointer, char *address, Place *out){
+    const EvalType *type = pointer->as.pointer.pointee;
+    size_t size = elementSize(type);
+    if(type && (type->kind == KIND_VOID || (type->kind == KIND_ARRAY && type->length < 0))) size = 0;
+
+    ExecStatus status = checkAccess(e, pointer, address, size);
+    if(status != EXEC_NORMAL) return status;
+
+    memset(out, 0, sizeof(*out));
+    out->type = type;
+    out->address = address;
+    out->base = pointer->as.pointer.base;
+    out->limit = pointer->as.pointer.limit;
+    return EXEC_NORMAL;
+}
+
+static ExecStatus evalPlace(Evaluator *e, ASTNode *node, Place *out){
+    ExecStatus status;
+    Value value;
+    switch(node->type){
+        case IDENTIFIER_NODE: {
+            Resolution *r = findResolution(e, node);
+            if(r && (r->kind == RESOLVED_LOCAL || r->kind == RESOLVED_GLOBAL)) return variablePlace(e, node, r, out);
+            return runtimeError(e, "'%s' is not a variable", node->identifier.name);
+        }
+        case ARRAY_ACCESS_NODE: {
+            Value index;
+            long long n;
+            if((status = evalExpr(e, node->arrayAccess.array, &value)) != EXEC_NORMAL) return status;
+            if((status = evalExpr(e, node->arrayAccess.index, &index)) != EXEC_NORMAL) return status;
+            if(value.kind == VALUE_PRIMITIVE && value.type == TYPE_STRING){
+                if((status = convertValue(e, value, pointerTo(e, &e->primitiveTypes[TYPE_CHAR]), &value)) != EXEC_NORMAL) return status;
+            }
+            if(value.kind != VALUE_POINTER) return runtimeError(e, "subscripted value is not an array or pointer");
+            if(!valueToLongLong(index, &n)) return runtimeError(e, "array index is not an integer");
+
+            char *address = value.as.pointer.address + n * (long long)elementSize(value.as.pointer.pointee);
+            if(node->arrayAccess.inBounds){
+                e->stats.boundsChecksElided++;
+                memset(out, 0, sizeof(*out));
+                out->type = value.as.pointer.pointee;
+                out->address = address;
+                out->base = value.as.pointer.base;
+                out->limit = value.as.pointer.limit;
+                return EXEC_NORMAL;
+            }
+            e->stats.boundsChecks++;
+            return pointerPlace(e, &value, address, out);
+        }
+        case FIELD_ACCESS_NODE: {
+            if((status = evalExpr(e, node->fieldAccess.object, &value)) != EXEC_NORMAL) return status;
+
+            const EvalType *type;
+            char *address;
+            if(value.kind == VALUE_POINTER){
+                type = value.as.pointer.pointee;
+                address = value.as.pointer.address;
+                if(type && isAggregateType(type) && (status = checkAccess(e, &value, address, type->size)) != EXEC_NORMAL) return status;
+            } else if(value.kind == VALUE_AGGREGATE){
+                type = value.as.aggregate.type;
+                address = value.as.aggregate.address;
+            } else{
+                return runtimeError(e, "request for field '%s' in something that is not a struct", node->fieldAccess.fieldName);
+            }
+            if(!isAggregateType(type)) return runtimeError(e, "request for field '%s' in something that is not a struct", node->fieldAccess.fieldName);
+
+            const EvalField *field = cachedField(e, node, type);
+            if(!field) return runtimeError(e, "%s has no field '%s'", typeName(type), node->fieldAccess.fieldName);
+
+            memset(out, 0, sizeof(*out));
+            out->type = field->type;
+            out->address = address + field->offset;
+            out->base = out->address;
+            out->limit = out->address + out->type->size;
+            return EXEC_NORMAL;
+        }
+        case UNARY_OPERATION_NODE:
+            if(node->unaryOp.op != DEFERENCE_UNOP) break;
+            if((status = evalExpr(e, node->unaryOp.expr, &value)) != EXEC_NORMAL) return status;
+            if(value.kind != VALUE_POINTER) return runtimeError(e, "dereferencing a value that is not a pointer");
+            return pointerPlace(e, &value, value.as.pointer.address, out);
+        default:
+            break;
+    }
+    return runtimeError(e, "expression is not assignable");
+}
+
+static ExecStatus primitiveError(Evaluator *e, PrimitiveStatus status, PrimitiveType type){
+    switch(status){
+        case PRIM_DIV_BY_ZERO: return runtimeError(e, "division by zero");
+        case PRIM_INVALID_SHIFT: return runtimeError(e, "invalid shift count");
+        default: return runtimeError(e, "operator not supported for %s", primitiveTypeName(type));
+    }
+}
+
+static ExecStatus pointerArithmetic(Evaluator *e, BinaryOpType op, Value pointer, Value offset, Value *out){
+    long long n;
+    if(!valueToLongLong(offset, &n)) return runtimeError(e, "pointer offset is not an integer");
+    if(op == SUB_BINOP) n = -n;
+
+    *out = pointer;
+    out->as.pointer.address = pointer.as.pointer.address + n * (long long)elementSize(pointer.as.pointer.pointee);
+    return EXEC_NORMAL;
+}
+
+static char *comparableAddress(Value value, bool *ok){
+    *ok = true;
+    if(value.kind == VALUE_POINTER) return value.as.pointer.address;
+    if(value.kind == VALUE_FUNCTION) return (char *)value.as.function.function + value.as.function.serial;
+    if(value.kind == VALUE_PRIMITIVE && isIntegerType(value.type)){
+        PrimitiveValue address = convertPrimitive(value.type, value.as.primitive, TYPE_UNSIGNED_ARCH);
+        return (char *)address.uArchVal;
+    }
+    *ok = false;
+    return NULL;
+}
+
+// Operands of the same type go straight to that type's handler, which
+// is the common case in loops; mixed types go through the conversions.
+static ExecStatus binaryValues(Evaluator *e, BinaryOpType op, Value left, Value right, Value *out){
+    if(left.kind == VALUE_PRIMITIVE && right.kind == VALUE_PRIMITIVE){
+        PrimitiveStatus status;
+        PrimitiveType type;
+        PrimitiveValue result;
+        if(left.type == right.type && op != SHIFT_LEFT_BINOP && op != SHIFT_RIGHT_BINOP){
+            PrimitiveBinaryHandler handler = primitiveBinaryHandlers[left.type][op];
+            if(!handler) return primitiveError(e, PRIM_UNSUPPORTED, left.type);
+            status = handler(left.as.primitive, right.as.primitive, &result);
+            type = isComparisonOp(op) ? TYPE_BOOL : left.type;
+        } else{
+            status = evalBinaryPrimitive(op, left.type, left.as.primitive, right.type, right.as.primitive, &type, &result);
+        }
+        if(status != PRIM_OK && status != PRIM_OVERFLOW) return primitiveError(e, status, left.type);
+
+        *out = makePrimitiveValue(type, result);
+        return EXEC_NORMAL;
+    }
+
+    if(left.kind == VALUE_POINTER && right.kind == VALUE_PRIMITIVE && (op == ADD_BINOP || op == SUB_BINOP)){
+        return pointerArithmetic(e, op, left, right, out);
+    }
+    if(left.kind == VALUE_PRIMITIVE && right.kind == VALUE_POINTER && op == ADD_BINOP){
+        return pointerArithmetic(e, op, right, left, out);
+    }
+    if(left.kind == VALUE_POINTER && right.kind == VALUE_POINTER && op == SUB_BINOP){
+        PrimitiveValue difference = {0};
+        difference.archVal = (left.as.pointer.address - right.as.pointer.address) / (long long)elementSize(left.as.pointer.pointee);
+        *out = makePrimitiveValue(TYPE_ARCH, difference);
+        return EXEC_NORMAL;
+    }
+    if(isComparisonOp(op)){
+        bool leftOk, rightOk;
+        char *a = comparableAddress(left, &leftOk);
+        char *b = comparableAddress(right, &rightOk);
+        if(leftOk && rightOk){
+            PrimitiveValue result = {0};
+            switch(op){
+                case EQU_BINOP: result.boolVal = a == b; break;
+                case NOT_EQU_BINOP: result.boolVal = a != b; break;
+                case LESS_BINOP: result.boolVal = a < b; break;
+                case LESS_EQU_BINOP: result.boolVal = a <= b; break;
+                case GREATER_BINOP: result.boolVal = a > b; break;
+                default: result.boolVal = a >= b; break;
+            }
+            *out = makePrimitiveValue(TYPE_BOOL, result);
+            return EXEC_NORMAL;
+        }
+    }
+    return runtimeError(e, "invalid operands to a binary operator");
+}
+
+static ExecStatus evalBinary(Evaluator *e, ASTNode *node, Value *out){
+    BinaryOpType op = node->binaryOp.op;
+    Value left, right;
+    ExecStatus status;
+    if((status = evalExpr(e, node->binaryOp.left, &left)) != EXEC_NORMAL) return status;
+
+    if(op == AND_BINOP || op == OR_BINOP){
+        bool truth;
+        if(!valueIsTruthy(e, left, &truth)) return EXEC_ERROR;
+        if(truth == (op == AND_BINOP)){
+            if((status = evalExpr(e, node->binaryOp.right, &right)) != EXEC_NORMAL) return status;
+            if(!valueIsTruthy(e, right, &truth)) return EXEC_ERROR;
+        }
+        PrimitiveValue result = {0};
+        result.boolVal = truth;
+        *out = makePrimitiveValue(TYPE_BOOL, result);
+        return EXEC_NORMAL;
+    }
+    if(op == COMMA_BINOP) return evalExpr(e, node->binaryOp.right, out);
+
+    if((status = evalExpr(e, node->binaryOp.right, &right)) != EXEC_NORMAL) return status;
+    return binaryValues(e, op, left, right, out);
+}
+
+static BinaryOpType assignmentOperator(AssignmentOpType op){
+    switch(op){
+        case ADD_AND_ASSIGN: return ADD_BINOP;
+        case SUB_AND_ASSIGN: return SUB_BINOP;
+        case MUL_AND_ASSIGN: return MUL_BINOP;
+        case DIV_AND_ASSIGN: return DIV_BINOP;
+        case MOD_AND_ASSIGN: return MOD_BINOP;
+        case AND_AND_ASSIGN: return BIT_AND_BINOP;
+        case OR_AND_ASSIGN: return BIT_OR_BINOP;
+        case XOR_AND_ASSIGN: return BIT_XOR_BINOP;
+        case SHIFT_LEFT_AND_ASSIGN: return SHIFT_LEFT_BINOP;
+        case SHIFT_RIGHT_AND_ASSIGN: return SHIFT_RIGHT_BINOP;
+        default: return COMMA_BINOP;
+    }
+}
+
+static ExecStatus evalAssignment(Evaluator *e, ASTNode *node, Value *out){
+    Place place;
+    Value value;
+    ExecStatus status;
+    if((status = evalPlace(e, node->assignment.left, &place)) != EXEC_NORMAL) return status;
+    if((status = evalExpr(e, node->assignment.right, &value)) != EXEC_NORMAL) return status;
+
+    if(node->assignment.op != SIMPLE_ASSIGN){
+        Value old;
+        if((status = readPlace(e, &place, &old)) != EXEC_NORMAL) return status;
+        if((status = binaryValues(e, assignmentOperator(node->assignment.op), old, value, &value)) != EXEC_NORMAL) return status;
+    }
+    return writePlace(e, &place, value, out);
+}
+
+static ExecStatus evalIncrement(Evaluator *e, ASTNode *node, Value *out){
+    UnaryOpType op = node->unaryOp.op;
+    Place place;
+    Value old, value;
+    ExecStatus status;
+    if((status = evalPlace(e, node->unaryOp.expr, &place)) != EXEC_NORMAL) return status;
+    if((status = readPlace(e, &place, &old)) != EXEC_NORMAL) return status;
+
+    BinaryOpType binary = op == PRE_INCREMENT_UNOP || op == POST_INCREMENT_UNOP ? ADD_BINOP : SUB_BINOP;
+    if(old.kind == VALUE_PRIMITIVE){
+        PrimitiveBinaryHandler handler = primitiveBinaryHandlers[old.type][binary];
+        if(!handler) return primitiveError(e, PRIM_UNSUPPORTED, old.type);
+        value = old;
+        handler(old.as.primitive, primitiveFromLongLong(old.type, 1), &value.as.primitive);
+    } else if(old.kind == VALUE_POINTER){
+        value = old;
+        long long step = (long long)elementSize(old.as.pointer.pointee);
+        value.as.pointer.address += binary == ADD_BINOP ? step : -step;
+    } else{
+        return runtimeError(e, "operand of increment or decrement is not a number or pointer");
+    }
+
+    if((status = writePlace(e, &place, value, &value)) != EXEC_NORMAL) return status;
+    *out = op == PRE_INCREMENT_UNOP || op == PRE_DECREMENT_UNOP ? value : old;
+    return EXEC_NORMAL;
+}
+
+static size_t valueSize(const Value *value){
+    switch(value->kind){
+        case VALUE_PRIMITIVE: return primitiveSize(value->type);
+        case VALUE_AGGREGATE: return value->as.aggregate.type->size;
+        case VALUE_VOID: return 0;
+        default: return sizeof(void *);
+    }
+}
+
+static ExecStatus evalSizeOf(Evaluator *e, ASTNode *node, ASTNode *operand, Value *out){
+    Resolution *r = findResolution(e, node);
+    size_t size;
+    ExecStatus status;
+    if(r && r->kind == RESOLVED_TYPE){
+        if(!r->type) return runtimeError(e, "sizeof of an unknown type");
+        size = r->type->size;
+        if(r->type->kind == KIND_ARRAY && r->type->length < 0){
+            Value length;
+            long long n;
+            if((status = evalExpr(e, r->type->lengthExpr, &length)) != EXEC_NORMAL) return status;
+            size = valueToLongLong(length, &n) && n > 0 ? (size_t)n * r->type->element->size : 0;
+        }
+    } else{
+        Resolution *variable = operand->type == IDENTIFIER_NODE ? findResolution(e, operand) : NULL;
+        if(variable && variable->type && variable->type->kind == KIND_ARRAY){
+            Place place;
+            if((status = evalPlace(e, operand, &place)) != EXEC_NORMAL) return status;
+            size = (size_t)(place.limit - place.address);
+        } else{
+            Value value;
+            if((status = evalExpr(e, operand, &value)) != EXEC_NORMAL) return status;
+            size = valueSize(&value);
+        }
+    }
+    *out = makePrimitiveValue(TYPE_UNSIGNED_ARCH, primitiveFromLongLong(TYPE_UNSIGNED_ARCH, (long long)size));
+    return EXEC_NORMAL;
+}
+
+static ExecStatus evalUnary(Evaluator *e, ASTNode *node, Value *out){
+    UnaryOpType op = node->unaryOp.op;
+    Value value;
+    Place place;
+    ExecStatus status;
+    switch(op){
+        case PRE_INCREMENT_UNOP:
+        case POST_INCREMENT_UNOP:
+        case PRE_DECREMENT_UNOP:
+        case POST_DECREMENT_UNOP:
+            return evalIncrement(e, node, out);
+        case DEFERENCE_UNOP:
+            if((status = evalPlace(e, node, &place)) != EXEC_NORMAL) return status;
+            return readPlace(e, &place, out);
+        case ADDRESS_OF_UNOP: {
+            ASTNode *operand = node->unaryOp.expr;
+            Resolution *r = operand->type == IDENTIFIER_NODE ? findResolution(e, operand) : NULL;
+            if(r && (r->kind == RESOLVED_FUNCTION || r->kind == RESOLVED_BUILTIN)) return evalExpr(e, operand, out);
+
+            if((status = evalPlace(e, operand, &place)) != EXEC_NORMAL) return status;
+            if(place.slot) return runtimeError(e, "cannot take the address of this expression");
+            *out = makePointer(place.address, place.base, place.limit, place.type);
+            return EXEC_NORMAL;
+        }
+        case SIZE_OF_UNOP:
+            return evalSizeOf(e, node, node->unaryOp.expr, out);
+        default:
+            break;
+    }
+
+    if((status = evalExpr(e, node->unaryOp.expr, &value)) != EXEC_NORMAL) return status;
+    if(value.kind == VALUE_PRIMITIVE){
+        PrimitiveUnaryHandler handler = primitiveUnaryHandlers[value.type][op];
+        if(!handler) return primitiveError(e, PRIM_UNSUPPORTED, value.type);
+
+        PrimitiveValue result;
+        PrimitiveStatus primitiveStatus = handler(value.as.primitive, &result);
+        if(primitiveStatus != PRIM_OK && primitiveStatus != PRIM_OVERFLOW) return primitiveError(e, primitiveStatus, value.type);
+        *out = makePrimitiveValue(op == NOT_UNOP ? TYPE_BOOL : value.type, result);
+        return EXEC_NORMAL;
+    }
+    if(op == NOT_UNOP){
+        bool truth;
+        if(!valueIsTruthy(e, value, &truth)) return EXEC_ERROR;
+        PrimitiveValue result = {0};
+        result.boolVal = !truth;
+        *out = makePrimitiveValue(TYPE_BOOL, result);
+        return EXEC_NORMAL;
+    }
+    return runtimeError(e, "invalid operand to a unary operator");
+}
+
+static ExecStatus callBuiltin(Evaluator *e, Builtin builtin, ASTNode *node, Value *out){
+    FILE *stream = e->options.out ? e->options.out : stdout;
+    (void)builtin;
+    for(int i = 0; i < node->functionCall.argsCount; i++){
+        Value value;
+        ExecStatus status = evalExpr(e, node->functionCall.args[i], &value);
+        if(status != EXEC_NORMAL) return status;
+        if(i > 0) fputc(' ', stream);
+        printValue(&value, stream);
+    }
+    fputc('\n', stream);
+    *out = voidValue();
+    return EXEC_NORMAL;
+}
+
+static ExecStatus bindParameters(Evaluator *e, EvalFunction *fn, EvalFrame *frame){
+    ExecStatus status;
+    for(int i = 0; i < fn->paramCount; i++){
+        Resolution *r = findResolution(e, fn->params[i]);
+        Value *slot = &frame->slots[i];
+        if(!r->inMemory){
+            if(r->type && (status = convertValue(e, *slot, r->type, slot)) != EXEC_NORMAL) return status;
+            continue;
+        }
+
+        size_t size = r->type ? r->type->size : sizeof(Value);
+        char *storage = NULL;
+        if((status = stackAllocate(e, size, &storage)) != EXEC_NORMAL) return status;
+
+        Place place = {NULL, r->type, storage, storage, storage + size};
+        Value argument = *slot;
+        *slot = makePointer(storage, storage, storage + size, r->type);
+        if((status = writePlace(e, &place, argument, NULL)) != EXEC_NORMAL) return status;
+    }
+    for(int i = fn->paramCount; i < fn->slotCount; i++){
+        frame->slots[i] = voidValue();
+    }
+    return EXEC_NORMAL;
+}
+
+static bool pointsInto(const Value *values, int count, const char *from, const char *to){
+    for(int i = 0; i < count; i++){
+        const char *address = values[i].kind == VALUE_POINTER ? values[i].as.pointer.address : values[i].kind == VALUE_AGGREGATE ? values[i].as.aggregate.address : NULL;
+        if(address && address >= from && address < to) return true;
+    }
+    return false;
+}
+
+// Runs fn with its arguments already at stack[base]. A call in tail
+// position comes back as EXEC_TAILCALL and runs in the same frame.
+static ExecStatus invoke(Evaluator *e, EvalFunction *fn, EvalFrame *env, int base, Value *out){
+    ExecStatus status;
+    MemoValue memoArgs[MEMO_MAX_ARGS];
+    EvalFunction *memoized = NULL;
+    if(fn->memoize){
+        for(int i = 0; i < fn->paramCount; i++){
+            Value *arg = &e->stack[base + i];
+            if((status = convertValue(e, *arg, findResolution(e, fn->params[i])->type, arg)) != EXEC_NORMAL) return status;
+            memoArgs[i].type = arg->type;
+            memoArgs[i].value = arg->as.primitive;
+        }
+
+        MemoValue cached;
+        if(memoLookup(&fn->memo, memoArgs, &cached)){
+            e->stats.memoHits++;
+            e->stackTop = base;
+            *out = makePrimitiveValue(cached.type, cached.value);
+            return EXEC_NORMAL;
+        }
+        e->stats.memoMisses++;
+        memoized = fn;
+    }
+    if(e->frameCount > e->options.maxCallDepth) return runtimeError(e, "maximum call depth of %d exceeded", e->options.maxCallDepth);
+
+    EvalFrame *caller = e->frame;
+    EvalFrame *frame = &e->frames[e->frameCount++];
+    frame->slots = &e->stack[base];
+    frame->memoryMark = e->memoryTop;
+    int pinned = e->pinned;
+    int tryDepth = e->tryDepth;
+    e->tryDepth = 0;
+    e->stats.calls++;
+
+    for(;;){
+        if(base + fn->slotCount > e->options.stackSlots){
+            status = runtimeError(e, "evaluator stack overflow calling %s", fn->name);
+            break;
+        }
+        frame->function = fn;
+        frame->env = env;
+        frame->serial = ++e->nextSerial;
+        e->frame = frame;
+        e->stackTop = base + fn->slotCount;
+
+        status = bindParameters(e, fn, frame);
+        if(status == EXEC_NORMAL) status = execList(e, fn->body, fn->bodyCount);
+        if(status != EXEC_TAILCALL) break;
+
+        EvalFunction *next = e->tailFunction;
+        memmove(frame->slots, &e->stack[e->tailArgs], next->paramCount * sizeof(Value));
+        if(!pointsInto(frame->slots, next->paramCount, frame->memoryMark, e->memoryTop)){
+            e->memoryTop = frame->memoryMark;
+            e->pinned = pinned;
+        }
+        fn = next;
+        env = e->tailEnv;
+        e->stats.tailCalls++;
+    }
+
+    Value result = voidValue();
+    if(status == EXEC_RETURN){
+        result = e->returnValue;
+        status = EXEC_NORMAL;
+    } else if(status == EXEC_BREAK || status == EXEC_CONTINUE){
+        status = EXEC_NORMAL;
+    } else if(status == EXEC_JUMP){
+        status = runtimeError(e, "label '%s' not found in %s", e->jumpLabel, fn->name);
+    }
+    if(status == EXEC_NORMAL && fn->returnType && result.kind != VALUE_VOID) status = convertValue(e, result, fn->returnType, &result);
+
+    frame->serial = 0;
+    e->frameCount--;
+    e->frame = caller;
+    e->stackTop = base;
+    e->pinned = pinned;
+    e->tryDepth = tryDepth;
+
+    // an aggregate result in the callee's memory moves down to where the frame began
+    char *top = frame->memoryMark;
+    if(status == EXEC_NORMAL && result.kind == VALUE_AGGREGATE && result.as.aggregate.address >= top && result.as.aggregate.address < e->memoryTop){
+        size_t size = result.as.aggregate.type->size;
+        memmove(top, result.as.aggregate.address, size);
+        result.as.aggregate.address = top;
+        top += alignUp(size ? size : 1, MEMORY_ALIGN);
+    }
+    e->memoryTop = top;
+
+    if(status == EXEC_NORMAL && memoized && result.kind == VALUE_PRIMITIVE){
+        memoStore(&memoized->memo, memoArgs, (MemoValue){result.type, result.as.primitive});
+    }
+    *out = result;
+    return status;
+}
+
+static ExecStatus evalCall(Evaluator *e, ASTNode *node, bool tail, Value *out){
+    ASTNode *callee = node->functionCall.function;
+    Resolution *r = callee->type == IDENTIFIER_NODE ? findResolution(e, callee) : NULL;
+    ExecStatus status;
+
+    int argCount = node->functionCall.argsCount;
+    EvalFunction *fn;
+    EvalFrame *env;
+    if(r && r->kind == RESOLVED_BUILTIN) return callBuiltin(e, r->constant, node, out);
+    if(r && r->kind == RESOLVED_FUNCTION){
+        fn = r->function;
+        env = functionEnv(e, fn);
+        if(argCount != fn->paramCount) return runtimeError(e, "%s expects %d arguments, got %d", fn->name, fn->paramCount, argCount);
+    } else{
+        Value function;
+        if((status = evalExpr(e, callee, &function)) != EXEC_NORMAL) return status;
+        if(function.kind != VALUE_FUNCTION) return runtimeError(e, "called object is not a function");
+        if(!function.as.function.function) return callBuiltin(e, (Builtin)function.as.function.serial, node, out);
+
+        fn = function.as.function.function;
+        env = function.as.function.env;
+        if(env && env->serial != function.as.function.serial) return runtimeError(e, "%s called after its enclosing function returned", fn->name);
+        if(argCount != fn->paramCount) return runtimeError(e, "%s expects %d arguments, got %d", fn->name, fn->paramCount, argCount);
+    }
+
+    int base = e->stackTop;
+    if(base + argCount > e->options.stackSlots) return runtimeError(e, "evaluator stack overflow calling %s", fn->name);
+    for(int i = 0; i < argCount; i++){
+        status = evalExpr(e, node->functionCall.args[i], &e->stack[base + i]);
+        if(status != EXEC_NORMAL){
+            e->stackTop = base;
+            return status;
+        }
+        e->stackTop = base + i + 1;
+    }
+
+    if(tail){
+        e->tailFunction = fn;
+        e->tailEnv = env;
+        e->tailArgs = base;
+        return EXEC_TAILCALL;
+    }
+    return invoke(e, fn, env, base, out);
+}
+
+// Calls marked as tail calls reuse the current frame, unless a try
+// block in this frame still has to see what the call throws.
+static ExecStatus evalTail(Evaluator *e, ASTNode *node, Value *out){
+    ExecStatus status;
+    Value value;
+    bool truth;
+    switch(node->type){
+        case FUNCTION_CALL_NODE:
+            if(node->functionCall.isTailCall && e->frame != e->frames && e->tryDepth == 0) return evalCall(e, node, true, out);
+            break;
+        case TERNARY_OPERATION_NODE:
+            if((status = evalExpr(e, node->ternaryOp.condition, &value)) != EXEC_NORMAL) return status;
+            if(!valueIsTruthy(e, value, &truth)) return EXEC_ERROR;
+            return evalTail(e, truth ? node->ternaryOp.trueExpr : node->ternaryOp.falseExpr, out);
+        case BINARY_OPERATION_NODE:
+            if(node->binaryOp.op != COMMA_BINOP) break;
+            if((status = evalExpr(e, node->binaryOp.left, &value)) != EXEC_NORMAL) return status;
+            return evalTail(e, node->binaryOp.right, out);
+        default:
+            break;
+    }
+    return evalExpr(e, node, out);
+}
+
+static ExecStatus evalSize(Evaluator *e, ASTNode *node, size_t *out){
+    Value value;
+    long long n;
+    ExecStatus status = evalExpr(e, node, &value);
+    if(status != EXEC_NORMAL) return status;
+    if(!valueToLongLong(value, &n) || n < 0) return runtimeError(e, "size is not a non-negative integer");
+    *out = (size_t)n;
+    return EXEC_NORMAL;
+}
+
+static ExecStatus evalPointer(Evaluator *e, ASTNode *node, Value *out){
+    ExecStatus status = evalExpr(e, node, out);
+    if(status != EXEC_NORMAL) return status;
+    if(out->kind == VALUE_PRIMITIVE && out->type == TYPE_STRING) return convertValue(e, *out, pointerTo(e, &e->voidType), out);
+    if(out->kind != VALUE_POINTER) return runtimeError(e, "expected a pointer");
+    return EXEC_NORMAL;
+}
+
+static ExecStatus allocate(Evaluator *e, AllocationKind placement, size_t count, size_t size, bool zeroed, Value *out){
+    char *storage = NULL;
+    bool overflows = size && count > SIZE_MAX / size;
+    size_t total = count * size;
+    if(placement == ALLOC_HEAP){
+        // like calloc, a size that overflows gets a null pointer
+        storage = overflows ? NULL : zeroed ? heapAllocateZeroed(count, size) : heapAllocate(total);
+        if(!storage){
+            *out = makePointer(NULL, NULL, NULL, &e->voidType);
+            return EXEC_NORMAL;
+        }
+    } else{
+        if(overflows) return runtimeError(e, "allocation size overflows");
+        ExecStatus status = stackAllocate(e, total, &storage);
+        if(status != EXEC_NORMAL) return status;
+        if(placement == ALLOC_STACK){
+            e->stats.stackAllocations++;
+            e->pinned++;
+        } else{
+            e->stats.regionAllocations++;
+        }
+    }
+    *out = makePointer(storage, storage, storage + total, &e->voidType);
+    return EXEC_NORMAL;
+}
+
+// free and realloc take NULL or the start of a block malloc returned: not a
+// pointer into one, and not stack, region or evaluator memory.
+static ExecStatus checkHeapBlock(Evaluator *e, const Value *pointer, const char *operation){
+    char *address = pointer->as.pointer.address;
+    if(!address) return EXEC_NORMAL;
+    if(pointer->as.pointer.base && address != pointer->as.pointer.base){
+        return runtimeError(e, "%s of a pointer %td bytes into an object", operation, address - pointer->as.pointer.base);
+    }
+    if(inEvaluatorMemory(e, address) || !heapOwns(address)) return runtimeError(e, "%s of memory not from malloc", operation);
+    return EXEC_NORMAL;
+}
+
+static ExecStatus evalMemory(Evaluator *e, ASTNode *node, Value *out){
+    Value dest, src, fill;
+    size_t size, count;
+    ExecStatus status;
+    Resolution *kernel = NULL;
+    if(node->type == MEMCPY_NODE || node->type == MEMMOVE_NODE || node->type == MEMSET_NODE){
+        kernel = findResolution(e, node);
+        if(kernel && kernel->kind != RESOLVED_KERNEL) kernel = NULL;
+    }
+    switch(node->type){
+        case MALLOC_NODE:
+            if((status = evalSize(e, node->mallocExpr.size, &size)) != EXEC_NORMAL) return status;
+            return allocate(e, node->mallocExpr.placement, 1, size, false, out);
+        case CALLOC_NODE:
+            if((status = evalSize(e, node->callocExpr.num, &count)) != EXEC_NORMAL) return status;
+            if((status = evalSize(e, node->callocExpr.size, &size)) != EXEC_NORMAL) return status;
+            return allocate(e, node->callocExpr.placement, count, size, true, out);
+        case REALLOC_NODE: {
+            if((status = evalPointer(e, node->reallocExpr.ptr, &dest)) != EXEC_NORMAL) return status;
+            if((status = evalSize(e, node->reallocExpr.size, &size)) != EXEC_NORMAL) return status;
+            if((status = checkHeapBlock(e, &dest, "realloc")) != EXEC_NORMAL) return status;
+
+            char *storage = heapReallocate(dest.as.pointer.address, size);
+            *out = storage ? makePointer(storage, storage, storage + size, dest.as.pointer.pointee) : makePointer(NULL, NULL, NULL, dest.as.pointer.pointee);
+            return EXEC_NORMAL;
+        }
+        case FREE_NODE:
+            if((status = evalPointer(e, node->freeExpr.ptr, &dest)) != EXEC_NORMAL) return status;
+            *out = voidValue();
+            if(node->freeExpr.elided){
+                e->stats.freesElided++;
+                return EXEC_NORMAL;
+            }
+            if((status = checkHeapBlock(e, &dest, "free")) != EXEC_NORMAL) return status;
+            heapFree(dest.as.pointer.address);
+            return EXEC_NORMAL;
+        case MEMCPY_NODE:
+        case MEMMOVE_NODE: {
+            ASTNode *destNode = node->type == MEMCPY_NODE ? node->memcpyExpr.dest : node->memmoveExpr.dest;
+            ASTNode *srcNode = node->type == MEMCPY_NODE ? node->memcpyExpr.src : node->memmoveExpr.src;
+            ASTNode *sizeNode = node->type == MEMCPY_NODE ? node->memcpyExpr.size : node->memmoveExpr.size;
+            if((status = evalPointer(e, destNode, &dest)) != EXEC_NORMAL) return status;
+            if((status = evalPointer(e, srcNode, &src)) != EXEC_NORMAL) return status;
+            if(kernel) size = (size_t)kernel->constant;
+            else if((status = evalSize(e, sizeNode, &size)) != EXEC_NORMAL) return status;
+            if(size == 0) break;
+            if((status = checkAccess(e, &dest, dest.as.pointer.address, size)) != EXEC_NORMAL) return status;
+            if((status = checkAccess(e, &src, src.as.pointer.address, size)) != EXEC_NORMAL) return status;
+            // memcpy gets memmove's semantics: overlap is not an error here
+            if(kernel) kernel->move(dest.as.pointer.address, src.as.pointer.address, size);
+            else moveMemory(dest.as.pointer.address, src.as.pointer.address, size);
+            break;
+        }
+        case MEMSET_NODE: {
+            long long byte;
+            if((status = evalPointer(e, node->memsetExpr.dest, &dest)) != EXEC_NORMAL) return status;
+            if((status = evalExpr(e, node->memsetExpr.value, &fill)) != EXEC_NORMAL) return status;
+            if(kernel) size = (size_t)kernel->constant;
+            else if((status = evalSize(e, node->memsetExpr.size, &size)) != EXEC_NORMAL) return status;
+            if(!valueToLongLong(fill, &byte)) return runtimeError(e, "memset value is not an integer");
+            if(size == 0) break;
+            if((status = checkAccess(e, &dest, dest.as.pointer.address, size)) != EXEC_NORMAL) return status;
+            if(kernel) kernel->fill(dest.as.pointer.address, (int)byte, size);
+            else fillMemory(dest.as.pointer.address, (int)byte, size);
+            break;
+        }
+        default:
+            return runtimeError(e, "unsupported memory operation");
+    }
+    *out = dest;
+    return EXEC_NORMAL;
+}
+
+static ExecStatus storeElements(Evaluator *e, ASTNode *list, const EvalType *elementType, char *storage, char *limit){
+    size_t size = elementSize(elementType);
+    for(int i = 0; i < list->array.elementsCount; i++){
+        char *address = storage + (size_t)i * size;
+        if(address + size > limit) return runtimeError(e, "too many initializers for an array of %zu elements", (size_t)(limit - storage) / size);
+
+        ASTNode *element = list->array.elements[i];
+        ExecStatus status;
+        if(element->type == ARRAY_NODE && elementType && elementType->kind == KIND_ARRAY){
+            status = storeElements(e, element, elementType->element, address, address + size);
+        } else{
+            Value value;
+            Place place = {NULL, elementType, address, storage, limit};
+            if((status = evalExpr(e, element, &value)) != EXEC_NORMAL) return status;
+            status = writePlace(e, &place, value, NULL);
+        }
+        if(status != EXEC_NORMAL) return status;
+    }
+    return EXEC_NORMAL;
+}
+
+static ExecStatus storeFields(Evaluator *e, ASTNode *list, const EvalType *type, char *storage){
+    int count = type->kind == KIND_UNION && list->array.elementsCount > 1 ? 1 : list->array.elementsCount;
+    if(count > type->fieldCount) return runtimeError(e, "too many initializers for %s", typeName(type));
+
+    for(int i = 0; i < count; i++){
+        const EvalField *field = &type->fields[i];
+        char *address = storage + field->offset;
+        ASTNode *element = list->array.elements[i];
+        ExecStatus status;
+        if(element->type == ARRAY_NODE && field->type->kind == KIND_ARRAY){
+            status = storeElements(e, element, field->type->element, address, address + field->type->size);
+        } else if(element->type == ARRAY_NODE && isAggregateType(field->type)){
+            status = storeFields(e, element, field->type, address);
+        } else{
+            Value value;
+            Place place = {NULL, field->type, address, address, address + field->type->size};
+            if((status = evalExpr(e, element, &value)) != EXEC_NORMAL) return status;
+            status = writePlace(e, &place, value, NULL);
+        }
+        if(status != EXEC_NORMAL) return status;
+    }
+    return EXEC_NORMAL;
+}
+
+static ExecStatus evalArrayLiteral(Evaluator *e, ASTNode *node, Value *out){
+    const EvalType *elementType = findResolution(e, node)->type;
+    size_t size = (size_t)node->array.elementsCount * elementSize(elementType);
+    char *storage = NULL;
+    ExecStatus status = stackAllocate(e, size, &storage);
+    if(status != EXEC_NORMAL) return status;
+    if((status = storeElements(e, node, elementType, storage, storage + size)) != EXEC_NORMAL) return status;
+
+    *out = makePointer(storage, storage, storage + size, elementType);
+    return EXEC_NORMAL;
+}
+
+static ExecStatus evalCompound(Evaluator *e, ASTNode *node, Value *out){
+    ASTNode **statements = node->compoundExpr.statements;
+    int count = node->compoundExpr.stmtCount;
+    *out = voidValue();
+    for(int i = 0; i < count; i++){
+        ASTNode *stmt = statements[i];
+        ExecStatus status = i == count - 1 && stmt->type != DECLARATION_NODE ? evalExpr(e, stmt, out) : execStmt(e, stmt);
+        if(status == EXEC_NORMAL) continue;
+        if(status != EXEC_JUMP) return status;
+
+        // jumps to the compound's own labels stay inside it, as in execList
+        int target = findLabel(statements, count, e->jumpLabel);
+        if(target < 0) return status;
+        i = target;
+    }
+    return EXEC_NORMAL;
+}
+
+static ExecStatus evalIdentifier(Evaluator *e, ASTNode *node, Value *out){
+    Resolution *r = findResolution(e, node);
+    if(!r) return runtimeError(e, "unknown identifier '%s'", node->identifier.name);
+
+    Place place;
+    ExecStatus status;
+    PrimitiveValue constant = {0};
+    switch(r->kind){
+        case RESOLVED_LOCAL:
+        case RESOLVED_GLOBAL:
+            if(!r->inMemory){
+                *out = r->kind == RESOLVED_GLOBAL ? e->globals[r->index] : frameAtDepth(e, r->depth)->slots[r->index];
+                return EXEC_NORMAL;
+            }
+            if((status = variablePlace(e, node, r, &place)) != EXEC_NORMAL) return status;
+            return readPlace(e, &place, out);
+        case RESOLVED_FUNCTION: {
+            EvalFrame *env = functionEnv(e, r->function);
+            *out = makeFunction(r->function, env, env ? env->serial : 0);
+            return EXEC_NORMAL;
+        }
+        case RESOLVED_ENUM:
+            constant.intVal = r->constant;
+            *out = makePrimitiveValue(TYPE_INT, constant);
+            return EXEC_NORMAL;
+        case RESOLVED_BUILTIN:
+            *out = makeFunction(NULL, NULL, (unsigned long)r->constant);
+            return EXEC_NORMAL;
+        default:
+            return runtimeError(e, "unknown identifier '%s'", node->identifier.name);
+    }
+}
+
+static ExecStatus evalExpr(Evaluator *e, ASTNode *node, Value *out){
+    ExecStatus status;
+    Value value;
+    bool truth;
+    switch(node->type){
+        case LITERAL_NODE:
+            *out = makePrimitiveValue(node->literal.type, node->literal.value);
+            return EXEC_NORMAL;
+        case IDENTIFIER_NODE:
+            return evalIdentifier(e, node, out);
+        case BINARY_OPERATION_NODE:
+            return evalBinary(e, node, out);
+        case UNARY_OPERATION_NODE:
+            return evalUnary(e, node, out);
+        case ASSIGNMENT_NODE:
+            return evalAssignment(e, node, out);
+        case FUNCTION_CALL_NODE:
+            return evalCall(e, node, false, out);
+        case ARRAY_ACCESS_NODE:
+        case FIELD_ACCESS_NODE: {
+            Place place;
+            if((status = evalPlace(e, node, &place)) != EXEC_NORMAL) return status;
+            return readPlace(e, &place, out);
+        }
+        case TERNARY_OPERATION_NODE:
+            if((status = evalExpr(e, node->ternaryOp.condition, &value)) != EXEC_NORMAL) return status;
+            if(!valueIsTruthy(e, value, &truth)) return EXEC_ERROR;
+            return evalExpr(e, truth ? node->ternaryOp.trueExpr : node->ternaryOp.falseExpr, out);
+        case CAST_EXPR_NODE:
+            if((status = evalExpr(e, node->castExpr.value, &value)) != EXEC_NORMAL) return status;
+            return convertValue(e, value, findResolution(e, node)->type, out);
+        case NULL_NODE: {
+            const EvalType *type = findResolution(e, node)->type;
+            *out = makePointer(NULL, NULL, NULL, type && type->kind == KIND_POINTER ? type->element : type ? type : &e->voidType);
+            return EXEC_NORMAL;
+        }
+        case MALLOC_NODE:
+        case CALLOC_NODE:
+        case REALLOC_NODE:
+        case FREE_NODE:
+        case MEMCPY_NODE:
+        case MEMSET_NODE:
+        case MEMMOVE_NODE:
+            return evalMemory(e, node, out);
+        case SIZEOF_NODE:
+            return evalSizeOf(e, node, node->sizeOfExpr.expr, out);
+        case TYPEOF_NODE: {
+            if((status = evalExpr(e, node->typeOfExpr.expr, &value)) != EXEC_NORMAL) return status;
+            PrimitiveValue name = {0};
+            name.stringVal = (char *)(value.kind == VALUE_PRIMITIVE ? primitiveTypeName(value.type) : "any");
+            *out = makePrimitiveValue(TYPE_STRING, name);
+            return EXEC_NORMAL;
+        }
+        case ARRAY_NODE:
+            return evalArrayLiteral(e, node, out);
+        case COMPOUND_EXPR_NODE:
+            return evalCompound(e, node, out);
+        case FUNCTION_NODE:
+        case LAMBDA_NODE: {
+            EvalFunction *fn = findResolution(e, node)->function;
+            EvalFrame *env = functionEnv(e, fn);
+            *out = makeFunction(fn, env, env ? env->serial : 0);
+            return EXEC_NORMAL;
+        }
+        default:
+            *out = voidValue();
+            return execStmt(e, node);
+    }
+}
+
+// Statements
+
+static ExecStatus initializeVariable(Evaluator *e, const Resolution *r, Value *slot, ASTNode *init, bool permanent){
+    const EvalType *type = r->type;
+    ExecStatus status;
+    Value value;
+    if(!r->inMemory){
+        if(!init){
+            *slot = zeroValue(type);
+            return EXEC_NORMAL;
+        }
+        if((status = evalExpr(e, init, &value)) != EXEC_NORMAL) return status;
+        return convertValue(e, value, type, slot);
+    }
+
+    bool isString = init && init->type == LITERAL_NODE && init->literal.type == TYPE_STRING;
+    size_t size = type ? type->size : sizeof(Value);
+    if(type && type->kind == KIND_ARRAY && type->length < 0){
+        long long length = 0;
+        if(type->lengthExpr){
+            if((status = evalExpr(e, type->lengthExpr, &value)) != EXEC_NORMAL) return status;
+            if(!valueToLongLong(value, &length) || length < 0) return runtimeError(e, "array size is not a non-negative integer");
+        } else if(init && init->type == ARRAY_NODE){
+            length = init->array.elementsCount;
+        } else if(isString){
+            length = (long long)strlen(init->literal.value.stringVal) + 1;
+        }
+        size = (size_t)length * type->element->size;
+    }
+
+    char *storage = NULL;
+    if(permanent){
+        if(!(storage = permanentAllocate(e, size))) return runtimeError(e, "out of memory allocating %zu bytes", size);
+    } else if((status = stackAllocate(e, size, &storage)) != EXEC_NORMAL) return status;
+    *slot = makePointer(storage, storage, storage + size, type);
+    if(!init) return EXEC_NORMAL;
+
+    if(type && type->kind == KIND_ARRAY){
+        if(init->type == ARRAY_NODE) return storeElements(e, init, type->element, storage, storage + size);
+        if(isString && type->element->kind == KIND_PRIMITIVE && type->element->size == 1){
+            size_t length = strlen(init->literal.value.stringVal) + 1;
+            memcpy(storage, init->literal.value.stringVal, length < size ? length : size);
+            return EXEC_NORMAL;
+        }
+        return runtimeError(e, "invalid array initializer");
+    }
+    if(isAggregateType(type) && init->type == ARRAY_NODE) return storeFields(e, init, type, storage);
+
+    Place place = {NULL, type, storage, storage, storage + size};
+    if((status = evalExpr(e, init, &value)) != EXEC_NORMAL) return status;
+    return writePlace(e, &place, value, NULL);
+}
+
+static ExecStatus execDeclaration(Evaluator *e, ASTNode *node, ASTNode *init){
+    Resolution *r = findResolution(e, node);
+    if(r->kind == RESOLVED_GLOBAL){
+        GlobalInfo *info = &e->globalInfo[r->index];
+        if(info->isStatic && info->initialized) return EXEC_NORMAL;
+        info->initialized = true;
+        return initializeVariable(e, r, &e->globals[r->index], init, true);
+    }
+    return initializeVariable(e, r, &e->frame->slots[r->index], init, false);
+}
+
+static int findLabel(ASTNode **statements, int count, const char *name){
+    for(int i = 0; i < count; i++){
+        if(statements[i] && statements[i]->type == LABEL_NODE && strcmp(statements[i]->labelStmt.labelName, name) == 0) return i;
+    }
+    return -1;
+}
+
+static ExecStatus execList(Evaluator *e, ASTNode **statements, int count){
+    for(int i = 0; i < count; i++){
+        ExecStatus status = execStmt(e, statements[i]);
+        if(status == EXEC_NORMAL) continue;
+        if(status != EXEC_JUMP) return status;
+
+        int target = findLabel(statements, count, e->jumpLabel);
+        if(target < 0) return status;
+        i = target;
+    }
+    return EXEC_NORMAL;
+}
+
+static ExecStatus evalCondition(Evaluator *e, ASTNode *condition, bool *out){
+    Value value;
+    if(!condition){
+        *out = true;
+        return EXEC_NORMAL;
+    }
+    ExecStatus status = evalExpr(e, condition, &value);
+    if(status != EXEC_NORMAL) return status;
+    return valueIsTruthy(e, value, out) ? EXEC_NORMAL : EXEC_ERROR;
+}
+
+// Memory taken during an iteration is given back before the next one,
+// unless a stack placed allocation has to live until the function returns.
+static void releaseIteration(Evaluator *e, char *mark, int pinned){
+    if(e->pinned == pinned) e->memoryTop = mark;
+}
+
+static ExecStatus execLoop(Evaluator *e, ASTNode *condition, ASTNode *increment, ASTNode **body, int bodyCount, bool testFirst){
+    char *mark = e->memoryTop;
+    int pinned = e->pinned;
+    ExecStatus status;
+    bool truth;
+    Value ignored;
+    for(;;){
+        if(testFirst){
+            if((status = evalCondition(e, condition, &truth)) != EXEC_NORMAL) return status;
+            if(!truth) break;
+        }
+        status = execList(e, body, bodyCount);
+        if(status == EXEC_BREAK) break;
+        if(status != EXEC_NORMAL && status != EXEC_CONTINUE) return status;
+        releaseIteration(e, mark, pinned);
+
+        if(increment && (status = evalExpr(e, increment, &ignored)) != EXEC_NORMAL) return status;
+        if(!testFirst){
+            if((status = evalCondition(e, condition, &truth)) != EXEC_NORMAL) return status;
+            if(!truth) break;
+        }
+    }
+    releaseIteration(e, mark, pinned);
+    return EXEC_NORMAL;
+}
+
+static ExecStatus execSwitch(Evaluator *e, ASTNode *node){
+    Value value, caseValue, equal;
+    ExecStatus status;
+    if((status = evalExpr(e, node->switchStmt.expr, &value)) != EXEC_NORMAL) return status;
+
+    int start = -1;
+    for(int i = 0; i < node->switchStmt.caseCount && start < 0; i++){
+        ASTNode *caseNode = node->switchStmt.cases[i];
+        if(caseNode->type != CASE_NODE) continue;
+
+        bool truth;
+        if((status = evalExpr(e, caseNode->caseStmt.value, &caseValue)) != EXEC_NORMAL) return status;
+        if((status = binaryValues(e, EQU_BINOP, value, caseValue, &equal)) != EXEC_NORMAL) return status;
+        if(!valueIsTruthy(e, equal, &truth)) return EXEC_ERROR;
+        if(truth) start = i;
+    }
+    for(int i = 0; i < node->switchStmt.caseCount && start < 0; i++){
+        if(node->switchStmt.cases[i]->type == DEFAULT_NODE) start = i;
+    }
+    if(start < 0) return EXEC_NORMAL;
+
+    // bodies run in order from the matching case so that a missing break falls through
+    for(int i = start; i < node->switchStmt.caseCount; i++){
+        ASTNode *caseNode = node->switchStmt.cases[i];
+        if(caseNode->type == CASE_NODE) status = execList(e, caseNode->caseStmt.body, caseNode->caseStmt.bodyCount);
+        else if(caseNode->type == DEFAULT_NODE) status = execList(e, caseNode->defaultStmt.body, caseNode->defaultStmt.bodyCount);
+        if(status == EXEC_BREAK) return EXEC_NORMAL;
+        if(status != EXEC_NORMAL) return status;
+    }
+    return EXEC_NORMAL;
+}
+
+static bool catchMatches(Evaluator *e, const Resolution *r, const Value *exception){
+    (void)e;
+    if(!r || !r->type) return true;
+    if(r->type->kind == KIND_PRIMITIVE) return exception->kind == VALUE_PRIMITIVE && exception->type == r->type->primitive;
+    if(r->type->kind == KIND_POINTER) return exception->kind == VALUE_POINTER;
+    return exception->kind == VALUE_AGGREGATE && exception->as.aggregate.type == r->type;
+}
+
+static ExecStatus execTry(Evaluator *e, ASTNode *node){
+    e->tryDepth++;
+    ExecStatus status = execList(e, node->tryStmt.tryBlock, node->tryStmt.tryBlockCount);
+    e->tryDepth--;
+    if(status != EXEC_THROW) return status;
+
+    Value exception = e->exception;
+    for(int i = 0; i < node->tryStmt.catchCount; i++){
+        ASTNode *catchNode = node->tryStmt.catchBlock[i];
+        if(catchNode->type != CATCH_NODE) continue;
+
+        ASTNode *var = catchNode->catchStmt.exceptionVar;
+        Resolution *r = var ? findResolution(e, var) : NULL;
+        if(!catchMatches(e, r, &exception)) continue;
+
+        if(r){
+            Value *slot = r->kind == RESOLVED_GLOBAL ? &e->globals[r->index] : &e->frame->slots[r->index];
+            if((status = initializeVariable(e, r, slot, NULL, r->kind == RESOLVED_GLOBAL)) != EXEC_NORMAL) return status;
+
+            Place place;
+            if(r->inMemory) place = (Place){NULL, r->type, slot->as.pointer.address, slot->as.pointer.base, slot->as.pointer.limit};
+            else place = (Place){slot, r->type, NULL, NULL, NULL};
+            if((status = writePlace(e, &place, exception, NULL)) != EXEC_NORMAL) return status;
+        }
+        return execList(e, catchNode->catchStmt.body, catchNode->catchStmt.bodyCount);
+    }
+    e->exception = exception;
+    return EXEC_THROW;
+}
+
+static ExecStatus execStmt(Evaluator *e, ASTNode *node){
+    ExecStatus status;
+    Value value;
+    bool truth;
+    if(!node) return EXEC_NORMAL;
+
+    switch(node->type){
+        case DECLARATION_NODE:
+            return execDeclaration(e, node, node->declaration.initializer);
+        case BLOCK_NODE:
+            return execList(e, node->block.statements, node->block.stmtCount);
+        case IF_NODE:
+            if((status = evalCondition(e, node->ifStmt.condition, &truth)) != EXEC_NORMAL) return status;
+            return execStmt(e, truth ? node->ifStmt.thenBranch : node->ifStmt.elseBranch);
+        case WHILE_NODE:
+            return execLoop(e, node->whileStmt.condition, NULL, node->whileStmt.body, node->whileStmt.bodyCount, true);
+        case DO_WHILE_NODE:
+            return execLoop(e, node->doWhileStmt.condition, NULL, node->doWhileStmt.body, node->doWhileStmt.bodyCount, false);
+        case FOR_NODE:
+            if((status = execStmt(e, node->forStmt.initializer)) != EXEC_NORMAL) return status;
+            return execLoop(e, node->forStmt.condition, node->forStmt.increment, node->forStmt.body, node->forStmt.bodyCount, true);
+        case SWITCH_NODE:
+            return execSwitch(e, node);
+        case TRY_NODE:
+            return execTry(e, node);
+        case THROW_NODE:
+            if((status = evalExpr(e, node->throwStmt.exceptionExpr, &e->exception)) != EXEC_NORMAL) return status;
+            return EXEC_THROW;
+        case RETURN_NODE:
+            e->returnValue = voidValue();
+            if(node->returnStmt.value && (status = evalTail(e, node->returnStmt.value, &e->returnValue)) != EXEC_NORMAL) return status;
+            return EXEC_RETURN;
+        case BREAK_NODE:
+            return EXEC_BREAK;
+        case CONTINUE_NODE:
+            return EXEC_CONTINUE;
+        case JUMP_NODE:
+            e->jumpLabel = node->jumpStmt.labelName;
+            return EXEC_JUMP;
+        case LABEL_NODE:
+        case FUNCTION_NODE:
+        case STRUCT_NODE:
+        case UNION_NODE:
+        case ENUM_NODE:
+        case TYPEDEF_NODE:
+        case IMPL_NODE:
+        case INCLUDE_NODE:
+        case CASE_NODE:
+        case DEFAULT_NODE:
+        case CATCH_NODE:
+            return EXEC_NORMAL;
+        default:
+            return evalExpr(e, node, &value);
+    }
+}
+
+// Public interface
+
+EvalOptions defaultEvalOptions(void){
+    EvalOptions options;
+    options.stackSlots = 1 << 16;
+    options.memorySize = (size_t)8 << 20;
+    options.maxCallDepth = 2000;
+    options.memoize = true;
+    options.memoCapacity = 1024;
+    options.out = NULL;
+    return options;
+}
+
+// False when resolution runs out of memory.
+static bool resolveTop(Evaluator *e){
+    jmp_buf failed;
+    if(setjmp(failed)) return false;
+    e->outOfMemory = &failed;
+    resolveProgram(e, e->top->body, e->top->bodyCount);
+    e->outOfMemory = NULL;
+    return true;
+}
+
+Evaluator *createEvaluator(ASTNode *program, const EvalOptions *options){
+    Evaluator *e = calloc(1, sizeof(Evaluator));
+    if(!e) return NULL;
+
+    e->options = options ? *options : defaultEvalOptions();
+    if(e->options.stackSlots <= 0 || e->options.maxCallDepth <= 0 || e->options.memorySize == 0){
+        free(e);
+        return NULL;
+    }
+    e->program = program;
+
+    int capacity = 64;
+    while(capacity < 2 * countASTNodes(program) + 16) capacity *= 2;
+    e->resolutionCapacity = capacity;
+    e->resolutions = calloc(capacity, sizeof(Resolution));
+
+    for(int i = 0; i < PRIMITIVE_TYPE_COUNT; i++){
+        EvalType *type = &e->primitiveTypes[i];
+        type->kind = KIND_PRIMITIVE;
+        type->primitive = (PrimitiveType)i;
+        type->length = -1;
+        type->size = type->align = primitiveSize((PrimitiveType)i);
+        type->name = primitiveTypeName((PrimitiveType)i);
+        type->complete = true;
+    }
+    e->voidType.kind = KIND_VOID;
+    e->voidType.length = -1;
+    e->voidType.align = 1;
+    e->voidType.complete = true;
+
+    e->top = calloc(1, sizeof(EvalFunction));
+    e->stack = malloc(e->options.stackSlots * sizeof(Value));
+    e->frames = calloc(e->options.maxCallDepth + 1, sizeof(EvalFrame));
+    e->memory = malloc(e->options.memorySize);
+    if(!e->resolutions || !e->top || !e->stack || !e->frames || !e->memory){
+        freeEvaluator(e);
+        return NULL;
+    }
+    e->memoryTop = e->memory;
+    e->memoryLimit = e->memory + e->options.memorySize;
+
+    e->top->name = "top level";
+    if(program && program->type == BLOCK_NODE){
+        e->top->body = program->block.statements;
+        e->top->bodyCount = program->block.stmtCount;
+    } else if(program){
+        e->top->body = &e->program;
+        e->top->bodyCount = 1;
+    }
+    if(!resolveTop(e)){
+        freeEvaluator(e);
+        return NULL;
+    }
+
+    e->globals = calloc(e->globalCount ? e->globalCount : 1, sizeof(Value));
+    if(!e->globals){
+        freeEvaluator(e);
+        return NULL;
+    }
+    return e;
+}
+
+void freeEvaluator(Evaluator *e){
+    if(!e) return;
+
+    for(int i = 0; i < e->typeCount; i++){
+        free(e->types[i]->fields);
+        free(e->types[i]);
+    }
+    free(e->types);
+    free(e->namedTypes);
+    for(int i = 0; i < e->functionCount; i++){
+        if(e->functions[i]->memoize) freeMemoCache(&e->functions[i]->memo);
+        free(e->functions[i]);
+    }
+    free(e->functions);
+    for(int i = 0; i < e->permanentCount; i++){
+        free(e->permanent[i]);
+    }
+    free(e->permanent);
+    free(e->globalInfo);
+    free(e->globals);
+    free(e->top);
+    free(e->stack);
+    free(e->frames);
+    free(e->memory);
+    free(e->resolutions);
+    for(int i = 0; i < e->cacheCount; i++){
+        free(e->caches[i]);
+    }
+    free(e->caches);
+    free(e);
+}
+
+static void enterTopFrame(Evaluator *e){
+    e->error[0] = '\0';
+    e->frameCount = 1;
+    e->frame = &e->frames[0];
+    e->frame->function = e->top;
+    e->frame->slots = e->stack;
+    e->frame->env = NULL;
+    e->frame->serial = ++e->nextSerial;
+    e->frame->memoryMark = e->memory;
+    e->stackTop = e->top->slotCount;
+    e->memoryTop = e->memory;
+    e->pinned = 0;
+    e->tryDepth = 0;
+    for(int i = 0; i < e->top->slotCount; i++){
+        e->stack[i] = voidValue();
+    }
+}
+
+static ExecStatus finishRun(Evaluator *e, ExecStatus status){
+    if(status == EXEC_THROW){
+        char type[64];
+        snprintf(type, sizeof(type), "%s", e->exception.kind == VALUE_PRIMITIVE ? primitiveTypeName(e->exception.type) : e->exception.kind == VALUE_AGGREGATE ? typeName(e->exception.as.aggregate.type) : "pointer");
+        status = runtimeError(e, "uncaught exception of type %s", type);
+    } else if(status == EXEC_JUMP){
+        status = runtimeError(e, "label '%s' not found", e->jumpLabel);
+    }
+    e->frameCount = 0;
+    e->frame = NULL;
+    e->outOfMemory = NULL;
+    return status;
+}
+
+static EvalFunction *findFunction(Evaluator *e, const char *name){
+    for(int i = 0; i < e->functionCount; i++){
+        EvalFunction *fn = e->functions[i];
+        if(fn->level == 1 && fn->definition->type == FUNCTION_NODE && strcmp(fn->name, name) == 0) return fn;
+    }
+    return NULL;
+}
+
+// Only declarations at the top level means the program starts at main.
+static bool hasTopLevelCode(Evaluator *e){
+    for(int i = 0; i < e->top->bodyCount; i++){
+        ASTNode *item = e->top->body[i];
+        if(!item) continue;
+
+        switch(item->type){
+            case FUNCTION_NODE:
+            case DECLARATION_NODE:
+            case STRUCT_NODE:
+            case UNION_NODE:
+            case ENUM_NODE:
+            case TYPEDEF_NODE:
+            case IMPL_NODE:
+            case INCLUDE_NODE:
+                break;
+            default:
+                return true;
+        }
+    }
+    return false;
+}
+
+bool runProgram(Evaluator *e, Value *result){
+    for(int i = 0; i < e->permanentCount; i++){
+        free(e->permanent[i]);
+    }
+    e->permanentCount = 0;
+    for(int i = 0; i < e->globalCount; i++){
+        e->globalInfo[i].initialized = false;
+        e->globals[i] = voidValue();
+    }
+    memset(&e->stats, 0, sizeof(e->stats));
+
+    jmp_buf failed;
+    if(setjmp(failed)){
+        finishRun(e, runtimeError(e, "out of memory"));
+        return false;
+    }
+    e->outOfMemory = &failed;
+    enterTopFrame(e);
+    Value value = voidValue();
+    ExecStatus status = execList(e, e->top->body, e->top->bodyCount);
+    if(status == EXEC_RETURN){
+        value = e->returnValue;
+        status = EXEC_NORMAL;
+    } else if(status == EXEC_NORMAL){
+        EvalFunction *main = findFunction(e, "main");
+        if(main && main->paramCount == 0 && !hasTopLevelCode(e)) status = invoke(e, main, NULL, e->stackTop, &value);
+    } else if(status == EXEC_BREAK || status == EXEC_CONTINUE){
+        status = EXEC_NORMAL;
+    }
+
+    if(finishRun(e, status) != EXEC_NORMAL) return false;
+    if(result) *result = value;
+    return true;
+}
+
+// Globals keep the values left by the last runProgram.
+bool callFunction(Evaluator *e, const char *name, const Value *args, int argCount, Value *result){
+    EvalFunction *fn = findFunction(e, name);
+    if(!fn){
+        runtimeError(e, "no function named '%s'", name);
+        return false;
+    }
+    if(argCount != fn->paramCount){
+        runtimeError(e, "%s expects %d arguments, got %d", name, fn->paramCount, argCount);
+        return false;
+    }
+
+    enterTopFrame(e);
+    if(e->stackTop + argCount > e->options.stackSlots){
+        runtimeError(e, "evaluator stack overflow calling %s", name);
+        return false;
+    }
+    if(argCount > 0) memcpy(&e->stack[e->stackTop], args, argCount * sizeof(Value));
+
+    jmp_buf failed;
+    if(setjmp(failed)){
+        finishRun(e, runtimeError(e, "out of memory"));
+        return false;
+    }
+    e->outOfMemory = &failed;
+    Value value;
+    ExecStatus status = invoke(e, fn, NULL, e->stackTop, &value);
+    if(finishRun(e, status) != EXEC_NORMAL) return false;
+    if(result) *result = value;
+    return true;
+}
+
+const char *evalError(Evaluator *e){
+    return e->error[0] ? e->error : NULL;
+}
+
+const EvalStats *evalStats(Evaluator *e){
+    return &e->stats;
+}
+
+void printEvalStats(Evaluator *e, FILE *out){
+    EvalStats *stats = &e->stats;
+    fprintf(out, "%lld calls, %lld tail calls\n", stats->calls, stats->tailCalls);
+    fprintf(out, "%lld bounds checks, %lld elided\n", stats->boundsChecks, stats->boundsChecksElided);
+    fprintf(out, "%lld memo hits, %lld memo misses\n", stats->memoHits, stats->memoMisses);
+    fprintf(out, "%lld stack allocations, %lld region allocations, %lld frees elided\n", stats->stackAllocations, stats->regionAllocations, stats->freesElided);
+    fprintf(out, "%lld field cache hits, %lld misses\n", stats->fieldCacheHits, stats->fieldCacheMisses);
+
+    int sites[CACHE_MEGAMORPHIC + 1] = {0};
+    for(int i = 0; i < e->cacheCount; i++){
+        sites[e->caches[i]->state]++;
+    }
+    fprintf(out, "field sites: %d unused, %d monomorphic, %d polymorphic, %d megamorphic\n",
+            sites[CACHE_EMPTY], sites[CACHE_MONOMORPHIC], sites[CACHE_POLYMORPHIC], sites[CACHE_MEGAMORPHIC]);
+}
+
+void printValue(const Value *value, FILE *out){
+    PrimitiveValue v = value->as.primitive;
+    switch(value->kind){
+        case VALUE_VOID:
+            fputs("void", out);
+            return;
+        case VALUE_POINTER:
+            if(value->as.pointer.address) fprintf(out, "%p", (void *)value->as.pointer.address);
+            else fputs("null", out);
+            return;
+        case VALUE_AGGREGATE:
+            fprintf(out, "<%s>", typeName(value->as.aggregate.type));
+            return;
+        case VALUE_FUNCTION:
+            fprintf(out, "<function %s>", value->as.function.function ? value->as.function.function->name : "print");
+            return;
+        case VALUE_PRIMITIVE:
+            break;
+    }
+
+    switch(value->type){
+        case TYPE_BOOL: fputs(v.boolVal ? "true" : "false", out); return;
+        case TYPE_CHAR:
+        case TYPE_SIGNED_CHAR:
+        case TYPE_UNSIGNED_CHAR: fputc(v.charVal, out); return;
+        case TYPE_STRING: fputs(v.stringVal ? v.stringVal : "null", out); return;
+        case TYPE_FLOAT: fprintf(out, "%g", v.floatVal); return;
+        case TYPE_DOUBLE: fprintf(out, "%g", v.doubleVal); return;
+        case TYPE_LONG_DOUBLE: fprintf(out, "%Lg", v.longDoubleVal); return;
+        default: break;
+    }
+    long long n;
+    if(isSignedType(value->type) && primitiveToLongLong(value->type, v, &n)) fprintf(out, "%lld", n);
+    else fprintf(out, "%llu", convertPrimitive(value->type, v, TYPE_ULONG_LONG).uLongLongVal);
+}
@@ -0,0 +1,82 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+#include "ast.h"
+#include <stdio.h>
+
+typedef struct EvalType EvalType;
+typedef struct EvalFunction EvalFunction;
+typedef struct EvalFrame EvalFrame;
+
+typedef enum {
+    VALUE_VOID,
+    VALUE_PRIMITIVE,
+    VALUE_POINTER,
+    VALUE_AGGREGATE,        // refers to struct or union storage, copied when stored
+    VALUE_FUNCTION
+} ValueKind;
+
+typedef struct {
+    ValueKind kind;
+    PrimitiveType type;
+    union {
+        PrimitiveValue primitive;
+        struct {
+            char *address;
+            char *base;             // bounds of the object pointed into, NULL when unknown
+            char *limit;
+            const EvalType *pointee;
+        } pointer;
+        struct {
+            char *address;
+            const EvalType *type;
+        } aggregate;
+        struct {
+            EvalFunction *function; // NULL for builtins
+            EvalFrame *env;         // frame the function was created in
+            unsigned long serial;   // activation of env, or the builtin
+        } function;
+    } as;
+} Value;
+
+typedef struct {
+    int stackSlots;             // values shared by the frames of all active calls
+    size_t memorySize;          // bytes for arrays, structs and demoted allocations
+    int maxCallDepth;
+    bool memoize;               // cache results of functions marked memoizable
+    int memoCapacity;
+    FILE *out;                  // where print writes
+} EvalOptions;
+
+typedef struct {
+    long long calls;
+    long long tailCalls;        // calls that reused the caller's frame
+    long long boundsChecks;
+    long long boundsChecksElided;
+    long long memoHits;
+    long long memoMisses;
+    long long stackAllocations;
+    long long regionAllocations;
+    long long freesElided;
+    long long fieldCacheHits;
+    long long fieldCacheMisses;     // fields looked up by name
+} EvalStats;
+
+typedef struct Evaluator Evaluator;
+
+// The program must not change while an evaluator for it exists.
+EvalOptions defaultEvalOptions(void);
+Evaluator *createEvaluator(ASTNode *program, const EvalOptions *options);
+void freeEvaluator(Evaluator *e);
+
+bool runProgram(Evaluator *e, Value *result);
+bool callFunction(Evaluator *e, const char *name, const Value *args, int argCount, Value *result);
+
+const char *evalError(Evaluator *e);
+const EvalStats *evalStats(Evaluator *e);
+void printEvalStats(Evaluator *e, FILE *out);
+
+Value makePrimitiveValue(PrimitiveType type, PrimitiveValue value);
+void printValue(const Value *value, FILE *out);
+
+#endif
@@ -0,0 +1,370 @@
+#include "fold.h"
+#include "primitive.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    TypeScope scope;
+    FoldStats *stats;
+} Folder;
+
+static void foldSlot(ASTNode **slot, void *ctx);
+
+static int discardNode(ASTNode *node){
+    int count = countASTNodes(node);
+    freeAST(node);
+    return count;
+}
+
+static bool isLiteral(ASTNode *node){
+    return node && node->type == LITERAL_NODE && node->literal.type != TYPE_STRING;
+}
+
+static bool isLiteralValue(ASTNode *node, long long n){
+    return isLiteral(node) && primitiveEquals(node->literal.type, node->literal.value, n);
+}
+
+static bool isBoolLiteral(ASTNode *node, bool value){
+    return isLiteral(node) && primitiveIsTruthy(node->literal.type, node->literal.value) == value;
+}
+
+static bool sameVariable(ASTNode *a, ASTNode *b){
+    return a->type == IDENTIFIER_NODE && b->type == IDENTIFIER_NODE && strcmp(a->identifier.name, b->identifier.name) == 0;
+}
+
+static void replaceWithLiteral(Folder *folder, ASTNode **slot, PrimitiveType type, PrimitiveValue value){
+    ASTNode *literal = createLiteralNode(type, value);
+    if(!literal) return;
+
+    folder->stats->nodesEliminated += discardNode(*slot) - 1;
+    *slot = literal;
+}
+
+// keep is a child of *slot; the caller must have cleared its pointer in
+// *slot so that discarding the rest of the tree doesn't free it.
+static void replaceWithChild(Folder *folder, ASTNode **slot, ASTNode *keep){
+    folder->stats->nodesEliminated += discardNode(*slot);
+    *slot = keep;
+}
+
+static void stripDoubleNot(Folder *folder, ASTNode **slot){
+    ASTNode *node = *slot;
+    while(node && node->type == UNARY_OPERATION_NODE && node->unaryOp.op == NOT_UNOP
+        && node->unaryOp.expr->type == UNARY_OPERATION_NODE && node->unaryOp.expr->unaryOp.op == NOT_UNOP){
+        ASTNode *inner = node->unaryOp.expr;
+        ASTNode *keep = inner->unaryOp.expr;
+        inner->unaryOp.expr = NULL;
+        replaceWithChild(folder, slot, keep);
+        folder->stats->identitiesApplied++;
+        node = *slot;
+    }
+}
+
+static bool isBoolValued(Folder *folder, ASTNode *expr){
+    PrimitiveType type;
+    return isBooleanExpression(expr) || (inferExpressionType(expr, &folder->scope, &type) && type == TYPE_BOOL);
+}
+
+static void foldUnary(Folder *folder, ASTNode **slot){
+    ASTNode *node = *slot;
+    ASTNode *operand = node->unaryOp.expr;
+    UnaryOpType op = node->unaryOp.op;
+
+    if(op != POSITIVE_UNOP && op != NEGATIVE_UNOP && op != NOT_UNOP && op != BIT_NOT_UNOP) return;
+
+    if(isLiteral(operand)){
+        PrimitiveType type;
+        PrimitiveValue value;
+        if(evalUnaryPrimitive(op, operand->literal.type, operand->literal.value, &type, &value) != PRIM_OK) return;
+
+        replaceWithLiteral(folder, slot, type, value);
+        folder->stats->constantsFolded++;
+        return;
+    }
+
+    if(op == NOT_UNOP) stripDoubleNot(folder, &node->unaryOp.expr);
+    operand = node->unaryOp.expr;
+
+    bool involution = op == POSITIVE_UNOP
+        || (operand->type == UNARY_OPERATION_NODE && operand->unaryOp.op == op && (op == NEGATIVE_UNOP || op == BIT_NOT_UNOP))
+        || (operand->type == UNARY_OPERATION_NODE && operand->unaryOp.op == NOT_UNOP && op == NOT_UNOP && isBoolValued(folder, operand->unaryOp.expr));
+    if(!involution) return;
+
+    ASTNode *keep;
+    if(op == POSITIVE_UNOP){
+        keep = operand;
+        node->unaryOp.expr = NULL;
+    } else{
+        keep = operand->unaryOp.expr;
+        operand->unaryOp.expr = NULL;
+    }
+    replaceWithChild(folder, slot, keep);
+    folder->stats->identitiesApplied++;
+}
+
+static void setLiteral(ASTNode *literal, PrimitiveType type, long long n){
+    literal->literal.type = type;
+    literal->literal.value = primitiveFromLongLong(type, n);
+}
+
+static bool reduceStrength(Folder *folder, ASTNode *node, PrimitiveType xType, ASTNode *x, ASTNode *literal, bool literalOnLeft){
+    int shift = primitivePowerOfTwo(literal->literal.type, literal->literal.value);
+    if(shift <= 0 || !isIntegerType(xType)) return false;
+
+    switch(node->binaryOp.op){
+        case MUL_BINOP:
+            node->binaryOp.op = SHIFT_LEFT_BINOP;
+            break;
+        case DIV_BINOP:
+            if(literalOnLeft || isSignedType(xType)) return false;
+            node->binaryOp.op = SHIFT_RIGHT_BINOP;
+            break;
+        case MOD_BINOP:
+            if(literalOnLeft || isSignedType(xType)) return false;
+            node->binaryOp.op = BIT_AND_BINOP;
+            setLiteral(literal, xType, (1LL << shift) - 1);
+            folder->stats->strengthReductions++;
+            return true;
+        default:
+            return false;
+    }
+
+    node->binaryOp.left = x;
+    node->binaryOp.right = literal;
+    setLiteral(literal, TYPE_INT, shift);
+    folder->stats->strengthReductions++;
+    return true;
+}
+
+static void foldIdentity(Folder *folder, ASTNode **slot){
+    ASTNode *node = *slot;
+    ASTNode *left = node->binaryOp.left;
+    ASTNode *right = node->binaryOp.right;
+    BinaryOpType op = node->binaryOp.op;
+
+    PrimitiveType leftType, rightType;
+    if(!inferExpressionType(left, &folder->scope, &leftType)) return;
+    if(!inferExpressionType(right, &folder->scope, &rightType)) return;
+    PrimitiveType resultType = binaryResultType(op, leftType, rightType);
+
+    if((op == SUB_BINOP || op == BIT_XOR_BINOP) && sameVariable(left, right) && isIntegerType(resultType)){
+        replaceWithLiteral(folder, slot, resultType, primitiveFromLongLong(resultType, 0));
+        folder->stats->identitiesApplied++;
+        return;
+    }
+
+    bool literalOnLeft = isLiteral(left);
+    ASTNode *literal = literalOnLeft ? left : right;
+    ASTNode *x = literalOnLeft ? right : left;
+    PrimitiveType xType = literalOnLeft ? rightType : leftType;
+    if(!isLiteral(literal)) return;
+
+    bool commutative = op == ADD_BINOP || op == MUL_BINOP || op == BIT_AND_BINOP || op == BIT_OR_BINOP || op == BIT_XOR_BINOP;
+    if(literalOnLeft && !commutative) return;
+
+    // Rewrites to x must not change the dynamic type of the result,
+    // e.g. byte * 1 is an int and can't simply become the byte.
+    bool keepsType = resultType == xType;
+    PrimitiveValue converted = convertPrimitive(literal->literal.type, literal->literal.value, resultType);
+    bool isZero = isLiteralValue(literal, 0);
+    bool isOne = isLiteralValue(literal, 1);
+
+    bool toX = false;
+    bool toLiteral = false;
+    switch(op){
+        case ADD_BINOP:
+            toX = isZero && isIntegerType(xType);
+            break;
+        case SUB_BINOP:
+        case BIT_OR_BINOP:
+        case BIT_XOR_BINOP:
+        case SHIFT_LEFT_BINOP:
+        case SHIFT_RIGHT_BINOP:
+            toX = isZero;
+            toLiteral = op == BIT_OR_BINOP && primitiveAllOnes(resultType, converted);
+            break;
+        case MUL_BINOP:
+            toX = isOne;
+            toLiteral = isZero && isIntegerType(xType);
+            break;
+        case DIV_BINOP:
+            toX = isOne;
+            break;
+        case MOD_BINOP:
+            toLiteral = isOne && isIntegerType(xType);
+            if(toLiteral) converted = primitiveFromLongLong(resultType, 0);
+            break;
+        case BIT_AND_BINOP:
+            toX = primitiveAllOnes(resultType, converted);
+            toLiteral = isZero;
+            break;
+        default:
+            break;
+    }
+
+    if(toX && keepsType){
+        if(literalOnLeft) node->binaryOp.right = NULL;
+        else node->binaryOp.left = NULL;
+        replaceWithChild(folder, slot, x);
+        folder->stats->identitiesApplied++;
+        return;
+    }
+
+    if(toLiteral && isPureExpression(x)){
+        replaceWithLiteral(folder, slot, resultType, converted);
+        folder->stats->identitiesApplied++;
+        return;
+    }
+
+    if(keepsType) reduceStrength(folder, node, xType, x, literal, literalOnLeft);
+}
+
+static void foldBinary(Folder *folder, ASTNode **slot){
+    ASTNode *node = *slot;
+    BinaryOpType op = node->binaryOp.op;
+
+    if(op == AND_BINOP || op == OR_BINOP){
+        stripDoubleNot(folder, &node->binaryOp.left);
+        stripDoubleNot(folder, &node->binaryOp.right);
+    }
+
+    ASTNode *left = node->binaryOp.left;
+    ASTNode *right = node->binaryOp.right;
+
+    if(isLiteral(left) && isLiteral(right)){
+        PrimitiveType type;
+        PrimitiveValue value;
+        if(evalBinaryPrimitive(op, left->literal.type, left->literal.value, right->literal.type, right->literal.value, &type, &value) != PRIM_OK) return;
+
+        replaceWithLiteral(folder, slot, type, value);
+        folder->stats->constantsFolded++;
+        return;
+    }
+
+    if(op == COMMA_BINOP && isPureExpression(left)){
+        node->binaryOp.right = NULL;
+        replaceWithChild(folder, slot, right);
+        folder->stats->identitiesApplied++;
+        return;
+    }
+
+    // false && x and true || x never evaluate x
+    if((op == AND_BINOP && isBoolLiteral(left, false)) || (op == OR_BINOP && isBoolLiteral(left, true))){
+        PrimitiveValue value = {0};
+        value.boolVal = op == OR_BINOP;
+        replaceWithLiteral(folder, slot, TYPE_BOOL, value);
+        folder->stats->constantsFolded++;
+        return;
+    }
+
+    // true && x and false || x are just the truth value of x
+    if(((op == AND_BINOP && isBoolLiteral(left, true)) || (op == OR_BINOP && isBoolLiteral(left, false))) && isBoolValued(folder, right)){
+        node->binaryOp.right = NULL;
+        replaceWithChild(folder, slot, right);
+        folder->stats->identitiesApplied++;
+        return;
+    }
+
+    foldIdentity(folder, slot);
+}
+
+static void foldTernary(Folder *folder, ASTNode **slot){
+    ASTNode *node = *slot;
+    stripDoubleNot(folder, &node->ternaryOp.condition);
+
+    ASTNode *condition = node->ternaryOp.condition;
+    if(!isLiteral(condition)) return;
+
+    ASTNode *keep;
+    if(primitiveIsTruthy(condition->literal.type, condition->literal.value)){
+        keep = node->ternaryOp.trueExpr;
+        node->ternaryOp.trueExpr = NULL;
+    } else{
+        keep = node->ternaryOp.falseExpr;
+        node->ternaryOp.falseExpr = NULL;
+    }
+    replaceWithChild(folder, slot, keep);
+    folder->stats->constantsFolded++;
+}
+
+static void foldCast(Folder *folder, ASTNode **slot){
+    ASTNode *node = *slot;
+    ASTNode *value = node->castExpr.value;
+
+    PrimitiveType target;
+    if(!isLiteral(value) || !typeNodeToPrimitive(node->castExpr.targetType, &target) || target == TYPE_STRING) return;
+
+    // float to integer conversion of an out-of-range value is undefined
+    if(isFloatingType(value->literal.type) && !isFloatingType(target)) return;
+
+    replaceWithLiteral(folder, slot, target, convertPrimitive(value->literal.type, value->literal.value, target));
+    folder->stats->constantsFolded++;
+}
+
+static void foldSlot(ASTNode **slot, void *ctx){
+    Folder *folder = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    switch(node->type){
+        case BLOCK_NODE:
+        case FUNCTION_NODE:
+        case LAMBDA_NODE:
+        case FOR_NODE:
+        case CATCH_NODE: {
+            int mark = enterTypeScope(&folder->scope);
+            forEachChild(node, foldSlot, folder);
+            leaveTypeScope(&folder->scope, mark);
+            break;
+        }
+        case DECLARATION_NODE:
+            forEachChild(node, foldSlot, folder);
+            declareSymbol(&folder->scope, node);
+            break;
+        default:
+            forEachChild(node, foldSlot, folder);
+            break;
+    }
+
+    switch(node->type){
+        case UNARY_OPERATION_NODE:
+            foldUnary(folder, slot);
+            break;
+        case BINARY_OPERATION_NODE:
+            foldBinary(folder, slot);
+            break;
+        case TERNARY_OPERATION_NODE:
+            foldTernary(folder, slot);
+            break;
+        case CAST_EXPR_NODE:
+            foldCast(folder, slot);
+            break;
+        case IF_NODE:
+            stripDoubleNot(folder, &node->ifStmt.condition);
+            break;
+        case WHILE_NODE:
+            stripDoubleNot(folder, &node->whileStmt.condition);
+            break;
+        case DO_WHILE_NODE:
+            stripDoubleNot(folder, &node->doWhileStmt.condition);
+            break;
+        case FOR_NODE:
+            stripDoubleNot(folder, &node->forStmt.condition);
+            break;
+        default:
+            break;
+    }
+}
+
+ASTNode *foldConstants(ASTNode *node, FoldStats *stats){
+    Folder folder;
+    initTypeScope(&folder.scope);
+    folder.stats = stats;
+    *stats = (FoldStats){0};
+
+    foldSlot(&node, &folder);
+
+    freeTypeScope(&folder.scope);
+    return node;
+}
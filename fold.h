@@ -0,0 +1,15 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "ast.h"
+
+typedef struct {
+    int nodesEliminated;
+    int constantsFolded;
+    int identitiesApplied;
+    int strengthReductions;
+} FoldStats;
+
+ASTNode *foldConstants(ASTNode *node, FoldStats *stats);
+
+#endif
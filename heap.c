@@ -0,0 +1,448 @@
+#define _GNU_SOURCE
+#include "heap.h"
+#include "memops.h"
+#include "utils.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Slabs and large blocks are aligned to SLAB_SIZE, so the header describing
+// any block is found by masking its address, once the slab registry has
+// said the masked address is one of ours.
+#define SLAB_SIZE ((size_t)256 << 10)
+#define SLAB_HEADER_SIZE 64
+#define LARGE_CLASS (-1)
+// Blocks move between a thread and the pool in batches of about this many
+// bytes, and a thread keeps at most two batches of a class.
+#define BATCH_BYTES 16384
+#define MAX_BATCH 64
+#define MIN_BATCH 4
+// Slots in the slab registry, which bounds the slabs and large blocks live at
+// once; 2^16 slabs are 16 GB.
+#define REGISTRY_SIZE ((size_t)1 << 16)
+#define REGISTRY_REMOVED ((uintptr_t)1)
+
+typedef struct Block {
+    struct Block *next;
+} Block;
+
+typedef struct {
+    int sizeClass;              // LARGE_CLASS for a block with its own mapping
+    size_t mapped;              // bytes mapped for a large block, header included
+} SlabHeader;
+
+typedef struct {
+    Block *head;
+    int count;
+} Batch;
+
+typedef struct {
+    pthread_mutex_t lock;
+    Batch *batches;
+    int batchCount;
+    int batchCapacity;
+    long long pooled;
+    long long slabs;
+} ClassPool;
+
+typedef struct {
+    Block *free;                // freed blocks, which hold old data
+    int freeCount;
+    char *fresh;                // the untouched, still zero, rest of a slab
+    char *freshEnd;
+    // written only by the owning thread, read by heapStats
+    _Atomic long long allocations;
+    _Atomic long long frees;
+} ClassCache;
+
+typedef struct ThreadCache {
+    ClassCache classes[HEAP_CLASS_COUNT];
+    struct ThreadCache *prev;
+    struct ThreadCache *next;
+} ThreadCache;
+
+static pthread_once_t heapOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t cacheKey;
+static ClassPool pools[HEAP_CLASS_COUNT];
+static size_t classSizes[HEAP_CLASS_COUNT];
+static int batchSizes[HEAP_CLASS_COUNT];
+
+// The live thread caches, and the counts of those that have exited.
+static pthread_mutex_t cachesLock = PTHREAD_MUTEX_INITIALIZER;
+static ThreadCache *caches;
+static long long retiredAllocations[HEAP_CLASS_COUNT];
+static long long retiredFrees[HEAP_CLASS_COUNT];
+
+static _Atomic long long largeAllocations;
+static _Atomic long long largeFrees;
+static _Atomic long long bytesMapped;
+
+// Every live slab and large mapping by address, so heapFree and
+// heapReallocate never read a header at an address that is not one. Open
+// addressing with linear probing; written under the lock, read without it.
+// A removed mapping leaves REGISTRY_REMOVED, which inserts reuse.
+static pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic uintptr_t registry[REGISTRY_SIZE];
+
+static _Thread_local ThreadCache *threadCache;
+
+static void retireCache(void *cache);
+
+static void initHeap(void){
+    for(int i = 0; i < HEAP_CLASS_COUNT; i++){
+        if(i < 8){
+            classSizes[i] = (size_t)(i + 1) * 16;
+        } else{
+            int step = i - 8;
+            int power = 7 + step / 4;
+            classSizes[i] = ((size_t)1 << power) + (size_t)(step % 4 + 1) * ((size_t)1 << (power - 2));
+        }
+        int batch = (int)(BATCH_BYTES / classSizes[i]);
+        batchSizes[i] = batch < MIN_BATCH ? MIN_BATCH : batch > MAX_BATCH ? MAX_BATCH : batch;
+        pthread_mutex_init(&pools[i].lock, NULL);
+    }
+    pthread_key_create(&cacheKey, retireCache);
+}
+
+static int sizeClassOf(size_t size){
+    if(size <= 128) return size ? (int)((size - 1) / 16) : 0;
+    size_t last = size - 1;
+    int power = 63 - __builtin_clzll((unsigned long long)last);
+    return 8 + (power - 7) * 4 + (int)((last >> (power - 2)) & 3);
+}
+
+// Counters have one writer, so they need no locked increment.
+static void increment(_Atomic long long *counter){
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+static size_t registrySlot(uintptr_t slab){
+    return (size_t)(((slab / SLAB_SIZE) * 0x9E3779B97F4A7C15ULL) >> 32) & (REGISTRY_SIZE - 1);
+}
+
+// false when the registry is full
+static bool registerSlab(void *slab){
+    uintptr_t key = (uintptr_t)slab;
+    pthread_mutex_lock(&registryLock);
+    size_t slot = registrySlot(key);
+    for(size_t probes = 0; probes < REGISTRY_SIZE; probes++, slot = (slot + 1) & (REGISTRY_SIZE - 1)){
+        uintptr_t entry = atomic_load_explicit(&registry[slot], memory_order_relaxed);
+        if(entry == 0 || entry == REGISTRY_REMOVED){
+            atomic_store_explicit(&registry[slot], key, memory_order_release);
+            pthread_mutex_unlock(&registryLock);
+            return true;
+        }
+    }
+    pthread_mutex_unlock(&registryLock);
+    return false;
+}
+
+static _Atomic uintptr_t *findSlab(uintptr_t key){
+    size_t slot = registrySlot(key);
+    for(size_t probes = 0; probes < REGISTRY_SIZE; probes++, slot = (slot + 1) & (REGISTRY_SIZE - 1)){
+        uintptr_t entry = atomic_load_explicit(&registry[slot], memory_order_acquire);
+        if(entry == key) return &registry[slot];
+        if(entry == 0) return NULL;
+    }
+    return NULL;
+}
+
+static void unregisterSlab(void *slab){
+    pthread_mutex_lock(&registryLock);
+    _Atomic uintptr_t *entry = findSlab((uintptr_t)slab);
+    if(entry) atomic_store_explicit(entry, REGISTRY_REMOVED, memory_order_release);
+    pthread_mutex_unlock(&registryLock);
+}
+
+// The header of the slab or large mapping block starts a block in; NULL for
+// any other address, including one inside a block.
+static SlabHeader *headerOf(const void *block){
+    SlabHeader *header = (SlabHeader *)((uintptr_t)block & ~(uintptr_t)(SLAB_SIZE - 1));
+    if(!findSlab((uintptr_t)header)) return NULL;
+    size_t offset = (size_t)((const char *)block - (char *)header);
+    if(offset < SLAB_HEADER_SIZE) return NULL;
+    offset -= SLAB_HEADER_SIZE;
+    if(header->sizeClass == LARGE_CLASS) return offset == 0 ? header : NULL;
+    size_t blockSize = classSizes[header->sizeClass];
+    return offset % blockSize == 0 && offset < (SLAB_SIZE - SLAB_HEADER_SIZE) / blockSize * blockSize ? header : NULL;
+}
+
+// Maps size bytes at a SLAB_SIZE boundary by over-mapping and trimming,
+// and registers them.
+static void *mapAligned(size_t size){
+    char *mapping = mmap(NULL, size + SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mapping == MAP_FAILED) return NULL;
+    char *start = (char *)(((uintptr_t)mapping + SLAB_SIZE - 1) & ~(uintptr_t)(SLAB_SIZE - 1));
+    if(start > mapping) munmap(mapping, (size_t)(start - mapping));
+    size_t after = (size_t)(mapping + size + SLAB_SIZE - (start + size));
+    if(after) munmap(start + size, after);
+    if(!registerSlab(start)){
+        munmap(start, size);
+        return NULL;
+    }
+    atomic_fetch_add_explicit(&bytesMapped, (long long)size, memory_order_relaxed);
+    return start;
+}
+
+static ThreadCache *currentCache(void){
+    if(threadCache) return threadCache;
+    pthread_once(&heapOnce, initHeap);
+    ThreadCache *cache = calloc(1, sizeof(ThreadCache));
+    if(!cache) return NULL;
+    pthread_mutex_lock(&cachesLock);
+    cache->next = caches;
+    if(caches) caches->prev = cache;
+    caches = cache;
+    pthread_mutex_unlock(&cachesLock);
+    pthread_setspecific(cacheKey, cache);
+    threadCache = cache;
+    return cache;
+}
+
+// When the batch list cannot grow the blocks join the last batch instead;
+// false only when the pool has no batch to join.
+static bool pushBatch(int sizeClass, Block *head, int count){
+    ClassPool *pool = &pools[sizeClass];
+    pthread_mutex_lock(&pool->lock);
+    if(GROW(pool->batches, pool->batchCount, pool->batchCapacity)){
+        pool->batches[pool->batchCount++] = (Batch){head, count};
+    } else if(pool->batchCount > 0){
+        Batch *last = &pool->batches[pool->batchCount - 1];
+        Block *tail = head;
+        while(tail->next) tail = tail->next;
+        tail->next = last->head;
+        last->head = head;
+        last->count += count;
+    } else{
+        pthread_mutex_unlock(&pool->lock);
+        return false;
+    }
+    pool->pooled += count;
+    pthread_mutex_unlock(&pool->lock);
+    return true;
+}
+
+// Refills an empty cache with a batch from the pool, or else with a new
+// slab; false when no memory could be mapped.
+static bool refill(ClassCache *c, int sizeClass){
+    ClassPool *pool = &pools[sizeClass];
+    pthread_mutex_lock(&pool->lock);
+    if(pool->batchCount > 0){
+        Batch batch = pool->batches[--pool->batchCount];
+        pool->pooled -= batch.count;
+        pthread_mutex_unlock(&pool->lock);
+        c->free = batch.head;
+        c->freeCount = batch.count;
+        return true;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    SlabHeader *slab = mapAligned(SLAB_SIZE);
+    if(!slab) return false;
+    slab->sizeClass = sizeClass;
+    size_t blockSize = classSizes[sizeClass];
+    c->fresh = (char *)slab + SLAB_HEADER_SIZE;
+    c->freshEnd = c->fresh + (SLAB_SIZE - SLAB_HEADER_SIZE) / blockSize * blockSize;
+    pthread_mutex_lock(&pool->lock);
+    pool->slabs++;
+    pthread_mutex_unlock(&pool->lock);
+    return true;
+}
+
+// Freed blocks are reused first while they may still be in the cache.
+static void *allocateSmall(int sizeClass, bool *zeroed){
+    ThreadCache *cache = currentCache();
+    if(!cache) return NULL;
+    ClassCache *c = &cache->classes[sizeClass];
+    if(!c->free && c->fresh == c->freshEnd && !refill(c, sizeClass)) return NULL;
+    Block *block;
+    if(c->free){
+        block = c->free;
+        c->free = block->next;
+        c->freeCount--;
+        *zeroed = false;
+    } else{
+        block = (Block *)c->fresh;
+        c->fresh += classSizes[sizeClass];
+        *zeroed = true;
+    }
+    increment(&c->allocations);
+    return block;
+}
+
+static void freeSmall(void *memory, int sizeClass){
+    ThreadCache *cache = currentCache();
+    Block *block = memory;
+    if(!cache){
+        // a thread without a cache hands the block straight to the pool
+        block->next = NULL;
+        pushBatch(sizeClass, block, 1);
+        return;
+    }
+    ClassCache *c = &cache->classes[sizeClass];
+    block->next = c->free;
+    c->free = block;
+    c->freeCount++;
+    increment(&c->frees);
+
+    int batch = batchSizes[sizeClass];
+    if(c->freeCount < 2 * batch) return;
+    // the newest blocks stay, the batch under them goes to the pool
+    Block *last = c->free;
+    for(int i = 1; i < batch; i++){
+        last = last->next;
+    }
+    Block *rest = last->next;
+    last->next = NULL;
+    if(pushBatch(sizeClass, rest, c->freeCount - batch)) c->freeCount = batch;
+    else last->next = rest;        // kept until the pool can take them
+}
+
+static void *allocateLarge(size_t size){
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t mapped = (SLAB_HEADER_SIZE + size + page - 1) & ~(page - 1);
+    SlabHeader *header = mapAligned(mapped);
+    if(!header) return NULL;
+    header->sizeClass = LARGE_CLASS;
+    header->mapped = mapped;
+    atomic_fetch_add_explicit(&largeAllocations, 1, memory_order_relaxed);
+    return (char *)header + SLAB_HEADER_SIZE;
+}
+
+// A thread's blocks go back to the pool when it exits, untouched slab
+// space included, so nothing it freed or never used is lost.
+static void retireCache(void *memory){
+    ThreadCache *cache = memory;
+    for(int i = 0; i < HEAP_CLASS_COUNT; i++){
+        ClassCache *c = &cache->classes[i];
+        while(c->fresh < c->freshEnd){
+            Block *block = (Block *)c->fresh;
+            block->next = c->free;
+            c->free = block;
+            c->freeCount++;
+            c->fresh += classSizes[i];
+        }
+        // lost only when the pool could never allocate a batch list
+        if(c->free) pushBatch(i, c->free, c->freeCount);
+    }
+    pthread_mutex_lock(&cachesLock);
+    for(int i = 0; i < HEAP_CLASS_COUNT; i++){
+        retiredAllocations[i] += atomic_load_explicit(&cache->classes[i].allocations, memory_order_relaxed);
+        retiredFrees[i] += atomic_load_explicit(&cache->classes[i].frees, memory_order_relaxed);
+    }
+    if(cache->prev) cache->prev->next = cache->next;
+    else caches = cache->next;
+    if(cache->next) cache->next->prev = cache->prev;
+    pthread_mutex_unlock(&cachesLock);
+    if(threadCache == cache) threadCache = NULL;
+    free(cache);
+}
+
+void *heapAllocate(size_t size){
+    if(size > HEAP_MAX_SMALL) return allocateLarge(size);
+    bool zeroed;
+    return allocateSmall(sizeClassOf(size), &zeroed);
+}
+
+void *heapAllocateZeroed(size_t count, size_t size){
+    if(size && count > SIZE_MAX / size) return NULL;
+    size_t total = count * size;
+    // fresh mappings are zero
+    if(total > HEAP_MAX_SMALL) return allocateLarge(total);
+    bool zeroed;
+    void *block = allocateSmall(sizeClassOf(total), &zeroed);
+    if(block && !zeroed) fillMemory(block, 0, total);
+    return block;
+}
+
+void *heapReallocate(void *block, size_t size){
+    if(!block) return heapAllocate(size);
+    SlabHeader *header = headerOf(block);
+    if(!header) return NULL;
+    size_t capacity;
+    if(header->sizeClass == LARGE_CLASS){
+        capacity = header->mapped - SLAB_HEADER_SIZE;
+        if(size > HEAP_MAX_SMALL){
+            size_t page = (size_t)sysconf(_SC_PAGESIZE);
+            size_t mapped = (SLAB_HEADER_SIZE + size + page - 1) & ~(page - 1);
+            if(mapped == header->mapped) return block;
+            // shrinking always stays in place, growing does while the
+            // pages after the mapping are free
+            if(mremap(header, header->mapped, mapped, 0) != MAP_FAILED){
+                atomic_fetch_add_explicit(&bytesMapped, (long long)mapped - (long long)header->mapped, memory_order_relaxed);
+                header->mapped = mapped;
+                return block;
+            }
+        }
+    } else{
+        capacity = classSizes[header->sizeClass];
+        // a block at least twice the size is worth moving to a smaller class
+        if(size <= capacity && (header->sizeClass == 0 || size > capacity / 2)) return block;
+    }
+
+    void *moved = heapAllocate(size);
+    if(!moved) return NULL;
+    moveMemory(moved, block, size < capacity ? size : capacity);
+    heapFree(block);
+    return moved;
+}
+
+bool heapFree(void *block){
+    if(!block) return true;
+    SlabHeader *header = headerOf(block);
+    if(!header) return false;
+    if(header->sizeClass != LARGE_CLASS){
+        freeSmall(block, header->sizeClass);
+        return true;
+    }
+    atomic_fetch_sub_explicit(&bytesMapped, (long long)header->mapped, memory_order_relaxed);
+    atomic_fetch_add_explicit(&largeFrees, 1, memory_order_relaxed);
+    unregisterSlab(header);
+    munmap(header, header->mapped);
+    return true;
+}
+
+bool heapOwns(const void *block){
+    return headerOf(block) != NULL;
+}
+
+void heapStats(HeapStats *out){
+    memset(out, 0, sizeof(*out));
+    pthread_once(&heapOnce, initHeap);
+    pthread_mutex_lock(&cachesLock);
+    for(int i = 0; i < HEAP_CLASS_COUNT; i++){
+        HeapClassStats *stats = &out->classes[i];
+        stats->blockSize = classSizes[i];
+        stats->allocations = retiredAllocations[i];
+        stats->frees = retiredFrees[i];
+        for(ThreadCache *cache = caches; cache; cache = cache->next){
+            stats->allocations += atomic_load_explicit(&cache->classes[i].allocations, memory_order_relaxed);
+            stats->frees += atomic_load_explicit(&cache->classes[i].frees, memory_order_relaxed);
+        }
+        pthread_mutex_lock(&pools[i].lock);
+        stats->slabs = pools[i].slabs;
+        stats->pooled = pools[i].pooled;
+        pthread_mutex_unlock(&pools[i].lock);
+    }
+    pthread_mutex_unlock(&cachesLock);
+    out->largeAllocations = atomic_load_explicit(&largeAllocations, memory_order_relaxed);
+    out->largeFrees = atomic_load_explicit(&largeFrees, memory_order_relaxed);
+    out->bytesMapped = atomic_load_explicit(&bytesMapped, memory_order_relaxed);
+}
+
+void printHeapStats(FILE *out){
+    HeapStats stats;
+    heapStats(&stats);
+    for(int i = 0; i < HEAP_CLASS_COUNT; i++){
+        HeapClassStats *c = &stats.classes[i];
+        if(!c->allocations && !c->slabs) continue;
+        fprintf(out, "%zu-byte blocks: %lld allocations, %lld frees, %lld live, %lld slabs, %lld pooled\n",
+                c->blockSize, c->allocations, c->frees, c->allocations - c->frees, c->slabs, c->pooled);
+    }
+    fprintf(out, "%lld large allocations, %lld large frees; %lld bytes mapped\n", stats.largeAllocations, stats.largeFrees, stats.bytesMapped);
+}
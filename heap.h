@@ -0,0 +1,50 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stddef.h>
+
+// Blocks up to HEAP_MAX_SMALL bytes come from size classes: 16 to 128 in
+// steps of 16, then four classes per doubling.
+#define HEAP_CLASS_COUNT 40
+#define HEAP_MAX_SMALL 32768
+
+// The heap behind malloc, calloc, realloc and free in scripts. Each thread
+// allocates from and frees into its own lists, which trade blocks with a
+// shared pool in batches, so threads rarely wait on each other. Larger
+// blocks get their own mapping. Blocks are 16-byte aligned and may be
+// freed by any thread.
+void *heapAllocate(size_t size);
+// Zeroed, NULL when count * size overflows. Memory not used since it was
+// mapped is known to be zero and is not cleared again.
+void *heapAllocateZeroed(size_t count, size_t size);
+// Stays in place while the block's size class, or its mapping, has room.
+// NULL, leaving block alone, when block is not one this heap handed out.
+void *heapReallocate(void *block, size_t size);
+// false, freeing nothing, when block is not one this heap handed out.
+bool heapFree(void *block);
+// Whether block is the start of a block this heap handed out and has not
+// unmapped. A block already freed into a size class still counts.
+bool heapOwns(const void *block);
+
+typedef struct {
+    size_t blockSize;
+    long long allocations;
+    long long frees;
+    long long slabs;            // slabs mapped for the class
+    long long pooled;           // blocks waiting in the shared pool
+} HeapClassStats;
+
+typedef struct {
+    HeapClassStats classes[HEAP_CLASS_COUNT];
+    long long largeAllocations;
+    long long largeFrees;
+    long long bytesMapped;      // slabs, which are never unmapped, and live large blocks
+} HeapStats;
+
+// Totals over all threads, including those that have exited.
+void heapStats(HeapStats *out);
+void printHeapStats(FILE *out);
+
+#endif
@@ -0,0 +1,724 @@
+#include "inline.h"
+#include "primitive.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TOP_LEVEL_NAME "<top level>"
+
+typedef struct {
+    ASTNode *node;
+    int size;
+    int callSites;
+    int *callees;
+    int calleeCount;
+    int calleeCapacity;
+    bool recursive;
+    bool supported;
+    bool visited;
+} InlineCandidate;
+
+typedef struct {
+    const InlineOptions *options;
+    InlineReport *report;
+
+    InlineCandidate *functions;
+    int functionCount;
+
+    TypeScope scope;
+    int localMark;              // scope entries from here on are locals of the caller
+    const char *caller;
+    int callerSize;
+    int loopDepth;
+    int expansionCount;
+} Inliner;
+
+InlineOptions defaultInlineOptions(void){
+    InlineOptions options;
+    options.maxCalleeSize = 24;
+    options.maxSingleSiteSize = 200;
+    options.literalArgumentBonus = 4;
+    options.loopBonus = 16;
+    options.maxCallerSize = 2000;
+    return options;
+}
+
+const char *inlineResultName(InlineResult result){
+    switch(result){
+        case INLINE_DONE: return "inlined";
+        case INLINE_RECURSIVE: return "recursive";
+        case INLINE_TOO_LARGE: return "callee too large";
+        case INLINE_CALLER_TOO_LARGE: return "caller too large";
+        case INLINE_ARGUMENT_MISMATCH: return "argument count mismatch";
+        case INLINE_NAME_CAPTURE: return "name capture";
+        case INLINE_UNSUPPORTED: return "unsupported callee";
+    }
+    return "?";
+}
+
+static int findFunction(Inliner *inliner, const char *name){
+    for(int i = 0; i < inliner->functionCount; i++){
+        if(strcmp(inliner->functions[i].node->functionDef.name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static int bodySize(ASTNode *function){
+    int size = 0;
+    for(int i = 0; i < function->functionDef.bodyCount; i++){
+        size += countASTNodes(function->functionDef.body[i]);
+    }
+    return size;
+}
+
+static void record(Inliner *inliner, const char *callee, int size, InlineResult result){
+    InlineReport *report = inliner->report;
+    if(report->decisionCount == report->decisionCapacity){
+        int capacity = report->decisionCapacity ? report->decisionCapacity * 2 : 16;
+        InlineDecision *decisions = realloc(report->decisions, capacity * sizeof(InlineDecision));
+        if(!decisions) return;
+        report->decisions = decisions;
+        report->decisionCapacity = capacity;
+    }
+
+    InlineDecision *decision = &report->decisions[report->decisionCount];
+    decision->caller = strdup(inliner->caller);
+    decision->callee = strdup(callee);
+    if(!decision->caller || !decision->callee){
+        free(decision->caller);
+        free(decision->callee);
+        return;
+    }
+    decision->calleeSize = size;
+    decision->result = result;
+    report->decisionCount++;
+}
+
+// Call graph
+
+static const char *calleeName(ASTNode *call){
+    ASTNode *function = call->functionCall.function;
+    return function && function->type == IDENTIFIER_NODE ? function->identifier.name : NULL;
+}
+
+typedef struct {
+    Inliner *inliner;
+    InlineCandidate *candidate;
+} CallScan;
+
+static void scanCalls(ASTNode **slot, void *ctx){
+    CallScan *scan = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    switch(node->type){
+        case FUNCTION_CALL_NODE: {
+            const char *name = calleeName(node);
+            int index = name ? findFunction(scan->inliner, name) : -1;
+            if(index < 0) break;
+
+            scan->inliner->functions[index].callSites++;
+            InlineCandidate *candidate = scan->candidate;
+            if(!candidate) break;
+            if(candidate->calleeCount == candidate->calleeCapacity){
+                int capacity = candidate->calleeCapacity ? candidate->calleeCapacity * 2 : 4;
+                int *callees = realloc(candidate->callees, capacity * sizeof(int));
+                if(!callees) break;
+                candidate->callees = callees;
+                candidate->calleeCapacity = capacity;
+            }
+            candidate->callees[candidate->calleeCount++] = index;
+            break;
+        }
+        case LABEL_NODE:
+        case JUMP_NODE:
+        case FUNCTION_NODE:
+        case LAMBDA_NODE:
+            if(scan->candidate && node != scan->candidate->node) scan->candidate->supported = false;
+            break;
+        case DECLARATION_NODE:
+            if(scan->candidate && (node->declaration.storageFlags & STORAGE_STATIC)) scan->candidate->supported = false;
+            break;
+        default:
+            break;
+    }
+    forEachChild(node, scanCalls, ctx);
+}
+
+static bool reaches(Inliner *inliner, int from, int target, bool *seen){
+    InlineCandidate *candidate = &inliner->functions[from];
+    for(int i = 0; i < candidate->calleeCount; i++){
+        int callee = candidate->callees[i];
+        if(callee == target) return true;
+        if(seen[callee]) continue;
+        seen[callee] = true;
+        if(reaches(inliner, callee, target, seen)) return true;
+    }
+    return false;
+}
+
+static void markRecursion(Inliner *inliner){
+    bool *seen = malloc((inliner->functionCount ? inliner->functionCount : 1) * sizeof(bool));
+    if(!seen){
+        for(int i = 0; i < inliner->functionCount; i++){
+            inliner->functions[i].recursive = true;
+        }
+        return;
+    }
+
+    for(int i = 0; i < inliner->functionCount; i++){
+        memset(seen, 0, inliner->functionCount * sizeof(bool));
+        inliner->functions[i].recursive = reaches(inliner, i, i, seen);
+    }
+    free(seen);
+}
+
+// Renaming
+
+typedef struct {
+    char *from;
+    char *to;
+} Rename;
+
+typedef struct {
+    Rename *renames;
+    int count;
+    int capacity;
+    int suffix;
+    NameSet freeNames;
+    bool failed;
+} Renamer;
+
+static char *withSuffix(Renamer *renamer, const char *name){
+    size_t length = strlen(name) + 32;
+    char *to = malloc(length);
+    if(!to){
+        renamer->failed = true;
+        return NULL;
+    }
+    snprintf(to, length, "%s__inl%d", name, renamer->suffix);
+    return to;
+}
+
+static const char *pushRename(Renamer *renamer, const char *from){
+    if(renamer->count == renamer->capacity){
+        int capacity = renamer->capacity ? renamer->capacity * 2 : 8;
+        Rename *renames = realloc(renamer->renames, capacity * sizeof(Rename));
+        if(!renames){
+            renamer->failed = true;
+            return NULL;
+        }
+        renamer->renames = renames;
+        renamer->capacity = capacity;
+    }
+
+    char *copy = strdup(from);
+    if(!copy){
+        renamer->failed = true;
+        return NULL;
+    }
+    char *to = withSuffix(renamer, from);
+    if(!to){
+        free(copy);
+        return NULL;
+    }
+    renamer->renames[renamer->count].from = copy;
+    renamer->renames[renamer->count].to = to;
+    renamer->count++;
+    return to;
+}
+
+static void popRenames(Renamer *renamer, int mark){
+    while(renamer->count > mark){
+        renamer->count--;
+        free(renamer->renames[renamer->count].from);
+        free(renamer->renames[renamer->count].to);
+    }
+}
+
+static const char *renamed(Renamer *renamer, const char *name){
+    for(int i = renamer->count - 1; i >= 0; i--){
+        if(strcmp(renamer->renames[i].from, name) == 0) return renamer->renames[i].to;
+    }
+    return NULL;
+}
+
+static void replaceName(Renamer *renamer, char **name, const char *to){
+    char *copy = strdup(to);
+    if(!copy){
+        renamer->failed = true;
+        return;
+    }
+    free(*name);
+    *name = copy;
+}
+
+// Labels are only in the callee from its own inlining, and are for the
+// whole function, so each expansion just needs its own.
+static void suffixLabel(Renamer *renamer, char **name){
+    char *to = withSuffix(renamer, *name);
+    if(!to) return;
+    free(*name);
+    *name = to;
+}
+
+// Locals and labels get a suffix unique to the call site; names that resolve
+// outside the callee are collected so the call site can be checked
+// for shadowing declarations.
+static void renameSlot(ASTNode **slot, void *ctx){
+    Renamer *renamer = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    switch(node->type){
+        case IDENTIFIER_NODE: {
+            const char *to = renamed(renamer, node->identifier.name);
+            if(to) replaceName(renamer, &node->identifier.name, to);
+            else addName(&renamer->freeNames, node->identifier.name);
+            break;
+        }
+        case DECLARATION_NODE: {
+            renameSlot(&node->declaration.varType, renamer);
+            renameSlot(&node->declaration.initializer, renamer);
+
+            const char *to = pushRename(renamer, node->declaration.varName);
+            if(to) replaceName(renamer, &node->declaration.varName, to);
+            break;
+        }
+        case LABEL_NODE:
+            suffixLabel(renamer, &node->labelStmt.labelName);
+            break;
+        case JUMP_NODE:
+            suffixLabel(renamer, &node->jumpStmt.labelName);
+            break;
+        case BLOCK_NODE:
+        case COMPOUND_EXPR_NODE:
+        case FOR_NODE:
+        case WHILE_NODE:
+        case DO_WHILE_NODE:
+        case CATCH_NODE: {
+            int mark = renamer->count;
+            forEachChild(node, renameSlot, renamer);
+            popRenames(renamer, mark);
+            break;
+        }
+        default:
+            forEachChild(node, renameSlot, renamer);
+            break;
+    }
+}
+
+// Expansion
+
+typedef struct {
+    const char *resultName;
+    const char *endLabel;
+    bool failed;
+} ReturnRewriter;
+
+static void countReturns(ASTNode **slot, void *ctx){
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    if(node->type == RETURN_NODE) (*(int *)ctx)++;
+    forEachChild(node, countReturns, ctx);
+}
+
+// return x becomes { result = x; jump end; }
+static void rewriteReturns(ASTNode **slot, void *ctx){
+    ReturnRewriter *rewriter = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    if(node->type != RETURN_NODE){
+        forEachChild(node, rewriteReturns, ctx);
+        return;
+    }
+
+    ASTNode *statements[2];
+    int count = 0;
+    ASTNode *value = node->returnStmt.value;
+    if(value && rewriter->resultName){
+        ASTNode *target = createIdentifierNode(rewriter->resultName);
+        statements[count] = target ? createAssignmentNode(target, value, SIMPLE_ASSIGN) : NULL;
+        if(!statements[count]){
+            freeAST(target);
+            rewriter->failed = true;
+            return;
+        }
+        count++;
+    } else if(value){
+        statements[count++] = value;
+    }
+
+    statements[count] = createJumpNode((char *)rewriter->endLabel);
+    ASTNode *block = statements[count] ? createBlockNode(statements, count + 1) : NULL;
+    if(!block){
+        // value is still owned by the return node
+        if(count > 0 && statements[0] != value){
+            statements[0]->assignment.right = NULL;
+            freeAST(statements[0]);
+        }
+        freeAST(statements[count]);
+        rewriter->failed = true;
+        return;
+    }
+
+    node->returnStmt.value = NULL;
+    freeAST(node);
+    *slot = block;
+}
+
+static bool isCallerLocal(Inliner *inliner, const char *name){
+    for(int i = inliner->scope.count - 1; i >= 0; i--){
+        if(strcmp(inliner->scope.symbols[i].name, name) == 0) return i >= inliner->localMark;
+    }
+    return false;
+}
+
+static void freeList(ASTNode **list, int count){
+    for(int i = 0; i < count; i++){
+        freeAST(list[i]);
+    }
+    free(list);
+}
+
+static bool appendStatement(ASTNode ***list, int *count, int *capacity, ASTNode *statement){
+    if(!statement) return false;
+    if(*count == *capacity){
+        int newCapacity = *capacity ? *capacity * 2 : 8;
+        ASTNode **grown = realloc(*list, newCapacity * sizeof(ASTNode *));
+        if(!grown){
+            freeAST(statement);
+            return false;
+        }
+        *list = grown;
+        *capacity = newCapacity;
+    }
+    (*list)[(*count)++] = statement;
+    return true;
+}
+
+// f(a, b) becomes ({ T p = a; U q = b; body...; result }) with every
+// local of the callee renamed for this call site.
+static ASTNode *expandCall(Inliner *inliner, ASTNode *callee, ASTNode *call, InlineResult *result){
+    int paramCount = callee->functionDef.paramCount;
+    int bodyCount = callee->functionDef.bodyCount;
+    ASTNode *returnType = callee->functionDef.returnType;
+
+    ASTNode **statements = NULL;
+    int count = 0, capacity = 0;
+    Renamer renamer = { NULL, 0, 0, inliner->expansionCount++, { NULL, 0, 0 }, false };
+    bool ok = true;
+
+    for(int i = 0; i < paramCount && ok; i++){
+        ASTNode *param = cloneAST(callee->functionDef.params[i]);
+        ok = appendStatement(&statements, &count, &capacity, param);
+        if(ok){
+            freeAST(param->declaration.initializer);
+            param->declaration.initializer = NULL;
+            renameSlot(&statements[count - 1], &renamer);
+        }
+    }
+    for(int i = 0; i < bodyCount && ok; i++){
+        ok = appendStatement(&statements, &count, &capacity, cloneAST(callee->functionDef.body[i]));
+        if(ok) renameSlot(&statements[count - 1], &renamer);
+    }
+    ok = ok && !renamer.failed;
+
+    // a caller local with the same name as a global the callee uses
+    // would silently take its place
+    if(ok){
+        for(int i = 0; i < renamer.freeNames.count; i++){
+            if(isCallerLocal(inliner, renamer.freeNames.names[i])){
+                *result = INLINE_NAME_CAPTURE;
+                ok = false;
+                break;
+            }
+        }
+    } else{
+        *result = INLINE_UNSUPPORTED;
+    }
+    popRenames(&renamer, 0);
+    free(renamer.renames);
+    freeNameSet(&renamer.freeNames);
+    if(!ok){
+        freeList(statements, count);
+        return NULL;
+    }
+
+    int returns = 0;
+    for(int i = paramCount; i < count; i++){
+        countReturns(&statements[i], &returns);
+    }
+    ASTNode *last = count > paramCount ? statements[count - 1] : NULL;
+    bool tailReturn = last && last->type == RETURN_NODE;
+    bool hasResult = !returnType || returnType->type != VOID_NODE;
+    PrimitiveType primitive;
+
+    if(returns > (tailReturn ? 1 : 0)){
+        char resultName[32], endLabel[32];
+        snprintf(resultName, sizeof(resultName), "__result__inl%d", renamer.suffix);
+        snprintf(endLabel, sizeof(endLabel), "__return__inl%d", renamer.suffix);
+
+        ReturnRewriter rewriter = { hasResult ? resultName : NULL, endLabel, false };
+        for(int i = paramCount; i < count; i++){
+            rewriteReturns(&statements[i], &rewriter);
+        }
+        ok = !rewriter.failed;
+
+        if(ok && hasResult){
+            ASTNode *type = returnType ? cloneAST(returnType) : NULL;
+            ASTNode *declaration = !returnType || type ? createDeclarationNode(type, resultName, NULL, 0) : NULL;
+            if(!declaration) freeAST(type);
+            ok = appendStatement(&statements, &count, &capacity, declaration);
+            if(ok){
+                memmove(&statements[paramCount + 1], &statements[paramCount], (count - paramCount - 1) * sizeof(ASTNode *));
+                statements[paramCount] = declaration;
+            }
+        }
+        ok = ok && appendStatement(&statements, &count, &capacity, createLabelNode(endLabel));
+        if(ok && hasResult) ok = appendStatement(&statements, &count, &capacity, createIdentifierNode(resultName));
+    } else if(tailReturn){
+        ASTNode *value = last->returnStmt.value;
+        last->returnStmt.value = NULL;
+        freeAST(last);
+        count--;
+
+        // the conversion a return would have applied
+        if(value && returnType && typeNodeToPrimitive(returnType, &primitive)){
+            ASTNode *type = cloneAST(returnType);
+            ASTNode *cast = type ? createCastExprNode(type, value) : NULL;
+            if(!cast){
+                freeAST(type);
+                freeAST(value);
+                value = NULL;
+                ok = false;
+            } else{
+                value = cast;
+            }
+        }
+        if(value) ok = ok && appendStatement(&statements, &count, &capacity, value);
+    }
+
+    ASTNode *expansion = ok ? createCompoundExprNode(statements, count) : NULL;
+    if(!expansion){
+        freeList(statements, count);
+        *result = INLINE_UNSUPPORTED;
+        return NULL;
+    }
+    free(statements);
+
+    // the arguments move into the parameter declarations
+    for(int i = 0; i < paramCount; i++){
+        expansion->compoundExpr.statements[i]->declaration.initializer = call->functionCall.args[i];
+        call->functionCall.args[i] = NULL;
+    }
+    *result = INLINE_DONE;
+    return expansion;
+}
+
+static int countLiteralArguments(ASTNode *call){
+    int count = 0;
+    for(int i = 0; i < call->functionCall.argsCount; i++){
+        ASTNode *arg = call->functionCall.args[i];
+        if(arg && (arg->type == LITERAL_NODE || arg->type == NULL_NODE)) count++;
+    }
+    return count;
+}
+
+static bool hasDeclaredParams(ASTNode *function){
+    for(int i = 0; i < function->functionDef.paramCount; i++){
+        ASTNode *param = function->functionDef.params[i];
+        if(!param || param->type != DECLARATION_NODE) return false;
+    }
+    return true;
+}
+
+static void tryInline(Inliner *inliner, ASTNode **slot){
+    ASTNode *call = *slot;
+    const char *name = calleeName(call);
+    int index = name ? findFunction(inliner, name) : -1;
+    if(index < 0 || isCallerLocal(inliner, name)) return;
+
+    InlineCandidate *candidate = &inliner->functions[index];
+    ASTNode *callee = candidate->node;
+    int size = bodySize(callee);
+    const InlineOptions *options = inliner->options;
+
+    int allowance = options->maxCalleeSize + countLiteralArguments(call) * options->literalArgumentBonus;
+    if(inliner->loopDepth > 0) allowance += options->loopBonus;
+    if(candidate->callSites == 1 && allowance < options->maxSingleSiteSize) allowance = options->maxSingleSiteSize;
+
+    InlineResult result;
+    if(candidate->recursive) result = INLINE_RECURSIVE;
+    else if(!candidate->supported || !hasDeclaredParams(callee)) result = INLINE_UNSUPPORTED;
+    else if(call->functionCall.argsCount != callee->functionDef.paramCount) result = INLINE_ARGUMENT_MISMATCH;
+    else if(size > allowance) result = INLINE_TOO_LARGE;
+    else if(inliner->callerSize + size > options->maxCallerSize) result = INLINE_CALLER_TOO_LARGE;
+    else{
+        int callSize = countASTNodes(call);
+        ASTNode *expansion = expandCall(inliner, callee, call, &result);
+        if(expansion){
+            int added = countASTNodes(expansion) - callSize;
+            freeAST(call);
+            *slot = expansion;
+            inliner->callerSize += added;
+            inliner->report->nodesAdded += added;
+            inliner->report->callsInlined++;
+        }
+    }
+    record(inliner, callee->functionDef.name, size, result);
+}
+
+static void inlineSlot(ASTNode **slot, void *ctx){
+    Inliner *inliner = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    switch(node->type){
+        case FUNCTION_NODE:
+        case LAMBDA_NODE: {
+            const char *caller = inliner->caller;
+            if(node->type == FUNCTION_NODE) inliner->caller = node->functionDef.name;
+            int mark = enterTypeScope(&inliner->scope);
+            forEachChild(node, inlineSlot, inliner);
+            leaveTypeScope(&inliner->scope, mark);
+            inliner->caller = caller;
+            break;
+        }
+        case FOR_NODE:
+        case WHILE_NODE:
+        case DO_WHILE_NODE: {
+            int mark = enterTypeScope(&inliner->scope);
+            inliner->loopDepth++;
+            forEachChild(node, inlineSlot, inliner);
+            inliner->loopDepth--;
+            leaveTypeScope(&inliner->scope, mark);
+            break;
+        }
+        case BLOCK_NODE:
+        case COMPOUND_EXPR_NODE:
+        case CATCH_NODE: {
+            int mark = enterTypeScope(&inliner->scope);
+            forEachChild(node, inlineSlot, inliner);
+            leaveTypeScope(&inliner->scope, mark);
+            break;
+        }
+        case DECLARATION_NODE:
+            forEachChild(node, inlineSlot, inliner);
+            declareSymbol(&inliner->scope, node);
+            break;
+        default:
+            forEachChild(node, inlineSlot, inliner);
+            break;
+    }
+
+    if(node->type == FUNCTION_CALL_NODE) tryInline(inliner, slot);
+}
+
+// Callees are processed before their callers so that what gets copied
+// into a caller is already inlined itself.
+static void processFunction(Inliner *inliner, ASTNode **items, int *slots, int index){
+    InlineCandidate *candidate = &inliner->functions[index];
+    if(candidate->visited) return;
+    candidate->visited = true;
+
+    for(int i = 0; i < candidate->calleeCount; i++){
+        processFunction(inliner, items, slots, candidate->callees[i]);
+    }
+
+    leaveTypeScope(&inliner->scope, 0);
+    inliner->localMark = 0;
+    inliner->loopDepth = 0;
+    inliner->callerSize = countASTNodes(candidate->node);
+    inlineSlot(&items[slots[index]], inliner);
+}
+
+ASTNode *inlineFunctions(ASTNode *program, const InlineOptions *options, InlineReport *report){
+    *report = (InlineReport){0};
+    if(!program) return NULL;
+
+    ASTNode **items = &program;
+    int itemCount = 1;
+    if(program->type == BLOCK_NODE){
+        items = program->block.statements;
+        itemCount = program->block.stmtCount;
+    }
+
+    Inliner inliner;
+    memset(&inliner, 0, sizeof(inliner));
+    inliner.options = options;
+    inliner.report = report;
+    inliner.caller = TOP_LEVEL_NAME;
+    initTypeScope(&inliner.scope);
+
+    inliner.functions = calloc(itemCount ? itemCount : 1, sizeof(InlineCandidate));
+    int *slots = malloc((itemCount ? itemCount : 1) * sizeof(int));
+    if(!inliner.functions || !slots){
+        free(inliner.functions);
+        free(slots);
+        return program;
+    }
+    for(int i = 0; i < itemCount; i++){
+        if(!items[i] || items[i]->type != FUNCTION_NODE) continue;
+        slots[inliner.functionCount] = i;
+        inliner.functions[inliner.functionCount].node = items[i];
+        inliner.functions[inliner.functionCount].supported = true;
+        inliner.functionCount++;
+    }
+
+    for(int i = 0; i < itemCount; i++){
+        CallScan scan = { &inliner, NULL };
+        for(int k = 0; k < inliner.functionCount; k++){
+            if(slots[k] == i) scan.candidate = &inliner.functions[k];
+        }
+        scanCalls(&items[i], &scan);
+    }
+    markRecursion(&inliner);
+
+    for(int i = 0; i < inliner.functionCount; i++){
+        processFunction(&inliner, items, slots, i);
+    }
+
+    leaveTypeScope(&inliner.scope, 0);
+    inliner.caller = TOP_LEVEL_NAME;
+    inliner.callerSize = 0;
+    for(int i = 0; i < itemCount; i++){
+        if(items[i] && items[i]->type != FUNCTION_NODE) inliner.callerSize += countASTNodes(items[i]);
+    }
+    for(int i = 0; i < itemCount; i++){
+        if(!items[i] || items[i]->type == FUNCTION_NODE) continue;
+
+        // what top-level statements declare are globals for everything after them
+        inliner.localMark = inliner.scope.count;
+        inliner.loopDepth = 0;
+        inlineSlot(&items[i], &inliner);
+    }
+
+    for(int i = 0; i < inliner.functionCount; i++){
+        free(inliner.functions[i].callees);
+    }
+    free(inliner.functions);
+    free(slots);
+    freeTypeScope(&inliner.scope);
+    return program;
+}
+
+void printInlineReport(InlineReport *report, FILE *out){
+    for(int i = 0; i < report->decisionCount; i++){
+        InlineDecision *decision = &report->decisions[i];
+        fprintf(out, "%s -> %s (%d nodes): %s\n", decision->caller, decision->callee, decision->calleeSize, inlineResultName(decision->result));
+    }
+    fprintf(out, "%d calls inlined, %d nodes added\n", report->callsInlined, report->nodesAdded);
+}
+
+void freeInlineReport(InlineReport *report){
+    for(int i = 0; i < report->decisionCount; i++){
+        free(report->decisions[i].caller);
+        free(report->decisions[i].callee);
+    }
+    free(report->decisions);
+    *report = (InlineReport){0};
+}
@@ -0,0 +1,47 @@
+#ifndef INLINE_H
+#define INLINE_H
+
+#include "ast.h"
+#include <stdio.h>
+
+typedef struct {
+    int maxCalleeSize;          // callee body size in AST nodes that is always inlined
+    int maxSingleSiteSize;      // limit for callees with exactly one call site
+    int literalArgumentBonus;   // extra size allowed per literal argument
+    int loopBonus;              // extra size allowed for calls inside loops
+    int maxCallerSize;          // a caller is never grown beyond this size
+} InlineOptions;
+
+typedef enum {
+    INLINE_DONE,
+    INLINE_RECURSIVE,
+    INLINE_TOO_LARGE,
+    INLINE_CALLER_TOO_LARGE,
+    INLINE_ARGUMENT_MISMATCH,
+    INLINE_NAME_CAPTURE,
+    INLINE_UNSUPPORTED          // labels, nested functions or static locals in the callee
+} InlineResult;
+
+typedef struct {
+    char *caller;
+    char *callee;
+    int calleeSize;
+    InlineResult result;
+} InlineDecision;
+
+typedef struct {
+    InlineDecision *decisions;
+    int decisionCount;
+    int decisionCapacity;
+    int callsInlined;
+    int nodesAdded;
+} InlineReport;
+
+InlineOptions defaultInlineOptions(void);
+ASTNode *inlineFunctions(ASTNode *program, const InlineOptions *options, InlineReport *report);
+
+const char *inlineResultName(InlineResult result);
+void printInlineReport(InlineReport *report, FILE *out);
+void freeInlineReport(InlineReport *report);
+
+#endif
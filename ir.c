@@ -0,0 +1,2071 @@
+#include "ir.h"
+#include "primitive.h"
+#include "utils.h"
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+// Where lowerToIR resumes when an allocation fails, so lowering returns NULL
+// without threading the failure through every builder function.
+static _Thread_local jmp_buf *loweringFailed;
+
+static _Noreturn void outOfMemory(void){
+    longjmp(*loweringFailed, 1);
+}
+
+typedef enum {
+    BINDING_SSA,
+    BINDING_SLOT,
+    BINDING_GLOBAL
+} BindingKind;
+
+typedef struct {
+    const char *name;
+    BindingKind kind;
+    int index;                  // SSA variable or slot register
+} Binding;
+
+typedef struct {
+    const char *name;
+    IRBlock *block;
+} LabelTarget;
+
+typedef struct {
+    const char *name;
+    int value;
+} EnumConstant;
+
+typedef struct {
+    const char *name;
+    IRType returnType;
+} FunctionSignature;
+
+typedef struct {
+    IRModule *module;
+    IRFunction *fn;
+    IRBlock *current;
+    IRBlock *handler;
+
+    Binding *bindings;
+    int bindingCount;
+    int bindingCapacity;
+
+    IRType *varTypes;
+    int varCount;
+    int varCapacity;
+
+    IRBlock **breakTargets;
+    int breakCount;
+    int breakCapacity;
+    IRBlock **continueTargets;
+    int continueCount;
+    int continueCapacity;
+
+    LabelTarget *labels;
+    int labelCount;
+    int labelCapacity;
+
+    const char **addressTaken;
+    int addressTakenCount;
+    int addressTakenCapacity;
+
+    EnumConstant *enums;
+    int enumCount;
+    int enumCapacity;
+
+    FunctionSignature *signatures;
+    int signatureCount;
+    int signatureCapacity;
+
+    ASTNode **topLevel;
+    int topLevelCount;
+
+    int lambdaCount;
+} IRBuilder;
+
+static const IRType voidType = { IR_TYPE_VOID, TYPE_INT };
+static const IRType anyType = { IR_TYPE_ANY, TYPE_INT };
+static const IRType pointerType = { IR_TYPE_POINTER, TYPE_INT };
+
+static IRType primitiveIRType(PrimitiveType type){
+    IRType result = { IR_TYPE_PRIMITIVE, type };
+    return result;
+}
+
+static bool sameIRType(IRType a, IRType b){
+    if(a.kind != b.kind) return false;
+    return a.kind != IR_TYPE_PRIMITIVE || a.primitive == b.primitive;
+}
+
+static IRType typeFromNode(ASTNode *typeNode){
+    PrimitiveType primitive;
+    if(!typeNode) return anyType;
+    if(typeNode->type == VOID_NODE) return voidType;
+    if(typeNode->type == POINTER_NODE || typeNode->type == ARRAY_NODE) return pointerType;
+    if(typeNodeToPrimitive(typeNode, &primitive)) return primitiveIRType(primitive);
+    return anyType;
+}
+
+// Instructions and blocks
+
+static IRInstr *newInstr(IROpcode op, IRType type, int argCount){
+    IRInstr *instr = calloc(1, sizeof(IRInstr));
+    if(!instr) outOfMemory();
+
+    instr->op = op;
+    instr->type = type;
+    instr->dest = -1;
+    instr->argCount = argCount;
+    if(argCount > 0){
+        instr->args = malloc(argCount * sizeof(int));
+        if(!instr->args) outOfMemory();
+    }
+    return instr;
+}
+
+static void freeInstr(IRInstr *instr){
+    if(!instr) return;
+
+    switch(instr->op){
+        case IR_CONST:
+            if(instr->type.kind == IR_TYPE_PRIMITIVE && instr->type.primitive == TYPE_STRING){
+                free(instr->constant.stringVal);
+            }
+            break;
+        case IR_GLOBAL:
+        case IR_LOAD_GLOBAL:
+        case IR_STORE_GLOBAL:
+        case IR_FIELD:
+            free(instr->symbol);
+            break;
+        default:
+            break;
+    }
+    free(instr->args);
+    free(instr);
+}
+
+static int newRegister(IRFunction *fn, IRType type, IRInstr *def){
+    if(!GROW(fn->registers, fn->registerCount, fn->registerCapacity)) outOfMemory();
+
+    int reg = fn->registerCount++;
+    fn->registers[reg].type = type;
+    fn->registers[reg].def = def;
+    fn->registers[reg].replacement = reg;
+    return reg;
+}
+
+static int findRegister(IRFunction *fn, int reg){
+    while(fn->registers[reg].replacement != reg){
+        int next = fn->registers[reg].replacement;
+        fn->registers[reg].replacement = fn->registers[next].replacement;
+        reg = next;
+    }
+    return reg;
+}
+
+static void addEdge(IRBlock *from, IRBlock *to){
+    if(!GROW(to->preds, to->predCount, to->predCapacity)) outOfMemory();
+    to->preds[to->predCount++] = from;
+}
+
+static IRBlock *newBlock(IRBuilder *b){
+    IRFunction *fn = b->fn;
+    IRBlock *block = calloc(1, sizeof(IRBlock));
+    if(!block) outOfMemory();
+
+    if(!GROW(fn->blocks, fn->blockCount, fn->blockCapacity)) outOfMemory();
+    block->id = fn->blockCount;
+    fn->blocks[fn->blockCount++] = block;
+
+    block->handler = b->handler;
+    if(block->handler) addEdge(block, block->handler);
+    return block;
+}
+
+static void freeBlock(IRBlock *block){
+    for(int i = 0; i < block->instrCount; i++){
+        freeInstr(block->instrs[i]);
+    }
+    free(block->instrs);
+    freeInstr(block->terminator);
+    free(block->preds);
+    free(block->defs);
+    free(block->incomplete);
+    free(block);
+}
+
+static void insertInstr(IRBlock *block, int index, IRInstr *instr){
+    if(!GROW(block->instrs, block->instrCount, block->instrCapacity)) outOfMemory();
+    memmove(&block->instrs[index + 1], &block->instrs[index], (block->instrCount - index) * sizeof(IRInstr *));
+    block->instrs[index] = instr;
+    block->instrCount++;
+}
+
+static int emitInBlock(IRBuilder *b, IRBlock *block, int index, IRInstr *instr){
+    if(instr->type.kind != IR_TYPE_VOID) instr->dest = newRegister(b->fn, instr->type, instr);
+    insertInstr(block, index, instr);
+    return instr->dest;
+}
+
+static int emit(IRBuilder *b, IRInstr *instr){
+    return emitInBlock(b, b->current, b->current->instrCount, instr);
+}
+
+static int emit0(IRBuilder *b, IROpcode op, IRType type){
+    return emit(b, newInstr(op, type, 0));
+}
+
+static int emit1(IRBuilder *b, IROpcode op, IRType type, int a){
+    IRInstr *instr = newInstr(op, type, 1);
+    instr->args[0] = a;
+    return emit(b, instr);
+}
+
+static int emit2(IRBuilder *b, IROpcode op, IRType type, int a, int c){
+    IRInstr *instr = newInstr(op, type, 2);
+    instr->args[0] = a;
+    instr->args[1] = c;
+    return emit(b, instr);
+}
+
+static int emitSymbol(IRBuilder *b, IROpcode op, IRType type, const char *symbol, int argCount, const int *args){
+    IRInstr *instr = newInstr(op, type, argCount);
+    for(int i = 0; i < argCount; i++){
+        instr->args[i] = args[i];
+    }
+    instr->symbol = strdup(symbol);
+    if(!instr->symbol) outOfMemory();
+    return emit(b, instr);
+}
+
+static int emitConst(IRBuilder *b, PrimitiveType type, PrimitiveValue value){
+    IRInstr *instr = newInstr(IR_CONST, primitiveIRType(type), 0);
+    instr->constant = value;
+    if(type == TYPE_STRING){
+        instr->constant.stringVal = strdup(value.stringVal ? value.stringVal : "");
+        if(!instr->constant.stringVal) outOfMemory();
+    }
+    return emit(b, instr);
+}
+
+static int emitIntConst(IRBuilder *b, PrimitiveType type, long long n){
+    return emitConst(b, type, primitiveFromLongLong(type, n));
+}
+
+static int emitUndef(IRBuilder *b, IRType type){
+    IRInstr *instr = newInstr(IR_UNDEF, type, 0);
+    return emitInBlock(b, b->fn->blocks[0], 0, instr);
+}
+
+static IRType registerType(IRBuilder *b, int reg){
+    return b->fn->registers[findRegister(b->fn, reg)].type;
+}
+
+static void terminate(IRBuilder *b, IRInstr *terminator){
+    IRBlock *block = b->current;
+    block->terminator = terminator;
+    if(terminator->targets[0]) addEdge(block, terminator->targets[0]);
+    if(terminator->targets[1]) addEdge(block, terminator->targets[1]);
+
+    // whatever follows is unreachable until a label or join point
+    b->current = newBlock(b);
+    b->current->sealed = true;
+}
+
+static void emitJump(IRBuilder *b, IRBlock *target){
+    IRInstr *instr = newInstr(IR_JUMP, voidType, 0);
+    instr->targets[0] = target;
+    terminate(b, instr);
+}
+
+static void emitBranch(IRBuilder *b, int condition, IRBlock *thenBlock, IRBlock *elseBlock){
+    if(thenBlock == elseBlock){
+        emitJump(b, thenBlock);
+        return;
+    }
+    IRInstr *instr = newInstr(IR_BRANCH, voidType, 1);
+    instr->args[0] = condition;
+    instr->targets[0] = thenBlock;
+    instr->targets[1] = elseBlock;
+    terminate(b, instr);
+}
+
+static void switchTo(IRBuilder *b, IRBlock *block){
+    b->current = block;
+}
+
+// SSA construction (Braun et al., "Simple and Efficient Construction of
+// Static Single Assignment Form"): variables are read on demand through
+// the predecessors and phis are completed once a block is sealed.
+
+static int newVariable(IRBuilder *b, IRType type){
+    if(!GROW(b->varTypes, b->varCount, b->varCapacity)) outOfMemory();
+    b->varTypes[b->varCount] = type;
+    return b->varCount++;
+}
+
+static void writeVariable(IRBlock *block, int var, int reg){
+    if(var >= block->defsCapacity){
+        int capacity = block->defsCapacity ? block->defsCapacity : 8;
+        while(capacity <= var) capacity *= 2;
+
+        int *defs = realloc(block->defs, capacity * sizeof(int));
+        if(!defs) outOfMemory();
+        for(int i = block->defsCapacity; i < capacity; i++){
+            defs[i] = -1;
+        }
+        block->defs = defs;
+        block->defsCapacity = capacity;
+    }
+    block->defs[var] = reg;
+}
+
+static int readVariable(IRBuilder *b, IRBlock *block, int var);
+
+static IRInstr *newPhi(IRBuilder *b, IRBlock *block, int var){
+    IRInstr *phi = newInstr(IR_PHI, b->varTypes[var], 0);
+    int index = 0;
+    while(index < block->instrCount && block->instrs[index]->op == IR_PHI) index++;
+    emitInBlock(b, block, index, phi);
+    return phi;
+}
+
+static int tryRemoveTrivialPhi(IRBuilder *b, IRInstr *phi){
+    int same = -1;
+    for(int i = 0; i < phi->argCount; i++){
+        int arg = findRegister(b->fn, phi->args[i]);
+        if(arg == same || arg == phi->dest) continue;
+        if(same != -1) return phi->dest;
+        same = arg;
+    }
+    if(same == -1) same = emitUndef(b, phi->type);
+
+    b->fn->registers[phi->dest].replacement = same;
+    return same;
+}
+
+static int addPhiOperands(IRBuilder *b, IRBlock *block, int var, IRInstr *phi){
+    phi->args = malloc((block->predCount ? block->predCount : 1) * sizeof(int));
+    if(!phi->args) outOfMemory();
+    phi->argCount = 0;
+
+    for(int i = 0; i < block->predCount; i++){
+        phi->args[phi->argCount++] = readVariable(b, block->preds[i], var);
+    }
+    return tryRemoveTrivialPhi(b, phi);
+}
+
+static int readVariableRecursive(IRBuilder *b, IRBlock *block, int var){
+    int value;
+    if(!block->sealed){
+        IRInstr *phi = newPhi(b, block, var);
+        if(!GROW(block->incomplete, block->incompleteCount, block->incompleteCapacity)) outOfMemory();
+        block->incomplete[block->incompleteCount].var = var;
+        block->incomplete[block->incompleteCount].phi = phi;
+        block->incompleteCount++;
+        value = phi->dest;
+    } else if(block->predCount == 0){
+        value = emitUndef(b, b->varTypes[var]);
+    } else if(block->predCount == 1){
+        value = readVariable(b, block->preds[0], var);
+    } else{
+        IRInstr *phi = newPhi(b, block, var);
+        writeVariable(block, var, phi->dest);
+        value = addPhiOperands(b, block, var, phi);
+    }
+    writeVariable(block, var, value);
+    return value;
+}
+
+static int readVariable(IRBuilder *b, IRBlock *block, int var){
+    if(var < block->defsCapacity && block->defs[var] != -1){
+        return findRegister(b->fn, block->defs[var]);
+    }
+    return readVariableRecursive(b, block, var);
+}
+
+static void sealBlock(IRBuilder *b, IRBlock *block){
+    if(block->sealed) return;
+
+    for(int i = 0; i < block->incompleteCount; i++){
+        addPhiOperands(b, block, block->incomplete[i].var, block->incomplete[i].phi);
+    }
+    block->incompleteCount = 0;
+    block->sealed = true;
+}
+
+// Scopes and names
+
+static void bind(IRBuilder *b, const char *name, BindingKind kind, int index){
+    if(!GROW(b->bindings, b->bindingCount, b->bindingCapacity)) outOfMemory();
+    b->bindings[b->bindingCount].name = name;
+    b->bindings[b->bindingCount].kind = kind;
+    b->bindings[b->bindingCount].index = index;
+    b->bindingCount++;
+}
+
+static Binding *lookup(IRBuilder *b, const char *name){
+    for(int i = b->bindingCount - 1; i >= 0; i--){
+        if(strcmp(b->bindings[i].name, name) == 0) return &b->bindings[i];
+    }
+    return NULL;
+}
+
+static bool isGlobalName(IRModule *module, const char *name){
+    for(int i = 0; i < module->globalCount; i++){
+        if(strcmp(module->globals[i], name) == 0) return true;
+    }
+    return false;
+}
+
+static void addGlobal(IRModule *module, const char *name){
+    if(isGlobalName(module, name)) return;
+
+    if(!GROW(module->globals, module->globalCount, module->globalCapacity)) outOfMemory();
+    module->globals[module->globalCount] = strdup(name);
+    if(!module->globals[module->globalCount]) outOfMemory();
+    module->globalCount++;
+}
+
+static bool lookupEnum(IRBuilder *b, const char *name, int *value){
+    for(int i = 0; i < b->enumCount; i++){
+        if(strcmp(b->enums[i].name, name) == 0){
+            *value = b->enums[i].value;
+            return true;
+        }
+    }
+    return false;
+}
+
+static IRType lookupReturnType(IRBuilder *b, ASTNode *callee){
+    if(!callee || callee->type != IDENTIFIER_NODE) return anyType;
+
+    for(int i = 0; i < b->signatureCount; i++){
+        if(strcmp(b->signatures[i].name, callee->identifier.name) == 0) return b->signatures[i].returnType;
+    }
+    return anyType;
+}
+
+static bool isAddressTaken(IRBuilder *b, const char *name){
+    for(int i = 0; i < b->addressTakenCount; i++){
+        if(strcmp(b->addressTaken[i], name) == 0) return true;
+    }
+    return false;
+}
+
+static void scanAddressTaken(ASTNode **slot, void *ctx){
+    IRBuilder *b = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    if(node->type == FUNCTION_NODE || node->type == LAMBDA_NODE) return;
+    if(node->type == UNARY_OPERATION_NODE && node->unaryOp.op == ADDRESS_OF_UNOP && node->unaryOp.expr->type == IDENTIFIER_NODE){
+        if(!GROW(b->addressTaken, b->addressTakenCount, b->addressTakenCapacity)) outOfMemory();
+        b->addressTaken[b->addressTakenCount++] = node->unaryOp.expr->identifier.name;
+    }
+    forEachChild(node, scanAddressTaken, ctx);
+}
+
+static IRBlock *labelBlock(IRBuilder *b, const char *name){
+    for(int i = 0; i < b->labelCount; i++){
+        if(strcmp(b->labels[i].name, name) == 0) return b->labels[i].block;
+    }
+
+    if(!GROW(b->labels, b->labelCount, b->labelCapacity)) outOfMemory();
+    b->labels[b->labelCount].name = name;
+    b->labels[b->labelCount].block = newBlock(b);
+    return b->labels[b->labelCount++].block;
+}
+
+// Expressions
+
+static int lowerExpr(IRBuilder *b, ASTNode *node);
+static void lowerStmt(IRBuilder *b, ASTNode *node);
+static IRFunction *lowerFunction(IRBuilder *b, const char *name, ASTNode *returnType, ASTNode **params, int paramCount, ASTNode **body, int bodyCount);
+
+static int convertTo(IRBuilder *b, int value, IRType type){
+    if(type.kind != IR_TYPE_PRIMITIVE) return value;
+    if(sameIRType(registerType(b, value), type)) return value;
+    return emit1(b, IR_CAST, type, value);
+}
+
+static int afterThrowingCall(IRBuilder *b, int result){
+    // inside try, a call ends its block so the handler edge sees the
+    // variable state at the point of the call
+    if(b->handler){
+        IRBlock *next = newBlock(b);
+        emitJump(b, next);
+        sealBlock(b, next);
+        switchTo(b, next);
+    }
+    return result;
+}
+
+static BinaryOpType assignmentToBinaryOp(AssignmentOpType op){
+    switch(op){
+        case ADD_AND_ASSIGN: return ADD_BINOP;
+        case SUB_AND_ASSIGN: return SUB_BINOP;
+        case MUL_AND_ASSIGN: return MUL_BINOP;
+        case DIV_AND_ASSIGN: return DIV_BINOP;
+        case MOD_AND_ASSIGN: return MOD_BINOP;
+        case AND_AND_ASSIGN: return BIT_AND_BINOP;
+        case OR_AND_ASSIGN: return BIT_OR_BINOP;
+        case XOR_AND_ASSIGN: return BIT_XOR_BINOP;
+        case SHIFT_LEFT_AND_ASSIGN: return SHIFT_LEFT_BINOP;
+        case SHIFT_RIGHT_AND_ASSIGN: return SHIFT_RIGHT_BINOP;
+        default: return COMMA_BINOP;
+    }
+}
+
+static int emitBinary(IRBuilder *b, BinaryOpType op, int left, int right){
+    IRType leftType = registerType(b, left);
+    IRType rightType = registerType(b, right);
+    IRType type = anyType;
+
+    if(isComparisonOp(op)) type = primitiveIRType(TYPE_BOOL);
+    else if(leftType.kind == IR_TYPE_PRIMITIVE && rightType.kind == IR_TYPE_PRIMITIVE){
+        type = primitiveIRType(binaryResultType(op, leftType.primitive, rightType.primitive));
+    } else if(leftType.kind == IR_TYPE_POINTER && (op == ADD_BINOP || op == SUB_BINOP)){
+        type = pointerType;
+    }
+
+    IRInstr *instr = newInstr(IR_BINARY, type, 2);
+    instr->args[0] = left;
+    instr->args[1] = right;
+    instr->binaryOp = op;
+    return emit(b, instr);
+}
+
+static int emitUnary(IRBuilder *b, UnaryOpType op, int value){
+    IRType type = op == NOT_UNOP ? primitiveIRType(TYPE_BOOL) : registerType(b, value);
+    IRInstr *instr = newInstr(IR_UNARY, type, 1);
+    instr->args[0] = value;
+    instr->unaryOp = op;
+    return emit(b, instr);
+}
+
+typedef enum {
+    LVALUE_SSA,
+    LVALUE_MEMORY,
+    LVALUE_GLOBAL
+} LValueKind;
+
+typedef struct {
+    LValueKind kind;
+    int var;
+    int address;
+    const char *symbol;
+} LValue;
+
+static LValue lowerLValue(IRBuilder *b, ASTNode *target){
+    LValue lvalue = { LVALUE_GLOBAL, -1, -1, NULL };
+
+    switch(target->type){
+        case IDENTIFIER_NODE: {
+            Binding *binding = lookup(b, target->identifier.name);
+            lvalue.symbol = target->identifier.name;
+            if(!binding) return lvalue;
+            if(binding->kind == BINDING_SSA){
+                lvalue.kind = LVALUE_SSA;
+                lvalue.var = binding->index;
+            } else if(binding->kind == BINDING_SLOT){
+                lvalue.kind = LVALUE_MEMORY;
+                lvalue.address = binding->index;
+            }
+            return lvalue;
+        }
+        case ARRAY_ACCESS_NODE: {
+            int base = lowerExpr(b, target->arrayAccess.array);
+            int index = lowerExpr(b, target->arrayAccess.index);
+            lvalue.kind = LVALUE_MEMORY;
+            lvalue.address = emit2(b, IR_INDEX, pointerType, base, index);
+            return lvalue;
+        }
+        case FIELD_ACCESS_NODE: {
+            int base = lowerExpr(b, target->fieldAccess.object);
+            lvalue.kind = LVALUE_MEMORY;
+            lvalue.address = emitSymbol(b, IR_FIELD, pointerType, target->fieldAccess.fieldName, 1, &base);
+            return lvalue;
+        }
+        case UNARY_OPERATION_NODE:
+            if(target->unaryOp.op == DEFERENCE_UNOP){
+                lvalue.kind = LVALUE_MEMORY;
+                lvalue.address = lowerExpr(b, target->unaryOp.expr);
+                return lvalue;
+            }
+            break;
+        default:
+            break;
+    }
+
+    // not assignable: evaluate for side effects and store nowhere
+    lowerExpr(b, target);
+    lvalue.kind = LVALUE_MEMORY;
+    lvalue.address = emitUndef(b, pointerType);
+    return lvalue;
+}
+
+static int loadLValue(IRBuilder *b, LValue lvalue){
+    switch(lvalue.kind){
+        case LVALUE_SSA:
+            return readVariable(b, b->current, lvalue.var);
+        case LVALUE_MEMORY:
+            return emit1(b, IR_LOAD, anyType, lvalue.address);
+        case LVALUE_GLOBAL:
+            return emitSymbol(b, IR_LOAD_GLOBAL, anyType, lvalue.symbol, 0, NULL);
+    }
+    return -1;
+}
+
+static int storeLValue(IRBuilder *b, LValue lvalue, int value){
+    switch(lvalue.kind){
+        case LVALUE_SSA:
+            value = convertTo(b, value, b->varTypes[lvalue.var]);
+            writeVariable(b->current, lvalue.var, value);
+            break;
+        case LVALUE_MEMORY: {
+            IRInstr *instr = newInstr(IR_STORE, voidType, 2);
+            instr->args[0] = lvalue.address;
+            instr->args[1] = value;
+            emit(b, instr);
+            break;
+        }
+        case LVALUE_GLOBAL:
+            emitSymbol(b, IR_STORE_GLOBAL, voidType, lvalue.symbol, 1, &value);
+            break;
+    }
+    return value;
+}
+
+static int lowerAssignment(IRBuilder *b, ASTNode *node){
+    LValue lvalue = lowerLValue(b, node->assignment.left);
+
+    int value;
+    if(node->assignment.op == SIMPLE_ASSIGN){
+        value = lowerExpr(b, node->assignment.right);
+    } else{
+        int old = loadLValue(b, lvalue);
+        int right = lowerExpr(b, node->assignment.right);
+        value = emitBinary(b, assignmentToBinaryOp(node->assignment.op), old, right);
+    }
+    return storeLValue(b, lvalue, value);
+}
+
+static int lowerIncrement(IRBuilder *b, ASTNode *node){
+    UnaryOpType op = node->unaryOp.op;
+    LValue lvalue = lowerLValue(b, node->unaryOp.expr);
+
+    int old = loadLValue(b, lvalue);
+    int one = emitIntConst(b, TYPE_INT, 1);
+    IRType type = registerType(b, old);
+    if(type.kind == IR_TYPE_PRIMITIVE) one = convertTo(b, one, type);
+
+    bool increment = op == PRE_INCREMENT_UNOP || op == POST_INCREMENT_UNOP;
+    int updated = emitBinary(b, increment ? ADD_BINOP : SUB_BINOP, old, one);
+    updated = storeLValue(b, lvalue, updated);
+
+    return op == PRE_INCREMENT_UNOP || op == PRE_DECREMENT_UNOP ? updated : old;
+}
+
+static int lowerAddressOf(IRBuilder *b, ASTNode *expr){
+    switch(expr->type){
+        case IDENTIFIER_NODE: {
+            Binding *binding = lookup(b, expr->identifier.name);
+            if(binding && binding->kind == BINDING_SLOT) return binding->index;
+            return emitSymbol(b, IR_GLOBAL, pointerType, expr->identifier.name, 0, NULL);
+        }
+        case ARRAY_ACCESS_NODE:
+        case FIELD_ACCESS_NODE:
+            return lowerLValue(b, expr).address;
+        case UNARY_OPERATION_NODE:
+            if(expr->unaryOp.op == DEFERENCE_UNOP) return lowerExpr(b, expr->unaryOp.expr);
+            break;
+        default:
+            break;
+    }
+    return emit1(b, IR_SLOT, pointerType, lowerExpr(b, expr));
+}
+
+static int lowerSizeOf(IRBuilder *b, ASTNode *expr){
+    PrimitiveType primitive;
+    if(typeNodeToPrimitive(expr, &primitive) && expr->type == IDENTIFIER_NODE){
+        return emitIntConst(b, TYPE_UNSIGNED_ARCH, (long long)primitiveSize(primitive));
+    }
+    if(expr->type == POINTER_NODE){
+        return emitIntConst(b, TYPE_UNSIGNED_ARCH, (long long)sizeof(void *));
+    }
+
+    int value = lowerExpr(b, expr);
+    IRType type = registerType(b, value);
+    if(type.kind == IR_TYPE_PRIMITIVE) return emitIntConst(b, TYPE_UNSIGNED_ARCH, (long long)primitiveSize(type.primitive));
+    return emit1(b, IR_SIZEOF, primitiveIRType(TYPE_UNSIGNED_ARCH), value);
+}
+
+// && and || and ?: merge through an anonymous SSA variable so the
+// phi comes out of the same machinery as named variables.
+static int lowerShortCircuit(IRBuilder *b, ASTNode *node){
+    bool isAnd = node->binaryOp.op == AND_BINOP;
+    int var = newVariable(b, primitiveIRType(TYPE_BOOL));
+
+    int left = convertTo(b, lowerExpr(b, node->binaryOp.left), primitiveIRType(TYPE_BOOL));
+    writeVariable(b->current, var, left);
+
+    IRBlock *rightBlock = newBlock(b);
+    IRBlock *merge = newBlock(b);
+    if(isAnd) emitBranch(b, left, rightBlock, merge);
+    else emitBranch(b, left, merge, rightBlock);
+    sealBlock(b, rightBlock);
+
+    switchTo(b, rightBlock);
+    int right = convertTo(b, lowerExpr(b, node->binaryOp.right), primitiveIRType(TYPE_BOOL));
+    writeVariable(b->current, var, right);
+    emitJump(b, merge);
+
+    sealBlock(b, merge);
+    switchTo(b, merge);
+    return readVariable(b, merge, var);
+}
+
+static int lowerTernary(IRBuilder *b, ASTNode *node){
+    int var = newVariable(b, anyType);
+    int condition = lowerExpr(b, node->ternaryOp.condition);
+
+    IRBlock *thenBlock = newBlock(b);
+    IRBlock *elseBlock = newBlock(b);
+    IRBlock *merge = newBlock(b);
+    emitBranch(b, condition, thenBlock, elseBlock);
+    sealBlock(b, thenBlock);
+    sealBlock(b, elseBlock);
+
+    switchTo(b, thenBlock);
+    int thenValue = lowerExpr(b, node->ternaryOp.trueExpr);
+    writeVariable(b->current, var, thenValue);
+    emitJump(b, merge);
+
+    switchTo(b, elseBlock);
+    int elseValue = lowerExpr(b, node->ternaryOp.falseExpr);
+    writeVariable(b->current, var, elseValue);
+    emitJump(b, merge);
+
+    IRType thenType = registerType(b, thenValue);
+    if(sameIRType(thenType, registerType(b, elseValue))) b->varTypes[var] = thenType;
+
+    sealBlock(b, merge);
+    switchTo(b, merge);
+    return readVariable(b, merge, var);
+}
+
+static int lowerCall(IRBuilder *b, ASTNode *node){
+    int argCount = node->functionCall.argsCount;
+    IRInstr *instr = newInstr(IR_CALL, lookupReturnType(b, node->functionCall.function), argCount + 1);
+
+    instr->args[0] = lowerExpr(b, node->functionCall.function);
+    for(int i = 0; i < argCount; i++){
+        instr->args[i + 1] = lowerExpr(b, node->functionCall.args[i]);
+    }
+
+    int result = emit(b, instr);
+    if(result == -1) result = emitUndef(b, anyType);
+    return afterThrowingCall(b, result);
+}
+
+static int lowerIdentifier(IRBuilder *b, ASTNode *node){
+    const char *name = node->identifier.name;
+    Binding *binding = lookup(b, name);
+
+    if(binding){
+        switch(binding->kind){
+            case BINDING_SSA:
+                return readVariable(b, b->current, binding->index);
+            case BINDING_SLOT:
+                return emit1(b, IR_LOAD, anyType, binding->index);
+            case BINDING_GLOBAL:
+                return emitSymbol(b, IR_LOAD_GLOBAL, anyType, name, 0, NULL);
+        }
+    }
+
+    int enumValue;
+    if(lookupEnum(b, name, &enumValue)) return emitIntConst(b, TYPE_INT, enumValue);
+    if(isGlobalName(b->module, name)) return emitSymbol(b, IR_LOAD_GLOBAL, anyType, name, 0, NULL);
+    return emitSymbol(b, IR_GLOBAL, pointerType, name, 0, NULL);
+}
+
+static int lowerIntrinsic(IRBuilder *b, IROpcode op, IRType type, int argCount, ASTNode *a, ASTNode *c, ASTNode *d){
+    ASTNode *operands[3] = { a, c, d };
+    IRInstr *instr = newInstr(op, type, argCount);
+    for(int i = 0; i < argCount; i++){
+        instr->args[i] = lowerExpr(b, operands[i]);
+    }
+    int result = emit(b, instr);
+    return result == -1 ? emitUndef(b, anyType) : result;
+}
+
+static int lowerExpr(IRBuilder *b, ASTNode *node){
+    if(!node) return emitUndef(b, anyType);
+
+    switch(node->type){
+        case LITERAL_NODE:
+            return emitConst(b, node->literal.type, node->literal.value);
+        case IDENTIFIER_NODE:
+            return lowerIdentifier(b, node);
+        case NULL_NODE: {
+            IRInstr *instr = newInstr(IR_CONST, pointerType, 0);
+            return emit(b, instr);
+        }
+        case ASSIGNMENT_NODE:
+            return lowerAssignment(b, node);
+        case UNARY_OPERATION_NODE:
+            switch(node->unaryOp.op){
+                case PRE_INCREMENT_UNOP:
+                case POST_INCREMENT_UNOP:
+                case PRE_DECREMENT_UNOP:
+                case POST_DECREMENT_UNOP:
+                    return lowerIncrement(b, node);
+                case ADDRESS_OF_UNOP:
+                    return lowerAddressOf(b, node->unaryOp.expr);
+                case DEFERENCE_UNOP:
+                    return emit1(b, IR_LOAD, anyType, lowerExpr(b, node->unaryOp.expr));
+                case SIZE_OF_UNOP:
+                    return lowerSizeOf(b, node->unaryOp.expr);
+                default:
+                    return emitUnary(b, node->unaryOp.op, lowerExpr(b, node->unaryOp.expr));
+            }
+        case BINARY_OPERATION_NODE:
+            if(node->binaryOp.op == AND_BINOP || node->binaryOp.op == OR_BINOP) return lowerShortCircuit(b, node);
+            if(node->binaryOp.op == COMMA_BINOP){
+                lowerExpr(b, node->binaryOp.left);
+                return lowerExpr(b, node->binaryOp.right);
+            } else{
+                int left = lowerExpr(b, node->binaryOp.left);
+                int right = lowerExpr(b, node->binaryOp.right);
+                return emitBinary(b, node->binaryOp.op, left, right);
+            }
+        case TERNARY_OPERATION_NODE:
+            return lowerTernary(b, node);
+        case ARRAY_ACCESS_NODE:
+        case FIELD_ACCESS_NODE:
+            return emit1(b, IR_LOAD, anyType, lowerLValue(b, node).address);
+        case FUNCTION_CALL_NODE:
+            return lowerCall(b, node);
+        case CAST_EXPR_NODE: {
+            int value = lowerExpr(b, node->castExpr.value);
+            IRType type = typeFromNode(node->castExpr.targetType);
+            if(type.kind == IR_TYPE_VOID) return emitUndef(b, anyType);
+            return emit1(b, IR_CAST, type, value);
+        }
+        case MALLOC_NODE:
+            return lowerIntrinsic(b, IR_MALLOC, pointerType, 1, node->mallocExpr.size, NULL, NULL);
+        case CALLOC_NODE:
+            return lowerIntrinsic(b, IR_CALLOC, pointerType, 2, node->callocExpr.num, node->callocExpr.size, NULL);
+        case REALLOC_NODE:
+            return lowerIntrinsic(b, IR_REALLOC, pointerType, 2, node->reallocExpr.ptr, node->reallocExpr.size, NULL);
+        case FREE_NODE:
+            if(node->freeExpr.elided){
+                lowerExpr(b, node->freeExpr.ptr);
+                return emitUndef(b, anyType);
+            }
+            return lowerIntrinsic(b, IR_FREE, voidType, 1, node->freeExpr.ptr, NULL, NULL);
+        case MEMCPY_NODE:
+            return lowerIntrinsic(b, IR_MEMCPY, pointerType, 3, node->memcpyExpr.dest, node->memcpyExpr.src, node->memcpyExpr.size);
+        case MEMSET_NODE:
+            return lowerIntrinsic(b, IR_MEMSET, pointerType, 3, node->memsetExpr.dest, node->memsetExpr.value, node->memsetExpr.size);
+        case MEMMOVE_NODE:
+            return lowerIntrinsic(b, IR_MEMMOVE, pointerType, 3, node->memmoveExpr.dest, node->memmoveExpr.src, node->memmoveExpr.size);
+        case SIZEOF_NODE:
+            return lowerSizeOf(b, node->sizeOfExpr.expr);
+        case TYPEOF_NODE: {
+            int value = lowerExpr(b, node->typeOfExpr.expr);
+            IRType type = registerType(b, value);
+            PrimitiveValue name = {0};
+            name.stringVal = (char *)(type.kind == IR_TYPE_PRIMITIVE ? primitiveTypeName(type.primitive) : "any");
+            return emitConst(b, TYPE_STRING, name);
+        }
+        case ARRAY_NODE: {
+            IRInstr *instr = newInstr(IR_ARRAY, pointerType, node->array.elementsCount);
+            for(int i = 0; i < node->array.elementsCount; i++){
+                instr->args[i] = lowerExpr(b, node->array.elements[i]);
+            }
+            return emit(b, instr);
+        }
+        case COMPOUND_EXPR_NODE: {
+            int mark = b->bindingCount;
+            int value = -1;
+            for(int i = 0; i < node->compoundExpr.stmtCount; i++){
+                ASTNode *stmt = node->compoundExpr.statements[i];
+                if(i == node->compoundExpr.stmtCount - 1 && stmt->type != DECLARATION_NODE) value = lowerExpr(b, stmt);
+                else lowerStmt(b, stmt);
+            }
+            b->bindingCount = mark;
+            return value == -1 ? emitUndef(b, anyType) : value;
+        }
+        case LAMBDA_NODE: {
+            char name[32];
+            snprintf(name, sizeof(name), "__lambda%d", b->lambdaCount++);
+            lowerFunction(b, name, node->lambda.returnType, node->lambda.params, node->lambda.paramCount, node->lambda.body, node->lambda.bodyCount);
+            return emitSymbol(b, IR_GLOBAL, pointerType, name, 0, NULL);
+        }
+        default:
+            lowerStmt(b, node);
+            return emitUndef(b, anyType);
+    }
+}
+
+// Statements
+
+static void lowerDeclaration(IRBuilder *b, ASTNode *node){
+    const char *name = node->declaration.varName;
+    ASTNode *varType = node->declaration.varType;
+    IRType type = typeFromNode(varType);
+
+    int value = -1;
+    if(varType && varType->type == ARRAY_NODE && !node->declaration.initializer){
+        int count = varType->array.size ? lowerExpr(b, varType->array.size) : emitIntConst(b, TYPE_INT, 0);
+        value = emit1(b, IR_SLOT, pointerType, count);
+    } else if(node->declaration.initializer){
+        value = convertTo(b, lowerExpr(b, node->declaration.initializer), type);
+    } else if(type.kind == IR_TYPE_PRIMITIVE && type.primitive != TYPE_STRING){
+        value = emitIntConst(b, type.primitive, 0);
+    }
+
+    for(int i = 0; i < b->topLevelCount; i++){
+        if(b->topLevel[i] != node) continue;
+        if(value != -1) emitSymbol(b, IR_STORE_GLOBAL, voidType, name, 1, &value);
+        return;
+    }
+
+    if(isAddressTaken(b, name)){
+        int slot = emit0(b, IR_SLOT, pointerType);
+        bind(b, name, BINDING_SLOT, slot);
+        if(value != -1){
+            IRInstr *instr = newInstr(IR_STORE, voidType, 2);
+            instr->args[0] = slot;
+            instr->args[1] = value;
+            emit(b, instr);
+        }
+        return;
+    }
+
+    int var = newVariable(b, type);
+    bind(b, name, BINDING_SSA, var);
+    if(value == -1) value = emitUndef(b, type);
+    writeVariable(b->current, var, value);
+}
+
+static void lowerStatements(IRBuilder *b, ASTNode **statements, int count){
+    for(int i = 0; i < count; i++){
+        lowerStmt(b, statements[i]);
+    }
+}
+
+static void pushBreak(IRBuilder *b, IRBlock *target){
+    if(!GROW(b->breakTargets, b->breakCount, b->breakCapacity)) outOfMemory();
+    b->breakTargets[b->breakCount++] = target;
+}
+
+static void pushContinue(IRBuilder *b, IRBlock *target){
+    if(!GROW(b->continueTargets, b->continueCount, b->continueCapacity)) outOfMemory();
+    b->continueTargets[b->continueCount++] = target;
+}
+
+static void lowerIf(IRBuilder *b, ASTNode *node){
+    int condition = lowerExpr(b, node->ifStmt.condition);
+    IRBlock *thenBlock = newBlock(b);
+    IRBlock *elseBlock = node->ifStmt.elseBranch ? newBlock(b) : NULL;
+    IRBlock *merge = newBlock(b);
+
+    emitBranch(b, condition, thenBlock, elseBlock ? elseBlock : merge);
+    sealBlock(b, thenBlock);
+
+    switchTo(b, thenBlock);
+    lowerStmt(b, node->ifStmt.thenBranch);
+    emitJump(b, merge);
+
+    if(elseBlock){
+        sealBlock(b, elseBlock);
+        switchTo(b, elseBlock);
+        lowerStmt(b, node->ifStmt.elseBranch);
+        emitJump(b, merge);
+    }
+
+    sealBlock(b, merge);
+    switchTo(b, merge);
+}
+
+static void lowerWhile(IRBuilder *b, ASTNode *node){
+    IRBlock *header = newBlock(b);
+    IRBlock *body = newBlock(b);
+    IRBlock *exit = newBlock(b);
+
+    emitJump(b, header);
+    switchTo(b, header);
+    int condition = lowerExpr(b, node->whileStmt.condition);
+    emitBranch(b, condition, body, exit);
+    sealBlock(b, body);
+
+    pushBreak(b, exit);
+    pushContinue(b, header);
+    switchTo(b, body);
+    int mark = b->bindingCount;
+    lowerStatements(b, node->whileStmt.body, node->whileStmt.bodyCount);
+    b->bindingCount = mark;
+    emitJump(b, header);
+    b->breakCount--;
+    b->continueCount--;
+
+    sealBlock(b, header);
+    sealBlock(b, exit);
+    switchTo(b, exit);
+}
+
+static void lowerDoWhile(IRBuilder *b, ASTNode *node){
+    IRBlock *body = newBlock(b);
+    IRBlock *test = newBlock(b);
+    IRBlock *exit = newBlock(b);
+
+    emitJump(b, body);
+    pushBreak(b, exit);
+    pushContinue(b, test);
+    switchTo(b, body);
+    int mark = b->bindingCount;
+    lowerStatements(b, node->doWhileStmt.body, node->doWhileStmt.bodyCount);
+    b->bindingCount = mark;
+    emitJump(b, test);
+    b->breakCount--;
+    b->continueCount--;
+
+    sealBlock(b, test);
+    switchTo(b, test);
+    int condition = lowerExpr(b, node->doWhileStmt.condition);
+    emitBranch(b, condition, body, exit);
+
+    sealBlock(b, body);
+    sealBlock(b, exit);
+    switchTo(b, exit);
+}
+
+static void lowerFor(IRBuilder *b, ASTNode *node){
+    int mark = b->bindingCount;
+    if(node->forStmt.initializer) lowerStmt(b, node->forStmt.initializer);
+
+    IRBlock *header = newBlock(b);
+    IRBlock *body = newBlock(b);
+    IRBlock *step = newBlock(b);
+    IRBlock *exit = newBlock(b);
+
+    emitJump(b, header);
+    switchTo(b, header);
+    if(node->forStmt.condition){
+        int condition = lowerExpr(b, node->forStmt.condition);
+        emitBranch(b, condition, body, exit);
+    } else{
+        emitJump(b, body);
+    }
+    sealBlock(b, body);
+
+    pushBreak(b, exit);
+    pushContinue(b, step);
+    switchTo(b, body);
+    int bodyMark = b->bindingCount;
+    lowerStatements(b, node->forStmt.body, node->forStmt.bodyCount);
+    b->bindingCount = bodyMark;
+    emitJump(b, step);
+    b->breakCount--;
+    b->continueCount--;
+
+    sealBlock(b, step);
+    switchTo(b, step);
+    if(node->forStmt.increment) lowerExpr(b, node->forStmt.increment);
+    emitJump(b, header);
+
+    sealBlock(b, header);
+    sealBlock(b, exit);
+    switchTo(b, exit);
+    b->bindingCount = mark;
+}
+
+static void lowerSwitch(IRBuilder *b, ASTNode *node){
+    int value = lowerExpr(b, node->switchStmt.expr);
+    int caseCount = node->switchStmt.caseCount;
+
+    IRBlock *exit = newBlock(b);
+    IRBlock **bodies = malloc((caseCount ? caseCount : 1) * sizeof(IRBlock *));
+    if(!bodies) outOfMemory();
+
+    IRBlock *defaultBlock = NULL;
+    for(int i = 0; i < caseCount; i++){
+        bodies[i] = newBlock(b);
+        if(node->switchStmt.cases[i]->type == DEFAULT_NODE) defaultBlock = bodies[i];
+    }
+
+    for(int i = 0; i < caseCount; i++){
+        ASTNode *caseNode = node->switchStmt.cases[i];
+        if(caseNode->type != CASE_NODE) continue;
+
+        int caseValue = lowerExpr(b, caseNode->caseStmt.value);
+        int matches = emitBinary(b, EQU_BINOP, value, caseValue);
+        IRBlock *next = newBlock(b);
+        emitBranch(b, matches, bodies[i], next);
+        sealBlock(b, next);
+        switchTo(b, next);
+    }
+    emitJump(b, defaultBlock ? defaultBlock : exit);
+
+    // case bodies are laid out in order so that a missing break falls through
+    pushBreak(b, exit);
+    for(int i = 0; i < caseCount; i++){
+        ASTNode *caseNode = node->switchStmt.cases[i];
+        sealBlock(b, bodies[i]);
+        switchTo(b, bodies[i]);
+
+        int mark = b->bindingCount;
+        if(caseNode->type == CASE_NODE) lowerStatements(b, caseNode->caseStmt.body, caseNode->caseStmt.bodyCount);
+        else if(caseNode->type == DEFAULT_NODE) lowerStatements(b, caseNode->defaultStmt.body, caseNode->defaultStmt.bodyCount);
+        b->bindingCount = mark;
+
+        emitJump(b, i + 1 < caseCount ? bodies[i + 1] : exit);
+    }
+    b->breakCount--;
+
+    free(bodies);
+    sealBlock(b, exit);
+    switchTo(b, exit);
+}
+
+static void lowerTry(IRBuilder *b, ASTNode *node){
+    IRBlock *outerHandler = b->handler;
+    IRBlock *handler = newBlock(b);
+    IRBlock *exit = newBlock(b);
+
+    b->handler = handler;
+    IRBlock *tryStart = newBlock(b);
+    emitJump(b, tryStart);
+    sealBlock(b, tryStart);
+    switchTo(b, tryStart);
+
+    int mark = b->bindingCount;
+    lowerStatements(b, node->tryStmt.tryBlock, node->tryStmt.tryBlockCount);
+    b->bindingCount = mark;
+    b->handler = outerHandler;
+    emitJump(b, exit);
+
+    sealBlock(b, handler);
+    switchTo(b, handler);
+    int exception = emit0(b, IR_CATCH, anyType);
+
+    for(int i = 0; i < node->tryStmt.catchCount; i++){
+        ASTNode *catchNode = node->tryStmt.catchBlock[i];
+        if(catchNode->type != CATCH_NODE) continue;
+
+        ASTNode *var = catchNode->catchStmt.exceptionVar;
+        IRType type = var && var->type == DECLARATION_NODE ? typeFromNode(var->declaration.varType) : anyType;
+        IRBlock *body = newBlock(b);
+        IRBlock *next = NULL;
+
+        if(type.kind == IR_TYPE_PRIMITIVE || type.kind == IR_TYPE_POINTER){
+            IRInstr *test = newInstr(IR_TYPE_TEST, primitiveIRType(TYPE_BOOL), 1);
+            test->args[0] = exception;
+            test->testType = type;
+            int matches = emit(b, test);
+            next = newBlock(b);
+            emitBranch(b, matches, body, next);
+            sealBlock(b, next);
+        } else{
+            emitJump(b, body);
+        }
+        sealBlock(b, body);
+
+        switchTo(b, body);
+        int catchMark = b->bindingCount;
+        if(var){
+            const char *name = var->type == DECLARATION_NODE ? var->declaration.varName : var->type == IDENTIFIER_NODE ? var->identifier.name : NULL;
+            if(name){
+                int ssa = newVariable(b, type);
+                bind(b, name, BINDING_SSA, ssa);
+                writeVariable(b->current, ssa, convertTo(b, exception, type));
+            }
+        }
+        lowerStatements(b, catchNode->catchStmt.body, catchNode->catchStmt.bodyCount);
+        b->bindingCount = catchMark;
+        emitJump(b, exit);
+
+        if(!next) break;
+        switchTo(b, next);
+    }
+
+    // no clause matched: rethrow to the enclosing handler
+    if(b->current->predCount > 0 || b->current == handler){
+        IRInstr *rethrow = newInstr(IR_THROW, voidType, 1);
+        rethrow->args[0] = exception;
+        terminate(b, rethrow);
+    }
+
+    sealBlock(b, exit);
+    switchTo(b, exit);
+}
+
+static void lowerStmt(IRBuilder *b, ASTNode *node){
+    if(!node) return;
+
+    switch(node->type){
+        case BLOCK_NODE: {
+            int mark = b->bindingCount;
+            lowerStatements(b, node->block.statements, node->block.stmtCount);
+            b->bindingCount = mark;
+            break;
+        }
+        case DECLARATION_NODE:
+            lowerDeclaration(b, node);
+            break;
+        case IF_NODE:
+            lowerIf(b, node);
+            break;
+        case WHILE_NODE:
+            lowerWhile(b, node);
+            break;
+        case DO_WHILE_NODE:
+            lowerDoWhile(b, node);
+            break;
+        case FOR_NODE:
+            lowerFor(b, node);
+            break;
+        case SWITCH_NODE:
+            lowerSwitch(b, node);
+            break;
+        case TRY_NODE:
+            lowerTry(b, node);
+            break;
+        case BREAK_NODE:
+            if(b->breakCount > 0) emitJump(b, b->breakTargets[b->breakCount - 1]);
+            break;
+        case CONTINUE_NODE:
+            if(b->continueCount > 0) emitJump(b, b->continueTargets[b->continueCount - 1]);
+            break;
+        case RETURN_NODE: {
+            IRInstr *instr;
+            if(node->returnStmt.value){
+                int value = convertTo(b, lowerExpr(b, node->returnStmt.value), b->fn->returnType);
+                instr = newInstr(IR_RETURN, voidType, 1);
+                instr->args[0] = value;
+            } else{
+                instr = newInstr(IR_RETURN, voidType, 0);
+            }
+            terminate(b, instr);
+            break;
+        }
+        case THROW_NODE: {
+            IRInstr *instr = newInstr(IR_THROW, voidType, 1);
+            instr->args[0] = lowerExpr(b, node->throwStmt.exceptionExpr);
+            terminate(b, instr);
+            break;
+        }
+        case LABEL_NODE: {
+            IRBlock *target = labelBlock(b, node->labelStmt.labelName);
+            emitJump(b, target);
+            switchTo(b, target);
+            break;
+        }
+        case JUMP_NODE:
+            emitJump(b, labelBlock(b, node->jumpStmt.labelName));
+            break;
+        case FUNCTION_NODE:
+            lowerFunction(b, node->functionDef.name, node->functionDef.returnType, node->functionDef.params, node->functionDef.paramCount, node->functionDef.body, node->functionDef.bodyCount);
+            break;
+        case IMPL_NODE:
+            for(int i = 0; i < node->implDef.methodsCount; i++){
+                ASTNode *method = node->implDef.methods[i];
+                if(method->type != FUNCTION_NODE) continue;
+
+                size_t length = strlen(node->implDef.structName) + strlen(method->functionDef.name) + 2;
+                char *name = malloc(length);
+                if(!name) outOfMemory();
+                snprintf(name, length, "%s.%s", node->implDef.structName, method->functionDef.name);
+                lowerFunction(b, name, method->functionDef.returnType, method->functionDef.params, method->functionDef.paramCount, method->functionDef.body, method->functionDef.bodyCount);
+                free(name);
+            }
+            break;
+        case ENUM_NODE:
+            for(int i = 0; i < node->enumDef.valuesCount; i++){
+                if(!GROW(b->enums, b->enumCount, b->enumCapacity)) outOfMemory();
+                b->enums[b->enumCount].name = node->enumDef.values[i];
+                b->enums[b->enumCount].value = node->enumDef.intValues[i];
+                b->enumCount++;
+            }
+            break;
+        case STRUCT_NODE:
+        case UNION_NODE:
+        case TYPEDEF_NODE:
+        case INCLUDE_NODE:
+        case CASE_NODE:
+        case DEFAULT_NODE:
+        case CATCH_NODE:
+            break;
+        default:
+            lowerExpr(b, node);
+            break;
+    }
+}
+
+// Cleanup once a function is fully built: drop unreachable blocks, fold
+// away phis that became trivial and rewrite operands to final registers.
+
+static void removeUnreachableBlocks(IRFunction *fn){
+    bool *reachable = calloc(fn->blockCount, sizeof(bool));
+    IRBlock **worklist = malloc(fn->blockCount * sizeof(IRBlock *));
+    if(!reachable || !worklist) outOfMemory();
+
+    int top = 0;
+    worklist[top++] = fn->blocks[0];
+    reachable[0] = true;
+    while(top > 0){
+        IRBlock *block = worklist[--top];
+        for(int i = 0; i < blockSuccessorCount(block); i++){
+            IRBlock *succ = blockSuccessor(block, i);
+            if(!reachable[succ->id]){
+                reachable[succ->id] = true;
+                worklist[top++] = succ;
+            }
+        }
+    }
+
+    for(int i = 0; i < fn->blockCount; i++){
+        IRBlock *block = fn->blocks[i];
+        if(!reachable[i]) continue;
+
+        int kept = 0;
+        for(int p = 0; p < block->predCount; p++){
+            if(!reachable[block->preds[p]->id]) continue;
+
+            for(int k = 0; k < block->instrCount && block->instrs[k]->op == IR_PHI; k++){
+                IRInstr *phi = block->instrs[k];
+                if(p < phi->argCount) phi->args[kept] = phi->args[p];
+            }
+            block->preds[kept++] = block->preds[p];
+        }
+        for(int k = 0; k < block->instrCount && block->instrs[k]->op == IR_PHI; k++){
+            if(block->instrs[k]->argCount > kept) block->instrs[k]->argCount = kept;
+        }
+        block->predCount = kept;
+    }
+
+    int kept = 0;
+    for(int i = 0; i < fn->blockCount; i++){
+        IRBlock *block = fn->blocks[i];
+        if(!reachable[i]){
+            freeBlock(block);
+            continue;
+        }
+        fn->blocks[kept++] = block;
+    }
+    fn->blockCount = kept;
+    for(int i = 0; i < fn->blockCount; i++){
+        fn->blocks[i]->id = i;
+    }
+
+    free(reachable);
+    free(worklist);
+}
+
+static void simplifyPhis(IRFunction *fn){
+    bool changed = true;
+    while(changed){
+        changed = false;
+        for(int i = 0; i < fn->blockCount; i++){
+            IRBlock *block = fn->blocks[i];
+            for(int k = 0; k < block->instrCount && block->instrs[k]->op == IR_PHI; k++){
+                IRInstr *phi = block->instrs[k];
+                if(findRegister(fn, phi->dest) != phi->dest) continue;
+
+                int same = -1;
+                bool trivial = true;
+                for(int a = 0; a < phi->argCount; a++){
+                    int arg = findRegister(fn, phi->args[a]);
+                    if(arg == same || arg == phi->dest) continue;
+                    if(same != -1){
+                        trivial = false;
+                        break;
+                    }
+                    same = arg;
+                }
+                if(trivial && same != -1){
+                    fn->registers[phi->dest].replacement = same;
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+static void rewriteOperands(IRFunction *fn, IRInstr *instr){
+    for(int i = 0; i < instr->argCount; i++){
+        instr->args[i] = findRegister(fn, instr->args[i]);
+    }
+}
+
+static void finalizeFunction(IRFunction *fn){
+    removeUnreachableBlocks(fn);
+    simplifyPhis(fn);
+
+    for(int i = 0; i < fn->blockCount; i++){
+        IRBlock *block = fn->blocks[i];
+        int kept = 0;
+        for(int k = 0; k < block->instrCount; k++){
+            IRInstr *instr = block->instrs[k];
+            if(instr->op == IR_PHI && findRegister(fn, instr->dest) != instr->dest){
+                fn->registers[instr->dest].def = NULL;
+                freeInstr(instr);
+                continue;
+            }
+            rewriteOperands(fn, instr);
+            block->instrs[kept++] = instr;
+        }
+        block->instrCount = kept;
+        if(block->terminator) rewriteOperands(fn, block->terminator);
+
+        free(block->defs);
+        block->defs = NULL;
+        block->defsCapacity = 0;
+        free(block->incomplete);
+        block->incomplete = NULL;
+        block->incompleteCount = block->incompleteCapacity = 0;
+    }
+
+    // placeholders for phis that turned out trivial are usually left unused
+    bool *used = calloc(fn->registerCount ? fn->registerCount : 1, sizeof(bool));
+    if(!used) outOfMemory();
+    for(int i = 0; i < fn->blockCount; i++){
+        IRBlock *block = fn->blocks[i];
+        for(int k = 0; k <= block->instrCount; k++){
+            IRInstr *instr = k < block->instrCount ? block->instrs[k] : block->terminator;
+            for(int a = 0; a < instr->argCount; a++){
+                used[instr->args[a]] = true;
+            }
+        }
+    }
+
+    IRBlock *entry = fn->blocks[0];
+    int kept = 0;
+    for(int k = 0; k < entry->instrCount; k++){
+        IRInstr *instr = entry->instrs[k];
+        if(instr->op == IR_UNDEF && !used[instr->dest]){
+            fn->registers[instr->dest].def = NULL;
+            freeInstr(instr);
+            continue;
+        }
+        entry->instrs[kept++] = instr;
+    }
+    entry->instrCount = kept;
+    free(used);
+}
+
+static IRFunction *lowerFunction(IRBuilder *b, const char *name, ASTNode *returnType, ASTNode **params, int paramCount, ASTNode **body, int bodyCount){
+    IRBuilder saved = *b;
+
+    IRFunction *fn = calloc(1, sizeof(IRFunction));
+    if(!fn) outOfMemory();
+    fn->name = strdup(name);
+    if(!fn->name) outOfMemory();
+    fn->returnType = returnType ? typeFromNode(returnType) : anyType;
+    fn->paramCount = paramCount;
+
+    if(!GROW(b->module->functions, b->module->functionCount, b->module->functionCapacity)) outOfMemory();
+    b->module->functions[b->module->functionCount++] = fn;
+
+    b->fn = fn;
+    b->handler = NULL;
+    b->varTypes = NULL;
+    b->varCount = b->varCapacity = 0;
+    b->breakTargets = NULL;
+    b->breakCount = b->breakCapacity = 0;
+    b->continueTargets = NULL;
+    b->continueCount = b->continueCapacity = 0;
+    b->labels = NULL;
+    b->labelCount = b->labelCapacity = 0;
+    b->addressTaken = NULL;
+    b->addressTakenCount = b->addressTakenCapacity = 0;
+
+    // locals of the enclosing function are not visible in here
+    int outerBindings = b->bindingCount;
+    for(int i = 0; i < b->bindingCount; i++){
+        if(b->bindings[i].kind != BINDING_GLOBAL){
+            b->bindingCount = i;
+            break;
+        }
+    }
+
+    for(int i = 0; i < paramCount; i++){
+        scanAddressTaken(&params[i], b);
+    }
+    for(int i = 0; i < bodyCount; i++){
+        scanAddressTaken(&body[i], b);
+    }
+
+    IRBlock *entry = newBlock(b);
+    entry->sealed = true;
+    switchTo(b, entry);
+
+    for(int i = 0; i < paramCount; i++){
+        ASTNode *param = params[i];
+        if(!param || param->type != DECLARATION_NODE) continue;
+
+        IRInstr *instr = newInstr(IR_PARAM, typeFromNode(param->declaration.varType), 0);
+        instr->paramIndex = i;
+        if(instr->type.kind == IR_TYPE_VOID) instr->type = anyType;
+        int value = emit(b, instr);
+
+        const char *paramName = param->declaration.varName;
+        if(isAddressTaken(b, paramName)){
+            int slot = emit0(b, IR_SLOT, pointerType);
+            IRInstr *store = newInstr(IR_STORE, voidType, 2);
+            store->args[0] = slot;
+            store->args[1] = value;
+            emit(b, store);
+            bind(b, paramName, BINDING_SLOT, slot);
+        } else{
+            int var = newVariable(b, instr->type);
+            bind(b, paramName, BINDING_SSA, var);
+            writeVariable(entry, var, value);
+        }
+    }
+
+    lowerStatements(b, body, bodyCount);
+
+    IRInstr *ret = newInstr(IR_RETURN, voidType, 0);
+    if(fn->returnType.kind != IR_TYPE_VOID && fn->returnType.kind != IR_TYPE_ANY){
+        ret->argCount = 1;
+        ret->args = malloc(sizeof(int));
+        if(!ret->args) outOfMemory();
+        ret->args[0] = emitUndef(b, fn->returnType);
+    }
+    terminate(b, ret);
+
+    for(int i = 0; i < b->labelCount; i++){
+        sealBlock(b, b->labels[i].block);
+    }
+    for(int i = 0; i < fn->blockCount; i++){
+        sealBlock(b, fn->blocks[i]);
+    }
+    finalizeFunction(fn);
+
+    free(b->varTypes);
+    free(b->breakTargets);
+    free(b->continueTargets);
+    free(b->labels);
+    free(b->addressTaken);
+
+    b->bindingCount = outerBindings;
+    b->fn = saved.fn;
+    b->current = saved.current;
+    b->handler = saved.handler;
+    b->varTypes = saved.varTypes;
+    b->varCount = saved.varCount;
+    b->varCapacity = saved.varCapacity;
+    b->breakTargets = saved.breakTargets;
+    b->breakCount = saved.breakCount;
+    b->breakCapacity = saved.breakCapacity;
+    b->continueTargets = saved.continueTargets;
+    b->continueCount = saved.continueCount;
+    b->continueCapacity = saved.continueCapacity;
+    b->labels = saved.labels;
+    b->labelCount = saved.labelCount;
+    b->labelCapacity = saved.labelCapacity;
+    b->addressTaken = saved.addressTaken;
+    b->addressTakenCount = saved.addressTakenCount;
+    b->addressTakenCapacity = saved.addressTakenCapacity;
+    return fn;
+}
+
+static void addSignature(IRBuilder *b, const char *name, ASTNode *returnType){
+    if(!GROW(b->signatures, b->signatureCount, b->signatureCapacity)) outOfMemory();
+    b->signatures[b->signatureCount].name = name;
+    b->signatures[b->signatureCount].returnType = returnType ? typeFromNode(returnType) : anyType;
+    b->signatureCount++;
+}
+
+static void lowerProgram(IRBuilder *b, ASTNode *program){
+    IRModule *module = b->module;
+    ASTNode **items = &program;
+    int itemCount = program ? 1 : 0;
+    if(program && program->type == BLOCK_NODE){
+        items = program->block.statements;
+        itemCount = program->block.stmtCount;
+    }
+
+    // top-level declarations become globals, everything else runs in __init
+    ASTNode **init = malloc((itemCount ? itemCount : 1) * sizeof(ASTNode *));
+    if(!init) outOfMemory();
+    b->topLevel = init;
+    int initCount = 0;
+    for(int i = 0; i < itemCount; i++){
+        ASTNode *item = items[i];
+        if(!item) continue;
+
+        if(item->type == FUNCTION_NODE){
+            addSignature(b, item->functionDef.name, item->functionDef.returnType);
+        } else if(item->type == DECLARATION_NODE){
+            addGlobal(module, item->declaration.varName);
+            init[initCount++] = item;
+        } else if(item->type == ENUM_NODE){
+            lowerStmt(b, item);
+        } else{
+            init[initCount++] = item;
+        }
+    }
+    for(int i = 0; i < module->globalCount; i++){
+        bind(b, module->globals[i], BINDING_GLOBAL, -1);
+    }
+
+    b->topLevelCount = initCount;
+    if(initCount > 0) lowerFunction(b, "__init", NULL, NULL, 0, init, initCount);
+    for(int i = 0; i < itemCount; i++){
+        if(items[i] && items[i]->type == FUNCTION_NODE) lowerStmt(b, items[i]);
+    }
+}
+
+IRModule *lowerToIR(ASTNode *program){
+    // on the heap, so what it holds is still known after a longjmp
+    IRBuilder *b = calloc(1, sizeof(IRBuilder));
+    if(!b) return NULL;
+    b->module = calloc(1, sizeof(IRModule));
+    if(!b->module){
+        free(b);
+        return NULL;
+    }
+
+    jmp_buf failed;
+    jmp_buf *outer = loweringFailed;
+    loweringFailed = &failed;
+    if(setjmp(failed) == 0){
+        lowerProgram(b, program);
+    } else{
+        // the unfinished function's own builder state is dropped
+        freeIRModule(b->module);
+        b->module = NULL;
+    }
+    loweringFailed = outer;
+
+    IRModule *module = b->module;
+    free(b->topLevel);
+    free(b->bindings);
+    free(b->enums);
+    free(b->signatures);
+    free(b);
+    return module;
+}
+
+void freeIRModule(IRModule *module){
+    if(!module) return;
+
+    for(int i = 0; i < module->functionCount; i++){
+        IRFunction *fn = module->functions[i];
+        for(int k = 0; k < fn->blockCount; k++){
+            freeBlock(fn->blocks[k]);
+        }
+        free(fn->blocks);
+        free(fn->registers);
+        free(fn->name);
+        free(fn);
+    }
+    free(module->functions);
+    for(int i = 0; i < module->globalCount; i++){
+        free(module->globals[i]);
+    }
+    free(module->globals);
+    free(module);
+}
+
+int blockSuccessorCount(IRBlock *block){
+    int count = block->handler ? 1 : 0;
+    if(block->terminator){
+        if(block->terminator->targets[0]) count++;
+        if(block->terminator->targets[1]) count++;
+    }
+    return count;
+}
+
+IRBlock *blockSuccessor(IRBlock *block, int index){
+    if(block->terminator){
+        for(int i = 0; i < 2; i++){
+            if(!block->terminator->targets[i]) continue;
+            if(index == 0) return block->terminator->targets[i];
+            index--;
+        }
+    }
+    return index == 0 ? block->handler : NULL;
+}
+
+// Verifier
+
+static bool fail(char *error, size_t errorSize, const char *format, ...){
+    if(error && errorSize > 0){
+        va_list args;
+        va_start(args, format);
+        vsnprintf(error, errorSize, format, args);
+        va_end(args);
+    }
+    return false;
+}
+
+static int intersect(int *idom, int *order, int a, int b){
+    while(a != b){
+        while(order[a] < order[b]) a = idom[a];
+        while(order[b] < order[a]) b = idom[b];
+    }
+    return a;
+}
+
+// Cooper, Harvey and Kennedy's iterative dominator algorithm over
+// reverse postorder; order[] holds the postorder number of each block.
+static bool computeDominators(IRFunction *fn, int *idom, int *order){
+    int count = fn->blockCount;
+    int *postorder = malloc(count * sizeof(int));
+    int *stack = malloc(count * sizeof(int));
+    int *next = calloc(count, sizeof(int));
+    bool *visited = calloc(count, sizeof(bool));
+    if(!postorder || !stack || !next || !visited){
+        free(postorder);
+        free(stack);
+        free(next);
+        free(visited);
+        return false;
+    }
+
+    int top = 0, visitedCount = 0;
+    stack[top++] = 0;
+    visited[0] = true;
+    while(top > 0){
+        IRBlock *block = fn->blocks[stack[top - 1]];
+        if(next[block->id] < blockSuccessorCount(block)){
+            IRBlock *succ = blockSuccessor(block, next[block->id]++);
+            if(!visited[succ->id]){
+                visited[succ->id] = true;
+                stack[top++] = succ->id;
+            }
+        } else{
+            order[block->id] = visitedCount;
+            postorder[visitedCount++] = block->id;
+            top--;
+        }
+    }
+
+    for(int i = 0; i < count; i++){
+        idom[i] = -1;
+    }
+    idom[0] = 0;
+
+    bool changed = true;
+    while(changed){
+        changed = false;
+        for(int i = visitedCount - 2; i >= 0; i--){
+            IRBlock *block = fn->blocks[postorder[i]];
+            int newIdom = -1;
+            for(int p = 0; p < block->predCount; p++){
+                int pred = block->preds[p]->id;
+                if(idom[pred] == -1) continue;
+                newIdom = newIdom == -1 ? pred : intersect(idom, order, pred, newIdom);
+            }
+            if(newIdom != idom[block->id]){
+                idom[block->id] = newIdom;
+                changed = true;
+            }
+        }
+    }
+
+    free(postorder);
+    free(stack);
+    free(next);
+    free(visited);
+    return true;
+}
+
+static bool dominates(int *idom, int a, int b){
+    while(true){
+        if(a == b) return true;
+        if(b == 0 || idom[b] == -1 || idom[b] == b) return false;
+        b = idom[b];
+    }
+}
+
+static int countEdges(IRBlock *from, IRBlock *to){
+    int count = 0;
+    for(int i = 0; i < blockSuccessorCount(from); i++){
+        if(blockSuccessor(from, i) == to) count++;
+    }
+    return count;
+}
+
+static int countPreds(IRBlock *block, IRBlock *pred){
+    int count = 0;
+    for(int i = 0; i < block->predCount; i++){
+        if(block->preds[i] == pred) count++;
+    }
+    return count;
+}
+
+bool verifyIRFunction(IRFunction *fn, char *error, size_t errorSize){
+    if(fn->blockCount == 0) return fail(error, errorSize, "%s: no blocks", fn->name);
+    if(fn->blocks[0]->predCount != 0) return fail(error, errorSize, "%s: entry block has predecessors", fn->name);
+
+    int *defBlock = malloc((fn->registerCount ? fn->registerCount : 1) * sizeof(int));
+    int *defIndex = malloc((fn->registerCount ? fn->registerCount : 1) * sizeof(int));
+    int *idom = malloc(fn->blockCount * sizeof(int));
+    int *order = malloc(fn->blockCount * sizeof(int));
+    bool ok = defBlock && defIndex && idom && order;
+    if(!ok) fail(error, errorSize, "%s: out of memory", fn->name);
+    for(int r = 0; ok && r < fn->registerCount; r++){
+        defBlock[r] = -1;
+    }
+
+    for(int i = 0; i < fn->blockCount && ok; i++){
+        IRBlock *block = fn->blocks[i];
+        if(block->id != i){
+            ok = fail(error, errorSize, "%s: bb%d has id %d", fn->name, i, block->id);
+            break;
+        }
+        if(!block->terminator || block->terminator->op < IR_JUMP){
+            ok = fail(error, errorSize, "%s: bb%d has no terminator", fn->name, i);
+            break;
+        }
+        for(int s = 0; s < blockSuccessorCount(block); s++){
+            IRBlock *succ = blockSuccessor(block, s);
+            if(countPreds(succ, block) != countEdges(block, succ)){
+                ok = fail(error, errorSize, "%s: edge bb%d -> bb%d missing from predecessors", fn->name, i, succ->id);
+                break;
+            }
+        }
+        for(int p = 0; p < block->predCount && ok; p++){
+            if(countEdges(block->preds[p], block) == 0){
+                ok = fail(error, errorSize, "%s: bb%d lists bb%d as predecessor without an edge", fn->name, i, block->preds[p]->id);
+            }
+        }
+
+        bool inPhis = true;
+        for(int k = 0; k < block->instrCount && ok; k++){
+            IRInstr *instr = block->instrs[k];
+            if(instr->op == IR_PHI){
+                if(!inPhis) ok = fail(error, errorSize, "%s: phi %%%d after non-phi in bb%d", fn->name, instr->dest, i);
+                else if(instr->argCount != block->predCount) ok = fail(error, errorSize, "%s: phi %%%d has %d operands for %d predecessors", fn->name, instr->dest, instr->argCount, block->predCount);
+            } else{
+                inPhis = false;
+            }
+            if(instr->op >= IR_JUMP) ok = fail(error, errorSize, "%s: terminator inside bb%d", fn->name, i);
+            if(instr->dest >= 0){
+                if(instr->dest >= fn->registerCount || defBlock[instr->dest] != -1){
+                    ok = fail(error, errorSize, "%s: register %%%d defined twice", fn->name, instr->dest);
+                } else{
+                    defBlock[instr->dest] = i;
+                    defIndex[instr->dest] = k;
+                }
+            }
+        }
+    }
+
+    if(ok && !computeDominators(fn, idom, order)) ok = fail(error, errorSize, "%s: out of memory", fn->name);
+
+    for(int i = 0; i < fn->blockCount && ok; i++){
+        IRBlock *block = fn->blocks[i];
+        for(int k = 0; k <= block->instrCount && ok; k++){
+            IRInstr *instr = k < block->instrCount ? block->instrs[k] : block->terminator;
+            for(int a = 0; a < instr->argCount && ok; a++){
+                int reg = instr->args[a];
+                if(reg < 0 || reg >= fn->registerCount || defBlock[reg] == -1){
+                    ok = fail(error, errorSize, "%s: use of undefined register %%%d in bb%d", fn->name, reg, i);
+                    break;
+                }
+
+                // a phi operand must be available at the end of its predecessor
+                int useBlock = instr->op == IR_PHI ? block->preds[a]->id : i;
+                int useIndex = instr->op == IR_PHI ? fn->blocks[useBlock]->instrCount : k;
+                if(defBlock[reg] == useBlock){
+                    if(defIndex[reg] >= useIndex) ok = fail(error, errorSize, "%s: %%%d used before its definition in bb%d", fn->name, reg, useBlock);
+                } else if(!dominates(idom, defBlock[reg], useBlock)){
+                    ok = fail(error, errorSize, "%s: definition of %%%d does not dominate its use in bb%d", fn->name, reg, useBlock);
+                }
+            }
+        }
+    }
+
+    free(defBlock);
+    free(defIndex);
+    free(idom);
+    free(order);
+    return ok;
+}
+
+bool verifyIRModule(IRModule *module, char *error, size_t errorSize){
+    for(int i = 0; i < module->functionCount; i++){
+        if(!verifyIRFunction(module->functions[i], error, errorSize)) return false;
+    }
+    return true;
+}
+
+// Textual dump
+
+static const char *opcodeName(IROpcode op){
+    switch(op){
+        case IR_CONST: return "const";
+        case IR_UNDEF: return "undef";
+        case IR_PARAM: return "param";
+        case IR_PHI: return "phi";
+        case IR_UNARY: return "unary";
+        case IR_BINARY: return "binary";
+        case IR_CAST: return "cast";
+        case IR_GLOBAL: return "global";
+        case IR_LOAD_GLOBAL: return "loadglobal";
+        case IR_STORE_GLOBAL: return "storeglobal";
+        case IR_SLOT: return "slot";
+        case IR_LOAD: return "load";
+        case IR_STORE: return "store";
+        case IR_INDEX: return "index";
+        case IR_FIELD: return "field";
+        case IR_ARRAY: return "array";
+        case IR_CALL: return "call";
+        case IR_MALLOC: return "malloc";
+        case IR_CALLOC: return "calloc";
+        case IR_REALLOC: return "realloc";
+        case IR_FREE: return "free";
+        case IR_MEMCPY: return "memcpy";
+        case IR_MEMSET: return "memset";
+        case IR_MEMMOVE: return "memmove";
+        case IR_SIZEOF: return "sizeof";
+        case IR_CATCH: return "catch";
+        case IR_TYPE_TEST: return "typetest";
+        case IR_JUMP: return "jump";
+        case IR_BRANCH: return "branch";
+        case IR_RETURN: return "return";
+        case IR_THROW: return "throw";
+        case IR_UNREACHABLE: return "unreachable";
+    }
+    return "?";
+}
+
+static const char *unaryOpName(UnaryOpType op){
+    static const char *names[] = { "pos", "neg", "not", "bitnot", "preinc", "postinc", "predec", "postdec", "deref", "addr", "sizeof" };
+    return names[op];
+}
+
+static const char *binaryOpName(BinaryOpType op){
+    static const char *names[] = { "add", "sub", "mul", "div", "mod", "and", "or", "bitand", "bitor", "bitxor", "shl", "shr", "eq", "ne", "lt", "le", "gt", "ge", "comma" };
+    return names[op];
+}
+
+static void dumpType(IRType type, FILE *out){
+    switch(type.kind){
+        case IR_TYPE_VOID: fprintf(out, "void"); break;
+        case IR_TYPE_PRIMITIVE: fprintf(out, "%s", primitiveTypeName(type.primitive)); break;
+        case IR_TYPE_POINTER: fprintf(out, "ptr"); break;
+        case IR_TYPE_ANY: fprintf(out, "any"); break;
+    }
+}
+
+static void dumpConstant(IRInstr *instr, FILE *out){
+    if(instr->type.kind != IR_TYPE_PRIMITIVE){
+        fprintf(out, "null");
+        return;
+    }
+
+    PrimitiveType type = instr->type.primitive;
+    PrimitiveValue value = instr->constant;
+    if(type == TYPE_STRING) fprintf(out, "\"%s\"", value.stringVal);
+    else if(type == TYPE_BOOL) fprintf(out, "%s", value.boolVal ? "true" : "false");
+    else if(isFloatingType(type)) fprintf(out, "%Lg", convertPrimitive(type, value, TYPE_LONG_DOUBLE).longDoubleVal);
+    else if(isSignedType(type)) fprintf(out, "%lld", convertPrimitive(type, value, TYPE_LONG_LONG).longLongVal);
+    else fprintf(out, "%llu", convertPrimitive(type, value, TYPE_ULONG_LONG).uLongLongVal);
+}
+
+static void dumpInstr(IRBlock *block, IRInstr *instr, FILE *out){
+    fprintf(out, "    ");
+    if(instr->dest >= 0){
+        fprintf(out, "%%%d: ", instr->dest);
+        dumpType(instr->type, out);
+        fprintf(out, " = ");
+    }
+    fprintf(out, "%s", opcodeName(instr->op));
+
+    switch(instr->op){
+        case IR_CONST:
+            fprintf(out, " ");
+            dumpConstant(instr, out);
+            break;
+        case IR_PARAM:
+            fprintf(out, " %d", instr->paramIndex);
+            break;
+        case IR_UNARY:
+            fprintf(out, " %s", unaryOpName(instr->unaryOp));
+            break;
+        case IR_BINARY:
+            fprintf(out, " %s", binaryOpName(instr->binaryOp));
+            break;
+        case IR_GLOBAL:
+        case IR_LOAD_GLOBAL:
+        case IR_STORE_GLOBAL:
+        case IR_FIELD:
+            fprintf(out, " @%s", instr->symbol);
+            break;
+        case IR_TYPE_TEST:
+            fprintf(out, " ");
+            dumpType(instr->testType, out);
+            break;
+        default:
+            break;
+    }
+
+    for(int i = 0; i < instr->argCount; i++){
+        fprintf(out, "%s%%%d", i == 0 && instr->op != IR_PHI ? " " : i == 0 ? " [" : ", ", instr->args[i]);
+        if(instr->op == IR_PHI) fprintf(out, " bb%d", block->preds[i]->id);
+    }
+    if(instr->op == IR_PHI && instr->argCount > 0) fprintf(out, "]");
+
+    for(int i = 0; i < 2; i++){
+        if(instr->targets[i]) fprintf(out, "%sbb%d", instr->argCount > 0 || i > 0 ? ", " : " ", instr->targets[i]->id);
+    }
+    fprintf(out, "\n");
+}
+
+void dumpIRFunction(IRFunction *fn, FILE *out){
+    fprintf(out, "fun %s(", fn->name);
+    IRBlock *entry = fn->blocks[0];
+    bool first = true;
+    for(int k = 0; k < entry->instrCount; k++){
+        IRInstr *instr = entry->instrs[k];
+        if(instr->op != IR_PARAM) continue;
+        fprintf(out, "%s%%%d: ", first ? "" : ", ", instr->dest);
+        dumpType(instr->type, out);
+        first = false;
+    }
+    fprintf(out, ") -> ");
+    dumpType(fn->returnType, out);
+    fprintf(out, " {\n");
+
+    for(int i = 0; i < fn->blockCount; i++){
+        IRBlock *block = fn->blocks[i];
+        fprintf(out, "bb%d:", block->id);
+        if(block->predCount > 0){
+            fprintf(out, "    ; preds");
+            for(int p = 0; p < block->predCount; p++){
+                fprintf(out, " bb%d", block->preds[p]->id);
+            }
+        }
+        if(block->handler) fprintf(out, "    ; unwind bb%d", block->handler->id);
+        fprintf(out, "\n");
+
+        for(int k = 0; k < block->instrCount; k++){
+            dumpInstr(block, block->instrs[k], out);
+        }
+        if(block->terminator) dumpInstr(block, block->terminator, out);
+    }
+    fprintf(out, "}\n");
+}
+
+void dumpIRModule(IRModule *module, FILE *out){
+    for(int i = 0; i < module->globalCount; i++){
+        fprintf(out, "global @%s\n", module->globals[i]);
+    }
+    if(module->globalCount > 0) fprintf(out, "\n");
+
+    for(int i = 0; i < module->functionCount; i++){
+        if(i > 0) fprintf(out, "\n");
+        dumpIRFunction(module->functions[i], out);
+    }
+}
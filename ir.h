@@ -0,0 +1,144 @@
+#ifndef IR_H
+#define IR_H
+
+#include "ast.h"
+#include <stdio.h>
+
+typedef enum {
+    IR_TYPE_VOID,
+    IR_TYPE_PRIMITIVE,
+    IR_TYPE_POINTER,
+    IR_TYPE_ANY
+} IRTypeKind;
+
+typedef struct {
+    IRTypeKind kind;
+    PrimitiveType primitive;
+} IRType;
+
+typedef enum {
+    IR_CONST,
+    IR_UNDEF,
+    IR_PARAM,
+    IR_PHI,
+    IR_UNARY,
+    IR_BINARY,
+    IR_CAST,
+
+    IR_GLOBAL,          // address of a global variable or function
+    IR_LOAD_GLOBAL,
+    IR_STORE_GLOBAL,
+    IR_SLOT,            // stack slot for a local whose address is taken
+    IR_LOAD,
+    IR_STORE,
+    IR_INDEX,           // address of an array element
+    IR_FIELD,           // address of a struct field
+    IR_ARRAY,           // array value built from its elements
+
+    IR_CALL,
+    IR_MALLOC,
+    IR_CALLOC,
+    IR_REALLOC,
+    IR_FREE,
+    IR_MEMCPY,
+    IR_MEMSET,
+    IR_MEMMOVE,
+    IR_SIZEOF,
+
+    IR_CATCH,           // exception value at the start of a handler
+    IR_TYPE_TEST,
+
+    IR_JUMP,
+    IR_BRANCH,
+    IR_RETURN,
+    IR_THROW,
+    IR_UNREACHABLE
+} IROpcode;
+
+typedef struct IRBlock IRBlock;
+
+typedef struct {
+    IROpcode op;
+    int dest;
+    IRType type;
+    int *args;
+    int argCount;
+    union {
+        PrimitiveValue constant;
+        UnaryOpType unaryOp;
+        BinaryOpType binaryOp;
+        char *symbol;
+        int paramIndex;
+        IRType testType;
+    };
+    IRBlock *targets[2];
+} IRInstr;
+
+typedef struct {
+    IRType type;
+    IRInstr *def;
+    int replacement;
+} IRRegister;
+
+typedef struct {
+    int var;
+    IRInstr *phi;
+} IRIncompletePhi;
+
+struct IRBlock {
+    int id;
+    IRInstr **instrs;
+    int instrCount;
+    int instrCapacity;
+    IRInstr *terminator;
+
+    IRBlock **preds;
+    int predCount;
+    int predCapacity;
+    IRBlock *handler;
+
+    bool sealed;
+    int *defs;
+    int defsCapacity;
+    IRIncompletePhi *incomplete;
+    int incompleteCount;
+    int incompleteCapacity;
+};
+
+typedef struct {
+    char *name;
+    IRType returnType;
+    int paramCount;
+
+    IRBlock **blocks;
+    int blockCount;
+    int blockCapacity;
+
+    IRRegister *registers;
+    int registerCount;
+    int registerCapacity;
+} IRFunction;
+
+typedef struct {
+    IRFunction **functions;
+    int functionCount;
+    int functionCapacity;
+
+    char **globals;
+    int globalCount;
+    int globalCapacity;
+} IRModule;
+
+IRModule *lowerToIR(ASTNode *program);
+void freeIRModule(IRModule *module);
+
+int blockSuccessorCount(IRBlock *block);
+IRBlock *blockSuccessor(IRBlock *block, int index);
+
+bool verifyIRFunction(IRFunction *fn, char *error, size_t errorSize);
+bool verifyIRModule(IRModule *module, char *error, size_t errorSize);
+
+void dumpIRFunction(IRFunction *fn, FILE *out);
+void dumpIRModule(IRModule *module, FILE *out);
+
+#endif
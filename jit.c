@@ -0,0 +1,1072 @@
+#include "jit.h"
+#include "atomics.h"
+#include "primitive.h"
+#include "utils.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Each compilation maps a chunk of its own.
+typedef struct {
+    uint8_t *code;
+    size_t mappedSize;
+} JitChunk;
+
+struct JitModule {
+    const RegisterModule *source;
+    JitOptions options;
+    bool *compilable;
+    JitEntry *entries;
+    uint8_t **tailEntries;          // past the prologue, where tail calls land
+    JitEntry **loopEntries;         // per instruction, set at loop headers
+    JitChunk *chunks;
+    int chunkCount;
+    int chunkCapacity;
+    int compiledCount;
+};
+
+JitOptions defaultJitOptions(void){
+    return (JitOptions){.perfMap = getenv("NEWLEAF_PERF_MAP") != NULL};
+}
+
+JitEntry jitEntry(const JitModule *jit, int function){
+    return jit && function >= 0 && function < jit->source->functionCount ? jit->entries[function] : NULL;
+}
+
+JitEntry jitLoopEntry(const JitModule *jit, int function, int instruction){
+    if(!jit || function < 0 || function >= jit->source->functionCount || !jit->loopEntries[function]) return NULL;
+    if(instruction < 0 || instruction >= jit->source->functions[function].codeSize) return NULL;
+    return jit->loopEntries[function][instruction];
+}
+
+int jitCompiledCount(const JitModule *jit){
+    return jit ? jit->compiledCount : 0;
+}
+
+#ifdef JIT_X86_64
+
+enum { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSI = 6, RDI = 7, R12 = 12, R13 = 13 };
+enum { XMM0 = 0, XMM1 = 1 };
+
+// condition codes as they appear in jcc and setcc
+enum {
+    CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_A = 0x7,
+    CC_P = 0xA, CC_NP = 0xB, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF
+};
+
+// rbx holds the frame, r12 the context and r13 the globals in every
+// compiled function
+#define SLOT(index) ((int32_t)(index) * 8)
+#define CONTEXT(field) ((int32_t)offsetof(JitContext, field))
+
+typedef enum {
+    PATCH_INSTRUCTION,          // target is an instruction of the current function
+    PATCH_STUB,                 // target is an out-of-line error exit
+    PATCH_ENTRY,                // target is a function's entry
+    PATCH_TAIL_ENTRY            // target is a function's entry past the prologue
+} PatchKind;
+
+typedef struct {
+    int site;                   // offset of the rel32 field
+    PatchKind kind;
+    int target;
+} Patch;
+
+// An error exit emitted after the function body, away from the hot path.
+typedef struct {
+    int status;                 // -1 leaves the callee's status in eax
+    int data;
+    int offset;
+} Stub;
+
+typedef struct {
+    const RegisterModule *module;
+    const JitModule *jit;
+    const bool *selected;           // the functions going into this chunk
+    uint8_t *code;
+    int size;
+    int capacity;
+    Patch *patches;
+    int patchCount;
+    int patchCapacity;
+    Stub *stubs;
+    int stubCount;
+    int stubCapacity;
+    int *instructionOffsets;
+    int *entryOffsets;
+    int *tailOffsets;
+    int *endOffsets;
+    int **loopOffsets;
+    bool outOfMemory;               // sticky; emission carries on and compileChunk fails
+} Assembler;
+
+static void emitByte(Assembler *as, uint8_t byte){
+    if(as->outOfMemory || !GROW(as->code, as->size, as->capacity)){
+        as->outOfMemory = true;
+        return;
+    }
+    as->code[as->size++] = byte;
+}
+
+static void emitBytes(Assembler *as, const char *bytes, int count){
+    for(int i = 0; i < count; i++) emitByte(as, (uint8_t)bytes[i]);
+}
+
+static void emit32(Assembler *as, uint32_t value){
+    for(int i = 0; i < 4; i++) emitByte(as, (uint8_t)(value >> (8 * i)));
+}
+
+static void emit64(Assembler *as, uint64_t value){
+    emit32(as, (uint32_t)value);
+    emit32(as, (uint32_t)(value >> 32));
+}
+
+#define EMIT(as, bytes) emitBytes(as, bytes, (int)sizeof(bytes) - 1)
+
+// op reg, [base + disp32] with an optional mandatory prefix, which has to
+// precede REX
+static void emitMemory(Assembler *as, uint8_t prefix, bool wide, const char *op, int opLength, int reg, int base, int32_t disp){
+    if(prefix) emitByte(as, prefix);
+    uint8_t rex = 0x40 | (wide ? 8 : 0) | (reg & 8 ? 4 : 0) | (base & 8 ? 1 : 0);
+    if(rex != 0x40) emitByte(as, rex);
+    emitBytes(as, op, opLength);
+    emitByte(as, 0x80 | (reg & 7) << 3 | (base & 7));
+    if((base & 7) == 4) emitByte(as, 0x24);
+    emit32(as, (uint32_t)disp);
+}
+
+// op reg, [base + rcx * 8 + disp32]
+static void emitIndexed(Assembler *as, bool wide, const char *op, int opLength, int reg, int base, int32_t disp){
+    uint8_t rex = 0x40 | (wide ? 8 : 0) | (reg & 8 ? 4 : 0) | (base & 8 ? 1 : 0);
+    if(rex != 0x40) emitByte(as, rex);
+    emitBytes(as, op, opLength);
+    emitByte(as, 0x84 | (reg & 7) << 3);
+    emitByte(as, 0xC0 | RCX << 3 | (base & 7));
+    emit32(as, (uint32_t)disp);
+}
+
+#define MEMORY(as, prefix, wide, op, reg, base, disp) emitMemory(as, prefix, wide, op, (int)sizeof(op) - 1, reg, base, disp)
+#define INDEXED(as, wide, op, reg, base, disp) emitIndexed(as, wide, op, (int)sizeof(op) - 1, reg, base, disp)
+
+static void load(Assembler *as, int reg, int slot){
+    MEMORY(as, 0, true, "\x8B", reg, RBX, SLOT(slot));
+}
+
+static void store(Assembler *as, int slot, int reg){
+    MEMORY(as, 0, true, "\x89", reg, RBX, SLOT(slot));
+}
+
+static void loadDouble(Assembler *as, int xmm, int slot){
+    MEMORY(as, 0xF2, false, "\x0F\x10", xmm, RBX, SLOT(slot));
+}
+
+static void storeDouble(Assembler *as, int slot, int xmm){
+    MEMORY(as, 0xF2, false, "\x0F\x11", xmm, RBX, SLOT(slot));
+}
+
+// cmp qword [rbx + slot], 0
+static void compareZero(Assembler *as, int slot){
+    MEMORY(as, 0, true, "\x83", 7, RBX, SLOT(slot));
+    emitByte(as, 0);
+}
+
+// ucomisd xmm, [rbx + slot]
+static void compareDouble(Assembler *as, int xmm, int slot){
+    MEMORY(as, 0x66, false, "\x0F\x2E", xmm, RBX, SLOT(slot));
+}
+
+static void compareWithZeroDouble(Assembler *as, int slot){
+    EMIT(as, "\x66\x0F\x57\xC9");               // xorpd xmm1, xmm1
+    compareDouble(as, XMM1, slot);
+}
+
+static void storeFlag(Assembler *as, int slot){
+    EMIT(as, "\x0F\xB6\xC0");                   // movzx eax, al
+    store(as, slot, RAX);
+}
+
+static void setFlag(Assembler *as, int cc, int slot){
+    emitByte(as, 0x0F);
+    emitByte(as, 0x90 | cc);
+    emitByte(as, 0xC0);
+    storeFlag(as, slot);
+}
+
+// ucomisd reports unordered through the parity flag, which decides == and !=
+static void setOrderedEqual(Assembler *as, int slot){
+    EMIT(as, "\x0F\x94\xC0\x0F\x9B\xC1\x20\xC8");  // sete al; setnp cl; and al, cl
+    storeFlag(as, slot);
+}
+
+static void setUnorderedNotEqual(Assembler *as, int slot){
+    EMIT(as, "\x0F\x95\xC0\x0F\x9A\xC1\x08\xC8");  // setne al; setp cl; or al, cl
+    storeFlag(as, slot);
+}
+
+static void emitEpilogue(Assembler *as){
+    EMIT(as, "\x41\x5D\x41\x5C\x5B\xC3");       // pop r13; pop r12; pop rbx; ret
+}
+
+static void addPatch(Assembler *as, PatchKind kind, int target){
+    if(!GROW(as->patches, as->patchCount, as->patchCapacity)){
+        as->outOfMemory = true;
+        return;
+    }
+    as->patches[as->patchCount++] = (Patch){as->size, kind, target};
+    emit32(as, 0);
+}
+
+static void jump(Assembler *as, PatchKind kind, int target){
+    emitByte(as, 0xE9);
+    addPatch(as, kind, target);
+}
+
+static void jumpIf(Assembler *as, int cc, PatchKind kind, int target){
+    emitByte(as, 0x0F);
+    emitByte(as, 0x80 | cc);
+    addPatch(as, kind, target);
+}
+
+static void failIf(Assembler *as, int cc, int status, int data){
+    if(!GROW(as->stubs, as->stubCount, as->stubCapacity)){
+        as->outOfMemory = true;
+        return;
+    }
+    as->stubs[as->stubCount] = (Stub){status, data, 0};
+    jumpIf(as, cc, PATCH_STUB, as->stubCount++);
+}
+
+// Short forward jumps inside one template.
+static int shortJump(Assembler *as, uint8_t opcode){
+    emitByte(as, opcode);
+    emitByte(as, 0);
+    return as->size - 1;
+}
+
+static void landShortJump(Assembler *as, int site){
+    if(as->outOfMemory) return;
+    as->code[site] = (uint8_t)(as->size - site - 1);
+}
+
+static void callAbsolute(Assembler *as, void *helper){
+    EMIT(as, "\x48\xB8");                       // mov rax, imm64; call rax
+    emit64(as, (uint64_t)(uintptr_t)helper);
+    EMIT(as, "\xFF\xD0");
+}
+
+// Helpers for the instructions too long to inline. They keep to the C
+// calling convention, which preserves rbx, r12 and r13.
+
+static void jitU2F(VMValue *target, const VMValue *source){
+    target->f = (double)source->u;
+}
+
+static void jitF2I(VMValue *target, const VMValue *source, int type){
+    PrimitiveValue value;
+    value.doubleVal = source->f;
+    *target = primitiveToVMValue(type, convertPrimitive(TYPE_DOUBLE, value, type));
+}
+
+// JIT_RETURNED_VOID when the update went through.
+static int jitAtomicUpdate(VMValue *slot, VMValue *result, const VMValue *operand, int operation){
+    switch(atomicUpdate(slot, (uint8_t)operation, *operand, result)){
+        case ATOMIC_DIVISION_BY_ZERO: return JIT_DIVISION_BY_ZERO;
+        case ATOMIC_INVALID_SHIFT: return JIT_INVALID_SHIFT;
+        default: return JIT_RETURNED_VOID;
+    }
+}
+
+static void jitPrint(JitContext *ctx, const VMValue *values, int count, const uint8_t *types){
+    for(int i = 0; i < count; i++){
+        Value value = makePrimitiveValue(types[i], vmValueToPrimitive(types[i], values[i]));
+        if(i > 0) fputc(' ', ctx->out);
+        printValue(&value, ctx->out);
+    }
+    fputc('\n', ctx->out);
+}
+
+static void emitFrameSetup(Assembler *as, const RegisterFunction *fn){
+    int zeroed = fn->localCount - fn->paramCount;
+    if(zeroed > 8){
+        MEMORY(as, 0, true, "\x8D", RDI, RBX, SLOT(fn->paramCount));   // lea rdi
+        emitByte(as, 0xB9);                                             // mov ecx, imm32
+        emit32(as, (uint32_t)zeroed);
+        EMIT(as, "\x31\xC0\xF3\x48\xAB");                               // xor eax, eax; rep stosq
+    } else if(zeroed > 0){
+        EMIT(as, "\x31\xC0");
+        for(int i = fn->paramCount; i < fn->localCount; i++) store(as, i, RAX);
+    }
+    for(int i = 0; i < fn->constantCount; i++){
+        EMIT(as, "\x48\xB8");
+        emit64(as, fn->constants[i].u);
+        store(as, fn->constantBase + i, RAX);
+    }
+}
+
+static void emitCallArguments(Assembler *as, const RegisterFunction *callee, int from, int to){
+    for(int i = 0; i < callee->paramCount; i++){
+        load(as, RAX, from + i);
+        store(as, to + i, RAX);
+    }
+}
+
+static void emitStackCheck(Assembler *as, int frameEnd, int callee){
+    MEMORY(as, 0, true, "\x8D", RDI, RBX, SLOT(frameEnd));             // lea rdi
+    MEMORY(as, 0, true, "\x3B", RDI, R12, CONTEXT(end));               // cmp rdi, [end]
+    failIf(as, CC_A, JIT_STACK_OVERFLOW, callee);
+}
+
+static void emitCall(Assembler *as, const RegisterFunction *fn, const RegisterInstruction *in){
+    const RegisterFunction *callee = &as->module->functions[in->b];
+    MEMORY(as, 0, false, "\x8B", RAX, R12, CONTEXT(depth));
+    MEMORY(as, 0, false, "\x3B", RAX, R12, CONTEXT(maxDepth));
+    failIf(as, CC_GE, JIT_CALL_DEPTH, 0);
+    emitStackCheck(as, fn->frameSize + callee->frameSize, in->b);
+
+    emitCallArguments(as, callee, in->c, fn->frameSize);
+    MEMORY(as, 0, true, "\xFF", 0, R12, CONTEXT(calls));              // inc qword
+    MEMORY(as, 0, false, "\xFF", 0, R12, CONTEXT(depth));             // inc dword
+    MEMORY(as, 0, true, "\x8D", RDI, RBX, SLOT(fn->frameSize));
+    EMIT(as, "\x4C\x89\xE6");                                           // mov rsi, r12
+    if(as->selected[in->b]){
+        emitByte(as, 0xE8);
+        addPatch(as, PATCH_ENTRY, in->b);
+    } else{
+        callAbsolute(as, (void *)as->jit->entries[in->b]);               // compiled into an earlier chunk
+    }
+    MEMORY(as, 0, false, "\xFF", 1, R12, CONTEXT(depth));             // dec dword
+    EMIT(as, "\x83\xF8\x01");                                           // cmp eax, 1
+    failIf(as, CC_A, -1, 0);
+    if(!callee->returnsVoid){
+        load(as, RAX, fn->frameSize);
+        store(as, in->a, RAX);
+    }
+}
+
+static void emitTailCall(Assembler *as, const RegisterInstruction *in){
+    const RegisterFunction *callee = &as->module->functions[in->b];
+    emitStackCheck(as, callee->frameSize, in->b);
+    // ascending copies are safe as the arguments never sit below register 0
+    emitCallArguments(as, callee, in->c, 0);
+    MEMORY(as, 0, true, "\xFF", 0, R12, CONTEXT(calls));
+    MEMORY(as, 0, true, "\xFF", 0, R12, CONTEXT(tailCalls));
+    if(as->selected[in->b]){
+        jump(as, PATCH_TAIL_ENTRY, in->b);
+    } else{
+        EMIT(as, "\x48\xB8");                                           // mov rax, imm64; jmp rax
+        emit64(as, (uint64_t)(uintptr_t)as->jit->tailEntries[in->b]);
+        EMIT(as, "\xFF\xE0");
+    }
+}
+
+static void emitBinary(Assembler *as, const char *op, int opLength, const RegisterInstruction *in, bool wrap32){
+    load(as, RAX, in->b);
+    emitMemory(as, 0, true, op, opLength, RAX, RBX, SLOT(in->c));
+    if(wrap32) EMIT(as, "\x48\x63\xC0");                              // movsxd rax, eax
+    store(as, in->a, RAX);
+}
+
+static void emitUnary(Assembler *as, const char *op, const RegisterInstruction *in, bool wrap32){
+    load(as, RAX, in->b);
+    EMIT(as, "\x48");
+    emitBytes(as, op, 2);
+    if(wrap32) EMIT(as, "\x48\x63\xC0");
+    store(as, in->a, RAX);
+}
+
+static void emitDouble(Assembler *as, uint8_t op, const RegisterInstruction *in){
+    loadDouble(as, XMM0, in->b);
+    char bytes[2] = {0x0F, (char)op};
+    emitMemory(as, 0xF2, false, bytes, 2, XMM0, RBX, SLOT(in->c));
+    storeDouble(as, in->a, XMM0);
+}
+
+static void emitDivision(Assembler *as, const RegisterInstruction *in, bool isSigned, bool remainder){
+    load(as, RCX, in->c);
+    EMIT(as, "\x48\x85\xC9");                                           // test rcx, rcx
+    failIf(as, CC_E, JIT_DIVISION_BY_ZERO, 0);
+    load(as, RAX, in->b);
+    if(!isSigned){
+        EMIT(as, "\x31\xD2\x48\xF7\xF1");                               // xor edx, edx; div rcx
+    } else{
+        // MIN / -1 wraps to MIN and MIN % -1 is 0 instead of trapping
+        EMIT(as, "\x48\x83\xF9\xFF");                                   // cmp rcx, -1
+        int divide = shortJump(as, 0x75);
+        if(remainder) EMIT(as, "\x31\xC0");                             // xor eax, eax
+        else EMIT(as, "\x48\xF7\xD8");                                  // neg rax
+        int done = shortJump(as, 0xEB);
+        landShortJump(as, divide);
+        EMIT(as, "\x48\x99\x48\xF7\xF9");                               // cqo; idiv rcx
+        if(remainder) EMIT(as, "\x48\x89\xD0");                         // mov rax, rdx
+        landShortJump(as, done);
+        store(as, in->a, RAX);
+        return;
+    }
+    if(remainder) EMIT(as, "\x48\x89\xD0");
+    store(as, in->a, RAX);
+}
+
+// op reg, [r13 + slot] or, indexed, [r13 + rcx * 8 + slot]; lock applies
+// to read-modify-write ops and has to precede REX.
+static void emitGlobal(Assembler *as, bool indexed, bool lock, const char *op, int opLength, int reg, int slot){
+    if(indexed){
+        if(lock) emitByte(as, 0xF0);
+        emitIndexed(as, true, op, opLength, reg, R13, SLOT(slot));
+    } else{
+        emitMemory(as, lock ? 0xF0 : 0, true, op, opLength, reg, R13, SLOT(slot));
+    }
+}
+
+#define GLOBAL(as, indexed, lock, op, reg, slot) emitGlobal(as, indexed, lock, op, (int)sizeof(op) - 1, reg, slot)
+
+// 64-bit sums and differences are one lock xadd; every other update goes
+// through the runtime's compare and swap. The indexed form reads its
+// operand from the register it writes.
+static void emitAtomicUpdate(Assembler *as, const RegisterInstruction *in){
+    bool indexed = in->op == ROP_ATOMIC_UPDATE_INDEXED;
+    int operand = indexed ? in->a : in->c;
+    AtomicOp op = ATOMIC_OPERATION_OP(in->aux);
+    AtomicKind kind = ATOMIC_OPERATION_KIND(in->aux);
+    bool adds = op == ATOMIC_ADD || op == ATOMIC_FETCH_ADD;
+    bool subtracts = op == ATOMIC_SUB || op == ATOMIC_FETCH_SUB;
+    if(indexed) load(as, RCX, in->c);
+
+    if((kind == ATOMIC_I64 || kind == ATOMIC_U64) && (adds || subtracts)){
+        load(as, RDX, operand);
+        EMIT(as, "\x48\x89\xD0");                                           // mov rax, rdx
+        if(subtracts) EMIT(as, "\x48\xF7\xD8");                             // neg rax
+        GLOBAL(as, indexed, true, "\x0F\xC1", RAX, in->b);                   // lock xadd
+        if(op == ATOMIC_ADD) EMIT(as, "\x48\x01\xD0");                      // add rax, rdx
+        if(op == ATOMIC_SUB) EMIT(as, "\x48\x29\xD0");                      // sub rax, rdx
+        store(as, in->a, RAX);
+        return;
+    }
+    GLOBAL(as, indexed, false, "\x8D", RDI, in->b);                            // lea
+    MEMORY(as, 0, true, "\x8D", RSI, RBX, SLOT(in->a));
+    MEMORY(as, 0, true, "\x8D", RDX, RBX, SLOT(operand));
+    emitByte(as, 0xB9);                                                     // mov ecx, imm32
+    emit32(as, in->aux);
+    callAbsolute(as, (void *)jitAtomicUpdate);
+    EMIT(as, "\x83\xF8");                                                   // cmp eax, imm8
+    emitByte(as, JIT_DIVISION_BY_ZERO);
+    failIf(as, CC_E, JIT_DIVISION_BY_ZERO, 0);
+    EMIT(as, "\x83\xF8");
+    emitByte(as, JIT_INVALID_SHIFT);
+    failIf(as, CC_E, JIT_INVALID_SHIFT, 0);
+}
+
+static void emitShift(Assembler *as, const RegisterInstruction *in, uint8_t modrm){
+    load(as, RCX, in->c);
+    EMIT(as, "\x48\x83\xF9");                                           // cmp rcx, imm8
+    emitByte(as, in->aux);
+    failIf(as, CC_AE, JIT_INVALID_SHIFT, 0);                            // negative counts compare above too
+    load(as, RAX, in->b);
+    EMIT(as, "\x48\xD3");
+    emitByte(as, modrm);
+    store(as, in->a, RAX);
+}
+
+static void emitCompare(Assembler *as, const RegisterInstruction *in, int cc){
+    load(as, RAX, in->b);
+    MEMORY(as, 0, true, "\x3B", RAX, RBX, SLOT(in->c));
+    setFlag(as, cc, in->a);
+}
+
+// x < y is tested as y > x so that unordered operands come out false
+static void emitCompareDouble(Assembler *as, const RegisterInstruction *in, int cc, bool swap){
+    loadDouble(as, XMM0, swap ? in->c : in->b);
+    compareDouble(as, XMM0, swap ? in->b : in->c);
+    setFlag(as, cc, in->a);
+}
+
+static void emitBranch(Assembler *as, const RegisterInstruction *in, int cc){
+    load(as, RAX, in->a);
+    MEMORY(as, 0, true, "\x3B", RAX, RBX, SLOT(in->b));
+    jumpIf(as, cc, PATCH_INSTRUCTION, in->c);
+}
+
+static void emitBranchDouble(Assembler *as, const RegisterInstruction *in, int cc, bool swap){
+    loadDouble(as, XMM0, swap ? in->b : in->a);
+    compareDouble(as, XMM0, swap ? in->a : in->b);
+    jumpIf(as, cc, PATCH_INSTRUCTION, in->c);
+}
+
+static void emitIncrementBranch(Assembler *as, const RegisterInstruction *in, int cc){
+    load(as, RAX, in->a);
+    EMIT(as, "\x48\x83\xC0\x01\x48\x63\xC0");                           // add rax, 1; movsxd rax, eax
+    store(as, in->a, RAX);
+    MEMORY(as, 0, true, "\x3B", RAX, RBX, SLOT(in->b));
+    jumpIf(as, cc, PATCH_INSTRUCTION, in->c);
+}
+
+static void emitInstruction(Assembler *as, const RegisterFunction *fn, const RegisterInstruction *in){
+    switch((RegisterOpcode)in->op){
+        case ROP_MOVE:
+            load(as, RAX, in->b);
+            store(as, in->a, RAX);
+            break;
+        case ROP_LOAD_GLOBAL:
+            MEMORY(as, 0, true, "\x8B", RAX, R13, SLOT(in->b));
+            store(as, in->a, RAX);
+            break;
+        case ROP_STORE_GLOBAL:
+            load(as, RAX, in->b);
+            MEMORY(as, 0, true, "\x89", RAX, R13, SLOT(in->a));
+            break;
+        case ROP_LOAD_INDEXED:
+        case ROP_LOAD_GLOBAL_INDEXED:
+            load(as, RCX, in->c);
+            INDEXED(as, true, "\x8B", RAX, in->op == ROP_LOAD_INDEXED ? RBX : R13, SLOT(in->b));
+            store(as, in->a, RAX);
+            break;
+        case ROP_STORE_INDEXED:
+        case ROP_STORE_GLOBAL_INDEXED:
+            load(as, RCX, in->b);
+            load(as, RAX, in->c);
+            INDEXED(as, true, "\x89", RAX, in->op == ROP_STORE_INDEXED ? RBX : R13, SLOT(in->a));
+            break;
+        case ROP_ATOMIC_LOAD:
+        case ROP_ATOMIC_LOAD_INDEXED:
+            // plain loads are sequentially consistent on x86-64
+            if(in->op == ROP_ATOMIC_LOAD_INDEXED) load(as, RCX, in->c);
+            GLOBAL(as, in->op == ROP_ATOMIC_LOAD_INDEXED, false, "\x8B", RAX, in->b);
+            store(as, in->a, RAX);
+            break;
+        case ROP_ATOMIC_STORE:
+        case ROP_ATOMIC_STORE_INDEXED:
+            // stores are not, so they go through xchg, which locks
+            if(in->op == ROP_ATOMIC_STORE_INDEXED){
+                load(as, RCX, in->b);
+                load(as, RAX, in->c);
+            } else{
+                load(as, RAX, in->b);
+            }
+            GLOBAL(as, in->op == ROP_ATOMIC_STORE_INDEXED, false, "\x87", RAX, in->a);
+            break;
+        case ROP_ATOMIC_UPDATE:
+        case ROP_ATOMIC_UPDATE_INDEXED:
+            emitAtomicUpdate(as, in);
+            break;
+        case ROP_CHECK_INDEX: {
+            uint32_t length = in->b | (uint32_t)in->c << 16;
+            load(as, RAX, in->a);
+            EMIT(as, "\x48\x3D");                                       // cmp rax, imm32
+            emit32(as, length);
+            failIf(as, CC_AE, JIT_INDEX_OUT_OF_BOUNDS, (int)length);
+            break;
+        }
+        case ROP_CLEAR:
+            MEMORY(as, 0, true, "\x8D", RDI, RBX, SLOT(in->a));
+            emitByte(as, 0xB9);
+            emit32(as, in->b);
+            EMIT(as, "\x31\xC0\xF3\x48\xAB");
+            break;
+        case ROP_ADD_I32: emitBinary(as, "\x03", 1, in, true); break;
+        case ROP_SUB_I32: emitBinary(as, "\x2B", 1, in, true); break;
+        case ROP_MUL_I32: emitBinary(as, "\x0F\xAF", 2, in, true); break;
+        case ROP_NEG_I32: emitUnary(as, "\xF7\xD8", in, true); break;
+        case ROP_ADD_I64: emitBinary(as, "\x03", 1, in, false); break;
+        case ROP_SUB_I64: emitBinary(as, "\x2B", 1, in, false); break;
+        case ROP_MUL_I64: emitBinary(as, "\x0F\xAF", 2, in, false); break;
+        case ROP_NEG_I64: emitUnary(as, "\xF7\xD8", in, false); break;
+        case ROP_DIV_I: emitDivision(as, in, true, false); break;
+        case ROP_MOD_I: emitDivision(as, in, true, true); break;
+        case ROP_DIV_U: emitDivision(as, in, false, false); break;
+        case ROP_MOD_U: emitDivision(as, in, false, true); break;
+        case ROP_ADD_F: emitDouble(as, 0x58, in); break;
+        case ROP_SUB_F: emitDouble(as, 0x5C, in); break;
+        case ROP_MUL_F: emitDouble(as, 0x59, in); break;
+        case ROP_DIV_F: {
+            compareWithZeroDouble(as, in->c);
+            int ordered = shortJump(as, 0x7A);                          // jp: NaN is not zero
+            failIf(as, CC_E, JIT_DIVISION_BY_ZERO, 0);
+            landShortJump(as, ordered);
+            emitDouble(as, 0x5E, in);
+            break;
+        }
+        case ROP_NEG_F:
+            load(as, RAX, in->b);
+            EMIT(as, "\x48\x0F\xBA\xF8\x3F");                           // btc rax, 63
+            store(as, in->a, RAX);
+            break;
+        case ROP_BIT_AND: emitBinary(as, "\x23", 1, in, false); break;
+        case ROP_BIT_OR: emitBinary(as, "\x0B", 1, in, false); break;
+        case ROP_BIT_XOR: emitBinary(as, "\x33", 1, in, false); break;
+        case ROP_BIT_NOT: emitUnary(as, "\xF7\xD0", in, false); break;
+        case ROP_SHL: emitShift(as, in, 0xE0); break;
+        case ROP_SHR_I: emitShift(as, in, 0xF8); break;
+        case ROP_SHR_U: emitShift(as, in, 0xE8); break;
+        case ROP_NOT:
+            compareZero(as, in->b);
+            setFlag(as, CC_E, in->a);
+            break;
+        case ROP_NOT_F:
+            compareWithZeroDouble(as, in->b);
+            setOrderedEqual(as, in->a);
+            break;
+        case ROP_EQ_I: emitCompare(as, in, CC_E); break;
+        case ROP_NE_I: emitCompare(as, in, CC_NE); break;
+        case ROP_LT_I: emitCompare(as, in, CC_L); break;
+        case ROP_LE_I: emitCompare(as, in, CC_LE); break;
+        case ROP_GT_I: emitCompare(as, in, CC_G); break;
+        case ROP_GE_I: emitCompare(as, in, CC_GE); break;
+        case ROP_LT_U: emitCompare(as, in, CC_B); break;
+        case ROP_LE_U: emitCompare(as, in, CC_BE); break;
+        case ROP_GT_U: emitCompare(as, in, CC_A); break;
+        case ROP_GE_U: emitCompare(as, in, CC_AE); break;
+        case ROP_EQ_F:
+            loadDouble(as, XMM0, in->b);
+            compareDouble(as, XMM0, in->c);
+            setOrderedEqual(as, in->a);
+            break;
+        case ROP_NE_F:
+            loadDouble(as, XMM0, in->b);
+            compareDouble(as, XMM0, in->c);
+            setUnorderedNotEqual(as, in->a);
+            break;
+        case ROP_LT_F: emitCompareDouble(as, in, CC_A, true); break;
+        case ROP_LE_F: emitCompareDouble(as, in, CC_AE, true); break;
+        case ROP_GT_F: emitCompareDouble(as, in, CC_A, false); break;
+        case ROP_GE_F: emitCompareDouble(as, in, CC_AE, false); break;
+        case ROP_WRAP_I8: MEMORY(as, 0, true, "\x0F\xBE", RAX, RBX, SLOT(in->b)); store(as, in->a, RAX); break;
+        case ROP_WRAP_U8: MEMORY(as, 0, false, "\x0F\xB6", RAX, RBX, SLOT(in->b)); store(as, in->a, RAX); break;
+        case ROP_WRAP_I16: MEMORY(as, 0, true, "\x0F\xBF", RAX, RBX, SLOT(in->b)); store(as, in->a, RAX); break;
+        case ROP_WRAP_U16: MEMORY(as, 0, false, "\x0F\xB7", RAX, RBX, SLOT(in->b)); store(as, in->a, RAX); break;
+        case ROP_WRAP_I32: MEMORY(as, 0, true, "\x63", RAX, RBX, SLOT(in->b)); store(as, in->a, RAX); break;
+        case ROP_WRAP_U32: MEMORY(as, 0, false, "\x8B", RAX, RBX, SLOT(in->b)); store(as, in->a, RAX); break;
+        case ROP_TO_BOOL:
+            compareZero(as, in->b);
+            setFlag(as, CC_NE, in->a);
+            break;
+        case ROP_TO_BOOL_F:
+            compareWithZeroDouble(as, in->b);
+            setUnorderedNotEqual(as, in->a);
+            break;
+        case ROP_I2F:
+            MEMORY(as, 0xF2, true, "\x0F\x2A", XMM0, RBX, SLOT(in->b));  // cvtsi2sd
+            storeDouble(as, in->a, XMM0);
+            break;
+        case ROP_U2F:
+        case ROP_F2I:
+            MEMORY(as, 0, true, "\x8D", RDI, RBX, SLOT(in->a));
+            MEMORY(as, 0, true, "\x8D", RSI, RBX, SLOT(in->b));
+            emitByte(as, 0xBA);                                         // mov edx, imm32
+            emit32(as, in->aux);
+            callAbsolute(as, in->op == ROP_U2F ? (void *)jitU2F : (void *)jitF2I);
+            break;
+        case ROP_FROUND:
+            MEMORY(as, 0xF2, false, "\x0F\x5A", XMM0, RBX, SLOT(in->b)); // cvtsd2ss
+            EMIT(as, "\xF3\x0F\x5A\xC0");                               // cvtss2sd xmm0, xmm0
+            storeDouble(as, in->a, XMM0);
+            break;
+        case ROP_JUMP:
+            jump(as, PATCH_INSTRUCTION, in->c);
+            break;
+        case ROP_JUMP_IF_FALSE:
+        case ROP_JUMP_IF_TRUE:
+            compareZero(as, in->a);
+            jumpIf(as, in->op == ROP_JUMP_IF_FALSE ? CC_E : CC_NE, PATCH_INSTRUCTION, in->c);
+            break;
+        case ROP_BR_EQ_I: emitBranch(as, in, CC_E); break;
+        case ROP_BR_NE_I: emitBranch(as, in, CC_NE); break;
+        case ROP_BR_LT_I: emitBranch(as, in, CC_L); break;
+        case ROP_BR_LE_I: emitBranch(as, in, CC_LE); break;
+        case ROP_BR_GT_I: emitBranch(as, in, CC_G); break;
+        case ROP_BR_GE_I: emitBranch(as, in, CC_GE); break;
+        case ROP_BR_LT_U: emitBranch(as, in, CC_B); break;
+        case ROP_BR_LE_U: emitBranch(as, in, CC_BE); break;
+        case ROP_BR_GT_U: emitBranch(as, in, CC_A); break;
+        case ROP_BR_GE_U: emitBranch(as, in, CC_AE); break;
+        case ROP_BR_EQ_F: {
+            loadDouble(as, XMM0, in->a);
+            compareDouble(as, XMM0, in->b);
+            int unordered = shortJump(as, 0x7A);
+            jumpIf(as, CC_E, PATCH_INSTRUCTION, in->c);
+            landShortJump(as, unordered);
+            break;
+        }
+        case ROP_BR_NE_F:
+            loadDouble(as, XMM0, in->a);
+            compareDouble(as, XMM0, in->b);
+            jumpIf(as, CC_P, PATCH_INSTRUCTION, in->c);
+            jumpIf(as, CC_NE, PATCH_INSTRUCTION, in->c);
+            break;
+        case ROP_BR_LT_F: emitBranchDouble(as, in, CC_A, true); break;
+        case ROP_BR_LE_F: emitBranchDouble(as, in, CC_AE, true); break;
+        case ROP_BR_GT_F: emitBranchDouble(as, in, CC_A, false); break;
+        case ROP_BR_GE_F: emitBranchDouble(as, in, CC_AE, false); break;
+        case ROP_INC_BR_LT_I32: emitIncrementBranch(as, in, CC_L); break;
+        case ROP_INC_BR_LE_I32: emitIncrementBranch(as, in, CC_LE); break;
+        case ROP_CALL: emitCall(as, fn, in); break;
+        case ROP_TAILCALL: emitTailCall(as, in); break;
+        case ROP_RETURN:
+            load(as, RAX, in->a);
+            store(as, 0, RAX);
+            emitByte(as, 0xB8);                                         // mov eax, imm32
+            emit32(as, JIT_RETURNED_VALUE);
+            emitEpilogue(as);
+            break;
+        case ROP_RETURN_VOID:
+            EMIT(as, "\x31\xC0");
+            emitEpilogue(as);
+            break;
+        case ROP_PRINT:
+            EMIT(as, "\x4C\x89\xE7");                                   // mov rdi, r12
+            MEMORY(as, 0, true, "\x8D", RSI, RBX, SLOT(in->a));
+            emitByte(as, 0xBA);
+            emit32(as, in->b);
+            EMIT(as, "\x48\xB9");                                       // mov rcx, imm64
+            emit64(as, (uint64_t)(uintptr_t)(fn->printTypes + in->c));
+            callAbsolute(as, (void *)jitPrint);
+            break;
+        default:
+            break;
+    }
+}
+
+static void emitStubs(Assembler *as, int function){
+    for(int i = 0; i < as->stubCount; i++){
+        Stub *stub = &as->stubs[i];
+        stub->offset = as->size;
+        if(stub->status < 0){
+            emitEpilogue(as);
+            continue;
+        }
+        if(stub->status == JIT_INDEX_OUT_OF_BOUNDS){
+            MEMORY(as, 0, true, "\x89", RAX, R12, CONTEXT(errorIndex));
+            MEMORY(as, 0, true, "\xC7", 0, R12, CONTEXT(errorLength));  // mov qword, imm32
+            emit32(as, (uint32_t)stub->data);
+        }
+        if(stub->status == JIT_STACK_OVERFLOW){
+            MEMORY(as, 0, false, "\xC7", 0, R12, CONTEXT(errorCallee));
+            emit32(as, (uint32_t)stub->data);
+        }
+        MEMORY(as, 0, false, "\xC7", 0, R12, CONTEXT(errorFunction));
+        emit32(as, (uint32_t)function);
+        emitByte(as, 0xB8);
+        emit32(as, (uint32_t)stub->status);
+        emitEpilogue(as);
+    }
+}
+
+static void patch(Assembler *as, const Patch *p, int target){
+    if(as->outOfMemory) return;
+    int32_t rel = target - (p->site + 4);
+    memcpy(as->code + p->site, &rel, sizeof(rel));
+}
+
+// Resolves the jumps inside the function just emitted; calls between
+// functions wait for the whole chunk.
+static void patchLocal(Assembler *as, int firstPatch){
+    int kept = firstPatch;
+    for(int i = firstPatch; i < as->patchCount; i++){
+        Patch *p = &as->patches[i];
+        if(p->kind == PATCH_INSTRUCTION) patch(as, p, as->instructionOffsets[p->target]);
+        else if(p->kind == PATCH_STUB) patch(as, p, as->stubs[p->target].offset);
+        else as->patches[kept++] = *p;
+    }
+    as->patchCount = kept;
+}
+
+static void emitPrologue(Assembler *as){
+    EMIT(as, "\x53\x41\x54\x41\x55");                                   // push rbx; push r12; push r13
+    EMIT(as, "\x48\x89\xFB\x49\x89\xF4");                               // mov rbx, rdi; mov r12, rsi
+    MEMORY(as, 0, true, "\x8B", R13, R12, CONTEXT(globals));
+}
+
+static bool isBranch(RegisterOpcode op){
+    RegisterFormat format = registerOpcodeFormat(op);
+    return format == RFORMAT_JUMP || format == RFORMAT_BRANCH_IF || format == RFORMAT_BRANCH;
+}
+
+// A loop running in the interpreter moves onto machine code through an
+// entry at its header; the frame is already set up, so the entry only loads
+// the fixed registers and jumps into the body.
+static void emitLoopEntries(Assembler *as, int index){
+    const RegisterFunction *fn = &as->module->functions[index];
+    int *offsets = as->loopOffsets[index];
+    for(int i = 0; i < fn->codeSize; i++){
+        const RegisterInstruction *in = &fn->code[i];
+        if(!isBranch(in->op) || in->c > i || offsets[in->c] >= 0) continue;
+        offsets[in->c] = as->size;
+        emitPrologue(as);
+        emitByte(as, 0xE9);
+        emit32(as, (uint32_t)(as->instructionOffsets[in->c] - (as->size + 4)));
+    }
+}
+
+static void emitFunction(Assembler *as, int index){
+    const RegisterFunction *fn = &as->module->functions[index];
+    int firstPatch = as->patchCount;
+    as->stubCount = 0;
+
+    as->entryOffsets[index] = as->size;
+    emitPrologue(as);
+    as->tailOffsets[index] = as->size;
+    emitFrameSetup(as, fn);
+
+    int *offsets = realloc(as->instructionOffsets, (size_t)(fn->codeSize + 1) * sizeof(int));
+    if(offsets) as->instructionOffsets = offsets;
+    as->loopOffsets[index] = malloc((size_t)(fn->codeSize > 0 ? fn->codeSize : 1) * sizeof(int));
+    if(!offsets || !as->loopOffsets[index]){
+        as->outOfMemory = true;
+        return;
+    }
+    for(int i = 0; i < fn->codeSize; i++){
+        as->instructionOffsets[i] = as->size;
+        as->loopOffsets[index][i] = -1;
+        emitInstruction(as, fn, &fn->code[i]);
+    }
+    as->instructionOffsets[fn->codeSize] = as->size;
+    emitStubs(as, index);
+    patchLocal(as, firstPatch);
+    emitLoopEntries(as, index);
+    as->endOffsets[index] = as->size;
+}
+
+// Top-level code runs once and stays interpreted; a function calling one
+// that cannot be compiled cannot be compiled either.
+static void markCompilable(const RegisterModule *module, bool *compilable){
+    for(int i = 0; i < module->functionCount; i++) compilable[i] = i > 0;
+    bool changed = true;
+    while(changed){
+        changed = false;
+        for(int i = 1; i < module->functionCount; i++){
+            const RegisterFunction *fn = &module->functions[i];
+            if(!compilable[i]) continue;
+            for(int k = 0; k < fn->codeSize; k++){
+                const RegisterInstruction *in = &fn->code[k];
+                // a throw unwinds interpreted frames only, and parallel loops
+                // hand their chunks to the interpreter's workers
+                bool supported = in->op < ROP_COUNT && in->op != ROP_THROW && in->op != ROP_PARALLEL_FOR;
+                if((in->op == ROP_CALL || in->op == ROP_TAILCALL) && !compilable[in->b]) supported = false;
+                if(!supported){
+                    compilable[i] = false;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+static void writePerfMap(const JitModule *jit, const Assembler *as, const uint8_t *code){
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+    FILE *file = fopen(path, "a");
+    if(!file) return;
+    for(int i = 0; i < jit->source->functionCount; i++){
+        if(!as->selected[i]) continue;
+        fprintf(file, "%lx %x jit:%s\n", (unsigned long)(uintptr_t)(code + as->entryOffsets[i]),
+                (unsigned)(as->endOffsets[i] - as->entryOffsets[i]), jit->source->functions[i].name);
+    }
+    fclose(file);
+}
+
+static void freeAssembler(Assembler *as){
+    free(as->code);
+    free(as->patches);
+    free(as->stubs);
+    free(as->instructionOffsets);
+    free(as->entryOffsets);
+    free(as->tailOffsets);
+    free(as->endOffsets);
+    if(as->loopOffsets){
+        for(int i = 0; i < as->module->functionCount; i++) free(as->loopOffsets[i]);
+    }
+    free(as->loopOffsets);
+}
+
+// Emits the selected functions into one new chunk. Their callees are either
+// selected too or already compiled.
+static bool compileChunk(JitModule *jit, const bool *selected, char *error, size_t errorSize){
+    const RegisterModule *module = jit->source;
+    int count = module->functionCount;
+    Assembler as = {0};
+    as.module = module;
+    as.jit = jit;
+    as.selected = selected;
+    as.entryOffsets = calloc(count, sizeof(int));
+    as.tailOffsets = calloc(count, sizeof(int));
+    as.endOffsets = calloc(count, sizeof(int));
+    as.loopOffsets = calloc(count, sizeof(int *));
+    bool ok = as.entryOffsets && as.tailOffsets && as.endOffsets && as.loopOffsets;
+    for(int i = 0; ok && i < count; i++){
+        if(!selected[i]) continue;
+        jit->loopEntries[i] = calloc(module->functions[i].codeSize > 0 ? module->functions[i].codeSize : 1, sizeof(JitEntry));
+        ok = jit->loopEntries[i] != NULL;
+    }
+    if(ok) ok = GROW(jit->chunks, jit->chunkCount, jit->chunkCapacity);
+    if(!ok){
+        snprintf(error, errorSize, "out of memory");
+        freeAssembler(&as);
+        return false;
+    }
+
+    for(int i = 0; i < count; i++){
+        if(selected[i]) emitFunction(&as, i);
+    }
+    if(as.outOfMemory){
+        snprintf(error, errorSize, "out of memory");
+        freeAssembler(&as);
+        return false;
+    }
+    for(int i = 0; i < as.patchCount; i++){
+        const Patch *p = &as.patches[i];
+        patch(&as, p, p->kind == PATCH_ENTRY ? as.entryOffsets[p->target] : as.tailOffsets[p->target]);
+    }
+
+    // written while only writable, then only executable
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t mappedSize = ((size_t)as.size + page - 1) / page * page;
+    if(mappedSize == 0) mappedSize = page;
+    uint8_t *code = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(code == MAP_FAILED){
+        snprintf(error, errorSize, "cannot map %zu bytes for machine code", mappedSize);
+        freeAssembler(&as);
+        return false;
+    }
+    memcpy(code, as.code, (size_t)as.size);
+    if(mprotect(code, mappedSize, PROT_READ | PROT_EXEC) != 0){
+        snprintf(error, errorSize, "cannot make machine code executable");
+        munmap(code, mappedSize);
+        freeAssembler(&as);
+        return false;
+    }
+    jit->chunks[jit->chunkCount++] = (JitChunk){code, mappedSize};
+
+    for(int i = 0; i < count; i++){
+        if(!selected[i]) continue;
+        jit->entries[i] = (JitEntry)(void *)(code + as.entryOffsets[i]);
+        jit->tailEntries[i] = code + as.tailOffsets[i];
+        for(int k = 0; k < module->functions[i].codeSize; k++){
+            int offset = as.loopOffsets[i][k];
+            if(offset >= 0) jit->loopEntries[i][k] = (JitEntry)(void *)(code + offset);
+        }
+        jit->compiledCount++;
+    }
+    if(jit->options.perfMap) writePerfMap(jit, &as, code);
+    freeAssembler(&as);
+    return true;
+}
+
+bool jitSupported(void){
+    return true;
+}
+
+JitModule *createJit(const RegisterModule *module, const JitOptions *options, char *error, size_t errorSize){
+    int count = module->functionCount > 0 ? module->functionCount : 1;
+    JitModule *jit = calloc(1, sizeof(JitModule));
+    if(jit){
+        jit->source = module;
+        jit->options = options ? *options : defaultJitOptions();
+        jit->compilable = calloc(count, sizeof(bool));
+        jit->entries = calloc(count, sizeof(JitEntry));
+        jit->tailEntries = calloc(count, sizeof(uint8_t *));
+        jit->loopEntries = calloc(count, sizeof(JitEntry *));
+    }
+    if(!jit || !jit->compilable || !jit->entries || !jit->tailEntries || !jit->loopEntries){
+        snprintf(error, errorSize, "out of memory");
+        freeJit(jit);
+        return NULL;
+    }
+    markCompilable(module, jit->compilable);
+    return jit;
+}
+
+static void selectCallees(const JitModule *jit, int function, bool *selected){
+    if(selected[function] || jit->entries[function]) return;
+    selected[function] = true;
+    const RegisterFunction *fn = &jit->source->functions[function];
+    for(int i = 0; i < fn->codeSize; i++){
+        const RegisterInstruction *in = &fn->code[i];
+        if(in->op == ROP_CALL || in->op == ROP_TAILCALL) selectCallees(jit, in->b, selected);
+    }
+}
+
+bool compileJitFunction(JitModule *jit, int function, char *error, size_t errorSize){
+    if(function < 0 || function >= jit->source->functionCount){
+        snprintf(error, errorSize, "no function %d", function);
+        return false;
+    }
+    if(jit->entries[function]) return true;
+    if(!jit->compilable[function]){
+        snprintf(error, errorSize, "%s cannot be compiled", jit->source->functions[function].name);
+        return false;
+    }
+    bool *selected = calloc(jit->source->functionCount, sizeof(bool));
+    if(!selected){
+        snprintf(error, errorSize, "out of memory");
+        return false;
+    }
+    selectCallees(jit, function, selected);
+    bool ok = compileChunk(jit, selected, error, errorSize);
+    free(selected);
+    return ok;
+}
+
+JitModule *compileJit(const RegisterModule *module, const JitOptions *options, char *error, size_t errorSize){
+    JitModule *jit = createJit(module, options, error, errorSize);
+    if(!jit) return NULL;
+    for(int i = 0; i < module->functionCount; i++){
+        if(jit->compilable[i]){
+            if(!compileChunk(jit, jit->compilable, error, errorSize)){
+                freeJit(jit);
+                return NULL;
+            }
+            break;
+        }
+    }
+    return jit;
+}
+
+void freeJit(JitModule *jit){
+    if(!jit) return;
+    for(int i = 0; i < jit->chunkCount; i++) munmap(jit->chunks[i].code, jit->chunks[i].mappedSize);
+    if(jit->loopEntries){
+        for(int i = 0; i < jit->source->functionCount; i++) free(jit->loopEntries[i]);
+    }
+    free(jit->chunks);
+    free(jit->compilable);
+    free(jit->entries);
+    free(jit->tailEntries);
+    free(jit->loopEntries);
+    free(jit);
+}
+
+#else
+
+bool jitSupported(void){
+    return false;
+}
+
+JitModule *createJit(const RegisterModule *module, const JitOptions *options, char *error, size_t errorSize){
+    (void)module;
+    (void)options;
+    snprintf(error, errorSize, "the JIT only generates x86-64 code for Linux");
+    return NULL;
+}
+
+JitModule *compileJit(const RegisterModule *module, const JitOptions *options, char *error, size_t errorSize){
+    return createJit(module, options, error, errorSize);
+}
+
+bool compileJitFunction(JitModule *jit, int function, char *error, size_t errorSize){
+    (void)jit;
+    (void)function;
+    snprintf(error, errorSize, "the JIT only generates x86-64 code for Linux");
+    return false;
+}
+
+void freeJit(JitModule *jit){
+    free(jit);
+}
+
+#endif
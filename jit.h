@@ -0,0 +1,73 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "regvm.h"
+#include <stdio.h>
+
+// What compiled code returns; anything past JIT_RETURNED_VALUE is an error
+// described by the context.
+typedef enum {
+    JIT_RETURNED_VOID,
+    JIT_RETURNED_VALUE,         // left in the first register of the frame
+    JIT_DIVISION_BY_ZERO,
+    JIT_INVALID_SHIFT,
+    JIT_INDEX_OUT_OF_BOUNDS,
+    JIT_CALL_DEPTH,
+    JIT_STACK_OVERFLOW
+} JitStatus;
+
+// Shared by every compiled frame of one native run; the generated code
+// reaches the fields by their offsets.
+typedef struct {
+    VMValue *globals;
+    VMValue *end;               // first register past the register file
+    int depth;
+    int maxDepth;
+    FILE *out;
+    long long calls;
+    long long tailCalls;
+    int errorFunction;          // where the run failed
+    int errorCallee;            // the function a stack overflow was calling
+    long long errorIndex;
+    long long errorLength;
+} JitContext;
+
+// frame holds the arguments in its first registers and room for the
+// function's frameSize registers.
+typedef int (*JitEntry)(VMValue *frame, JitContext *ctx);
+
+typedef struct {
+    bool perfMap;               // append symbols to /tmp/perf-<pid>.map for perf
+} JitOptions;
+
+typedef struct JitModule JitModule;
+
+// Only x86-64 Linux has a code generator; elsewhere compileJit fails and
+// everything stays on the interpreter.
+bool jitSupported(void);
+// No perf map unless NEWLEAF_PERF_MAP is set in the environment.
+JitOptions defaultJitOptions(void);
+
+// A JIT with nothing compiled yet, for compiling functions as they get hot.
+// The register module must outlive the result.
+JitModule *createJit(const RegisterModule *module, const JitOptions *options, char *error, size_t errorSize);
+
+// Compiles every function except the top-level code whose instructions and
+// callees all have templates.
+JitModule *compileJit(const RegisterModule *module, const JitOptions *options, char *error, size_t errorSize);
+
+// Compiles one function along with the callees it needs that are not
+// compiled yet; true if it was already compiled.
+bool compileJitFunction(JitModule *jit, int function, char *error, size_t errorSize);
+void freeJit(JitModule *jit);
+
+// NULL for functions left to the interpreter.
+JitEntry jitEntry(const JitModule *jit, int function);
+
+// Enters a compiled function at the header of a loop ending in a backward
+// jump to instruction, taking over a frame the interpreter has been running;
+// NULL if there is no such loop.
+JitEntry jitLoopEntry(const JitModule *jit, int function, int instruction);
+int jitCompiledCount(const JitModule *jit);
+
+#endif
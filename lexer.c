@@ -1,4 +1,5 @@
 #include "lexer.h"
+#include "context.h"
 #include <string.h>
 #include <ctype.h>
 #include <stdbool.h>
@@ -8,27 +9,22 @@ Token createToken(Lexer *lexer, TokenType type, TokenData data, char *lexeme){
     Token token;
     token.type = type;
     token.data = data;
-    token.line = lexer->line;
-    token.column = lexer->column;
-    token.lexeme = strdup(lexeme);
-    if(!token.lexeme){
-        token.type = TOKEN_NULL;
-        token.data.identifier = NULL;
-        return token;
-    };
+    token.line = lexer->tokenLine;
+    token.column = lexer->tokenColumn;
+    token.lexeme = lexeme;
     return token;
 }
 
-char peek(Lexer *lexer){
+static char peek(Lexer *lexer){
     return lexer->src[lexer->pos];
 }
 
-char peekNext(Lexer *lexer){
+static char peekNext(Lexer *lexer){
     if(lexer->src[lexer->pos + 1] == '\0') return '\0';
     return lexer->src[lexer->pos + 1];
 }
 
-char advance(Lexer *lexer){
+static char advance(Lexer *lexer){
     char current = lexer->src[lexer->pos];
     if(current == '\0') return '\0';
 
@@ -42,17 +38,17 @@ char advance(Lexer *lexer){
     return current;
 }
 
-void skipWhiteSpace(Lexer *lexer){
+static void skipWhiteSpace(Lexer *lexer){
     while(isspace(lexer->src[lexer->pos])){
         advance(lexer);
     }
 }
 
-bool isAtEnd(Lexer *lexer){
+static bool isAtEnd(Lexer *lexer){
     return lexer->src[lexer->pos] == '\0';
 }
 
-bool match(Lexer *lexer, char expected){
+static bool match(Lexer *lexer, char expected){
     if(isAtEnd(lexer)) return false;
     if(peek(lexer) != expected) return false;
     
@@ -60,14 +56,17 @@ bool match(Lexer *lexer, char expected){
     return true;
 }
 
-void initLexer(Lexer *lexer, char *src){
-    lexer->src = strdup(src);
+void initLexer(Lexer *lexer, Context *context, const char *src){
+    lexer->context = context;
+    lexer->src = src;
     lexer->pos = 0;
     lexer->column = 1;
     lexer->line = 1;
+    lexer->tokenLine = 1;
+    lexer->tokenColumn = 1;
 }
 
-Token lexNumber(Lexer *lexer){
+static Token lexNumber(Lexer *lexer){
     size_t start = lexer->pos;
     bool isFloat = false;
 
@@ -83,12 +82,7 @@ Token lexNumber(Lexer *lexer){
             advance(lexer);
         }
     }
-    size_t len = lexer->pos - start;
-    char *numStr = malloc(len + 1);
-
-    if(!numStr) return createToken(lexer, TOKEN_NULL, (TokenData){0}, "");
-    memcpy(numStr, &lexer->src[start], len);
-    numStr[len] = '\0';
+    char *numStr = internString(lexer->context, &lexer->src[start], lexer->pos - start);
 
     TokenData data;
     if(isFloat){
@@ -99,12 +93,10 @@ Token lexNumber(Lexer *lexer){
         data.literal.value.intVal = atoi(numStr);
     }
 
-    Token token = createToken(lexer, TOKEN_NUMBER, data, numStr);
-    free(numStr);
-    return token;
+    return createToken(lexer, TOKEN_NUMBER, data, numStr);
 }
 
-Token lexString(Lexer *lexer){
+static Token lexString(Lexer *lexer){
     size_t start = lexer->pos;
     while(!isAtEnd(lexer) && peek(lexer) != '"'){
         if(peek(lexer) == '\\' && peekNext(lexer) == '"') advance(lexer);
@@ -116,32 +108,20 @@ Token lexString(Lexer *lexer){
     }
     
     advance(lexer);
-    size_t len = lexer->pos - start - 1;
-    char *str = malloc(len + 1);
-    if(!str) return createToken(lexer, TOKEN_NULL, (TokenData){0}, "");
-
-    memcpy(str, &lexer->src[start], len);
-    str[len] = '\0';
+    char *str = internString(lexer->context, &lexer->src[start], lexer->pos - start - 1);
 
     TokenData data = {0};
     data.literal.type = TYPE_STRING;
-    data.literal.value.stringVal = strdup(str);
-
-    Token token = createToken(lexer, TOKEN_STRING_LITERAL, data, str);
-    return token;
+    data.literal.value.stringVal = str;
+    return createToken(lexer, TOKEN_STRING_LITERAL, data, str);
 }
 
-Token lexIdentifier(Lexer *lexer){
+static Token lexIdentifier(Lexer *lexer){
     size_t start = lexer->pos;
     while(isalnum(peek(lexer)) || peek(lexer) == '_'){
         advance(lexer);
     }
-
-    size_t len = lexer->pos - start;
-    char *text = malloc(len + 1);
-    if(!text) return createToken(lexer, TOKEN_NULL, (TokenData){0}, "");
-    memcpy(text, &lexer->src[start], len);
-    text[len] = '\0';
+    char *text = internString(lexer->context, &lexer->src[start], lexer->pos - start);
 
     TokenType type = TOKEN_IDENTIFIER;
     #define KeyWord(str, tok) if(strcmp(text, str) == 0) type = tok;
@@ -186,6 +166,7 @@ Token lexIdentifier(Lexer *lexer){
     KeyWord("while", TOKEN_WHILE);
     KeyWord("do", TOKEN_DO);
     KeyWord("for", TOKEN_FOR);
+    KeyWord("parallel", TOKEN_PARALLEL);
     KeyWord("switch", TOKEN_SWITCH);
     KeyWord("case", TOKEN_CASE);
     KeyWord("default", TOKEN_DEFAULT);
@@ -214,20 +195,19 @@ Token lexIdentifier(Lexer *lexer){
     KeyWord("memcpy", TOKEN_MEMCPY);
     KeyWord("memset", TOKEN_MEMSET);
     KeyWord("memmove", TOKEN_MEMMOVE);
-    #undef KeyWord;
+    #undef KeyWord
 
     TokenData data = {0};
     if(type == TOKEN_IDENTIFIER){
-        data.identifier = strdup(text);
+        data.identifier = text;
     }
-
-    Token token = createToken(lexer, type, data, text);
-    free(text);
-    return token;
+    return createToken(lexer, type, data, text);
 }
 
 Token nextToken(Lexer *lexer){
     skipWhiteSpace(lexer);
+    lexer->tokenLine = lexer->line;
+    lexer->tokenColumn = lexer->column;
 
     if(isAtEnd(lexer)){
         return createToken(lexer, TOKEN_EOF, (TokenData){0}, "");
@@ -259,7 +239,7 @@ Token nextToken(Lexer *lexer){
         case '-':
             if(match(lexer, '-')) return createToken(lexer, TOKEN_DECREMENT, (TokenData){0}, "--");
             if(match(lexer, '=')) return createToken(lexer, TOKEN_SUB_ASSIGNMENT, (TokenData){0}, "-=");
-            if(match(lexer, ">")) return createToken(lexer, TOKEN_ARROW, (TokenData){0}, "->");
+            if(match(lexer, '>')) return createToken(lexer, TOKEN_ARROW, (TokenData){0}, "->");
             return createToken(lexer, TOKEN_MINUS, (TokenData){0}, "-");
         case '*':
             if(match(lexer, '=')) return createToken(lexer, TOKEN_MUL_ASSIGNMENT, (TokenData){0}, "*=");
@@ -326,6 +306,6 @@ Token nextToken(Lexer *lexer){
         case '\\':
             return createToken(lexer, TOKEN_BACKSLASH, (TokenData){0}, "\\");
         default:
-            return createToken(lexer, TOKEN_NULL, (TokenData){0}, "");
+            return createToken(lexer, TOKEN_NULL, (TokenData){0}, internString(lexer->context, &lexer->src[lexer->pos - 1], 1));
     }
 }
\ No newline at end of file
@@ -97,13 +97,14 @@ typedef enum {
     TOKEN_GREATER_EQUAL_THAN,   // >=
 
     TOKEN_QUESTION,             // ?
-    TOKEN_BACKSLASH,            // \ 
+    TOKEN_BACKSLASH,            // backslash
 
     TOKEN_IF,                   // if
     TOKEN_ELSE,                 // else
     TOKEN_WHILE,                // while
     TOKEN_DO,                   // do
     TOKEN_FOR,                  // for
+    TOKEN_PARALLEL,             // parallel (before for)
     TOKEN_SWITCH,               // switch
     TOKEN_CASE,                 // case
     TOKEN_DEFAULT,              // default
@@ -136,11 +137,17 @@ typedef enum {
     TOKEN_EOF                   // eof
 } TokenType;
 
+// Owns the strings tokens point into, see context.h.
+typedef struct Context Context;
+
 typedef struct {
-    char *src;
+    Context *context;
+    const char *src;            // read in place, must outlive the lexer
     size_t pos;
     int line;
     int column;
+    int tokenLine;              // where the token being lexed starts
+    int tokenColumn;
 } Lexer;
 
 typedef union {
@@ -155,13 +162,13 @@ typedef union {
 typedef struct {
     TokenType type;
     TokenData data;
-    char *lexeme;
+    char *lexeme;               // interned in the lexer's context, or a literal for punctuation
     int line;
     int column;
 } Token;
 
 Token createToken(Lexer *lexer, TokenType type, TokenData data, char *lexeme);
-void initLexer(Lexer *lexer, char *src);
+void initLexer(Lexer *lexer, Context *context, const char *src);
 Token nextToken(Lexer *lexer);
 
 #endif
\ No newline at end of file
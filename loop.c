@@ -0,0 +1,783 @@
+#include "loop.h"
+#include "primitive.h"
+#include "utils.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    TypeScope scope;
+    int functionMark;           // first scope entry of the current function, -1 at top level
+    NameSet addressTaken;
+    LoopStats *stats;
+    int tempCount;
+} LoopOptimizer;
+
+typedef struct {
+    NameSet written;
+    bool writesMemory;
+    bool hasCalls;
+    bool hasLabels;
+} LoopEffects;
+
+typedef struct {
+    ASTNode **nodes;
+    int count;
+    int capacity;
+} NodeList;
+
+static bool appendNode(NodeList *list, ASTNode *node){
+    if(list->count == list->capacity){
+        int capacity = list->capacity ? list->capacity * 2 : 4;
+        ASTNode **nodes = realloc(list->nodes, capacity * sizeof(ASTNode *));
+        if(!nodes) return false;
+        list->nodes = nodes;
+        list->capacity = capacity;
+    }
+    list->nodes[list->count++] = node;
+    return true;
+}
+
+static bool isIntegerLiteral(ASTNode *node, long long *value){
+    return node && node->type == LITERAL_NODE && primitiveToLongLong(node->literal.type, node->literal.value, value);
+}
+
+static bool isVariable(ASTNode *node, const char *name){
+    return node && node->type == IDENTIFIER_NODE && strcmp(node->identifier.name, name) == 0;
+}
+
+static bool representable(PrimitiveType type, long long n){
+    long long back;
+    return primitiveToLongLong(type, primitiveFromLongLong(type, n), &back) && back == n;
+}
+
+static void collectAddressTaken(ASTNode **slot, void *ctx){
+    NameSet *names = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    if(node->type == UNARY_OPERATION_NODE && node->unaryOp.op == ADDRESS_OF_UNOP && node->unaryOp.expr->type == IDENTIFIER_NODE){
+        addName(names, node->unaryOp.expr->identifier.name);
+    }
+    forEachChild(node, collectAddressTaken, ctx);
+}
+
+static void noteWrite(LoopEffects *effects, ASTNode *target){
+    while(target){
+        switch(target->type){
+            case IDENTIFIER_NODE:
+                addName(&effects->written, target->identifier.name);
+                return;
+            case ARRAY_ACCESS_NODE:
+                effects->writesMemory = true;
+                target = target->arrayAccess.array;
+                break;
+            case FIELD_ACCESS_NODE:
+                if(target->fieldAccess.isPointerAccess) effects->writesMemory = true;
+                target = target->fieldAccess.object;
+                break;
+            default:
+                effects->writesMemory = true;
+                return;
+        }
+    }
+}
+
+static void collectEffects(ASTNode **slot, void *ctx){
+    LoopEffects *effects = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    switch(node->type){
+        case ASSIGNMENT_NODE:
+            noteWrite(effects, node->assignment.left);
+            break;
+        case UNARY_OPERATION_NODE:
+            if(node->unaryOp.op >= PRE_INCREMENT_UNOP && node->unaryOp.op <= POST_DECREMENT_UNOP) noteWrite(effects, node->unaryOp.expr);
+            break;
+        case DECLARATION_NODE:
+            addName(&effects->written, node->declaration.varName);
+            break;
+        case FUNCTION_CALL_NODE:
+            effects->hasCalls = true;
+            break;
+        case FREE_NODE:
+        case REALLOC_NODE:
+        case MEMCPY_NODE:
+        case MEMSET_NODE:
+        case MEMMOVE_NODE:
+            effects->writesMemory = true;
+            break;
+        case LABEL_NODE:
+            effects->hasLabels = true;
+            break;
+        default:
+            break;
+    }
+    forEachChild(node, collectEffects, ctx);
+}
+
+static void initEffects(LoopEffects *effects){
+    initNameSet(&effects->written);
+    effects->writesMemory = false;
+    effects->hasCalls = false;
+    effects->hasLabels = false;
+}
+
+static bool isLocal(LoopOptimizer *opt, const char *name){
+    if(opt->functionMark < 0) return false;
+
+    for(int i = opt->scope.count - 1; i >= 0; i--){
+        if(strcmp(opt->scope.symbols[i].name, name) == 0) return i >= opt->functionMark;
+    }
+    return false;
+}
+
+// A variable keeps its value across the loop if nothing in the loop
+// assigns it, and no call or store through a pointer can reach it.
+static bool isStable(LoopOptimizer *opt, LoopEffects *effects, const char *name){
+    if(hasName(&effects->written, name)) return false;
+    if((effects->hasCalls || effects->writesMemory) && hasName(&opt->addressTaken, name)) return false;
+    if(effects->hasCalls && !isLocal(opt, name)) return false;
+    return true;
+}
+
+// A shift traps on a count outside the width of the shifted type, so only a
+// literal count known to be inside it is safe to evaluate ahead of time.
+static bool isSafeShift(LoopOptimizer *opt, ASTNode *expr){
+    long long count;
+    PrimitiveType type;
+    if(!isIntegerLiteral(expr->binaryOp.right, &count)) return false;
+    long long width = CHAR_BIT;
+    if(inferExpressionType(expr->binaryOp.left, &opt->scope, &type) && isIntegerType(type)) width = (long long)primitiveSize(type) * CHAR_BIT;
+    return count >= 0 && count < width;
+}
+
+// Memory reads are only invariant when nothing in the loop can store,
+// and only hoisted from positions that are always evaluated.
+static bool isInvariant(LoopOptimizer *opt, LoopEffects *effects, ASTNode *expr, bool allowMemory){
+    if(!expr) return true;
+
+    bool memoryStable = allowMemory && !effects->writesMemory && !effects->hasCalls;
+    switch(expr->type){
+        case LITERAL_NODE:
+        case NULL_NODE:
+            return true;
+        case IDENTIFIER_NODE:
+            return isStable(opt, effects, expr->identifier.name);
+        case SIZEOF_NODE: {
+            PrimitiveType type;
+            return typeNodeToPrimitive(expr->sizeOfExpr.expr, &type) || isInvariant(opt, effects, expr->sizeOfExpr.expr, allowMemory);
+        }
+        case UNARY_OPERATION_NODE:
+            switch(expr->unaryOp.op){
+                case POSITIVE_UNOP:
+                case NEGATIVE_UNOP:
+                case NOT_UNOP:
+                case BIT_NOT_UNOP:
+                    return isInvariant(opt, effects, expr->unaryOp.expr, allowMemory);
+                case DEFERENCE_UNOP:
+                    return memoryStable && isInvariant(opt, effects, expr->unaryOp.expr, allowMemory);
+                default:
+                    return false;
+            }
+        case BINARY_OPERATION_NODE:
+            if(expr->binaryOp.op == DIV_BINOP || expr->binaryOp.op == MOD_BINOP){
+                ASTNode *divisor = expr->binaryOp.right;
+                if(divisor->type != LITERAL_NODE || primitiveEquals(divisor->literal.type, divisor->literal.value, 0)) return false;
+            }
+            if((expr->binaryOp.op == SHIFT_LEFT_BINOP || expr->binaryOp.op == SHIFT_RIGHT_BINOP) && !isSafeShift(opt, expr)) return false;
+            return isInvariant(opt, effects, expr->binaryOp.left, allowMemory) && isInvariant(opt, effects, expr->binaryOp.right, allowMemory);
+        case TERNARY_OPERATION_NODE:
+            return isInvariant(opt, effects, expr->ternaryOp.condition, allowMemory)
+                && isInvariant(opt, effects, expr->ternaryOp.trueExpr, allowMemory)
+                && isInvariant(opt, effects, expr->ternaryOp.falseExpr, allowMemory);
+        case CAST_EXPR_NODE:
+            return isInvariant(opt, effects, expr->castExpr.value, allowMemory);
+        case ARRAY_ACCESS_NODE:
+            return memoryStable && isInvariant(opt, effects, expr->arrayAccess.array, allowMemory) && isInvariant(opt, effects, expr->arrayAccess.index, allowMemory);
+        case FIELD_ACCESS_NODE:
+            if(expr->fieldAccess.isPointerAccess && !memoryStable) return false;
+            return isInvariant(opt, effects, expr->fieldAccess.object, allowMemory);
+        default:
+            return false;
+    }
+}
+
+static void searchVariable(ASTNode **slot, void *ctx){
+    bool *found = ctx;
+    if(*found || !*slot) return;
+
+    if((*slot)->type == IDENTIFIER_NODE){
+        *found = true;
+        return;
+    }
+    forEachChild(*slot, searchVariable, ctx);
+}
+
+static bool isWorthHoisting(ASTNode *expr){
+    switch(expr->type){
+        case UNARY_OPERATION_NODE:
+        case BINARY_OPERATION_NODE:
+        case TERNARY_OPERATION_NODE:
+        case CAST_EXPR_NODE:
+        case ARRAY_ACCESS_NODE:
+        case FIELD_ACCESS_NODE:
+            break;
+        default:
+            return false;
+    }
+
+    // anything without a variable in it is left to constant folding
+    bool found = false;
+    if(expr->type == CAST_EXPR_NODE) searchVariable(&expr->castExpr.value, &found);
+    else searchVariable(&expr, &found);
+    return found;
+}
+
+// Loop-invariant code motion
+
+typedef struct {
+    LoopOptimizer *opt;
+    LoopEffects *effects;
+    NodeList hoisted;
+    bool allowMemory;
+} Hoister;
+
+static void hoistSlot(ASTNode **slot, void *ctx);
+
+static void hoist(Hoister *h, ASTNode **slot){
+    char name[32];
+    snprintf(name, sizeof(name), "__licm%d", h->opt->tempCount++);
+
+    PrimitiveType type;
+    ASTNode *varType = NULL;
+    if(inferExpressionType(*slot, &h->opt->scope, &type)){
+        varType = createIdentifierNode(primitiveTypeName(type));
+        if(!varType) return;
+    }
+
+    ASTNode *declaration = createDeclarationNode(varType, name, *slot, 0);
+    ASTNode *reference = createIdentifierNode(name);
+    if(!declaration || !reference || !appendNode(&h->hoisted, declaration)){
+        if(declaration){
+            declaration->declaration.initializer = NULL;
+            freeAST(declaration);
+        } else{
+            freeAST(varType);
+        }
+        freeAST(reference);
+        return;
+    }
+
+    *slot = reference;
+    h->opt->stats->invariantsHoisted++;
+}
+
+static void hoistWith(Hoister *h, ASTNode **slot, bool allowMemory){
+    bool saved = h->allowMemory;
+    h->allowMemory = allowMemory;
+    hoistSlot(slot, h);
+    h->allowMemory = saved;
+}
+
+static void hoistChildren(Hoister *h, ASTNode *node, bool allowMemory){
+    bool saved = h->allowMemory;
+    h->allowMemory = allowMemory;
+    forEachChild(node, hoistSlot, h);
+    h->allowMemory = saved;
+}
+
+static void hoistSlot(ASTNode **slot, void *ctx){
+    Hoister *h = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    if(isWorthHoisting(node) && isInvariant(h->opt, h->effects, node, h->allowMemory)){
+        hoist(h, slot);
+        return;
+    }
+
+    switch(node->type){
+        case FUNCTION_NODE:
+        case LAMBDA_NODE:
+        case SIZEOF_NODE:
+        case TYPEOF_NODE:
+            break;
+        case DECLARATION_NODE:
+            hoistWith(h, &node->declaration.initializer, false);
+            break;
+        case CAST_EXPR_NODE:
+            hoistSlot(&node->castExpr.value, h);
+            break;
+        case ASSIGNMENT_NODE:
+            hoistChildren(h, node->assignment.left, h->allowMemory);
+            hoistSlot(&node->assignment.right, h);
+            break;
+        case UNARY_OPERATION_NODE:
+            if(node->unaryOp.op == SIZE_OF_UNOP) break;
+            if(node->unaryOp.op >= PRE_INCREMENT_UNOP && node->unaryOp.op <= POST_DECREMENT_UNOP) hoistChildren(h, node->unaryOp.expr, h->allowMemory);
+            else if(node->unaryOp.op == ADDRESS_OF_UNOP) hoistChildren(h, node->unaryOp.expr, h->allowMemory);
+            else hoistSlot(&node->unaryOp.expr, h);
+            break;
+        case BINARY_OPERATION_NODE:
+            hoistSlot(&node->binaryOp.left, h);
+            hoistWith(h, &node->binaryOp.right, h->allowMemory && node->binaryOp.op != AND_BINOP && node->binaryOp.op != OR_BINOP);
+            break;
+        case TERNARY_OPERATION_NODE:
+            hoistSlot(&node->ternaryOp.condition, h);
+            hoistWith(h, &node->ternaryOp.trueExpr, false);
+            hoistWith(h, &node->ternaryOp.falseExpr, false);
+            break;
+        case ARRAY_ACCESS_NODE:
+        case FIELD_ACCESS_NODE:
+            forEachChild(node, hoistSlot, h);
+            break;
+        default:
+            hoistChildren(h, node, false);
+            break;
+    }
+}
+
+static void hoistList(Hoister *h, ASTNode **list, int count){
+    for(int i = 0; i < count; i++){
+        hoistWith(h, &list[i], false);
+    }
+}
+
+// Induction variables
+
+typedef struct {
+    const char *name;
+    PrimitiveType type;
+    long long start;
+    bool startKnown;
+    long long step;
+} InductionVariable;
+
+typedef struct {
+    BinaryOpType op;
+    PrimitiveType literalType;
+    PrimitiveValue literalValue;
+    PrimitiveType type;
+    long long factor;
+    char name[32];
+} DerivedVariable;
+
+typedef struct {
+    LoopOptimizer *opt;
+    InductionVariable *iv;
+    bool exactWidth;            // the derived value can't wrap differently from the induction variable
+    DerivedVariable *derived;
+    int derivedCount;
+    int derivedCapacity;
+} Reducer;
+
+static bool readStep(ASTNode *increment, const char *name, long long *step){
+    if(!increment) return false;
+
+    if(increment->type == UNARY_OPERATION_NODE && isVariable(increment->unaryOp.expr, name)){
+        switch(increment->unaryOp.op){
+            case PRE_INCREMENT_UNOP:
+            case POST_INCREMENT_UNOP:
+                *step = 1;
+                return true;
+            case PRE_DECREMENT_UNOP:
+            case POST_DECREMENT_UNOP:
+                *step = -1;
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    if(increment->type != ASSIGNMENT_NODE || !isVariable(increment->assignment.left, name)) return false;
+
+    ASTNode *right = increment->assignment.right;
+    long long n;
+    switch(increment->assignment.op){
+        case ADD_AND_ASSIGN:
+        case SUB_AND_ASSIGN:
+            if(!isIntegerLiteral(right, &n) || n == LLONG_MIN) return false;
+            *step = increment->assignment.op == ADD_AND_ASSIGN ? n : -n;
+            return true;
+        case SIMPLE_ASSIGN:
+            // i = i + c, i = c + i, i = i - c
+            if(right->type != BINARY_OPERATION_NODE) return false;
+            if(right->binaryOp.op == ADD_BINOP && isVariable(right->binaryOp.left, name) && isIntegerLiteral(right->binaryOp.right, &n)){
+                *step = n;
+                return true;
+            }
+            if(right->binaryOp.op == ADD_BINOP && isVariable(right->binaryOp.right, name) && isIntegerLiteral(right->binaryOp.left, &n)){
+                *step = n;
+                return true;
+            }
+            if(right->binaryOp.op == SUB_BINOP && isVariable(right->binaryOp.left, name) && isIntegerLiteral(right->binaryOp.right, &n) && n != LLONG_MIN){
+                *step = -n;
+                return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+static bool findInductionVariable(LoopOptimizer *opt, ASTNode *loop, InductionVariable *iv){
+    ASTNode *init = loop->forStmt.initializer;
+    ASTNode *start;
+    if(!init) return false;
+
+    if(init->type == DECLARATION_NODE){
+        iv->name = init->declaration.varName;
+        if(!typeNodeToPrimitive(init->declaration.varType, &iv->type)) return false;
+        start = init->declaration.initializer;
+    } else if(init->type == ASSIGNMENT_NODE && init->assignment.op == SIMPLE_ASSIGN && init->assignment.left->type == IDENTIFIER_NODE){
+        iv->name = init->assignment.left->identifier.name;
+        if(!lookupSymbolType(&opt->scope, iv->name, &iv->type)) return false;
+        start = init->assignment.right;
+    } else{
+        return false;
+    }
+
+    if(!isIntegerType(iv->type) || hasName(&opt->addressTaken, iv->name)) return false;
+    iv->startKnown = isIntegerLiteral(start, &iv->start) && representable(iv->type, iv->start);
+    return readStep(loop->forStmt.increment, iv->name, &iv->step) && iv->step != 0;
+}
+
+static BinaryOpType swapComparison(BinaryOpType op){
+    switch(op){
+        case LESS_BINOP: return GREATER_BINOP;
+        case LESS_EQU_BINOP: return GREATER_EQU_BINOP;
+        case GREATER_BINOP: return LESS_BINOP;
+        case GREATER_EQU_BINOP: return LESS_EQU_BINOP;
+        default: return op;
+    }
+}
+
+// ceil(distance / step) for positive distance and step
+static bool stepsToCover(long long distance, long long step, long long *count){
+    long long rounded;
+    if(__builtin_add_overflow(distance, step - 1, &rounded)) return false;
+    *count = rounded / step;
+    return true;
+}
+
+static bool computeTripCount(InductionVariable *iv, ASTNode *condition, long long *tripCount){
+    if(!iv->startKnown || !condition || condition->type != BINARY_OPERATION_NODE) return false;
+
+    BinaryOpType op = condition->binaryOp.op;
+    ASTNode *boundNode;
+    if(isVariable(condition->binaryOp.left, iv->name)){
+        boundNode = condition->binaryOp.right;
+    } else if(isVariable(condition->binaryOp.right, iv->name)){
+        boundNode = condition->binaryOp.left;
+        op = swapComparison(op);
+    } else{
+        return false;
+    }
+
+    long long bound;
+    if(!isIntegerLiteral(boundNode, &bound) || !representable(iv->type, bound)) return false;
+
+    // the comparison must be done in the induction variable's signedness
+    PrimitiveType compareType = promotePrimitiveTypes(iv->type, boundNode->literal.type);
+    if(isSignedType(compareType) != isSignedType(iv->type)) return false;
+
+    long long a = iv->start, s = iv->step, n, distance;
+    switch(op){
+        case LESS_BINOP:
+        case LESS_EQU_BINOP:
+            if(a > bound || (a == bound && op == LESS_BINOP)){
+                n = 0;
+                break;
+            }
+            if(s < 0 || __builtin_sub_overflow(bound, a, &distance)) return false;
+            if(op == LESS_BINOP){
+                if(!stepsToCover(distance, s, &n)) return false;
+            } else{
+                n = distance / s + 1;
+            }
+            break;
+        case GREATER_BINOP:
+        case GREATER_EQU_BINOP:
+            if(a < bound || (a == bound && op == GREATER_BINOP)){
+                n = 0;
+                break;
+            }
+            if(s > 0 || s == LLONG_MIN || __builtin_sub_overflow(a, bound, &distance)) return false;
+            if(op == GREATER_BINOP){
+                if(!stepsToCover(distance, -s, &n)) return false;
+            } else{
+                n = distance / -s + 1;
+            }
+            break;
+        case NOT_EQU_BINOP:
+            if(__builtin_sub_overflow(bound, a, &distance)) return false;
+            if(distance % s != 0 || distance / s < 0) return false;
+            n = distance / s;
+            break;
+        default:
+            return false;
+    }
+
+    // the value that fails the test must not wrap around first
+    long long last;
+    if(__builtin_mul_overflow(n, s, &last) || __builtin_add_overflow(a, last, &last)) return false;
+    if(!representable(iv->type, last)) return false;
+
+    *tripCount = n;
+    return true;
+}
+
+static DerivedVariable *derivedFor(Reducer *r, ASTNode *node, long long factor, PrimitiveType type){
+    for(int i = 0; i < r->derivedCount; i++){
+        if(r->derived[i].factor == factor && r->derived[i].type == type) return &r->derived[i];
+    }
+
+    long long step;
+    if(__builtin_mul_overflow(r->iv->step, factor, &step)) return NULL;
+
+    if(r->derivedCount == r->derivedCapacity){
+        int capacity = r->derivedCapacity ? r->derivedCapacity * 2 : 4;
+        DerivedVariable *derived = realloc(r->derived, capacity * sizeof(DerivedVariable));
+        if(!derived) return NULL;
+        r->derived = derived;
+        r->derivedCapacity = capacity;
+    }
+
+    ASTNode *literal = node->binaryOp.right;
+    DerivedVariable *dv = &r->derived[r->derivedCount++];
+    dv->op = node->binaryOp.op;
+    dv->literalType = literal->literal.type;
+    dv->literalValue = literal->literal.value;
+    dv->type = type;
+    dv->factor = factor;
+    snprintf(dv->name, sizeof(dv->name), "__iv%d", r->opt->tempCount++);
+    r->opt->stats->inductionVariablesReduced++;
+    return dv;
+}
+
+// i * c, c * i and i << c become a variable that advances by step * c
+static void reduceSlot(ASTNode **slot, void *ctx){
+    Reducer *r = ctx;
+    ASTNode *node = *slot;
+    if(!node || node->type == FUNCTION_NODE || node->type == LAMBDA_NODE) return;
+
+    forEachChild(node, reduceSlot, ctx);
+    if(node->type != BINARY_OPERATION_NODE) return;
+
+    BinaryOpType op = node->binaryOp.op;
+    if(op == MUL_BINOP && isVariable(node->binaryOp.right, r->iv->name) && node->binaryOp.left->type == LITERAL_NODE){
+        ASTNode *swap = node->binaryOp.left;
+        node->binaryOp.left = node->binaryOp.right;
+        node->binaryOp.right = swap;
+    }
+    if((op != MUL_BINOP && op != SHIFT_LEFT_BINOP) || !isVariable(node->binaryOp.left, r->iv->name)) return;
+
+    long long factor;
+    ASTNode *literal = node->binaryOp.right;
+    if(!isIntegerLiteral(literal, &factor)) return;
+    if(op == SHIFT_LEFT_BINOP){
+        if(factor < 0 || factor >= (long long)(primitiveSize(r->iv->type) * 8) || factor > 62) return;
+        factor = 1LL << factor;
+    }
+
+    PrimitiveType type = binaryResultType(op, r->iv->type, literal->literal.type);
+    if(!isIntegerType(type)) return;
+    if(!r->exactWidth && primitiveSize(type) != primitiveSize(r->iv->type)) return;
+
+    DerivedVariable *dv = derivedFor(r, node, factor, type);
+    if(!dv) return;
+
+    ASTNode *reference = createIdentifierNode(dv->name);
+    if(!reference) return;
+    freeAST(node);
+    *slot = reference;
+}
+
+static ASTNode *derivedDeclaration(Reducer *r, DerivedVariable *dv){
+    ASTNode *varType = createIdentifierNode(primitiveTypeName(dv->type));
+    ASTNode *variable = createIdentifierNode(r->iv->name);
+    ASTNode *literal = createLiteralNode(dv->literalType, dv->literalValue);
+    ASTNode *value = variable && literal ? createBinaryOpNode(variable, literal, dv->op) : NULL;
+    if(!varType || !value){
+        freeAST(varType);
+        if(!value){
+            freeAST(variable);
+            freeAST(literal);
+        }
+        freeAST(value);
+        return NULL;
+    }
+    return createDeclarationNode(varType, dv->name, value, 0);
+}
+
+static ASTNode *derivedUpdate(Reducer *r, DerivedVariable *dv){
+    ASTNode *variable = createIdentifierNode(dv->name);
+    ASTNode *step = createLiteralNode(dv->type, primitiveFromLongLong(dv->type, r->iv->step * dv->factor));
+    if(!variable || !step){
+        freeAST(variable);
+        freeAST(step);
+        return NULL;
+    }
+    return createAssignmentNode(variable, step, ADD_AND_ASSIGN);
+}
+
+static void optimizeInductionVariables(LoopOptimizer *opt, ASTNode *loop, NodeList *prefix){
+    InductionVariable iv;
+    if(!findInductionVariable(opt, loop, &iv)) return;
+
+    // the induction variable may only change in the increment
+    LoopEffects effects;
+    initEffects(&effects);
+    collectEffects(&loop->forStmt.condition, &effects);
+    for(int i = 0; i < loop->forStmt.bodyCount; i++){
+        collectEffects(&loop->forStmt.body[i], &effects);
+    }
+    bool modified = hasName(&effects.written, iv.name);
+    freeNameSet(&effects.written);
+    if(modified) return;
+
+    long long tripCount;
+    bool counted = computeTripCount(&iv, loop->forStmt.condition, &tripCount);
+    if(counted){
+        loop->forStmt.tripCount = tripCount;
+        opt->stats->tripCountsTagged++;
+    }
+
+    Reducer r = { opt, &iv, counted, NULL, 0, 0 };
+    reduceSlot(&loop->forStmt.condition, &r);
+    for(int i = 0; i < loop->forStmt.bodyCount; i++){
+        reduceSlot(&loop->forStmt.body[i], &r);
+    }
+    if(r.derivedCount == 0) return;
+
+    // for(init; cond; inc) becomes init; dv = i * c; for(; cond; inc, dv += step * c)
+    ASTNode *init = loop->forStmt.initializer;
+    ASTNode *increment = loop->forStmt.increment;
+    loop->forStmt.initializer = NULL;
+    appendNode(prefix, init);
+
+    for(int i = 0; i < r.derivedCount; i++){
+        ASTNode *declaration = derivedDeclaration(&r, &r.derived[i]);
+        ASTNode *update = derivedUpdate(&r, &r.derived[i]);
+        ASTNode *combined = declaration && update ? createBinaryOpNode(increment, update, COMMA_BINOP) : NULL;
+        if(!combined){
+            // out of memory with uses already rewritten: nothing sensible to fall back to
+            abort();
+        }
+        appendNode(prefix, declaration);
+        increment = combined;
+    }
+    loop->forStmt.increment = increment;
+    free(r.derived);
+}
+
+static void optimizeLoop(LoopOptimizer *opt, ASTNode **slot){
+    ASTNode *loop = *slot;
+
+    LoopEffects effects;
+    initEffects(&effects);
+    collectEffects(slot, &effects);
+    bool hasLabels = effects.hasLabels;
+    freeNameSet(&effects.written);
+
+    // a jump into the loop would skip anything placed in front of it
+    if(hasLabels) return;
+
+    NodeList prefix = { NULL, 0, 0 };
+    if(loop->type == FOR_NODE) optimizeInductionVariables(opt, loop, &prefix);
+
+    initEffects(&effects);
+    collectEffects(slot, &effects);
+
+    Hoister h = { opt, &effects, { NULL, 0, 0 }, false };
+    switch(loop->type){
+        case WHILE_NODE:
+            hoistWith(&h, &loop->whileStmt.condition, true);
+            hoistList(&h, loop->whileStmt.body, loop->whileStmt.bodyCount);
+            break;
+        case DO_WHILE_NODE:
+            hoistList(&h, loop->doWhileStmt.body, loop->doWhileStmt.bodyCount);
+            hoistWith(&h, &loop->doWhileStmt.condition, false);
+            break;
+        case FOR_NODE:
+            hoistWith(&h, &loop->forStmt.condition, true);
+            hoistList(&h, loop->forStmt.body, loop->forStmt.bodyCount);
+            hoistWith(&h, &loop->forStmt.increment, false);
+            break;
+        default:
+            break;
+    }
+    freeNameSet(&effects.written);
+
+    if(h.hoisted.count > 0 || prefix.count > 0){
+        // hoisted values go first; they never depend on the initializer
+        for(int i = 0; i < prefix.count; i++){
+            appendNode(&h.hoisted, prefix.nodes[i]);
+        }
+        appendNode(&h.hoisted, loop);
+
+        ASTNode *block = createBlockNode(h.hoisted.nodes, h.hoisted.count);
+        if(!block) abort();
+        *slot = block;
+    }
+    free(h.hoisted.nodes);
+    free(prefix.nodes);
+}
+
+static void optimizeSlot(ASTNode **slot, void *ctx){
+    LoopOptimizer *opt = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    switch(node->type){
+        case FUNCTION_NODE:
+        case LAMBDA_NODE: {
+            int mark = enterTypeScope(&opt->scope);
+            int outerFunction = opt->functionMark;
+            opt->functionMark = mark;
+            forEachChild(node, optimizeSlot, opt);
+            opt->functionMark = outerFunction;
+            leaveTypeScope(&opt->scope, mark);
+            break;
+        }
+        case BLOCK_NODE:
+        case FOR_NODE:
+        case WHILE_NODE:
+        case DO_WHILE_NODE:
+        case CATCH_NODE: {
+            int mark = enterTypeScope(&opt->scope);
+            forEachChild(node, optimizeSlot, opt);
+            leaveTypeScope(&opt->scope, mark);
+            break;
+        }
+        case DECLARATION_NODE:
+            forEachChild(node, optimizeSlot, opt);
+            declareSymbol(&opt->scope, node);
+            break;
+        default:
+            forEachChild(node, optimizeSlot, opt);
+            break;
+    }
+
+    if(node->type == FOR_NODE || node->type == WHILE_NODE || node->type == DO_WHILE_NODE) optimizeLoop(opt, slot);
+}
+
+ASTNode *optimizeLoops(ASTNode *node, LoopStats *stats){
+    LoopOptimizer opt;
+    initTypeScope(&opt.scope);
+    initNameSet(&opt.addressTaken);
+    opt.functionMark = -1;
+    opt.stats = stats;
+    opt.tempCount = 0;
+    *stats = (LoopStats){0};
+
+    collectAddressTaken(&node, &opt.addressTaken);
+    optimizeSlot(&node, &opt);
+
+    freeTypeScope(&opt.scope);
+    freeNameSet(&opt.addressTaken);
+    return node;
+}
@@ -0,0 +1,14 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include "ast.h"
+
+typedef struct {
+    int invariantsHoisted;
+    int inductionVariablesReduced;
+    int tripCountsTagged;
+} LoopStats;
+
+ASTNode *optimizeLoops(ASTNode *node, LoopStats *stats);
+
+#endif
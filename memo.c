@@ -0,0 +1,144 @@
+#include "memo.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MEMO_WAYS 2
+
+// A lookup boxes its key into stack boxes, so only stores allocate, and only
+// for values that do not fit inline.
+typedef struct {
+    BoxedValue values[MEMO_MAX_ARGS];
+    Box boxes[MEMO_MAX_ARGS];
+} MemoKey;
+
+static uint64_t hashKey(const MemoKey *key, int count){
+    uint64_t hash = 14695981039346656037ULL;
+    for(int i = 0; i < count; i++){
+        hash = hashBoxed(hash, key->values[i]);
+    }
+    return hash;
+}
+
+static void boxKey(MemoCache *cache, const MemoValue *args, MemoKey *key){
+    for(int i = 0; i < cache->argCount; i++){
+        key->values[i] = boxPrimitive(args[i].type, args[i].value, &key->boxes[i]);
+    }
+}
+
+static bool sameArgs(MemoCache *cache, const MemoEntry *entry, const MemoKey *key){
+    for(int i = 0; i < cache->argCount; i++){
+        if(!boxedEquals(entry->args[i], key->values[i])) return false;
+    }
+    return true;
+}
+
+static void releaseEntry(MemoCache *cache, MemoEntry *entry){
+    if(!entry->used) return;
+    for(int i = 0; i < cache->argCount; i++){
+        freeBoxed(entry->args[i]);
+    }
+    freeBoxed(entry->result);
+    entry->used = false;
+}
+
+bool initMemoCache(MemoCache *cache, int argCount, int capacity){
+    memset(cache, 0, sizeof(*cache));
+    if(argCount < 0 || argCount > MEMO_MAX_ARGS) return false;
+
+    int rounded = MEMO_WAYS;
+    while(rounded < capacity && rounded < (1 << 24)){
+        rounded *= 2;
+    }
+    cache->entries = calloc(rounded, sizeof(MemoEntry));
+    if(!cache->entries) return false;
+
+    cache->capacity = rounded;
+    cache->argCount = argCount;
+    return true;
+}
+
+void freeMemoCache(MemoCache *cache){
+    for(int i = 0; i < cache->capacity; i++){
+        releaseEntry(cache, &cache->entries[i]);
+    }
+    free(cache->entries);
+    memset(cache, 0, sizeof(*cache));
+}
+
+void clearMemoCache(MemoCache *cache){
+    for(int i = 0; i < cache->capacity; i++){
+        releaseEntry(cache, &cache->entries[i]);
+    }
+    memset(cache->entries, 0, cache->capacity * sizeof(MemoEntry));
+    memset(&cache->stats, 0, sizeof(cache->stats));
+    cache->clock = 0;
+}
+
+static MemoEntry *findSet(MemoCache *cache, uint64_t hash){
+    return &cache->entries[hash & (uint64_t)(cache->capacity - MEMO_WAYS)];
+}
+
+bool memoLookup(MemoCache *cache, const MemoValue *args, MemoValue *result){
+    if(!cache->entries) return false;
+
+    MemoKey key;
+    boxKey(cache, args, &key);
+    uint64_t hash = hashKey(&key, cache->argCount);
+
+    MemoEntry *set = findSet(cache, hash);
+    for(int i = 0; i < MEMO_WAYS; i++){
+        MemoEntry *entry = &set[i];
+        if(entry->used && entry->hash == hash && sameArgs(cache, entry, &key)){
+            entry->stamp = ++cache->clock;
+            result->type = boxedType(entry->result);
+            result->value = unboxPrimitive(entry->result);
+            cache->stats.hits++;
+            return true;
+        }
+    }
+    cache->stats.misses++;
+    return false;
+}
+
+void memoStore(MemoCache *cache, const MemoValue *args, MemoValue result){
+    if(!cache->entries) return;
+
+    MemoKey key;
+    boxKey(cache, args, &key);
+    uint64_t hash = hashKey(&key, cache->argCount);
+
+    MemoEntry *set = findSet(cache, hash);
+    MemoEntry *victim = &set[0];
+    for(int i = 0; i < MEMO_WAYS; i++){
+        MemoEntry *entry = &set[i];
+        if(!entry->used || (entry->hash == hash && sameArgs(cache, entry, &key))){
+            victim = entry;
+            break;
+        }
+        if(entry->stamp < victim->stamp) victim = entry;
+    }
+    if(victim->used && (victim->hash != hash || !sameArgs(cache, victim, &key))) cache->stats.evictions++;
+    releaseEntry(cache, victim);
+
+    // a value that cannot get its own box is simply not remembered
+    Box resultBox;
+    BoxedValue boxedResult = boxPrimitive(result.type, result.value, &resultBox);
+    int copied = 0;
+    while(copied < cache->argCount && copyBoxed(key.values[copied], &victim->args[copied])){
+        copied++;
+    }
+    if(copied < cache->argCount || !copyBoxed(boxedResult, &victim->result)){
+        while(copied > 0) freeBoxed(victim->args[--copied]);
+        return;
+    }
+    victim->hash = hash;
+    victim->stamp = ++cache->clock;
+    victim->used = true;
+    cache->stats.stores++;
+}
+
+void printMemoStats(MemoCache *cache, const char *name, FILE *out){
+    long long lookups = cache->stats.hits + cache->stats.misses;
+    double rate = lookups ? 100.0 * cache->stats.hits / lookups : 0.0;
+    fprintf(out, "%s: %lld hits, %lld misses (%.1f%%), %lld stores, %lld evictions\n", name, cache->stats.hits, cache->stats.misses, rate, cache->stats.stores, cache->stats.evictions);
+}
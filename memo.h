@@ -0,0 +1,51 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include "ast.h"
+#include "boxed.h"
+#include <stdio.h>
+
+#define MEMO_MAX_ARGS 4
+
+typedef struct {
+    PrimitiveType type;
+    PrimitiveValue value;
+} MemoValue;
+
+// Arguments and result are kept boxed, so an entry fits in one cache line;
+// the few values that do not fit inline own a heap box.
+typedef struct {
+    BoxedValue args[MEMO_MAX_ARGS];
+    BoxedValue result;
+    uint64_t hash;
+    uint32_t stamp;         // last use, for replacement within a set
+    bool used;
+} MemoEntry;
+
+typedef struct {
+    long long hits;
+    long long misses;
+    long long stores;
+    long long evictions;
+} MemoStats;
+
+// Fixed-size two-way set associative cache of results for one function.
+// It never grows; a full set evicts its least recently used entry.
+typedef struct {
+    MemoEntry *entries;
+    int capacity;
+    int argCount;
+    uint32_t clock;
+    MemoStats stats;
+} MemoCache;
+
+bool initMemoCache(MemoCache *cache, int argCount, int capacity);
+void freeMemoCache(MemoCache *cache);
+void clearMemoCache(MemoCache *cache);
+
+bool memoLookup(MemoCache *cache, const MemoValue *args, MemoValue *result);
+void memoStore(MemoCache *cache, const MemoValue *args, MemoValue result);
+
+void printMemoStats(MemoCache *cache, const char *name, FILE *out);
+
+#endif
@@ -0,0 +1,405 @@
+#include "memops.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Used when the L3 size cannot be read.
+#define DEFAULT_CACHE_SIZE (8u << 20)
+// Below this the vector loops are not worth their setup.
+#define LOOP_MINIMUM 256
+
+#define ALWAYS_INLINE static inline __attribute__((always_inline))
+
+static pthread_once_t featuresOnce = PTHREAD_ONCE_INIT;
+static _Atomic bool featuresReady;
+static int hasAvx2;
+// From this size a copy or fill bypasses the cache: it would evict
+// everything else and the data would be gone from it before it is read.
+static size_t streamingThreshold;
+
+static void detectFeatures(void){
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    hasAvx2 = __builtin_cpu_supports("avx2");
+#endif
+    long cache = -1;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    cache = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+    // a copy brings in both its source and its destination
+    streamingThreshold = (cache > 0 ? (size_t)cache : DEFAULT_CACHE_SIZE) / 2;
+    atomic_store_explicit(&featuresReady, true, memory_order_release);
+}
+
+// The flag keeps the call to pthread_once off every copy.
+ALWAYS_INLINE void ensureFeatures(void){
+    if(!atomic_load_explicit(&featuresReady, memory_order_acquire)) pthread_once(&featuresOnce, detectFeatures);
+}
+
+// Every load is done before the first store, so these are right for any
+// overlap. The memcpy calls have constant sizes and become single moves.
+ALWAYS_INLINE void moveUpTo16(unsigned char *dest, const unsigned char *src, size_t size){
+    if(size >= 8){
+        uint64_t head, tail;
+        memcpy(&head, src, 8);
+        memcpy(&tail, src + size - 8, 8);
+        memcpy(dest, &head, 8);
+        memcpy(dest + size - 8, &tail, 8);
+    } else if(size >= 4){
+        uint32_t head, tail;
+        memcpy(&head, src, 4);
+        memcpy(&tail, src + size - 4, 4);
+        memcpy(dest, &head, 4);
+        memcpy(dest + size - 4, &tail, 4);
+    } else if(size >= 2){
+        uint16_t head, tail;
+        memcpy(&head, src, 2);
+        memcpy(&tail, src + size - 2, 2);
+        memcpy(dest, &head, 2);
+        memcpy(dest + size - 2, &tail, 2);
+    } else if(size == 1){
+        *dest = *src;
+    }
+}
+
+ALWAYS_INLINE void fillUpTo16(unsigned char *dest, int byte, size_t size){
+    uint64_t pattern = 0x0101010101010101ULL * (unsigned char)byte;
+    if(size >= 8){
+        memcpy(dest, &pattern, 8);
+        memcpy(dest + size - 8, &pattern, 8);
+    } else if(size >= 4){
+        memcpy(dest, &pattern, 4);
+        memcpy(dest + size - 4, &pattern, 4);
+    } else if(size >= 2){
+        memcpy(dest, &pattern, 2);
+        memcpy(dest + size - 2, &pattern, 2);
+    } else if(size == 1){
+        *dest = (unsigned char)byte;
+    }
+}
+
+#if defined(__x86_64__)
+
+// SSE2 is part of x86-64, so sizes up to 64 need no dispatch.
+ALWAYS_INLINE void moveUpTo64(unsigned char *dest, const unsigned char *src, size_t size){
+    if(size <= 16){
+        moveUpTo16(dest, src, size);
+    } else if(size <= 32){
+        __m128i head = _mm_loadu_si128((const __m128i *)src);
+        __m128i tail = _mm_loadu_si128((const __m128i *)(src + size - 16));
+        _mm_storeu_si128((__m128i *)dest, head);
+        _mm_storeu_si128((__m128i *)(dest + size - 16), tail);
+    } else {
+        __m128i a = _mm_loadu_si128((const __m128i *)src);
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(src + size - 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(src + size - 16));
+        _mm_storeu_si128((__m128i *)dest, a);
+        _mm_storeu_si128((__m128i *)(dest + 16), b);
+        _mm_storeu_si128((__m128i *)(dest + size - 32), c);
+        _mm_storeu_si128((__m128i *)(dest + size - 16), d);
+    }
+}
+
+ALWAYS_INLINE void fillUpTo64(unsigned char *dest, int byte, size_t size){
+    if(size <= 16){
+        fillUpTo16(dest, byte, size);
+        return;
+    }
+    __m128i pattern = _mm_set1_epi8((char)byte);
+    _mm_storeu_si128((__m128i *)dest, pattern);
+    _mm_storeu_si128((__m128i *)(dest + size - 16), pattern);
+    if(size > 32){
+        _mm_storeu_si128((__m128i *)(dest + 16), pattern);
+        _mm_storeu_si128((__m128i *)(dest + size - 32), pattern);
+    }
+}
+
+// Larger than 64 bytes. Up to LOOP_MINIMUM everything is loaded into
+// registers first; beyond, the first and last 32 bytes are held while the
+// loop stores aligned blocks in the direction that reads each source byte
+// before it can be overwritten.
+__attribute__((target("avx2")))
+static void moveAvx2(unsigned char *dest, const unsigned char *src, size_t size){
+    if(size <= 128){
+        __m256i a = _mm256_loadu_si256((const __m256i *)src);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(src + size - 64));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(src + size - 32));
+        _mm256_storeu_si256((__m256i *)dest, a);
+        _mm256_storeu_si256((__m256i *)(dest + 32), b);
+        _mm256_storeu_si256((__m256i *)(dest + size - 64), c);
+        _mm256_storeu_si256((__m256i *)(dest + size - 32), d);
+        return;
+    }
+    if(size <= LOOP_MINIMUM){
+        const unsigned char *srcEnd = src + size;
+        __m256i a = _mm256_loadu_si256((const __m256i *)src);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(src + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(src + 96));
+        __m256i e = _mm256_loadu_si256((const __m256i *)(srcEnd - 128));
+        __m256i f = _mm256_loadu_si256((const __m256i *)(srcEnd - 96));
+        __m256i g = _mm256_loadu_si256((const __m256i *)(srcEnd - 64));
+        __m256i h = _mm256_loadu_si256((const __m256i *)(srcEnd - 32));
+        unsigned char *destEnd = dest + size;
+        _mm256_storeu_si256((__m256i *)dest, a);
+        _mm256_storeu_si256((__m256i *)(dest + 32), b);
+        _mm256_storeu_si256((__m256i *)(dest + 64), c);
+        _mm256_storeu_si256((__m256i *)(dest + 96), d);
+        _mm256_storeu_si256((__m256i *)(destEnd - 128), e);
+        _mm256_storeu_si256((__m256i *)(destEnd - 96), f);
+        _mm256_storeu_si256((__m256i *)(destEnd - 64), g);
+        _mm256_storeu_si256((__m256i *)(destEnd - 32), h);
+        return;
+    }
+
+    __m256i head = _mm256_loadu_si256((const __m256i *)src);
+    __m256i tail = _mm256_loadu_si256((const __m256i *)(src + size - 32));
+    unsigned char *end = dest + size;
+
+    if((uintptr_t)dest - (uintptr_t)src < size){
+        // dest starts inside the source: copy from the top down
+        unsigned char *to = (unsigned char *)((uintptr_t)end & ~(uintptr_t)31);
+        const unsigned char *from = src + (to - dest);
+        while(to - dest > 128){
+            to -= 128;
+            from -= 128;
+            __m256i a = _mm256_loadu_si256((const __m256i *)(from + 96));
+            __m256i b = _mm256_loadu_si256((const __m256i *)(from + 64));
+            __m256i c = _mm256_loadu_si256((const __m256i *)(from + 32));
+            __m256i d = _mm256_loadu_si256((const __m256i *)from);
+            _mm256_store_si256((__m256i *)(to + 96), a);
+            _mm256_store_si256((__m256i *)(to + 64), b);
+            _mm256_store_si256((__m256i *)(to + 32), c);
+            _mm256_store_si256((__m256i *)to, d);
+        }
+        while(to - dest > 32){
+            to -= 32;
+            from -= 32;
+            _mm256_store_si256((__m256i *)to, _mm256_loadu_si256((const __m256i *)from));
+        }
+        _mm256_storeu_si256((__m256i *)(end - 32), tail);
+        _mm256_storeu_si256((__m256i *)dest, head);
+        return;
+    }
+
+    bool streaming = size >= streamingThreshold && (src + size <= dest || dest + size <= src);
+    unsigned char *to = (unsigned char *)(((uintptr_t)dest + 32) & ~(uintptr_t)31);
+    const unsigned char *from = src + (to - dest);
+    unsigned char *last = end - 32;
+    if(streaming){
+        while(last - to >= 128){
+            __m256i a = _mm256_loadu_si256((const __m256i *)from);
+            __m256i b = _mm256_loadu_si256((const __m256i *)(from + 32));
+            __m256i c = _mm256_loadu_si256((const __m256i *)(from + 64));
+            __m256i d = _mm256_loadu_si256((const __m256i *)(from + 96));
+            _mm256_stream_si256((__m256i *)to, a);
+            _mm256_stream_si256((__m256i *)(to + 32), b);
+            _mm256_stream_si256((__m256i *)(to + 64), c);
+            _mm256_stream_si256((__m256i *)(to + 96), d);
+            to += 128;
+            from += 128;
+        }
+        // streaming stores are weakly ordered
+        _mm_sfence();
+    }
+    while(last - to >= 128){
+        __m256i a = _mm256_loadu_si256((const __m256i *)from);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(from + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(from + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(from + 96));
+        _mm256_store_si256((__m256i *)to, a);
+        _mm256_store_si256((__m256i *)(to + 32), b);
+        _mm256_store_si256((__m256i *)(to + 64), c);
+        _mm256_store_si256((__m256i *)(to + 96), d);
+        to += 128;
+        from += 128;
+    }
+    // the last block may run into the tail, which is rewritten below
+    while(to < last){
+        _mm256_store_si256((__m256i *)to, _mm256_loadu_si256((const __m256i *)from));
+        to += 32;
+        from += 32;
+    }
+    _mm256_storeu_si256((__m256i *)dest, head);
+    _mm256_storeu_si256((__m256i *)last, tail);
+}
+
+// Larger than 64 bytes.
+__attribute__((target("avx2")))
+static void fillAvx2(unsigned char *dest, int byte, size_t size){
+    __m256i pattern = _mm256_set1_epi8((char)byte);
+    _mm256_storeu_si256((__m256i *)dest, pattern);
+    _mm256_storeu_si256((__m256i *)(dest + 32), pattern);
+    _mm256_storeu_si256((__m256i *)(dest + size - 64), pattern);
+    _mm256_storeu_si256((__m256i *)(dest + size - 32), pattern);
+    if(size <= 128) return;
+
+    unsigned char *to = (unsigned char *)(((uintptr_t)dest + 32) & ~(uintptr_t)31);
+    unsigned char *last = dest + size - 32;
+    if(size >= streamingThreshold){
+        while(last - to >= 128){
+            _mm256_stream_si256((__m256i *)to, pattern);
+            _mm256_stream_si256((__m256i *)(to + 32), pattern);
+            _mm256_stream_si256((__m256i *)(to + 64), pattern);
+            _mm256_stream_si256((__m256i *)(to + 96), pattern);
+            to += 128;
+        }
+        _mm_sfence();
+    }
+    while(last - to >= 128){
+        _mm256_store_si256((__m256i *)to, pattern);
+        _mm256_store_si256((__m256i *)(to + 32), pattern);
+        _mm256_store_si256((__m256i *)(to + 64), pattern);
+        _mm256_store_si256((__m256i *)(to + 96), pattern);
+        to += 128;
+    }
+    while(to < last){
+        _mm256_store_si256((__m256i *)to, pattern);
+        to += 32;
+    }
+}
+
+void moveMemory(void *dest, const void *src, size_t size){
+    if(size <= 64){
+        moveUpTo64(dest, src, size);
+        return;
+    }
+    ensureFeatures();
+    if(hasAvx2){
+        moveAvx2(dest, src, size);
+    } else {
+        memmove(dest, src, size);
+    }
+}
+
+void fillMemory(void *dest, int byte, size_t size){
+    if(size <= 64){
+        fillUpTo64(dest, byte, size);
+        return;
+    }
+    ensureFeatures();
+    if(hasAvx2){
+        fillAvx2(dest, byte, size);
+    } else {
+        memset(dest, byte, size);
+    }
+}
+
+#else
+
+ALWAYS_INLINE void moveUpTo64(unsigned char *dest, const unsigned char *src, size_t size){
+    if(size <= 16){
+        moveUpTo16(dest, src, size);
+    } else {
+        memmove(dest, src, size);
+    }
+}
+
+ALWAYS_INLINE void fillUpTo64(unsigned char *dest, int byte, size_t size){
+    if(size <= 16){
+        fillUpTo16(dest, byte, size);
+    } else {
+        memset(dest, byte, size);
+    }
+}
+
+void moveMemory(void *dest, const void *src, size_t size){
+    moveUpTo64(dest, src, size);
+}
+
+void fillMemory(void *dest, int byte, size_t size){
+    fillUpTo64(dest, byte, size);
+}
+
+#endif
+
+// Kernels for one size, or for a range whose bounds let the compiler keep
+// only the branch of moveUpTo64 or fillUpTo64 that applies.
+#define SIZED_KERNELS(name, size) \
+    static void move##name(void *dest, const void *src, size_t unused){ \
+        (void)unused; \
+        moveUpTo64(dest, src, size); \
+    } \
+    static void fill##name(void *dest, int byte, size_t unused){ \
+        (void)unused; \
+        fillUpTo64(dest, byte, size); \
+    }
+
+#define RANGE_KERNELS(name, low, high) \
+    static void move##name(void *dest, const void *src, size_t size){ \
+        if(size >= (low) && size <= (high)) moveUpTo64(dest, src, size); \
+    } \
+    static void fill##name(void *dest, int byte, size_t size){ \
+        if(size >= (low) && size <= (high)) fillUpTo64(dest, byte, size); \
+    }
+
+SIZED_KERNELS(1, 1)
+SIZED_KERNELS(2, 2)
+SIZED_KERNELS(4, 4)
+SIZED_KERNELS(8, 8)
+SIZED_KERNELS(16, 16)
+SIZED_KERNELS(32, 32)
+SIZED_KERNELS(64, 64)
+RANGE_KERNELS(3, 3, 3)
+RANGE_KERNELS(5To7, 5, 7)
+RANGE_KERNELS(9To15, 9, 15)
+RANGE_KERNELS(17To31, 17, 31)
+RANGE_KERNELS(33To63, 33, 63)
+
+static void moveNothing(void *dest, const void *src, size_t size){
+    (void)dest;
+    (void)src;
+    (void)size;
+}
+
+static void fillNothing(void *dest, int byte, size_t size){
+    (void)dest;
+    (void)byte;
+    (void)size;
+}
+
+MoveKernel moveKernelFor(size_t size){
+    switch(size){
+        case 0: return moveNothing;
+        case 1: return move1;
+        case 2: return move2;
+        case 3: return move3;
+        case 4: return move4;
+        case 8: return move8;
+        case 16: return move16;
+        case 32: return move32;
+        case 64: return move64;
+    }
+    if(size < 8) return move5To7;
+    if(size < 16) return move9To15;
+    if(size < 32) return move17To31;
+    if(size < 64) return move33To63;
+    return moveMemory;
+}
+
+FillKernel fillKernelFor(size_t size){
+    switch(size){
+        case 0: return fillNothing;
+        case 1: return fill1;
+        case 2: return fill2;
+        case 3: return fill3;
+        case 4: return fill4;
+        case 8: return fill8;
+        case 16: return fill16;
+        case 32: return fill32;
+        case 64: return fill64;
+    }
+    if(size < 8) return fill5To7;
+    if(size < 16) return fill9To15;
+    if(size < 32) return fill17To31;
+    if(size < 64) return fill33To63;
+    return fillMemory;
+}
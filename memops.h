@@ -0,0 +1,23 @@
+#ifndef MEMOPS_H
+#define MEMOPS_H
+
+#include <stddef.h>
+
+// The kernels behind memcpy, memmove and memset in scripts. Copies are
+// correct whatever the overlap, so memcpy and memmove share them.
+typedef void (*MoveKernel)(void *dest, const void *src, size_t size);
+typedef void (*FillKernel)(void *dest, int byte, size_t size);
+
+// Up to 64 bytes are moved with loads that all happen before the stores;
+// larger sizes use AVX2 where the CPU has it, with streaming stores once
+// a copy or fill is too big to stay in the cache.
+void moveMemory(void *dest, const void *src, size_t size);
+void fillMemory(void *dest, int byte, size_t size);
+
+// The kernel for a size known before the call: straight-line code for
+// sizes up to 64, moveMemory or fillMemory beyond. Kernels are only valid
+// for that size.
+MoveKernel moveKernelFor(size_t size);
+FillKernel fillKernelFor(size_t size);
+
+#endif
@@ -2,6 +2,15 @@
 #include <stdlib.h>
 #include <stdbool.h>
 
+// Frees what a construct parsed before it failed, so a script with a syntax
+// error leaves nothing behind.
+static ASTNode *discard(ASTNode *first, ASTNode *second, ASTNode *third){
+    freeAST(first);
+    freeAST(second);
+    freeAST(third);
+    return NULL;
+}
+
 int getPrecedence(TokenType type){
     switch(type){
         case TOKEN_OR:
@@ -56,8 +65,9 @@ ASTNode *parsePrimaryExpression(Parser *parser){
         case TOKEN_LPAREN: {
             advance(parser);
             expr = parseExpression(parser);
+            if(!expr) return NULL;
             if(parser->current.type != TOKEN_RPAREN){
-                return NULL;
+                return discard(expr, NULL, NULL);
             }
             advance(parser);
             break;
@@ -148,7 +158,7 @@ ASTNode *parseBinaryExpression(Parser *parser, int minPrecedence){
         advance(parser);
 
         ASTNode *right = parseBinaryExpression(parser, prec + 1);
-        if(!right) return NULL;
+        if(!right) return discard(left, NULL, NULL);
 
         left = createBinaryOpNode(left, right, op);
     }
@@ -163,13 +173,13 @@ ASTNode *parseTernaryExpression(Parser *parser){
         advance(parser);
 
         ASTNode *trueExpr = parseExpression(parser);
-        if(!trueExpr) return NULL;
+        if(!trueExpr) return discard(condition, NULL, NULL);
 
-        if(parser->current.type != TOKEN_COLON) return NULL;
+        if(parser->current.type != TOKEN_COLON) return discard(condition, trueExpr, NULL);
         advance(parser);
 
         ASTNode *falseExpr = parseExpression(parser);
-        if(!falseExpr) return NULL;
+        if(!falseExpr) return discard(condition, trueExpr, NULL);
 
         return createTernaryOpNode(condition, trueExpr, falseExpr);
     }
@@ -192,7 +202,13 @@ ASTNode *parsePostfixExpression(Parser *parser){
                 if(parser->current.type != TOKEN_RPAREN){
                     while(1){
                         ASTNode *arg = parseExpression(parser);
-                        if(!arg) return NULL;
+                        if(!arg){
+                            for(int i = 0; i < argsCount; i++){
+                                freeAST(args[i]);
+                            }
+                            free(args);
+                            return discard(expr, NULL, NULL);
+                        }
 
                         args = realloc(args, sizeof(ASTNode *) * (argsCount + 1));
                         args[argsCount++] = arg;
@@ -204,17 +220,24 @@ ASTNode *parsePostfixExpression(Parser *parser){
                         }
                     }
                 }
-                if(parser->current.type != TOKEN_RPAREN) return NULL;
+                if(parser->current.type != TOKEN_RPAREN){
+                    for(int i = 0; i < argsCount; i++){
+                        freeAST(args[i]);
+                    }
+                    free(args);
+                    return discard(expr, NULL, NULL);
+                }
                 advance(parser);
                 expr = createFunctionCallNode(expr, args, argsCount);
+                free(args);
                 break;
             }
 
             case TOKEN_LBRACKET: {
                 advance(parser);
                 ASTNode *index = parseExpression(parser);
-                if(!index) return NULL;
-                if(parser->current.type != TOKEN_RBRACKET) return NULL;
+                if(!index) return discard(expr, NULL, NULL);
+                if(parser->current.type != TOKEN_RBRACKET) return discard(expr, index, NULL);
                 advance(parser);
 
                 expr = createArrayAccessNode(expr, index);
@@ -223,7 +246,7 @@ ASTNode *parsePostfixExpression(Parser *parser){
 
             case TOKEN_DOT: {
                 advance(parser);
-                if(parser->current.type != TOKEN_IDENTIFIER) return NULL;
+                if(parser->current.type != TOKEN_IDENTIFIER) return discard(expr, NULL, NULL);
                 char *field = parser->current.data.identifier;
                 advance(parser);
 
@@ -233,7 +256,7 @@ ASTNode *parsePostfixExpression(Parser *parser){
 
             case TOKEN_ARROW: {
                 advance(parser);
-                if(parser->current.type != TOKEN_IDENTIFIER) return NULL;
+                if(parser->current.type != TOKEN_IDENTIFIER) return discard(expr, NULL, NULL);
                 char *field = parser->current.data.identifier;
                 advance(parser);
 
@@ -250,7 +273,7 @@ ASTNode *parseExpressionStmt(Parser *parser){
     ASTNode *expr = parseExpression(parser);
     if(!expr) return NULL;
 
-    if(parser->current.type != TOKEN_SEMICOLON) return NULL;
+    if(parser->current.type != TOKEN_SEMICOLON) return discard(expr, NULL, NULL);
 
     advance(parser);
     return expr;
@@ -264,16 +287,24 @@ ASTNode *parseBlockStmt(Parser *parser){
     int count = 0;
 
     while(parser->current.type != TOKEN_RBRACE && parser->current.type != TOKEN_EOF){
-        ASTNode *stmt = parseStatement(parser);
-        if(!stmt) return NULL;
+        ASTNode *stmt = parseStmt(parser);
+        if(!stmt) break;
 
         statements = realloc(statements, sizeof(ASTNode *) * (count + 1));
         statements[count++] = stmt;
     }
 
-    if(parser->current.type != TOKEN_RBRACE) return NULL;
+    if(parser->current.type != TOKEN_RBRACE){
+        for(int i = 0; i < count; i++){
+            freeAST(statements[i]);
+        }
+        free(statements);
+        return NULL;
+    }
     advance(parser);
-    return createBlockNode(statements, count);
+    ASTNode *block = createBlockNode(statements, count);
+    free(statements);
+    return block;
 }
 
 ASTNode *parseReturnStmt(Parser *parser){
@@ -286,7 +317,7 @@ ASTNode *parseReturnStmt(Parser *parser){
         if(!expr) return NULL;
     }
 
-    if(parser->current.type != TOKEN_SEMICOLON) return NULL;
+    if(parser->current.type != TOKEN_SEMICOLON) return discard(expr, NULL, NULL);
     advance(parser);
 
     return createReturnNode(expr);
@@ -302,17 +333,17 @@ ASTNode *parseIfStmt(Parser *parser){
     ASTNode *condition = parseExpression(parser);
     if(!condition) return NULL;
 
-    if(parser->current.type != TOKEN_RPAREN) return NULL;
+    if(parser->current.type != TOKEN_RPAREN) return discard(condition, NULL, NULL);
     advance(parser);
 
-    ASTNode *thenBranch = parseStatement(parser);
-    if(!thenBranch) return NULL;
+    ASTNode *thenBranch = parseStmt(parser);
+    if(!thenBranch) return discard(condition, NULL, NULL);
 
     ASTNode *elseBranch = NULL;
     if(parser->current.type == TOKEN_ELSE){
         advance(parser);
-        elseBranch = parseStatement(parser);
-        if(!elseBranch) return NULL;
+        elseBranch = parseStmt(parser);
+        if(!elseBranch) return discard(condition, thenBranch, NULL);
     }
 
     return createIfStmtNode(condition, thenBranch, elseBranch);
@@ -328,17 +359,14 @@ ASTNode *parseWhileStmt(Parser *parser){
     ASTNode *condition = parseExpression(parser);
     if(!condition) return NULL;
 
-    if(parser->current.type != TOKEN_RPAREN) return NULL;
+    if(parser->current.type != TOKEN_RPAREN) return discard(condition, NULL, NULL);
     advance(parser);
 
-    ASTNode *body = parseStatement(parser);
-    if(!body) return NULL;
-
-    ASTNode **bodyArr = malloc(sizeof(ASTNode*));
-    if(!bodyArr) return NULL;
-    bodyArr[0] = body;
+    ASTNode *body = parseStmt(parser);
+    if(!body) return discard(condition, NULL, NULL);
 
-    return createWhileStmtNode(condition, bodyArr, 1);
+    // the node copies the body list
+    return createWhileStmtNode(condition, &body, 1);
 }
 
 ASTNode *parseForStmt(Parser *parser){
@@ -353,62 +381,64 @@ ASTNode *parseForStmt(Parser *parser){
         initializer = parseExpression(parser);
         if(!initializer) return NULL;
     }
-    if(parser->current.type != TOKEN_SEMICOLON) return NULL;
+    if(parser->current.type != TOKEN_SEMICOLON) return discard(initializer, NULL, NULL);
     advance(parser);
 
     ASTNode *condition = NULL;
     if(parser->current.type != TOKEN_SEMICOLON){
         condition = parseExpression(parser);
-        if(!condition) return NULL;
+        if(!condition) return discard(initializer, NULL, NULL);
     }
-    if(parser->current.type != TOKEN_SEMICOLON) return NULL;
+    if(parser->current.type != TOKEN_SEMICOLON) return discard(initializer, condition, NULL);
     advance(parser);
 
     ASTNode *increment = NULL;
     if(parser->current.type != TOKEN_RPAREN){
         increment = parseExpression(parser);
-        if(!increment) return NULL;
+        if(!increment) return discard(initializer, condition, NULL);
     }
-    if(parser->current.type != TOKEN_RPAREN) return NULL;
+    if(parser->current.type != TOKEN_RPAREN) return discard(initializer, condition, increment);
     advance(parser);
 
     ASTNode *body = parseStmt(parser);
-    if(!body) return NULL;
+    if(!body) return discard(initializer, condition, increment);
+
+    return createForStmtNode(initializer, condition, increment, &body, 1);
+}
+
+ASTNode *parseParallelForStmt(Parser *parser){
+    if(parser->current.type != TOKEN_PARALLEL) return NULL;
+    advance(parser);
 
-    ASTNode **bodyArr = malloc(sizeof(ASTNode *));
-    if(!bodyArr) return NULL;
-    bodyArr[0] = body;
-    
-    return createForStmtNode(initializer, condition, increment, bodyArr, 1);
+    ASTNode *loop = parseForStmt(parser);
+    if(!loop) return NULL;
+    loop->forStmt.parallel = true;
+    return loop;
 }
 
 ASTNode *parseDoWhileStmt(Parser *parser){
     if(parser->current.type != TOKEN_DO) return NULL;
     advance(parser);
 
-    ASTNode *body = parseStatement(parser);
+    ASTNode *body = parseStmt(parser);
     if(!body) return NULL;
 
-    ASTNode **bodyArr = malloc(sizeof(ASTNode*));
-    if(!bodyArr) return NULL;
-    bodyArr[0] = body;
-
-    if(parser->current.type != TOKEN_WHILE) return NULL;
+    if(parser->current.type != TOKEN_WHILE) return discard(body, NULL, NULL);
     advance(parser);
 
-    if(parser->current.type != TOKEN_LPAREN) return NULL;
+    if(parser->current.type != TOKEN_LPAREN) return discard(body, NULL, NULL);
     advance(parser);
 
     ASTNode *condition = parseExpression(parser);
-    if(!condition) return NULL;
+    if(!condition) return discard(body, NULL, NULL);
 
-    if(parser->current.type != TOKEN_RPAREN) return NULL;
+    if(parser->current.type != TOKEN_RPAREN) return discard(body, condition, NULL);
     advance(parser);
 
-    if(parser->current.type != TOKEN_SEMICOLON) return NULL;
+    if(parser->current.type != TOKEN_SEMICOLON) return discard(body, condition, NULL);
     advance(parser);
 
-    return createDoWhileStmtNode(condition, bodyArr, 1);
+    return createDoWhileStmtNode(&body, 1, condition);
 }
 
 ASTNode *parseStmt(Parser *parser){
@@ -423,6 +453,8 @@ ASTNode *parseStmt(Parser *parser){
             return parseWhileStmt(parser);
         case TOKEN_FOR:
             return parseForStmt(parser);
+        case TOKEN_PARALLEL:
+            return parseParallelForStmt(parser);
         case TOKEN_DO:
             return parseDoWhileStmt(parser);
         default:
@@ -452,7 +484,7 @@ ASTNode *parseAssignmentExpr(Parser *parser){
     }
     advance(parser);
     ASTNode *right = parseExpression(parser);
-    if(!right) return NULL;
+    if(!right) return discard(left, NULL, NULL);
 
     return createAssignmentNode(left, right, op);
 }
@@ -10,6 +10,8 @@ typedef struct {
 
 void initParser(Parser *parser, Lexer *lexer);
 void advance(Parser *parser);
+UnaryOpType tokenToUnaryOp(TokenType type, bool isPrefix);
+BinaryOpType tokenToBinaryOp(TokenType type);
 ASTNode *parseExpression(Parser *parser);
 ASTNode *parseUnaryExpression(Parser *parser);
 ASTNode *parsePrimaryExpression(Parser *parser);
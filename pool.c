@@ -0,0 +1,285 @@
+#include "pool.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Halving a range of 64-bit bounds leaves at most 64 ranges behind it.
+#define DEQUE_CAPACITY 128
+// How long a chunk should run once the cost of an iteration is known: long
+// enough to hide the split and the clock reads, short enough to balance.
+#define CHUNK_NANOSECONDS 50000
+#define SPINS_BEFORE_YIELD 64
+
+typedef struct {
+    _Atomic int64_t lo;
+    _Atomic int64_t hi;
+} RangeSlot;
+
+// Chase-Lev deque: the owner pushes and takes at the bottom, thieves take
+// from the top, so they get the oldest and largest ranges.
+typedef struct {
+    _Alignas(64) _Atomic int64_t top;
+    _Alignas(64) _Atomic int64_t bottom;
+    RangeSlot slots[DEQUE_CAPACITY];
+} Deque;
+
+typedef struct {
+    Deque deque;
+    WorkPool *pool;
+    int index;
+    int64_t grain;              // ranges up to this many iterations run without splitting
+    uint64_t seed;              // picks the first victim to steal from
+    long long chunks;
+    long long steals;
+    pthread_t thread;
+} Worker;
+
+struct WorkPool {
+    Worker *workers;
+    int count;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned generation;        // bumped by every loop
+    int running;                // threads besides the caller still in the loop
+    bool stopping;
+
+    RangeBody body;
+    void *ctx;
+    int64_t maxGrain;           // keeps a few ranges per worker around to steal
+    _Atomic int64_t remaining;  // iterations not run yet
+    _Atomic int failed;         // first failing worker + 1, 0 while all succeed
+};
+
+static bool pushRange(Deque *d, int64_t lo, int64_t hi){
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    if(b - t >= DEQUE_CAPACITY) return false;
+    RangeSlot *slot = &d->slots[b % DEQUE_CAPACITY];
+    atomic_store_explicit(&slot->lo, lo, memory_order_relaxed);
+    atomic_store_explicit(&slot->hi, hi, memory_order_relaxed);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_release);
+    return true;
+}
+
+static bool takeRange(Deque *d, int64_t *lo, int64_t *hi){
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&d->top, memory_order_relaxed);
+    if(t > b){
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return false;
+    }
+    RangeSlot *slot = &d->slots[b % DEQUE_CAPACITY];
+    *lo = atomic_load_explicit(&slot->lo, memory_order_relaxed);
+    *hi = atomic_load_explicit(&slot->hi, memory_order_relaxed);
+    if(t < b) return true;
+
+    // the last range goes to whoever moves top first
+    bool won = atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    return won;
+}
+
+static bool stealRange(Deque *d, int64_t *lo, int64_t *hi){
+    int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if(t >= b) return false;
+    RangeSlot *slot = &d->slots[t % DEQUE_CAPACITY];
+    int64_t stolenLo = atomic_load_explicit(&slot->lo, memory_order_relaxed);
+    int64_t stolenHi = atomic_load_explicit(&slot->hi, memory_order_relaxed);
+    if(!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed)) return false;
+    *lo = stolenLo;
+    *hi = stolenHi;
+    return true;
+}
+
+static uint64_t nextRandom(Worker *w){
+    w->seed ^= w->seed << 13;
+    w->seed ^= w->seed >> 7;
+    w->seed ^= w->seed << 17;
+    return w->seed;
+}
+
+static bool stealFromOthers(WorkPool *pool, Worker *w, int64_t *lo, int64_t *hi){
+    if(pool->count < 2) return false;
+    int first = (int)(nextRandom(w) % (uint64_t)pool->count);
+    for(int i = 0; i < pool->count; i++){
+        Worker *victim = &pool->workers[(first + i) % pool->count];
+        if(victim != w && stealRange(&victim->deque, lo, hi)){
+            w->steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int64_t nanoseconds(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Moves the grain halfway towards what this chunk says runs for
+// CHUNK_NANOSECONDS; bodies that vary from one iteration to the next keep
+// it from jumping around.
+static void adaptGrain(WorkPool *pool, Worker *w, int64_t iterations, int64_t elapsed){
+    double target = (double)iterations * CHUNK_NANOSECONDS / (double)(elapsed > 0 ? elapsed : 1);
+    int64_t grain = target > (double)pool->maxGrain ? pool->maxGrain : (int64_t)target;
+    w->grain = (w->grain + (grain > 1 ? grain : 1)) / 2;
+    if(w->grain < 1) w->grain = 1;
+}
+
+// Leaves the upper halves of the range to thieves and runs what is left.
+static bool runRange(WorkPool *pool, Worker *w, int64_t lo, int64_t hi){
+    while(hi - lo > w->grain){
+        int64_t mid = lo + (hi - lo) / 2;
+        if(!pushRange(&w->deque, mid, hi)) break;
+        hi = mid;
+    }
+    int64_t before = nanoseconds();
+    bool ok = pool->body(w->index, lo, hi, pool->ctx);
+    adaptGrain(pool, w, hi - lo, nanoseconds() - before);
+    w->chunks++;
+    atomic_fetch_sub_explicit(&pool->remaining, hi - lo, memory_order_acq_rel);
+    return ok;
+}
+
+static void workLoop(WorkPool *pool, Worker *w){
+    int idle = 0;
+    while(atomic_load_explicit(&pool->remaining, memory_order_acquire) > 0 && atomic_load_explicit(&pool->failed, memory_order_relaxed) == 0){
+        int64_t lo, hi;
+        if(takeRange(&w->deque, &lo, &hi) || stealFromOthers(pool, w, &lo, &hi)){
+            idle = 0;
+            if(!runRange(pool, w, lo, hi)){
+                int none = 0;
+                atomic_compare_exchange_strong(&pool->failed, &none, w->index + 1);
+            }
+        } else if(++idle >= SPINS_BEFORE_YIELD){
+            sched_yield();
+        }
+    }
+}
+
+static void *workerMain(void *arg){
+    Worker *w = arg;
+    WorkPool *pool = w->pool;
+    unsigned seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    for(;;){
+        while(pool->generation == seen && !pool->stopping) pthread_cond_wait(&pool->start, &pool->lock);
+        if(pool->stopping) break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        workLoop(pool, w);
+
+        pthread_mutex_lock(&pool->lock);
+        if(--pool->running == 0) pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+WorkPool *createWorkPool(int workers){
+    if(workers <= 0){
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cores > 0 ? (int)cores : 1;
+    }
+    WorkPool *pool = calloc(1, sizeof(WorkPool));
+    if(!pool) return NULL;
+    void *memory = NULL;
+    if(posix_memalign(&memory, 64, (size_t)workers * sizeof(Worker)) != 0){
+        free(pool);
+        return NULL;
+    }
+    pool->workers = memory;
+    memset(pool->workers, 0, (size_t)workers * sizeof(Worker));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    // worker 0 is whichever thread calls parallelFor
+    pool->count = workers;
+    for(int i = 0; i < workers; i++){
+        Worker *w = &pool->workers[i];
+        w->pool = pool;
+        w->index = i;
+        w->seed = 0x9E3779B97F4A7C15ull * (uint64_t)(i + 1);
+        if(i > 0 && pthread_create(&w->thread, NULL, workerMain, w) != 0){
+            pool->count = i;
+            break;
+        }
+    }
+    return pool;
+}
+
+void freeWorkPool(WorkPool *pool){
+    if(!pool) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for(int i = 1; i < pool->count; i++) pthread_join(pool->workers[i].thread, NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->workers);
+    free(pool);
+}
+
+int workPoolSize(const WorkPool *pool){
+    return pool->count;
+}
+
+bool parallelFor(WorkPool *pool, int64_t start, int64_t end, RangeBody body, void *ctx, ParallelStats *stats){
+    if(stats) *stats = (ParallelStats){0, 0, -1};
+    if(end <= start) return true;
+
+    int64_t iterations = end - start;
+    pool->body = body;
+    pool->ctx = ctx;
+    pool->maxGrain = iterations / (4 * (int64_t)pool->count);
+    if(pool->maxGrain < 1) pool->maxGrain = 1;
+    atomic_store(&pool->remaining, iterations);
+    atomic_store(&pool->failed, 0);
+    for(int i = 0; i < pool->count; i++){
+        Worker *w = &pool->workers[i];
+        atomic_store(&w->deque.top, 0);
+        atomic_store(&w->deque.bottom, 0);
+        w->grain = 1;
+        w->chunks = 0;
+        w->steals = 0;
+    }
+    Worker *caller = &pool->workers[0];
+    pushRange(&caller->deque, start, end);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->running = pool->count - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    workLoop(pool, caller);
+
+    pthread_mutex_lock(&pool->lock);
+    while(pool->running > 0) pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+
+    int failed = atomic_load(&pool->failed);
+    if(stats){
+        for(int i = 0; i < pool->count; i++){
+            stats->chunks += pool->workers[i].chunks;
+            stats->steals += pool->workers[i].steals;
+        }
+        stats->failedWorker = failed - 1;
+    }
+    return failed == 0;
+}
@@ -0,0 +1,31 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Runs iterations [lo, hi) on worker, false to stop the loop.
+typedef bool (*RangeBody)(int worker, int64_t lo, int64_t hi, void *ctx);
+
+typedef struct {
+    long long chunks;           // calls of the body
+    long long steals;           // ranges taken from another worker's deque
+    int failedWorker;           // the first worker whose body returned false, -1 if none
+} ParallelStats;
+
+typedef struct WorkPool WorkPool;
+
+// workers counts the calling thread, which takes part in every loop; 0
+// starts one per online core.
+WorkPool *createWorkPool(int workers);
+void freeWorkPool(WorkPool *pool);
+int workPoolSize(const WorkPool *pool);
+
+// Splits [start, end) across the workers and returns once every iteration
+// ran or one body failed. Each worker keeps a Chase-Lev deque of ranges: it
+// splits its own range in halves, runs the lower end and leaves the upper
+// halves for idle workers to steal. The size a range is split down to
+// follows the measured cost of an iteration. One loop runs at a time.
+bool parallelFor(WorkPool *pool, int64_t start, int64_t end, RangeBody body, void *ctx, ParallelStats *stats);
+
+#endif
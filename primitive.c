@@ -0,0 +1,622 @@
+#include "primitive.h"
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+
+// Chosen by type, so unsigned types never compare a value below zero.
+#define IS_SIGNED(ctype) _Generic((ctype)0, \
+    char: CHAR_MIN < 0, \
+    signed char: 1, \
+    short: 1, \
+    int: 1, \
+    long: 1, \
+    long long: 1, \
+    default: 0)
+#define SIGN_BIT(CTYPE, UCTYPE, value) (((UCTYPE)(value) >> (sizeof(CTYPE) * CHAR_BIT - 1)) & 1)
+
+// type, suffix, C type, unsigned C type, union field, minimum value
+#define INTEGER_TYPES(X) \
+    X(TYPE_BYTE, Byte, unsigned char, unsigned char, byteVal, 0) \
+    X(TYPE_SHORT, Short, short, unsigned short, shortVal, SHRT_MIN) \
+    X(TYPE_USHORT, UShort, unsigned short, unsigned short, uShortVal, 0) \
+    X(TYPE_INT, Int, int, unsigned int, intVal, INT_MIN) \
+    X(TYPE_UINT, UInt, unsigned int, unsigned int, uIntVal, 0) \
+    X(TYPE_LONG, Long, long, unsigned long, longVal, LONG_MIN) \
+    X(TYPE_ULONG, ULong, unsigned long, unsigned long, uLongVal, 0) \
+    X(TYPE_LONG_LONG, LongLong, long long, unsigned long long, longLongVal, LLONG_MIN) \
+    X(TYPE_ULONG_LONG, ULongLong, unsigned long long, unsigned long long, uLongLongVal, 0) \
+    X(TYPE_SIGNED_CHAR, SignedChar, signed char, unsigned char, signedCharVal, SCHAR_MIN) \
+    X(TYPE_CHAR, Char, char, unsigned char, charVal, CHAR_MIN) \
+    X(TYPE_UNSIGNED_CHAR, UChar, unsigned char, unsigned char, uCharVal, 0) \
+    X(TYPE_ARCH, Arch, intptr_t, uintptr_t, archVal, INTPTR_MIN) \
+    X(TYPE_UNSIGNED_ARCH, UArch, uintptr_t, uintptr_t, uArchVal, 0)
+
+#define FLOATING_TYPES(X) \
+    X(TYPE_FLOAT, Float, float, floatVal) \
+    X(TYPE_DOUBLE, Double, double, doubleVal) \
+    X(TYPE_LONG_DOUBLE, LongDouble, long double, longDoubleVal)
+
+#define DEFINE_COMPARISONS(NAME, FIELD) \
+    static PrimitiveStatus equ##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        *out = (PrimitiveValue){0}; out->boolVal = a.FIELD == b.FIELD; return PRIM_OK; \
+    } \
+    static PrimitiveStatus notEqu##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        *out = (PrimitiveValue){0}; out->boolVal = a.FIELD != b.FIELD; return PRIM_OK; \
+    } \
+    static PrimitiveStatus less##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        *out = (PrimitiveValue){0}; out->boolVal = a.FIELD < b.FIELD; return PRIM_OK; \
+    } \
+    static PrimitiveStatus lessEqu##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        *out = (PrimitiveValue){0}; out->boolVal = a.FIELD <= b.FIELD; return PRIM_OK; \
+    } \
+    static PrimitiveStatus greater##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        *out = (PrimitiveValue){0}; out->boolVal = a.FIELD > b.FIELD; return PRIM_OK; \
+    } \
+    static PrimitiveStatus greaterEqu##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        *out = (PrimitiveValue){0}; out->boolVal = a.FIELD >= b.FIELD; return PRIM_OK; \
+    } \
+    static PrimitiveStatus and##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        *out = (PrimitiveValue){0}; out->boolVal = a.FIELD && b.FIELD; return PRIM_OK; \
+    } \
+    static PrimitiveStatus or##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        *out = (PrimitiveValue){0}; out->boolVal = a.FIELD || b.FIELD; return PRIM_OK; \
+    } \
+    static PrimitiveStatus not##NAME(PrimitiveValue a, PrimitiveValue *out){ \
+        *out = (PrimitiveValue){0}; out->boolVal = !a.FIELD; return PRIM_OK; \
+    } \
+    static PrimitiveStatus positive##NAME(PrimitiveValue a, PrimitiveValue *out){ \
+        *out = a; return PRIM_OK; \
+    }
+
+#define DEFINE_INTEGER_HANDLERS(TYPE, NAME, CTYPE, UCTYPE, FIELD, MIN) \
+    DEFINE_COMPARISONS(NAME, FIELD) \
+    static PrimitiveStatus add##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        CTYPE result; \
+        bool overflow = __builtin_add_overflow(a.FIELD, b.FIELD, &result); \
+        *out = (PrimitiveValue){0}; out->FIELD = result; \
+        return overflow && IS_SIGNED(CTYPE) ? PRIM_OVERFLOW : PRIM_OK; \
+    } \
+    static PrimitiveStatus sub##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        CTYPE result; \
+        bool overflow = __builtin_sub_overflow(a.FIELD, b.FIELD, &result); \
+        *out = (PrimitiveValue){0}; out->FIELD = result; \
+        return overflow && IS_SIGNED(CTYPE) ? PRIM_OVERFLOW : PRIM_OK; \
+    } \
+    static PrimitiveStatus mul##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        CTYPE result; \
+        bool overflow = __builtin_mul_overflow(a.FIELD, b.FIELD, &result); \
+        *out = (PrimitiveValue){0}; out->FIELD = result; \
+        return overflow && IS_SIGNED(CTYPE) ? PRIM_OVERFLOW : PRIM_OK; \
+    } \
+    static PrimitiveStatus div##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        *out = (PrimitiveValue){0}; \
+        if(b.FIELD == 0) return PRIM_DIV_BY_ZERO; \
+        if(IS_SIGNED(CTYPE) && b.FIELD == (CTYPE)-1 && a.FIELD == (CTYPE)(MIN)){ \
+            out->FIELD = a.FIELD; \
+            return PRIM_OVERFLOW; \
+        } \
+        out->FIELD = (CTYPE)(a.FIELD / b.FIELD); \
+        return PRIM_OK; \
+    } \
+    static PrimitiveStatus mod##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        *out = (PrimitiveValue){0}; \
+        if(b.FIELD == 0) return PRIM_DIV_BY_ZERO; \
+        if(IS_SIGNED(CTYPE) && b.FIELD == (CTYPE)-1) return a.FIELD == (CTYPE)(MIN) ? PRIM_OVERFLOW : PRIM_OK; \
+        out->FIELD = (CTYPE)(a.FIELD % b.FIELD); \
+        return PRIM_OK; \
+    } \
+    static PrimitiveStatus bitAnd##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        *out = (PrimitiveValue){0}; out->FIELD = (CTYPE)(a.FIELD & b.FIELD); return PRIM_OK; \
+    } \
+    static PrimitiveStatus bitOr##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        *out = (PrimitiveValue){0}; out->FIELD = (CTYPE)(a.FIELD | b.FIELD); return PRIM_OK; \
+    } \
+    static PrimitiveStatus bitXor##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        *out = (PrimitiveValue){0}; out->FIELD = (CTYPE)(a.FIELD ^ b.FIELD); return PRIM_OK; \
+    } \
+    static PrimitiveStatus shiftLeft##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        long long count = b.longLongVal; \
+        *out = (PrimitiveValue){0}; \
+        if(count < 0 || count >= (long long)(sizeof(CTYPE) * CHAR_BIT)) return PRIM_INVALID_SHIFT; \
+        out->FIELD = (CTYPE)((UCTYPE)a.FIELD << count); \
+        if(IS_SIGNED(CTYPE) && (SIGN_BIT(CTYPE, UCTYPE, a.FIELD) || (CTYPE)(out->FIELD >> count) != a.FIELD)) return PRIM_OVERFLOW; \
+        return PRIM_OK; \
+    } \
+    static PrimitiveStatus shiftRight##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        long long count = b.longLongVal; \
+        *out = (PrimitiveValue){0}; \
+        if(count < 0 || count >= (long long)(sizeof(CTYPE) * CHAR_BIT)) return PRIM_INVALID_SHIFT; \
+        out->FIELD = (CTYPE)(a.FIELD >> count); \
+        return PRIM_OK; \
+    } \
+    static PrimitiveStatus negative##NAME(PrimitiveValue a, PrimitiveValue *out){ \
+        CTYPE result; \
+        bool overflow = __builtin_sub_overflow((CTYPE)0, a.FIELD, &result); \
+        *out = (PrimitiveValue){0}; out->FIELD = result; \
+        return overflow && IS_SIGNED(CTYPE) ? PRIM_OVERFLOW : PRIM_OK; \
+    } \
+    static PrimitiveStatus bitNot##NAME(PrimitiveValue a, PrimitiveValue *out){ \
+        *out = (PrimitiveValue){0}; out->FIELD = (CTYPE)~a.FIELD; return PRIM_OK; \
+    }
+
+#define DEFINE_FLOATING_HANDLERS(TYPE, NAME, CTYPE, FIELD) \
+    DEFINE_COMPARISONS(NAME, FIELD) \
+    static PrimitiveStatus add##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        *out = (PrimitiveValue){0}; out->FIELD = a.FIELD + b.FIELD; return PRIM_OK; \
+    } \
+    static PrimitiveStatus sub##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        *out = (PrimitiveValue){0}; out->FIELD = a.FIELD - b.FIELD; return PRIM_OK; \
+    } \
+    static PrimitiveStatus mul##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        *out = (PrimitiveValue){0}; out->FIELD = a.FIELD * b.FIELD; return PRIM_OK; \
+    } \
+    static PrimitiveStatus div##NAME(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){ \
+        *out = (PrimitiveValue){0}; \
+        if(b.FIELD == 0) return PRIM_DIV_BY_ZERO; \
+        out->FIELD = a.FIELD / b.FIELD; \
+        return PRIM_OK; \
+    } \
+    static PrimitiveStatus negative##NAME(PrimitiveValue a, PrimitiveValue *out){ \
+        *out = (PrimitiveValue){0}; out->FIELD = -a.FIELD; return PRIM_OK; \
+    }
+
+#define INTEGER_ROW(TYPE, NAME, CTYPE, UCTYPE, FIELD, MIN) \
+    [TYPE] = { \
+        [ADD_BINOP] = add##NAME, [SUB_BINOP] = sub##NAME, [MUL_BINOP] = mul##NAME, \
+        [DIV_BINOP] = div##NAME, [MOD_BINOP] = mod##NAME, \
+        [AND_BINOP] = and##NAME, [OR_BINOP] = or##NAME, \
+        [BIT_AND_BINOP] = bitAnd##NAME, [BIT_OR_BINOP] = bitOr##NAME, [BIT_XOR_BINOP] = bitXor##NAME, \
+        [SHIFT_LEFT_BINOP] = shiftLeft##NAME, [SHIFT_RIGHT_BINOP] = shiftRight##NAME, \
+        [EQU_BINOP] = equ##NAME, [NOT_EQU_BINOP] = notEqu##NAME, \
+        [LESS_BINOP] = less##NAME, [LESS_EQU_BINOP] = lessEqu##NAME, \
+        [GREATER_BINOP] = greater##NAME, [GREATER_EQU_BINOP] = greaterEqu##NAME \
+    },
+
+#define FLOATING_ROW(TYPE, NAME, CTYPE, FIELD) \
+    [TYPE] = { \
+        [ADD_BINOP] = add##NAME, [SUB_BINOP] = sub##NAME, [MUL_BINOP] = mul##NAME, [DIV_BINOP] = div##NAME, \
+        [AND_BINOP] = and##NAME, [OR_BINOP] = or##NAME, \
+        [EQU_BINOP] = equ##NAME, [NOT_EQU_BINOP] = notEqu##NAME, \
+        [LESS_BINOP] = less##NAME, [LESS_EQU_BINOP] = lessEqu##NAME, \
+        [GREATER_BINOP] = greater##NAME, [GREATER_EQU_BINOP] = greaterEqu##NAME \
+    },
+
+#define INTEGER_UNARY_ROW(TYPE, NAME, CTYPE, UCTYPE, FIELD, MIN) \
+    [TYPE] = { \
+        [POSITIVE_UNOP] = positive##NAME, [NEGATIVE_UNOP] = negative##NAME, \
+        [NOT_UNOP] = not##NAME, [BIT_NOT_UNOP] = bitNot##NAME \
+    },
+
+#define FLOATING_UNARY_ROW(TYPE, NAME, CTYPE, FIELD) \
+    [TYPE] = { \
+        [POSITIVE_UNOP] = positive##NAME, [NEGATIVE_UNOP] = negative##NAME, [NOT_UNOP] = not##NAME \
+    },
+
+INTEGER_TYPES(DEFINE_INTEGER_HANDLERS)
+FLOATING_TYPES(DEFINE_FLOATING_HANDLERS)
+DEFINE_COMPARISONS(Bool, boolVal)
+
+static PrimitiveStatus bitAndBool(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){
+    *out = (PrimitiveValue){0}; out->boolVal = a.boolVal & b.boolVal; return PRIM_OK;
+}
+
+static PrimitiveStatus bitOrBool(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){
+    *out = (PrimitiveValue){0}; out->boolVal = a.boolVal | b.boolVal; return PRIM_OK;
+}
+
+static PrimitiveStatus bitXorBool(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){
+    *out = (PrimitiveValue){0}; out->boolVal = a.boolVal ^ b.boolVal; return PRIM_OK;
+}
+
+static int compareStrings(PrimitiveValue a, PrimitiveValue b){
+    if(!a.stringVal || !b.stringVal) return (a.stringVal != NULL) - (b.stringVal != NULL);
+    return strcmp(a.stringVal, b.stringVal);
+}
+
+static PrimitiveStatus equString(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){
+    *out = (PrimitiveValue){0}; out->boolVal = compareStrings(a, b) == 0; return PRIM_OK;
+}
+
+static PrimitiveStatus notEquString(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){
+    *out = (PrimitiveValue){0}; out->boolVal = compareStrings(a, b) != 0; return PRIM_OK;
+}
+
+static PrimitiveStatus lessString(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){
+    *out = (PrimitiveValue){0}; out->boolVal = compareStrings(a, b) < 0; return PRIM_OK;
+}
+
+static PrimitiveStatus lessEquString(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){
+    *out = (PrimitiveValue){0}; out->boolVal = compareStrings(a, b) <= 0; return PRIM_OK;
+}
+
+static PrimitiveStatus greaterString(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){
+    *out = (PrimitiveValue){0}; out->boolVal = compareStrings(a, b) > 0; return PRIM_OK;
+}
+
+static PrimitiveStatus greaterEquString(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out){
+    *out = (PrimitiveValue){0}; out->boolVal = compareStrings(a, b) >= 0; return PRIM_OK;
+}
+
+const PrimitiveBinaryHandler primitiveBinaryHandlers[PRIMITIVE_TYPE_COUNT][BINARY_OP_COUNT] = {
+    INTEGER_TYPES(INTEGER_ROW)
+    FLOATING_TYPES(FLOATING_ROW)
+    [TYPE_BOOL] = {
+        [AND_BINOP] = andBool, [OR_BINOP] = orBool,
+        [BIT_AND_BINOP] = bitAndBool, [BIT_OR_BINOP] = bitOrBool, [BIT_XOR_BINOP] = bitXorBool,
+        [EQU_BINOP] = equBool, [NOT_EQU_BINOP] = notEquBool,
+        [LESS_BINOP] = lessBool, [LESS_EQU_BINOP] = lessEquBool,
+        [GREATER_BINOP] = greaterBool, [GREATER_EQU_BINOP] = greaterEquBool
+    },
+    [TYPE_STRING] = {
+        [EQU_BINOP] = equString, [NOT_EQU_BINOP] = notEquString,
+        [LESS_BINOP] = lessString, [LESS_EQU_BINOP] = lessEquString,
+        [GREATER_BINOP] = greaterString, [GREATER_EQU_BINOP] = greaterEquString
+    }
+};
+
+const PrimitiveUnaryHandler primitiveUnaryHandlers[PRIMITIVE_TYPE_COUNT][UNARY_OP_COUNT] = {
+    INTEGER_TYPES(INTEGER_UNARY_ROW)
+    FLOATING_TYPES(FLOATING_UNARY_ROW)
+    [TYPE_BOOL] = { [POSITIVE_UNOP] = positiveBool, [NOT_UNOP] = notBool }
+};
+
+bool isIntegerType(PrimitiveType type){
+    switch(type){
+        case TYPE_BOOL:
+        case TYPE_FLOAT:
+        case TYPE_DOUBLE:
+        case TYPE_LONG_DOUBLE:
+        case TYPE_STRING:
+            return false;
+        default:
+            return true;
+    }
+}
+
+bool isSignedType(PrimitiveType type){
+    switch(type){
+        case TYPE_SHORT:
+        case TYPE_INT:
+        case TYPE_LONG:
+        case TYPE_LONG_LONG:
+        case TYPE_SIGNED_CHAR:
+        case TYPE_ARCH:
+        case TYPE_FLOAT:
+        case TYPE_DOUBLE:
+        case TYPE_LONG_DOUBLE:
+            return true;
+        case TYPE_CHAR:
+            return IS_SIGNED(char);
+        default:
+            return false;
+    }
+}
+
+bool isFloatingType(PrimitiveType type){
+    return type == TYPE_FLOAT || type == TYPE_DOUBLE || type == TYPE_LONG_DOUBLE;
+}
+
+bool isComparisonOp(BinaryOpType op){
+    switch(op){
+        case AND_BINOP:
+        case OR_BINOP:
+        case EQU_BINOP:
+        case NOT_EQU_BINOP:
+        case LESS_BINOP:
+        case LESS_EQU_BINOP:
+        case GREATER_BINOP:
+        case GREATER_EQU_BINOP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+size_t primitiveSize(PrimitiveType type){
+    switch(type){
+        case TYPE_BYTE: return sizeof(unsigned char);
+        case TYPE_BOOL: return sizeof(bool);
+        case TYPE_SHORT: return sizeof(short);
+        case TYPE_USHORT: return sizeof(unsigned short);
+        case TYPE_INT: return sizeof(int);
+        case TYPE_UINT: return sizeof(unsigned int);
+        case TYPE_LONG: return sizeof(long);
+        case TYPE_ULONG: return sizeof(unsigned long);
+        case TYPE_LONG_LONG: return sizeof(long long);
+        case TYPE_ULONG_LONG: return sizeof(unsigned long long);
+        case TYPE_FLOAT: return sizeof(float);
+        case TYPE_DOUBLE: return sizeof(double);
+        case TYPE_LONG_DOUBLE: return sizeof(long double);
+        case TYPE_SIGNED_CHAR: return sizeof(signed char);
+        case TYPE_CHAR: return sizeof(char);
+        case TYPE_UNSIGNED_CHAR: return sizeof(unsigned char);
+        case TYPE_STRING: return sizeof(char *);
+        case TYPE_ARCH: return sizeof(intptr_t);
+        case TYPE_UNSIGNED_ARCH: return sizeof(uintptr_t);
+    }
+    return 0;
+}
+
+static const struct {
+    const char *name;
+    PrimitiveType type;
+} primitiveNames[] = {
+    {"byte", TYPE_BYTE},
+    {"bool", TYPE_BOOL},
+    {"short", TYPE_SHORT},
+    {"ushort", TYPE_USHORT},
+    {"int", TYPE_INT},
+    {"uint", TYPE_UINT},
+    {"long", TYPE_LONG},
+    {"ulong", TYPE_ULONG},
+    {"longlong", TYPE_LONG_LONG},
+    {"ulonglong", TYPE_ULONG_LONG},
+    {"float", TYPE_FLOAT},
+    {"double", TYPE_DOUBLE},
+    {"longdouble", TYPE_LONG_DOUBLE},
+    {"schar", TYPE_SIGNED_CHAR},
+    {"char", TYPE_CHAR},
+    {"uchar", TYPE_UNSIGNED_CHAR},
+    {"string", TYPE_STRING},
+    {"arch", TYPE_ARCH},
+    {"uarch", TYPE_UNSIGNED_ARCH}
+};
+
+const char *primitiveTypeName(PrimitiveType type){
+    for(size_t i = 0; i < sizeof(primitiveNames) / sizeof(primitiveNames[0]); i++){
+        if(primitiveNames[i].type == type) return primitiveNames[i].name;
+    }
+    return "?";
+}
+
+bool typeNodeToPrimitive(ASTNode *typeNode, PrimitiveType *out){
+    if(!typeNode) return false;
+
+    if(typeNode->type == LITERAL_NODE){
+        *out = typeNode->literal.type;
+        return true;
+    }
+    if(typeNode->type != IDENTIFIER_NODE) return false;
+
+    for(size_t i = 0; i < sizeof(primitiveNames) / sizeof(primitiveNames[0]); i++){
+        if(strcmp(typeNode->identifier.name, primitiveNames[i].name) == 0){
+            *out = primitiveNames[i].type;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int integerRank(PrimitiveType type){
+    switch(type){
+        case TYPE_BOOL: return 0;
+        case TYPE_BYTE:
+        case TYPE_SIGNED_CHAR:
+        case TYPE_CHAR:
+        case TYPE_UNSIGNED_CHAR: return 1;
+        case TYPE_SHORT:
+        case TYPE_USHORT: return 2;
+        case TYPE_INT:
+        case TYPE_UINT: return 3;
+        case TYPE_LONG:
+        case TYPE_ULONG:
+        case TYPE_ARCH:
+        case TYPE_UNSIGNED_ARCH: return 4;
+        case TYPE_LONG_LONG:
+        case TYPE_ULONG_LONG: return 5;
+        default: return -1;
+    }
+}
+
+static PrimitiveType unsignedCounterpart(PrimitiveType type){
+    switch(type){
+        case TYPE_SHORT: return TYPE_USHORT;
+        case TYPE_INT: return TYPE_UINT;
+        case TYPE_LONG: return TYPE_ULONG;
+        case TYPE_LONG_LONG: return TYPE_ULONG_LONG;
+        case TYPE_SIGNED_CHAR:
+        case TYPE_CHAR: return TYPE_UNSIGNED_CHAR;
+        case TYPE_ARCH: return TYPE_UNSIGNED_ARCH;
+        default: return type;
+    }
+}
+
+// Usual arithmetic conversions, minus the promotion of small types to int:
+// the language keeps byte, short and char arithmetic in their own width.
+PrimitiveType promotePrimitiveTypes(PrimitiveType a, PrimitiveType b){
+    if(a == b) return a;
+    if(a == TYPE_STRING || b == TYPE_STRING) return TYPE_STRING;
+    if(a == TYPE_LONG_DOUBLE || b == TYPE_LONG_DOUBLE) return TYPE_LONG_DOUBLE;
+    if(a == TYPE_DOUBLE || b == TYPE_DOUBLE) return TYPE_DOUBLE;
+    if(a == TYPE_FLOAT || b == TYPE_FLOAT) return TYPE_FLOAT;
+
+    int rankA = integerRank(a);
+    int rankB = integerRank(b);
+    if(rankA == rankB) return isSignedType(a) ? b : a;
+
+    PrimitiveType high = rankA > rankB ? a : b;
+    PrimitiveType low = rankA > rankB ? b : a;
+    if(isSignedType(high) && !isSignedType(low) && low != TYPE_BOOL && primitiveSize(high) <= primitiveSize(low)){
+        return unsignedCounterpart(high);
+    }
+    return high;
+}
+
+PrimitiveType binaryResultType(BinaryOpType op, PrimitiveType leftType, PrimitiveType rightType){
+    if(isComparisonOp(op)) return TYPE_BOOL;
+    if(op == SHIFT_LEFT_BINOP || op == SHIFT_RIGHT_BINOP) return leftType;
+    if(op == COMMA_BINOP) return rightType;
+    return promotePrimitiveTypes(leftType, rightType);
+}
+
+static long long readSigned(PrimitiveType type, PrimitiveValue value){
+    switch(type){
+        case TYPE_SHORT: return value.shortVal;
+        case TYPE_INT: return value.intVal;
+        case TYPE_LONG: return value.longVal;
+        case TYPE_LONG_LONG: return value.longLongVal;
+        case TYPE_SIGNED_CHAR: return value.signedCharVal;
+        case TYPE_CHAR: return value.charVal;
+        case TYPE_ARCH: return value.archVal;
+        default: return 0;
+    }
+}
+
+static unsigned long long readUnsigned(PrimitiveType type, PrimitiveValue value){
+    switch(type){
+        case TYPE_BYTE: return value.byteVal;
+        case TYPE_BOOL: return value.boolVal;
+        case TYPE_USHORT: return value.uShortVal;
+        case TYPE_UINT: return value.uIntVal;
+        case TYPE_ULONG: return value.uLongVal;
+        case TYPE_ULONG_LONG: return value.uLongLongVal;
+        case TYPE_UNSIGNED_CHAR: return value.uCharVal;
+        case TYPE_UNSIGNED_ARCH: return value.uArchVal;
+        case TYPE_STRING: return (uintptr_t)value.stringVal;
+        default: return 0;
+    }
+}
+
+static long double readFloating(PrimitiveType type, PrimitiveValue value){
+    switch(type){
+        case TYPE_FLOAT: return value.floatVal;
+        case TYPE_DOUBLE: return value.doubleVal;
+        case TYPE_LONG_DOUBLE: return value.longDoubleVal;
+        default: return 0;
+    }
+}
+
+#define STORE_PRIMITIVE(type, result, x) \
+    switch(type){ \
+        case TYPE_BYTE: result.byteVal = (unsigned char)(x); break; \
+        case TYPE_BOOL: result.boolVal = (x) != 0; break; \
+        case TYPE_SHORT: result.shortVal = (short)(x); break; \
+        case TYPE_USHORT: result.uShortVal = (unsigned short)(x); break; \
+        case TYPE_INT: result.intVal = (int)(x); break; \
+        case TYPE_UINT: result.uIntVal = (unsigned int)(x); break; \
+        case TYPE_LONG: result.longVal = (long)(x); break; \
+        case TYPE_ULONG: result.uLongVal = (unsigned long)(x); break; \
+        case TYPE_LONG_LONG: result.longLongVal = (long long)(x); break; \
+        case TYPE_ULONG_LONG: result.uLongLongVal = (unsigned long long)(x); break; \
+        case TYPE_FLOAT: result.floatVal = (float)(x); break; \
+        case TYPE_DOUBLE: result.doubleVal = (double)(x); break; \
+        case TYPE_LONG_DOUBLE: result.longDoubleVal = (long double)(x); break; \
+        case TYPE_SIGNED_CHAR: result.signedCharVal = (signed char)(x); break; \
+        case TYPE_CHAR: result.charVal = (char)(x); break; \
+        case TYPE_UNSIGNED_CHAR: result.uCharVal = (unsigned char)(x); break; \
+        case TYPE_ARCH: result.archVal = (intptr_t)(x); break; \
+        case TYPE_UNSIGNED_ARCH: result.uArchVal = (uintptr_t)(x); break; \
+        case TYPE_STRING: break; \
+    }
+
+PrimitiveValue convertPrimitive(PrimitiveType from, PrimitiveValue value, PrimitiveType to){
+    if(from == to) return value;
+
+    PrimitiveValue result = {0};
+    if(from == TYPE_STRING || to == TYPE_STRING) return result;
+
+    if(isFloatingType(from)){
+        long double x = readFloating(from, value);
+        STORE_PRIMITIVE(to, result, x);
+    } else if(isSignedType(from)){
+        long long x = readSigned(from, value);
+        STORE_PRIMITIVE(to, result, x);
+    } else{
+        unsigned long long x = readUnsigned(from, value);
+        STORE_PRIMITIVE(to, result, x);
+    }
+    return result;
+}
+
+PrimitiveValue primitiveFromLongLong(PrimitiveType type, long long n){
+    PrimitiveValue value = {0};
+    value.longLongVal = n;
+    return convertPrimitive(TYPE_LONG_LONG, value, type);
+}
+
+// Fails for non-integer types and for unsigned values above LLONG_MAX.
+bool primitiveToLongLong(PrimitiveType type, PrimitiveValue value, long long *out){
+    if(!isIntegerType(type)) return false;
+    if(isSignedType(type)){
+        *out = readSigned(type, value);
+        return true;
+    }
+
+    unsigned long long n = readUnsigned(type, value);
+    if(n > LLONG_MAX) return false;
+    *out = (long long)n;
+    return true;
+}
+
+bool primitiveIsTruthy(PrimitiveType type, PrimitiveValue value){
+    if(type == TYPE_STRING) return value.stringVal != NULL;
+    if(isFloatingType(type)) return readFloating(type, value) != 0;
+    if(isSignedType(type)) return readSigned(type, value) != 0;
+    return readUnsigned(type, value) != 0;
+}
+
+bool primitiveEquals(PrimitiveType type, PrimitiveValue value, long long n){
+    if(type == TYPE_STRING) return false;
+    if(isFloatingType(type)) return readFloating(type, value) == (long double)n;
+    if(isSignedType(type)) return readSigned(type, value) == n;
+    return n >= 0 && readUnsigned(type, value) == (unsigned long long)n;
+}
+
+bool primitiveAllOnes(PrimitiveType type, PrimitiveValue value){
+    if(!isIntegerType(type)) return false;
+    if(isSignedType(type)) return readSigned(type, value) == -1;
+
+    unsigned long long bits = readUnsigned(type, value);
+    int width = (int)(primitiveSize(type) * CHAR_BIT);
+    unsigned long long mask = width >= 64 ? ~0ULL : (1ULL << width) - 1;
+    return bits == mask;
+}
+
+int primitivePowerOfTwo(PrimitiveType type, PrimitiveValue value){
+    if(!isIntegerType(type)) return -1;
+
+    unsigned long long bits;
+    if(isSignedType(type)){
+        long long n = readSigned(type, value);
+        if(n <= 0) return -1;
+        bits = (unsigned long long)n;
+    } else{
+        bits = readUnsigned(type, value);
+    }
+    if(bits == 0 || (bits & (bits - 1)) != 0) return -1;
+    return __builtin_ctzll(bits);
+}
+
+PrimitiveStatus evalBinaryPrimitive(BinaryOpType op, PrimitiveType leftType, PrimitiveValue left, PrimitiveType rightType, PrimitiveValue right, PrimitiveType *resultType, PrimitiveValue *out){
+    if(op == COMMA_BINOP){
+        *resultType = rightType;
+        *out = right;
+        return PRIM_OK;
+    }
+
+    PrimitiveType type;
+    if(op == SHIFT_LEFT_BINOP || op == SHIFT_RIGHT_BINOP){
+        if(!isIntegerType(rightType)) return PRIM_UNSUPPORTED;
+        type = leftType;
+        right = convertPrimitive(rightType, right, TYPE_LONG_LONG);
+        if(!isSignedType(rightType) && right.longLongVal < 0) return PRIM_INVALID_SHIFT;
+    } else{
+        type = promotePrimitiveTypes(leftType, rightType);
+        left = convertPrimitive(leftType, left, type);
+        right = convertPrimitive(rightType, right, type);
+    }
+
+    PrimitiveBinaryHandler handler = primitiveBinaryHandlers[type][op];
+    if(!handler) return PRIM_UNSUPPORTED;
+
+    *resultType = isComparisonOp(op) ? TYPE_BOOL : type;
+    return handler(left, right, out);
+}
+
+PrimitiveStatus evalUnaryPrimitive(UnaryOpType op, PrimitiveType type, PrimitiveValue value, PrimitiveType *resultType, PrimitiveValue *out){
+    PrimitiveUnaryHandler handler = primitiveUnaryHandlers[type][op];
+    if(!handler) return PRIM_UNSUPPORTED;
+
+    *resultType = op == NOT_UNOP ? TYPE_BOOL : type;
+    return handler(value, out);
+}
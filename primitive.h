@@ -0,0 +1,49 @@
+#ifndef PRIMITIVE_H
+#define PRIMITIVE_H
+
+#include "ast.h"
+#include <stddef.h>
+
+#define PRIMITIVE_TYPE_COUNT (TYPE_UNSIGNED_ARCH + 1)
+#define UNARY_OP_COUNT (SIZE_OF_UNOP + 1)
+#define BINARY_OP_COUNT (COMMA_BINOP + 1)
+
+typedef enum {
+    PRIM_OK,
+    PRIM_OVERFLOW,              // signed overflow, the wrapped result is still written
+    PRIM_DIV_BY_ZERO,
+    PRIM_INVALID_SHIFT,         // negative count or count >= width of the type
+    PRIM_UNSUPPORTED
+} PrimitiveStatus;
+
+// Both operands are already converted to the handler's type, except for
+// shifts where the right operand is the shift count in longLongVal.
+typedef PrimitiveStatus (*PrimitiveBinaryHandler)(PrimitiveValue a, PrimitiveValue b, PrimitiveValue *out);
+typedef PrimitiveStatus (*PrimitiveUnaryHandler)(PrimitiveValue a, PrimitiveValue *out);
+
+extern const PrimitiveBinaryHandler primitiveBinaryHandlers[PRIMITIVE_TYPE_COUNT][BINARY_OP_COUNT];
+extern const PrimitiveUnaryHandler primitiveUnaryHandlers[PRIMITIVE_TYPE_COUNT][UNARY_OP_COUNT];
+
+bool isIntegerType(PrimitiveType type);
+bool isSignedType(PrimitiveType type);
+bool isFloatingType(PrimitiveType type);
+bool isComparisonOp(BinaryOpType op);
+size_t primitiveSize(PrimitiveType type);
+const char *primitiveTypeName(PrimitiveType type);
+
+PrimitiveType promotePrimitiveTypes(PrimitiveType a, PrimitiveType b);
+PrimitiveType binaryResultType(BinaryOpType op, PrimitiveType leftType, PrimitiveType rightType);
+PrimitiveValue convertPrimitive(PrimitiveType from, PrimitiveValue value, PrimitiveType to);
+PrimitiveValue primitiveFromLongLong(PrimitiveType type, long long n);
+bool primitiveToLongLong(PrimitiveType type, PrimitiveValue value, long long *out);
+bool primitiveIsTruthy(PrimitiveType type, PrimitiveValue value);
+bool primitiveEquals(PrimitiveType type, PrimitiveValue value, long long n);
+bool primitiveAllOnes(PrimitiveType type, PrimitiveValue value);
+int primitivePowerOfTwo(PrimitiveType type, PrimitiveValue value);
+
+PrimitiveStatus evalBinaryPrimitive(BinaryOpType op, PrimitiveType leftType, PrimitiveValue left, PrimitiveType rightType, PrimitiveValue right, PrimitiveType *resultType, PrimitiveValue *out);
+PrimitiveStatus evalUnaryPrimitive(UnaryOpType op, PrimitiveType type, PrimitiveValue value, PrimitiveType *resultType, PrimitiveValue *out);
+
+bool typeNodeToPrimitive(ASTNode *typeNode, PrimitiveType *out);
+
+#endif
@@ -0,0 +1,291 @@
+#include "purity.h"
+#include "memo.h"
+#include "primitive.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    ASTNode **functions;
+    int functionCount;
+    NameSet constants;          // const globals and enum values
+} PurityAnalysis;
+
+typedef struct {
+    PurityAnalysis *analysis;
+    ASTNode *function;
+    TypeScope scope;
+    int paramEnd;               // scope entries below this are parameters
+    bool impure;
+} EffectScan;
+
+const char *purityName(Purity purity){
+    switch(purity){
+        case PURITY_UNKNOWN: return "unknown";
+        case PURITY_IMPURE: return "impure";
+        case PURITY_PURE: return "pure";
+        case PURITY_MEMOIZABLE: return "memoizable";
+    }
+    return "?";
+}
+
+static ASTNode *findFunction(PurityAnalysis *analysis, const char *name){
+    for(int i = 0; i < analysis->functionCount; i++){
+        if(strcmp(analysis->functions[i]->functionDef.name, name) == 0) return analysis->functions[i];
+    }
+    return NULL;
+}
+
+// index of the innermost declaration of name, -1 for non-locals
+static int findLocal(EffectScan *scan, const char *name){
+    for(int i = scan->scope.count - 1; i >= 0; i--){
+        if(strcmp(scan->scope.symbols[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+// Memory reached through a pointer is only known to belong to this call
+// when the pointer is a local declared in the body. Parameters may point
+// into the caller.
+static bool isOwnedAddress(EffectScan *scan, ASTNode *node){
+    while(node){
+        switch(node->type){
+            case IDENTIFIER_NODE:
+                return findLocal(scan, node->identifier.name) >= scan->paramEnd;
+            case CAST_EXPR_NODE:
+                node = node->castExpr.value;
+                break;
+            case BINARY_OPERATION_NODE:
+                if(node->binaryOp.op != ADD_BINOP && node->binaryOp.op != SUB_BINOP) return false;
+                node = node->binaryOp.left;
+                break;
+            default:
+                return false;
+        }
+    }
+    return false;
+}
+
+static bool isLocalTarget(EffectScan *scan, ASTNode *target){
+    switch(target->type){
+        case IDENTIFIER_NODE:
+            return findLocal(scan, target->identifier.name) >= 0;
+        case ARRAY_ACCESS_NODE:
+            return isOwnedAddress(scan, target->arrayAccess.array);
+        case FIELD_ACCESS_NODE:
+            if(target->fieldAccess.isPointerAccess) return isOwnedAddress(scan, target->fieldAccess.object);
+            return isLocalTarget(scan, target->fieldAccess.object);
+        case UNARY_OPERATION_NODE:
+            return target->unaryOp.op == DEFERENCE_UNOP && isOwnedAddress(scan, target->unaryOp.expr);
+        default:
+            return false;
+    }
+}
+
+static void scanEffects(ASTNode **slot, void *ctx){
+    EffectScan *scan = ctx;
+    ASTNode *node = *slot;
+    if(!node || scan->impure) return;
+
+    switch(node->type){
+        case IDENTIFIER_NODE: {
+            const char *name = node->identifier.name;
+            // reading a mutable global makes the result depend on more than the arguments
+            if(findLocal(scan, name) < 0 && !hasName(&scan->analysis->constants, name) && !findFunction(scan->analysis, name)) scan->impure = true;
+            return;
+        }
+        case ASSIGNMENT_NODE:
+            if(!isLocalTarget(scan, node->assignment.left)) scan->impure = true;
+            break;
+        case UNARY_OPERATION_NODE:
+            switch(node->unaryOp.op){
+                case PRE_INCREMENT_UNOP:
+                case POST_INCREMENT_UNOP:
+                case PRE_DECREMENT_UNOP:
+                case POST_DECREMENT_UNOP:
+                    if(!isLocalTarget(scan, node->unaryOp.expr)) scan->impure = true;
+                    break;
+                case DEFERENCE_UNOP:
+                    if(!isOwnedAddress(scan, node->unaryOp.expr)) scan->impure = true;
+                    break;
+                case SIZE_OF_UNOP:
+                    return;
+                default:
+                    break;
+            }
+            break;
+        case ARRAY_ACCESS_NODE:
+            if(!isOwnedAddress(scan, node->arrayAccess.array)) scan->impure = true;
+            break;
+        case FIELD_ACCESS_NODE:
+            if(node->fieldAccess.isPointerAccess && !isOwnedAddress(scan, node->fieldAccess.object)) scan->impure = true;
+            break;
+        case FUNCTION_CALL_NODE: {
+            ASTNode *callee = node->functionCall.function;
+            ASTNode *target = NULL;
+            if(callee && callee->type == IDENTIFIER_NODE && findLocal(scan, callee->identifier.name) < 0) target = findFunction(scan->analysis, callee->identifier.name);
+            if(!target || target->functionDef.purity == PURITY_IMPURE) scan->impure = true;
+            break;
+        }
+        case MALLOC_NODE:
+        case CALLOC_NODE:
+        case REALLOC_NODE:
+        case FREE_NODE:
+        case MEMCPY_NODE:
+        case MEMSET_NODE:
+        case MEMMOVE_NODE:
+        case THROW_NODE:
+        case LAMBDA_NODE:
+            scan->impure = true;
+            return;
+        case FUNCTION_NODE:
+            if(node != scan->function){
+                scan->impure = true;
+                return;
+            }
+            break;
+        case DECLARATION_NODE:
+            if(node->declaration.storageFlags & STORAGE_STATIC){
+                scan->impure = true;
+                return;
+            }
+            scanEffects(&node->declaration.initializer, scan);
+            declareSymbol(&scan->scope, node);
+            return;
+        // type operands name types, not variables
+        case CAST_EXPR_NODE:
+            scanEffects(&node->castExpr.value, scan);
+            return;
+        case ARRAY_NODE:
+            for(int i = 0; i < node->array.elementsCount; i++){
+                scanEffects(&node->array.elements[i], scan);
+            }
+            return;
+        case SIZEOF_NODE:
+        case NULL_NODE:
+            return;
+        default:
+            break;
+    }
+
+    switch(node->type){
+        case FUNCTION_NODE: {
+            int mark = enterTypeScope(&scan->scope);
+            for(int i = 0; i < node->functionDef.paramCount; i++){
+                scanEffects(&node->functionDef.params[i], scan);
+            }
+            scan->paramEnd = scan->scope.count;
+            for(int i = 0; i < node->functionDef.bodyCount; i++){
+                scanEffects(&node->functionDef.body[i], scan);
+            }
+            leaveTypeScope(&scan->scope, mark);
+            break;
+        }
+        case BLOCK_NODE:
+        case COMPOUND_EXPR_NODE:
+        case FOR_NODE:
+        case WHILE_NODE:
+        case DO_WHILE_NODE:
+        case CATCH_NODE: {
+            int mark = enterTypeScope(&scan->scope);
+            forEachChild(node, scanEffects, scan);
+            leaveTypeScope(&scan->scope, mark);
+            break;
+        }
+        default:
+            forEachChild(node, scanEffects, scan);
+            break;
+    }
+}
+
+static bool isKeyType(ASTNode *typeNode){
+    PrimitiveType type;
+    return typeNode && typeNodeToPrimitive(typeNode, &type) && type != TYPE_STRING;
+}
+
+static bool isMemoizable(ASTNode *function){
+    if(function->functionDef.paramCount > MEMO_MAX_ARGS || !isKeyType(function->functionDef.returnType)) return false;
+
+    for(int i = 0; i < function->functionDef.paramCount; i++){
+        ASTNode *param = function->functionDef.params[i];
+        if(!param || param->type != DECLARATION_NODE || !isKeyType(param->declaration.varType)) return false;
+    }
+    return true;
+}
+
+static void collectConstants(PurityAnalysis *analysis, ASTNode *node){
+    if(node->type == DECLARATION_NODE && (node->declaration.storageFlags & STORAGE_CONST)){
+        addName(&analysis->constants, node->declaration.varName);
+    } else if(node->type == ENUM_NODE){
+        for(int i = 0; i < node->enumDef.valuesCount; i++){
+            addName(&analysis->constants, node->enumDef.values[i]);
+        }
+    } else if(node->type == TYPEDEF_NODE && node->typedefDef.original){
+        collectConstants(analysis, node->typedefDef.original);
+    }
+}
+
+ASTNode *analyzePurity(ASTNode *node, PurityStats *stats){
+    *stats = (PurityStats){0};
+    if(!node) return NULL;
+
+    ASTNode **items = &node;
+    int itemCount = 1;
+    if(node->type == BLOCK_NODE){
+        items = node->block.statements;
+        itemCount = node->block.stmtCount;
+    }
+
+    PurityAnalysis analysis;
+    analysis.functions = malloc((itemCount ? itemCount : 1) * sizeof(ASTNode *));
+    analysis.functionCount = 0;
+    initNameSet(&analysis.constants);
+    if(!analysis.functions) return node;
+
+    for(int i = 0; i < itemCount; i++){
+        if(!items[i]) continue;
+        if(items[i]->type == FUNCTION_NODE){
+            items[i]->functionDef.purity = PURITY_PURE;
+            analysis.functions[analysis.functionCount++] = items[i];
+        } else{
+            collectConstants(&analysis, items[i]);
+        }
+    }
+
+    // Start from everything pure and demote until nothing changes, so that
+    // recursive and mutually recursive functions can still be pure.
+    bool changed = true;
+    while(changed){
+        changed = false;
+        for(int i = 0; i < analysis.functionCount; i++){
+            ASTNode *function = analysis.functions[i];
+            if(function->functionDef.purity == PURITY_IMPURE) continue;
+
+            EffectScan scan = { &analysis, function, {0}, 0, false };
+            initTypeScope(&scan.scope);
+            scanEffects(&analysis.functions[i], &scan);
+            freeTypeScope(&scan.scope);
+
+            if(scan.impure){
+                function->functionDef.purity = PURITY_IMPURE;
+                changed = true;
+            }
+        }
+    }
+
+    for(int i = 0; i < analysis.functionCount; i++){
+        ASTNode *function = analysis.functions[i];
+        stats->functionsAnalyzed++;
+        if(function->functionDef.purity == PURITY_IMPURE) continue;
+
+        stats->pureFunctions++;
+        if(isMemoizable(function)){
+            function->functionDef.purity = PURITY_MEMOIZABLE;
+            stats->memoizableFunctions++;
+        }
+    }
+
+    free(analysis.functions);
+    freeNameSet(&analysis.constants);
+    return node;
+}
@@ -0,0 +1,16 @@
+#ifndef PURITY_H
+#define PURITY_H
+
+#include "ast.h"
+
+typedef struct {
+    int functionsAnalyzed;
+    int pureFunctions;
+    int memoizableFunctions;
+} PurityStats;
+
+ASTNode *analyzePurity(ASTNode *node, PurityStats *stats);
+
+const char *purityName(Purity purity);
+
+#endif
@@ -0,0 +1,585 @@
+#include "range.h"
+#include "primitive.h"
+#include "utils.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    long long lo;
+    long long hi;
+} Range;
+
+typedef struct {
+    const char *name;
+    long long length;           // elements of a declared array, -1 otherwise
+    ASTNode *elementType;
+    bool hasRange;              // an induction variable inside its loop body
+    Range range;
+} Binding;
+
+typedef struct {
+    RangeStats *stats;
+    TypeScope scope;
+    Binding *bindings;
+    int bindingCount;
+    int bindingCapacity;
+    int functionFloor;          // first binding of the innermost function
+    NameSet unstable;           // address taken, or written by a nested function
+    bool failed;
+} RangePass;
+
+static bool isIntegerLiteral(ASTNode *node, long long *value){
+    return node && node->type == LITERAL_NODE && primitiveToLongLong(node->literal.type, node->literal.value, value);
+}
+
+static bool isVariable(ASTNode *node, const char *name){
+    return node && node->type == IDENTIFIER_NODE && strcmp(node->identifier.name, name) == 0;
+}
+
+static bool representable(PrimitiveType type, long long n){
+    long long back;
+    return primitiveToLongLong(type, primitiveFromLongLong(type, n), &back) && back == n;
+}
+
+static bool fits(PrimitiveType type, Range r){
+    if(!isIntegerType(type) || (!isSignedType(type) && r.lo < 0)) return false;
+    return representable(type, r.lo) && representable(type, r.hi);
+}
+
+// Bindings
+
+static bool pushBinding(RangePass *p, const char *name, long long length, ASTNode *elementType){
+    if(p->bindingCount == p->bindingCapacity){
+        int capacity = p->bindingCapacity ? p->bindingCapacity * 2 : 16;
+        Binding *bindings = realloc(p->bindings, capacity * sizeof(Binding));
+        if(!bindings){
+            p->failed = true;
+            return false;
+        }
+        p->bindings = bindings;
+        p->bindingCapacity = capacity;
+    }
+
+    Binding *binding = &p->bindings[p->bindingCount++];
+    binding->name = name;
+    binding->length = length;
+    binding->elementType = elementType;
+    binding->hasRange = false;
+    return true;
+}
+
+static int findBinding(RangePass *p, const char *name){
+    for(int i = p->bindingCount - 1; i >= 0; i--){
+        if(strcmp(p->bindings[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+typedef struct {
+    int bindings;
+    int types;
+} ScopeMark;
+
+static ScopeMark enterScope(RangePass *p){
+    return (ScopeMark){ p->bindingCount, enterTypeScope(&p->scope) };
+}
+
+static void leaveScope(RangePass *p, ScopeMark mark){
+    leaveTypeScope(&p->scope, mark.types);
+    p->bindingCount = mark.bindings;
+}
+
+static long long arrayTypeLength(ASTNode *type){
+    long long length;
+    if(!type || type->type != ARRAY_NODE || !isIntegerLiteral(type->array.size, &length) || length <= 0) return -1;
+    return length;
+}
+
+static void declare(RangePass *p, ASTNode *declaration, bool isParam){
+    ASTNode *type = declaration->declaration.varType;
+    long long length = -1;
+    ASTNode *elementType = NULL;
+
+    // parameters of array type are pointers to the caller's array
+    if(!isParam && type && type->type == ARRAY_NODE){
+        length = arrayTypeLength(type);
+        ASTNode *init = declaration->declaration.initializer;
+        if(length < 0 && !type->array.size && init && init->type == ARRAY_NODE && init->array.elementsCount > 0) length = init->array.elementsCount;
+        elementType = type->array.typeOfElement;
+    }
+    pushBinding(p, declaration->declaration.varName, length, elementType);
+    declareSymbol(&p->scope, declaration);
+}
+
+// Ranges of integer expressions
+
+static bool rangeOf(RangePass *p, ASTNode *expr, Range *out);
+
+static bool operandRanges(RangePass *p, ASTNode *expr, PrimitiveType *type, Range *left, Range *right){
+    if(!inferExpressionType(expr, &p->scope, type)) return false;
+    if(!rangeOf(p, expr->binaryOp.left, left) || !rangeOf(p, expr->binaryOp.right, right)) return false;
+
+    // operands converted to the result type must keep their values
+    return fits(*type, *left) && fits(*type, *right);
+}
+
+static bool binaryRange(RangePass *p, ASTNode *expr, Range *out){
+    PrimitiveType type;
+    Range a, b, r;
+    if(!operandRanges(p, expr, &type, &a, &b)) return false;
+
+    switch(expr->binaryOp.op){
+        case ADD_BINOP:
+            if(__builtin_add_overflow(a.lo, b.lo, &r.lo) || __builtin_add_overflow(a.hi, b.hi, &r.hi)) return false;
+            break;
+        case SUB_BINOP:
+            if(__builtin_sub_overflow(a.lo, b.hi, &r.lo) || __builtin_sub_overflow(a.hi, b.lo, &r.hi)) return false;
+            break;
+        case MUL_BINOP: {
+            long long products[4];
+            if(__builtin_mul_overflow(a.lo, b.lo, &products[0]) || __builtin_mul_overflow(a.lo, b.hi, &products[1]) ||
+               __builtin_mul_overflow(a.hi, b.lo, &products[2]) || __builtin_mul_overflow(a.hi, b.hi, &products[3])) return false;
+            r.lo = r.hi = products[0];
+            for(int i = 1; i < 4; i++){
+                if(products[i] < r.lo) r.lo = products[i];
+                if(products[i] > r.hi) r.hi = products[i];
+            }
+            break;
+        }
+        case DIV_BINOP:
+            // truncating division by a positive constant is monotonic
+            if(b.lo != b.hi || b.lo <= 0) return false;
+            r.lo = a.lo / b.lo;
+            r.hi = a.hi / b.lo;
+            break;
+        case MOD_BINOP:
+            if(b.lo != b.hi || b.lo <= 0) return false;
+            r.lo = a.lo < 0 ? (a.lo > -(b.lo - 1) ? a.lo : -(b.lo - 1)) : 0;
+            r.hi = a.hi > 0 ? (a.hi < b.lo - 1 ? a.hi : b.lo - 1) : 0;
+            break;
+        case BIT_AND_BINOP:
+            // masking with a non-negative value can only clear bits
+            if(a.lo >= 0 && (b.lo < 0 || a.hi <= b.hi)){
+                r = (Range){ 0, a.hi };
+            } else if(b.lo >= 0){
+                r = (Range){ 0, b.hi };
+            } else{
+                return false;
+            }
+            break;
+        case SHIFT_RIGHT_BINOP:
+            if(a.lo < 0 || b.lo < 0 || b.hi >= (long long)(primitiveSize(type) * 8)) return false;
+            r.lo = a.lo >> b.hi;
+            r.hi = a.hi >> b.lo;
+            break;
+        default:
+            return false;
+    }
+
+    if(!fits(type, r)) return false;
+    *out = r;
+    return true;
+}
+
+static bool rangeOf(RangePass *p, ASTNode *expr, Range *out){
+    if(!expr) return false;
+
+    long long n;
+    switch(expr->type){
+        case LITERAL_NODE:
+            if(!isIntegerType(expr->literal.type) || !isIntegerLiteral(expr, &n)) return false;
+            if(!isSignedType(expr->literal.type) && n < 0) return false;
+            *out = (Range){ n, n };
+            return true;
+        case IDENTIFIER_NODE: {
+            int index = findBinding(p, expr->identifier.name);
+            if(index < 0 || !p->bindings[index].hasRange) return false;
+            *out = p->bindings[index].range;
+            return true;
+        }
+        case CAST_EXPR_NODE: {
+            PrimitiveType type;
+            if(!typeNodeToPrimitive(expr->castExpr.targetType, &type) || !rangeOf(p, expr->castExpr.value, out)) return false;
+            return fits(type, *out);
+        }
+        case UNARY_OPERATION_NODE: {
+            PrimitiveType type;
+            if(expr->unaryOp.op != POSITIVE_UNOP && expr->unaryOp.op != NEGATIVE_UNOP) return false;
+            if(!inferExpressionType(expr, &p->scope, &type) || !rangeOf(p, expr->unaryOp.expr, out) || !fits(type, *out)) return false;
+            if(expr->unaryOp.op == NEGATIVE_UNOP){
+                if(out->lo == LLONG_MIN) return false;
+                *out = (Range){ -out->hi, -out->lo };
+            }
+            return fits(type, *out);
+        }
+        case BINARY_OPERATION_NODE:
+            return binaryRange(p, expr, out);
+        default:
+            return false;
+    }
+}
+
+// Arrays
+
+static long long lengthOf(RangePass *p, ASTNode *array, ASTNode **elementType){
+    *elementType = NULL;
+    if(!array) return -1;
+
+    switch(array->type){
+        case IDENTIFIER_NODE: {
+            int index = findBinding(p, array->identifier.name);
+            if(index < 0) return -1;
+            *elementType = p->bindings[index].elementType;
+            return p->bindings[index].length;
+        }
+        case ARRAY_ACCESS_NODE: {
+            // rows of a multi-dimensional array
+            ASTNode *rowType;
+            if(lengthOf(p, array->arrayAccess.array, &rowType) < 0 || !rowType || rowType->type != ARRAY_NODE) return -1;
+            *elementType = rowType->array.typeOfElement;
+            return arrayTypeLength(rowType);
+        }
+        case ARRAY_NODE:
+            return array->array.elementsCount > 0 ? array->array.elementsCount : -1;
+        default:
+            return -1;
+    }
+}
+
+static void checkAccess(RangePass *p, ASTNode *access){
+    p->stats->accessesAnalyzed++;
+
+    ASTNode *elementType;
+    long long length = lengthOf(p, access->arrayAccess.array, &elementType);
+    Range index;
+    if(length < 0 || !rangeOf(p, access->arrayAccess.index, &index)) return;
+
+    if(index.lo >= 0 && index.hi < length){
+        access->arrayAccess.inBounds = true;
+        p->stats->accessesProven++;
+    }
+}
+
+// Loops
+
+typedef struct {
+    NameSet written;
+    bool hasLabels;
+} LoopEffects;
+
+static void collectEffects(ASTNode **slot, void *ctx){
+    LoopEffects *effects = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    ASTNode *target = NULL;
+    switch(node->type){
+        case ASSIGNMENT_NODE:
+            target = node->assignment.left;
+            break;
+        case UNARY_OPERATION_NODE:
+            if(node->unaryOp.op >= PRE_INCREMENT_UNOP && node->unaryOp.op <= POST_DECREMENT_UNOP) target = node->unaryOp.expr;
+            break;
+        case LABEL_NODE:
+            effects->hasLabels = true;
+            break;
+        default:
+            break;
+    }
+    if(target && target->type == IDENTIFIER_NODE) addName(&effects->written, target->identifier.name);
+    forEachChild(node, collectEffects, ctx);
+}
+
+static bool readStep(ASTNode *increment, const char *name, long long *step){
+    if(!increment) return false;
+
+    if(increment->type == UNARY_OPERATION_NODE && isVariable(increment->unaryOp.expr, name)){
+        switch(increment->unaryOp.op){
+            case PRE_INCREMENT_UNOP:
+            case POST_INCREMENT_UNOP:
+                *step = 1;
+                return true;
+            case PRE_DECREMENT_UNOP:
+            case POST_DECREMENT_UNOP:
+                *step = -1;
+                return true;
+            default:
+                return false;
+        }
+    }
+    if(increment->type != ASSIGNMENT_NODE || !isVariable(increment->assignment.left, name)) return false;
+
+    ASTNode *right = increment->assignment.right;
+    long long n;
+    switch(increment->assignment.op){
+        case ADD_AND_ASSIGN:
+        case SUB_AND_ASSIGN:
+            if(!isIntegerLiteral(right, &n) || n == LLONG_MIN) return false;
+            *step = increment->assignment.op == ADD_AND_ASSIGN ? n : -n;
+            return true;
+        case SIMPLE_ASSIGN:
+            if(right->type != BINARY_OPERATION_NODE || !isVariable(right->binaryOp.left, name) || !isIntegerLiteral(right->binaryOp.right, &n)) return false;
+            if(right->binaryOp.op == ADD_BINOP){
+                *step = n;
+                return true;
+            }
+            if(right->binaryOp.op == SUB_BINOP && n != LLONG_MIN){
+                *step = -n;
+                return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+static BinaryOpType swapComparison(BinaryOpType op){
+    switch(op){
+        case LESS_BINOP: return GREATER_BINOP;
+        case LESS_EQU_BINOP: return GREATER_EQU_BINOP;
+        case GREATER_BINOP: return LESS_BINOP;
+        case GREATER_EQU_BINOP: return LESS_EQU_BINOP;
+        default: return op;
+    }
+}
+
+// The values the induction variable of a for loop takes inside the body.
+// It starts in start, moves by step and is only used while the condition
+// holds, so one side is bounded by the start and the other by the test.
+static bool bodyRange(RangePass *p, ASTNode *loop, const char *name, PrimitiveType type, Range start, Range *out){
+    long long step;
+    if(!readStep(loop->forStmt.increment, name, &step)) return false;
+
+    ASTNode *condition = loop->forStmt.condition;
+    if(!condition || condition->type != BINARY_OPERATION_NODE) return false;
+
+    BinaryOpType op = condition->binaryOp.op;
+    ASTNode *boundNode;
+    if(isVariable(condition->binaryOp.left, name)){
+        boundNode = condition->binaryOp.right;
+    } else if(isVariable(condition->binaryOp.right, name)){
+        boundNode = condition->binaryOp.left;
+        op = swapComparison(op);
+    } else{
+        return false;
+    }
+
+    Range bound;
+    PrimitiveType boundType;
+    if(!rangeOf(p, boundNode, &bound) || !inferExpressionType(boundNode, &p->scope, &boundType)) return false;
+    if(isSignedType(promotePrimitiveTypes(type, boundType)) != isSignedType(type)) return false;
+
+    Range r;
+    if(step > 0){
+        r.lo = start.lo;
+        if(op == LESS_BINOP || (op == NOT_EQU_BINOP && step == 1 && start.hi <= bound.lo)){
+            if(bound.hi == LLONG_MIN) return false;
+            r.hi = bound.hi - 1;
+        } else if(op == LESS_EQU_BINOP){
+            r.hi = bound.hi;
+        } else{
+            return false;
+        }
+    } else{
+        r.hi = start.hi;
+        if(op == GREATER_BINOP || (op == NOT_EQU_BINOP && step == -1 && start.lo >= bound.hi)){
+            if(bound.lo == LLONG_MAX) return false;
+            r.lo = bound.lo + 1;
+        } else if(op == GREATER_EQU_BINOP){
+            r.lo = bound.lo;
+        } else{
+            return false;
+        }
+    }
+
+    // the step out of the range must not wrap around
+    long long next;
+    if(__builtin_add_overflow(step > 0 ? r.hi : r.lo, step, &next) || !representable(type, next)) return false;
+    if(r.lo > r.hi || !fits(type, r)) return false;
+
+    *out = r;
+    return true;
+}
+
+static void walk(ASTNode **slot, void *ctx);
+
+static void walkFor(RangePass *p, ASTNode *loop){
+    ScopeMark mark = enterScope(p);
+    ASTNode *init = loop->forStmt.initializer;
+    const char *name = NULL;
+    PrimitiveType type;
+    Range start;
+    bool known = false;
+
+    if(init && init->type == DECLARATION_NODE){
+        walk(&init->declaration.initializer, p);
+        name = init->declaration.varName;
+        known = typeNodeToPrimitive(init->declaration.varType, &type) && rangeOf(p, init->declaration.initializer, &start);
+        declare(p, init, false);
+    } else if(init && init->type == ASSIGNMENT_NODE && init->assignment.op == SIMPLE_ASSIGN && init->assignment.left->type == IDENTIFIER_NODE){
+        walk(&init->assignment.right, p);
+        name = init->assignment.left->identifier.name;
+        // only a local of this function: globals can change in any call made by the body
+        known = findBinding(p, name) >= p->functionFloor && lookupSymbolType(&p->scope, name, &type) && rangeOf(p, init->assignment.right, &start);
+    } else{
+        walk(&loop->forStmt.initializer, p);
+    }
+
+    known = known && isIntegerType(type) && fits(type, start) && !hasName(&p->unstable, name);
+    if(known){
+        // the increment is checked to be the only write by bodyRange
+        LoopEffects effects;
+        initNameSet(&effects.written);
+        effects.hasLabels = false;
+        collectEffects(&loop->forStmt.condition, &effects);
+        for(int i = 0; i < loop->forStmt.bodyCount; i++){
+            collectEffects(&loop->forStmt.body[i], &effects);
+        }
+        known = !effects.hasLabels && !hasName(&effects.written, name);
+        freeNameSet(&effects.written);
+    }
+
+    walk(&loop->forStmt.condition, p);
+    walk(&loop->forStmt.increment, p);
+
+    Range range;
+    ScopeMark bodyMark = enterScope(p);
+    if(known && bodyRange(p, loop, name, type, start, &range) && pushBinding(p, name, -1, NULL)){
+        p->bindings[p->bindingCount - 1].hasRange = true;
+        p->bindings[p->bindingCount - 1].range = range;
+    }
+    for(int i = 0; i < loop->forStmt.bodyCount; i++){
+        walk(&loop->forStmt.body[i], p);
+    }
+    leaveScope(p, bodyMark);
+    leaveScope(p, mark);
+}
+
+// Nested functions see the variables of the enclosing one at the time of
+// the call, not where they are defined.
+static void collectUnstable(ASTNode **slot, void *ctx){
+    NameSet *unstable = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    if(node->type == UNARY_OPERATION_NODE && node->unaryOp.op == ADDRESS_OF_UNOP && node->unaryOp.expr && node->unaryOp.expr->type == IDENTIFIER_NODE){
+        addName(unstable, node->unaryOp.expr->identifier.name);
+    } else if(node->type == FUNCTION_NODE || node->type == LAMBDA_NODE){
+        LoopEffects effects;
+        initNameSet(&effects.written);
+        effects.hasLabels = false;
+        forEachChild(node, collectEffects, &effects);
+        for(int i = 0; i < effects.written.count; i++){
+            addName(unstable, effects.written.names[i]);
+        }
+        freeNameSet(&effects.written);
+    }
+    forEachChild(node, collectUnstable, ctx);
+}
+
+static void walkFunction(RangePass *p, ASTNode **params, int paramCount, ASTNode **body, int bodyCount){
+    NameSet outer = p->unstable;
+    int outerFloor = p->functionFloor;
+
+    initNameSet(&p->unstable);
+    for(int i = 0; i < bodyCount; i++){
+        collectUnstable(&body[i], &p->unstable);
+    }
+
+    ScopeMark mark = enterScope(p);
+    // induction variables of the enclosing function are not ranges here
+    for(int i = 0; i < p->bindingCount; i++){
+        if(p->bindings[i].hasRange) pushBinding(p, p->bindings[i].name, -1, NULL);
+    }
+    p->functionFloor = p->bindingCount;
+    for(int i = 0; i < paramCount; i++){
+        if(params[i] && params[i]->type == DECLARATION_NODE) declare(p, params[i], true);
+    }
+    for(int i = 0; i < bodyCount; i++){
+        walk(&body[i], p);
+    }
+    leaveScope(p, mark);
+
+    freeNameSet(&p->unstable);
+    p->unstable = outer;
+    p->functionFloor = outerFloor;
+}
+
+static void walk(ASTNode **slot, void *ctx){
+    RangePass *p = ctx;
+    ASTNode *node = *slot;
+    if(!node || p->failed) return;
+
+    switch(node->type){
+        case DECLARATION_NODE:
+            walk(&node->declaration.initializer, p);
+            declare(p, node, false);
+            break;
+        case ARRAY_ACCESS_NODE:
+            walk(&node->arrayAccess.array, p);
+            walk(&node->arrayAccess.index, p);
+            checkAccess(p, node);
+            break;
+        case FOR_NODE:
+            walkFor(p, node);
+            break;
+        case FUNCTION_NODE:
+            walkFunction(p, node->functionDef.params, node->functionDef.paramCount, node->functionDef.body, node->functionDef.bodyCount);
+            break;
+        case LAMBDA_NODE:
+            walkFunction(p, node->lambda.params, node->lambda.paramCount, node->lambda.body, node->lambda.bodyCount);
+            break;
+        case TRY_NODE: {
+            ScopeMark mark = enterScope(p);
+            for(int i = 0; i < node->tryStmt.tryBlockCount; i++){
+                walk(&node->tryStmt.tryBlock[i], p);
+            }
+            leaveScope(p, mark);
+            for(int i = 0; i < node->tryStmt.catchCount; i++){
+                walk(&node->tryStmt.catchBlock[i], p);
+            }
+            break;
+        }
+        case IF_NODE: {
+            walk(&node->ifStmt.condition, p);
+            ScopeMark mark = enterScope(p);
+            walk(&node->ifStmt.thenBranch, p);
+            leaveScope(p, mark);
+            walk(&node->ifStmt.elseBranch, p);
+            leaveScope(p, mark);
+            break;
+        }
+        default: {
+            // declarations in a statement list stay visible to the statements after them
+            ScopeMark mark = enterScope(p);
+            forEachChild(node, walk, p);
+            leaveScope(p, mark);
+            break;
+        }
+    }
+}
+
+ASTNode *eliminateBoundsChecks(ASTNode *node, RangeStats *stats){
+    RangePass p;
+    memset(&p, 0, sizeof(p));
+    p.stats = stats;
+    p.functionFloor = INT_MAX;
+    initTypeScope(&p.scope);
+    initNameSet(&p.unstable);
+    *stats = (RangeStats){0};
+
+    // top-level declarations are globals, visible to every function
+    if(node && node->type == BLOCK_NODE){
+        for(int i = 0; i < node->block.stmtCount; i++){
+            walk(&node->block.statements[i], &p);
+        }
+    } else{
+        walk(&node, &p);
+    }
+
+    free(p.bindings);
+    freeNameSet(&p.unstable);
+    freeTypeScope(&p.scope);
+    return node;
+}
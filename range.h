@@ -0,0 +1,13 @@
+#ifndef RANGE_H
+#define RANGE_H
+
+#include "ast.h"
+
+typedef struct {
+    int accessesAnalyzed;
+    int accessesProven;
+} RangeStats;
+
+ASTNode *eliminateBoundsChecks(ASTNode *node, RangeStats *stats);
+
+#endif
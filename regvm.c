@@ -0,0 +1,1774 @@
+#include "regvm.h"
+#include "atomics.h"
+#include "jit.h"
+#include "pool.h"
+#include "primitive.h"
+#include "utils.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__)
+#define REGVM_COMPUTED_GOTO 1
+#endif
+
+#define MAX_REGISTER_OPERAND 0xFFFF
+
+typedef struct {
+    const char *name;
+    RegisterFormat format;
+} RegisterOpcodeInfo;
+
+#define REGISTER_OP_INFO(name, format) {#name, format},
+static const RegisterOpcodeInfo registerOpcodeInfo[ROP_COUNT] = {
+    REGISTER_OPS(REGISTER_OP_INFO)
+};
+#undef REGISTER_OP_INFO
+
+const char *registerOpcodeName(RegisterOpcode op){
+    return op < ROP_COUNT ? registerOpcodeInfo[op].name : "?";
+}
+
+RegisterFormat registerOpcodeFormat(RegisterOpcode op){
+    return registerOpcodeInfo[op].format;
+}
+
+static bool fail(char *error, size_t errorSize, const char *format, ...){
+    if(error && errorSize > 0){
+        va_list args;
+        va_start(args, format);
+        vsnprintf(error, errorSize, format, args);
+        va_end(args);
+    }
+    return false;
+}
+
+static uint32_t readU32(const uint8_t *p){
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t readU16(const uint8_t *p){
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+// Translation from stack bytecode
+
+typedef enum {
+    OPERAND_NONE,
+    OPERAND_NUMBER,         // a slot, count or index rather than a register
+    OPERAND_LOCAL,
+    OPERAND_CONSTANT,
+    OPERAND_STACK,          // the fixed register of a stack position
+    OPERAND_TEMP            // a temporary waiting for linear scan
+} OperandKind;
+
+typedef struct {
+    OperandKind kind;
+    int index;
+} Operand;
+
+typedef struct {
+    RegisterOpcode op;
+    int aux;
+    Operand a;
+    Operand b;
+    Operand c;
+    int target;             // bytecode offset jumped to, -1 for none
+} DraftInstruction;
+
+typedef struct {
+    const BytecodeModule *module;
+    const BytecodeFunction *source;
+    RegisterFunction *fn;
+    DraftInstruction *code;
+    int codeSize;
+    int codeCapacity;
+    // what each stack position holds; loads of locals and constants stay
+    // pending here until an instruction reads them in place
+    Operand *stack;
+    int depth;
+    int *constantRegisters;     // module constant -> function constant, -1 when unused
+    int constantCapacity;
+    int printCapacity;
+    int tempCount;              // numbered in the order of their definitions
+    int *instructionAt;         // bytecode offset -> first instruction translated from it
+    // Once an allocation fails translation carries on into scratch and the
+    // function fails at the end, so the translators need no error checks.
+    bool outOfMemory;
+    DraftInstruction scratch;
+} Translator;
+
+static const Operand noOperand = {OPERAND_NONE, 0};
+
+static Operand operand(OperandKind kind, int index){
+    Operand o;
+    o.kind = kind;
+    o.index = index;
+    return o;
+}
+
+static bool sameOperand(Operand a, Operand b){
+    return a.kind == b.kind && a.index == b.index;
+}
+
+static DraftInstruction *emit(Translator *t, RegisterOpcode op, Operand a, Operand b, Operand c){
+    DraftInstruction *ins = &t->scratch;
+    if(GROW(t->code, t->codeSize, t->codeCapacity)) ins = &t->code[t->codeSize++];
+    else t->outOfMemory = true;
+    ins->op = op;
+    ins->aux = 0;
+    ins->a = a;
+    ins->b = b;
+    ins->c = c;
+    ins->target = -1;
+    return ins;
+}
+
+static Operand newTemp(Translator *t){
+    return operand(OPERAND_TEMP, t->tempCount++);
+}
+
+static void push(Translator *t, Operand o){
+    t->stack[t->depth++] = o;
+}
+
+static Operand pop(Translator *t){
+    return t->stack[--t->depth];
+}
+
+static bool onStack(Translator *t, Operand o){
+    for(int i = 0; i < t->depth; i++){
+        if(sameOperand(t->stack[i], o)) return true;
+    }
+    return false;
+}
+
+static Operand constantOperand(Translator *t, int index){
+    if(t->constantRegisters[index] < 0){
+        RegisterFunction *fn = t->fn;
+        if(fn->constantCount == t->constantCapacity){
+            int capacity = t->constantCapacity ? t->constantCapacity * 2 : 8;
+            VMValue *constants = realloc(fn->constants, capacity * sizeof(VMValue));
+            if(constants) fn->constants = constants;
+            PrimitiveType *types = realloc(fn->constantTypes, capacity * sizeof(PrimitiveType));
+            if(types) fn->constantTypes = types;
+            if(!constants || !types){
+                t->outOfMemory = true;
+                return operand(OPERAND_CONSTANT, 0);
+            }
+            t->constantCapacity = capacity;
+        }
+        fn->constants[fn->constantCount] = t->module->constants[index].value;
+        fn->constantTypes[fn->constantCount] = t->module->constants[index].type;
+        t->constantRegisters[index] = fn->constantCount++;
+    }
+    return operand(OPERAND_CONSTANT, t->constantRegisters[index]);
+}
+
+// Copies every pending read of an operand into one temporary before it is overwritten.
+static void capture(Translator *t, Operand o){
+    Operand temp = noOperand;
+    for(int i = 0; i < t->depth; i++){
+        if(!sameOperand(t->stack[i], o)) continue;
+        if(temp.kind == OPERAND_NONE){
+            temp = newTemp(t);
+            emit(t, ROP_MOVE, temp, o, noOperand);
+        }
+        t->stack[i] = temp;
+    }
+}
+
+static void captureLocals(Translator *t, int slot, int count){
+    for(int i = 0; i < t->depth; i++){
+        Operand o = t->stack[i];
+        if(o.kind == OPERAND_LOCAL && o.index >= slot && o.index < slot + count) capture(t, o);
+    }
+}
+
+static bool writesA(RegisterOpcode op){
+    switch(registerOpcodeInfo[op].format){
+        case RFORMAT_AB:
+        case RFORMAT_ABC:
+        case RFORMAT_SHIFT:
+        case RFORMAT_CONVERT:
+        case RFORMAT_LOAD_GLOBAL:
+        case RFORMAT_LOAD_INDEXED:
+        case RFORMAT_ATOMIC:
+            return true;
+        case RFORMAT_CALL:
+            return op == ROP_CALL;
+        default:
+            return false;
+    }
+}
+
+// The value was computed by the last instruction and nothing else reads it yet.
+static bool justComputed(Translator *t, Operand value){
+    if(value.kind != OPERAND_TEMP || t->codeSize == 0 || onStack(t, value)) return false;
+    DraftInstruction *last = &t->code[t->codeSize - 1];
+    return writesA(last->op) && sameOperand(last->a, value);
+}
+
+// Moves positions [from, to) of the stack into their fixed registers.
+static void settleStack(Translator *t, int from, int to){
+    for(int i = 0; i < t->depth; i++){
+        Operand o = t->stack[i];
+        if(o.kind == OPERAND_STACK && o.index != i && o.index >= from && o.index < to) capture(t, o);
+    }
+    for(int i = to - 1; i >= from; i--){
+        Operand fixed = operand(OPERAND_STACK, i);
+        Operand value = t->stack[i];
+        if(sameOperand(value, fixed)) continue;
+        t->stack[i] = fixed;
+        if(justComputed(t, value)) t->code[t->codeSize - 1].a = fixed;
+        else emit(t, ROP_MOVE, fixed, value, noOperand);
+    }
+}
+
+static bool stackSettled(Translator *t){
+    for(int i = 0; i < t->depth; i++){
+        if(!sameOperand(t->stack[i], operand(OPERAND_STACK, i))) return false;
+    }
+    return true;
+}
+
+static void storeLocal(Translator *t, int slot, bool keep){
+    Operand value = pop(t);
+    Operand local = operand(OPERAND_LOCAL, slot);
+    if(!sameOperand(value, local)){
+        if(justComputed(t, value) && !onStack(t, local)){
+            // load, compute and store fold into one three-address instruction
+            t->code[t->codeSize - 1].a = local;
+        } else{
+            captureLocals(t, slot, 1);
+            emit(t, ROP_MOVE, local, value, noOperand);
+        }
+    }
+    if(keep) push(t, local);
+}
+
+static int aluOp(Opcode op){
+    switch(op){
+#define ALU_CASE(name, format) case OP_##name: return ROP_##name;
+        REGISTER_ALU_OPS(ALU_CASE)
+#undef ALU_CASE
+        default:
+            return -1;
+    }
+}
+
+static bool isCompare(RegisterOpcode op){
+    return op >= ROP_EQ_I && op <= ROP_GE_F;
+}
+
+// Integer comparisons invert exactly; an unordered float comparison is false
+// both ways, so only equality inverts there.
+static int invertedCompare(RegisterOpcode op){
+    switch(op){
+        case ROP_EQ_I: return ROP_NE_I;
+        case ROP_NE_I: return ROP_EQ_I;
+        case ROP_LT_I: return ROP_GE_I;
+        case ROP_LE_I: return ROP_GT_I;
+        case ROP_GT_I: return ROP_LE_I;
+        case ROP_GE_I: return ROP_LT_I;
+        case ROP_LT_U: return ROP_GE_U;
+        case ROP_LE_U: return ROP_GT_U;
+        case ROP_GT_U: return ROP_LE_U;
+        case ROP_GE_U: return ROP_LT_U;
+        case ROP_EQ_F: return ROP_NE_F;
+        case ROP_NE_F: return ROP_EQ_F;
+        default: return -1;
+    }
+}
+
+static void translateBranch(Translator *t, Opcode op, int target){
+    Operand cond = pop(t);
+    bool whenTrue = op == OP_JUMP_IF_TRUE;
+    if(stackSettled(t) && justComputed(t, cond) && isCompare(t->code[t->codeSize - 1].op)){
+        DraftInstruction *last = &t->code[t->codeSize - 1];
+        int compare = whenTrue ? (int)last->op : invertedCompare(last->op);
+        if(compare >= 0){
+            // the branch forms follow the comparisons in the same order
+            last->op = ROP_BR_EQ_I + (compare - ROP_EQ_I);
+            last->a = last->b;
+            last->b = last->c;
+            last->c = noOperand;
+            last->target = target;
+            return;
+        }
+    }
+    if(cond.kind == OPERAND_STACK && cond.index < t->depth){
+        Operand temp = newTemp(t);
+        emit(t, ROP_MOVE, temp, cond, noOperand);
+        cond = temp;
+    }
+    // A condition left on the stack by DUP may have its definition moved
+    // into a fixed register, which then holds it for the branch.
+    int last = t->codeSize - 1;
+    bool defined = cond.kind == OPERAND_TEMP && last >= 0 && writesA(t->code[last].op) && sameOperand(t->code[last].a, cond);
+    settleStack(t, 0, t->depth);
+    if(defined) cond = t->code[last].a;
+    emit(t, whenTrue ? ROP_JUMP_IF_TRUE : ROP_JUMP_IF_FALSE, cond, noOperand, noOperand)->target = target;
+}
+
+static void translateCall(Translator *t, Opcode op, int index){
+    const BytecodeFunction *callee = &t->module->functions[index];
+    int first = t->depth - callee->paramCount;
+    settleStack(t, first, t->depth);
+    Operand args = callee->paramCount > 0 ? operand(OPERAND_STACK, first) : operand(OPERAND_NUMBER, 0);
+    t->depth = first;
+    if(op == OP_CALL && !callee->returnsVoid){
+        Operand result = newTemp(t);
+        emit(t, ROP_CALL, result, operand(OPERAND_NUMBER, index), args);
+        push(t, result);
+    } else{
+        emit(t, op == OP_CALL ? ROP_CALL : ROP_TAILCALL, operand(OPERAND_NUMBER, 0), operand(OPERAND_NUMBER, index), args);
+    }
+}
+
+static void translatePrint(Translator *t, const uint8_t *code){
+    RegisterFunction *fn = t->fn;
+    int count = code[1];
+    int first = t->depth - count;
+    settleStack(t, first, t->depth);
+    int offset = fn->printTypesSize;
+    for(int i = 0; i < count; i++){
+        if(!GROW(fn->printTypes, fn->printTypesSize, t->printCapacity)){
+            t->outOfMemory = true;
+            break;
+        }
+        fn->printTypes[fn->printTypesSize++] = code[2 + i];
+    }
+    t->depth = first;
+    emit(t, ROP_PRINT, count > 0 ? operand(OPERAND_STACK, first) : operand(OPERAND_NUMBER, 0), operand(OPERAND_NUMBER, count), operand(OPERAND_NUMBER, offset));
+}
+
+static void translateInstruction(Translator *t, int offset){
+    const uint8_t *code = t->source->code + offset;
+    Opcode op = code[0];
+    int a = opcodeOperands(op) == OPERANDS_U16 || opcodeOperands(op) == OPERANDS_U16_U16 ? readU16(code + 1) : 0;
+    int next = offset + instructionLength(t->source->code, offset);
+
+    switch(op){
+        case OP_CONST:
+            push(t, constantOperand(t, a));
+            return;
+        case OP_LOAD:
+            push(t, operand(OPERAND_LOCAL, a));
+            return;
+        case OP_STORE:
+        case OP_STORE_POP:
+            storeLocal(t, a, op == OP_STORE);
+            return;
+        case OP_LOAD_GLOBAL:
+        case OP_ATOMIC_LOAD: {
+            Operand result = newTemp(t);
+            emit(t, op == OP_LOAD_GLOBAL ? ROP_LOAD_GLOBAL : ROP_ATOMIC_LOAD, result, operand(OPERAND_NUMBER, a), noOperand);
+            push(t, result);
+            return;
+        }
+        case OP_STORE_GLOBAL:
+        case OP_STORE_GLOBAL_POP:
+        case OP_ATOMIC_STORE:
+            emit(t, op == OP_ATOMIC_STORE ? ROP_ATOMIC_STORE : ROP_STORE_GLOBAL, operand(OPERAND_NUMBER, a), t->stack[t->depth - 1], noOperand);
+            if(op == OP_STORE_GLOBAL_POP) t->depth--;
+            return;
+        case OP_LOAD_INDEXED:
+        case OP_LOAD_GLOBAL_INDEXED:
+        case OP_ATOMIC_LOAD_INDEXED: {
+            Operand index = pop(t);
+            Operand result = newTemp(t);
+            RegisterOpcode load = op == OP_LOAD_INDEXED ? ROP_LOAD_INDEXED : op == OP_LOAD_GLOBAL_INDEXED ? ROP_LOAD_GLOBAL_INDEXED : ROP_ATOMIC_LOAD_INDEXED;
+            emit(t, load, result, operand(OPERAND_NUMBER, a), index);
+            push(t, result);
+            return;
+        }
+        case OP_STORE_INDEXED:
+        case OP_STORE_INDEXED_POP:
+        case OP_STORE_GLOBAL_INDEXED:
+        case OP_STORE_GLOBAL_INDEXED_POP:
+        case OP_ATOMIC_STORE_INDEXED: {
+            // array elements are only ever read through indexed loads, so no
+            // pending read of a local can alias the element written
+            Operand value = pop(t);
+            Operand index = pop(t);
+            RegisterOpcode store = ROP_ATOMIC_STORE_INDEXED;
+            if(op == OP_STORE_INDEXED || op == OP_STORE_INDEXED_POP) store = ROP_STORE_INDEXED;
+            else if(op == OP_STORE_GLOBAL_INDEXED || op == OP_STORE_GLOBAL_INDEXED_POP) store = ROP_STORE_GLOBAL_INDEXED;
+            emit(t, store, operand(OPERAND_NUMBER, a), index, value);
+            if(op == OP_STORE_INDEXED || op == OP_STORE_GLOBAL_INDEXED || op == OP_ATOMIC_STORE_INDEXED) push(t, value);
+            return;
+        }
+        case OP_ATOMIC_UPDATE: {
+            Operand value = pop(t);
+            Operand result = newTemp(t);
+            emit(t, ROP_ATOMIC_UPDATE, result, operand(OPERAND_NUMBER, a), value)->aux = (uint8_t)readU16(code + 3);
+            push(t, result);
+            return;
+        }
+        case OP_ATOMIC_UPDATE_INDEXED: {
+            // the operand goes in through the register the result comes out of
+            Operand value = pop(t);
+            Operand index = pop(t);
+            Operand result = newTemp(t);
+            emit(t, ROP_MOVE, result, value, noOperand);
+            emit(t, ROP_ATOMIC_UPDATE_INDEXED, result, operand(OPERAND_NUMBER, a), index)->aux = (uint8_t)readU16(code + 3);
+            push(t, result);
+            return;
+        }
+        case OP_CHECK_INDEX: {
+            uint32_t length = readU32(code + 1);
+            emit(t, ROP_CHECK_INDEX, t->stack[t->depth - 1], operand(OPERAND_NUMBER, length & 0xFFFF), operand(OPERAND_NUMBER, length >> 16));
+            return;
+        }
+        case OP_CLEAR: {
+            int count = readU16(code + 3);
+            captureLocals(t, a, count);
+            emit(t, ROP_CLEAR, operand(OPERAND_NUMBER, a), operand(OPERAND_NUMBER, count), noOperand);
+            return;
+        }
+        case OP_POP:
+            t->depth--;
+            return;
+        case OP_DUP:
+            push(t, t->stack[t->depth - 1]);
+            return;
+        case OP_SWAP: {
+            Operand top = t->stack[t->depth - 1];
+            t->stack[t->depth - 1] = t->stack[t->depth - 2];
+            t->stack[t->depth - 2] = top;
+            return;
+        }
+        case OP_JUMP:
+            settleStack(t, 0, t->depth);
+            emit(t, ROP_JUMP, noOperand, noOperand, noOperand)->target = next + (int32_t)readU32(code + 1);
+            return;
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE:
+            translateBranch(t, op, next + (int32_t)readU32(code + 1));
+            return;
+        case OP_CALL:
+        case OP_TAILCALL:
+            translateCall(t, op, a);
+            return;
+        case OP_RETURN:
+            emit(t, ROP_RETURN, pop(t), noOperand, noOperand);
+            return;
+        case OP_RETURN_VOID:
+            emit(t, ROP_RETURN_VOID, noOperand, noOperand, noOperand);
+            return;
+        case OP_THROW:
+            emit(t, ROP_THROW, pop(t), noOperand, noOperand)->aux = code[1];
+            return;
+        case OP_PARALLEL_FOR: {
+            // the chunks read the locals straight from their registers,
+            // which always hold them at a statement boundary
+            Operand end = pop(t);
+            Operand start = pop(t);
+            emit(t, ROP_PARALLEL_FOR, start, operand(OPERAND_NUMBER, a), end);
+            return;
+        }
+        case OP_PRINT:
+            translatePrint(t, code);
+            return;
+        default:
+            break;
+    }
+
+    RegisterOpcode alu = aluOp(op);
+    RegisterFormat format = registerOpcodeInfo[alu].format;
+    Operand right = format == RFORMAT_ABC || format == RFORMAT_SHIFT ? pop(t) : noOperand;
+    Operand left = pop(t);
+    Operand result = newTemp(t);
+    DraftInstruction *ins = emit(t, alu, result, left, right);
+    if(format == RFORMAT_SHIFT || format == RFORMAT_CONVERT) ins->aux = code[1];
+    push(t, result);
+}
+
+static bool isConstantOne(Translator *t, Operand o){
+    return o.kind == OPERAND_CONSTANT && t->fn->constants[o.index].i == 1;
+}
+
+// i = i + 1 followed by a loop test on i becomes one instruction. The test
+// stays behind it since the loop entry jumps straight to it.
+static void fuseLoopIncrements(Translator *t){
+    for(int i = 0; i + 1 < t->codeSize; i++){
+        DraftInstruction *step = &t->code[i];
+        DraftInstruction *test = &t->code[i + 1];
+        if(step->op != ROP_ADD_I32 || step->a.kind != OPERAND_LOCAL || !sameOperand(step->a, step->b) || !isConstantOne(t, step->c)) continue;
+        if((test->op != ROP_BR_LT_I && test->op != ROP_BR_LE_I) || !sameOperand(test->a, step->a)) continue;
+        step->op = test->op == ROP_BR_LT_I ? ROP_INC_BR_LT_I32 : ROP_INC_BR_LE_I32;
+        step->b = test->b;
+        step->c = noOperand;
+        step->target = test->target;
+    }
+}
+
+// The stack is settled into its fixed registers at every jump and join, so
+// a temporary is written and then read within one straight run of code.
+// Its interval from first to last mention is then exact, and a register
+// freed by the last read of one can take the next definition. -1 when out
+// of memory.
+static int allocateTemps(Translator *t, int *physical){
+    int count = t->tempCount > 0 ? t->tempCount : 1;
+    int *start = malloc(count * sizeof(int));
+    int *end = malloc(count * sizeof(int));
+    int *activeEnd = malloc(count * sizeof(int));
+    int *activeRegister = malloc(count * sizeof(int));
+    int *freeRegisters = malloc(count * sizeof(int));
+    int used = 0;
+    if(!start || !end || !activeEnd || !activeRegister || !freeRegisters) used = -1;
+
+    for(int i = 0; used == 0 && i < t->tempCount; i++){
+        start[i] = -1;
+        end[i] = -1;
+    }
+    for(int i = 0; used == 0 && i < t->codeSize; i++){
+        Operand operands[3] = {t->code[i].a, t->code[i].b, t->code[i].c};
+        for(int k = 0; k < 3; k++){
+            if(operands[k].kind != OPERAND_TEMP) continue;
+            int temp = operands[k].index;
+            if(start[temp] < 0) start[temp] = i;
+            end[temp] = i;
+        }
+    }
+
+    int activeCount = 0;
+    int freeCount = 0;
+    for(int temp = 0; used >= 0 && temp < t->tempCount; temp++){
+        physical[temp] = 0;
+        if(start[temp] < 0) continue;
+        for(int i = 0; i < activeCount; ){
+            if(activeEnd[i] <= start[temp]){
+                freeRegisters[freeCount++] = activeRegister[i];
+                activeCount--;
+                activeEnd[i] = activeEnd[activeCount];
+                activeRegister[i] = activeRegister[activeCount];
+            } else{
+                i++;
+            }
+        }
+        physical[temp] = freeCount > 0 ? freeRegisters[--freeCount] : used++;
+        activeEnd[activeCount] = end[temp];
+        activeRegister[activeCount++] = physical[temp];
+    }
+
+    free(start);
+    free(end);
+    free(activeEnd);
+    free(activeRegister);
+    free(freeRegisters);
+    return used;
+}
+
+static bool finishFunction(Translator *t, char *error, size_t errorSize){
+    RegisterFunction *fn = t->fn;
+    fuseLoopIncrements(t);
+
+    int *physical = malloc((t->tempCount > 0 ? t->tempCount : 1) * sizeof(int));
+    int temps = physical ? allocateTemps(t, physical) : -1;
+    if(temps < 0){
+        free(physical);
+        return fail(error, errorSize, "out of memory translating %s", fn->name);
+    }
+    int stackBase = fn->constantBase + fn->constantCount;
+    int tempBase = stackBase + t->source->maxStack;
+    fn->frameSize = tempBase + temps;
+    if(fn->frameSize > MAX_REGISTER_OPERAND + 1 || t->codeSize > MAX_REGISTER_OPERAND || fn->printTypesSize > MAX_REGISTER_OPERAND){
+        free(physical);
+        return fail(error, errorSize, "%s is too large for the register VM", fn->name);
+    }
+
+    fn->code = malloc((t->codeSize > 0 ? t->codeSize : 1) * sizeof(RegisterInstruction));
+    if(!fn->code){
+        free(physical);
+        return fail(error, errorSize, "out of memory translating %s", fn->name);
+    }
+    fn->codeSize = t->codeSize;
+    for(int i = 0; i < t->codeSize; i++){
+        DraftInstruction *draft = &t->code[i];
+        Operand operands[3] = {draft->a, draft->b, draft->c};
+        uint16_t encoded[3];
+        for(int k = 0; k < 3; k++){
+            Operand o = operands[k];
+            switch(o.kind){
+                case OPERAND_NONE: encoded[k] = 0; break;
+                case OPERAND_NUMBER:
+                case OPERAND_LOCAL: encoded[k] = o.index; break;
+                case OPERAND_CONSTANT: encoded[k] = fn->constantBase + o.index; break;
+                case OPERAND_STACK: encoded[k] = stackBase + o.index; break;
+                case OPERAND_TEMP: encoded[k] = tempBase + physical[o.index]; break;
+            }
+        }
+        if(draft->target >= 0) encoded[2] = t->instructionAt[draft->target];
+        fn->code[i] = (RegisterInstruction){draft->op, draft->aux, encoded[0], encoded[1], encoded[2]};
+    }
+    free(physical);
+    return true;
+}
+
+static bool translateFunction(const BytecodeModule *module, int index, RegisterFunction *fn, char *error, size_t errorSize){
+    const BytecodeFunction *source = &module->functions[index];
+    fn->name = strdup(source->name);
+    fn->paramCount = source->paramCount;
+    fn->returnType = source->returnType;
+    fn->returnsVoid = source->returnsVoid;
+    fn->localCount = source->localCount;
+    fn->constantBase = source->localCount;
+    if(!fn->name) return fail(error, errorSize, "out of memory translating %s", source->name);
+
+    Translator t;
+    memset(&t, 0, sizeof(t));
+    t.module = module;
+    t.source = source;
+    t.fn = fn;
+    int codeSize = source->codeSize > 0 ? source->codeSize : 1;
+    int *depths = malloc(codeSize * sizeof(int));
+    bool *targets = calloc(codeSize, sizeof(bool));
+    t.instructionAt = malloc(codeSize * sizeof(int));
+    t.stack = malloc((source->maxStack > 0 ? source->maxStack : 1) * sizeof(Operand));
+    t.constantRegisters = malloc((module->constantCount > 0 ? module->constantCount : 1) * sizeof(int));
+    bool ok = depths && targets && t.instructionAt && t.stack && t.constantRegisters;
+    if(!ok) fail(error, errorSize, "out of memory translating %s", fn->name);
+    for(int i = 0; ok && i < module->constantCount; i++){
+        t.constantRegisters[i] = -1;
+    }
+
+    ok = ok && bytecodeStackDepths(module, source, depths, error, errorSize);
+    for(int offset = 0; ok && offset < source->codeSize; offset += instructionLength(source->code, offset)){
+        if(opcodeOperands(source->code[offset]) != OPERANDS_JUMP) continue;
+        targets[offset + 5 + (int32_t)readU32(source->code + offset + 1)] = true;
+    }
+    for(int i = 0; ok && i < source->handlerCount; i++){
+        targets[source->handlers[i].target] = true;
+    }
+
+    // Every stack position sits in its fixed register where control flow
+    // meets; in between, values stay wherever they were computed.
+    bool fallsThrough = false;
+    for(int offset = 0; ok && offset < source->codeSize; offset += instructionLength(source->code, offset)){
+        Opcode op = source->code[offset];
+        if(depths[offset] < 0){
+            t.instructionAt[offset] = t.codeSize;
+            fallsThrough = false;
+            continue;
+        }
+        if(targets[offset] || !fallsThrough){
+            if(fallsThrough) settleStack(&t, 0, t.depth);
+            t.depth = depths[offset];
+            for(int i = 0; i < t.depth; i++){
+                t.stack[i] = operand(OPERAND_STACK, i);
+            }
+        }
+        t.instructionAt[offset] = t.codeSize;
+        translateInstruction(&t, offset);
+        fallsThrough = op != OP_JUMP && op != OP_RETURN && op != OP_RETURN_VOID && op != OP_TAILCALL && op != OP_THROW;
+    }
+    if(ok && t.outOfMemory) ok = fail(error, errorSize, "out of memory translating %s", fn->name);
+    if(ok) ok = finishFunction(&t, error, errorSize);
+
+    // instructions never move once translated, so each range maps across whole
+    if(ok && source->handlerCount > 0){
+        fn->handlers = malloc(source->handlerCount * sizeof(RegisterHandler));
+        if(!fn->handlers) ok = fail(error, errorSize, "out of memory translating %s", fn->name);
+        else fn->handlerCount = source->handlerCount;
+        for(int i = 0; i < fn->handlerCount; i++){
+            const BytecodeHandler *h = &source->handlers[i];
+            int start = h->start < source->codeSize ? t.instructionAt[h->start] : t.codeSize;
+            int end = h->end < source->codeSize ? t.instructionAt[h->end] : t.codeSize;
+            fn->handlers[i] = (RegisterHandler){start, end, t.instructionAt[h->target], h->type};
+        }
+    }
+
+    free(depths);
+    free(targets);
+    free(t.instructionAt);
+    free(t.stack);
+    free(t.constantRegisters);
+    free(t.code);
+    return ok;
+}
+
+RegisterModule *compileRegisterModule(const BytecodeModule *source, char *error, size_t errorSize){
+    RegisterModule *module = calloc(1, sizeof(RegisterModule));
+    if(module) module->functions = calloc(source->functionCount > 0 ? source->functionCount : 1, sizeof(RegisterFunction));
+    if(!module || !module->functions){
+        free(module);
+        fail(error, errorSize, "out of memory translating to registers");
+        return NULL;
+    }
+    module->source = source;
+    module->functionCount = source->functionCount;
+    if(source->functionCount < 1){
+        freeRegisterModule(module);
+        fail(error, errorSize, "missing top-level function");
+        return NULL;
+    }
+    for(int i = 0; i < source->functionCount; i++){
+        if(!translateFunction(source, i, &module->functions[i], error, errorSize)){
+            freeRegisterModule(module);
+            return NULL;
+        }
+    }
+    return module;
+}
+
+void freeRegisterModule(RegisterModule *module){
+    if(!module) return;
+    for(int i = 0; i < module->functionCount; i++){
+        RegisterFunction *fn = &module->functions[i];
+        free(fn->name);
+        free(fn->constants);
+        free(fn->constantTypes);
+        free(fn->code);
+        free(fn->printTypes);
+        free(fn->handlers);
+    }
+    free(module->functions);
+    free(module);
+}
+
+// Listing
+
+static Value toValue(PrimitiveType type, VMValue v){
+    return makePrimitiveValue(type, vmValueToPrimitive(type, v));
+}
+
+void dumpRegisterFunction(const RegisterModule *module, const RegisterFunction *fn, FILE *out){
+    const BytecodeFunction *source = &module->source->functions[fn - module->functions];
+    fprintf(out, "fun %s(", fn->name);
+    for(int i = 0; i < fn->paramCount; i++){
+        fprintf(out, "%s%s", i > 0 ? ", " : "", primitiveTypeName(source->paramTypes[i]));
+    }
+    fprintf(out, ") -> %s    ; %d locals, %d registers\n", fn->returnsVoid ? "void" : primitiveTypeName(fn->returnType), fn->localCount, fn->frameSize);
+    for(int i = 0; i < fn->constantCount; i++){
+        Value value = toValue(fn->constantTypes[i], fn->constants[i]);
+        fprintf(out, "        r%d = ", fn->constantBase + i);
+        printValue(&value, out);
+        fprintf(out, "\n");
+    }
+
+    for(int i = 0; i < fn->codeSize; i++){
+        const RegisterInstruction *ins = &fn->code[i];
+        fprintf(out, "%6d  %s", i, registerOpcodeName(ins->op));
+        switch(registerOpcodeInfo[ins->op].format){
+            case RFORMAT_NONE:
+                break;
+            case RFORMAT_A:
+                fprintf(out, " r%d", ins->a);
+                break;
+            case RFORMAT_THROW:
+                fprintf(out, " r%d    ; %s", ins->a, primitiveTypeName(ins->aux));
+                break;
+            case RFORMAT_AB:
+                fprintf(out, " r%d r%d", ins->a, ins->b);
+                break;
+            case RFORMAT_ABC:
+                fprintf(out, " r%d r%d r%d", ins->a, ins->b, ins->c);
+                break;
+            case RFORMAT_SHIFT:
+                fprintf(out, " r%d r%d r%d    ; width %d", ins->a, ins->b, ins->c, ins->aux);
+                break;
+            case RFORMAT_CONVERT:
+                fprintf(out, " r%d r%d    ; %s", ins->a, ins->b, primitiveTypeName(ins->aux));
+                break;
+            case RFORMAT_LOAD_GLOBAL:
+                fprintf(out, " r%d @%d", ins->a, ins->b);
+                break;
+            case RFORMAT_STORE_GLOBAL:
+                fprintf(out, " @%d r%d", ins->a, ins->b);
+                break;
+            case RFORMAT_LOAD_INDEXED:
+                fprintf(out, " r%d %s%d[r%d]", ins->a, ins->op == ROP_LOAD_INDEXED ? "r" : "@", ins->b, ins->c);
+                break;
+            case RFORMAT_STORE_INDEXED:
+                fprintf(out, " %s%d[r%d] r%d", ins->op == ROP_STORE_INDEXED ? "r" : "@", ins->a, ins->b, ins->c);
+                break;
+            case RFORMAT_ATOMIC:
+                fprintf(out, " r%d @%d r%d    ; %s %s", ins->a, ins->b, ins->c, atomicOpName(ATOMIC_OPERATION_OP(ins->aux)), atomicKindName(ATOMIC_OPERATION_KIND(ins->aux)));
+                break;
+            case RFORMAT_ATOMIC_INDEXED:
+                fprintf(out, " r%d @%d[r%d]    ; %s %s", ins->a, ins->b, ins->c, atomicOpName(ATOMIC_OPERATION_OP(ins->aux)), atomicKindName(ATOMIC_OPERATION_KIND(ins->aux)));
+                break;
+            case RFORMAT_CHECK:
+                fprintf(out, " r%d %u", ins->a, ins->b | (uint32_t)ins->c << 16);
+                break;
+            case RFORMAT_CLEAR:
+                fprintf(out, " r%d %d", ins->a, ins->b);
+                break;
+            case RFORMAT_JUMP:
+                fprintf(out, " -> %d", ins->c);
+                break;
+            case RFORMAT_BRANCH_IF:
+                fprintf(out, " r%d -> %d", ins->a, ins->c);
+                break;
+            case RFORMAT_BRANCH:
+                fprintf(out, " r%d r%d -> %d", ins->a, ins->b, ins->c);
+                break;
+            case RFORMAT_PARALLEL:
+                fprintf(out, " %s r%d r%d", module->functions[ins->b].name, ins->a, ins->c);
+                break;
+            case RFORMAT_CALL:
+                if(ins->op == ROP_CALL && !module->functions[ins->b].returnsVoid) fprintf(out, " r%d =", ins->a);
+                fprintf(out, " %s r%d", module->functions[ins->b].name, ins->c);
+                break;
+            case RFORMAT_PRINT:
+                fprintf(out, " r%d %d", ins->a, ins->b);
+                for(int k = 0; k < ins->b; k++){
+                    fprintf(out, " %s", primitiveTypeName(fn->printTypes[ins->c + k]));
+                }
+                break;
+        }
+        fprintf(out, "\n");
+    }
+    for(int i = 0; i < fn->handlerCount; i++){
+        const RegisterHandler *h = &fn->handlers[i];
+        fprintf(out, "        catch %s [%d, %d) -> %d\n", h->type < 0 ? "any" : primitiveTypeName(h->type), h->start, h->end, h->target);
+    }
+}
+
+void dumpRegisterModule(const RegisterModule *module, FILE *out){
+    for(int i = 0; i < module->functionCount; i++){
+        if(i > 0) fprintf(out, "\n");
+        dumpRegisterFunction(module, &module->functions[i], out);
+    }
+}
+
+// Interpreter
+
+typedef struct {
+    const RegisterFunction *function;
+    const RegisterInstruction *pc;      // the call the caller resumes after
+    VMValue *base;
+} RegFrame;
+
+struct RegVM {
+    const RegisterModule *module;
+    VMOptions options;
+    VMValue *registers;
+    RegFrame *frames;
+    VMValue *globals;
+    VMStats stats;
+    long long *pairCounts;              // ROP_COUNT * ROP_COUNT while profiling
+    const JitModule *jit;
+    JitModule *tierJit;                 // set while tiering, compiles hot functions
+    TierOptions tiers;
+    int *callCounts;                    // per function, negative once promoted or rejected
+    int *loopCounts;                    // per instruction at loop headers, laid out by codeBase
+    int *codeBase;
+    WorkPool *pool;                     // started by the first parallel loop
+    struct RegVM **workers;             // one per pool worker, each running chunks on its own registers
+    int workerCount;
+    bool isWorker;                      // shares the globals and compiled code of the VM that started it
+    char error[256];
+};
+
+RegVM *createRegVM(const RegisterModule *module, const VMOptions *options){
+    RegVM *vm = calloc(1, sizeof(RegVM));
+    if(!vm) return NULL;
+
+    vm->module = module;
+    vm->options = options ? *options : defaultVMOptions();
+    if(!vm->options.out) vm->options.out = stdout;
+    vm->registers = calloc(vm->options.stackSlots > 0 ? vm->options.stackSlots : 1, sizeof(VMValue));
+    vm->frames = calloc(vm->options.maxCallDepth > 0 ? vm->options.maxCallDepth : 1, sizeof(RegFrame));
+    vm->globals = calloc(module->source->globalSlots > 0 ? module->source->globalSlots : 1, sizeof(VMValue));
+    if(!vm->registers || !vm->frames || !vm->globals){
+        freeRegVM(vm);
+        return NULL;
+    }
+    return vm;
+}
+
+void freeRegVM(RegVM *vm){
+    if(!vm) return;
+    freeWorkPool(vm->pool);
+    for(int i = 0; i < vm->workerCount; i++) freeRegVM(vm->workers[i]);
+    free(vm->workers);
+    free(vm->registers);
+    free(vm->frames);
+    if(!vm->isWorker) free(vm->globals);
+    free(vm->pairCounts);
+    free(vm->callCounts);
+    free(vm->loopCounts);
+    free(vm->codeBase);
+    free(vm);
+}
+
+const char *regVMError(RegVM *vm){
+    return vm->error[0] ? vm->error : NULL;
+}
+
+const VMStats *regVMStats(RegVM *vm){
+    return &vm->stats;
+}
+
+static bool regVMFail(RegVM *vm, const RegisterFunction *fn, const char *format, ...){
+    va_list args;
+    va_start(args, format);
+    int length = snprintf(vm->error, sizeof(vm->error), "%s: ", fn->name);
+    if(length < 0 || length >= (int)sizeof(vm->error)) length = 0;
+    vsnprintf(vm->error + length, sizeof(vm->error) - length, format, args);
+    va_end(args);
+    return false;
+}
+
+void attachRegVMJit(RegVM *vm, const JitModule *jit){
+    vm->jit = jit;
+}
+
+// Runs compiled code for a frame whose arguments are in place; depth counts
+// the interpreted frames below it.
+static bool runNative(RegVM *vm, JitEntry native, VMValue *base, int depth, bool *returnedValue){
+    JitContext ctx = {0};
+    ctx.globals = vm->globals;
+    ctx.end = vm->registers + vm->options.stackSlots;
+    ctx.depth = depth;
+    ctx.maxDepth = vm->options.maxCallDepth;
+    ctx.out = vm->options.out;
+    int status = native(base, &ctx);
+    vm->stats.calls += ctx.calls;
+    vm->stats.tailCalls += ctx.tailCalls;
+    *returnedValue = status == JIT_RETURNED_VALUE;
+
+    const RegisterFunction *at = &vm->module->functions[ctx.errorFunction];
+    switch(status){
+        case JIT_RETURNED_VOID:
+        case JIT_RETURNED_VALUE:
+            return true;
+        case JIT_DIVISION_BY_ZERO: return regVMFail(vm, at, "division by zero");
+        case JIT_INVALID_SHIFT: return regVMFail(vm, at, "invalid shift count");
+        case JIT_INDEX_OUT_OF_BOUNDS: return regVMFail(vm, at, "index %lld out of bounds for length %u", ctx.errorIndex, (unsigned)ctx.errorLength);
+        case JIT_CALL_DEPTH: return regVMFail(vm, at, "maximum call depth of %d exceeded", vm->options.maxCallDepth);
+        case JIT_STACK_OVERFLOW: return regVMFail(vm, at, "VM stack overflow calling %s", vm->module->functions[ctx.errorCallee].name);
+        default: return regVMFail(vm, at, "machine code failed with status %d", status);
+    }
+}
+
+TierOptions defaultTierOptions(void){
+    return (TierOptions){.callThreshold = 1000, .loopThreshold = 10000, .log = NULL};
+}
+
+bool enableRegVMTiering(RegVM *vm, JitModule *jit, const TierOptions *options){
+    const RegisterModule *module = vm->module;
+    int count = module->functionCount > 0 ? module->functionCount : 1;
+    int instructions = 0;
+    free(vm->callCounts);
+    free(vm->loopCounts);
+    free(vm->codeBase);
+    vm->callCounts = calloc(count, sizeof(int));
+    vm->codeBase = calloc(count, sizeof(int));
+    for(int i = 0; i < module->functionCount; i++){
+        if(vm->codeBase) vm->codeBase[i] = instructions;
+        instructions += module->functions[i].codeSize;
+    }
+    vm->loopCounts = calloc(instructions > 0 ? instructions : 1, sizeof(int));
+    if(!vm->callCounts || !vm->codeBase || !vm->loopCounts){
+        free(vm->callCounts);
+        free(vm->loopCounts);
+        free(vm->codeBase);
+        vm->callCounts = vm->loopCounts = vm->codeBase = NULL;
+        return false;
+    }
+    vm->jit = jit;
+    vm->tierJit = jit;
+    vm->tiers = options ? *options : defaultTierOptions();
+    return true;
+}
+
+static bool promote(RegVM *vm, int function){
+    char error[128];
+    if(compileJitFunction(vm->tierJit, function, error, sizeof(error))) return true;
+    if(vm->tiers.log) fprintf(vm->tiers.log, "tier-up of %s failed: %s\n", vm->module->functions[function].name, error);
+    return false;
+}
+
+// Counts a call and compiles the callee once it is hot; the entry to run it
+// through, or NULL to keep interpreting.
+static JitEntry countCall(RegVM *vm, int function){
+    int *count = &vm->callCounts[function];
+    if(*count < 0 || ++*count < vm->tiers.callThreshold) return NULL;
+    *count = -1;
+    if(!promote(vm, function)) return NULL;
+    if(vm->tiers.log) fprintf(vm->tiers.log, "tier-up %s after %d calls\n", vm->module->functions[function].name, vm->tiers.callThreshold);
+    return jitEntry(vm->jit, function);
+}
+
+// Counts a backward jump to header; the entry to finish the frame in
+// machine code once the loop is hot, or NULL to keep interpreting.
+static JitEntry countLoop(RegVM *vm, const RegisterFunction *fn, const RegisterInstruction *header){
+    int function = (int)(fn - vm->module->functions);
+    int instruction = (int)(header - fn->code);
+    JitEntry entry = jitLoopEntry(vm->jit, function, instruction);
+    if(entry) return entry;
+
+    int *count = &vm->loopCounts[vm->codeBase[function] + instruction];
+    if(*count < 0 || ++*count < vm->tiers.loopThreshold) return NULL;
+    *count = -1;
+    if(!promote(vm, function)) return NULL;
+    if(vm->tiers.log) fprintf(vm->tiers.log, "on-stack replacement of %s at instruction %d after %d iterations\n", fn->name, instruction, vm->tiers.loopThreshold);
+    return jitLoopEntry(vm->jit, function, instruction);
+}
+
+static const RegisterHandler *findHandler(const RegisterFunction *fn, const RegisterInstruction *pc, int type){
+    int index = (int)(pc - fn->code);
+    for(int i = 0; i < fn->handlerCount; i++){
+        const RegisterHandler *h = &fn->handlers[i];
+        if(index >= h->start && index < h->end && (h->type < 0 || h->type == type)) return h;
+    }
+    return NULL;
+}
+
+static void enterFrame(const RegisterFunction *fn, VMValue *base){
+    memset(base + fn->paramCount, 0, (size_t)(fn->localCount - fn->paramCount) * sizeof(VMValue));
+    memcpy(base + fn->constantBase, fn->constants, (size_t)fn->constantCount * sizeof(VMValue));
+}
+
+#ifdef REGVM_COMPUTED_GOTO
+#define TARGET(name) TARGET_##name:
+#define DISPATCH() goto *table[pc->op]
+#else
+#define TARGET(name) case ROP_##name:
+#define DISPATCH() continue
+#endif
+// no do-while wrappers: continue has to reach the dispatch loop
+#define NEXT() { pc++; DISPATCH(); }
+// a backward jump is where a hot loop leaves for machine code
+#define JUMP_TO(index) { \
+        const RegisterInstruction *target = fn->code + (index); \
+        if(loopCounts && target <= pc && (native = countLoop(vm, fn, target)) != NULL) goto OSR; \
+        pc = target; \
+        DISPATCH(); \
+    }
+
+#define RA r[pc->a]
+#define RB r[pc->b]
+#define RC r[pc->c]
+
+#define BINARY_INT(expr) do { int64_t a = RB.i; int64_t b = RC.i; RA.i = (expr); } while(0)
+#define BINARY_UINT(expr) do { uint64_t a = RB.u; uint64_t b = RC.u; RA.u = (expr); } while(0)
+#define BINARY_FLOAT(expr) do { double a = RB.f; double b = RC.f; RA.f = (expr); } while(0)
+#define BRANCH(cond) if(cond) JUMP_TO(pc->c) NEXT()
+
+static bool runParallel(RegVM *vm, const RegisterFunction *fn, const VMValue *r, int function, int64_t start, int64_t end);
+
+// Runs a function whose arguments are already in the first registers.
+static bool execute(RegVM *vm, int index, Value *result){
+    const RegisterModule *module = vm->module;
+    const RegisterFunction *fn = &module->functions[index];
+    VMValue *globals = vm->globals;
+    VMValue *registersEnd = vm->registers + vm->options.stackSlots;
+    RegFrame *frames = vm->frames;
+    int frameCount = 0;
+    long long *pairs = vm->pairCounts;
+    int previous = -1;
+    const int *loopCounts = vm->loopCounts;
+
+    VMValue *r = vm->registers;
+    if(r + fn->frameSize > registersEnd) return regVMFail(vm, fn, "VM stack overflow");
+    JitEntry native = jitEntry(vm->jit, index);
+    if(!native && vm->callCounts) native = countCall(vm, index);
+    if(native){
+        bool returnedValue;
+        if(!runNative(vm, native, r, 0, &returnedValue)) return false;
+        if(result){
+            if(returnedValue) *result = toValue(fn->returnType, r[0]);
+            else result->kind = VALUE_VOID;
+        }
+        return true;
+    }
+    enterFrame(fn, r);
+    const RegisterInstruction *pc = fn->code;
+
+#ifdef REGVM_COMPUTED_GOTO
+#define DISPATCH_LABEL(name, format) &&TARGET_##name,
+    static void *const dispatch[ROP_COUNT] = {
+        REGISTER_OPS(DISPATCH_LABEL)
+    };
+#undef DISPATCH_LABEL
+    static void *const profiled[ROP_COUNT] = {
+        [0 ... ROP_COUNT - 1] = &&PROFILE
+    };
+    void *const *table = pairs ? profiled : dispatch;
+    DISPATCH();
+
+PROFILE:
+    if(previous >= 0) pairs[previous * ROP_COUNT + pc->op]++;
+    previous = pc->op;
+    goto *dispatch[pc->op];
+#else
+    for(;;){
+    if(pairs){
+        if(previous >= 0) pairs[previous * ROP_COUNT + pc->op]++;
+        previous = pc->op;
+    }
+    switch(pc->op){
+#endif
+
+    TARGET(MOVE){
+        RA = RB;
+        NEXT();
+    }
+    TARGET(LOAD_GLOBAL){
+        RA = globals[pc->b];
+        NEXT();
+    }
+    TARGET(STORE_GLOBAL){
+        globals[pc->a] = RB;
+        NEXT();
+    }
+    TARGET(LOAD_INDEXED){
+        RA = r[pc->b + RC.i];
+        NEXT();
+    }
+    TARGET(STORE_INDEXED){
+        r[pc->a + RB.i] = RC;
+        NEXT();
+    }
+    TARGET(LOAD_GLOBAL_INDEXED){
+        RA = globals[pc->b + RC.i];
+        NEXT();
+    }
+    TARGET(STORE_GLOBAL_INDEXED){
+        globals[pc->a + RB.i] = RC;
+        NEXT();
+    }
+    TARGET(ATOMIC_LOAD){
+        RA = atomicLoad(&globals[pc->b]);
+        NEXT();
+    }
+    TARGET(ATOMIC_STORE){
+        atomicStore(&globals[pc->a], RB);
+        NEXT();
+    }
+    TARGET(ATOMIC_LOAD_INDEXED){
+        RA = atomicLoad(&globals[pc->b + RC.i]);
+        NEXT();
+    }
+    TARGET(ATOMIC_STORE_INDEXED){
+        atomicStore(&globals[pc->a + RB.i], RC);
+        NEXT();
+    }
+    TARGET(ATOMIC_UPDATE){
+        AtomicStatus status = atomicUpdate(&globals[pc->b], pc->aux, RC, &RA);
+        if(status != ATOMIC_OK) return regVMFail(vm, fn, "%s", atomicStatusMessage(status));
+        NEXT();
+    }
+    TARGET(ATOMIC_UPDATE_INDEXED){
+        AtomicStatus status = atomicUpdate(&globals[pc->b + RC.i], pc->aux, RA, &RA);
+        if(status != ATOMIC_OK) return regVMFail(vm, fn, "%s", atomicStatusMessage(status));
+        NEXT();
+    }
+    TARGET(CHECK_INDEX){
+        uint32_t length = pc->b | (uint32_t)pc->c << 16;
+        if(RA.u >= length) return regVMFail(vm, fn, "index %lld out of bounds for length %u", (long long)RA.i, length);
+        NEXT();
+    }
+    TARGET(CLEAR){
+        memset(r + pc->a, 0, (size_t)pc->b * sizeof(VMValue));
+        NEXT();
+    }
+    TARGET(ADD_I32){
+        BINARY_INT((int32_t)(uint32_t)((uint64_t)a + (uint64_t)b));
+        NEXT();
+    }
+    TARGET(SUB_I32){
+        BINARY_INT((int32_t)(uint32_t)((uint64_t)a - (uint64_t)b));
+        NEXT();
+    }
+    TARGET(MUL_I32){
+        BINARY_INT((int32_t)(uint32_t)((uint64_t)a * (uint64_t)b));
+        NEXT();
+    }
+    TARGET(NEG_I32){
+        RA.i = (int32_t)(uint32_t)(0 - RB.u);
+        NEXT();
+    }
+    TARGET(ADD_I64){
+        BINARY_UINT(a + b);
+        NEXT();
+    }
+    TARGET(SUB_I64){
+        BINARY_UINT(a - b);
+        NEXT();
+    }
+    TARGET(MUL_I64){
+        BINARY_UINT(a * b);
+        NEXT();
+    }
+    TARGET(NEG_I64){
+        RA.u = 0 - RB.u;
+        NEXT();
+    }
+    TARGET(DIV_I){
+        if(RC.i == 0) return regVMFail(vm, fn, "division by zero");
+        // MIN / -1 wraps to MIN as the evaluator's handlers do
+        BINARY_INT(b == -1 ? (int64_t)(0 - (uint64_t)a) : a / b);
+        NEXT();
+    }
+    TARGET(MOD_I){
+        if(RC.i == 0) return regVMFail(vm, fn, "division by zero");
+        BINARY_INT(b == -1 ? 0 : a % b);
+        NEXT();
+    }
+    TARGET(DIV_U){
+        if(RC.u == 0) return regVMFail(vm, fn, "division by zero");
+        BINARY_UINT(a / b);
+        NEXT();
+    }
+    TARGET(MOD_U){
+        if(RC.u == 0) return regVMFail(vm, fn, "division by zero");
+        BINARY_UINT(a % b);
+        NEXT();
+    }
+    TARGET(ADD_F){
+        BINARY_FLOAT(a + b);
+        NEXT();
+    }
+    TARGET(SUB_F){
+        BINARY_FLOAT(a - b);
+        NEXT();
+    }
+    TARGET(MUL_F){
+        BINARY_FLOAT(a * b);
+        NEXT();
+    }
+    TARGET(DIV_F){
+        if(RC.f == 0.0) return regVMFail(vm, fn, "division by zero");
+        BINARY_FLOAT(a / b);
+        NEXT();
+    }
+    TARGET(NEG_F){
+        RA.f = -RB.f;
+        NEXT();
+    }
+    TARGET(BIT_AND){
+        BINARY_UINT(a & b);
+        NEXT();
+    }
+    TARGET(BIT_OR){
+        BINARY_UINT(a | b);
+        NEXT();
+    }
+    TARGET(BIT_XOR){
+        BINARY_UINT(a ^ b);
+        NEXT();
+    }
+    TARGET(BIT_NOT){
+        RA.u = ~RB.u;
+        NEXT();
+    }
+    TARGET(SHL){
+        if(RC.i < 0 || RC.i >= pc->aux) return regVMFail(vm, fn, "invalid shift count");
+        BINARY_UINT(a << b);
+        NEXT();
+    }
+    TARGET(SHR_I){
+        if(RC.i < 0 || RC.i >= pc->aux) return regVMFail(vm, fn, "invalid shift count");
+        BINARY_INT(a >> b);
+        NEXT();
+    }
+    TARGET(SHR_U){
+        if(RC.i < 0 || RC.i >= pc->aux) return regVMFail(vm, fn, "invalid shift count");
+        BINARY_UINT(a >> b);
+        NEXT();
+    }
+    TARGET(NOT){
+        RA.i = RB.i == 0;
+        NEXT();
+    }
+    TARGET(NOT_F){
+        RA.i = RB.f == 0.0;
+        NEXT();
+    }
+    TARGET(EQ_I){
+        RA.i = RB.i == RC.i;
+        NEXT();
+    }
+    TARGET(NE_I){
+        RA.i = RB.i != RC.i;
+        NEXT();
+    }
+    TARGET(LT_I){
+        RA.i = RB.i < RC.i;
+        NEXT();
+    }
+    TARGET(LE_I){
+        RA.i = RB.i <= RC.i;
+        NEXT();
+    }
+    TARGET(GT_I){
+        RA.i = RB.i > RC.i;
+        NEXT();
+    }
+    TARGET(GE_I){
+        RA.i = RB.i >= RC.i;
+        NEXT();
+    }
+    TARGET(LT_U){
+        RA.i = RB.u < RC.u;
+        NEXT();
+    }
+    TARGET(LE_U){
+        RA.i = RB.u <= RC.u;
+        NEXT();
+    }
+    TARGET(GT_U){
+        RA.i = RB.u > RC.u;
+        NEXT();
+    }
+    TARGET(GE_U){
+        RA.i = RB.u >= RC.u;
+        NEXT();
+    }
+    TARGET(EQ_F){
+        RA.i = RB.f == RC.f;
+        NEXT();
+    }
+    TARGET(NE_F){
+        RA.i = RB.f != RC.f;
+        NEXT();
+    }
+    TARGET(LT_F){
+        RA.i = RB.f < RC.f;
+        NEXT();
+    }
+    TARGET(LE_F){
+        RA.i = RB.f <= RC.f;
+        NEXT();
+    }
+    TARGET(GT_F){
+        RA.i = RB.f > RC.f;
+        NEXT();
+    }
+    TARGET(GE_F){
+        RA.i = RB.f >= RC.f;
+        NEXT();
+    }
+    TARGET(WRAP_I8){
+        RA.i = (int8_t)RB.u;
+        NEXT();
+    }
+    TARGET(WRAP_U8){
+        RA.u = (uint8_t)RB.u;
+        NEXT();
+    }
+    TARGET(WRAP_I16){
+        RA.i = (int16_t)RB.u;
+        NEXT();
+    }
+    TARGET(WRAP_U16){
+        RA.u = (uint16_t)RB.u;
+        NEXT();
+    }
+    TARGET(WRAP_I32){
+        RA.i = (int32_t)RB.u;
+        NEXT();
+    }
+    TARGET(WRAP_U32){
+        RA.u = (uint32_t)RB.u;
+        NEXT();
+    }
+    TARGET(TO_BOOL){
+        RA.i = RB.i != 0;
+        NEXT();
+    }
+    TARGET(TO_BOOL_F){
+        RA.i = RB.f != 0.0;
+        NEXT();
+    }
+    TARGET(I2F){
+        RA.f = (double)RB.i;
+        NEXT();
+    }
+    TARGET(U2F){
+        RA.f = (double)RB.u;
+        NEXT();
+    }
+    TARGET(F2I){
+        PrimitiveValue value;
+        value.doubleVal = RB.f;
+        RA = primitiveToVMValue(pc->aux, convertPrimitive(TYPE_DOUBLE, value, pc->aux));
+        NEXT();
+    }
+    TARGET(FROUND){
+        RA.f = (float)RB.f;
+        NEXT();
+    }
+    TARGET(JUMP){
+        JUMP_TO(pc->c);
+    }
+    TARGET(JUMP_IF_FALSE){
+        BRANCH(RA.i == 0);
+    }
+    TARGET(JUMP_IF_TRUE){
+        BRANCH(RA.i != 0);
+    }
+    TARGET(BR_EQ_I){
+        BRANCH(RA.i == RB.i);
+    }
+    TARGET(BR_NE_I){
+        BRANCH(RA.i != RB.i);
+    }
+    TARGET(BR_LT_I){
+        BRANCH(RA.i < RB.i);
+    }
+    TARGET(BR_LE_I){
+        BRANCH(RA.i <= RB.i);
+    }
+    TARGET(BR_GT_I){
+        BRANCH(RA.i > RB.i);
+    }
+    TARGET(BR_GE_I){
+        BRANCH(RA.i >= RB.i);
+    }
+    TARGET(BR_LT_U){
+        BRANCH(RA.u < RB.u);
+    }
+    TARGET(BR_LE_U){
+        BRANCH(RA.u <= RB.u);
+    }
+    TARGET(BR_GT_U){
+        BRANCH(RA.u > RB.u);
+    }
+    TARGET(BR_GE_U){
+        BRANCH(RA.u >= RB.u);
+    }
+    TARGET(BR_EQ_F){
+        BRANCH(RA.f == RB.f);
+    }
+    TARGET(BR_NE_F){
+        BRANCH(RA.f != RB.f);
+    }
+    TARGET(BR_LT_F){
+        BRANCH(RA.f < RB.f);
+    }
+    TARGET(BR_LE_F){
+        BRANCH(RA.f <= RB.f);
+    }
+    TARGET(BR_GT_F){
+        BRANCH(RA.f > RB.f);
+    }
+    TARGET(BR_GE_F){
+        BRANCH(RA.f >= RB.f);
+    }
+    TARGET(INC_BR_LT_I32){
+        RA.i = (int32_t)(uint32_t)(RA.u + 1);
+        BRANCH(RA.i < RB.i);
+    }
+    TARGET(INC_BR_LE_I32){
+        RA.i = (int32_t)(uint32_t)(RA.u + 1);
+        BRANCH(RA.i <= RB.i);
+    }
+    TARGET(CALL){
+        const RegisterFunction *callee = &module->functions[pc->b];
+        VMValue *calleeBase = r + fn->frameSize;
+        if(frameCount == vm->options.maxCallDepth) return regVMFail(vm, fn, "maximum call depth of %d exceeded", vm->options.maxCallDepth);
+        if(calleeBase + callee->frameSize > registersEnd) return regVMFail(vm, fn, "VM stack overflow calling %s", callee->name);
+
+        vm->stats.calls++;
+        memcpy(calleeBase, r + pc->c, (size_t)callee->paramCount * sizeof(VMValue));
+        native = jitEntry(vm->jit, pc->b);
+        if(!native && vm->callCounts) native = countCall(vm, pc->b);
+        if(native){
+            bool returnedValue;
+            if(!runNative(vm, native, calleeBase, frameCount + 1, &returnedValue)) return false;
+            if(returnedValue) RA = calleeBase[0];
+            NEXT();
+        }
+        frames[frameCount++] = (RegFrame){fn, pc, r};
+        enterFrame(callee, calleeBase);
+        fn = callee;
+        r = calleeBase;
+        pc = fn->code;
+        DISPATCH();
+    }
+    TARGET(TAILCALL){
+        const RegisterFunction *callee = &module->functions[pc->b];
+        if(r + callee->frameSize > registersEnd) return regVMFail(vm, fn, "VM stack overflow calling %s", callee->name);
+
+        vm->stats.calls++;
+        vm->stats.tailCalls++;
+        memmove(r, r + pc->c, (size_t)callee->paramCount * sizeof(VMValue));
+        fn = callee;
+        native = jitEntry(vm->jit, pc->b);
+        if(!native && vm->callCounts) native = countCall(vm, pc->b);
+        if(native) goto OSR;
+        enterFrame(callee, r);
+        pc = fn->code;
+        DISPATCH();
+    }
+    TARGET(RETURN){
+        VMValue value = RA;
+        if(frameCount == 0){
+            if(result) *result = toValue(fn->returnType, value);
+            return true;
+        }
+        RegFrame *frame = &frames[--frameCount];
+        fn = frame->function;
+        pc = frame->pc;
+        r = frame->base;
+        RA = value;
+        NEXT();
+    }
+    TARGET(RETURN_VOID){
+        if(frameCount == 0){
+            if(result) result->kind = VALUE_VOID;
+            return true;
+        }
+        RegFrame *frame = &frames[--frameCount];
+        fn = frame->function;
+        pc = frame->pc;
+        r = frame->base;
+        NEXT();
+    }
+    TARGET(THROW){
+        VMValue exception = RA;
+        int type = pc->aux;
+        const RegisterFunction *thrower = fn;
+        const RegisterHandler *handler;
+        vm->stats.throws++;
+        // compiled code never calls anything that throws, so every frame
+        // left here is an interpreted one
+        while(!(handler = findHandler(fn, pc, type))){
+            if(frameCount == 0) return regVMFail(vm, thrower, "uncaught exception of type %s", primitiveTypeName(type));
+            RegFrame *frame = &frames[--frameCount];
+            fn = frame->function;
+            pc = frame->pc;
+            r = frame->base;
+            vm->stats.unwoundFrames++;
+        }
+        r[fn->constantBase + fn->constantCount] = exception;
+        pc = fn->code + handler->target;
+        DISPATCH();
+    }
+    TARGET(PARALLEL_FOR){
+        if(!runParallel(vm, fn, r, pc->b, RA.i, RC.i)) return false;
+        NEXT();
+    }
+    TARGET(PRINT){
+        const uint8_t *types = fn->printTypes + pc->c;
+        for(int i = 0; i < pc->b; i++){
+            Value value = toValue(types[i], r[pc->a + i]);
+            if(i > 0) fputc(' ', vm->options.out);
+            printValue(&value, vm->options.out);
+        }
+        fputc('\n', vm->options.out);
+        NEXT();
+    }
+
+    // native finishes the frame at r, which the caller's frame is waiting on
+    // as if the interpreter had run it
+OSR: {
+        bool returnedValue;
+        if(!runNative(vm, native, r, frameCount + 1, &returnedValue)) return false;
+        if(frameCount == 0){
+            if(result){
+                if(returnedValue) *result = toValue(fn->returnType, r[0]);
+                else result->kind = VALUE_VOID;
+            }
+            return true;
+        }
+        VMValue value = r[0];
+        RegFrame *frame = &frames[--frameCount];
+        fn = frame->function;
+        pc = frame->pc;
+        r = frame->base;
+        if(returnedValue) RA = value;
+        NEXT();
+    }
+
+#ifndef REGVM_COMPUTED_GOTO
+        default:
+            return regVMFail(vm, fn, "invalid opcode %d", pc->op);
+    }
+    }
+#endif
+}
+
+static void resetRun(RegVM *vm){
+    vm->error[0] = '\0';
+    memset(&vm->stats, 0, sizeof(vm->stats));
+}
+
+// Parallel loops
+
+// Workers run compiled code but never compile any themselves, so the JIT
+// module stays unchanged while they run.
+static RegVM *createWorker(RegVM *vm){
+    RegVM *worker = calloc(1, sizeof(RegVM));
+    if(!worker) return NULL;
+    worker->module = vm->module;
+    worker->options = vm->options;
+    worker->globals = vm->globals;
+    worker->jit = vm->jit;
+    worker->isWorker = true;
+    worker->registers = calloc(vm->options.stackSlots > 0 ? vm->options.stackSlots : 1, sizeof(VMValue));
+    worker->frames = calloc(vm->options.maxCallDepth > 0 ? vm->options.maxCallDepth : 1, sizeof(RegFrame));
+    if(!worker->registers || !worker->frames){
+        freeRegVM(worker);
+        return NULL;
+    }
+    return worker;
+}
+
+// A worker runs the loops nested in its chunks by itself, on one more VM.
+static bool startWorkers(RegVM *vm){
+    if(vm->workers) return true;
+    int count = 1;
+    if(!vm->isWorker){
+        vm->pool = createWorkPool(vm->options.threads);
+        if(!vm->pool) return false;
+        count = workPoolSize(vm->pool);
+    }
+    RegVM **workers = calloc(count, sizeof(RegVM *));
+    bool ok = workers != NULL;
+    for(int i = 0; ok && i < count; i++){
+        workers[i] = createWorker(vm);
+        ok = workers[i] != NULL;
+    }
+    if(!ok){
+        for(int i = 0; workers && i < count; i++) freeRegVM(workers[i]);
+        free(workers);
+        return false;
+    }
+    vm->workers = workers;
+    vm->workerCount = count;
+    return true;
+}
+
+typedef struct {
+    RegVM *vm;
+    int function;
+    const VMValue *shared;      // the locals of the frame running the loop
+    int sharedCount;
+} ParallelLoop;
+
+static bool runChunk(int worker, int64_t lo, int64_t hi, void *ctx){
+    ParallelLoop *loop = ctx;
+    RegVM *vm = loop->vm->workers[worker];
+    memcpy(vm->registers, loop->shared, (size_t)loop->sharedCount * sizeof(VMValue));
+    vm->registers[loop->sharedCount].i = lo;
+    vm->registers[loop->sharedCount + 1].i = hi;
+    return execute(vm, loop->function, NULL);
+}
+
+static bool runParallel(RegVM *vm, const RegisterFunction *fn, const VMValue *r, int function, int64_t start, int64_t end){
+    if(start >= end) return true;
+    if(!startWorkers(vm)) return regVMFail(vm, fn, "cannot start the workers of a parallel loop");
+    // a loop worth running in parallel is hot already
+    if(vm->callCounts && vm->callCounts[function] >= 0){
+        vm->callCounts[function] = -1;
+        if(promote(vm, function) && vm->tiers.log) fprintf(vm->tiers.log, "tier-up %s before its parallel loop\n", vm->module->functions[function].name);
+    }
+    for(int i = 0; i < vm->workerCount; i++) vm->workers[i]->jit = vm->jit;
+    ParallelLoop loop = {vm, function, r, vm->module->functions[function].paramCount - 2};
+    for(int i = 0; i < vm->workerCount; i++) resetRun(vm->workers[i]);
+
+    ParallelStats stats = {1, 0, -1};
+    bool ok;
+    if(vm->pool){
+        ok = parallelFor(vm->pool, start, end, runChunk, &loop, &stats);
+    } else{
+        ok = runChunk(0, start, end, &loop);
+        if(!ok) stats.failedWorker = 0;
+    }
+
+    for(int i = 0; i < vm->workerCount; i++){
+        const VMStats *s = &vm->workers[i]->stats;
+        vm->stats.calls += s->calls;
+        vm->stats.tailCalls += s->tailCalls;
+        vm->stats.throws += s->throws;
+        vm->stats.unwoundFrames += s->unwoundFrames;
+        vm->stats.parallelChunks += s->parallelChunks;
+        vm->stats.steals += s->steals;
+    }
+    vm->stats.parallelChunks += stats.chunks;
+    vm->stats.steals += stats.steals;
+    if(!ok) snprintf(vm->error, sizeof(vm->error), "%s", vm->workers[stats.failedWorker]->error);
+    return ok;
+}
+
+bool runRegVM(RegVM *vm, Value *result){
+    const BytecodeModule *source = vm->module->source;
+    resetRun(vm);
+    memset(vm->globals, 0, (size_t)source->globalSlots * sizeof(VMValue));
+
+    Value value;
+    if(!execute(vm, 0, &value)) return false;
+    if(value.kind == VALUE_VOID && source->mainFunction > 0 && !execute(vm, source->mainFunction, &value)) return false;
+    if(result) *result = value;
+    return true;
+}
+
+const VMValue *regVMGlobals(RegVM *vm){
+    return vm->globals;
+}
+
+void restoreRegVMGlobals(RegVM *vm, const VMValue *globals){
+    memcpy(vm->globals, globals, (size_t)vm->module->source->globalSlots * sizeof(VMValue));
+}
+
+// Globals keep the values left by the last runRegVM.
+bool callRegVM(RegVM *vm, const char *name, const Value *args, int argCount, Value *result){
+    const BytecodeModule *source = vm->module->source;
+    resetRun(vm);
+    int index = findBytecodeFunction(source, name);
+    if(index < 0){
+        snprintf(vm->error, sizeof(vm->error), "no function named '%s'", name);
+        return false;
+    }
+
+    const RegisterFunction *fn = &vm->module->functions[index];
+    if(argCount != fn->paramCount) return regVMFail(vm, fn, "expects %d arguments, got %d", fn->paramCount, argCount);
+    if(argCount > vm->options.stackSlots) return regVMFail(vm, fn, "VM stack overflow");
+    for(int i = 0; i < argCount; i++){
+        PrimitiveType type = source->functions[index].paramTypes[i];
+        if(args[i].kind != VALUE_PRIMITIVE || (args[i].type == TYPE_STRING) != (type == TYPE_STRING)){
+            return regVMFail(vm, fn, "argument %d is not convertible to %s", i + 1, primitiveTypeName(type));
+        }
+        vm->registers[i] = primitiveToVMValue(type, convertPrimitive(args[i].type, args[i].as.primitive, type));
+    }
+    return execute(vm, index, result);
+}
+
+// Profiling
+
+void enableRegVMProfile(RegVM *vm){
+    if(vm->pairCounts) return;
+    // profiling just stays off when the counts can't be allocated
+    vm->pairCounts = calloc((size_t)ROP_COUNT * ROP_COUNT, sizeof(long long));
+}
+
+typedef struct {
+    long long count;
+    int first;
+    int second;
+} InstructionPair;
+
+static int compareInstructionPairs(const void *a, const void *b){
+    long long x = ((const InstructionPair *)a)->count;
+    long long y = ((const InstructionPair *)b)->count;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+void printRegVMProfile(RegVM *vm, int limit, FILE *out){
+    if(!vm->pairCounts) return;
+    InstructionPair *pairs = malloc((size_t)ROP_COUNT * ROP_COUNT * sizeof(InstructionPair));
+    if(!pairs){
+        fprintf(out, "out of memory sorting the profile\n");
+        return;
+    }
+    int count = 0;
+    for(int first = 0; first < ROP_COUNT; first++){
+        for(int second = 0; second < ROP_COUNT; second++){
+            long long n = vm->pairCounts[first * ROP_COUNT + second];
+            if(n > 0) pairs[count++] = (InstructionPair){n, first, second};
+        }
+    }
+    qsort(pairs, count, sizeof(InstructionPair), compareInstructionPairs);
+    for(int i = 0; i < count && (limit <= 0 || i < limit); i++){
+        fprintf(out, "%14lld  %s -> %s\n", pairs[i].count, registerOpcodeName(pairs[i].first), registerOpcodeName(pairs[i].second));
+    }
+    free(pairs);
+}
@@ -0,0 +1,236 @@
+#ifndef REGVM_H
+#define REGVM_H
+
+#include "bytecode.h"
+#include "vm.h"
+
+typedef enum {
+    RFORMAT_NONE,
+    RFORMAT_A,              // a reads a register
+    RFORMAT_THROW,          // throws a, aux holds its type
+    RFORMAT_AB,             // a = op b
+    RFORMAT_ABC,            // a = b op c
+    RFORMAT_SHIFT,          // a = b op c, aux holds the width of the type
+    RFORMAT_CONVERT,        // a = op b, aux holds the target type
+    RFORMAT_LOAD_GLOBAL,    // a = global b
+    RFORMAT_STORE_GLOBAL,   // global a = b
+    RFORMAT_LOAD_INDEXED,   // a = slot b indexed by c
+    RFORMAT_STORE_INDEXED,  // slot a indexed by b = c
+    RFORMAT_ATOMIC,         // a = global b updated with c, aux holds the operation
+    RFORMAT_ATOMIC_INDEXED, // a = global b indexed by c updated with a, aux holds the operation
+    RFORMAT_CHECK,          // a must be below the length b | c << 16
+    RFORMAT_CLEAR,          // zero b slots from a
+    RFORMAT_JUMP,           // jump to instruction c
+    RFORMAT_BRANCH_IF,      // jump to c depending on a
+    RFORMAT_BRANCH,         // jump to c when a op b holds
+    RFORMAT_CALL,           // a = function b with arguments from c
+    RFORMAT_PARALLEL,       // function b over the iterations [a, c)
+    RFORMAT_PRINT           // b values from a, types at c in the print table
+} RegisterFormat;
+
+#define REGISTER_ALU_OPS(X) \
+    X(ADD_I32, RFORMAT_ABC) \
+    X(SUB_I32, RFORMAT_ABC) \
+    X(MUL_I32, RFORMAT_ABC) \
+    X(NEG_I32, RFORMAT_AB) \
+    X(ADD_I64, RFORMAT_ABC) \
+    X(SUB_I64, RFORMAT_ABC) \
+    X(MUL_I64, RFORMAT_ABC) \
+    X(NEG_I64, RFORMAT_AB) \
+    X(DIV_I, RFORMAT_ABC) \
+    X(MOD_I, RFORMAT_ABC) \
+    X(DIV_U, RFORMAT_ABC) \
+    X(MOD_U, RFORMAT_ABC) \
+    X(ADD_F, RFORMAT_ABC) \
+    X(SUB_F, RFORMAT_ABC) \
+    X(MUL_F, RFORMAT_ABC) \
+    X(DIV_F, RFORMAT_ABC) \
+    X(NEG_F, RFORMAT_AB) \
+    X(BIT_AND, RFORMAT_ABC) \
+    X(BIT_OR, RFORMAT_ABC) \
+    X(BIT_XOR, RFORMAT_ABC) \
+    X(BIT_NOT, RFORMAT_AB) \
+    X(SHL, RFORMAT_SHIFT) \
+    X(SHR_I, RFORMAT_SHIFT) \
+    X(SHR_U, RFORMAT_SHIFT) \
+    X(NOT, RFORMAT_AB) \
+    X(NOT_F, RFORMAT_AB) \
+    X(EQ_I, RFORMAT_ABC) \
+    X(NE_I, RFORMAT_ABC) \
+    X(LT_I, RFORMAT_ABC) \
+    X(LE_I, RFORMAT_ABC) \
+    X(GT_I, RFORMAT_ABC) \
+    X(GE_I, RFORMAT_ABC) \
+    X(LT_U, RFORMAT_ABC) \
+    X(LE_U, RFORMAT_ABC) \
+    X(GT_U, RFORMAT_ABC) \
+    X(GE_U, RFORMAT_ABC) \
+    X(EQ_F, RFORMAT_ABC) \
+    X(NE_F, RFORMAT_ABC) \
+    X(LT_F, RFORMAT_ABC) \
+    X(LE_F, RFORMAT_ABC) \
+    X(GT_F, RFORMAT_ABC) \
+    X(GE_F, RFORMAT_ABC) \
+    X(WRAP_I8, RFORMAT_AB) \
+    X(WRAP_U8, RFORMAT_AB) \
+    X(WRAP_I16, RFORMAT_AB) \
+    X(WRAP_U16, RFORMAT_AB) \
+    X(WRAP_I32, RFORMAT_AB) \
+    X(WRAP_U32, RFORMAT_AB) \
+    X(TO_BOOL, RFORMAT_AB) \
+    X(TO_BOOL_F, RFORMAT_AB) \
+    X(I2F, RFORMAT_AB) \
+    X(U2F, RFORMAT_AB) \
+    X(F2I, RFORMAT_CONVERT) \
+    X(FROUND, RFORMAT_AB)
+
+// compare and branch in one dispatch, one per comparison of REGISTER_ALU_OPS
+#define REGISTER_BRANCH_OPS(X) \
+    X(BR_EQ_I, RFORMAT_BRANCH) \
+    X(BR_NE_I, RFORMAT_BRANCH) \
+    X(BR_LT_I, RFORMAT_BRANCH) \
+    X(BR_LE_I, RFORMAT_BRANCH) \
+    X(BR_GT_I, RFORMAT_BRANCH) \
+    X(BR_GE_I, RFORMAT_BRANCH) \
+    X(BR_LT_U, RFORMAT_BRANCH) \
+    X(BR_LE_U, RFORMAT_BRANCH) \
+    X(BR_GT_U, RFORMAT_BRANCH) \
+    X(BR_GE_U, RFORMAT_BRANCH) \
+    X(BR_EQ_F, RFORMAT_BRANCH) \
+    X(BR_NE_F, RFORMAT_BRANCH) \
+    X(BR_LT_F, RFORMAT_BRANCH) \
+    X(BR_LE_F, RFORMAT_BRANCH) \
+    X(BR_GT_F, RFORMAT_BRANCH) \
+    X(BR_GE_F, RFORMAT_BRANCH)
+
+#define REGISTER_OPS(X) \
+    X(MOVE, RFORMAT_AB) \
+    X(LOAD_GLOBAL, RFORMAT_LOAD_GLOBAL) \
+    X(STORE_GLOBAL, RFORMAT_STORE_GLOBAL) \
+    X(LOAD_INDEXED, RFORMAT_LOAD_INDEXED) \
+    X(STORE_INDEXED, RFORMAT_STORE_INDEXED) \
+    X(LOAD_GLOBAL_INDEXED, RFORMAT_LOAD_INDEXED) \
+    X(STORE_GLOBAL_INDEXED, RFORMAT_STORE_INDEXED) \
+    X(ATOMIC_LOAD, RFORMAT_LOAD_GLOBAL) \
+    X(ATOMIC_STORE, RFORMAT_STORE_GLOBAL) \
+    X(ATOMIC_LOAD_INDEXED, RFORMAT_LOAD_INDEXED) \
+    X(ATOMIC_STORE_INDEXED, RFORMAT_STORE_INDEXED) \
+    X(ATOMIC_UPDATE, RFORMAT_ATOMIC) \
+    X(ATOMIC_UPDATE_INDEXED, RFORMAT_ATOMIC_INDEXED) \
+    X(CHECK_INDEX, RFORMAT_CHECK) \
+    X(CLEAR, RFORMAT_CLEAR) \
+    REGISTER_ALU_OPS(X) \
+    X(JUMP, RFORMAT_JUMP) \
+    X(JUMP_IF_FALSE, RFORMAT_BRANCH_IF) \
+    X(JUMP_IF_TRUE, RFORMAT_BRANCH_IF) \
+    REGISTER_BRANCH_OPS(X) \
+    X(INC_BR_LT_I32, RFORMAT_BRANCH) \
+    X(INC_BR_LE_I32, RFORMAT_BRANCH) \
+    X(CALL, RFORMAT_CALL) \
+    X(TAILCALL, RFORMAT_CALL) \
+    X(RETURN, RFORMAT_A) \
+    X(RETURN_VOID, RFORMAT_NONE) \
+    X(THROW, RFORMAT_THROW) \
+    X(PARALLEL_FOR, RFORMAT_PARALLEL) \
+    X(PRINT, RFORMAT_PRINT)
+
+#define REGISTER_OP_ENUM(name, format) ROP_##name,
+typedef enum {
+    REGISTER_OPS(REGISTER_OP_ENUM)
+    ROP_COUNT
+} RegisterOpcode;
+#undef REGISTER_OP_ENUM
+
+typedef struct {
+    uint8_t op;
+    uint8_t aux;
+    uint16_t a;
+    uint16_t b;
+    uint16_t c;
+} RegisterInstruction;
+
+// The bytecode's handler table in instruction indices; a handler starts with
+// the exception in the register of stack position 0.
+typedef struct {
+    int start;
+    int end;
+    int target;
+    int type;               // -1 for any
+} RegisterHandler;
+
+// Registers are laid out as the bytecode locals, then the constants the
+// function uses, then one register per stack position live across a jump,
+// then the temporaries shared out by linear scan.
+typedef struct {
+    char *name;
+    int paramCount;
+    PrimitiveType returnType;
+    bool returnsVoid;
+    int localCount;
+    int constantBase;
+    int constantCount;
+    VMValue *constants;     // copied into the frame on entry
+    PrimitiveType *constantTypes;
+    int frameSize;
+    RegisterInstruction *code;
+    int codeSize;
+    uint8_t *printTypes;
+    int printTypesSize;
+    RegisterHandler *handlers;
+    int handlerCount;
+} RegisterFunction;
+
+typedef struct {
+    const BytecodeModule *source;
+    RegisterFunction *functions;
+    int functionCount;
+} RegisterModule;
+
+typedef struct RegVM RegVM;
+typedef struct JitModule JitModule;
+
+// Translates verified stack bytecode; the bytecode module must outlive the result.
+RegisterModule *compileRegisterModule(const BytecodeModule *module, char *error, size_t errorSize);
+void freeRegisterModule(RegisterModule *module);
+
+const char *registerOpcodeName(RegisterOpcode op);
+RegisterFormat registerOpcodeFormat(RegisterOpcode op);
+void dumpRegisterFunction(const RegisterModule *module, const RegisterFunction *fn, FILE *out);
+void dumpRegisterModule(const RegisterModule *module, FILE *out);
+
+// The module must outlive the VM.
+RegVM *createRegVM(const RegisterModule *module, const VMOptions *options);
+void freeRegVM(RegVM *vm);
+
+bool runRegVM(RegVM *vm, Value *result);
+bool callRegVM(RegVM *vm, const char *name, const Value *args, int argCount, Value *result);
+// The globals as the last run left them, see vmGlobals.
+const VMValue *regVMGlobals(RegVM *vm);
+void restoreRegVMGlobals(RegVM *vm, const VMValue *globals);
+
+// Calls of the functions jit compiled run as machine code from now on; the
+// JIT module must outlive the VM.
+void attachRegVMJit(RegVM *vm, const JitModule *jit);
+
+typedef struct {
+    int callThreshold;          // calls before a function is compiled
+    int loopThreshold;          // backward jumps to one loop header before its frame moves to machine code
+    FILE *log;                  // where tier-up events go, NULL for nowhere
+} TierOptions;
+
+TierOptions defaultTierOptions(void);
+
+// Starts every function in the interpreter and has jit compile the ones
+// that get hot. A loop that gets hot switches to machine code in the middle
+// of its frame. Counts carry over from one run to the next.
+bool enableRegVMTiering(RegVM *vm, JitModule *jit, const TierOptions *options);
+
+const char *regVMError(RegVM *vm);
+const VMStats *regVMStats(RegVM *vm);
+
+// Counts each pair of consecutively executed instructions from now on, the
+// data used to pick which pairs deserve a fused instruction.
+void enableRegVMProfile(RegVM *vm);
+void printRegVMProfile(RegVM *vm, int limit, FILE *out);
+
+#endif
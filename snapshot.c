@@ -0,0 +1,389 @@
+#include "snapshot.h"
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Written in the byte order of the machine, which must match when mapping.
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+
+// Parameter types and handlers are used in place, so their layout is the image's.
+_Static_assert(sizeof(PrimitiveType) == sizeof(int32_t), "PrimitiveType is not 32 bits");
+_Static_assert(sizeof(BytecodeHandler) == 4 * sizeof(int32_t), "BytecodeHandler is not four 32-bit fields");
+
+// Offsets count bytes from the start of the image; 0 stands for none.
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t bytecodeVersion;
+    uint32_t byteOrder;
+    uint64_t size;
+    uint64_t checksum;          // FNV-1a of the image with this field zero
+    uint32_t constantCount;
+    uint32_t globalCount;
+    uint32_t functionCount;
+    uint32_t globalSlots;
+    int32_t mainFunction;
+    uint32_t reserved;
+    uint64_t constants;
+    uint64_t globals;
+    uint64_t functions;
+    uint64_t values;            // globalSlots values, strings as the offset of their text
+} SnapshotHeader;
+
+typedef struct {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t value;             // the offset of the text for strings
+} SnapshotConstant;
+
+typedef struct {
+    uint64_t name;
+    uint32_t type;
+    uint32_t slot;
+    uint32_t length;
+    uint32_t reserved;
+} SnapshotGlobal;
+
+typedef struct {
+    uint64_t name;
+    uint64_t paramTypes;
+    uint64_t code;
+    uint64_t handlers;
+    uint32_t paramCount;
+    uint32_t returnType;
+    uint32_t returnsVoid;
+    uint32_t localCount;
+    uint32_t maxStack;
+    uint32_t codeSize;
+    uint32_t handlerCount;
+    uint32_t reserved;
+} SnapshotFunction;
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    bool outOfMemory;           // sticky; nothing more is reserved or copied
+} ImageBuffer;
+
+static bool fail(char *error, size_t errorSize, const char *format, ...){
+    if(error && errorSize > 0){
+        va_list args;
+        va_start(args, format);
+        vsnprintf(error, errorSize, format, args);
+        va_end(args);
+    }
+    return false;
+}
+
+// Appends size zeroed bytes at the next 8-byte boundary and returns their
+// offset; the buffer moves, so sections are filled through offsets. Out of
+// memory it returns 0 and sets the buffer's flag, which the writer checks
+// before filling a section it reserved.
+static uint64_t reserveBytes(ImageBuffer *buffer, size_t size){
+    if(buffer->outOfMemory) return 0;
+    size_t offset = (buffer->size + 7) & ~(size_t)7;
+    if(offset + size > buffer->capacity){
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+        while(capacity < offset + size) capacity *= 2;
+        uint8_t *grown = realloc(buffer->data, capacity);
+        if(!grown){
+            buffer->outOfMemory = true;
+            return 0;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memset(buffer->data + buffer->size, 0, offset + size - buffer->size);
+    buffer->size = offset + size;
+    return offset;
+}
+
+static uint64_t appendBytes(ImageBuffer *buffer, const void *data, size_t size){
+    uint64_t offset = reserveBytes(buffer, size);
+    if(size > 0 && !buffer->outOfMemory) memcpy(buffer->data + offset, data, size);
+    return offset;
+}
+
+static uint64_t appendString(ImageBuffer *buffer, const char *s){
+    return appendBytes(buffer, s, strlen(s) + 1);
+}
+
+#define AT(buffer, type, offset) ((type *)((buffer)->data + (offset)))
+
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size){
+    const unsigned char *bytes = data;
+    for(size_t i = 0; i < size; i++){
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// The checksum of an image, skipping the header field that holds it.
+static uint64_t imageChecksum(const void *image, size_t size){
+    size_t field = offsetof(SnapshotHeader, checksum);
+    uint64_t hash = hashBytes(14695981039346656037ULL, image, field);
+    field += sizeof(uint64_t);
+    return hashBytes(hash, (const uint8_t *)image + field, size - field);
+}
+
+bool writeSnapshot(const BytecodeModule *module, const VMValue *globals, const char *path, char *error, size_t errorSize){
+    ImageBuffer buffer = {NULL, 0, 0, false};
+    uint64_t header = reserveBytes(&buffer, sizeof(SnapshotHeader));
+    uint64_t constants = reserveBytes(&buffer, (size_t)module->constantCount * sizeof(SnapshotConstant));
+    uint64_t globalTable = reserveBytes(&buffer, (size_t)module->globalCount * sizeof(SnapshotGlobal));
+    uint64_t functions = reserveBytes(&buffer, (size_t)module->functionCount * sizeof(SnapshotFunction));
+    uint64_t values = reserveBytes(&buffer, (size_t)module->globalSlots * sizeof(uint64_t));
+    if(buffer.outOfMemory){
+        free(buffer.data);
+        return fail(error, errorSize, "out of memory");
+    }
+
+    for(int i = 0; i < module->constantCount; i++){
+        const BytecodeConstant *k = &module->constants[i];
+        uint64_t value = k->type == TYPE_STRING ? appendString(&buffer, k->value.s) : k->value.u;
+        AT(&buffer, SnapshotConstant, constants)[i] = (SnapshotConstant){k->type, 0, value};
+    }
+
+    for(int i = 0; i < module->globalCount; i++){
+        const BytecodeGlobal *g = &module->globals[i];
+        uint64_t name = appendString(&buffer, g->name);
+        AT(&buffer, SnapshotGlobal, globalTable)[i] = (SnapshotGlobal){name, g->type, (uint32_t)g->slot, (uint32_t)g->length, 0};
+    }
+    for(int i = 0; i < module->globalSlots; i++){
+        AT(&buffer, uint64_t, values)[i] = globals[i].u;
+    }
+    // a string global holds a constant's text, saved as where that text went
+    for(int i = 0; i < module->globalCount; i++){
+        const BytecodeGlobal *g = &module->globals[i];
+        if(g->type != TYPE_STRING) continue;
+        int slots = g->length > 0 ? g->length : 1;
+        for(int s = g->slot; s < g->slot + slots; s++){
+            if(!globals[s].s){
+                AT(&buffer, uint64_t, values)[s] = 0;
+                continue;
+            }
+            int k = 0;
+            while(k < module->constantCount && (module->constants[k].type != TYPE_STRING || module->constants[k].value.s != globals[s].s)) k++;
+            if(k == module->constantCount){
+                free(buffer.data);
+                return fail(error, errorSize, "global '%s' holds a string that is not a constant of the program", g->name);
+            }
+            AT(&buffer, uint64_t, values)[s] = AT(&buffer, SnapshotConstant, constants)[k].value;
+        }
+    }
+
+    for(int i = 0; i < module->functionCount; i++){
+        const BytecodeFunction *fn = &module->functions[i];
+        SnapshotFunction entry = {0};
+        entry.name = appendString(&buffer, fn->name);
+        entry.paramTypes = appendBytes(&buffer, fn->paramTypes, (size_t)fn->paramCount * sizeof(PrimitiveType));
+        entry.code = appendBytes(&buffer, fn->code, (size_t)fn->codeSize);
+        entry.handlers = appendBytes(&buffer, fn->handlers, (size_t)fn->handlerCount * sizeof(BytecodeHandler));
+        entry.paramCount = (uint32_t)fn->paramCount;
+        entry.returnType = fn->returnType;
+        entry.returnsVoid = fn->returnsVoid;
+        entry.localCount = (uint32_t)fn->localCount;
+        entry.maxStack = (uint32_t)fn->maxStack;
+        entry.codeSize = (uint32_t)fn->codeSize;
+        entry.handlerCount = (uint32_t)fn->handlerCount;
+        AT(&buffer, SnapshotFunction, functions)[i] = entry;
+    }
+
+    SnapshotHeader *h = AT(&buffer, SnapshotHeader, header);
+    memcpy(h->magic, SNAPSHOT_MAGIC, 4);
+    h->version = SNAPSHOT_VERSION;
+    h->bytecodeVersion = BYTECODE_VERSION;
+    h->byteOrder = SNAPSHOT_BYTE_ORDER;
+    h->size = buffer.size;
+    h->constantCount = (uint32_t)module->constantCount;
+    h->globalCount = (uint32_t)module->globalCount;
+    h->functionCount = (uint32_t)module->functionCount;
+    h->globalSlots = (uint32_t)module->globalSlots;
+    h->mainFunction = module->mainFunction;
+    h->constants = constants;
+    h->globals = globalTable;
+    h->functions = functions;
+    h->values = values;
+    if(buffer.outOfMemory){
+        free(buffer.data);
+        return fail(error, errorSize, "out of memory");
+    }
+    h->checksum = imageChecksum(buffer.data, buffer.size);
+
+    FILE *out = fopen(path, "wb");
+    if(!out){
+        free(buffer.data);
+        return fail(error, errorSize, "cannot write '%s'", path);
+    }
+    bool ok = fwrite(buffer.data, 1, buffer.size, out) == buffer.size;
+    ok = fclose(out) == 0 && ok;
+    free(buffer.data);
+    return ok ? true : fail(error, errorSize, "cannot write '%s'", path);
+}
+
+// Whether [offset, offset + size) lies inside the image and is aligned for what it holds.
+static bool inImage(const Snapshot *snapshot, uint64_t offset, uint64_t size, size_t align){
+    return offset <= snapshot->imageSize && size <= snapshot->imageSize - offset && offset % align == 0;
+}
+
+static char *imageString(const Snapshot *snapshot, uint64_t offset){
+    if(offset == 0 || offset >= snapshot->imageSize) return NULL;
+    char *s = (char *)snapshot->image + offset;
+    return memchr(s, '\0', snapshot->imageSize - offset) ? s : NULL;
+}
+
+static void *imageAt(const Snapshot *snapshot, uint64_t offset){
+    return (uint8_t *)snapshot->image + offset;
+}
+
+// Rebuilds the module's tables around what the image holds; false when an
+// offset or count points outside it, or with outOfMemory set when the tables
+// cannot be allocated.
+static bool loadModule(Snapshot *snapshot, const SnapshotHeader *h, bool *outOfMemory){
+    BytecodeModule *module = calloc(1, sizeof(BytecodeModule));
+    if(!module){
+        *outOfMemory = true;
+        return false;
+    }
+    snapshot->module = module;
+    module->mainFunction = h->mainFunction;
+    module->globalSlots = (int)h->globalSlots;
+    if(h->constantCount > UINT16_MAX + 1 || h->globalCount > UINT16_MAX || h->globalSlots > UINT16_MAX || h->functionCount > UINT16_MAX + 1) return false;
+    if(!inImage(snapshot, h->constants, (uint64_t)h->constantCount * sizeof(SnapshotConstant), 8)) return false;
+    if(!inImage(snapshot, h->globals, (uint64_t)h->globalCount * sizeof(SnapshotGlobal), 8)) return false;
+    if(!inImage(snapshot, h->functions, (uint64_t)h->functionCount * sizeof(SnapshotFunction), 8)) return false;
+    if(!inImage(snapshot, h->values, (uint64_t)h->globalSlots * sizeof(uint64_t), 8)) return false;
+
+    module->constants = calloc(h->constantCount > 0 ? h->constantCount : 1, sizeof(BytecodeConstant));
+    module->globals = calloc(h->globalCount > 0 ? h->globalCount : 1, sizeof(BytecodeGlobal));
+    module->functions = calloc(h->functionCount > 0 ? h->functionCount : 1, sizeof(BytecodeFunction));
+    snapshot->globals = calloc(h->globalSlots > 0 ? h->globalSlots : 1, sizeof(VMValue));
+    if(!module->constants || !module->globals || !module->functions || !snapshot->globals){
+        *outOfMemory = true;
+        return false;
+    }
+
+    const SnapshotConstant *constants = imageAt(snapshot, h->constants);
+    for(uint32_t i = 0; i < h->constantCount; i++){
+        BytecodeConstant *k = &module->constants[module->constantCount++];
+        k->type = (PrimitiveType)constants[i].type;
+        k->value.u = constants[i].value;
+        if(k->type == TYPE_STRING && !(k->value.s = imageString(snapshot, constants[i].value))) return false;
+    }
+
+    const SnapshotGlobal *globals = imageAt(snapshot, h->globals);
+    for(uint32_t i = 0; i < h->globalCount; i++){
+        BytecodeGlobal *g = &module->globals[module->globalCount++];
+        g->name = imageString(snapshot, globals[i].name);
+        g->type = (PrimitiveType)globals[i].type;
+        g->slot = (int)globals[i].slot;
+        g->length = (int)globals[i].length;
+        if(!g->name || globals[i].slot > h->globalSlots || globals[i].length > h->globalSlots - globals[i].slot) return false;
+    }
+
+    const uint64_t *values = imageAt(snapshot, h->values);
+    for(uint32_t i = 0; i < h->globalSlots; i++){
+        snapshot->globals[i].u = values[i];
+    }
+    for(int i = 0; i < module->globalCount; i++){
+        const BytecodeGlobal *g = &module->globals[i];
+        if(g->type != TYPE_STRING) continue;
+        int slots = g->length > 0 ? g->length : 1;
+        for(int s = g->slot; s < g->slot + slots && s < module->globalSlots; s++){
+            if(values[s] != 0 && !(snapshot->globals[s].s = imageString(snapshot, values[s]))) return false;
+        }
+    }
+
+    const SnapshotFunction *functions = imageAt(snapshot, h->functions);
+    for(uint32_t i = 0; i < h->functionCount; i++){
+        const SnapshotFunction *entry = &functions[i];
+        BytecodeFunction *fn = &module->functions[module->functionCount++];
+        fn->name = imageString(snapshot, entry->name);
+        if(!fn->name || entry->paramCount > UINT16_MAX || entry->localCount > UINT16_MAX || entry->codeSize > (1u << 28) || entry->handlerCount > (1u << 20)) return false;
+        if(!inImage(snapshot, entry->paramTypes, (uint64_t)entry->paramCount * sizeof(PrimitiveType), _Alignof(PrimitiveType))) return false;
+        if(!inImage(snapshot, entry->code, entry->codeSize, 1)) return false;
+        if(!inImage(snapshot, entry->handlers, (uint64_t)entry->handlerCount * sizeof(BytecodeHandler), _Alignof(BytecodeHandler))) return false;
+        fn->paramCount = (int)entry->paramCount;
+        fn->paramTypes = imageAt(snapshot, entry->paramTypes);
+        fn->returnType = (PrimitiveType)entry->returnType;
+        fn->returnsVoid = entry->returnsVoid != 0;
+        fn->localCount = (int)entry->localCount;
+        fn->maxStack = (int)entry->maxStack;
+        fn->code = imageAt(snapshot, entry->code);
+        fn->codeSize = (int)entry->codeSize;
+        fn->codeCapacity = fn->codeSize;
+        fn->handlers = imageAt(snapshot, entry->handlers);
+        fn->handlerCount = (int)entry->handlerCount;
+        fn->handlerCapacity = fn->handlerCount;
+    }
+    return true;
+}
+
+Snapshot *openSnapshot(const char *path, char *error, size_t errorSize){
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){
+        fail(error, errorSize, "cannot open '%s'", path);
+        return NULL;
+    }
+    struct stat info;
+    if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(SnapshotHeader)){
+        close(fd);
+        fail(error, errorSize, "'%s' is not a snapshot", path);
+        return NULL;
+    }
+    // private and read-only: the VMs never write code, and a stray write faults
+    void *image = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(image == MAP_FAILED){
+        fail(error, errorSize, "cannot map '%s'", path);
+        return NULL;
+    }
+
+    Snapshot *snapshot = calloc(1, sizeof(Snapshot));
+    if(!snapshot){
+        munmap(image, (size_t)info.st_size);
+        fail(error, errorSize, "out of memory");
+        return NULL;
+    }
+    snapshot->image = image;
+    snapshot->imageSize = (size_t)info.st_size;
+
+    const SnapshotHeader *h = image;
+    bool outOfMemory = false;
+    if(memcmp(h->magic, SNAPSHOT_MAGIC, 4) != 0){
+        fail(error, errorSize, "'%s' is not a snapshot", path);
+    } else if(h->version != SNAPSHOT_VERSION || h->bytecodeVersion != BYTECODE_VERSION || h->byteOrder != SNAPSHOT_BYTE_ORDER){
+        fail(error, errorSize, "'%s' was written by another version or machine", path);
+    } else if(h->size != snapshot->imageSize){
+        fail(error, errorSize, "'%s' is truncated", path);
+    } else if(h->checksum != imageChecksum(image, snapshot->imageSize)){
+        fail(error, errorSize, "'%s' is damaged: its checksum does not match", path);
+    } else if(!loadModule(snapshot, h, &outOfMemory)){
+        if(outOfMemory) fail(error, errorSize, "out of memory");
+        else fail(error, errorSize, "'%s' is damaged", path);
+    } else if(verifyBytecode(snapshot->module, error, errorSize)){
+        return snapshot;
+    }
+    closeSnapshot(snapshot);
+    return NULL;
+}
+
+void closeSnapshot(Snapshot *snapshot){
+    if(!snapshot) return;
+    if(snapshot->module){
+        free(snapshot->module->functions);
+        free(snapshot->module->constants);
+        free(snapshot->module->globals);
+        free(snapshot->module);
+    }
+    free(snapshot->globals);
+    munmap(snapshot->image, snapshot->imageSize);
+    free(snapshot);
+}
@@ -0,0 +1,30 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "bytecode.h"
+
+#define SNAPSHOT_MAGIC "NLSN"
+#define SNAPSHOT_VERSION 2
+
+// A compiled program with the globals its top-level code left, saved so
+// later processes skip lexing, parsing, compiling and initialization. The
+// image holds offsets rather than pointers: names, string constants, code and
+// handler tables are used in place from a read-only mapping of the file, and
+// only the tables describing them are rebuilt when it is opened. An image is
+// tied to the bytecode version and byte order that wrote it, and carries a
+// checksum so one damaged on disk is rejected rather than run.
+typedef struct Snapshot {
+    BytecodeModule *module;     // points into the image, freed by closeSnapshot only
+    VMValue *globals;           // module->globalSlots values
+    void *image;
+    size_t imageSize;
+} Snapshot;
+
+// globals holds the module's globalSlots values; string globals may only
+// hold the module's string constants.
+bool writeSnapshot(const BytecodeModule *module, const VMValue *globals, const char *path, char *error, size_t errorSize);
+// Maps the image at path, checks its checksum and verifies its bytecode.
+Snapshot *openSnapshot(const char *path, char *error, size_t errorSize);
+void closeSnapshot(Snapshot *snapshot);
+
+#endif
@@ -0,0 +1,358 @@
+#include "tailcall.h"
+#include "primitive.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    ASTNode **functions;
+    int functionCount;
+    TailCallStats *stats;
+
+    ASTNode *current;           // innermost function or lambda
+    NameSet *locals;            // every name declared in it
+    bool frameEscapes;          // its frame may be referenced after a call
+    ASTNode *selfLabel;         // set when self calls may become jumps
+    bool labelUsed;
+    int tryDepth;
+} TailCallPass;
+
+typedef struct {
+    NameSet *names;
+    const char *counted;
+    int count;
+    bool frameEscapes;
+    bool hasClosures;
+} FrameScan;
+
+static ASTNode *findFunction(TailCallPass *pass, const char *name){
+    for(int i = 0; i < pass->functionCount; i++){
+        if(strcmp(pass->functions[i]->functionDef.name, name) == 0) return pass->functions[i];
+    }
+    return NULL;
+}
+
+// Whether a result of type b can be returned unchanged as type a.
+static bool sameType(ASTNode *a, ASTNode *b){
+    if(!a || !b) return a == b;
+
+    PrimitiveType primitiveA, primitiveB;
+    bool isPrimitiveA = typeNodeToPrimitive(a, &primitiveA);
+    bool isPrimitiveB = typeNodeToPrimitive(b, &primitiveB);
+    if(isPrimitiveA || isPrimitiveB) return isPrimitiveA && isPrimitiveB && primitiveA == primitiveB;
+    if(a->type != b->type) return false;
+
+    switch(a->type){
+        case IDENTIFIER_NODE: return strcmp(a->identifier.name, b->identifier.name) == 0;
+        case POINTER_NODE: return sameType(a->pointer.ptr, b->pointer.ptr);
+        case VOID_NODE: return true;
+        default: return false;
+    }
+}
+
+static void scanFrame(ASTNode **slot, void *ctx){
+    FrameScan *scan = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    switch(node->type){
+        case DECLARATION_NODE:
+            if(scan->names) addName(scan->names, node->declaration.varName);
+            if(scan->counted && strcmp(node->declaration.varName, scan->counted) == 0) scan->count++;
+            if(node->declaration.varType && node->declaration.varType->type == ARRAY_NODE) scan->frameEscapes = true;
+            break;
+        case UNARY_OPERATION_NODE:
+            if(node->unaryOp.op == ADDRESS_OF_UNOP) scan->frameEscapes = true;
+            break;
+        case MALLOC_NODE:
+            if(node->mallocExpr.placement != ALLOC_HEAP) scan->frameEscapes = true;
+            break;
+        case CALLOC_NODE:
+            if(node->callocExpr.placement != ALLOC_HEAP) scan->frameEscapes = true;
+            break;
+        case FUNCTION_NODE:
+        case LAMBDA_NODE:
+            scan->hasClosures = true;
+            break;
+        default:
+            break;
+    }
+    forEachChild(node, scanFrame, scan);
+}
+
+static int countDeclarations(ASTNode *function, const char *name){
+    FrameScan scan = { NULL, name, 0, false, false };
+    forEachChild(function, scanFrame, &scan);
+    return scan.count;
+}
+
+// Reassigning the parameters and jumping back is only the same as a new
+// call when nothing can observe the old values afterwards.
+static bool canJumpToSelf(ASTNode *function, FrameScan *frame){
+    if(frame->frameEscapes || frame->hasClosures || hasName(frame->names, function->functionDef.name)) return false;
+
+    for(int i = 0; i < function->functionDef.paramCount; i++){
+        ASTNode *param = function->functionDef.params[i];
+        if(!param || param->type != DECLARATION_NODE) return false;
+        if(countDeclarations(function, param->declaration.varName) != 1) return false;
+    }
+    return true;
+}
+
+static ASTNode *returnTypeOf(ASTNode *function){
+    return function->type == FUNCTION_NODE ? function->functionDef.returnType : function->lambda.returnType;
+}
+
+static ASTNode *callTarget(TailCallPass *pass, ASTNode *call){
+    ASTNode *callee = call->functionCall.function;
+    if(!callee || callee->type != IDENTIFIER_NODE || hasName(pass->locals, callee->identifier.name)) return NULL;
+    return findFunction(pass, callee->identifier.name);
+}
+
+static void markTail(TailCallPass *pass, ASTNode *expr){
+    if(!expr) return;
+
+    switch(expr->type){
+        case FUNCTION_CALL_NODE: {
+            ASTNode *target = callTarget(pass, expr);
+            if(target && !expr->functionCall.isTailCall && expr->functionCall.argsCount == target->functionDef.paramCount && sameType(returnTypeOf(pass->current), target->functionDef.returnType)){
+                expr->functionCall.isTailCall = true;
+                pass->stats->tailCallsMarked++;
+            }
+            break;
+        }
+        case TERNARY_OPERATION_NODE:
+            markTail(pass, expr->ternaryOp.trueExpr);
+            markTail(pass, expr->ternaryOp.falseExpr);
+            break;
+        case COMPOUND_EXPR_NODE:
+            if(expr->compoundExpr.stmtCount > 0) markTail(pass, expr->compoundExpr.statements[expr->compoundExpr.stmtCount - 1]);
+            break;
+        case BINARY_OPERATION_NODE:
+            if(expr->binaryOp.op == COMMA_BINOP) markTail(pass, expr->binaryOp.right);
+            break;
+        default:
+            break;
+    }
+}
+
+static void freeStatements(ASTNode **list, int count){
+    for(int i = 0; i < count; i++){
+        freeAST(list[i]);
+    }
+    free(list);
+}
+
+// return f(a, b) inside f becomes
+// { T __tail_x = a; U __tail_y = b; x = __tail_x; y = __tail_y; jump __tail_f; }
+static bool rewriteSelfCall(TailCallPass *pass, ASTNode **slot){
+    ASTNode *function = pass->current;
+    ASTNode *call = (*slot)->returnStmt.value;
+    int paramCount = function->functionDef.paramCount;
+
+    int changed = 0;
+    for(int i = 0; i < paramCount; i++){
+        ASTNode *arg = call->functionCall.args[i];
+        const char *name = function->functionDef.params[i]->declaration.varName;
+        if(!arg || arg->type != IDENTIFIER_NODE || strcmp(arg->identifier.name, name) != 0) changed++;
+    }
+    bool useTemps = changed > 1;
+
+    ASTNode **statements = malloc((2 * paramCount + 1) * sizeof(ASTNode *));
+    ASTNode **targets = malloc((paramCount ? paramCount : 1) * sizeof(ASTNode *));
+    if(!statements || !targets){
+        free(statements);
+        free(targets);
+        return false;
+    }
+
+    int count = 0;
+    bool ok = true;
+    for(int i = 0; i < paramCount && ok; i++){
+        ASTNode *param = function->functionDef.params[i];
+        ASTNode *arg = call->functionCall.args[i];
+        const char *name = param->declaration.varName;
+        targets[i] = NULL;
+        if(arg && arg->type == IDENTIFIER_NODE && strcmp(arg->identifier.name, name) == 0) continue;
+
+        if(!useTemps){
+            ASTNode *target = createIdentifierNode(name);
+            statements[count] = target ? createAssignmentNode(target, NULL, SIMPLE_ASSIGN) : NULL;
+            if(!statements[count]) freeAST(target);
+            ok = statements[count] != NULL;
+            if(ok) targets[i] = statements[count++];
+            continue;
+        }
+
+        size_t length = strlen(name) + sizeof("__tail_");
+        char *temp = malloc(length);
+        ASTNode *type = param->declaration.varType ? cloneAST(param->declaration.varType) : NULL;
+        ASTNode *declaration = NULL;
+        if(temp && (type || !param->declaration.varType)){
+            snprintf(temp, length, "__tail_%s", name);
+            declaration = createDeclarationNode(type, temp, NULL, 0);
+        }
+        if(!declaration){
+            freeAST(type);
+            free(temp);
+            ok = false;
+            break;
+        }
+        targets[i] = declaration;
+        statements[count++] = declaration;
+        free(temp);
+    }
+
+    // assignments from the temporaries follow all of their declarations
+    for(int i = 0; i < paramCount && ok && useTemps; i++){
+        if(!targets[i]) continue;
+        ASTNode *target = createIdentifierNode(function->functionDef.params[i]->declaration.varName);
+        ASTNode *value = createIdentifierNode(targets[i]->declaration.varName);
+        statements[count] = target && value ? createAssignmentNode(target, value, SIMPLE_ASSIGN) : NULL;
+        if(!statements[count]){
+            freeAST(target);
+            freeAST(value);
+            ok = false;
+            break;
+        }
+        count++;
+    }
+
+    if(ok){
+        statements[count] = createJumpNode(pass->selfLabel->labelStmt.labelName);
+        ok = statements[count] != NULL;
+        if(ok) count++;
+    }
+    ASTNode *block = ok ? createBlockNode(statements, count) : NULL;
+    if(!block){
+        freeStatements(statements, count);
+        free(targets);
+        return false;
+    }
+    free(statements);
+
+    for(int i = 0; i < paramCount; i++){
+        if(!targets[i]) continue;
+        if(targets[i]->type == DECLARATION_NODE) targets[i]->declaration.initializer = call->functionCall.args[i];
+        else targets[i]->assignment.right = call->functionCall.args[i];
+        call->functionCall.args[i] = NULL;
+    }
+    free(targets);
+
+    freeAST(*slot);
+    *slot = block;
+    return true;
+}
+
+static void visitFunction(TailCallPass *pass, ASTNode *node);
+
+static void visitSlot(ASTNode **slot, void *ctx){
+    TailCallPass *pass = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    switch(node->type){
+        case FUNCTION_NODE:
+        case LAMBDA_NODE:
+            visitFunction(pass, node);
+            return;
+        case TRY_NODE:
+            // a call made inside a try still needs the handler of this frame
+            pass->tryDepth++;
+            for(int i = 0; i < node->tryStmt.tryBlockCount; i++){
+                visitSlot(&node->tryStmt.tryBlock[i], pass);
+            }
+            pass->tryDepth--;
+            for(int i = 0; i < node->tryStmt.catchCount; i++){
+                visitSlot(&node->tryStmt.catchBlock[i], pass);
+            }
+            return;
+        case RETURN_NODE: {
+            forEachChild(node, visitSlot, pass);
+            if(!pass->current || pass->tryDepth > 0 || pass->frameEscapes) return;
+
+            ASTNode *value = node->returnStmt.value;
+            markTail(pass, value);
+            if(pass->selfLabel && value && value->type == FUNCTION_CALL_NODE && value->functionCall.isTailCall && callTarget(pass, value) == pass->current && rewriteSelfCall(pass, slot)){
+                pass->labelUsed = true;
+                pass->stats->selfCallsRewritten++;
+            }
+            return;
+        }
+        default:
+            forEachChild(node, visitSlot, pass);
+            return;
+    }
+}
+
+static void visitFunction(TailCallPass *pass, ASTNode *node){
+    TailCallPass saved = *pass;
+    NameSet locals;
+    initNameSet(&locals);
+
+    FrameScan frame = { &locals, NULL, 0, false, false };
+    forEachChild(node, scanFrame, &frame);
+
+    pass->current = node;
+    pass->locals = &locals;
+    pass->frameEscapes = frame.frameEscapes;
+    pass->selfLabel = NULL;
+    pass->labelUsed = false;
+    pass->tryDepth = 0;
+
+    // the label and the body slot for it are allocated up front so that
+    // a rewrite never leaves a jump without its target
+    bool topLevel = node->type == FUNCTION_NODE && findFunction(pass, node->functionDef.name) == node;
+    if(topLevel && canJumpToSelf(node, &frame)){
+        size_t length = strlen(node->functionDef.name) + sizeof("__tail_");
+        char *label = malloc(length);
+        ASTNode **body = realloc(node->functionDef.body, (node->functionDef.bodyCount + 1) * sizeof(ASTNode *));
+        if(body) node->functionDef.body = body;
+        if(label && body){
+            snprintf(label, length, "__tail_%s", node->functionDef.name);
+            pass->selfLabel = createLabelNode(label);
+        }
+        free(label);
+    }
+
+    forEachChild(node, visitSlot, pass);
+
+    if(pass->selfLabel && pass->labelUsed){
+        memmove(&node->functionDef.body[1], &node->functionDef.body[0], node->functionDef.bodyCount * sizeof(ASTNode *));
+        node->functionDef.body[0] = pass->selfLabel;
+        node->functionDef.bodyCount++;
+    } else{
+        freeAST(pass->selfLabel);
+    }
+    freeNameSet(&locals);
+
+    saved.stats = pass->stats;
+    *pass = saved;
+}
+
+ASTNode *eliminateTailCalls(ASTNode *node, TailCallStats *stats){
+    *stats = (TailCallStats){0};
+    if(!node) return NULL;
+
+    ASTNode **items = &node;
+    int itemCount = 1;
+    if(node->type == BLOCK_NODE){
+        items = node->block.statements;
+        itemCount = node->block.stmtCount;
+    }
+
+    TailCallPass pass;
+    memset(&pass, 0, sizeof(pass));
+    pass.stats = stats;
+    pass.functions = malloc((itemCount ? itemCount : 1) * sizeof(ASTNode *));
+    if(!pass.functions) return node;
+
+    for(int i = 0; i < itemCount; i++){
+        if(items[i] && items[i]->type == FUNCTION_NODE) pass.functions[pass.functionCount++] = items[i];
+    }
+
+    visitSlot(&node, &pass);
+    free(pass.functions);
+    return node;
+}
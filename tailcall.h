@@ -0,0 +1,13 @@
+#ifndef TAILCALL_H
+#define TAILCALL_H
+
+#include "ast.h"
+
+typedef struct {
+    int tailCallsMarked;
+    int selfCallsRewritten;
+} TailCallStats;
+
+ASTNode *eliminateTailCalls(ASTNode *node, TailCallStats *stats);
+
+#endif
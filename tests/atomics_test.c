@@ -0,0 +1,60 @@
+#include "builders.h"
+#include "harness.h"
+#include <stdio.h>
+
+// Parallel loops reducing into atomic globals: with any number of workers
+// no update may be lost, so every engine must return what the evaluator,
+// which runs the loop in order, returns.
+
+#define MAX_THREADS 8
+
+static ASTNode *atomicGlobal(const char *var){
+    return createDeclarationNode(name("longlong"), var, literal(TYPE_LONG_LONG, 0), STORAGE_ATOMIC);
+}
+
+// atomic longlong total, seen;
+// int sum(int n){ parallel for(int i = 0; i < n; i++){ total += i * i; seen |= 1 << i % 40; } return 0; }
+static ASTNode *reduction(void){
+    ASTNode *loop = forLoop(declare("int", "i", integer(0)), binary(name("i"), LESS_BINOP, name("n")), increment("i"),
+        block(2,
+            update(name("total"), ADD_AND_ASSIGN, binary(name("i"), MUL_BINOP, name("i"))),
+            update(name("seen"), OR_AND_ASSIGN, binary(literal(TYPE_LONG_LONG, 1), SHIFT_LEFT_BINOP, binary(name("i"), MOD_BINOP, integer(40))))));
+    loop->forStmt.parallel = true;
+    ASTNode *sum = function("sum", 1, "n", block(2, loop, returns(integer(0))));
+    // longlong twice(int n){ sum(n); sum(n); return total; }, the second call
+    // adding to what the first left
+    ASTNode *twice = function("twice", 1, "n", block(3, call("sum", 1, name("n")), call("sum", 1, name("n")), returns(name("total"))));
+    // longlong bits(int n){ sum(n); return seen; }
+    ASTNode *bits = function("bits", 1, "n", block(2, call("sum", 1, name("n")), returns(name("seen"))));
+    freeAST(twice->functionDef.returnType);
+    twice->functionDef.returnType = name("longlong");
+    freeAST(bits->functionDef.returnType);
+    bits->functionDef.returnType = name("longlong");
+    return block(5, atomicGlobal("total"), atomicGlobal("seen"), sum, twice, bits);
+}
+
+// The sum of the squares below n.
+static long long squares(long long n){
+    return (n - 1) * n * (2 * n - 1) / 6;
+}
+
+int main(void){
+    ASTNode *program = reduction();
+
+    // i * i is an int, so the largest count keeps it below 2^31
+    long long counts[] = {0, 1, 7, 1000, 40000};
+    for(int threads = 1; threads <= MAX_THREADS; threads *= 2){
+        setEngineThreads(threads);
+        for(size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++){
+            char test[96];
+            snprintf(test, sizeof(test), "sum of %lld squares on %d threads", counts[i], threads);
+            expectOnEveryEngine(test, program, NULL, "twice", &counts[i], 1, 2 * squares(counts[i]));
+            long long bits = counts[i] >= 40 ? (1LL << 40) - 1 : (1LL << counts[i]) - 1;
+            snprintf(test, sizeof(test), "bits of %lld iterations on %d threads", counts[i], threads);
+            expectOnEveryEngine(test, program, NULL, "bits", &counts[i], 1, bits);
+        }
+    }
+    setEngineThreads(0);
+    freeAST(program);
+    return finishTests();
+}
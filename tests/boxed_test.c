@@ -0,0 +1,135 @@
+#include "boxed.h"
+#include "harness.h"
+#include "primitive.h"
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Every primitive type boxed and unboxed again: the type and the bits must
+// come back, integers must go out of line exactly past 43 bits, and copies
+// of out-of-line values must equal the original.
+
+#define INLINE_LIMIT (1LL << 42)
+
+static bool sameValue(PrimitiveType type, PrimitiveValue a, PrimitiveValue b){
+    if(type == TYPE_LONG_DOUBLE) return a.longDoubleVal == b.longDoubleVal;
+    if(type == TYPE_DOUBLE && isnan(a.doubleVal)) return isnan(b.doubleVal);
+    return memcmp(&a, &b, primitiveSize(type)) == 0;
+}
+
+// outOfLine is 1 or 0 when where the value goes is known, -1 otherwise.
+static void roundTrip(const char *what, PrimitiveType type, PrimitiveValue value, int outOfLine){
+    char test[96];
+    snprintf(test, sizeof(test), "%s %s", primitiveTypeName(type), what);
+    Box box;
+    BoxedValue boxed = boxPrimitive(type, value, &box);
+    PrimitiveValue back = unboxPrimitive(boxed);
+    expectThat(test, boxedType(boxed) == type, "the type changed");
+    expectThat(test, sameValue(type, value, back), "the value changed");
+    if(outOfLine >= 0) expectThat(test, isBoxedOutOfLine(boxed) == (outOfLine == 1), outOfLine ? "stayed inline" : "went out of line");
+
+    BoxedValue copy;
+    bool copied = copyBoxed(boxed, &copy);
+    expectThat(test, copied && boxedEquals(boxed, copy) && hashBoxed(0, boxed) == hashBoxed(0, copy), "the copy differs");
+    if(copied){
+        expectThat(test, sameValue(type, value, unboxPrimitive(copy)), "the copy's value changed");
+        freeBoxed(copy);
+    }
+}
+
+static PrimitiveValue fromBits(PrimitiveType type, unsigned long long bits){
+    PrimitiveValue value;
+    memset(&value, 0, sizeof(value));
+    memcpy(&value, &bits, primitiveSize(type));
+    return value;
+}
+
+// Zero, one, all ones, both ends of the signed range and both sides of
+// the 43-bit limits, each cut to the type's width.
+static void integers(void){
+    for(int t = 0; t < PRIMITIVE_TYPE_COUNT; t++){
+        PrimitiveType type = (PrimitiveType)t;
+        if(!isIntegerType(type)) continue;
+        if(type == TYPE_BOOL){
+            roundTrip("false", type, fromBits(type, 0), 0);
+            roundTrip("true", type, fromBits(type, 1), 0);
+            continue;
+        }
+
+        int width = (int)primitiveSize(type) * 8;
+        unsigned long long mask = width == 64 ? ~0ULL : (1ULL << width) - 1;
+        unsigned long long candidates[] = {
+            0, 1, mask, mask >> 1, (mask >> 1) + 1,
+            INLINE_LIMIT - 1, INLINE_LIMIT, (unsigned long long)-INLINE_LIMIT, (unsigned long long)(-INLINE_LIMIT - 1)
+        };
+        for(size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++){
+            unsigned long long bits = candidates[i] & mask;
+            bool fits;
+            char what[64];
+            if(isSignedType(type)){
+                // sign extend from the type's width
+                long long n = width == 64 ? (long long)bits : (long long)(bits << (64 - width)) >> (64 - width);
+                fits = n >= -INLINE_LIMIT && n < INLINE_LIMIT;
+                snprintf(what, sizeof(what), "%lld", n);
+            } else{
+                // the value goes through long long, so the top of a 64-bit
+                // type wraps to small negative numbers that fit
+                long long n = (long long)bits;
+                fits = width == 64 ? n >= -INLINE_LIMIT && n < INLINE_LIMIT : bits < (unsigned long long)INLINE_LIMIT;
+                snprintf(what, sizeof(what), "%llu", bits);
+            }
+            roundTrip(what, type, fromBits(type, bits), !fits);
+        }
+    }
+
+    // an address held as an integer is past 43 bits
+    static int somewhere;
+    roundTrip("address", TYPE_UNSIGNED_ARCH, (PrimitiveValue){.uArchVal = (uintptr_t)&somewhere}, 1);
+}
+
+static void floats(void){
+    float floats[] = {0.0f, -0.0f, 1.5f, FLT_MIN / 4, FLT_MAX, -INFINITY, NAN};
+    for(size_t i = 0; i < sizeof(floats) / sizeof(floats[0]); i++){
+        char what[32];
+        snprintf(what, sizeof(what), "%g", floats[i]);
+        roundTrip(what, TYPE_FLOAT, (PrimitiveValue){.floatVal = floats[i]}, 0);
+    }
+
+    double doubles[] = {0.0, -0.0, 1e300, DBL_MIN / 4, -INFINITY, NAN, -NAN};
+    for(size_t i = 0; i < sizeof(doubles) / sizeof(doubles[0]); i++){
+        char what[32];
+        snprintf(what, sizeof(what), "%g", doubles[i]);
+        roundTrip(what, TYPE_DOUBLE, (PrimitiveValue){.doubleVal = doubles[i]}, 0);
+    }
+    Box box;
+    BoxedValue zero = boxPrimitive(TYPE_DOUBLE, (PrimitiveValue){.doubleVal = 0.0}, &box);
+    BoxedValue negativeZero = boxPrimitive(TYPE_DOUBLE, (PrimitiveValue){.doubleVal = -0.0}, &box);
+    expectThat("double 0.0 and -0.0", !boxedEquals(zero, negativeZero), "compared equal");
+    BoxedValue nan = boxPrimitive(TYPE_DOUBLE, (PrimitiveValue){.doubleVal = NAN}, &box);
+    BoxedValue negativeNan = boxPrimitive(TYPE_DOUBLE, (PrimitiveValue){.doubleVal = -NAN}, &box);
+    expectThat("double NaNs", boxedEquals(nan, negativeNan), "were not folded into one");
+
+    long double longDoubles[] = {0.0L, 1.0L / 3, -LDBL_MAX};
+    for(size_t i = 0; i < sizeof(longDoubles) / sizeof(longDoubles[0]); i++){
+        char what[32];
+        snprintf(what, sizeof(what), "%Lg", longDoubles[i]);
+        roundTrip(what, TYPE_LONG_DOUBLE, (PrimitiveValue){.longDoubleVal = longDoubles[i]}, 1);
+    }
+}
+
+static void pointers(void){
+    static char text[] = "text";
+    roundTrip("pointer", TYPE_STRING, (PrimitiveValue){.stringVal = text}, 0);
+    roundTrip("NULL", TYPE_STRING, (PrimitiveValue){.stringVal = NULL}, 0);
+    // never dereferenced; a pointer past 48 bits needs a box
+    roundTrip("pointer past 48 bits", TYPE_STRING, (PrimitiveValue){.stringVal = (char *)(uintptr_t)0xFFFF800000001000ULL}, 1);
+}
+
+int main(void){
+    integers();
+    floats();
+    pointers();
+    return finishTests();
+}
@@ -0,0 +1,177 @@
+#include "builders.h"
+#include "primitive.h"
+#include <stdarg.h>
+#include <stdlib.h>
+
+#define MAX_LIST 64
+
+ASTNode *integer(long long value){
+    return literal(TYPE_INT, value);
+}
+
+ASTNode *literal(PrimitiveType type, long long value){
+    return createLiteralNode(type, primitiveFromLongLong(type, value));
+}
+
+ASTNode *name(const char *identifier){
+    return createIdentifierNode(identifier);
+}
+
+ASTNode *binary(ASTNode *left, BinaryOpType op, ASTNode *right){
+    return createBinaryOpNode(left, right, op);
+}
+
+ASTNode *unary(UnaryOpType op, ASTNode *operand){
+    return createUnaryOpNode(operand, op);
+}
+
+ASTNode *ternary(ASTNode *condition, ASTNode *whenTrue, ASTNode *whenFalse){
+    return createTernaryOpNode(condition, whenTrue, whenFalse);
+}
+
+ASTNode *assign(ASTNode *target, ASTNode *value){
+    return createAssignmentNode(target, value, SIMPLE_ASSIGN);
+}
+
+ASTNode *update(ASTNode *target, AssignmentOpType op, ASTNode *value){
+    return createAssignmentNode(target, value, op);
+}
+
+ASTNode *increment(const char *variable){
+    return createUnaryOpNode(name(variable), POST_INCREMENT_UNOP);
+}
+
+ASTNode *element(ASTNode *array, ASTNode *index){
+    return createArrayAccessNode(array, index);
+}
+
+ASTNode *field(ASTNode *object, const char *fieldName){
+    return createFieldAccessNode(object, (char *)fieldName, false);
+}
+
+ASTNode *call(const char *function, int argCount, ...){
+    ASTNode *args[MAX_LIST];
+    va_list list;
+    va_start(list, argCount);
+    for(int i = 0; i < argCount; i++){
+        args[i] = va_arg(list, ASTNode *);
+    }
+    va_end(list);
+    return createFunctionCallNode(name(function), args, argCount);
+}
+
+ASTNode *declare(const char *type, const char *variable, ASTNode *initializer){
+    return createDeclarationNode(name(type), variable, initializer, 0);
+}
+
+ASTNode *declareArray(const char *type, int length, const char *variable){
+    return createDeclarationNode(createArrayNode(name(type), integer(length), NULL, 0), variable, NULL, 0);
+}
+
+ASTNode *declarePointer(const char *type, const char *variable, ASTNode *initializer){
+    return createDeclarationNode(createPointerNode(name(type)), variable, initializer, 0);
+}
+
+ASTNode *allocate(ASTNode *size){
+    return createMallocExprNode(size);
+}
+
+ASTNode *release(ASTNode *pointer){
+    return createFreeExprNode(pointer);
+}
+
+// The struct keeps the field list.
+ASTNode *structure(const char *structName, int fieldCount, ...){
+    ASTNode **fields = malloc((fieldCount ? fieldCount : 1) * sizeof(ASTNode *));
+    va_list list;
+    va_start(list, fieldCount);
+    for(int i = 0; i < fieldCount; i++){
+        fields[i] = declare("int", va_arg(list, const char *), NULL);
+    }
+    va_end(list);
+    return createStructNode((char *)structName, fields, fieldCount);
+}
+
+// The body's statements become the function's, without the block around them.
+ASTNode *function(const char *functionName, int paramCount, ...){
+    ASTNode *params[MAX_LIST];
+    va_list list;
+    va_start(list, paramCount);
+    for(int i = 0; i < paramCount; i++){
+        params[i] = declare("int", va_arg(list, const char *), NULL);
+    }
+    ASTNode *body = va_arg(list, ASTNode *);
+    va_end(list);
+
+    ASTNode *node = createFunctionNode((char *)functionName, name("int"), params, paramCount, body->block.statements, body->block.stmtCount, 0);
+    free(body->block.statements);
+    free(body);
+    return node;
+}
+
+ASTNode *block(int count, ...){
+    ASTNode *statements[MAX_LIST];
+    va_list list;
+    va_start(list, count);
+    for(int i = 0; i < count; i++){
+        statements[i] = va_arg(list, ASTNode *);
+    }
+    va_end(list);
+    return createBlockNode(statements, count);
+}
+
+ASTNode *compound(int count, ...){
+    ASTNode *statements[MAX_LIST];
+    va_list list;
+    va_start(list, count);
+    for(int i = 0; i < count; i++){
+        statements[i] = va_arg(list, ASTNode *);
+    }
+    va_end(list);
+    return createCompoundExprNode(statements, count);
+}
+
+ASTNode *returns(ASTNode *value){
+    return createReturnNode(value);
+}
+
+ASTNode *ifElse(ASTNode *condition, ASTNode *then, ASTNode *otherwise){
+    return createIfStmtNode(condition, then, otherwise);
+}
+
+ASTNode *whileLoop(ASTNode *condition, ASTNode *body){
+    return createWhileStmtNode(condition, &body, 1);
+}
+
+ASTNode *doWhile(ASTNode *body, ASTNode *condition){
+    return createDoWhileStmtNode(&body, 1, condition);
+}
+
+ASTNode *forLoop(ASTNode *initializer, ASTNode *condition, ASTNode *step, ASTNode *body){
+    return createForStmtNode(initializer, condition, step, &body, 1);
+}
+
+ASTNode *breaks(void){
+    return createBreakStmtNode();
+}
+
+ASTNode *continues(void){
+    return createContinueStmtNode();
+}
+
+ASTNode *label(const char *labelName){
+    return createLabelNode((char *)labelName);
+}
+
+ASTNode *jump(const char *labelName){
+    return createJumpNode((char *)labelName);
+}
+
+ASTNode *tryCatch(ASTNode *body, ASTNode *exception, ASTNode *handler){
+    ASTNode *clause = createCatchStmtNode(exception, &handler, 1);
+    return createTryStmtNode(&body, 1, &clause, 1);
+}
+
+ASTNode *throws(ASTNode *value){
+    return createThrowStmtNode(value);
+}
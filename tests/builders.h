@@ -0,0 +1,52 @@
+#ifndef BUILDERS_H
+#define BUILDERS_H
+
+#include "ast.h"
+
+// Short constructors for the programs tests and benchmarks run, since the
+// parser does not read declarations or functions yet. Statement bodies are
+// single statements, usually a block; the trees are freed with freeAST.
+
+ASTNode *integer(long long value);
+ASTNode *literal(PrimitiveType type, long long value);
+ASTNode *name(const char *identifier);
+ASTNode *binary(ASTNode *left, BinaryOpType op, ASTNode *right);
+ASTNode *unary(UnaryOpType op, ASTNode *operand);
+ASTNode *ternary(ASTNode *condition, ASTNode *whenTrue, ASTNode *whenFalse);
+ASTNode *assign(ASTNode *target, ASTNode *value);
+ASTNode *update(ASTNode *target, AssignmentOpType op, ASTNode *value);
+ASTNode *increment(const char *variable);
+ASTNode *element(ASTNode *array, ASTNode *index);
+// object.fieldName
+ASTNode *field(ASTNode *object, const char *fieldName);
+ASTNode *call(const char *function, int argCount, ...);
+
+ASTNode *declare(const char *type, const char *variable, ASTNode *initializer);
+ASTNode *declareArray(const char *type, int length, const char *variable);
+// type *variable = initializer
+ASTNode *declarePointer(const char *type, const char *variable, ASTNode *initializer);
+ASTNode *allocate(ASTNode *size);
+ASTNode *release(ASTNode *pointer);
+// struct structName { int ... }, with fieldCount field names after it.
+ASTNode *structure(const char *structName, int fieldCount, ...);
+// An int function whose parameters are paramCount int names, then its body.
+ASTNode *function(const char *functionName, int paramCount, ...);
+
+ASTNode *block(int count, ...);
+// ({ ... }), whose last statement gives its value.
+ASTNode *compound(int count, ...);
+ASTNode *returns(ASTNode *value);
+ASTNode *ifElse(ASTNode *condition, ASTNode *then, ASTNode *otherwise);
+ASTNode *whileLoop(ASTNode *condition, ASTNode *body);
+ASTNode *doWhile(ASTNode *body, ASTNode *condition);
+ASTNode *forLoop(ASTNode *initializer, ASTNode *condition, ASTNode *step, ASTNode *body);
+ASTNode *breaks(void);
+ASTNode *continues(void);
+ASTNode *label(const char *labelName);
+ASTNode *jump(const char *labelName);
+// try body catch(exception) handler; exception is a declaration, or NULL
+// to catch anything.
+ASTNode *tryCatch(ASTNode *body, ASTNode *exception, ASTNode *handler);
+ASTNode *throws(ASTNode *value);
+
+#endif
@@ -0,0 +1,59 @@
+#include "deadcode.h"
+#include "builders.h"
+#include "harness.h"
+#include <stddef.h>
+
+// Programs dead-code elimination once changed, run on every engine before
+// and after the pass.
+
+static ASTNode *eliminate(ASTNode *program){
+    DeadCodeStats stats;
+    return eliminateDeadCode(program, &stats);
+}
+
+// do { ... } while(0) runs its body once, but a continue anywhere in it,
+// even nested, goes to the condition and leaves the loop. Flattening it
+// would bind that continue to the loop around it instead.
+static void nestedContinueInDoWhileZero(void){
+    ASTNode *program = block(1, function("f", 1, "n", block(3,
+        declare("int", "s", integer(0)),
+        forLoop(declare("int", "i", integer(0)), binary(name("i"), LESS_BINOP, name("n")), increment("i"), block(2,
+            doWhile(block(2,
+                ifElse(binary(name("i"), EQU_BINOP, integer(2)), continues(), NULL),
+                update(name("s"), ADD_AND_ASSIGN, integer(10))), integer(0)),
+            update(name("s"), ADD_AND_ASSIGN, integer(1)))),
+        returns(name("s")))));
+    long long n = 5;
+    expectOnEveryEngine("nested continue in do-while(0)", program, eliminate, "f", &n, 1, 45);
+    freeAST(program);
+
+    // Deeper, inside a block inside an if.
+    program = block(1, function("f", 1, "n", block(3,
+        declare("int", "s", integer(0)),
+        whileLoop(binary(name("n"), GREATER_BINOP, integer(0)), block(3,
+            update(name("n"), SUB_AND_ASSIGN, integer(1)),
+            doWhile(block(1,
+                ifElse(binary(name("n"), MOD_BINOP, integer(2)),
+                    block(2, update(name("s"), ADD_AND_ASSIGN, integer(100)), continues()),
+                    block(1, update(name("s"), ADD_AND_ASSIGN, integer(10))))), integer(0)),
+            update(name("s"), ADD_AND_ASSIGN, integer(1)))),
+        returns(name("s")))));
+    expectOnEveryEngine("continue nested in an if in do-while(0)", program, eliminate, "f", &n, 1, 235);
+    freeAST(program);
+
+    // A continue of an inner loop does not keep the do-while.
+    program = block(1, function("f", 1, "n", block(3,
+        declare("int", "s", integer(0)),
+        doWhile(block(1,
+            forLoop(declare("int", "i", integer(0)), binary(name("i"), LESS_BINOP, name("n")), increment("i"), block(2,
+                ifElse(binary(name("i"), EQU_BINOP, integer(1)), continues(), NULL),
+                update(name("s"), ADD_AND_ASSIGN, name("i"))))), integer(0)),
+        returns(name("s")))));
+    expectOnEveryEngine("inner loop continue in do-while(0)", program, eliminate, "f", &n, 1, 9);
+    freeAST(program);
+}
+
+int main(void){
+    nestedContinueInDoWhileZero();
+    return finishTests();
+}
@@ -0,0 +1,304 @@
+#include "cse.h"
+#include "deadcode.h"
+#include "escape.h"
+#include "eval.h"
+#include "fold.h"
+#include "inline.h"
+#include "ir.h"
+#include "loop.h"
+#include "primitive.h"
+#include "purity.h"
+#include "range.h"
+#include "tailcall.h"
+#include "builders.h"
+#include "harness.h"
+#include <stdio.h>
+
+// Seeded random programs run on every engine, as built and after the
+// optimization passes, plus programs that once came out differently.
+
+#define PROGRAMS 300
+
+static unsigned long long seed;
+
+static int randomBelow(int n){
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return (int)(seed % (unsigned long long)n);
+}
+
+static const char *const variables[] = {"a", "b", "c", "d", "e", "g"};
+
+static ASTNode *randomExpression(int depth, int visible, bool helper);
+
+// Comparisons and logical operators give bool, which only some engines take
+// as an operand of unary and bitwise operators, so their results are added
+// to an int first.
+static ASTNode *randomCondition(int depth, int visible, bool helper){
+    ASTNode *condition;
+    switch(randomBelow(5)){
+        case 0: condition = binary(randomExpression(depth, visible, helper), AND_BINOP, randomExpression(depth, visible, helper)); break;
+        case 1: condition = binary(randomExpression(depth, visible, helper), OR_BINOP, randomExpression(depth, visible, helper)); break;
+        case 2: condition = binary(randomExpression(depth, visible, helper), LESS_BINOP + randomBelow(4), randomExpression(depth, visible, helper)); break;
+        case 3: condition = binary(randomExpression(depth, visible, helper), EQU_BINOP + randomBelow(2), randomExpression(depth, visible, helper)); break;
+        default: condition = unary(NOT_UNOP, randomExpression(depth, visible, helper)); break;
+    }
+    return binary(condition, ADD_BINOP, integer(randomBelow(3)));
+}
+
+// Reads only the first visible variables. Values stay small enough that
+// nothing overflows: multiplication is only by a small literal, and
+// assignments mask what they store.
+static ASTNode *randomExpression(int depth, int visible, bool helper){
+    if(depth == 0 || randomBelow(4) == 0){
+        if(randomBelow(3) == 0) return integer(randomBelow(7) - 3);
+        return name(variables[randomBelow(visible)]);
+    }
+    switch(randomBelow(helper ? 10 : 9)){
+        case 0: return binary(randomExpression(depth - 1, visible, helper), ADD_BINOP, randomExpression(depth - 1, visible, helper));
+        case 1: return binary(randomExpression(depth - 1, visible, helper), SUB_BINOP, randomExpression(depth - 1, visible, helper));
+        case 2: return binary(randomExpression(depth - 1, visible, helper), MUL_BINOP, integer(randomBelow(7) - 3));
+        case 3:
+        case 4: return randomCondition(depth - 1, visible, helper);
+        case 5: return ternary(randomExpression(depth - 1, visible, helper), randomExpression(depth - 1, visible, helper), randomExpression(depth - 1, visible, helper));
+        case 6: return binary(randomExpression(depth - 1, visible, helper), BIT_AND_BINOP + randomBelow(3), randomExpression(depth - 1, visible, helper));
+        case 7: return unary(NEGATIVE_UNOP + 2 * randomBelow(2), randomExpression(depth - 1, visible, helper));
+        case 8: return binary(integer(randomBelow(5) * 10), ADD_BINOP, randomExpression(depth - 1, visible, helper));
+        default: return call("h", 2, randomExpression(depth - 1, visible, false), randomExpression(depth - 1, visible, false));
+    }
+}
+
+static ASTNode *masked(ASTNode *value){
+    return binary(value, BIT_AND_BINOP, integer(1023));
+}
+
+static ASTNode *randomStatement(void){
+    const char *target = variables[randomBelow(6)];
+    switch(randomBelow(4)){
+        case 0: return assign(name(target), masked(randomExpression(3, 6, true)));
+        case 1: return ifElse(randomCondition(1, 6, true),
+                              block(1, assign(name(target), masked(randomExpression(2, 6, true)))),
+                              block(1, assign(name(variables[randomBelow(6)]), masked(randomExpression(2, 6, true)))));
+        case 2: return forLoop(declare("int", "i", integer(0)), binary(name("i"), LESS_BINOP, integer(randomBelow(4))), increment("i"),
+                               block(1, assign(name(target), masked(binary(name(target), ADD_BINOP, randomExpression(2, 6, true))))));
+        default: return whileLoop(binary(name(target), GREATER_BINOP, integer(randomBelow(200))),
+                                  block(1, assign(name(target), binary(name(target), SUB_BINOP, binary(integer(1), ADD_BINOP, binary(name(target), BIT_AND_BINOP, integer(7)))))));
+    }
+}
+
+static ASTNode *randomProgram(void){
+    ASTNode *helper = function("h", 2, "x", "y", block(1,
+        returns(binary(binary(name("x"), ADD_BINOP, name("y")), BIT_AND_BINOP, integer(63)))));
+    ASTNode *f = function("f", 3, "a", "b", "c", block(7,
+        declare("int", "d", randomExpression(2, 3, false)),
+        declare("int", "e", randomExpression(2, 4, false)),
+        declare("int", "g", randomExpression(2, 5, true)),
+        randomStatement(),
+        randomStatement(),
+        randomStatement(),
+        returns(randomExpression(3, 6, true))));
+    return block(2, helper, f);
+}
+
+static ASTNode *optimize(ASTNode *program){
+    FoldStats fold;
+    DeadCodeStats deadCode;
+    LoopStats loops;
+    CSEStats cse;
+    RangeStats ranges;
+    EscapeReport escapes = {0};
+    PurityStats purity;
+    TailCallStats tailCalls;
+    InlineOptions options = defaultInlineOptions();
+    InlineReport report = {0};
+
+    program = foldConstants(program, &fold);
+    program = inlineFunctions(program, &options, &report);
+    freeInlineReport(&report);
+    program = eliminateDeadCode(program, &deadCode);
+    program = optimizeLoops(program, &loops);
+    program = eliminateCommonSubexpressions(program, &cse);
+    program = eliminateBoundsChecks(program, &ranges);
+    program = analyzeEscapes(program, &escapes);
+    freeEscapeReport(&escapes);
+    program = analyzePurity(program, &purity);
+    return eliminateTailCalls(program, &tailCalls);
+}
+
+// Lowers the program to SSA and runs the IR verifier on every function.
+static bool verifiesAsIR(const char *test, ASTNode *program){
+    char error[256] = "lowering to IR failed";
+    IRModule *module = lowerToIR(program);
+    bool ok = module && verifyIRModule(module, error, sizeof(error));
+    freeIRModule(module);
+    return expectThat(test, ok, error);
+}
+
+// Calls f twice on one evaluator; false when either call fails.
+static bool callTwice(ASTNode *program, bool memoize, const Value *args, int argCount, long long results[2], EvalStats *stats){
+    EvalOptions options = defaultEvalOptions();
+    options.memoize = memoize;
+    Evaluator *e = createEvaluator(program, &options);
+    Value result;
+    bool ok = e && runProgram(e, &result);
+    for(int i = 0; ok && i < 2; i++){
+        ok = callFunction(e, "f", args, argCount, &result) && primitiveToLongLong(result.type, result.as.primitive, &results[i]);
+    }
+    if(ok) *stats = *evalStats(e);
+    freeEvaluator(e);
+    return ok;
+}
+
+// The evaluator must return the same with memoization as without, both on
+// a first call and on a repeat the cache answers.
+static void sameWhenMemoized(const char *test, ASTNode *optimized, const long long *args, int argCount){
+    Value values[3];
+    for(int i = 0; i < argCount; i++){
+        values[i] = makePrimitiveValue(TYPE_INT, primitiveFromLongLong(TYPE_INT, args[i]));
+    }
+    long long plain[2], memoized[2];
+    EvalStats plainStats, memoStats;
+    bool plainOk = callTwice(optimized, false, values, argCount, plain, &plainStats);
+    bool memoOk = callTwice(optimized, true, values, argCount, memoized, &memoStats);
+    char detail[128];
+    snprintf(detail, sizeof(detail), "memoized %s %lld, %lld; unmemoized %s %lld, %lld",
+             memoOk ? "gave" : "failed", memoized[0], memoized[1], plainOk ? "gave" : "failed", plain[0], plain[1]);
+    bool same = plainOk == memoOk && (!plainOk || (plain[0] == memoized[0] && plain[1] == memoized[1]));
+    expectThat(test, same, detail);
+    // f is pure, so the repeat must come from the cache
+    if(same && plainOk) expectThat(test, memoStats.memoHits > 0 && plainStats.memoHits == 0, "the repeat call was not memoized");
+}
+
+// int a = 1, d = 0, f = -1; return a * 10 + (d || f);
+// The register VM once tested a temporary its branch never wrote.
+static void shortCircuitInArithmetic(void){
+    ASTNode *program = block(1, function("f", 0, block(4,
+        declare("int", "a", integer(1)),
+        declare("int", "d", integer(0)),
+        declare("int", "f", integer(-1)),
+        returns(binary(binary(name("a"), MUL_BINOP, integer(10)), ADD_BINOP, binary(name("d"), OR_BINOP, name("f")))))));
+    expectOnEveryEngine("short circuit in arithmetic", program, NULL, "f", NULL, 0, 11);
+    freeAST(program);
+
+    // The && form, and both nested inside another operand.
+    program = block(1, function("f", 2, "x", "y", block(1,
+        returns(binary(binary(name("x"), MUL_BINOP, integer(10)), ADD_BINOP,
+                       binary(binary(name("x"), AND_BINOP, name("y")), SUB_BINOP, binary(name("y"), OR_BINOP, name("x"))))))));
+    for(long long x = -1; x <= 1; x++){
+        for(long long y = -1; y <= 1; y++){
+            long long args[] = {x, y};
+            sameOnEveryEngine("short circuit operands", program, NULL, "f", args, 2);
+        }
+    }
+    freeAST(program);
+}
+
+// Sizes are no limit, so callees that grew by inlining are inlined too.
+static ASTNode *inlineAll(ASTNode *program){
+    InlineOptions options = defaultInlineOptions();
+    options.maxCalleeSize = 1000;
+    options.maxCallerSize = 10000;
+    InlineReport report;
+    program = inlineFunctions(program, &options, &report);
+    freeInlineReport(&report);
+    return program;
+}
+
+// sign returns early, so each expansion of it ends in a label. twice gets
+// two of those from its own inlining, and every copy of twice needs its
+// labels renamed again.
+static void nestedEarlyReturns(void){
+    ASTNode *sign = function("sign", 1, "x", block(3,
+        ifElse(binary(name("x"), LESS_BINOP, integer(0)), returns(integer(-1)), NULL),
+        ifElse(binary(name("x"), GREATER_BINOP, integer(0)), returns(integer(1)), NULL),
+        returns(integer(0))));
+    ASTNode *twice = function("twice", 1, "x", block(1,
+        returns(binary(call("sign", 1, name("x")), ADD_BINOP, call("sign", 1, binary(name("x"), SUB_BINOP, integer(3)))))));
+    ASTNode *f = function("f", 1, "a", block(1,
+        returns(binary(binary(call("twice", 1, name("a")), MUL_BINOP, integer(10)), ADD_BINOP, call("twice", 1, binary(name("a"), ADD_BINOP, integer(5)))))));
+    ASTNode *program = block(3, sign, twice, f);
+
+    const long long args[] = {-4, 1, 4};
+    const long long expected[] = {-20, 2, 22};
+    for(int i = 0; i < 3; i++){
+        expectOnEveryEngine("nested early returns", program, inlineAll, "f", &args[i], 1, expected[i]);
+    }
+    freeAST(program);
+}
+
+// An early return inlined into a loop body jumps out of the expansion on
+// some iterations only.
+static void earlyReturnInLoop(void){
+    ASTNode *clamp = function("clamp", 1, "x", block(2,
+        ifElse(binary(name("x"), GREATER_BINOP, integer(5)), returns(integer(5)), NULL),
+        returns(name("x"))));
+    ASTNode *f = function("f", 1, "n", block(3,
+        declare("int", "s", integer(0)),
+        forLoop(declare("int", "i", integer(0)), binary(name("i"), LESS_BINOP, name("n")), increment("i"),
+            block(1, update(name("s"), ADD_AND_ASSIGN, call("clamp", 1, name("i"))))),
+        returns(name("s"))));
+    ASTNode *program = block(2, clamp, f);
+    long long n = 10;
+    expectOnEveryEngine("early return in a loop", program, inlineAll, "f", &n, 1, 35);
+    freeAST(program);
+}
+
+// The shape inlining gives a function with early returns: a goto to a
+// label later in the same compound expression. The evaluator, the stack VM
+// and closures each once lost the jump or its value.
+static void jumpsInCompoundExpressions(void){
+    ASTNode *program = block(1, function("f", 1, "x", block(1,
+        returns(binary(integer(1), ADD_BINOP, compound(5,
+            declare("int", "r", NULL),
+            ifElse(binary(name("x"), GREATER_BINOP, integer(0)), block(2, assign(name("r"), integer(10)), jump("done")), NULL),
+            assign(name("r"), integer(20)),
+            label("done"),
+            name("r")))))));
+    long long positive = 3, negative = -3;
+    expectOnEveryEngine("goto within a compound expression", program, NULL, "f", &positive, 1, 11);
+    expectOnEveryEngine("goto within a compound expression", program, NULL, "f", &negative, 1, 21);
+    freeAST(program);
+
+    // Out of an inner compound to a label of the one around it.
+    program = block(1, function("f", 1, "x", block(1,
+        returns(compound(5,
+            declare("int", "r", integer(1)),
+            assign(name("r"), binary(name("r"), ADD_BINOP, compound(2,
+                ifElse(binary(name("x"), GREATER_BINOP, integer(5)), jump("out"), NULL),
+                integer(3)))),
+            update(name("r"), ADD_AND_ASSIGN, integer(100)),
+            label("out"),
+            name("r"))))));
+    long long small = 2, large = 7;
+    expectOnEveryEngine("goto out of an inner compound expression", program, NULL, "f", &small, 1, 104);
+    expectOnEveryEngine("goto out of an inner compound expression", program, NULL, "f", &large, 1, 1);
+    freeAST(program);
+}
+
+int main(void){
+    shortCircuitInArithmetic();
+    nestedEarlyReturns();
+    earlyReturnInLoop();
+    jumpsInCompoundExpressions();
+
+    for(int i = 0; i < PROGRAMS; i++){
+        char test[64];
+        seed = 0x9E3779B97F4A7C15ULL + (unsigned long long)i * 7919;
+        ASTNode *program = randomProgram();
+        long long args[] = {randomBelow(7) - 3, randomBelow(7) - 3, randomBelow(200)};
+        snprintf(test, sizeof(test), "random program %d", i);
+        if(sameOnEveryEngine(test, program, NULL, "f", args, 3)){
+            sameOnEveryEngine(test, program, optimize, "f", args, 3);
+        }
+        // The IR must verify for the program as built and as optimized.
+        ASTNode *optimized = optimize(cloneAST(program));
+        verifiesAsIR(test, program);
+        verifiesAsIR(test, optimized);
+        sameWhenMemoized(test, optimized, args, 3);
+        freeAST(optimized);
+        freeAST(program);
+    }
+
+    return finishTests();
+}
@@ -0,0 +1,121 @@
+#include "escape.h"
+#include "builders.h"
+#include "harness.h"
+#include <stdio.h>
+#include <string.h>
+
+// Which allocations escape analysis moves off the heap, and that the
+// programs return the same with and without the move.
+
+static ASTNode *promote(ASTNode *program){
+    EscapeReport report;
+    program = analyzeEscapes(program, &report);
+    freeEscapeReport(&report);
+    return program;
+}
+
+// Analyzes a copy of program and checks where variable in function ended
+// up: expected is ALLOC_HEAP when it must not have been demoted.
+static void expectPlacement(const char *test, ASTNode *program, const char *function, const char *variable, AllocationKind expected){
+    ASTNode *copy = cloneAST(program);
+    EscapeReport report;
+    copy = analyzeEscapes(copy, &report);
+    AllocationKind placement = ALLOC_HEAP;
+    for(int i = 0; i < report.demotionCount; i++){
+        EscapeDemotion *demotion = &report.demotions[i];
+        if(strcmp(demotion->function, function) == 0 && strcmp(demotion->variable, variable) == 0) placement = demotion->placement;
+    }
+    char detail[128];
+    snprintf(detail, sizeof(detail), "%s in %s went to the %s, expected the %s", variable, function,
+             allocationKindName(placement), allocationKindName(expected));
+    expectThat(test, placement == expected, detail);
+    freeEscapeReport(&report);
+    freeAST(copy);
+}
+
+// int *p = malloc(size); p[0] = n; p[1] = n * 2; ...; free(p); return s
+static ASTNode *localBuffer(ASTNode *size, ASTNode *between){
+    return block(6,
+        declarePointer("int", "p", allocate(size)),
+        assign(element(name("p"), integer(0)), name("n")),
+        assign(element(name("p"), integer(1)), binary(name("n"), MUL_BINOP, integer(2))),
+        between ? between : block(0),
+        declare("int", "s", binary(element(name("p"), integer(0)), ADD_BINOP, element(name("p"), integer(1)))),
+        block(2, release(name("p")), returns(name("s"))));
+}
+
+static void localOnly(void){
+    ASTNode *program = block(1, function("f", 1, "n", localBuffer(integer(16), NULL)));
+    long long n = 7;
+    expectPlacement("buffer used only locally", program, "f", "p", ALLOC_STACK);
+    expectOnEveryEngine("buffer used only locally", program, promote, "f", &n, 1, 21);
+    freeAST(program);
+
+    // too big for the frame, so it only leaves the heap for a region
+    program = block(1, function("f", 1, "n", localBuffer(integer(8192), NULL)));
+    expectPlacement("large local buffer", program, "f", "p", ALLOC_REGION);
+    expectOnEveryEngine("large local buffer", program, promote, "f", &n, 1, 21);
+    freeAST(program);
+
+    // a buffer per iteration is released with the iteration
+    program = block(1, function("f", 1, "n", block(3,
+        declare("int", "t", integer(0)),
+        forLoop(declare("int", "i", integer(0)), binary(name("i"), LESS_BINOP, name("n")), increment("i"), block(4,
+            declarePointer("int", "q", allocate(integer(16))),
+            assign(element(name("q"), integer(0)), name("i")),
+            update(name("t"), ADD_AND_ASSIGN, element(name("q"), integer(0))),
+            release(name("q")))),
+        returns(name("t")))));
+    expectPlacement("buffer allocated in a loop", program, "f", "q", ALLOC_REGION);
+    expectOnEveryEngine("buffer allocated in a loop", program, promote, "f", &n, 1, 21);
+    freeAST(program);
+}
+
+static void addressTaken(void){
+    // int **r = &p; the buffer is reachable through r after p is gone
+    ASTNode *between = declare("int", "r", unary(ADDRESS_OF_UNOP, name("p")));
+    ASTNode *program = block(1, function("f", 1, "n", localBuffer(integer(16), between)));
+    long long n = 7;
+    expectPlacement("address of the pointer taken", program, "f", "p", ALLOC_HEAP);
+    sameOnEveryEngine("address of the pointer taken", program, promote, "f", &n, 1);
+    freeAST(program);
+}
+
+static void returnedPointer(void){
+    // int *make(int n) hands its buffer to the caller, which reads and frees it
+    ASTNode *make = function("make", 1, "n", block(3,
+        declarePointer("int", "p", allocate(integer(16))),
+        assign(element(name("p"), integer(0)), name("n")),
+        returns(name("p"))));
+    freeAST(make->functionDef.returnType);
+    make->functionDef.returnType = createPointerNode(name("int"));
+    ASTNode *program = block(2, make,
+        function("f", 1, "n", block(4,
+            declarePointer("int", "q", call("make", 1, binary(name("n"), ADD_BINOP, integer(1)))),
+            declare("int", "s", element(name("q"), integer(0))),
+            release(name("q")),
+            returns(name("s")))));
+    long long n = 7;
+    expectPlacement("returned pointer", program, "make", "p", ALLOC_HEAP);
+    expectOnEveryEngine("returned pointer", program, promote, "f", &n, 1, 8);
+    freeAST(program);
+}
+
+static void labels(void){
+    // a jump back over the declaration would allocate again, so a function
+    // with labels keeps everything on the heap
+    ASTNode *between = block(2, jump("done"), label("done"));
+    ASTNode *program = block(1, function("f", 1, "n", localBuffer(integer(16), between)));
+    long long n = 7;
+    expectPlacement("function with a label", program, "f", "p", ALLOC_HEAP);
+    expectOnEveryEngine("function with a label", program, promote, "f", &n, 1, 21);
+    freeAST(program);
+}
+
+int main(void){
+    localOnly();
+    addressTaken();
+    returnedPointer();
+    labels();
+    return finishTests();
+}
@@ -0,0 +1,103 @@
+#include "backend.h"
+#include "builders.h"
+#include "harness.h"
+#include <stdio.h>
+#include <string.h>
+
+// throw and catch on every engine that compiles them: handlers matching by
+// type, nested handlers, rethrowing from a handler and unwinding through
+// calls. The closure compiler does not take exceptions, which is checked
+// here rather than left to show only as a skip.
+
+static void throwAndCatch(void){
+    // int r = 0; try { if(x > 0) throw x * 2; r = 1; } catch(int e){ r = e + 100; } return r;
+    ASTNode *program = block(1, function("f", 1, "x", block(3,
+        declare("int", "r", integer(0)),
+        tryCatch(block(2,
+                ifElse(binary(name("x"), GREATER_BINOP, integer(0)), throws(binary(name("x"), MUL_BINOP, integer(2))), NULL),
+                assign(name("r"), integer(1))),
+            declare("int", "e", NULL),
+            block(1, assign(name("r"), binary(name("e"), ADD_BINOP, integer(100))))),
+        returns(name("r")))));
+    long long thrown = 5, notThrown = -1;
+    expectOnEveryEngine("throw and catch", program, NULL, "f", &thrown, 1, 110);
+    expectOnEveryEngine("try without a throw", program, NULL, "f", &notThrown, 1, 1);
+
+    char error[256] = "";
+    Engine *engine = createEngine(program, BACKEND_CLOSURES, NULL, error, sizeof(error));
+    expectThat("closures reject exceptions", !engine && strstr(error, "exceptions") != NULL, "the closure compiler took a try statement");
+    freeEngine(engine);
+    freeAST(program);
+}
+
+// The inner handler catches type, the outer one int.
+static ASTNode *nestedHandlers(const char *type){
+    return block(1, function("f", 1, "x", block(3,
+        declare("int", "r", integer(0)),
+        tryCatch(block(2,
+                tryCatch(block(2,
+                        ifElse(binary(name("x"), GREATER_BINOP, integer(0)), throws(name("x")), NULL),
+                        assign(name("r"), integer(1))),
+                    declare(type, "e", NULL),
+                    block(1, assign(name("r"), integer(2)))),
+                update(name("r"), ADD_AND_ASSIGN, integer(10))),
+            declare("int", "e", NULL),
+            block(1, assign(name("r"), binary(name("e"), ADD_BINOP, integer(100))))),
+        returns(name("r")))));
+}
+
+static void nested(void){
+    long long thrown = 3, notThrown = 0;
+    ASTNode *program = nestedHandlers("long");
+    expectOnEveryEngine("inner handler of another type", program, NULL, "f", &thrown, 1, 103);
+    expectOnEveryEngine("nested handlers without a throw", program, NULL, "f", &notThrown, 1, 11);
+    freeAST(program);
+
+    program = nestedHandlers("int");
+    expectOnEveryEngine("inner handler of the thrown type", program, NULL, "f", &thrown, 1, 12);
+    freeAST(program);
+}
+
+static void rethrow(void){
+    // try { try { throw x; } catch(int e){ r = 1; throw e + 10; } } catch(int e){ r += e; }
+    ASTNode *program = block(1, function("f", 1, "x", block(3,
+        declare("int", "r", integer(0)),
+        tryCatch(block(1,
+                tryCatch(block(1, throws(name("x"))),
+                    declare("int", "e", NULL),
+                    block(2, assign(name("r"), integer(1)), throws(binary(name("e"), ADD_BINOP, integer(10)))))),
+            declare("int", "e", NULL),
+            block(1, update(name("r"), ADD_AND_ASSIGN, name("e")))),
+        returns(name("r")))));
+    long long x = 5;
+    expectOnEveryEngine("rethrow from a handler", program, NULL, "f", &x, 1, 16);
+    freeAST(program);
+}
+
+static void unwinding(void){
+    // int g(int n){ if(n == 0) throw 7; return g(n - 1) + 1; }
+    ASTNode *program = block(3,
+        function("g", 1, "n", block(2,
+            ifElse(binary(name("n"), EQU_BINOP, integer(0)), throws(integer(7)), NULL),
+            returns(binary(call("g", 1, binary(name("n"), SUB_BINOP, integer(1))), ADD_BINOP, integer(1))))),
+        function("f", 1, "x", block(3,
+            declare("int", "r", integer(0)),
+            tryCatch(block(1, assign(name("r"), call("g", 1, name("x")))),
+                declare("int", "e", NULL),
+                block(1, assign(name("r"), binary(binary(name("e"), MUL_BINOP, integer(1000)), ADD_BINOP, name("x"))))),
+            returns(name("r")))),
+        function("uncaught", 1, "x", block(1, returns(call("g", 1, name("x"))))));
+    long long x = 50;
+    expectOnEveryEngine("unwinding through calls", program, NULL, "f", &x, 1, 7050);
+    // nothing catches it, so every engine fails
+    sameOnEveryEngine("uncaught through calls", program, NULL, "uncaught", &x, 1);
+    freeAST(program);
+}
+
+int main(void){
+    throwAndCatch();
+    nested();
+    rethrow();
+    unwinding();
+    return finishTests();
+}
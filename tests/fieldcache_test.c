@@ -0,0 +1,85 @@
+#include "builders.h"
+#include "eval.h"
+#include "harness.h"
+#include "primitive.h"
+#include <stdio.h>
+
+// The evaluator's field access caches: one site in readX meets one, two or
+// five struct layouts, each with x at a different offset, and the hit and
+// miss counts show it monomorphic, polymorphic and then megamorphic.
+
+#define LAYOUTS 5
+#define ROUNDS 10
+
+static const char *const structs[LAYOUTS] = {"A", "B", "C", "D", "E"};
+static const char *const makers[LAYOUTS] = {"makeA", "makeB", "makeC", "makeD", "makeE"};
+
+// struct S { int p0; ...; int x; } with index fields before x.
+static ASTNode *layout(int index){
+    switch(index){
+        case 0: return structure(structs[0], 1, "x");
+        case 1: return structure(structs[1], 2, "p0", "x");
+        case 2: return structure(structs[2], 3, "p0", "p1", "x");
+        case 3: return structure(structs[3], 4, "p0", "p1", "p2", "x");
+        default: return structure(structs[4], 5, "p0", "p1", "p2", "p3", "x");
+    }
+}
+
+// int readX(s){ return s.x; }, its parameter untyped so it takes any struct;
+// int makeS(int n){ S s; s.x = n; return readX(s); } for each layout.
+static ASTNode *program(void){
+    ASTNode *readX = function("readX", 1, "s", block(1, returns(field(name("s"), "x"))));
+    ASTNode *param = readX->functionDef.params[0];
+    freeAST(param->declaration.varType);
+    param->declaration.varType = name("any");
+
+    ASTNode *items[2 * LAYOUTS + 1];
+    for(int i = 0; i < LAYOUTS; i++){
+        items[i] = layout(i);
+        items[LAYOUTS + i] = function(makers[i], 1, "n", block(3,
+            declare(structs[i], "s", NULL),
+            assign(field(name("s"), "x"), binary(name("n"), ADD_BINOP, integer(i))),
+            returns(call("readX", 1, name("s")))));
+    }
+    items[2 * LAYOUTS] = readX;
+    return createBlockNode(items, 2 * LAYOUTS + 1);
+}
+
+// Calls the first layouts makers in turn, ROUNDS times over, and checks the
+// results and the cache counts.
+static void expectCounts(const char *test, int layouts, long long hits, long long misses){
+    ASTNode *root = program();
+    Evaluator *e = createEvaluator(root, NULL);
+    Value result;
+    bool ok = e && runProgram(e, &result);
+    bool right = true;
+    for(int round = 0; ok && round < ROUNDS; round++){
+        for(int i = 0; ok && i < layouts; i++){
+            Value arg = makePrimitiveValue(TYPE_INT, primitiveFromLongLong(TYPE_INT, round));
+            long long value;
+            ok = callFunction(e, makers[i], &arg, 1, &result) && primitiveToLongLong(result.type, result.as.primitive, &value);
+            if(ok && value != round + i) right = false;
+        }
+    }
+    char detail[160];
+    snprintf(detail, sizeof(detail), "%s", ok ? "a call returned the wrong x" : e ? evalError(e) : "out of memory");
+    expectThat(test, ok && right, detail);
+    if(ok){
+        const EvalStats *stats = evalStats(e);
+        snprintf(detail, sizeof(detail), "%lld hits, %lld misses; expected %lld, %lld", stats->fieldCacheHits, stats->fieldCacheMisses, hits, misses);
+        expectThat(test, stats->fieldCacheHits == hits && stats->fieldCacheMisses == misses, detail);
+    }
+    freeEvaluator(e);
+    freeAST(root);
+}
+
+int main(void){
+    // each makeS site sees one layout and misses once; readX misses once per
+    // layout while it has ways free
+    expectCounts("monomorphic field site", 1, 2 * ROUNDS - 2, 2);
+    expectCounts("polymorphic field site", 2, 4 * ROUNDS - 4, 4);
+    // the fifth layout finds the ways full, which turns the site
+    // megamorphic, and misses once more before the shared table has it
+    expectCounts("megamorphic field site", 5, 10 * ROUNDS - 11, 11);
+    return finishTests();
+}
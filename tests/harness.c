@@ -0,0 +1,120 @@
+#include "harness.h"
+#include "backend.h"
+#include "primitive.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_ARGS 8
+
+typedef struct {
+    bool accepted;              // the backend compiled the program
+    bool ok;
+    long long value;
+    char error[256];
+} Outcome;
+
+static int checks;
+static int failures;
+static int comparisons;
+static int skipped[BACKEND_COUNT];
+static int engineThreads;
+
+static Outcome runOn(ASTNode *program, ExecutionBackend backend, const char *name, const Value *args, int argCount){
+    Outcome outcome = {false, false, 0, ""};
+    EngineOptions options = {.threads = engineThreads};
+    Engine *engine = createEngineWithOptions(program, backend, &options, outcome.error, sizeof(outcome.error));
+    if(!engine) return outcome;
+    outcome.accepted = true;
+
+    Value result;
+    if(runEngine(engine, &result) && callEngine(engine, name, args, argCount, &result)){
+        outcome.ok = primitiveToLongLong(result.type, result.as.primitive, &outcome.value);
+        if(!outcome.ok) snprintf(outcome.error, sizeof(outcome.error), "returned a value that is not an integer");
+    } else{
+        snprintf(outcome.error, sizeof(outcome.error), "%s", engineError(engine));
+    }
+    freeEngine(engine);
+    return outcome;
+}
+
+static void describe(const Outcome *outcome, char *out, size_t size){
+    if(outcome->ok) snprintf(out, size, "%lld", outcome->value);
+    else snprintf(out, size, "error: %s", outcome->error);
+}
+
+static bool compareEngines(const char *test, ASTNode *program, ProgramPass pass, const char *name, const long long *args, int argCount, const long long *expected){
+    Value values[MAX_ARGS];
+    if(argCount > MAX_ARGS) abort();
+    for(int i = 0; i < argCount; i++){
+        values[i] = makePrimitiveValue(TYPE_INT, primitiveFromLongLong(TYPE_INT, args[i]));
+    }
+
+    bool same = true;
+    char text[300];
+    Outcome reference = runOn(program, BACKEND_EVALUATOR, name, values, argCount);
+    if(expected && (!reference.ok || reference.value != *expected)){
+        describe(&reference, text, sizeof(text));
+        printf("%s: expected %lld, the evaluator gave %s\n", test, *expected, text);
+        same = false;
+    }
+
+    for(int b = 0; b < BACKEND_COUNT; b++){
+        ASTNode *copy = cloneAST(program);
+        Outcome outcome = runOn(copy, (ExecutionBackend)b, name, values, argCount);
+        freeAST(copy);
+        // Backends that reject the program are skipped; one that accepts it
+        // must still accept it after the pass.
+        if(!outcome.accepted){
+            skipped[b]++;
+            continue;
+        }
+        if(pass){
+            copy = pass(cloneAST(program));
+            outcome = runOn(copy, (ExecutionBackend)b, name, values, argCount);
+            freeAST(copy);
+        }
+
+        // Errors match errors, whatever the message.
+        if(!outcome.accepted || outcome.ok != reference.ok || (outcome.ok && outcome.value != reference.value)){
+            char want[300];
+            describe(&reference, want, sizeof(want));
+            describe(&outcome, text, sizeof(text));
+            printf("%s: %s%s gave %s, the evaluator %s\n", test, backendName(b), pass ? " after the pass" : "", text, want);
+            same = false;
+        }
+    }
+
+    checks++;
+    comparisons++;
+    if(!same) failures++;
+    return same;
+}
+
+bool sameOnEveryEngine(const char *test, ASTNode *program, ProgramPass pass, const char *name, const long long *args, int argCount){
+    return compareEngines(test, program, pass, name, args, argCount, NULL);
+}
+
+bool expectOnEveryEngine(const char *test, ASTNode *program, ProgramPass pass, const char *name, const long long *args, int argCount, long long expected){
+    return compareEngines(test, program, pass, name, args, argCount, &expected);
+}
+
+void setEngineThreads(int threads){
+    engineThreads = threads;
+}
+
+bool expectThat(const char *test, bool passed, const char *detail){
+    checks++;
+    if(!passed){
+        printf("%s: %s\n", test, detail);
+        failures++;
+    }
+    return passed;
+}
+
+int finishTests(void){
+    for(int b = 0; b < BACKEND_COUNT; b++){
+        if(skipped[b]) printf("%s skipped %d of %d programs, which it does not compile\n", backendName((ExecutionBackend)b), skipped[b], comparisons);
+    }
+    printf("%d checks, %d failed\n", checks, failures);
+    return failures ? 1 : 0;
+}
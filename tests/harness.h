@@ -0,0 +1,35 @@
+#ifndef HARNESS_H
+#define HARNESS_H
+
+#include "ast.h"
+#include <stdbool.h>
+
+// Runs one program on every engine and compares what they return, so a
+// pass or backend that changes a program's meaning shows up as a mismatch.
+
+// A rewrite applied to each engine's copy of the program, like an
+// optimization pass; returns the new root.
+typedef ASTNode *(*ProgramPass)(ASTNode *program);
+
+// Calls name(args) with the evaluator on the program as given, then on
+// every backend with a copy pass has rewritten, when pass is not NULL. Each
+// must return the evaluator's value, or fail when it fails. Backends whose
+// subset leaves the program out are skipped. Prints the engines that
+// differ. The program stays owned by the caller.
+bool sameOnEveryEngine(const char *test, ASTNode *program, ProgramPass pass, const char *name, const long long *args, int argCount);
+// The same, and the evaluator must return expected.
+bool expectOnEveryEngine(const char *test, ASTNode *program, ProgramPass pass, const char *name, const long long *args, int argCount, long long expected);
+
+// The worker threads each engine gets for parallel loops from here on; 0,
+// the default, for one per core.
+void setEngineThreads(int threads);
+
+// Counts one check, printing test and detail when passed is false; returns
+// passed. For properties that are not a value returned by the engines.
+bool expectThat(const char *test, bool passed, const char *detail);
+
+// Prints how many programs each backend skipped and how many checks
+// failed; the exit status for main.
+int finishTests(void);
+
+#endif
@@ -0,0 +1,224 @@
+#include "heap.h"
+#include "backend.h"
+#include "builders.h"
+#include "harness.h"
+#include "primitive.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The script heap: its statistics, reallocation in place, zeroing reused
+// blocks, frees from other threads, and turning away pointers it never
+// handed out, both when called directly and from a script's free and
+// realloc.
+
+#define BLOCKS 1000
+#define LARGE (100 * 1024)
+
+static int classOf(size_t size){
+    HeapStats stats;
+    heapStats(&stats);
+    for(int i = 0; i < HEAP_CLASS_COUNT; i++){
+        if(stats.classes[i].blockSize >= size) return i;
+    }
+    return -1;
+}
+
+static void statistics(void){
+    char detail[200];
+    // allocate once first so the heap exists when counting starts
+    heapFree(heapAllocate(48));
+    int c = classOf(48);
+    HeapStats before, after;
+    heapStats(&before);
+    void *blocks[BLOCKS];
+    for(int i = 0; i < BLOCKS; i++) blocks[i] = heapAllocate(40);
+    for(int i = 0; i < BLOCKS; i++) heapFree(blocks[i]);
+    void *large = heapAllocate(LARGE);
+    heapStats(&after);
+    snprintf(detail, sizeof(detail), "%lld allocations and %lld frees of 48-byte blocks, expected %d of each",
+             after.classes[c].allocations - before.classes[c].allocations, after.classes[c].frees - before.classes[c].frees, BLOCKS);
+    expectThat("heapStats counts a class", after.classes[c].blockSize == 48 &&
+               after.classes[c].allocations - before.classes[c].allocations == BLOCKS &&
+               after.classes[c].frees - before.classes[c].frees == BLOCKS, detail);
+    expectThat("heapStats counts a large block", after.largeAllocations - before.largeAllocations == 1 &&
+               after.bytesMapped - before.bytesMapped >= LARGE, "the large allocation was not counted");
+
+    heapFree(large);
+    heapStats(&after);
+    snprintf(detail, sizeof(detail), "%lld large frees, %lld bytes mapped of %lld", after.largeFrees - before.largeFrees, after.bytesMapped, before.bytesMapped);
+    expectThat("heapStats counts a large free", after.largeFrees - before.largeFrees == 1 && after.bytesMapped == before.bytesMapped, detail);
+}
+
+static void reallocation(void){
+    // 40 bytes are in the 48-byte class, which has room up to 48 and keeps
+    // anything over half of it
+    char *block = heapAllocate(40);
+    memset(block, 7, 40);
+    expectThat("realloc within the class", heapReallocate(block, 48) == block, "moved");
+    expectThat("realloc shrinking a little", heapReallocate(block, 30) == block, "moved");
+    char *moved = heapReallocate(block, 200);
+    bool kept = moved != NULL;
+    for(int i = 0; kept && i < 30; i++) kept = moved[i] == 7;
+    expectThat("realloc past the class", moved && moved != block && kept, "the contents did not move with the block");
+
+    char *large = heapReallocate(moved, LARGE);
+    expectThat("realloc to a large block", large && large[0] == 7 && large[29] == 7, "the contents did not move with the block");
+    large[LARGE - 1] = 9;
+    expectThat("shrinking a large block", heapReallocate(large, LARGE / 2) == large, "moved");
+    heapFree(large);
+}
+
+static void zeroing(void){
+    // the block freed last is the next one handed out, with its old bytes
+    char *block = heapAllocate(64);
+    memset(block, 0xAB, 64);
+    heapFree(block);
+    unsigned char *zeroed = heapAllocateZeroed(4, 16);
+    bool zero = zeroed != NULL;
+    for(int i = 0; zero && i < 64; i++) zero = zeroed[i] == 0;
+    expectThat("calloc of a reused block", zeroed == (unsigned char *)block, "the freed block was not reused");
+    expectThat("calloc of a reused block", zero, "kept old bytes");
+    heapFree(zeroed);
+    expectThat("calloc that overflows", heapAllocateZeroed(SIZE_MAX / 8, 16) == NULL, "returned a block");
+}
+
+typedef struct {
+    void **blocks;
+    int count;
+    bool allocate;
+} Work;
+
+static void *work(void *arg){
+    Work *w = arg;
+    for(int i = 0; i < w->count; i++){
+        if(w->allocate){
+            w->blocks[i] = heapAllocate(100);
+            if(w->blocks[i]) memset(w->blocks[i], i & 0xFF, 100);
+        } else{
+            heapFree(w->blocks[i]);
+        }
+    }
+    return NULL;
+}
+
+static void runThread(Work *w){
+    pthread_t thread;
+    pthread_create(&thread, NULL, work, w);
+    pthread_join(thread, NULL);
+}
+
+// Blocks allocated by one thread and freed by another, both ways round,
+// including after the allocating thread has exited.
+static void crossThread(void){
+    int c = classOf(100);
+    HeapStats before, after;
+    heapStats(&before);
+
+    void *blocks[BLOCKS];
+    Work w = {blocks, BLOCKS, true};
+    runThread(&w);
+    bool intact = true;
+    for(int i = 0; i < BLOCKS; i++){
+        intact = intact && blocks[i] && heapOwns(blocks[i]) && ((unsigned char *)blocks[i])[99] == (i & 0xFF);
+    }
+    expectThat("blocks from an exited thread", intact, "lost or changed");
+    for(int i = 0; i < BLOCKS; i++) heapFree(blocks[i]);
+
+    for(int i = 0; i < BLOCKS; i++) blocks[i] = heapAllocate(100);
+    w.allocate = false;
+    runThread(&w);
+
+    heapStats(&after);
+    long long allocations = after.classes[c].allocations - before.classes[c].allocations;
+    long long frees = after.classes[c].frees - before.classes[c].frees;
+    char detail[128];
+    snprintf(detail, sizeof(detail), "%lld allocations, %lld frees; expected %d of each", allocations, frees, 2 * BLOCKS);
+    expectThat("frees from other threads", allocations == 2 * BLOCKS && frees == 2 * BLOCKS, detail);
+
+    // what the other thread freed is handed out again
+    bool reused = true;
+    for(int i = 0; i < BLOCKS; i++){
+        blocks[i] = heapAllocate(100);
+        reused = reused && blocks[i];
+        if(blocks[i]) memset(blocks[i], 1, 100);
+    }
+    for(int i = 0; i < BLOCKS; i++) heapFree(blocks[i]);
+    expectThat("blocks freed by another thread", reused, "could not be allocated again");
+}
+
+static void provenance(void){
+    int local = 0;
+    char *block = heapAllocate(32);
+    char *large = heapAllocate(LARGE);
+    void *foreign = malloc(32);
+    expectThat("heapOwns a small block", heapOwns(block), "disowned it");
+    expectThat("heapOwns a large block", heapOwns(large), "disowned it");
+    expectThat("heapOwns a stack address", !heapOwns(&local), "owned it");
+    expectThat("heapOwns a block from malloc", !heapOwns(foreign), "owned it");
+    expectThat("heapOwns a pointer into a block", !heapOwns(block + 16) && !heapOwns(large + 64), "owned it");
+
+    expectThat("heapFree of a stack address", !heapFree(&local), "freed it");
+    expectThat("heapFree of a pointer into a block", !heapFree(block + 16), "freed it");
+    expectThat("heapReallocate of a pointer into a block", heapReallocate(large + 64, 10) == NULL, "moved it");
+    expectThat("heapReallocate of a block from malloc", heapReallocate(foreign, 64) == NULL, "moved it");
+    expectThat("heapFree of a block", heapFree(block) && heapFree(large), "refused it");
+    expectThat("heapOwns a freed large block", !heapOwns(large), "still owned it");
+    free(foreign);
+}
+
+// int f(int n){ int *p = malloc(16); p[0] = n; ...tail }
+static ASTNode *scriptWith(ASTNode *tail){
+    return block(1, function("f", 1, "n", block(3,
+        declarePointer("int", "p", allocate(integer(16))),
+        assign(element(name("p"), integer(0)), name("n")),
+        tail)));
+}
+
+// Runs f(5) on the evaluator, the one engine that runs pointers; returns
+// whether it succeeded, with the error in error otherwise.
+static bool runScript(ASTNode *program, long long *value, char *error, size_t errorSize){
+    Engine *engine = createEngine(program, BACKEND_EVALUATOR, NULL, error, errorSize);
+    Value arg = makePrimitiveValue(TYPE_INT, primitiveFromLongLong(TYPE_INT, 5));
+    Value result;
+    bool ok = engine && runEngine(engine, &result) && callEngine(engine, "f", &arg, 1, &result) &&
+              primitiveToLongLong(result.type, result.as.primitive, value);
+    if(engine && !ok) snprintf(error, errorSize, "%s", engineError(engine));
+    freeEngine(engine);
+    freeAST(program);
+    return ok;
+}
+
+static void scripts(void){
+    char error[256] = "";
+    long long value = 0;
+    // int *q = realloc(p, 64); q[1] = q[0] * 2; int r = q[0] + q[1]; free(q); return r;
+    bool ok = runScript(scriptWith(block(5,
+        declarePointer("int", "q", createReallocExprNode(name("p"), integer(64))),
+        assign(element(name("q"), integer(1)), binary(element(name("q"), integer(0)), MUL_BINOP, integer(2))),
+        declare("int", "r", binary(element(name("q"), integer(0)), ADD_BINOP, element(name("q"), integer(1)))),
+        release(name("q")),
+        returns(name("r")))), &value, error, sizeof(error));
+    expectThat("script realloc and free", ok && value == 15, error);
+
+    // free(p + 1)
+    ok = runScript(scriptWith(block(2, release(binary(name("p"), ADD_BINOP, integer(1))), returns(integer(0)))), &value, error, sizeof(error));
+    expectThat("script free of a pointer into a block", !ok && strstr(error, "into an object"), ok ? "succeeded" : error);
+
+    // realloc(p + 2, 32)
+    ok = runScript(scriptWith(block(2, release(createReallocExprNode(binary(name("p"), ADD_BINOP, integer(2)), integer(32))), returns(integer(0)))),
+                   &value, error, sizeof(error));
+    expectThat("script realloc of a pointer into a block", !ok && strstr(error, "into an object"), ok ? "succeeded" : error);
+}
+
+int main(void){
+    statistics();
+    reallocation();
+    zeroing();
+    crossThread();
+    provenance();
+    scripts();
+    return finishTests();
+}
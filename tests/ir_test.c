@@ -0,0 +1,72 @@
+#include "ir.h"
+#include "builders.h"
+#include "harness.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The IR dump of a small program, kept exact so changes to lowering or to
+// the dump format show up as a diff.
+
+static const char *const loopDump =
+    "global @total\n"
+    "\n"
+    "fun __init() -> any {\n"
+    "bb0:\n"
+    "    %0: int = const 0\n"
+    "    storeglobal @total %0\n"
+    "    return\n"
+    "}\n"
+    "\n"
+    "fun f(%0: int) -> int {\n"
+    "bb0:\n"
+    "    %0: int = param 0\n"
+    "    %1: int = const 0\n"
+    "    %2: int = const 0\n"
+    "    jump bb1\n"
+    "bb1:    ; preds bb0 bb3\n"
+    "    %3: int = phi [%2 bb0, %9 bb3]\n"
+    "    %6: int = phi [%1 bb0, %7 bb3]\n"
+    "    %5: bool = binary lt %3, %0\n"
+    "    branch %5, bb2, bb4\n"
+    "bb2:    ; preds bb1\n"
+    "    %7: int = binary add %6, %3\n"
+    "    jump bb3\n"
+    "bb3:    ; preds bb2\n"
+    "    %8: int = const 1\n"
+    "    %9: int = binary add %3, %8\n"
+    "    jump bb1\n"
+    "bb4:    ; preds bb1\n"
+    "    return %6\n"
+    "}\n";
+
+// int total = 0; int f(int n){ int s = 0; for(int i = 0; i < n; i++) s += i; return s; }
+static void loopGolden(void){
+    ASTNode *program = block(2, declare("int", "total", integer(0)), function("f", 1, "n", block(3,
+        declare("int", "s", integer(0)),
+        forLoop(declare("int", "i", integer(0)), binary(name("i"), LESS_BINOP, name("n")), increment("i"),
+            block(1, update(name("s"), ADD_AND_ASSIGN, name("i")))),
+        returns(name("s")))));
+    IRModule *module = lowerToIR(program);
+    char error[256] = "lowering to IR failed";
+    bool verified = module && verifyIRModule(module, error, sizeof(error));
+    expectThat("loop lowering verifies", verified, error);
+
+    char *dump = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&dump, &size);
+    if(module && out) dumpIRModule(module, out);
+    if(out) fclose(out);
+    bool same = dump && strcmp(dump, loopDump) == 0;
+    if(!same) printf("loop dump was:\n%s", dump ? dump : "");
+    expectThat("loop dump matches the golden text", same, "dump differs");
+
+    free(dump);
+    freeIRModule(module);
+    freeAST(program);
+}
+
+int main(void){
+    loopGolden();
+    return finishTests();
+}
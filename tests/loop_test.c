@@ -0,0 +1,54 @@
+#include "loop.h"
+#include "builders.h"
+#include "harness.h"
+#include <stddef.h>
+
+// Programs the loop optimizer once changed, run on every engine before and
+// after the pass.
+
+static ASTNode *optimize(ASTNode *program){
+    LoopStats stats;
+    return optimizeLoops(program, &stats);
+}
+
+// A shift by a variable count can trap, so it must stay behind the guard
+// and inside a loop that may not run at all.
+static void guardedShifts(void){
+    ASTNode *program = block(1, function("f", 2, "x", "n", block(3,
+        declare("int", "s", integer(0)),
+        forLoop(declare("int", "i", integer(0)), binary(name("i"), LESS_BINOP, integer(4)), increment("i"),
+            block(1, ifElse(binary(name("n"), LESS_BINOP, integer(32)),
+                update(name("s"), ADD_AND_ASSIGN, binary(name("x"), SHIFT_LEFT_BINOP, name("n"))), NULL))),
+        returns(name("s")))));
+    long long inRange[] = {3, 4};
+    long long outOfRange[] = {3, 40};
+    expectOnEveryEngine("guarded shift, count in range", program, optimize, "f", inRange, 2, 192);
+    expectOnEveryEngine("guarded shift, count out of range", program, optimize, "f", outOfRange, 2, 0);
+    freeAST(program);
+
+    program = block(1, function("f", 3, "x", "n", "m", block(3,
+        declare("int", "s", integer(0)),
+        forLoop(declare("int", "i", integer(0)), binary(name("i"), LESS_BINOP, name("m")), increment("i"),
+            block(1, update(name("s"), ADD_AND_ASSIGN, binary(name("x"), SHIFT_RIGHT_BINOP, name("n"))))),
+        returns(name("s")))));
+    long long zeroTrips[] = {64, -1, 0};
+    long long twoTrips[] = {64, 2, 2};
+    expectOnEveryEngine("shift in a loop that runs zero times", program, optimize, "f", zeroTrips, 3, 0);
+    expectOnEveryEngine("shift in a loop that runs twice", program, optimize, "f", twoTrips, 3, 32);
+    freeAST(program);
+
+    // A literal count inside the width is still hoisted and still right.
+    program = block(1, function("f", 2, "x", "n", block(3,
+        declare("int", "s", integer(0)),
+        forLoop(declare("int", "i", integer(0)), binary(name("i"), LESS_BINOP, name("n")), increment("i"),
+            block(1, update(name("s"), ADD_AND_ASSIGN, binary(binary(name("x"), ADD_BINOP, integer(1)), SHIFT_LEFT_BINOP, integer(3))))),
+        returns(name("s")))));
+    long long args[] = {2, 5};
+    expectOnEveryEngine("shift by a literal in a loop", program, optimize, "f", args, 2, 120);
+    freeAST(program);
+}
+
+int main(void){
+    guardedShifts();
+    return finishTests();
+}
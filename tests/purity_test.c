@@ -0,0 +1,122 @@
+#include "purity.h"
+#include "builders.h"
+#include "harness.h"
+#include <stdio.h>
+#include <string.h>
+
+// Which functions purity analysis marks pure, and that memoizing the
+// memoizable ones does not change what any engine returns.
+
+static ASTNode *analyze(ASTNode *program){
+    PurityStats stats;
+    return analyzePurity(program, &stats);
+}
+
+// Analyzes a copy of program and checks the purity of the named function.
+static void expectPurity(const char *test, ASTNode *program, const char *function, Purity expected){
+    ASTNode *copy = analyze(cloneAST(program));
+    Purity purity = PURITY_UNKNOWN;
+    for(int i = 0; i < copy->block.stmtCount; i++){
+        ASTNode *item = copy->block.statements[i];
+        if(item->type == FUNCTION_NODE && strcmp(item->functionDef.name, function) == 0) purity = item->functionDef.purity;
+    }
+    char detail[128];
+    snprintf(detail, sizeof(detail), "%s is %s, expected %s", function, purityName(purity), purityName(expected));
+    expectThat(test, purity == expected, detail);
+    freeAST(copy);
+}
+
+static void pure(void){
+    ASTNode *program = block(1, function("f", 2, "x", "y", block(2,
+        declare("int", "s", binary(name("x"), MUL_BINOP, name("x"))),
+        returns(binary(name("s"), ADD_BINOP, name("y"))))));
+    long long args[] = {3, 4};
+    expectPurity("arithmetic on the arguments", program, "f", PURITY_MEMOIZABLE);
+    expectOnEveryEngine("arithmetic on the arguments", program, analyze, "f", args, 2, 13);
+    freeAST(program);
+
+    // reading a const global still depends only on the arguments
+    ASTNode *limit = createDeclarationNode(name("int"), "limit", integer(100), STORAGE_CONST);
+    program = block(2, limit, function("f", 1, "x", block(1,
+        returns(binary(name("x"), ADD_BINOP, name("limit"))))));
+    long long x = 5;
+    expectPurity("reading a const global", program, "f", PURITY_MEMOIZABLE);
+    expectOnEveryEngine("reading a const global", program, analyze, "f", &x, 1, 105);
+    freeAST(program);
+}
+
+static void impure(void){
+    ASTNode *program = block(2,
+        declare("int", "count", integer(0)),
+        function("f", 1, "x", block(2,
+            update(name("count"), ADD_AND_ASSIGN, integer(1)),
+            returns(binary(name("x"), ADD_BINOP, name("count"))))));
+    long long x = 5;
+    expectPurity("global write", program, "f", PURITY_IMPURE);
+    expectOnEveryEngine("global write", program, analyze, "f", &x, 1, 6);
+    freeAST(program);
+
+    // a caller of an impure function is impure too
+    program = block(3,
+        declare("int", "count", integer(0)),
+        function("bump", 0, block(1, returns(update(name("count"), ADD_AND_ASSIGN, integer(1))))),
+        function("f", 1, "x", block(1, returns(binary(name("x"), ADD_BINOP, call("bump", 0))))));
+    expectPurity("calls a global write", program, "f", PURITY_IMPURE);
+    expectOnEveryEngine("calls a global write", program, analyze, "f", &x, 1, 6);
+    freeAST(program);
+
+    program = block(1, function("f", 1, "x", block(2,
+        call("print", 1, name("x")),
+        returns(name("x")))));
+    expectPurity("output", program, "f", PURITY_IMPURE);
+    freeAST(program);
+
+    // int f(int *p) reads memory the caller owns
+    program = block(1, function("f", 1, "p", block(1, returns(element(name("p"), integer(0))))));
+    ASTNode *param = program->block.statements[0]->functionDef.params[0];
+    freeAST(param->declaration.varType);
+    param->declaration.varType = createPointerNode(name("int"));
+    expectPurity("pointer parameter", program, "f", PURITY_IMPURE);
+    freeAST(program);
+}
+
+static void recursive(void){
+    // int fib(int n){ return n < 2 ? n : fib(n - 1) + fib(n - 2); }
+    ASTNode *program = block(1, function("fib", 1, "n", block(1,
+        returns(ternary(binary(name("n"), LESS_BINOP, integer(2)), name("n"),
+            binary(call("fib", 1, binary(name("n"), SUB_BINOP, integer(1))), ADD_BINOP,
+                   call("fib", 1, binary(name("n"), SUB_BINOP, integer(2)))))))));
+    long long n = 20;
+    expectPurity("recursion", program, "fib", PURITY_MEMOIZABLE);
+    expectOnEveryEngine("recursion", program, analyze, "fib", &n, 1, 6765);
+    freeAST(program);
+
+    program = block(2,
+        function("even", 1, "n", block(1,
+            returns(ternary(binary(name("n"), EQU_BINOP, integer(0)), integer(1), call("odd", 1, binary(name("n"), SUB_BINOP, integer(1))))))),
+        function("odd", 1, "n", block(1,
+            returns(ternary(binary(name("n"), EQU_BINOP, integer(0)), integer(0), call("even", 1, binary(name("n"), SUB_BINOP, integer(1))))))));
+    n = 9;
+    expectPurity("mutual recursion", program, "even", PURITY_MEMOIZABLE);
+    expectPurity("mutual recursion", program, "odd", PURITY_MEMOIZABLE);
+    expectOnEveryEngine("mutual recursion", program, analyze, "even", &n, 1, 0);
+    freeAST(program);
+
+    // recursion does not hide a write on the way down
+    program = block(2,
+        declare("int", "depth", integer(0)),
+        function("down", 1, "n", block(2,
+            assign(name("depth"), name("n")),
+            returns(ternary(binary(name("n"), EQU_BINOP, integer(0)), integer(0),
+                binary(integer(1), ADD_BINOP, call("down", 1, binary(name("n"), SUB_BINOP, integer(1)))))))));
+    expectPurity("recursion with a global write", program, "down", PURITY_IMPURE);
+    expectOnEveryEngine("recursion with a global write", program, analyze, "down", &n, 1, 9);
+    freeAST(program);
+}
+
+int main(void){
+    pure();
+    impure();
+    recursive();
+    return finishTests();
+}
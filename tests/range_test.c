@@ -0,0 +1,112 @@
+#include "range.h"
+#include "builders.h"
+#include "harness.h"
+#include <stdio.h>
+#include <string.h>
+
+// Which array accesses range analysis proves in bounds, and that every
+// engine still returns the same, or fails the same, once their checks are
+// gone.
+
+#define MAX_ACCESSES 16
+
+static ASTNode *eliminate(ASTNode *program){
+    RangeStats stats;
+    return eliminateBoundsChecks(program, &stats);
+}
+
+typedef struct {
+    char marks[MAX_ACCESSES + 1];
+    int count;
+} AccessMarks;
+
+static void markAccesses(ASTNode **slot, void *ctx){
+    AccessMarks *marks = ctx;
+    ASTNode *node = *slot;
+    if(!node) return;
+
+    if(node->type == ARRAY_ACCESS_NODE && marks->count < MAX_ACCESSES){
+        marks->marks[marks->count++] = node->arrayAccess.inBounds ? '+' : '-';
+    }
+    forEachChild(node, markAccesses, ctx);
+}
+
+// Analyzes a copy of program and compares its accesses, in source order,
+// with expected: '+' for one proven in bounds, '-' for one still checked.
+static void expectChecks(const char *test, ASTNode *program, const char *expected){
+    ASTNode *copy = eliminate(cloneAST(program));
+    AccessMarks marks = {{0}, 0};
+    markAccesses(&copy, &marks);
+    char detail[128];
+    snprintf(detail, sizeof(detail), "accesses %s, expected %s", marks.marks, expected);
+    expectThat(test, strcmp(marks.marks, expected) == 0, detail);
+    freeAST(copy);
+}
+
+// for(int i = from; i < to; i++) a[i - offset] = i - offset; then the same
+// loop summing
+static ASTNode *fillAndSum(int length, ASTNode *from, BinaryOpType test, ASTNode *to, long long offset){
+    ASTNode *index = offset ? binary(name("i"), SUB_BINOP, integer(offset)) : name("i");
+    return block(1, function("f", 1, "n", block(5,
+        declareArray("int", length, "a"),
+        declare("int", "s", integer(0)),
+        forLoop(declare("int", "i", from), binary(name("i"), test, to), increment("i"),
+            block(1, assign(element(name("a"), index), cloneAST(index)))),
+        forLoop(declare("int", "i", cloneAST(from)), binary(name("i"), test, cloneAST(to)), increment("i"),
+            block(1, update(name("s"), ADD_AND_ASSIGN, element(name("a"), cloneAST(index))))),
+        returns(name("s")))));
+}
+
+static void inRange(void){
+    ASTNode *program = fillAndSum(10, integer(0), LESS_BINOP, integer(10), 0);
+    long long n = 0;
+    expectChecks("loop over the whole array", program, "++");
+    expectOnEveryEngine("loop over the whole array", program, eliminate, "f", &n, 1, 45);
+    freeAST(program);
+
+    // the last int values before the top, shifted down to the array
+    program = fillAndSum(7, integer(2147483640), LESS_BINOP, integer(2147483647), 2147483640);
+    expectChecks("loop up to the largest int", program, "++");
+    expectOnEveryEngine("loop up to the largest int", program, eliminate, "f", &n, 1, 21);
+    freeAST(program);
+}
+
+static void outOfRange(void){
+    // one past the end: the check stays and every engine fails on a[10]
+    ASTNode *program = fillAndSum(10, integer(0), LESS_EQU_BINOP, integer(10), 0);
+    long long n = 0;
+    expectChecks("loop one past the end", program, "--");
+    sameOnEveryEngine("loop one past the end", program, eliminate, "f", &n, 1);
+    freeAST(program);
+
+    // an index from outside is never proven
+    program = block(1, function("f", 1, "n", block(3,
+        declareArray("int", 10, "a"),
+        assign(element(name("a"), name("n")), integer(5)),
+        returns(element(name("a"), name("n"))))));
+    long long inside = 9, past = 10, negative = -1;
+    expectChecks("index from an argument", program, "--");
+    expectOnEveryEngine("index from an argument inside", program, eliminate, "f", &inside, 1, 5);
+    sameOnEveryEngine("index from an argument past the end", program, eliminate, "f", &past, 1);
+    sameOnEveryEngine("negative index from an argument", program, eliminate, "f", &negative, 1);
+    freeAST(program);
+
+    // i <= INT_MAX never ends, so i has no range: i++ would overflow
+    program = fillAndSum(8, integer(2147483640), LESS_EQU_BINOP, integer(2147483647), 2147483640);
+    expectChecks("loop through the largest int", program, "--");
+    freeAST(program);
+
+    // i + INT_MAX overflows int before the subtraction brings it back
+    program = block(1, function("f", 1, "n", block(2,
+        declareArray("int", 10, "a"),
+        forLoop(declare("int", "i", integer(0)), binary(name("i"), LESS_BINOP, integer(10)), increment("i"),
+            block(1, assign(element(name("a"), binary(binary(name("i"), ADD_BINOP, integer(2147483647)), SUB_BINOP, integer(2147483647))), name("i")))))));
+    expectChecks("index that overflows on the way", program, "-");
+    freeAST(program);
+}
+
+int main(void){
+    inRange();
+    outOfRange();
+    return finishTests();
+}
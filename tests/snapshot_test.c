@@ -0,0 +1,178 @@
+#include "backend.h"
+#include "builders.h"
+#include "harness.h"
+#include "primitive.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Snapshots written by each bytecode backend and started on every one,
+// which must return what the evaluator returns without running the
+// top-level code again; then images damaged on disk, which openSnapshot
+// must turn away.
+
+#define ARG_COUNT 4
+
+static const ExecutionBackend bytecodeBackends[] = {BACKEND_STACK_VM, BACKEND_REGISTER_VM, BACKEND_JIT, BACKEND_TIERED};
+#define BYTECODE_BACKENDS (int)(sizeof(bytecodeBackends) / sizeof(bytecodeBackends[0]))
+
+// int base = 0; int table[8]; base = 40; for(int i = 0; i < 8; i++) table[i] = i * i;
+// int f(int x){ return base + table[x & 7] * x; }
+static ASTNode *program(void){
+    return block(5,
+        declare("int", "base", integer(0)),
+        declareArray("int", 8, "table"),
+        assign(name("base"), integer(40)),
+        forLoop(declare("int", "i", integer(0)), binary(name("i"), LESS_BINOP, integer(8)), increment("i"),
+            block(1, assign(element(name("table"), name("i")), binary(name("i"), MUL_BINOP, name("i"))))),
+        function("f", 1, "x", block(1,
+            returns(binary(name("base"), ADD_BINOP, binary(element(name("table"), binary(name("x"), BIT_AND_BINOP, integer(7))), MUL_BINOP, name("x")))))));
+}
+
+static bool callF(Engine *engine, long long x, long long *value){
+    Value arg = makePrimitiveValue(TYPE_INT, primitiveFromLongLong(TYPE_INT, x));
+    Value result;
+    return callEngine(engine, "f", &arg, 1, &result) && primitiveToLongLong(result.type, result.as.primitive, value);
+}
+
+static const long long args[ARG_COUNT] = {0, 3, 13, -5};
+
+// Writes a snapshot of root from writer to path; false when the backend is
+// not available here.
+static bool writeFrom(ASTNode *root, ExecutionBackend writer, const char *path){
+    char error[256] = "";
+    Engine *engine = createEngine(root, writer, NULL, error, sizeof(error));
+    if(!engine) return false;
+    Value result;
+    char test[96];
+    snprintf(test, sizeof(test), "snapshot from %s", backendName(writer));
+    bool ok = runEngine(engine, &result) && snapshotEngine(engine, path, error, sizeof(error));
+    expectThat(test, ok, error[0] ? error : engineError(engine));
+    freeEngine(engine);
+    return ok;
+}
+
+static void roundTrips(const char *path){
+    ASTNode *root = program();
+    char error[256] = "";
+    long long expected[ARG_COUNT];
+    Engine *reference = createEngine(root, BACKEND_EVALUATOR, NULL, error, sizeof(error));
+    Value result;
+    bool ok = reference && runEngine(reference, &result);
+    for(int i = 0; ok && i < ARG_COUNT; i++) ok = callF(reference, args[i], &expected[i]);
+    expectThat("evaluator reference", ok, reference ? engineError(reference) : error);
+    freeEngine(reference);
+
+    for(int w = 0; ok && w < BYTECODE_BACKENDS; w++){
+        if(!writeFrom(root, bytecodeBackends[w], path)) continue;
+        Snapshot *snapshot = openSnapshot(path, error, sizeof(error));
+        char test[96];
+        snprintf(test, sizeof(test), "open a snapshot from %s", backendName(bytecodeBackends[w]));
+        if(!expectThat(test, snapshot != NULL, error)) continue;
+
+        for(int r = 0; r < BYTECODE_BACKENDS; r++){
+            snprintf(test, sizeof(test), "snapshot from %s run on %s", backendName(bytecodeBackends[w]), backendName(bytecodeBackends[r]));
+            EngineOptions options = {0};
+            Engine *engine = createEngineFromSnapshot(snapshot, bytecodeBackends[r], &options, error, sizeof(error));
+            // the JIT backends are not available everywhere
+            if(!engine) continue;
+            bool same = true;
+            char detail[300] = "";
+            for(int i = 0; same && i < ARG_COUNT; i++){
+                long long value = 0;
+                if(!callF(engine, args[i], &value)){
+                    snprintf(detail, sizeof(detail), "f(%lld) failed: %s", args[i], engineError(engine));
+                    same = false;
+                } else if(value != expected[i]){
+                    snprintf(detail, sizeof(detail), "f(%lld) gave %lld, the evaluator %lld", args[i], value, expected[i]);
+                    same = false;
+                }
+            }
+            expectThat(test, same, detail);
+            freeEngine(engine);
+        }
+        closeSnapshot(snapshot);
+    }
+    freeAST(root);
+}
+
+static unsigned char *readImage(const char *path, size_t *size){
+    FILE *in = fopen(path, "rb");
+    if(!in) return NULL;
+    fseek(in, 0, SEEK_END);
+    long length = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    unsigned char *bytes = length > 0 ? malloc((size_t)length) : NULL;
+    if(bytes && fread(bytes, 1, (size_t)length, in) != (size_t)length){
+        free(bytes);
+        bytes = NULL;
+    }
+    fclose(in);
+    *size = bytes ? (size_t)length : 0;
+    return bytes;
+}
+
+static void writeImage(const char *path, const unsigned char *bytes, size_t size){
+    FILE *out = fopen(path, "wb");
+    if(!out) return;
+    fwrite(bytes, 1, size, out);
+    fclose(out);
+}
+
+// Writes image with the byte at offset flipped, or cut to size when offset
+// is past it, and expects openSnapshot to fail saying why.
+static void expectRejected(const char *test, const char *path, const unsigned char *image, size_t size, size_t offset, size_t keep, const char *reason){
+    unsigned char *copy = malloc(size);
+    if(!copy) return;
+    memcpy(copy, image, size);
+    if(offset < size) copy[offset] ^= 0x10;
+    writeImage(path, copy, keep);
+    free(copy);
+
+    char error[256] = "";
+    Snapshot *snapshot = openSnapshot(path, error, sizeof(error));
+    char detail[320];
+    snprintf(detail, sizeof(detail), snapshot ? "opened" : "failed with '%s', expected '%s'", error, reason);
+    expectThat(test, !snapshot && strstr(error, reason) != NULL, detail);
+    closeSnapshot(snapshot);
+}
+
+static void damagedImages(const char *path){
+    ASTNode *root = program();
+    bool written = writeFrom(root, BACKEND_STACK_VM, path);
+    freeAST(root);
+    size_t size = 0;
+    unsigned char *image = written ? readImage(path, &size) : NULL;
+    if(!expectThat("read the image back", image != NULL, "cannot read the snapshot")) return;
+
+    // the last byte is code or a name, which only the checksum catches
+    expectRejected("a flipped byte at the end", path, image, size, size - 1, size, "checksum");
+    expectRejected("a flipped byte in the middle", path, image, size, size / 2, size, "checksum");
+    // 24 is where the header keeps the checksum
+    expectRejected("a flipped checksum", path, image, size, 24, size, "checksum");
+    expectRejected("a truncated image", path, image, size, size, size - 8, "truncated");
+    expectRejected("a changed magic", path, image, size, 0, size, "not a snapshot");
+
+    // unchanged, it still opens
+    writeImage(path, image, size);
+    char error[256] = "";
+    Snapshot *snapshot = openSnapshot(path, error, sizeof(error));
+    expectThat("the image rewritten unchanged", snapshot != NULL, error);
+    closeSnapshot(snapshot);
+    free(image);
+}
+
+int main(void){
+    char path[] = "/tmp/snapshot_testXXXXXX";
+    int fd = mkstemp(path);
+    if(fd < 0){
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    roundTrips(path);
+    damagedImages(path);
+    unlink(path);
+    return finishTests();
+}
@@ -0,0 +1,57 @@
+#include "tailcall.h"
+#include "builders.h"
+#include "eval.h"
+#include "harness.h"
+#include "primitive.h"
+#include <stdio.h>
+
+// Tail calls between functions taking different numbers of arguments.
+// The recursion runs far deeper than any engine's call stack, so an engine
+// that does not reuse the frame fails instead of returning.
+
+#define DEPTH 100000
+
+// int two(int n, int acc){ if(n == 0) return acc; return three(n - 1, acc + 1, 2); }
+// int three(int n, int acc, int k){ if(n == 0) return acc; return two(n - 1, acc + k); }
+static ASTNode *differentArities(void){
+    return block(2,
+        function("two", 2, "n", "acc", block(2,
+            ifElse(binary(name("n"), EQU_BINOP, integer(0)), returns(name("acc")), NULL),
+            returns(call("three", 3, binary(name("n"), SUB_BINOP, integer(1)), binary(name("acc"), ADD_BINOP, integer(1)), integer(2))))),
+        function("three", 3, "n", "acc", "k", block(2,
+            ifElse(binary(name("n"), EQU_BINOP, integer(0)), returns(name("acc")), NULL),
+            returns(call("two", 2, binary(name("n"), SUB_BINOP, integer(1)), binary(name("acc"), ADD_BINOP, name("k")))))));
+}
+
+static void mutualRecursion(void){
+    ASTNode *program = differentArities();
+    TailCallStats stats;
+    program = eliminateTailCalls(program, &stats);
+    char detail[96];
+    snprintf(detail, sizeof(detail), "%d tail calls marked, expected 2", stats.tailCallsMarked);
+    expectThat("mutual recursion of different arities", stats.tailCallsMarked == 2, detail);
+
+    // every engine gets the marked program; half the steps add 1, half 2
+    long long args[] = {DEPTH, 0};
+    expectOnEveryEngine("mutual recursion of different arities", program, NULL, "two", args, 2, DEPTH / 2 * 3);
+    long long odd[] = {DEPTH + 1, 0};
+    expectOnEveryEngine("mutual recursion of different arities, odd depth", program, NULL, "two", odd, 2, DEPTH / 2 * 3 + 1);
+
+    // and the evaluator counts each of them as a tail call
+    Evaluator *e = createEvaluator(program, NULL);
+    Value values[2] = {
+        makePrimitiveValue(TYPE_INT, primitiveFromLongLong(TYPE_INT, DEPTH)),
+        makePrimitiveValue(TYPE_INT, primitiveFromLongLong(TYPE_INT, 0))
+    };
+    Value result;
+    bool ok = e && runProgram(e, &result) && callFunction(e, "two", values, 2, &result);
+    snprintf(detail, sizeof(detail), "%lld tail calls, expected %d", ok ? evalStats(e)->tailCalls : -1, DEPTH);
+    expectThat("mutual recursion of different arities", ok && evalStats(e)->tailCalls == DEPTH, detail);
+    freeEvaluator(e);
+    freeAST(program);
+}
+
+int main(void){
+    mutualRecursion();
+    return finishTests();
+}
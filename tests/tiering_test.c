@@ -0,0 +1,63 @@
+#include "backend.h"
+#include "builders.h"
+#include "harness.h"
+#include "jit.h"
+#include "primitive.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The tiered backend with low thresholds: the log must show the tier-up
+// and the on-stack replacement, and the results must not change with them.
+
+// int step(int x){ return x * 3 + 1 & 1023; }
+// int f(int n){ int s = 0; for(int i = 0; i < n; i++) s = s + step(i) & 65535; return s; }
+static ASTNode *hotProgram(void){
+    return block(2,
+        function("step", 1, "x", block(1,
+            returns(binary(binary(binary(name("x"), MUL_BINOP, integer(3)), ADD_BINOP, integer(1)), BIT_AND_BINOP, integer(1023))))),
+        function("f", 1, "n", block(3,
+            declare("int", "s", integer(0)),
+            forLoop(declare("int", "i", integer(0)), binary(name("i"), LESS_BINOP, name("n")), increment("i"),
+                block(1, assign(name("s"), binary(binary(name("s"), ADD_BINOP, call("step", 1, name("i"))), BIT_AND_BINOP, integer(65535))))),
+            returns(name("s")))));
+}
+
+static void tierUpIsLogged(void){
+    ASTNode *program = hotProgram();
+    long long n = 1000;
+    // the reference value, from every engine at the default thresholds
+    expectOnEveryEngine("hot loop and callee", program, NULL, "f", &n, 1, 41324);
+    if(!jitSupported()){
+        freeAST(program);
+        return;
+    }
+
+    char *logText = NULL;
+    size_t logSize = 0;
+    FILE *log = open_memstream(&logText, &logSize);
+    EngineOptions options = {.callThreshold = 10, .loopThreshold = 100, .tierLog = log};
+    char error[256] = "";
+    Engine *engine = createEngineWithOptions(program, BACKEND_TIERED, &options, error, sizeof(error));
+    Value arg = makePrimitiveValue(TYPE_INT, primitiveFromLongLong(TYPE_INT, n));
+    Value result;
+    long long value = -1;
+    bool ok = engine && runEngine(engine, &result) && callEngine(engine, "f", &arg, 1, &result) &&
+              primitiveToLongLong(result.type, result.as.primitive, &value);
+    if(engine && !ok) snprintf(error, sizeof(error), "%s", engineError(engine));
+    fclose(log);
+
+    char detail[300];
+    snprintf(detail, sizeof(detail), "returned %lld, %s", value, ok ? "expected 41324" : error);
+    expectThat("tiered with low thresholds", ok && value == 41324, detail);
+    expectThat("tiered with low thresholds", strstr(logText, "tier-up step after 10 calls") != NULL, logText);
+    expectThat("tiered with low thresholds", strstr(logText, "on-stack replacement of f") != NULL, logText);
+    freeEngine(engine);
+    free(logText);
+    freeAST(program);
+}
+
+int main(void){
+    tierUpIsLogged();
+    return finishTests();
+}
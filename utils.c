@@ -1,7 +1,9 @@
 #include "utils.h"
+#include "primitive.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 char *readFile(const char *filename){
     FILE *fptr = fopen(filename, "rb");
@@ -22,4 +24,208 @@ char *readFile(const char *filename){
 
     fclose(fptr);
     return buffer;
-}
\ No newline at end of file
+}
+
+bool growArray(void *array, int count, int *capacity, size_t elementSize){
+    if(count < *capacity) return true;
+
+    // array points at the caller's pointer, whatever its element type
+    void *old;
+    memcpy(&old, array, sizeof(old));
+    int newCapacity = *capacity ? *capacity * 2 : 8;
+    void *grown = realloc(old, newCapacity * elementSize);
+    if(!grown) return false;
+    memcpy(array, &grown, sizeof(grown));
+    *capacity = newCapacity;
+    return true;
+}
+
+void initTypeScope(TypeScope *scope){
+    scope->symbols = NULL;
+    scope->count = 0;
+    scope->capacity = 0;
+}
+
+void freeTypeScope(TypeScope *scope){
+    free(scope->symbols);
+    initTypeScope(scope);
+}
+
+int enterTypeScope(TypeScope *scope){
+    return scope->count;
+}
+
+void leaveTypeScope(TypeScope *scope, int mark){
+    scope->count = mark;
+}
+
+void declareSymbol(TypeScope *scope, ASTNode *declaration){
+    if(!declaration || declaration->type != DECLARATION_NODE) return;
+
+    if(scope->count == scope->capacity){
+        int capacity = scope->capacity ? scope->capacity * 2 : 16;
+        ScopedSymbol *symbols = realloc(scope->symbols, capacity * sizeof(ScopedSymbol));
+        if(!symbols) return;
+        scope->symbols = symbols;
+        scope->capacity = capacity;
+    }
+
+    ScopedSymbol *symbol = &scope->symbols[scope->count++];
+    symbol->name = declaration->declaration.varName;
+    symbol->isKnown = typeNodeToPrimitive(declaration->declaration.varType, &symbol->type);
+}
+
+bool lookupSymbolType(TypeScope *scope, const char *name, PrimitiveType *out){
+    for(int i = scope->count - 1; i >= 0; i--){
+        if(strcmp(scope->symbols[i].name, name) == 0){
+            if(!scope->symbols[i].isKnown) return false;
+            *out = scope->symbols[i].type;
+            return true;
+        }
+    }
+    return false;
+}
+
+void initNameSet(NameSet *set){
+    set->names = NULL;
+    set->count = 0;
+    set->capacity = 0;
+}
+
+void freeNameSet(NameSet *set){
+    for(int i = 0; i < set->count; i++){
+        free(set->names[i]);
+    }
+    free(set->names);
+    initNameSet(set);
+}
+
+bool addName(NameSet *set, const char *name){
+    if(hasName(set, name)) return true;
+
+    if(set->count == set->capacity){
+        int capacity = set->capacity ? set->capacity * 2 : 8;
+        char **names = realloc(set->names, capacity * sizeof(char *));
+        if(!names) return false;
+        set->names = names;
+        set->capacity = capacity;
+    }
+
+    char *copy = strdup(name);
+    if(!copy) return false;
+    set->names[set->count++] = copy;
+    return true;
+}
+
+bool hasName(NameSet *set, const char *name){
+    for(int i = 0; i < set->count; i++){
+        if(strcmp(set->names[i], name) == 0) return true;
+    }
+    return false;
+}
+
+bool isPureExpression(ASTNode *expr){
+    if(!expr) return true;
+
+    switch(expr->type){
+        case IDENTIFIER_NODE:
+        case LITERAL_NODE:
+        case NULL_NODE:
+        case SIZEOF_NODE:
+        case TYPEOF_NODE:
+        case LAMBDA_NODE:
+            return true;
+        case UNARY_OPERATION_NODE:
+            switch(expr->unaryOp.op){
+                case PRE_INCREMENT_UNOP:
+                case POST_INCREMENT_UNOP:
+                case PRE_DECREMENT_UNOP:
+                case POST_DECREMENT_UNOP:
+                    return false;
+                default:
+                    return isPureExpression(expr->unaryOp.expr);
+            }
+        case BINARY_OPERATION_NODE:
+            if(expr->binaryOp.op == DIV_BINOP || expr->binaryOp.op == MOD_BINOP){
+                ASTNode *divisor = expr->binaryOp.right;
+                if(divisor->type != LITERAL_NODE || primitiveEquals(divisor->literal.type, divisor->literal.value, 0)) return false;
+            }
+            return isPureExpression(expr->binaryOp.left) && isPureExpression(expr->binaryOp.right);
+        case TERNARY_OPERATION_NODE:
+            return isPureExpression(expr->ternaryOp.condition) && isPureExpression(expr->ternaryOp.trueExpr) && isPureExpression(expr->ternaryOp.falseExpr);
+        case ARRAY_ACCESS_NODE:
+            return isPureExpression(expr->arrayAccess.array) && isPureExpression(expr->arrayAccess.index);
+        case FIELD_ACCESS_NODE:
+            return isPureExpression(expr->fieldAccess.object);
+        case CAST_EXPR_NODE:
+            return isPureExpression(expr->castExpr.value);
+        default:
+            return false;
+    }
+}
+
+bool isBooleanExpression(ASTNode *expr){
+    if(!expr) return false;
+
+    switch(expr->type){
+        case LITERAL_NODE:
+            return expr->literal.type == TYPE_BOOL;
+        case UNARY_OPERATION_NODE:
+            return expr->unaryOp.op == NOT_UNOP;
+        case BINARY_OPERATION_NODE:
+            return isComparisonOp(expr->binaryOp.op);
+        default:
+            return false;
+    }
+}
+
+bool inferExpressionType(ASTNode *expr, TypeScope *scope, PrimitiveType *out){
+    if(!expr) return false;
+
+    PrimitiveType left, right;
+    switch(expr->type){
+        case LITERAL_NODE:
+            *out = expr->literal.type;
+            return true;
+        case IDENTIFIER_NODE:
+            return scope && lookupSymbolType(scope, expr->identifier.name, out);
+        case CAST_EXPR_NODE:
+            return typeNodeToPrimitive(expr->castExpr.targetType, out);
+        case ASSIGNMENT_NODE:
+            return inferExpressionType(expr->assignment.left, scope, out);
+        case UNARY_OPERATION_NODE:
+            switch(expr->unaryOp.op){
+                case NOT_UNOP:
+                    *out = TYPE_BOOL;
+                    return true;
+                case DEFERENCE_UNOP:
+                case ADDRESS_OF_UNOP:
+                    return false;
+                case SIZE_OF_UNOP:
+                    *out = TYPE_UNSIGNED_ARCH;
+                    return true;
+                default:
+                    return inferExpressionType(expr->unaryOp.expr, scope, out);
+            }
+        case BINARY_OPERATION_NODE:
+            if(isComparisonOp(expr->binaryOp.op)){
+                *out = TYPE_BOOL;
+                return true;
+            }
+            if(!inferExpressionType(expr->binaryOp.left, scope, &left)) return false;
+            if(!inferExpressionType(expr->binaryOp.right, scope, &right)) return false;
+            *out = binaryResultType(expr->binaryOp.op, left, right);
+            return true;
+        case TERNARY_OPERATION_NODE:
+            if(!inferExpressionType(expr->ternaryOp.trueExpr, scope, &left)) return false;
+            if(!inferExpressionType(expr->ternaryOp.falseExpr, scope, &right)) return false;
+            if(left != right) return false;
+            *out = left;
+            return true;
+        case SIZEOF_NODE:
+            *out = TYPE_UNSIGNED_ARCH;
+            return true;
+        default:
+            return false;
+    }
+}
@@ -2,7 +2,48 @@
 #define UTILS_H
 
 #include "ast.h"
+#include <stddef.h>
+
+typedef struct {
+    const char *name;
+    PrimitiveType type;
+    bool isKnown;
+} ScopedSymbol;
+
+typedef struct {
+    ScopedSymbol *symbols;
+    int count;
+    int capacity;
+} TypeScope;
+
+typedef struct {
+    char **names;
+    int count;
+    int capacity;
+} NameSet;
 
 char *readFile(const char *filename);
 
-#endif
\ No newline at end of file
+// Makes room for array[count], doubling capacity (from 8) once count has
+// reached it. False when out of memory, leaving array and capacity as they
+// were, so callers report the failure their own way.
+#define GROW(array, count, capacity) growArray(&(array), (count), &(capacity), sizeof(*(array)))
+bool growArray(void *array, int count, int *capacity, size_t elementSize);
+
+void initTypeScope(TypeScope *scope);
+void freeTypeScope(TypeScope *scope);
+int enterTypeScope(TypeScope *scope);
+void leaveTypeScope(TypeScope *scope, int mark);
+void declareSymbol(TypeScope *scope, ASTNode *declaration);
+bool lookupSymbolType(TypeScope *scope, const char *name, PrimitiveType *out);
+
+void initNameSet(NameSet *set);
+void freeNameSet(NameSet *set);
+bool addName(NameSet *set, const char *name);
+bool hasName(NameSet *set, const char *name);
+
+bool isPureExpression(ASTNode *expr);
+bool isBooleanExpression(ASTNode *expr);
+bool inferExpressionType(ASTNode *expr, TypeScope *scope, PrimitiveType *out);
+
+#endif
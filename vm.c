@@ -0,0 +1,748 @@
+#include "vm.h"
+#include "atomics.h"
+#include "pool.h"
+#include "primitive.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+typedef struct {
+    const BytecodeFunction *function;
+    const uint8_t *ip;          // where the caller resumes
+    VMValue *base;
+} VMFrame;
+
+struct VM {
+    const BytecodeModule *module;
+    VMOptions options;
+    VMValue *stack;
+    VMFrame *frames;
+    VMValue *globals;
+    VMStats stats;
+    WorkPool *pool;             // started by the first parallel loop
+    struct VM **workers;        // one per pool worker, each running chunks on its own stack
+    int workerCount;
+    bool isWorker;              // shares the globals of the VM that started it
+    char error[256];
+};
+
+VMOptions defaultVMOptions(void){
+    VMOptions options;
+    options.stackSlots = 1 << 20;
+    options.maxCallDepth = 100000;
+    options.out = stdout;
+    options.threads = 0;
+    return options;
+}
+
+VM *createVM(const BytecodeModule *module, const VMOptions *options){
+    VM *vm = calloc(1, sizeof(VM));
+    if(!vm) return NULL;
+
+    vm->module = module;
+    vm->options = options ? *options : defaultVMOptions();
+    if(!vm->options.out) vm->options.out = stdout;
+    vm->stack = calloc(vm->options.stackSlots > 0 ? vm->options.stackSlots : 1, sizeof(VMValue));
+    vm->frames = calloc(vm->options.maxCallDepth > 0 ? vm->options.maxCallDepth : 1, sizeof(VMFrame));
+    vm->globals = calloc(module->globalSlots > 0 ? module->globalSlots : 1, sizeof(VMValue));
+    if(!vm->stack || !vm->frames || !vm->globals){
+        freeVM(vm);
+        return NULL;
+    }
+    return vm;
+}
+
+void freeVM(VM *vm){
+    if(!vm) return;
+    freeWorkPool(vm->pool);
+    for(int i = 0; i < vm->workerCount; i++) freeVM(vm->workers[i]);
+    free(vm->workers);
+    free(vm->stack);
+    free(vm->frames);
+    if(!vm->isWorker) free(vm->globals);
+    free(vm);
+}
+
+const char *vmError(VM *vm){
+    return vm->error[0] ? vm->error : NULL;
+}
+
+const VMStats *vmStats(VM *vm){
+    return &vm->stats;
+}
+
+static bool vmFail(VM *vm, const BytecodeFunction *fn, const char *format, ...){
+    va_list args;
+    va_start(args, format);
+    int length = snprintf(vm->error, sizeof(vm->error), "%s: ", fn->name);
+    if(length < 0 || length >= (int)sizeof(vm->error)) length = 0;
+    vsnprintf(vm->error + length, sizeof(vm->error) - length, format, args);
+    va_end(args);
+    return false;
+}
+
+static Value toValue(PrimitiveType type, VMValue v){
+    return makePrimitiveValue(type, vmValueToPrimitive(type, v));
+}
+
+#define READ_U8() (ip += 1, ip[-1])
+#define READ_U16() (ip += 2, (uint16_t)(ip[-2] | ip[-1] << 8))
+#define READ_U32() (ip += 4, (uint32_t)ip[-4] | (uint32_t)ip[-3] << 8 | (uint32_t)ip[-2] << 16 | (uint32_t)ip[-1] << 24)
+#define READ_I32() ((int32_t)READ_U32())
+
+#ifdef VM_COMPUTED_GOTO
+#define TARGET(name) TARGET_##name:
+#define NEXT() goto *dispatch[*ip++]
+#else
+#define TARGET(name) case OP_##name:
+#define NEXT() continue
+#endif
+
+#define BINARY_INT(expr) do { int64_t b = (--sp)->i; int64_t a = sp[-1].i; sp[-1].i = (expr); } while(0)
+#define BINARY_UINT(expr) do { uint64_t b = (--sp)->u; uint64_t a = sp[-1].u; sp[-1].u = (expr); } while(0)
+#define BINARY_FLOAT(expr) do { double b = (--sp)->f; double a = sp[-1].f; sp[-1].f = (expr); } while(0)
+#define COMPARE_INT(op) do { int64_t b = (--sp)->i; sp[-1].i = sp[-1].i op b; } while(0)
+#define COMPARE_UINT(op) do { uint64_t b = (--sp)->u; sp[-1].i = sp[-1].u op b; } while(0)
+#define COMPARE_FLOAT(op) do { double b = (--sp)->f; sp[-1].i = sp[-1].f op b; } while(0)
+
+static bool runParallel(VM *vm, const BytecodeFunction *fn, const VMValue *base, int function, int64_t start, int64_t end);
+
+// Runs a function whose arguments are already at the bottom of the stack.
+static bool execute(VM *vm, int index, Value *result){
+    const BytecodeModule *module = vm->module;
+    const BytecodeFunction *fn = &module->functions[index];
+    const BytecodeConstant *constants = module->constants;
+    VMValue *globals = vm->globals;
+    VMValue *stackEnd = vm->stack + vm->options.stackSlots;
+    VMFrame *frames = vm->frames;
+    int frameCount = 0;
+
+    VMValue *base = vm->stack;
+    if(base + fn->localCount + fn->maxStack > stackEnd) return vmFail(vm, fn, "VM stack overflow");
+    memset(base + fn->paramCount, 0, (size_t)(fn->localCount - fn->paramCount) * sizeof(VMValue));
+    VMValue *sp = base + fn->localCount;
+    const uint8_t *ip = fn->code;
+
+#ifdef VM_COMPUTED_GOTO
+#define DISPATCH_LABEL(name, operands, pops, pushes) &&TARGET_##name,
+    static void *const dispatch[OP_COUNT] = {
+        BYTECODE_OPS(DISPATCH_LABEL)
+    };
+#undef DISPATCH_LABEL
+    NEXT();
+#else
+    for(;;) switch(*ip++){
+#endif
+
+    TARGET(CONST){
+        *sp++ = constants[READ_U16()].value;
+        NEXT();
+    }
+    TARGET(LOAD){
+        *sp++ = base[READ_U16()];
+        NEXT();
+    }
+    TARGET(STORE){
+        base[READ_U16()] = sp[-1];
+        NEXT();
+    }
+    TARGET(STORE_POP){
+        base[READ_U16()] = *--sp;
+        NEXT();
+    }
+    TARGET(LOAD_GLOBAL){
+        *sp++ = globals[READ_U16()];
+        NEXT();
+    }
+    TARGET(STORE_GLOBAL){
+        globals[READ_U16()] = sp[-1];
+        NEXT();
+    }
+    TARGET(STORE_GLOBAL_POP){
+        globals[READ_U16()] = *--sp;
+        NEXT();
+    }
+    TARGET(LOAD_INDEXED){
+        int slot = READ_U16();
+        sp[-1] = base[slot + sp[-1].i];
+        NEXT();
+    }
+    TARGET(STORE_INDEXED){
+        int slot = READ_U16();
+        VMValue value = *--sp;
+        base[slot + sp[-1].i] = value;
+        sp[-1] = value;
+        NEXT();
+    }
+    TARGET(STORE_INDEXED_POP){
+        int slot = READ_U16();
+        sp -= 2;
+        base[slot + sp[0].i] = sp[1];
+        NEXT();
+    }
+    TARGET(LOAD_GLOBAL_INDEXED){
+        int slot = READ_U16();
+        sp[-1] = globals[slot + sp[-1].i];
+        NEXT();
+    }
+    TARGET(STORE_GLOBAL_INDEXED){
+        int slot = READ_U16();
+        VMValue value = *--sp;
+        globals[slot + sp[-1].i] = value;
+        sp[-1] = value;
+        NEXT();
+    }
+    TARGET(STORE_GLOBAL_INDEXED_POP){
+        int slot = READ_U16();
+        sp -= 2;
+        globals[slot + sp[0].i] = sp[1];
+        NEXT();
+    }
+    TARGET(ATOMIC_LOAD){
+        *sp++ = atomicLoad(&globals[READ_U16()]);
+        NEXT();
+    }
+    TARGET(ATOMIC_STORE){
+        atomicStore(&globals[READ_U16()], sp[-1]);
+        NEXT();
+    }
+    TARGET(ATOMIC_LOAD_INDEXED){
+        int slot = READ_U16();
+        sp[-1] = atomicLoad(&globals[slot + sp[-1].i]);
+        NEXT();
+    }
+    TARGET(ATOMIC_STORE_INDEXED){
+        int slot = READ_U16();
+        VMValue value = *--sp;
+        atomicStore(&globals[slot + sp[-1].i], value);
+        sp[-1] = value;
+        NEXT();
+    }
+    TARGET(ATOMIC_UPDATE){
+        int slot = READ_U16();
+        int operation = READ_U16();
+        AtomicStatus status = atomicUpdate(&globals[slot], (uint8_t)operation, sp[-1], &sp[-1]);
+        if(status != ATOMIC_OK) return vmFail(vm, fn, "%s", atomicStatusMessage(status));
+        NEXT();
+    }
+    TARGET(ATOMIC_UPDATE_INDEXED){
+        int slot = READ_U16();
+        int operation = READ_U16();
+        sp--;
+        AtomicStatus status = atomicUpdate(&globals[slot + sp[-1].i], (uint8_t)operation, sp[0], &sp[-1]);
+        if(status != ATOMIC_OK) return vmFail(vm, fn, "%s", atomicStatusMessage(status));
+        NEXT();
+    }
+    TARGET(CHECK_INDEX){
+        uint32_t length = READ_U32();
+        if(sp[-1].u >= length) return vmFail(vm, fn, "index %lld out of bounds for length %u", (long long)sp[-1].i, length);
+        NEXT();
+    }
+    TARGET(CLEAR){
+        int slot = READ_U16();
+        int count = READ_U16();
+        memset(base + slot, 0, (size_t)count * sizeof(VMValue));
+        NEXT();
+    }
+    TARGET(POP){
+        sp--;
+        NEXT();
+    }
+    TARGET(DUP){
+        sp[0] = sp[-1];
+        sp++;
+        NEXT();
+    }
+    TARGET(SWAP){
+        VMValue top = sp[-1];
+        sp[-1] = sp[-2];
+        sp[-2] = top;
+        NEXT();
+    }
+    TARGET(ADD_I32){
+        BINARY_INT((int32_t)(uint32_t)((uint64_t)a + (uint64_t)b));
+        NEXT();
+    }
+    TARGET(SUB_I32){
+        BINARY_INT((int32_t)(uint32_t)((uint64_t)a - (uint64_t)b));
+        NEXT();
+    }
+    TARGET(MUL_I32){
+        BINARY_INT((int32_t)(uint32_t)((uint64_t)a * (uint64_t)b));
+        NEXT();
+    }
+    TARGET(NEG_I32){
+        sp[-1].i = (int32_t)(uint32_t)(0 - sp[-1].u);
+        NEXT();
+    }
+    TARGET(ADD_I64){
+        BINARY_UINT(a + b);
+        NEXT();
+    }
+    TARGET(SUB_I64){
+        BINARY_UINT(a - b);
+        NEXT();
+    }
+    TARGET(MUL_I64){
+        BINARY_UINT(a * b);
+        NEXT();
+    }
+    TARGET(NEG_I64){
+        sp[-1].u = 0 - sp[-1].u;
+        NEXT();
+    }
+    TARGET(DIV_I){
+        if(sp[-1].i == 0) return vmFail(vm, fn, "division by zero");
+        // MIN / -1 wraps to MIN as the evaluator's handlers do
+        BINARY_INT(b == -1 ? (int64_t)(0 - (uint64_t)a) : a / b);
+        NEXT();
+    }
+    TARGET(MOD_I){
+        if(sp[-1].i == 0) return vmFail(vm, fn, "division by zero");
+        BINARY_INT(b == -1 ? 0 : a % b);
+        NEXT();
+    }
+    TARGET(DIV_U){
+        if(sp[-1].u == 0) return vmFail(vm, fn, "division by zero");
+        BINARY_UINT(a / b);
+        NEXT();
+    }
+    TARGET(MOD_U){
+        if(sp[-1].u == 0) return vmFail(vm, fn, "division by zero");
+        BINARY_UINT(a % b);
+        NEXT();
+    }
+    TARGET(ADD_F){
+        BINARY_FLOAT(a + b);
+        NEXT();
+    }
+    TARGET(SUB_F){
+        BINARY_FLOAT(a - b);
+        NEXT();
+    }
+    TARGET(MUL_F){
+        BINARY_FLOAT(a * b);
+        NEXT();
+    }
+    TARGET(DIV_F){
+        if(sp[-1].f == 0.0) return vmFail(vm, fn, "division by zero");
+        BINARY_FLOAT(a / b);
+        NEXT();
+    }
+    TARGET(NEG_F){
+        sp[-1].f = -sp[-1].f;
+        NEXT();
+    }
+    TARGET(BIT_AND){
+        BINARY_UINT(a & b);
+        NEXT();
+    }
+    TARGET(BIT_OR){
+        BINARY_UINT(a | b);
+        NEXT();
+    }
+    TARGET(BIT_XOR){
+        BINARY_UINT(a ^ b);
+        NEXT();
+    }
+    TARGET(BIT_NOT){
+        sp[-1].u = ~sp[-1].u;
+        NEXT();
+    }
+    TARGET(SHL){
+        int width = READ_U8();
+        if(sp[-1].i < 0 || sp[-1].i >= width) return vmFail(vm, fn, "invalid shift count");
+        BINARY_UINT(a << b);
+        NEXT();
+    }
+    TARGET(SHR_I){
+        int width = READ_U8();
+        if(sp[-1].i < 0 || sp[-1].i >= width) return vmFail(vm, fn, "invalid shift count");
+        BINARY_INT(a >> b);
+        NEXT();
+    }
+    TARGET(SHR_U){
+        int width = READ_U8();
+        if(sp[-1].i < 0 || sp[-1].i >= width) return vmFail(vm, fn, "invalid shift count");
+        BINARY_UINT(a >> b);
+        NEXT();
+    }
+    TARGET(NOT){
+        sp[-1].i = sp[-1].i == 0;
+        NEXT();
+    }
+    TARGET(NOT_F){
+        sp[-1].i = sp[-1].f == 0.0;
+        NEXT();
+    }
+    TARGET(EQ_I){
+        COMPARE_INT(==);
+        NEXT();
+    }
+    TARGET(NE_I){
+        COMPARE_INT(!=);
+        NEXT();
+    }
+    TARGET(LT_I){
+        COMPARE_INT(<);
+        NEXT();
+    }
+    TARGET(LE_I){
+        COMPARE_INT(<=);
+        NEXT();
+    }
+    TARGET(GT_I){
+        COMPARE_INT(>);
+        NEXT();
+    }
+    TARGET(GE_I){
+        COMPARE_INT(>=);
+        NEXT();
+    }
+    TARGET(LT_U){
+        COMPARE_UINT(<);
+        NEXT();
+    }
+    TARGET(LE_U){
+        COMPARE_UINT(<=);
+        NEXT();
+    }
+    TARGET(GT_U){
+        COMPARE_UINT(>);
+        NEXT();
+    }
+    TARGET(GE_U){
+        COMPARE_UINT(>=);
+        NEXT();
+    }
+    TARGET(EQ_F){
+        COMPARE_FLOAT(==);
+        NEXT();
+    }
+    TARGET(NE_F){
+        COMPARE_FLOAT(!=);
+        NEXT();
+    }
+    TARGET(LT_F){
+        COMPARE_FLOAT(<);
+        NEXT();
+    }
+    TARGET(LE_F){
+        COMPARE_FLOAT(<=);
+        NEXT();
+    }
+    TARGET(GT_F){
+        COMPARE_FLOAT(>);
+        NEXT();
+    }
+    TARGET(GE_F){
+        COMPARE_FLOAT(>=);
+        NEXT();
+    }
+    TARGET(WRAP_I8){
+        sp[-1].i = (int8_t)sp[-1].u;
+        NEXT();
+    }
+    TARGET(WRAP_U8){
+        sp[-1].u = (uint8_t)sp[-1].u;
+        NEXT();
+    }
+    TARGET(WRAP_I16){
+        sp[-1].i = (int16_t)sp[-1].u;
+        NEXT();
+    }
+    TARGET(WRAP_U16){
+        sp[-1].u = (uint16_t)sp[-1].u;
+        NEXT();
+    }
+    TARGET(WRAP_I32){
+        sp[-1].i = (int32_t)sp[-1].u;
+        NEXT();
+    }
+    TARGET(WRAP_U32){
+        sp[-1].u = (uint32_t)sp[-1].u;
+        NEXT();
+    }
+    TARGET(TO_BOOL){
+        sp[-1].i = sp[-1].i != 0;
+        NEXT();
+    }
+    TARGET(TO_BOOL_F){
+        sp[-1].i = sp[-1].f != 0.0;
+        NEXT();
+    }
+    TARGET(I2F){
+        sp[-1].f = (double)sp[-1].i;
+        NEXT();
+    }
+    TARGET(U2F){
+        sp[-1].f = (double)sp[-1].u;
+        NEXT();
+    }
+    TARGET(F2I){
+        PrimitiveType type = READ_U8();
+        PrimitiveValue value;
+        value.doubleVal = sp[-1].f;
+        sp[-1] = primitiveToVMValue(type, convertPrimitive(TYPE_DOUBLE, value, type));
+        NEXT();
+    }
+    TARGET(FROUND){
+        sp[-1].f = (float)sp[-1].f;
+        NEXT();
+    }
+    TARGET(JUMP){
+        int32_t offset = READ_I32();
+        ip += offset;
+        NEXT();
+    }
+    TARGET(JUMP_IF_FALSE){
+        int32_t offset = READ_I32();
+        if((--sp)->i == 0) ip += offset;
+        NEXT();
+    }
+    TARGET(JUMP_IF_TRUE){
+        int32_t offset = READ_I32();
+        if((--sp)->i != 0) ip += offset;
+        NEXT();
+    }
+    TARGET(CALL){
+        const BytecodeFunction *callee = &module->functions[READ_U16()];
+        VMValue *callBase = sp - callee->paramCount;
+        if(frameCount == vm->options.maxCallDepth) return vmFail(vm, fn, "maximum call depth of %d exceeded", vm->options.maxCallDepth);
+        if(callBase + callee->localCount + callee->maxStack > stackEnd) return vmFail(vm, fn, "VM stack overflow calling %s", callee->name);
+
+        frames[frameCount++] = (VMFrame){fn, ip, base};
+        vm->stats.calls++;
+        memset(sp, 0, (size_t)(callee->localCount - callee->paramCount) * sizeof(VMValue));
+        fn = callee;
+        base = callBase;
+        sp = base + fn->localCount;
+        ip = fn->code;
+        NEXT();
+    }
+    TARGET(TAILCALL){
+        const BytecodeFunction *callee = &module->functions[READ_U16()];
+        if(base + callee->localCount + callee->maxStack > stackEnd) return vmFail(vm, fn, "VM stack overflow calling %s", callee->name);
+
+        vm->stats.calls++;
+        vm->stats.tailCalls++;
+        memmove(base, sp - callee->paramCount, (size_t)callee->paramCount * sizeof(VMValue));
+        memset(base + callee->paramCount, 0, (size_t)(callee->localCount - callee->paramCount) * sizeof(VMValue));
+        fn = callee;
+        sp = base + fn->localCount;
+        ip = fn->code;
+        NEXT();
+    }
+    TARGET(RETURN){
+        VMValue value = sp[-1];
+        if(frameCount == 0){
+            if(result) *result = toValue(fn->returnType, value);
+            return true;
+        }
+        VMFrame *frame = &frames[--frameCount];
+        sp = base;
+        *sp++ = value;
+        fn = frame->function;
+        ip = frame->ip;
+        base = frame->base;
+        NEXT();
+    }
+    TARGET(RETURN_VOID){
+        if(frameCount == 0){
+            if(result) result->kind = VALUE_VOID;
+            return true;
+        }
+        VMFrame *frame = &frames[--frameCount];
+        sp = base;
+        fn = frame->function;
+        ip = frame->ip;
+        base = frame->base;
+        NEXT();
+    }
+    TARGET(THROW){
+        PrimitiveType type = READ_U8();
+        VMValue exception = *--sp;
+        const BytecodeFunction *thrower = fn;
+        const BytecodeHandler *handler;
+        vm->stats.throws++;
+        // a caller resumes after its call, so the byte before ip is inside it
+        while(!(handler = findBytecodeHandler(fn, (int)(ip - fn->code) - 1, type))){
+            if(frameCount == 0) return vmFail(vm, thrower, "uncaught exception of type %s", primitiveTypeName(type));
+            VMFrame *frame = &frames[--frameCount];
+            fn = frame->function;
+            ip = frame->ip;
+            base = frame->base;
+            vm->stats.unwoundFrames++;
+        }
+        sp = base + fn->localCount;
+        *sp++ = exception;
+        ip = fn->code + handler->target;
+        NEXT();
+    }
+    TARGET(PARALLEL_FOR){
+        int function = READ_U16();
+        sp -= 2;
+        if(!runParallel(vm, fn, base, function, sp[0].i, sp[1].i)) return false;
+        NEXT();
+    }
+    TARGET(PRINT){
+        int count = READ_U8();
+        const uint8_t *types = ip;
+        ip += count;
+        sp -= count;
+        for(int i = 0; i < count; i++){
+            Value value = toValue(types[i], sp[i]);
+            if(i > 0) fputc(' ', vm->options.out);
+            printValue(&value, vm->options.out);
+        }
+        fputc('\n', vm->options.out);
+        NEXT();
+    }
+
+#ifndef VM_COMPUTED_GOTO
+        default:
+            return vmFail(vm, fn, "invalid opcode %d", ip[-1]);
+    }
+#endif
+}
+
+static void resetRun(VM *vm){
+    vm->error[0] = '\0';
+    memset(&vm->stats, 0, sizeof(vm->stats));
+}
+
+// Parallel loops
+
+static VM *createWorker(VM *vm){
+    VM *worker = calloc(1, sizeof(VM));
+    if(!worker) return NULL;
+    worker->module = vm->module;
+    worker->options = vm->options;
+    worker->globals = vm->globals;
+    worker->isWorker = true;
+    worker->stack = calloc(vm->options.stackSlots > 0 ? vm->options.stackSlots : 1, sizeof(VMValue));
+    worker->frames = calloc(vm->options.maxCallDepth > 0 ? vm->options.maxCallDepth : 1, sizeof(VMFrame));
+    if(!worker->stack || !worker->frames){
+        freeVM(worker);
+        return NULL;
+    }
+    return worker;
+}
+
+// A worker runs the loops nested in its chunks by itself, on one more VM.
+static bool startWorkers(VM *vm){
+    if(vm->workers) return true;
+    int count = 1;
+    if(!vm->isWorker){
+        vm->pool = createWorkPool(vm->options.threads);
+        if(!vm->pool) return false;
+        count = workPoolSize(vm->pool);
+    }
+    VM **workers = calloc(count, sizeof(VM *));
+    bool ok = workers != NULL;
+    for(int i = 0; ok && i < count; i++){
+        workers[i] = createWorker(vm);
+        ok = workers[i] != NULL;
+    }
+    if(!ok){
+        for(int i = 0; workers && i < count; i++) freeVM(workers[i]);
+        free(workers);
+        return false;
+    }
+    vm->workers = workers;
+    vm->workerCount = count;
+    return true;
+}
+
+typedef struct {
+    VM *vm;
+    int function;
+    const VMValue *shared;      // the locals of the frame running the loop
+    int sharedCount;
+} ParallelLoop;
+
+static bool runChunk(int worker, int64_t lo, int64_t hi, void *ctx){
+    ParallelLoop *loop = ctx;
+    VM *vm = loop->vm->workers[worker];
+    memcpy(vm->stack, loop->shared, (size_t)loop->sharedCount * sizeof(VMValue));
+    vm->stack[loop->sharedCount].i = lo;
+    vm->stack[loop->sharedCount + 1].i = hi;
+    return execute(vm, loop->function, NULL);
+}
+
+static bool runParallel(VM *vm, const BytecodeFunction *fn, const VMValue *base, int function, int64_t start, int64_t end){
+    if(start >= end) return true;
+    if(!startWorkers(vm)) return vmFail(vm, fn, "cannot start the workers of a parallel loop");
+    ParallelLoop loop = {vm, function, base, vm->module->functions[function].paramCount - 2};
+    for(int i = 0; i < vm->workerCount; i++) resetRun(vm->workers[i]);
+
+    ParallelStats stats = {1, 0, -1};
+    bool ok;
+    if(vm->pool){
+        ok = parallelFor(vm->pool, start, end, runChunk, &loop, &stats);
+    } else{
+        ok = runChunk(0, start, end, &loop);
+        if(!ok) stats.failedWorker = 0;
+    }
+
+    for(int i = 0; i < vm->workerCount; i++){
+        const VMStats *s = &vm->workers[i]->stats;
+        vm->stats.calls += s->calls;
+        vm->stats.tailCalls += s->tailCalls;
+        vm->stats.throws += s->throws;
+        vm->stats.unwoundFrames += s->unwoundFrames;
+        vm->stats.parallelChunks += s->parallelChunks;
+        vm->stats.steals += s->steals;
+    }
+    vm->stats.parallelChunks += stats.chunks;
+    vm->stats.steals += stats.steals;
+    if(!ok) snprintf(vm->error, sizeof(vm->error), "%s", vm->workers[stats.failedWorker]->error);
+    return ok;
+}
+
+bool runVM(VM *vm, Value *result){
+    const BytecodeModule *module = vm->module;
+    resetRun(vm);
+    memset(vm->globals, 0, (size_t)module->globalSlots * sizeof(VMValue));
+
+    Value value;
+    if(!execute(vm, 0, &value)) return false;
+    if(value.kind == VALUE_VOID && module->mainFunction > 0 && !execute(vm, module->mainFunction, &value)) return false;
+    if(result) *result = value;
+    return true;
+}
+
+const VMValue *vmGlobals(VM *vm){
+    return vm->globals;
+}
+
+void restoreVMGlobals(VM *vm, const VMValue *globals){
+    memcpy(vm->globals, globals, (size_t)vm->module->globalSlots * sizeof(VMValue));
+}
+
+// Globals keep the values left by the last runVM.
+bool callVM(VM *vm, const char *name, const Value *args, int argCount, Value *result){
+    const BytecodeModule *module = vm->module;
+    resetRun(vm);
+    int index = findBytecodeFunction(module, name);
+    if(index < 0){
+        snprintf(vm->error, sizeof(vm->error), "no function named '%s'", name);
+        return false;
+    }
+
+    const BytecodeFunction *fn = &module->functions[index];
+    if(argCount != fn->paramCount) return vmFail(vm, fn, "expects %d arguments, got %d", fn->paramCount, argCount);
+    if(argCount > vm->options.stackSlots) return vmFail(vm, fn, "VM stack overflow");
+    for(int i = 0; i < argCount; i++){
+        PrimitiveType type = fn->paramTypes[i];
+        if(args[i].kind != VALUE_PRIMITIVE || (args[i].type == TYPE_STRING) != (type == TYPE_STRING)){
+            return vmFail(vm, fn, "argument %d is not convertible to %s", i + 1, primitiveTypeName(type));
+        }
+        vm->stack[i] = primitiveToVMValue(type, convertPrimitive(args[i].type, args[i].as.primitive, type));
+    }
+    return execute(vm, index, result);
+}
@@ -0,0 +1,41 @@
+#ifndef VM_H
+#define VM_H
+
+#include "bytecode.h"
+#include "eval.h"
+#include <stdio.h>
+
+typedef struct {
+    int stackSlots;             // values shared by the frames of all active calls
+    int maxCallDepth;
+    FILE *out;                  // where print writes
+    int threads;                // workers for parallel loops, 0 for one per core
+} VMOptions;
+
+typedef struct {
+    long long calls;
+    long long tailCalls;        // calls that reused the caller's frame
+    long long throws;
+    long long unwoundFrames;    // frames a throw left without finding a handler
+    long long parallelChunks;   // ranges of parallel loop iterations run as one call
+    long long steals;           // ranges a worker took from another's deque
+} VMStats;
+
+typedef struct VM VM;
+
+// The module must outlive the VM.
+VMOptions defaultVMOptions(void);
+VM *createVM(const BytecodeModule *module, const VMOptions *options);
+void freeVM(VM *vm);
+
+bool runVM(VM *vm, Value *result);
+bool callVM(VM *vm, const char *name, const Value *args, int argCount, Value *result);
+// The module's globalSlots values as the last run left them.
+const VMValue *vmGlobals(VM *vm);
+// Puts back globals a snapshot saved, so calls can follow without runVM.
+void restoreVMGlobals(VM *vm, const VMValue *globals);
+
+const char *vmError(VM *vm);
+const VMStats *vmStats(VM *vm);
+
+#endif